@@ -14,18 +14,74 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <assert.h>
-#include <bitset>
 #include <stdexcept>
 #include <stdint.h>
 
 #include "../log.hpp"
+#include "../math/qts.hpp"
+#include "../profiler.hpp"
 #include "../state.hpp"
-#include "../math/matrix.hpp"
 #include "anim.hpp"
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MORTAR_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MORTAR_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MORTAR_NEON
+#endif
+
 using namespace Mortar::Animation;
 
+// Just enough of each instruction set for the Hermite kernel, so it's written
+// once for every lane width
+#if defined(MORTAR_AVX)
+typedef __m256 Lanes;
+constexpr unsigned LANE_COUNT = 8;
+
+static inline Lanes loadLanes(const float *f) { return _mm256_loadu_ps(f); }
+static inline Lanes splatLanes(float f) { return _mm256_set1_ps(f); }
+static inline Lanes addLanes(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+static inline Lanes subLanes(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+static inline Lanes mulLanes(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+static inline void storeLanes(float *f, Lanes a) { _mm256_storeu_ps(f, a); }
+#elif defined(MORTAR_SSE)
+typedef __m128 Lanes;
+constexpr unsigned LANE_COUNT = 4;
+
+static inline Lanes loadLanes(const float *f) { return _mm_loadu_ps(f); }
+static inline Lanes splatLanes(float f) { return _mm_set1_ps(f); }
+static inline Lanes addLanes(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes subLanes(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes mulLanes(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline void storeLanes(float *f, Lanes a) { _mm_storeu_ps(f, a); }
+#elif defined(MORTAR_NEON)
+typedef float32x4_t Lanes;
+constexpr unsigned LANE_COUNT = 4;
+
+static inline Lanes loadLanes(const float *f) { return vld1q_f32(f); }
+static inline Lanes splatLanes(float f) { return vdupq_n_f32(f); }
+static inline Lanes addLanes(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+static inline Lanes subLanes(Lanes a, Lanes b) { return vsubq_f32(a, b); }
+static inline Lanes mulLanes(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+static inline void storeLanes(float *f, Lanes a) { vst1q_f32(f, a); }
+#else
+typedef float Lanes;
+constexpr unsigned LANE_COUNT = 1;
+
+static inline Lanes loadLanes(const float *f) { return *f; }
+static inline Lanes splatLanes(float f) { return f; }
+static inline Lanes addLanes(Lanes a, Lanes b) { return a + b; }
+static inline Lanes subLanes(Lanes a, Lanes b) { return a - b; }
+static inline Lanes mulLanes(Lanes a, Lanes b) { return a * b; }
+static inline void storeLanes(float *f, Lanes a) { *f = a; }
+#endif
+
 struct KeyframeLookupKey {
   // Floating point frame position
   float position;
@@ -36,7 +92,8 @@ struct KeyframeLookupKey {
   // Integer position of current frame after current interval
   unsigned char subinterval;
 
-  uint8_t intervalMask;
+  // Integer position of current frame from the start of the animation
+  unsigned frame;
 };
 
 float inline squared(float f) {
@@ -47,63 +104,199 @@ float inline cubed(float f) {
   return f * f * f;
 }
 
-float inline calculateHermite(float position, float tStart, float tEnd, float inverseDuration, float blendStart, float blendEnd, float rateStart, float rateEnd) {
-  float u = (position - tStart) * inverseDuration;
-  float duration = tEnd - tStart;
+// Evaluates each channel's decoded segment at the position, LANE_COUNT
+// channels at a time
+static void evaluateBakedSegments(const AnimationCursor::BakedSegments& segments, float position, float *values, unsigned count) {
+  const Lanes one = splatLanes(1.0f);
+  const Lanes two = splatLanes(2.0f);
+  const Lanes three = splatLanes(3.0f);
+  const Lanes lanePosition = splatLanes(position);
+
+  unsigned i = 0;
+  for (; i + LANE_COUNT <= count; i += LANE_COUNT) {
+    Lanes u = mulLanes(subLanes(lanePosition, loadLanes(&segments.startTimes[i])), loadLanes(&segments.inverseDurations[i]));
+    Lanes u2 = mulLanes(u, u);
+    Lanes u3 = mulLanes(u2, u);
+
+    Lanes startBlend = addLanes(subLanes(mulLanes(two, u3), mulLanes(three, u2)), one);
+    Lanes endBlend = subLanes(one, startBlend);
+    Lanes startRateBlend = addLanes(subLanes(u3, mulLanes(two, u2)), u);
+    Lanes endRateBlend = subLanes(u3, u2);
+
+    Lanes value = mulLanes(startBlend, loadLanes(&segments.startValues[i]));
+    value = addLanes(value, mulLanes(endBlend, loadLanes(&segments.endValues[i])));
+    value = addLanes(value, mulLanes(startRateBlend, loadLanes(&segments.startRates[i])));
+    value = addLanes(value, mulLanes(endRateBlend, loadLanes(&segments.endRates[i])));
+
+    storeLanes(values + i, value);
+  }
 
-  float durationAdjustedStartRate = duration * rateStart;
-  float durationAdjustedEndRate = duration * rateEnd;
+  for (; i < count; i++) {
+    float u = (position - segments.startTimes[i]) * segments.inverseDurations[i];
 
-  return (2 * cubed(u) - 3 * squared(u) + 1) * blendStart + (-2 * cubed(u) + 3 * squared(u)) * blendEnd + (cubed(u) - 2 * squared(u) + u) * durationAdjustedStartRate + (cubed(u) - squared(u)) * durationAdjustedEndRate;
+    values[i] = (2 * cubed(u) - 3 * squared(u) + 1) * segments.startValues[i] + (-2 * cubed(u) + 3 * squared(u)) * segments.endValues[i] + (cubed(u) - 2 * squared(u) + u) * segments.startRates[i] + (cubed(u) - squared(u)) * segments.endRates[i];
+  }
 }
 
-float calculateChannelValue(const Mortar::Resource::Animation::Channel *channel, const struct KeyframeLookupKey *key) {
-  Mortar::Resource::Animation::KeyframeType keyframeType = channel->getKeyframeType();
+static void evaluateBakedChannels(const Mortar::Resource::Animation::BakedChannels& baked, const struct KeyframeLookupKey *key, unsigned channelCount, AnimationCursor *cursor) {
+  assert(channelCount <= baked.channels.size());
 
-  if (keyframeType == Mortar::Resource::Animation::KeyframeType::NONE) {
-    return channel->getFloatData();
-  } else if (keyframeType == Mortar::Resource::Animation::KeyframeType::BOOLEAN) {
-    throw std::runtime_error("boolean keyframes unimplemented");
-  }
+  AnimationCursor::BakedSegments& segments = cursor->bakedSegments;
+  std::vector<float>& values = cursor->channelValues;
 
-  const uint8_t *mask = channel->getKeyframeMask(key->interval);
+  // Channels whose segment doesn't cover the position decode the one that
+  // does in place
+  for (unsigned i = 0; i < channelCount; i++) {
+    if (key->position >= segments.validFrom[i] && key->position < segments.validUntil[i]) {
+      continue;
+    }
 
-  unsigned keyframe = 0;
-  for (int i = 0; i < key->subinterval; i++) {
-    // Relies on subinterval to be zero-indexed so we can mask against the
-    // current subinterval after the loop
-    keyframe += std::bitset<8>(mask[i]).count();
+    const Mortar::Resource::Animation::BakedChannels::Channel& channel = baked.channels[i];
+    uint32_t keyIndex = baked.findSegment(channel, key->position, segments.keys[i]);
+    Mortar::Resource::Animation::BakedChannels::Segment segment = baked.decodeSegment(channel, keyIndex);
+
+    segments.keys[i] = keyIndex;
+    segments.validFrom[i] = segment.validFrom;
+    segments.validUntil[i] = segment.validUntil;
+    segments.startTimes[i] = segment.startTime;
+    segments.inverseDurations[i] = segment.inverseDuration;
+    segments.startValues[i] = segment.startValue;
+    segments.endValues[i] = segment.endValue;
+    segments.startRates[i] = segment.startRate;
+    segments.endRates[i] = segment.endRate;
   }
-  keyframe += std::bitset<8>(mask[key->subinterval] & key->intervalMask).count();
 
-  if (Mortar::State::printNextFrame) {
-    DEBUG("mask 0x%x, 0x%x, 0x%x, 0x%x; interval mask 0x%x", mask[0], mask[1], mask[2], mask[3], key->intervalMask);
+  values.resize(channelCount);
+
+  if (Mortar::State::interpolate == Mortar::State::InterpolateType::NONE) {
+    for (unsigned i = 0; i < channelCount; i++) {
+      values[i] = segments.startValues[i];
+    }
+  } else {
+    evaluateBakedSegments(segments, key->position, values.data(), channelCount);
   }
+}
 
-  unsigned intervalOffset = channel->getIntervalOffset(key->interval);
+// Finds the keyframe starting the channel's segment at the frame, from the
+// cursor's segment when the frame is still inside it
+template <bool Trace>
+static inline unsigned findKeyframe(const Mortar::Resource::Animation::Channel *channel, const struct KeyframeLookupKey *key, AnimationCursor::Segment& segment) {
+  unsigned keyframe;
+  if (key->frame >= segment.firstFrame && key->frame < segment.endFrame) {
+    keyframe = segment.keyframe;
+  } else {
+    keyframe = channel->getKeyframeCount(key->frame);
+    segment = { key->frame, channel->getNextKeyframeFrame(key->frame), keyframe };
+  }
 
-  if (Mortar::State::printNextFrame) {
-    DEBUG("keyframe %d, interval offset %d", keyframe, intervalOffset);
+  if constexpr (Trace) {
+    const uint8_t *mask = channel->getKeyframeMask(key->interval);
+    TRACE("mask 0x%x, 0x%x, 0x%x, 0x%x; frame %u", mask[0], mask[1], mask[2], mask[3], key->frame);
+    TRACE("keyframe %d, interval offset %zu", keyframe, channel->getIntervalOffset(key->interval));
   }
 
-  if (channel->getKeyframeType() == Mortar::Resource::Animation::KeyframeType::FLOAT) {
-    unsigned offset = (intervalOffset + keyframe - 1) * 4;
-    float *startData = (float *)channel->getData() + offset;
-    float *endData = startData + 4;
+  return keyframe;
+}
+
+// Evaluates one batch of unbaked channels of the same keyframe type into the
+// cursor's channel values. Specialized per keyframe type and interpolation,
+// so the loops don't branch on either; Trace builds the copy that logs every
+// lookup for State::printNextFrame.
+template <Mortar::Resource::Animation::KeyframeType Type, Mortar::State::InterpolateType Interpolate, bool Trace>
+static void evaluateChannelBatch(const Mortar::Resource::Animation *animation, std::span<const uint32_t> batch, const struct KeyframeLookupKey *key, AnimationCursor *cursor) {
+  using KeyframeType = Mortar::Resource::Animation::KeyframeType;
+
+  unsigned channelsPerElement = animation->getElement(0)->getChannelCount();
+  std::vector<float>& values = cursor->channelValues;
+
+  auto getChannel = [&] (uint32_t channelIdx) {
+    return animation->getElement(channelIdx / channelsPerElement)->getChannel(channelIdx % channelsPerElement);
+  };
+
+  if constexpr (Type == KeyframeType::NONE) {
+    for (uint32_t channelIdx : batch) {
+      values[channelIdx] = getChannel(channelIdx)->getFloatData();
+    }
+  } else if constexpr (Type == KeyframeType::FLOAT && Interpolate == Mortar::State::InterpolateType::NONE) {
+    for (uint32_t channelIdx : batch) {
+      const Mortar::Resource::Animation::Channel *channel = getChannel(channelIdx);
+      unsigned keyframe = findKeyframe<Trace>(channel, key, cursor->segments[channelIdx]);
 
-    if (Mortar::State::printNextFrame) {
-      DEBUG("t start %f, t end %f, invDur %f, p %f, q %f, v %f, w %f", startData[0], endData[0], startData[1], startData[2], endData[2], startData[3], endData[3]);
+      values[channelIdx] = ((const float *)channel->getData())[(keyframe - 1) * 4 + 2];
+    }
+  } else if constexpr (Type == KeyframeType::FLOAT && Interpolate == Mortar::State::InterpolateType::HERMITE) {
+    // Segments are gathered into lanes, as baked ones are decoded, so the
+    // same kernel evaluates them across channels
+    AnimationCursor::BakedSegments& segments = cursor->batchSegments;
+    segments.startTimes.resize(batch.size());
+    segments.inverseDurations.resize(batch.size());
+    segments.startValues.resize(batch.size());
+    segments.endValues.resize(batch.size());
+    segments.startRates.resize(batch.size());
+    segments.endRates.resize(batch.size());
+
+    for (size_t i = 0; i < batch.size(); i++) {
+      const Mortar::Resource::Animation::Channel *channel = getChannel(batch[i]);
+      unsigned keyframe = findKeyframe<Trace>(channel, key, cursor->segments[batch[i]]);
+
+      const float *startData = (const float *)channel->getData() + (keyframe - 1) * 4;
+      const float *endData = startData + 4;
+
+      if constexpr (Trace) {
+        TRACE("t start %f, t end %f, invDur %f, p %f, q %f, v %f, w %f", startData[0], endData[0], startData[1], startData[2], endData[2], startData[3], endData[3]);
+      }
+
+      float duration = endData[0] - startData[0];
+      segments.startTimes[i] = startData[0];
+      segments.inverseDurations[i] = startData[1];
+      segments.startValues[i] = startData[2];
+      segments.endValues[i] = endData[2];
+      segments.startRates[i] = startData[3] * duration;
+      segments.endRates[i] = endData[3] * duration;
     }
 
-    switch (Mortar::State::interpolate) {
-      case Mortar::State::InterpolateType::NONE:
-        return startData[2];
-      case Mortar::State::InterpolateType::HERMITE:
-        return calculateHermite(key->position, startData[0], endData[0], startData[1], startData[2], endData[2], startData[3], endData[3]);
+    std::vector<float>& batchValues = cursor->batchValues;
+    batchValues.resize(batch.size());
+    evaluateBakedSegments(segments, key->position, batchValues.data(), batch.size());
+
+    for (size_t i = 0; i < batch.size(); i++) {
+      values[batch[i]] = batchValues[i];
+    }
+  } else if constexpr (Type == KeyframeType::BOOLEAN) {
+    if (!batch.empty()) {
+      throw std::runtime_error("boolean keyframes unimplemented");
     }
   } else {
-    DEBUG("keyframe type %d", keyframeType);
-    throw std::runtime_error("unimplemented keyframe type");
+    if (!batch.empty()) {
+      DEBUG("keyframe type %d", static_cast<int>(Type));
+      throw std::runtime_error("unimplemented keyframe type");
+    }
+  }
+}
+
+// The leading channels of a batch below channelCount
+static std::span<const uint32_t> limitBatch(const std::vector<uint32_t>& batch, unsigned channelCount) {
+  return { batch.data(), (size_t)(std::lower_bound(batch.begin(), batch.end(), channelCount) - batch.begin()) };
+}
+
+template <bool Trace>
+static void evaluateChannels(const Mortar::Resource::Animation *animation, const struct KeyframeLookupKey *key, unsigned channelCount, AnimationCursor *cursor) {
+  using KeyframeType = Mortar::Resource::Animation::KeyframeType;
+  using InterpolateType = Mortar::State::InterpolateType;
+
+  const Mortar::Resource::Animation::ChannelBatches& batches = animation->getChannelBatches();
+  cursor->channelValues.resize(channelCount);
+
+  evaluateChannelBatch<KeyframeType::NONE, InterpolateType::NONE, Trace>(animation, limitBatch(batches.constant, channelCount), key, cursor);
+  evaluateChannelBatch<KeyframeType::BOOLEAN, InterpolateType::NONE, Trace>(animation, limitBatch(batches.boolean, channelCount), key, cursor);
+
+  switch (Mortar::State::interpolate) {
+    case InterpolateType::NONE:
+      evaluateChannelBatch<KeyframeType::FLOAT, InterpolateType::NONE, Trace>(animation, limitBatch(batches.keyframed, channelCount), key, cursor);
+      break;
+    case InterpolateType::HERMITE:
+      evaluateChannelBatch<KeyframeType::FLOAT, InterpolateType::HERMITE, Trace>(animation, limitBatch(batches.keyframed, channelCount), key, cursor);
+      break;
   }
 }
 
@@ -130,74 +323,116 @@ struct KeyframeLookupKey createKeyframeLookup(unsigned intervalCount, float posi
   }
   assert(key.subinterval >= 0 && key.subinterval < 4);
 
-  key.intervalMask = (1 << (((intPositionAfterInterval & 0x7) + 1) & 0x1f)) - 1;
+  key.frame = (key.interval << 5) + intPositionAfterInterval;
 
   return key;
 }
 
-std::vector<Mortar::Math::Matrix> Mortar::Animation::runSkeletalAnimation(const Mortar::Resource::Animation *animation, const std::vector<Mortar::Resource::Joint *>& joints, float position) {
+void Mortar::Animation::runSkeletalAnimation(const Mortar::Resource::Animation *animation, const std::vector<Mortar::Resource::Joint *>& joints, float position, std::span<Mortar::Math::QTS> poses, AnimationCursor *cursor) {
+  PROFILE_ZONE("runSkeletalAnimation");
+
+  size_t jointCount = std::min(joints.size(), poses.size());
+
   if (position >= animation->getLength()) {
     position = animation->getLength() - 0.01;
   }
 
   struct KeyframeLookupKey key = createKeyframeLookup(animation->getIntervalCount(), position);
 
-  std::vector<Mortar::Math::Matrix> transforms;
-  transforms.reserve(joints.size());
+  // Without a cursor nothing carries over, and the scratch is allocated here
+  AnimationCursor localCursor;
+  if (!cursor) {
+    cursor = &localCursor;
+  }
+
+  // Every element has the same number of channels, so each channel gets a
+  // fixed segment slot. An empty segment never matches a frame.
+  unsigned channelsPerElement = animation->getElementCount() ? animation->getElement(0)->getChannelCount() : 0;
+  if (cursor->animation != animation) {
+    cursor->animation = animation;
+    cursor->segments.assign(animation->getElementCount() * channelsPerElement, { 0, 0, 0 });
+
+    // Empty ranges, so every baked channel decodes on first use
+    size_t channelCount = animation->isBaked() ? animation->getBakedChannels().channels.size() : 0;
+    AnimationCursor::BakedSegments& bakedSegments = cursor->bakedSegments;
+    bakedSegments.keys.assign(channelCount, 0);
+    bakedSegments.validFrom.assign(channelCount, 0.0f);
+    bakedSegments.validUntil.assign(channelCount, 0.0f);
+    bakedSegments.startTimes.resize(channelCount);
+    bakedSegments.inverseDurations.resize(channelCount);
+    bakedSegments.startValues.resize(channelCount);
+    bakedSegments.endValues.resize(channelCount);
+    bakedSegments.startRates.resize(channelCount);
+    bakedSegments.endRates.resize(channelCount);
+  }
+
+  // Every channel of the pose is evaluated up front, a batch at a time
+  unsigned elementCount = std::min<size_t>(animation->getElementCount(), jointCount);
+  unsigned channelCount = elementCount * channelsPerElement;
+  if (animation->isBaked()) {
+    evaluateBakedChannels(animation->getBakedChannels(), &key, channelCount, cursor);
+  } else if (Mortar::State::printNextFrame) {
+    evaluateChannels<true>(animation, &key, channelCount, cursor);
+  } else {
+    evaluateChannels<false>(animation, &key, channelCount, cursor);
+  }
+
+  const std::vector<float>& channelValues = cursor->channelValues;
+  auto channelValue = [&] (unsigned elementIdx, unsigned channelIdx) {
+    return channelValues[elementIdx * channelsPerElement + channelIdx];
+  };
+
+  for (size_t i = 0; i < jointCount; i++) {
+    Mortar::Math::QTS& pose = poses[i];
+    pose = Mortar::Math::QTS();
 
-  for (int i = 0; i < joints.size(); i++) {
     if (i >= animation->getElementCount()) {
-      transforms[i] = Math::Matrix();
       continue;
     }
 
     const Mortar::Resource::Animation::Element *element = animation->getElement(i);
     const Mortar::Resource::Joint *joint = joints.at(i);
 
+    // The clips' rotations are transposed, which conjugates a quaternion
     if (element->getHasRotation()) {
-      float yaw = calculateChannelValue(element->getChannel(3), &key);
-      float pitch = calculateChannelValue(element->getChannel(4), &key);
-      float roll = calculateChannelValue(element->getChannel(5), &key);
-
-      transforms.push_back(Mortar::Math::Matrix::rotationZYX(pitch, yaw, roll));
-      transforms[i].transpose();
-    } else {
-      transforms.push_back(Mortar::Math::Matrix());
+      float yaw = channelValue(i, 3);
+      float pitch = channelValue(i, 4);
+      float roll = channelValue(i, 5);
+
+      pose.rotation = Mortar::Math::Quaternion::rotationZYX(pitch, yaw, roll).conjugate();
     }
 
+    // Joint transforms are rigid, or near enough, so the joint's scale is
+    // taken before the rotation like the clip's
     if (element->getIsRelativeToJoint()) {
-      transforms[i] = transforms[i] * joint->getTransform();
+      const Mortar::Math::QTS& jointTransform = joint->getDecomposedTransform();
+
+      pose.rotation = pose.rotation * jointTransform.rotation;
+      pose.translation = jointTransform.translation;
+      pose.scale = jointTransform.scale;
     }
 
     if (element->getHasScale()) {
-      float scaleX = calculateChannelValue(element->getChannel(6), &key);
-      float scaleY = calculateChannelValue(element->getChannel(7), &key);
-      float scaleZ = calculateChannelValue(element->getChannel(8), &key);
-
-      transforms[i].scale(scaleX, scaleY, scaleZ);
+      pose.scale.x *= channelValue(i, 6);
+      pose.scale.y *= channelValue(i, 7);
+      pose.scale.z *= channelValue(i, 8);
     }
 
-    float transX = calculateChannelValue(element->getChannel(0), &key);
-    float transY = calculateChannelValue(element->getChannel(1), &key);
-    float transZ = calculateChannelValue(element->getChannel(2), &key);
-
-    transforms[i].translate(transX, transY, transZ);
+    pose.translation.x += channelValue(i, 0);
+    pose.translation.y += channelValue(i, 1);
+    pose.translation.z += channelValue(i, 2);
 
     if (joint->getIsRelativeToAttachment()) {
       Mortar::Math::Vector attachmentPoint = joint->getAttachmentPoint();
 
-      Mortar::Math::Vector transformedAttachment = attachmentPoint * transforms[i];
-      transforms[i].setTranslation(transformedAttachment);
-
-      transforms[i].translate(-attachmentPoint);
+      Mortar::Math::Vector transformedAttachment = pose.transformPoint(attachmentPoint);
+      pose.translation = Mortar::Math::Vector(transformedAttachment.x - attachmentPoint.x, transformedAttachment.y - attachmentPoint.y, transformedAttachment.z - attachmentPoint.z, 1.0f);
     }
 
-    transforms[i]._13 = -transforms[i]._13;
-    transforms[i]._23 = -transforms[i]._23;
-    transforms[i]._31 = -transforms[i]._31;
-    transforms[i]._32 = -transforms[i]._32;
-    transforms[i]._43 = -transforms[i]._43;
+    // Z is mirrored on both sides, which keeps the scale and flips the
+    // rotation's X and Y and the translation's Z
+    pose.rotation.x = -pose.rotation.x;
+    pose.rotation.y = -pose.rotation.y;
+    pose.translation.z = -pose.translation.z;
   }
-
-  return transforms;
 }
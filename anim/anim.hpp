@@ -17,14 +17,54 @@
 #ifndef MORTAR_ANIM_H
 #define MORTAR_ANIM_H
 
+#include <span>
+#include <stdint.h>
 #include <vector>
 
-#include "../math/matrix.hpp"
+#include "../math/qts.hpp"
 #include "../resource/types/anim.hpp"
 #include "../resource/types/joint.hpp"
 
 namespace Mortar::Animation {
-  std::vector<Mortar::Math::Matrix> runSkeletalAnimation(const Mortar::Resource::Animation *animation, const std::vector<Mortar::Resource::Joint *>& joints, float position);
+  // Remembers the keyframe segment each channel was last evaluated in, so
+  // frames that stay inside it skip the keyframe lookup. It also holds the
+  // evaluation scratch, so steady frames don't allocate. Keep one per actor.
+  struct AnimationCursor {
+    struct Segment {
+      // Frames [firstFrame, endFrame) all start at the same keyframe
+      unsigned firstFrame;
+      unsigned endFrame;
+      unsigned keyframe;
+    };
+
+    // Decoded segments of a baked animation, one lane per channel, so the
+    // Hermite kernel reads them in place
+    struct BakedSegments {
+      std::vector<uint32_t> keys;
+      std::vector<float> validFrom;
+      std::vector<float> validUntil;
+      std::vector<float> startTimes;
+      std::vector<float> inverseDurations;
+      std::vector<float> startValues;
+      std::vector<float> endValues;
+      std::vector<float> startRates;
+      std::vector<float> endRates;
+    };
+
+    const Mortar::Resource::Animation *animation = nullptr;
+    std::vector<Segment> segments;
+
+    BakedSegments bakedSegments;
+    std::vector<float> channelValues;
+
+    // Scratch for gathering one batch of unbaked segments into lanes
+    BakedSegments batchSegments;
+    std::vector<float> batchValues;
+  };
+
+  // Writes the local poses of the first poses.size() joints; the rest aren't
+  // evaluated
+  void runSkeletalAnimation(const Mortar::Resource::Animation *animation, const std::vector<Mortar::Resource::Joint *>& joints, float position, std::span<Mortar::Math::QTS> poses, AnimationCursor *cursor = nullptr);
 }
 
 #endif
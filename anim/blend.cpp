@@ -0,0 +1,51 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MORTAR_SSE
+#endif
+
+#include "blend.hpp"
+
+using namespace Mortar::Animation;
+
+// out = a * aWeight + b * bWeight, four floats at once
+static inline void mix4(const float *a, const float *b, float aWeight, float bWeight, float *out) {
+#ifdef MORTAR_SSE
+  __m128 value = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(aWeight)), _mm_mul_ps(_mm_loadu_ps(b), _mm_set1_ps(bWeight)));
+  _mm_storeu_ps(out, value);
+#else
+  for (int i = 0; i < 4; i++) {
+    out[i] = a[i] * aWeight + b[i] * bWeight;
+  }
+#endif
+}
+
+void Mortar::Animation::blendPoses(std::span<const Math::QTS> from, std::span<const Math::QTS> to, float weight, std::span<Math::QTS> out) {
+  assert(from.size() >= out.size() && to.size() >= out.size());
+
+  for (size_t i = 0; i < out.size(); i++) {
+    const Math::QTS& a = from[i];
+    const Math::QTS& b = to[i];
+
+    out[i].rotation = Math::Quaternion::slerp(a.rotation, b.rotation, weight);
+    mix4(&a.scale.x, &b.scale.x, 1.0f - weight, weight, &out[i].scale.x);
+    mix4(&a.translation.x, &b.translation.x, 1.0f - weight, weight, &out[i].translation.x);
+  }
+}
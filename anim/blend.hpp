@@ -0,0 +1,31 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_ANIM_BLEND_H
+#define MORTAR_ANIM_BLEND_H
+
+#include <span>
+
+#include "../math/qts.hpp"
+
+namespace Mortar::Animation {
+  // Blends two local poses joint by joint, weight being how much of to is
+  // taken. Rotations are slerped, scales and translations lerped. Out may
+  // alias from.
+  void blendPoses(std::span<const Math::QTS> from, std::span<const Math::QTS> to, float weight, std::span<Math::QTS> out);
+}
+
+#endif
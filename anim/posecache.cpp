@@ -0,0 +1,84 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "../state.hpp"
+#include "posecache.hpp"
+
+using namespace Mortar::Animation;
+
+size_t PoseCache::KeyHash::operator()(const Key& key) const noexcept {
+  size_t h1 = std::hash<const void *>{}(key.animation);
+  size_t h2 = std::hash<const void *>{}(key.joints);
+  size_t h3 = std::hash<long>{}(key.position);
+  size_t h4 = std::hash<size_t>{}(key.jointCount * 2 + key.isInterpolated);
+
+  return h1 ^ (h2 << 1) ^ (h3 << 2) ^ (h4 << 3);
+}
+
+void PoseCache::beginFrame() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  this->entries.clear();
+  this->usedEntries = 0;
+}
+
+void PoseCache::getPose(const Resource::Animation *animation, const std::vector<Resource::Joint *>& joints, float position, std::span<Math::QTS> poses, AnimationCursor *cursor) {
+  size_t jointCount = std::min(joints.size(), poses.size());
+  Key key { animation, &joints, std::lround(position * POSITION_STEPS), State::interpolate != State::InterpolateType::NONE, jointCount };
+
+  // Every actor evaluates the snapped position, so a pose doesn't depend on
+  // which actor got to it first
+  float snappedPosition = key.position / POSITION_STEPS;
+
+  Entry *cachedEntry = nullptr;
+  Entry *claimedEntry = nullptr;
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    auto cached = this->entries.find(key);
+    if (cached == this->entries.end()) {
+      if (this->usedEntries == this->entryPool.size()) {
+        this->entryPool.push_back(std::make_unique<Entry>());
+      }
+
+      claimedEntry = this->entryPool[this->usedEntries++].get();
+      claimedEntry->isReady = false;
+      this->entries[key] = claimedEntry;
+    } else if (cached->second->isReady) {
+      cachedEntry = cached->second;
+    }
+  }
+
+  // Ready entries aren't written again until beginFrame(), so they're read
+  // without the lock
+  if (cachedEntry) {
+    std::copy_n(cachedEntry->poses.begin(), jointCount, poses.begin());
+    return;
+  }
+
+  runSkeletalAnimation(animation, joints, snappedPosition, poses.first(jointCount), cursor);
+
+  if (claimedEntry) {
+    claimedEntry->poses.assign(poses.begin(), poses.begin() + jointCount);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    claimedEntry->isReady = true;
+  }
+}
@@ -0,0 +1,84 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_ANIM_POSECACHE_H
+#define MORTAR_ANIM_POSECACHE_H
+
+#include <memory>
+#include <mutex>
+#include <span>
+#include <tsl/sparse_map.h>
+#include <vector>
+
+#include "../math/qts.hpp"
+#include "../resource/types/anim.hpp"
+#include "../resource/types/joint.hpp"
+#include "anim.hpp"
+
+namespace Mortar::Animation {
+  // Shares local poses between actors playing the same clip on the same
+  // skeleton at the same position within a frame. Positions are snapped to
+  // a fraction of a frame so actors in lockstep always hit. Safe to use from
+  // several threads between calls to beginFrame().
+  class PoseCache {
+    public:
+      // Fractions of a frame positions are snapped to
+      static constexpr float POSITION_STEPS = 64.0f;
+
+      // Forgets the last frame's poses, keeping their storage
+      void beginFrame();
+
+      // Same as runSkeletalAnimation, but reuses a pose another actor already
+      // evaluated this frame
+      void getPose(const Resource::Animation *animation, const std::vector<Resource::Joint *>& joints, float position, std::span<Math::QTS> poses, AnimationCursor *cursor = nullptr);
+
+    private:
+      struct Key {
+        const Resource::Animation *animation;
+
+        // The skeleton; characters sharing joints share poses
+        const std::vector<Resource::Joint *> *joints;
+
+        long position;
+        bool isInterpolated;
+        size_t jointCount;
+
+        bool operator==(const Key& other) const = default;
+      };
+
+      struct KeyHash {
+        size_t operator()(const Key& key) const noexcept;
+      };
+
+      struct Entry {
+        std::vector<Math::QTS> poses;
+
+        // Set once poses are written; until then other actors evaluate
+        // the pose themselves rather than wait
+        bool isReady;
+      };
+
+      std::mutex mutex;
+      tsl::sparse_map<Key, Entry *, KeyHash> entries;
+
+      // Entries are handed out in order and reused every frame, and they're
+      // boxed so growing this doesn't move them
+      std::vector<std::unique_ptr<Entry>> entryPool;
+      size_t usedEntries = 0;
+  };
+}
+
+#endif
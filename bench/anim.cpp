@@ -0,0 +1,214 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "../anim/anim.hpp"
+#include "../math/matrix.hpp"
+#include "../math/qts.hpp"
+#include "../resource/loadcontext.hpp"
+#include "../resource/types/anim.hpp"
+#include "../resource/types/joint.hpp"
+#include "../state.hpp"
+#include "bench.hpp"
+
+using namespace Mortar;
+
+namespace {
+  // Frame count of the generated clips, and how far apart their keys are
+  const unsigned CLIP_LENGTH = 128;
+  const unsigned KEY_SPACING = 4;
+  const unsigned CHANNELS_PER_ELEMENT = 9;
+
+  // A skeleton and a clip for it, built the way the LSW readers build them,
+  // with keys every few frames on smooth curves. The context owns them all.
+  struct Fixture {
+    std::unique_ptr<Resource::LoadContext> context;
+    std::vector<Resource::Joint *> joints;
+    Resource::Animation *animation;
+  };
+
+  Resource::Animation::Channel *makeChannel(Resource::LoadContext& context, unsigned seed) {
+    Resource::Animation::Channel *channel = context.createResource<Resource::Animation::Channel>();
+    channel->setKeyframeType(Resource::Animation::KeyframeType::FLOAT);
+
+    std::vector<unsigned> keyFrames;
+    for (unsigned frame = 0; frame < CLIP_LENGTH - 1; frame += KEY_SPACING) {
+      keyFrames.push_back(frame);
+    }
+    keyFrames.push_back(CLIP_LENGTH - 1);
+
+    // Each key is its time, the inverse of the time to the next key, a value
+    // and a rate; frame zero is at position one
+    float *keys = context.allocateArray<Resource::Animation::Channel, float>(keyFrames.size() * 4);
+    float phase = 0.37f * seed;
+
+    for (size_t i = 0; i < keyFrames.size(); i++) {
+      float time = keyFrames[i] + 1.0f;
+      float nextTime = i + 1 < keyFrames.size() ? keyFrames[i + 1] + 1.0f : time + 1.0f;
+
+      keys[i * 4 + 0] = time;
+      keys[i * 4 + 1] = 1.0f / (nextTime - time);
+      keys[i * 4 + 2] = sinf(0.05f * time + phase);
+      keys[i * 4 + 3] = 0.05f * cosf(0.05f * time + phase);
+    }
+
+    channel->setData(keys, keyFrames.size() * 4 * sizeof(float));
+
+    // A mask bit per frame, 32 frames to an interval
+    unsigned intervalCount = (CLIP_LENGTH + 31) / 32;
+    unsigned keysBefore = 0;
+
+    for (unsigned interval = 0; interval < intervalCount; interval++) {
+      uint8_t masks[4] = {};
+      unsigned keysIn = 0;
+
+      for (unsigned frame : keyFrames) {
+        if (frame / 32 == interval) {
+          masks[(frame % 32) / 8] |= 1 << (frame % 8);
+          keysIn++;
+        }
+      }
+
+      channel->addKeyframeMask(masks[0], masks[1], masks[2], masks[3]);
+      channel->addIntervalOffset(keysBefore);
+      keysBefore += keysIn;
+    }
+
+    return channel;
+  }
+
+  std::shared_ptr<Fixture> makeFixture(unsigned jointCount, bool bake) {
+    auto fixture = std::make_shared<Fixture>();
+    fixture->context = std::make_unique<Resource::LoadContext>(State::getResourceManager());
+    Resource::LoadContext& context = *fixture->context;
+
+    for (unsigned i = 0; i < jointCount; i++) {
+      Resource::Joint *joint = context.createResource<Resource::Joint>();
+
+      Math::Matrix transform = Math::Matrix::rotationZYX(0.1f * i, 0.0f, 0.05f * i);
+      transform.f[12] = 0.0f;
+      transform.f[13] = 0.3f;
+      transform.f[14] = 0.0f;
+
+      joint->setName("joint");
+      joint->setParentIdx(static_cast<int>(i) - 1);
+      joint->setTransform(Math::Affine(transform));
+      joint->setIsRelativeToAttachment(false);
+
+      fixture->joints.push_back(joint);
+    }
+
+    Resource::Animation *animation = context.createResource<Resource::Animation>();
+    animation->setLength(CLIP_LENGTH);
+    animation->setIntervalCount((CLIP_LENGTH + 31) / 32);
+
+    for (unsigned i = 0; i < jointCount; i++) {
+      Resource::Animation::Element *element = context.createResource<Resource::Animation::Element>();
+      element->setHasRotation(true);
+      element->setHasScale(false);
+      element->setIsRelativeToJoint(true);
+
+      for (unsigned j = 0; j < CHANNELS_PER_ELEMENT; j++) {
+        element->addChannel(makeChannel(context, i * CHANNELS_PER_ELEMENT + j));
+      }
+
+      animation->addElement(element);
+    }
+
+    if (bake) {
+      animation->bake(State::animTolerance);
+    }
+
+    fixture->animation = animation;
+
+    return fixture;
+  }
+}
+
+void Mortar::Bench::registerAnimationBenchmarks(Registry& registry) {
+  for (unsigned jointCount : { 16, 64, 128 }) {
+    for (bool bake : { false, true }) {
+      std::shared_ptr<Fixture> fixture = makeFixture(jointCount, bake);
+      std::string name = std::string("anim/runSkeletalAnimation/") + (bake ? "baked/" : "raw/") + std::to_string(jointCount);
+
+      // Playback at half a frame a step, as the engine advances a cursor
+      registry.add(name, [fixture, jointCount, poses = std::vector<Math::QTS>(jointCount), cursor = Animation::AnimationCursor()] (uint64_t iterations) mutable {
+        float position = 1.0f;
+
+        for (uint64_t i = 0; i < iterations; i++) {
+          Animation::runSkeletalAnimation(fixture->animation, fixture->joints, position, poses, &cursor);
+          keep(poses.back());
+
+          position += 0.5f;
+          if (position >= CLIP_LENGTH) {
+            position = 1.0f;
+          }
+        }
+      }, jointCount);
+    }
+  }
+
+  // Without a cursor every channel looks its keyframe up afresh
+  std::shared_ptr<Fixture> raw = makeFixture(64, false);
+
+  registry.add("anim/runSkeletalAnimation/uncached/64", [raw, poses = std::vector<Math::QTS>(64)] (uint64_t iterations) mutable {
+    float position = 1.0f;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+      Animation::runSkeletalAnimation(raw->animation, raw->joints, position, poses);
+      keep(poses.back());
+
+      position += 0.5f;
+      if (position >= CLIP_LENGTH) {
+        position = 1.0f;
+      }
+    }
+  }, 64);
+
+  registry.add("anim/Channel::getKeyframeCount", [raw] (uint64_t iterations) {
+    const Resource::Animation::Channel *channel = raw->animation->getElement(0)->getChannel(0);
+
+    for (uint64_t i = 0; i < iterations; i++) {
+      unsigned frame = (i * 7) % (CLIP_LENGTH - 1);
+
+      keep(channel->getKeyframeCount(frame));
+      keep(channel->getNextKeyframeFrame(frame));
+    }
+  });
+
+  std::shared_ptr<Fixture> baked = makeFixture(64, true);
+  if (!baked->animation->isBaked()) {
+    return;
+  }
+
+  // Jumping around the clip defeats the hint, as seeking does
+  registry.add("anim/BakedChannels::findSegment", [baked] (uint64_t iterations) {
+    const Resource::Animation::BakedChannels& channels = baked->animation->getBakedChannels();
+    const Resource::Animation::BakedChannels::Channel& channel = channels.channels[0];
+    uint32_t key = 0;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+      float position = 1.0f + (i * 37) % (CLIP_LENGTH - 1);
+
+      key = channels.findSegment(channel, position, key);
+      keep(key);
+    }
+  });
+}
@@ -0,0 +1,209 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../state.hpp"
+#include "bench.hpp"
+
+// Microbenchmarks for the engine's hot paths. Each benchmark is calibrated to
+// run for a slice of --min-time, then timed over several repetitions; the
+// median is reported, and --json writes every result for trend tracking.
+//
+//   mortar-bench [--filter substring] [--min-time seconds] [--repetitions n]
+//                [--json path] [--data file]...
+
+using namespace Mortar::Bench;
+
+namespace {
+  struct Result {
+    const Benchmark *benchmark;
+    uint64_t iterations;
+    std::vector<double> times;
+
+    double median;
+    double minimum;
+    double mean;
+  };
+
+  double runOnce(const Benchmark& benchmark, uint64_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    benchmark.body(iterations);
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(end - start).count();
+  }
+
+  Result run(const Benchmark& benchmark, double minTime, unsigned repetitions) {
+    // Find how many iterations fill a repetition's share of the time, growing
+    // the count until a run is long enough to measure
+    double sliceTime = minTime / repetitions;
+    uint64_t iterations = 1;
+    double elapsed = runOnce(benchmark, iterations);
+
+    while (elapsed < sliceTime / 10.0 && iterations < (1ull << 40)) {
+      iterations *= 10;
+      elapsed = runOnce(benchmark, iterations);
+    }
+
+    iterations = std::max<uint64_t>(1, iterations * (sliceTime / std::max(elapsed, 1e-9)));
+
+    Result result { &benchmark, iterations, {}, 0.0, 0.0, 0.0 };
+    for (unsigned i = 0; i < repetitions; i++) {
+      result.times.push_back(runOnce(benchmark, iterations) * 1e9 / iterations);
+    }
+
+    std::vector<double> sorted = result.times;
+    std::sort(sorted.begin(), sorted.end());
+
+    result.median = sorted[sorted.size() / 2];
+    result.minimum = sorted.front();
+    for (double time : sorted) {
+      result.mean += time / sorted.size();
+    }
+
+    return result;
+  }
+
+  void writeEscaped(FILE *file, const std::string& string) {
+    for (char c : string) {
+      if (c == '"' || c == '\\') {
+        fputc('\\', file);
+      }
+
+      fputc(c, file);
+    }
+  }
+
+  bool writeJson(const char *path, const std::vector<Result>& results) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+      fprintf(stderr, "unable to open %s\n", path);
+      return false;
+    }
+
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+#ifdef NDEBUG
+    const char *buildType = "release";
+#else
+    const char *buildType = "debug";
+#endif
+
+    fprintf(file, "{\n  \"context\": { \"date\": \"%s\", \"build\": \"%s\" },\n  \"benchmarks\": [\n", date, buildType);
+
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result& result = results[i];
+
+      fputs("    { \"name\": \"", file);
+      writeEscaped(file, result.benchmark->name);
+      fprintf(file, "\", \"iterations\": %llu, \"repetitions\": %zu, \"median_ns\": %.3f, \"min_ns\": %.3f, \"mean_ns\": %.3f", (unsigned long long)result.iterations, result.times.size(), result.median, result.minimum, result.mean);
+
+      if (result.benchmark->itemsPerIteration) {
+        fprintf(file, ", \"items_per_second\": %.1f", result.benchmark->itemsPerIteration * 1e9 / result.median);
+      }
+
+      fputs(i + 1 < results.size() ? " },\n" : " }\n", file);
+    }
+
+    fputs("  ]\n}\n", file);
+
+    return fclose(file) == 0;
+  }
+}
+
+void Registry::add(const std::string& name, Body body, uint64_t itemsPerIteration) {
+  this->benchmarks.push_back({ name, std::move(body), itemsPerIteration });
+}
+
+const std::vector<Benchmark>& Registry::getBenchmarks() const {
+  return this->benchmarks;
+}
+
+const std::vector<std::string>& Registry::getDataFiles() const {
+  return this->dataFiles;
+}
+
+void Registry::addDataFile(const std::string& path) {
+  this->dataFiles.push_back(path);
+}
+
+int main(int argc, char **argv) {
+  const char *filter = nullptr;
+  const char *jsonPath = nullptr;
+  double minTime = 0.5;
+  unsigned repetitions = 5;
+
+  Registry registry;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 < argc && strcmp(argv[i], "--filter") == 0) {
+      filter = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--json") == 0) {
+      jsonPath = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--min-time") == 0) {
+      minTime = atof(argv[++i]);
+    } else if (i + 1 < argc && strcmp(argv[i], "--repetitions") == 0) {
+      repetitions = std::max(1, atoi(argv[++i]));
+    } else if (i + 1 < argc && strcmp(argv[i], "--data") == 0) {
+      registry.addDataFile(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--filter substring] [--min-time seconds] [--repetitions n] [--json path] [--data file]...\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // Readers hand parts of their work to jobs, as they do in the engine
+  Mortar::State::getJobSystem().initialize();
+  Mortar::State::getResourceManager().initialize(&Mortar::State::getJobSystem());
+
+  registerMathBenchmarks(registry);
+  registerAnimationBenchmarks(registry);
+  registerReaderBenchmarks(registry);
+
+  std::vector<Result> results;
+  for (const Benchmark& benchmark : registry.getBenchmarks()) {
+    if (filter && benchmark.name.find(filter) == std::string::npos) {
+      continue;
+    }
+
+    results.push_back(run(benchmark, minTime, repetitions));
+
+    const Result& result = results.back();
+    printf("%-48s %12.1f ns  (min %.1f, mean %.1f, %llu iterations)", benchmark.name.c_str(), result.median, result.minimum, result.mean, (unsigned long long)result.iterations);
+    if (benchmark.itemsPerIteration) {
+      printf("  %.3g items/s", benchmark.itemsPerIteration * 1e9 / result.median);
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+
+  Mortar::State::getJobSystem().shutDown();
+
+  if (jsonPath && !writeJson(jsonPath, results)) {
+    return 1;
+  }
+
+  return 0;
+}
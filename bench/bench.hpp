@@ -0,0 +1,69 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MORTAR_BENCH_BENCH_H
+#define MORTAR_BENCH_BENCH_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Mortar::Bench {
+  // A benchmark's body runs its operation the given number of times. Setup
+  // belongs outside it, captured by the body, so it isn't timed.
+  typedef std::function<void (uint64_t iterations)> Body;
+
+  struct Benchmark {
+    std::string name;
+    Body body;
+
+    // Items one iteration processes, such as joints or bytes, for a rate
+    // alongside the time; zero leaves the rate out
+    uint64_t itemsPerIteration;
+  };
+
+  class Registry {
+    public:
+      void add(const std::string& name, Body body, uint64_t itemsPerIteration = 0);
+
+      const std::vector<Benchmark>& getBenchmarks() const;
+
+      // Files named on the command line, for benchmarks reading game data
+      const std::vector<std::string>& getDataFiles() const;
+      void addDataFile(const std::string& path);
+
+    private:
+      std::vector<Benchmark> benchmarks;
+      std::vector<std::string> dataFiles;
+  };
+
+  // Keeps the compiler from discarding a result it can see is never used
+  template <typename T>
+  inline void keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &value;
+#endif
+  }
+
+  void registerMathBenchmarks(Registry& registry);
+  void registerAnimationBenchmarks(Registry& registry);
+  void registerReaderBenchmarks(Registry& registry);
+}
+
+#endif
@@ -0,0 +1,105 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <span>
+#include <string>
+#include <vector>
+
+#include "../math/affine.hpp"
+#include "../math/batch.hpp"
+#include "../math/matrix.hpp"
+#include "../math/qts.hpp"
+#include "bench.hpp"
+
+using namespace Mortar;
+
+namespace {
+  // Rigid transforms that vary from one to the next, as a skeleton's do
+  std::vector<Math::Matrix> makeTransforms(size_t count) {
+    std::vector<Math::Matrix> transforms;
+
+    for (size_t i = 0; i < count; i++) {
+      Math::Matrix transform = Math::Matrix::rotationZYX(0.1f * i, 0.05f * i, -0.02f * i);
+      transform.f[12] = 0.5f * i;
+      transform.f[13] = 0.25f;
+      transform.f[14] = -0.125f * i;
+
+      transforms.push_back(transform);
+    }
+
+    return transforms;
+  }
+
+  // A chain several joints deep branching every few, roughly a character's
+  std::vector<int> makeParents(size_t count) {
+    std::vector<int> parents;
+
+    for (size_t i = 0; i < count; i++) {
+      parents.push_back(i == 0 ? -1 : (i % 5 == 0 ? static_cast<int>(i / 2) : static_cast<int>(i - 1)));
+    }
+
+    return parents;
+  }
+}
+
+void Mortar::Bench::registerMathBenchmarks(Registry& registry) {
+  std::vector<Math::Matrix> pair = makeTransforms(2);
+
+  registry.add("math/Matrix::operator*", [pair] (uint64_t iterations) {
+    Math::Matrix result = pair[0];
+
+    for (uint64_t i = 0; i < iterations; i++) {
+      result = result * pair[1];
+      keep(result);
+    }
+  });
+
+  for (size_t count : { 64, 256, 1024 }) {
+    std::string suffix = "/" + std::to_string(count);
+
+    std::vector<Math::Matrix> a = makeTransforms(count);
+    std::vector<Math::Matrix> b = makeTransforms(count);
+
+    std::vector<Math::Affine> affines;
+    std::vector<Math::QTS> local;
+    for (const Math::Matrix& matrix : a) {
+      affines.push_back(Math::Affine(matrix));
+      local.push_back(Math::QTS(matrix));
+    }
+
+    std::vector<int> parents = makeParents(count);
+
+    registry.add("math/multiplyEach(Matrix)" + suffix, [a, b, out = std::vector<Math::Matrix>(count)] (uint64_t iterations) mutable {
+      for (uint64_t i = 0; i < iterations; i++) {
+        Math::multiplyEach(a, b, out);
+        keep(out.back());
+      }
+    }, count);
+
+    registry.add("math/multiplyEach(Affine)" + suffix, [affines, b, out = std::vector<Math::Affine>(count)] (uint64_t iterations) mutable {
+      for (uint64_t i = 0; i < iterations; i++) {
+        Math::multiplyEach(affines, b, out);
+        keep(out.back());
+      }
+    }, count);
+
+    registry.add("math/multiplyHierarchy(QTS)" + suffix, [local, parents, out = std::vector<Math::Matrix>(count)] (uint64_t iterations) mutable {
+      for (uint64_t i = 0; i < iterations; i++) {
+        Math::multiplyHierarchy(std::span<const Math::QTS>(local), parents, Math::Matrix(), out);
+        keep(out.back());
+      }
+    }, count);
+  }
+}
@@ -0,0 +1,100 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <ctype.h>
+#include <filesystem>
+#include <memory>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "../game/lsw/readers/anim.hpp"
+#include "../game/lsw/readers/hgp.hpp"
+#include "../game/lsw/readers/nup.hpp"
+#include "../resource/loadcontext.hpp"
+#include "../resource/types/anim.hpp"
+#include "../resource/types/character.hpp"
+#include "../resource/types/scene.hpp"
+#include "../state.hpp"
+#include "../streams/memorystream.hpp"
+#include "bench.hpp"
+
+using namespace Mortar;
+
+namespace {
+  std::shared_ptr<std::vector<uint8_t>> readFile(const std::string& path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+      return nullptr;
+    }
+
+    auto data = std::make_shared<std::vector<uint8_t>>(std::filesystem::file_size(path));
+    size_t read = fread(data->data(), 1, data->size(), file);
+    fclose(file);
+
+    if (read != data->size()) {
+      return nullptr;
+    }
+
+    return data;
+  }
+
+  // Parses the whole file from memory, then frees everything it created
+  template <typename Parse>
+  Mortar::Bench::Body makeParse(std::shared_ptr<std::vector<uint8_t>> data, Parse parse) {
+    return [data, parse] (uint64_t iterations) {
+      for (uint64_t i = 0; i < iterations; i++) {
+        Resource::LoadContext context(State::getResourceManager());
+        MemoryStream stream(data->data(), data->size());
+
+        parse(context, stream);
+      }
+    };
+  }
+}
+
+// The game's files can't be shipped, so these only run for files given with
+// --data; the reader is chosen by extension
+void Mortar::Bench::registerReaderBenchmarks(Registry& registry) {
+  for (const std::string& path : registry.getDataFiles()) {
+    std::shared_ptr<std::vector<uint8_t>> data = readFile(path);
+    if (!data) {
+      fprintf(stderr, "unable to read %s\n", path.c_str());
+      continue;
+    }
+
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [] (unsigned char c) { return tolower(c); });
+
+    std::string name = std::filesystem::path(path).filename().string();
+
+    if (extension == ".nup") {
+      registry.add("readers/NUP/" + name, makeParse(data, [] (Resource::LoadContext& context, Stream& stream) {
+        Game::LSW::Readers::NUPReader::read(context, context.createResource<Resource::Scene>(), stream);
+      }), data->size());
+    } else if (extension == ".hgp") {
+      registry.add("readers/HGP/" + name, makeParse(data, [] (Resource::LoadContext& context, Stream& stream) {
+        Game::LSW::Readers::HGPReader::read(context, context.createResource<Resource::Character>(), stream);
+      }), data->size());
+    } else if (extension == ".ani") {
+      registry.add("readers/ANI/" + name, makeParse(data, [] (Resource::LoadContext& context, Stream& stream) {
+        keep(Game::LSW::Readers::AnimReader::read(context, stream));
+      }), data->size());
+    } else {
+      fprintf(stderr, "no reader for %s\n", path.c_str());
+    }
+  }
+}
@@ -29,6 +29,14 @@ void Camera::setLookAt(const Math::Vector &lookAt) {
   this->cameraLookAt = lookAt;
 }
 
+const Math::Vector& Camera::getPosition() const {
+  return this->cameraPosition;
+}
+
+const Math::Vector& Camera::getLookAt() const {
+  return this->cameraLookAt;
+}
+
 const Math::Matrix Camera::getViewTransform() const {
   return Math::Matrix::lookAt(this->cameraPosition, this->cameraLookAt, Math::Vector::yAxis);
 }
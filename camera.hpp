@@ -23,6 +23,8 @@ namespace Mortar {
 
       void setPosition(const Math::Vector& position);
       void setLookAt(const Math::Vector& lookAt);
+      const Math::Vector& getPosition() const;
+      const Math::Vector& getLookAt() const;
       const Math::Matrix getViewTransform() const;
       void translate(const Math::Vector& translate);
 
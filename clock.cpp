@@ -15,6 +15,9 @@
  */
 
 #include <SDL2/SDL_timer.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
 
 #include "clock.hpp"
 
@@ -25,15 +28,63 @@ void Clock::initialize() {
   this->countsLastFrame = SDL_GetPerformanceCounter();
 
   this->secondsPerCount = 1.0f / this->perfFrequency;
+
+  this->setFixedStep(this->stepRate, this->maxSteps);
 }
 
 void Clock::update() {
   uint64_t counts = SDL_GetPerformanceCounter();
+  uint64_t elapsed = counts - this->countsLastFrame;
 
-  this->timeDelta = (counts - this->countsLastFrame) * this->secondsPerCount;
+  this->timeDelta = elapsed * this->secondsPerCount;
   this->countsLastFrame = counts;
+
+  this->advance(elapsed);
+}
+
+void Clock::update(float timeDelta) {
+  this->timeDelta = timeDelta;
+  this->countsLastFrame = SDL_GetPerformanceCounter();
+
+  this->advance(llround(static_cast<double>(timeDelta) * this->perfFrequency));
+}
+
+void Clock::advance(uint64_t elapsed) {
+  this->accumulated += elapsed;
+  this->stepCount = std::min<uint64_t>(this->accumulated / this->countsPerStep, this->maxSteps);
+  this->accumulated -= this->stepCount * this->countsPerStep;
+
+  // Whatever the capped steps couldn't cover is given up, apart from what's
+  // needed to blend into the next step
+  this->accumulated = std::min(this->accumulated, this->countsPerStep - 1);
 }
 
 float Clock::getTimeDelta() {
   return this->timeDelta;
 }
+
+void Clock::setFixedStep(unsigned stepRate, unsigned maxSteps) {
+  if (stepRate == 0 || maxSteps == 0) {
+    throw std::runtime_error("fixed step rate and step limit must not be zero");
+  }
+
+  this->stepRate = stepRate;
+  this->maxSteps = maxSteps;
+
+  // Only a placeholder until initialize() has read the counter's frequency
+  this->countsPerStep = std::max<uint64_t>(this->perfFrequency / stepRate, 1);
+  this->accumulated = 0;
+  this->stepCount = 0;
+}
+
+unsigned Clock::getStepCount() const {
+  return this->stepCount;
+}
+
+float Clock::getStepDuration() const {
+  return this->countsPerStep * this->secondsPerCount;
+}
+
+float Clock::getInterpolationAlpha() const {
+  return (float)this->accumulated / this->countsPerStep;
+}
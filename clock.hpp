@@ -20,20 +20,55 @@
 #include <stdint.h>
 
 namespace Mortar {
+  // Measures frames, and schedules the simulation in fixed steps across
+  // them. Each update adds the frame's time to an accumulator and takes
+  // whole steps out of it; what's left over is how far the display is into
+  // the next step.
   class Clock {
     public:
+      static const unsigned DEFAULT_STEP_RATE = 60;
+      static const unsigned DEFAULT_MAX_STEPS = 5;
+
       void initialize();
       void update();
 
+      // Updates as if the given seconds had passed since the last frame, for
+      // runs that have to simulate the same frames whatever the machine
+      void update(float timeDelta);
+
       float getTimeDelta();
 
+      // Steps per second, and most steps one update may take. Time past the
+      // last of those is dropped, so a slow frame slows the simulation down
+      // rather than making the next frame slower still. May be called before
+      // initialize().
+      void setFixedStep(unsigned stepRate, unsigned maxSteps = DEFAULT_MAX_STEPS);
+
+      // Steps to simulate this frame, and how long each one is in seconds
+      unsigned getStepCount() const;
+      float getStepDuration() const;
+
+      // Fraction of a step accumulated since the last one, for blending the
+      // last two simulated states
+      float getInterpolationAlpha() const;
+
     private:
-      uint64_t perfFrequency;
+      uint64_t perfFrequency = 0;
       uint64_t countsLastFrame;
 
       float secondsPerCount;
 
       float timeDelta;
+
+      // Kept in counter units, so the schedule doesn't drift
+      unsigned stepRate = DEFAULT_STEP_RATE;
+      unsigned maxSteps = DEFAULT_MAX_STEPS;
+      uint64_t countsPerStep = 1;
+      uint64_t accumulated = 0;
+
+      unsigned stepCount = 0;
+
+      void advance(uint64_t elapsed);
   };
 }
 
@@ -14,7 +14,9 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <SDL2/SDL_timer.h>
 #include <SDL2/SDL_video.h>
+#include <algorithm>
 #include <stdexcept>
 
 #include "display.hpp"
@@ -32,8 +34,14 @@ void DisplayManager::initialize(GraphicsAPI graphicsApi, unsigned int width, uns
 
   unsigned windowFlags = 0;
   switch (graphicsApi) {
+    case GraphicsAPI::NONE:
+      this->isInitialized = true;
+      return;
     case GraphicsAPI::OPENGL:
-      windowFlags |= SDL_WINDOW_OPENGL;
+      windowFlags |= SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
+      break;
+    case GraphicsAPI::VULKAN:
+      windowFlags |= SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE;
   };
 
   this->window = SDL_CreateWindow("Mortar Engine", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, windowFlags);
@@ -64,7 +72,17 @@ void DisplayManager::setWindowDimensions(unsigned width, unsigned height) {
 
   this->setManagerDimensions(width, height);
 
-  SDL_SetWindowSize(this->window, width, height);
+  if (this->window) {
+    SDL_SetWindowSize(this->window, width, height);
+  }
+}
+
+unsigned DisplayManager::getWidth() const {
+  return this->width;
+}
+
+unsigned DisplayManager::getHeight() const {
+  return this->height;
 }
 
 void DisplayManager::setManagerDimensions(unsigned width, unsigned height) {
@@ -78,3 +96,93 @@ void DisplayManager::setManagerDimensions(unsigned width, unsigned height) {
     this->perspectiveTransform = Math::Matrix::perspectiveRH(this->fov, this->aspectRatio, this->zNear, this->zFar);
   }
 }
+
+void DisplayManager::setSwapInterval(SwapInterval interval) {
+  this->swapInterval = interval;
+  this->swapIntervalChanged = true;
+}
+
+DisplayManager::SwapInterval DisplayManager::getSwapInterval() const {
+  return this->swapInterval;
+}
+
+void DisplayManager::applySwapInterval() {
+  if (!this->swapIntervalChanged.exchange(false)) {
+    return;
+  }
+
+  SwapInterval interval = this->swapInterval;
+  if (SDL_GL_SetSwapInterval(static_cast<int>(interval)) == 0) {
+    return;
+  }
+
+  if (interval == SwapInterval::ADAPTIVE) {
+    DEBUG("adaptive vsync unsupported, using vsync");
+    this->swapInterval = SwapInterval::VSYNC;
+    SDL_GL_SetSwapInterval(static_cast<int>(SwapInterval::VSYNC));
+  } else {
+    DEBUG("unable to set swap interval %d: %s", static_cast<int>(interval), SDL_GetError());
+  }
+}
+
+void DisplayManager::setFrameRateCap(unsigned framesPerSecond) {
+  this->frameRateCap = framesPerSecond;
+  this->countsPerFrame = framesPerSecond ? SDL_GetPerformanceFrequency() / framesPerSecond : 0;
+  this->nextDeadline = 0;
+}
+
+unsigned DisplayManager::getFrameRateCap() const {
+  return this->frameRateCap;
+}
+
+void DisplayManager::pace() {
+  uint64_t frequency = SDL_GetPerformanceFrequency();
+  uint64_t now = SDL_GetPerformanceCounter();
+
+  if (this->countsPerFrame) {
+    // Deadlines follow on from each other so pacing doesn't drift, unless
+    // we've fallen more than a frame behind
+    if (this->nextDeadline == 0 || now > this->nextDeadline + this->countsPerFrame) {
+      this->nextDeadline = now;
+    }
+    this->nextDeadline += this->countsPerFrame;
+
+    // Leave a couple of milliseconds to spin, to cover the sleep overshooting
+    uint64_t spinCounts = frequency / 500;
+    if (this->nextDeadline > now + spinCounts) {
+      SDL_Delay((this->nextDeadline - now - spinCounts) * 1000 / frequency);
+    }
+
+    while ((now = SDL_GetPerformanceCounter()) < this->nextDeadline);
+  }
+
+  if (this->lastFrameEnd) {
+    this->frameTimes[this->nextFrameTime] = (float)(now - this->lastFrameEnd) / frequency;
+    this->nextFrameTime = (this->nextFrameTime + 1) % STATS_WINDOW;
+    this->frameTimeCount = std::min(this->frameTimeCount + 1, STATS_WINDOW);
+  }
+
+  this->lastFrameEnd = now;
+}
+
+DisplayManager::FrameStats DisplayManager::getFrameStats() const {
+  FrameStats stats {};
+  if (this->frameTimeCount == 0) {
+    return stats;
+  }
+
+  std::array<float, STATS_WINDOW> sorted = this->frameTimes;
+  std::sort(sorted.begin(), sorted.begin() + this->frameTimeCount);
+
+  float total = 0.0f;
+  for (size_t i = 0; i < this->frameTimeCount; i++) {
+    total += sorted[i];
+  }
+
+  stats.average = total / this->frameTimeCount;
+  stats.minimum = sorted[0];
+  stats.maximum = sorted[this->frameTimeCount - 1];
+  stats.percentile99 = sorted[(this->frameTimeCount - 1) * 99 / 100];
+
+  return stats;
+}
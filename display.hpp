@@ -18,16 +18,44 @@
 #define MORTAR_DISPLAY_H
 
 #include <SDL2/SDL.h>
+#include <array>
+#include <atomic>
+#include <stdint.h>
 
 #include "math/matrix.hpp"
 
 namespace Mortar {
   class DisplayManager {
     public:
+      // With NONE there's no window, only the dimensions and projection,
+      // for running without a display
       enum class GraphicsAPI {
+        NONE,
         OPENGL,
+        VULKAN,
       };
 
+      // Values as SDL_GL_SetSwapInterval takes them. Adaptive vsync tears
+      // instead of waiting a whole refresh when a frame is late, and falls
+      // back to plain vsync where it isn't supported.
+      enum class SwapInterval {
+        ADAPTIVE = -1,
+        IMMEDIATE = 0,
+        VSYNC = 1,
+      };
+
+      // Over the last STATS_WINDOW frames, in seconds
+      struct FrameStats {
+        float average;
+        float minimum;
+        float maximum;
+
+        // Time 99% of frames came in under
+        float percentile99;
+      };
+
+      static const size_t STATS_WINDOW = 240;
+
       DisplayManager()
         : aspectRatio { -1.0f },
           fov { (float)std::numbers::pi * 45.0f / 180.0f },
@@ -36,27 +64,66 @@ namespace Mortar {
 
       void initialize(GraphicsAPI graphicsApi, unsigned width, unsigned height);
 
+      // Null when initialized without a graphics API
       SDL_Window *getWindow() const;
 
+      // Renderers pick up the new size, and resize their targets, from the
+      // next frame
       void setWindowDimensions(unsigned width, unsigned height);
 
+      // Safe to read from the render thread
+      unsigned getWidth() const;
+      unsigned getHeight() const;
+
       const Math::Matrix& getPerspectiveTransform() const;
 
+      // Takes effect at the next swap
+      void setSwapInterval(SwapInterval interval);
+      SwapInterval getSwapInterval() const;
+
+      // Called by the renderer before each swap, from the thread its context
+      // is current on, to apply a changed swap interval
+      void applySwapInterval();
+
+      // Most frames per second pace() lets through, or zero for no limit
+      void setFrameRateCap(unsigned framesPerSecond);
+      unsigned getFrameRateCap() const;
+
+      // Ends a frame: records its time, then waits out the rest of its slot
+      // under the cap. Sleeps until just short of the deadline and spins the
+      // rest, as sleeps are only good to a millisecond or so.
+      void pace();
+
+      FrameStats getFrameStats() const;
+
     private:
       bool isInitialized = false;
 
-      unsigned width;
-      unsigned height;
+      std::atomic<unsigned> width;
+      std::atomic<unsigned> height;
       float aspectRatio;
       float fov;
       float zNear;
       float zFar;
 
-      SDL_Window *window;
+      SDL_Window *window = nullptr;
 
       Math::Matrix perspectiveTransform;
 
       void setManagerDimensions(unsigned width, unsigned height);
+
+      // Requested from the game thread, applied on the render thread
+      std::atomic<SwapInterval> swapInterval { SwapInterval::VSYNC };
+      std::atomic<bool> swapIntervalChanged { true };
+
+      unsigned frameRateCap = 0;
+      uint64_t countsPerFrame = 0;
+      uint64_t nextDeadline = 0;
+
+      uint64_t lastFrameEnd = 0;
+      std::array<float, STATS_WINDOW> frameTimes {};
+      size_t frameTimeCount = 0;
+      size_t nextFrameTime = 0;
   };
 }
 
@@ -21,6 +21,10 @@ namespace Mortar::Game {
   class Game {
     public:
       virtual void initialize() = 0;
+      virtual void shutDown() = 0;
+
+      // Called once a frame, before the scene is rendered
+      virtual void update() = 0;
   };
 }
 
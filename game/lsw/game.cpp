@@ -14,6 +14,9 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <memory>
+
+#include "../../log.hpp"
 #include "../../state.hpp"
 #include "game.hpp"
 #include "loaders/loaders.hpp"
@@ -24,12 +27,99 @@ using namespace Mortar::Game::LSW;
 void Game::initialize() {
   Resource::ResourceManager& resourceManager = State::getResourceManager();
 
+  resourceManager.registerResourceLoader<Resource::Animation>(AnimationLoader());
   resourceManager.registerResourceLoader<Resource::Character>(CharacterLoader());
   resourceManager.registerResourceLoader<Resource::Scene>(SceneLoader());
 
-  Scene::SceneManager& sceneManager = State::getSceneManager();
+  this->prefetcher.initialize();
+
+  if (!this->startScene.empty()) {
+    this->loadScene(this->startScene);
+  }
+}
+
+void Game::shutDown() {
+  this->prefetcher.shutDown();
+}
+
+void Game::setStartScene(const std::string& name) {
+  this->startScene = name;
+}
+
+void Game::loadScene(const std::string& name) {
+  Resource::ResourceManager& resourceManager = State::getResourceManager();
+
+  this->loadStart = std::chrono::steady_clock::now();
+
+  SceneManifest manifest = getSceneManifest(name);
+  DEBUG("loading %s: %zu characters, %zu animations, %llu bytes", name.c_str(), manifest.characters.size(), manifest.animations.size(), (unsigned long long)manifest.size);
+
+  if (this->progressiveLoad) {
+    // Loads already under way or done publish nothing, and the whole scene
+    // is set once update() sees it's loaded
+    std::shared_ptr<Mortar::Scene::SceneFeed> feed = std::make_shared<Mortar::Scene::SceneFeed>();
+    watchSceneLoad(name, feed);
+
+    this->pendingScene = name;
+    this->pendingLoad = resourceManager.getResourceAsync<Resource::Scene>(name);
+
+    State::getSceneManager().setDepthMode(getSceneDepthMode(name));
+    State::getSceneManager().streamScene(feed);
+    return;
+  }
+
+  const Resource::Scene *scene = resourceManager.getResource<Resource::Scene>(name);
+  State::getSceneManager().setDepthMode(getSceneDepthMode(name));
+  this->switchScene(name, scene);
+}
+
+void Game::update() {
+  if (!this->pendingLoad || !this->pendingLoad->isReady()) {
+    return;
+  }
+
+  Resource::ResourceFuture<Resource::Scene> load = *std::move(this->pendingLoad);
+  this->pendingLoad.reset();
+
+  // Unused if the scene was already loaded
+  watchSceneLoad(this->pendingScene, nullptr);
+
+  this->switchScene(this->pendingScene, load.get());
+}
+
+void Game::setProgressiveLoad(bool progressiveLoad) {
+  this->progressiveLoad = progressiveLoad;
+}
+
+void Game::switchScene(const std::string& name, const Resource::Scene *scene) {
+  State::getSceneManager().setScene(scene);
+
+  // Progressive loads count until the whole scene is in
+  std::chrono::duration<float, std::milli> loadTime = std::chrono::steady_clock::now() - this->loadStart;
+  State::getTelemetry().recordLoad(name, loadTime.count());
+
+  if (!this->currentScene.empty() && this->currentScene != name) {
+    State::getResourceManager().releaseResource(this->currentScene);
+  }
+
+  this->currentScene = name;
+
+  // The next scene is read in while this one plays, so switching to it is
+  // quick
+  std::string nextScene = getNextScene(name);
+  if (this->prefetchNextScene && !nextScene.empty()) {
+    this->prefetchScene(nextScene);
+  }
+}
+
+void Game::prefetchScene(const std::string& name) {
+  this->prefetcher.prefetch(name, true);
+}
+
+bool Game::isPrefetching() const {
+  return this->prefetcher.isBusy();
+}
 
-  // Load a scene we know we have
-  Resource::Scene *scene = resourceManager.getResource<Resource::Scene>("negotiations_a");
-  sceneManager.setScene(scene);
+void Game::setPrefetchNextScene(bool prefetchNextScene) {
+  this->prefetchNextScene = prefetchNextScene;
 }
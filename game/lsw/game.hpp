@@ -17,12 +17,56 @@
 #ifndef MORTAR_GAME_LSW_H
 #define MORTAR_GAME_LSW_H
 
+#include <chrono>
+#include <optional>
+#include <string>
+
 #include "../game.hpp"
+#include "../../resource/manager.hpp"
+#include "../../resource/types/scene.hpp"
+#include "prefetcher.hpp"
 
 namespace Mortar::Game::LSW {
   class Game : public Mortar::Game::Game {
     public:
       virtual void initialize() override;
+      virtual void shutDown() override;
+
+      // Finishes switching to a scene loaded progressively once its load is
+      // done. A failed load throws from here.
+      virtual void update() override;
+
+      // The scene initialize() loads; empty leaves loading one to the caller
+      void setStartScene(const std::string& name);
+
+      // Switches to a scene, loading it now unless it was preloaded
+      void loadScene(const std::string& name);
+
+      // Scenes loaded from source are drawn as they're read, instead of
+      // loadScene waiting for the whole load
+      void setProgressiveLoad(bool progressiveLoad);
+
+      // Starts reading a scene that's likely to be next in the background
+      void prefetchScene(const std::string& name);
+      bool isPrefetching() const;
+
+      // Whether switching to a scene prefetches the one after it
+      void setPrefetchNextScene(bool prefetchNextScene);
+
+    private:
+      Prefetcher prefetcher;
+      std::string currentScene;
+
+      bool progressiveLoad = false;
+      bool prefetchNextScene = true;
+      std::string pendingScene;
+      std::optional<Resource::ResourceFuture<Resource::Scene>> pendingLoad;
+      std::chrono::steady_clock::time_point loadStart;
+
+      void switchScene(const std::string& name, const Resource::Scene *scene);
+
+      // The only one described so far
+      std::string startScene = "negotiations_a";
   };
 }
 
@@ -0,0 +1,39 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <filesystem>
+#include <memory>
+
+#include "../../../profiler.hpp"
+#include "../../../resource/loadcontext.hpp"
+#include "../../../state.hpp"
+#include "loaders.hpp"
+#include "../readers/anim.hpp"
+
+using namespace Mortar::Game::LSW;
+
+Mortar::Resource::Animation *AnimationLoader::operator()(const std::string &name) {
+  PROFILE_ZONE("AnimationLoader");
+
+  Resource::LoadContext context(State::getResourceManager());
+
+  std::unique_ptr<Stream> stream = openDataFile(std::filesystem::path(dataPath).append(name));
+  Resource::Animation *resource = Readers::AnimReader::read(context, *stream);
+
+  context.commit();
+
+  return resource;
+}
@@ -14,11 +14,16 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <exception>
 #include <filesystem>
 #include <tsl/sparse_map.h>
+#include <memory>
+#include <vector>
 
+#include "../../../jobs/task.hpp"
+#include "../../../profiler.hpp"
+#include "../../../resource/loadcontext.hpp"
 #include "../../../state.hpp"
-#include "../../../streams/filestream.hpp"
 #include "loaders.hpp"
 #include "../readers/anim.hpp"
 #include "../readers/hgp.hpp"
@@ -57,29 +62,106 @@ tsl::sparse_map<std::string, struct CharacterDescription> charDescriptions = {
   }
 };
 
-Mortar::Resource::Character *CharacterLoader::operator()(const std::string &name) {
+void Mortar::Game::LSW::addCharacterToManifest(SceneManifest& manifest, const std::string& name) {
   if (!charDescriptions.contains(name)) {
-    throw std::runtime_error("unknown scene name");
+    throw std::runtime_error("unknown character name");
   }
 
-  Mortar::Resource::Character *resource = State::getResourceManager().createResource<Mortar::Resource::Character>();
-
   struct CharacterDescription& desc = charDescriptions.at(name);
 
+  manifest.characters.push_back(name);
+  addDataFileToManifest(manifest, std::filesystem::path(desc.path).append(desc.filePrefix).concat(".hgp"), true);
+
+  for (auto& animation : desc.animations) {
+    auto aniPath = std::filesystem::path(desc.path).append(animation.second).concat(".ani");
+
+    manifest.animations.push_back(aniPath.lexically_relative(dataPath).generic_string());
+    addDataFileToManifest(manifest, aniPath, false);
+  }
+}
+
+// The HGP and every clip's header are read as jobs of their own, all at
+// once. A fresh HGP is baked for next time while the headers are added.
+static Mortar::Jobs::Task<Mortar::Resource::Character *> readCharacter(Mortar::Jobs::JobSystem& jobSystem, Mortar::Resource::LoadContext& context, const struct CharacterDescription& desc) {
   auto hgpPath = std::filesystem::path(desc.path).append(desc.filePrefix).concat(".hgp");
-  FileStream stream = FileStream(hgpPath.c_str(), "rb");
+  uint64_t sourceKey = getSourceKey(hgpPath);
 
-  Readers::HGPReader::read(resource, stream);
+  bool isBaked = true;
+  Mortar::Jobs::AsyncJob<Mortar::Resource::Character *> character = Mortar::Jobs::async(jobSystem, [&] () {
+    Mortar::Resource::Character *resource = readBaked<Mortar::Resource::Character>(context, hgpPath, sourceKey);
+    if (!resource) {
+      resource = context.createResource<Mortar::Resource::Character>();
 
+      std::unique_ptr<Stream> stream = openDataFile(hgpPath);
+      Readers::HGPReader::read(context, resource, *stream);
+      isBaked = false;
+    }
+
+    return resource;
+  });
+
+  // Only the headers are read now; each clip is loaded the first time an
+  // actor plays it
+  std::vector<Mortar::Jobs::AsyncJob<Mortar::Resource::Animation::Header>> headers;
   for (auto& animation : desc.animations) {
-    auto animPrefix = std::filesystem::path(desc.path).append(animation.second);
+    auto aniPath = std::filesystem::path(desc.path).append(animation.second).concat(".ani");
+
+    headers.push_back(Mortar::Jobs::async(jobSystem, [aniPath] () {
+      std::unique_ptr<Stream> aniStream = openDataFile(aniPath);
+      return Readers::AnimReader::readHeader(*aniStream);
+    }));
+  }
+
+  Mortar::Resource::Character *resource = co_await character;
+
+  Mortar::Jobs::AsyncJob<void> bake = Mortar::Jobs::async(jobSystem, [resource, hgpPath, sourceKey, isBaked] () {
+    if (!isBaked) {
+      writeBaked(resource, hgpPath, sourceKey);
+    }
+  });
+
+  resource->setResourceManager(&context.getResourceManager());
 
-    auto aniPath = std::filesystem::path(animPrefix).concat(".ani");
-    FileStream stream = FileStream(aniPath.c_str(), "rb");
+  // The bake reads the character, so it's finished even if a header fails
+  std::exception_ptr error;
+  try {
+    size_t headerIdx = 0;
+    for (auto& animation : desc.animations) {
+      auto aniPath = std::filesystem::path(desc.path).append(animation.second).concat(".ani");
 
-    Mortar::Resource::Animation *ani = Readers::AnimReader::read(stream);
-    resource->addSkeletalAnimation(animation.first, ani);
+      Mortar::Resource::Animation::Header header = co_await headers[headerIdx];
+      headerIdx++;
+
+      std::string aniName = aniPath.lexically_relative(dataPath).generic_string();
+      resource->addSkeletalAnimation(animation.first, aniName, header);
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  co_await bake;
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  co_return resource;
+}
+
+Mortar::Resource::Character *CharacterLoader::operator()(const std::string &name) {
+  PROFILE_ZONE("CharacterLoader");
+
+  if (!charDescriptions.contains(name)) {
+    throw std::runtime_error("unknown scene name");
   }
 
+  Resource::LoadContext context(State::getResourceManager());
+
+  struct CharacterDescription& desc = charDescriptions.at(name);
+
+  Mortar::Resource::Character *resource = Jobs::runTask(State::getJobSystem(), readCharacter(State::getJobSystem(), context, desc));
+
+  context.commit();
+
   return resource;
 }
@@ -0,0 +1,195 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+#include "../../../log.hpp"
+#include "../readers/baked.hpp"
+#include "../../../streams/bufferedstream.hpp"
+#include "../../../streams/filestream.hpp"
+#include "../../../streams/mappedfilestream.hpp"
+#include "../../../streams/packfile.hpp"
+#include "loaders.hpp"
+
+static PackFile *getDataPack() {
+  static std::once_flag opened;
+  static std::unique_ptr<PackFile> pack;
+
+  std::call_once(opened, [] () {
+    if (!std::filesystem::exists(Mortar::Game::LSW::dataPackPath)) {
+      return;
+    }
+
+    try {
+      pack = std::make_unique<PackFile>(Mortar::Game::LSW::dataPackPath.c_str());
+    } catch (std::ifstream::failure& e) {
+      DEBUG("unable to open %s (%s), using loose files", Mortar::Game::LSW::dataPackPath.c_str(), e.what());
+    }
+  });
+
+  return pack.get();
+}
+
+std::unique_ptr<Stream> Mortar::Game::LSW::openDataFile(const std::filesystem::path& path) {
+  PackFile *pack = getDataPack();
+  if (pack) {
+    std::filesystem::path relative = path.lexically_relative(dataPath);
+    if (!relative.empty() && *relative.begin() != "..") {
+      std::unique_ptr<Stream> stream = pack->open(relative.generic_string());
+      if (stream) {
+        return stream;
+      }
+    }
+  }
+
+  try {
+    return std::make_unique<MappedFileStream>(path.c_str());
+  } catch (std::ifstream::failure& e) {
+    // Some network filesystems refuse mappings; a missing file will fail
+    // again below with the real error
+    DEBUG("unable to map %s (%s), using buffered reads", path.c_str(), e.what());
+  }
+
+  return std::make_unique<BufferedStream>(std::make_unique<FileStream>(path.c_str(), "rb"));
+}
+
+uint64_t Mortar::Game::LSW::getSourceKey(const std::filesystem::path& path) {
+  std::error_code error;
+
+  // Files that are only in the pack take its size and time
+  std::filesystem::path stamped = path;
+  PackFile *pack = getDataPack();
+  if (pack && !std::filesystem::exists(path) && pack->contains(path.lexically_relative(dataPath).generic_string())) {
+    stamped = dataPackPath;
+  }
+
+  uintmax_t size = std::filesystem::file_size(stamped, error);
+  if (error) {
+    return 0;
+  }
+
+  auto modified = std::filesystem::last_write_time(stamped, error);
+  if (error) {
+    return 0;
+  }
+
+  // FNV-1a over the path, then the stamp
+  uint64_t key = 0xcbf29ce484222325;
+  auto mix = [&key] (const void *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+      key = (key ^ ((const uint8_t *)data)[i]) * 0x100000001b3;
+    }
+  };
+
+  std::string name = path.generic_string();
+  int64_t ticks = modified.time_since_epoch().count();
+
+  mix(name.data(), name.size());
+  mix(&size, sizeof(size));
+  mix(&ticks, sizeof(ticks));
+
+  return key ? key : 1;
+}
+
+static std::filesystem::path getBakedPath(const std::filesystem::path& source) {
+  return std::filesystem::path(Mortar::Game::LSW::cachePath).append(source.lexically_relative(Mortar::Game::LSW::dataPath).generic_string()).concat(".baked");
+}
+
+void Mortar::Game::LSW::addDataFileToManifest(SceneManifest& manifest, const std::filesystem::path& path, bool bakeable) {
+  std::error_code error;
+
+  std::filesystem::path file = path;
+  uintmax_t size = 0;
+
+  // A current baked copy is read instead of the source. Whether it's current
+  // isn't checked here; a stale one costs a wasted read ahead at worst.
+  if (bakeable) {
+    file = getBakedPath(path);
+    size = std::filesystem::file_size(file, error);
+  }
+
+  if (!bakeable || error) {
+    file = path;
+    size = std::filesystem::file_size(file, error);
+
+    PackFile *pack = getDataPack();
+    if (pack) {
+      uint64_t packedSize = pack->getSize(path.lexically_relative(dataPath).generic_string());
+      if (packedSize) {
+        size = packedSize;
+        error.clear();
+      }
+    }
+  }
+
+  if (error) {
+    DEBUG("%s is missing from the manifest", path.c_str());
+    return;
+  }
+
+  manifest.files.push_back({ file, size });
+  manifest.size += size;
+}
+
+template <typename T>
+T *Mortar::Game::LSW::readBaked(Resource::LoadContext& context, const std::filesystem::path& source, uint64_t sourceKey) {
+  std::filesystem::path bakedPath = getBakedPath(source);
+  if (!sourceKey || !std::filesystem::exists(bakedPath)) {
+    return nullptr;
+  }
+
+  // Read into a context of our own, so a bad copy leaves nothing behind
+  Resource::LoadContext bakedContext(context.getResourceManager());
+  T *resource = bakedContext.createResource<T>();
+
+  try {
+    std::unique_ptr<Stream> stream = openDataFile(bakedPath);
+    if (!Readers::BakedReader::read(bakedContext, resource, *stream, sourceKey)) {
+      DEBUG("%s is stale", bakedPath.c_str());
+      return nullptr;
+    }
+  } catch (std::exception& e) {
+    DEBUG("unable to read %s (%s)", bakedPath.c_str(), e.what());
+    return nullptr;
+  }
+
+  context.absorb(bakedContext);
+
+  return resource;
+}
+
+template <typename T>
+void Mortar::Game::LSW::writeBaked(const T *resource, const std::filesystem::path& source, uint64_t sourceKey) {
+  if (!sourceKey) {
+    return;
+  }
+
+  std::filesystem::path bakedPath = getBakedPath(source);
+
+  try {
+    Readers::BakedWriter::write(resource, bakedPath, sourceKey);
+  } catch (std::exception& e) {
+    DEBUG("unable to write %s (%s)", bakedPath.c_str(), e.what());
+  }
+}
+
+template Mortar::Resource::Scene *Mortar::Game::LSW::readBaked(Resource::LoadContext&, const std::filesystem::path&, uint64_t);
+template Mortar::Resource::Character *Mortar::Game::LSW::readBaked(Resource::LoadContext&, const std::filesystem::path&, uint64_t);
+template void Mortar::Game::LSW::writeBaked(const Resource::Scene *, const std::filesystem::path&, uint64_t);
+template void Mortar::Game::LSW::writeBaked(const Resource::Character *, const std::filesystem::path&, uint64_t);
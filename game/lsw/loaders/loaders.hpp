@@ -18,13 +18,96 @@
 #define MORTAR_GAME_LSW_LOADERS_H
 
 #include <filesystem>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
 
+#include "../../../render/renderqueue.hpp"
+#include "../../../resource/loadcontext.hpp"
+#include "../../../resource/types/anim.hpp"
 #include "../../../resource/types/character.hpp"
 #include "../../../resource/types/scene.hpp"
+#include "../../../scene/scenefeed.hpp"
+#include "../../../streams/stream.hpp"
 
 namespace Mortar::Game::LSW {
   const std::filesystem::path dataPath { "lego_data" };
 
+  // A pack of the data directory, built with mortar-pack, is used in place of
+  // the loose files it holds when present
+  const std::filesystem::path dataPackPath { "lego_data.pak" };
+
+  // Opens a data file for reading, out of the data pack if it's there, and
+  // otherwise mapping it into memory where possible and falling back to
+  // buffered file reads where it can't be mapped
+  std::unique_ptr<Stream> openDataFile(const std::filesystem::path& path);
+
+  // Baked copies of data files live under here, at the same relative paths
+  const std::filesystem::path cachePath { "cache" };
+
+  // Identifies one version of a data file by its path, size and modification
+  // time, or the pack's for files only found there; zero if the file can't
+  // be inspected
+  uint64_t getSourceKey(const std::filesystem::path& path);
+
+  // Rebuilds a scene or character from the baked copy of source, if there is
+  // one for this version of it. Anything read from a stale or damaged copy is
+  // thrown away and null is returned.
+  template <typename T>
+  T *readBaked(Resource::LoadContext& context, const std::filesystem::path& source, uint64_t sourceKey);
+
+  // Bakes a freshly read resource for the next load. Failures are only
+  // logged, as the cache is never required.
+  template <typename T>
+  void writeBaked(const T *resource, const std::filesystem::path& source, uint64_t sourceKey);
+
+  // Lists everything loading a scene reads off disk, so it can be read ahead
+  // of time. Sizes are as stored, in the pack or on disk.
+  struct SceneManifest {
+    struct File {
+      std::filesystem::path path;
+      uint64_t size;
+    };
+
+    std::vector<std::string> characters;
+
+    // Named as AnimationLoader takes them
+    std::vector<std::string> animations;
+
+    std::vector<File> files;
+    uint64_t size = 0;
+  };
+
+  // Throws std::runtime_error for an unknown scene
+  SceneManifest getSceneManifest(const std::string& name);
+
+  // How the scene's opaque draws should use the depth buffer, as measured
+  // for its overdraw; throws std::runtime_error for an unknown scene
+  Render::DepthMode getSceneDepthMode(const std::string& name);
+
+  // The scene played after the named one, or empty if there's none
+  // described; throws std::runtime_error for an unknown scene
+  std::string getNextScene(const std::string& name);
+
+  // The next load of the named scene from its source publishes its parts to
+  // the feed as they're read; a null feed stops that. Loads of a baked copy
+  // publish nothing, as they're quick enough to wait for.
+  void watchSceneLoad(const std::string& name, std::shared_ptr<Mortar::Scene::SceneFeed> feed);
+
+  // Adds a character, its files and its animations
+  void addCharacterToManifest(SceneManifest& manifest, const std::string& name);
+
+  // Adds a data file, or its baked copy in its place where there is one and
+  // bakeable is set. Files that can't be found are left out.
+  void addDataFileToManifest(SceneManifest& manifest, const std::filesystem::path& path, bool bakeable);
+
+  // Animations are named by their path under the data directory
+  class AnimationLoader {
+    public:
+      Resource::Animation *operator()(const std::string& name);
+  };
+
   class CharacterLoader {
     public:
       Resource::Character *operator()(const std::string& name);
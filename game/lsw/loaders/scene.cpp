@@ -14,13 +14,19 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <exception>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <tsl/sparse_map.h>
+#include <vector>
 
+#include "../../../jobs/task.hpp"
+#include "../../../profiler.hpp"
+#include "../../../resource/loadcontext.hpp"
 #include "../../../state.hpp"
-#include "../../../streams/filestream.hpp"
 #include "loaders.hpp"
 #include "../readers/nup.hpp"
 
@@ -34,6 +40,11 @@ struct SceneDescription {
   std::string filePrefix;
 
   std::vector<std::string> playerCharacters;
+
+  Mortar::Render::DepthMode depthMode;
+
+  // The scene played after this one, if it's described
+  std::string nextScene;
 };
 
 tsl::sparse_map<std::string, struct SceneDescription> sceneDescriptions = {
@@ -42,29 +53,174 @@ tsl::sparse_map<std::string, struct SceneDescription> sceneDescriptions = {
     {
       std::filesystem::path(ep1Dir).append("chapter_01/negotiations_a"),
       "negotiations_a",
-      { "quigonjinn", "obiwankenobi" }
+      { "quigonjinn", "obiwankenobi" },
+      Mortar::Render::DepthMode::PREPASS,
+      ""
     }
   }
 };
 
-Mortar::Resource::Scene *SceneLoader::operator()(const std::string &name) {
+// Feeds waiting on the next load of each scene
+static std::mutex sceneFeedsMutex;
+static tsl::sparse_map<std::string, std::shared_ptr<Mortar::Scene::SceneFeed>> sceneFeeds;
+
+void Mortar::Game::LSW::watchSceneLoad(const std::string& name, std::shared_ptr<Mortar::Scene::SceneFeed> feed) {
+  std::lock_guard<std::mutex> lock(sceneFeedsMutex);
+
+  if (feed) {
+    sceneFeeds[name] = std::move(feed);
+  } else {
+    sceneFeeds.erase(name);
+  }
+}
+
+static std::shared_ptr<Mortar::Scene::SceneFeed> takeSceneFeed(const std::string& name) {
+  std::lock_guard<std::mutex> lock(sceneFeedsMutex);
+
+  auto found = sceneFeeds.find(name);
+  if (found == sceneFeeds.end()) {
+    return nullptr;
+  }
+
+  std::shared_ptr<Mortar::Scene::SceneFeed> feed = found->second;
+  sceneFeeds.erase(found);
+
+  return feed;
+}
+
+SceneManifest Mortar::Game::LSW::getSceneManifest(const std::string& name) {
   if (!sceneDescriptions.contains(name)) {
     throw std::runtime_error("unknown scene name");
   }
 
-  Mortar::Resource::Scene *resource = State::getResourceManager().createResource<Mortar::Resource::Scene>();
-
   struct SceneDescription& desc = sceneDescriptions.at(name);
 
+  SceneManifest manifest;
+  addDataFileToManifest(manifest, std::filesystem::path(desc.path).append(desc.filePrefix).concat(".nup"), true);
+
+  for (auto& charName : desc.playerCharacters) {
+    addCharacterToManifest(manifest, charName);
+  }
+
+  return manifest;
+}
+
+Mortar::Render::DepthMode Mortar::Game::LSW::getSceneDepthMode(const std::string& name) {
+  if (!sceneDescriptions.contains(name)) {
+    throw std::runtime_error("unknown scene name");
+  }
+
+  return sceneDescriptions.at(name).depthMode;
+}
+
+std::string Mortar::Game::LSW::getNextScene(const std::string& name) {
+  if (!sceneDescriptions.contains(name)) {
+    throw std::runtime_error("unknown scene name");
+  }
+
+  return sceneDescriptions.at(name).nextScene;
+}
+
+// The NUP is read as a job while the characters load. A fresh read is baked
+// for next time while the characters are still being waited on.
+static Mortar::Jobs::Task<Mortar::Resource::Scene *> readScene(Mortar::Jobs::JobSystem& jobSystem, Mortar::Resource::LoadContext& context, const struct SceneDescription& desc, std::vector<Mortar::Resource::ResourceFuture<Mortar::Resource::Character>>& playerCharacters, const Readers::NUPReader::Listener *listener) {
   auto nupPath = std::filesystem::path(desc.path).append(desc.filePrefix).concat(".nup");
-  FileStream stream = FileStream(nupPath.c_str(), "rb");
+  uint64_t sourceKey = getSourceKey(nupPath);
+
+  bool isBaked = true;
+  Mortar::Resource::Scene *resource = co_await Mortar::Jobs::async(jobSystem, [&] () {
+    Mortar::Resource::Scene *resource = readBaked<Mortar::Resource::Scene>(context, nupPath, sourceKey);
+    if (!resource) {
+      resource = context.createResource<Mortar::Resource::Scene>();
+
+      std::unique_ptr<Stream> stream = openDataFile(nupPath);
+      Readers::NUPReader::read(context, resource, *stream, listener);
+      isBaked = false;
+    }
+
+    return resource;
+  });
+
+  Mortar::Jobs::AsyncJob<void> bake = Mortar::Jobs::async(jobSystem, [resource, nupPath, sourceKey, isBaked] () {
+    if (!isBaked) {
+      writeBaked(resource, nupPath, sourceKey);
+    }
+  });
+
+  // The bake reads the scene, so it's finished even if a character fails
+  std::exception_ptr error;
+  try {
+    for (auto& pc : playerCharacters) {
+      resource->addPlayerCharacter(co_await Mortar::Jobs::async(jobSystem, [&pc] () {
+        return pc.get();
+      }));
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  co_await bake;
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  co_return resource;
+}
 
-  Readers::NUPReader::read(resource, stream);
+Mortar::Resource::Scene *SceneLoader::operator()(const std::string &name) {
+  PROFILE_ZONE("SceneLoader");
 
+  if (!sceneDescriptions.contains(name)) {
+    throw std::runtime_error("unknown scene name");
+  }
+
+  Resource::LoadContext context(State::getResourceManager());
+
+  struct SceneDescription& desc = sceneDescriptions.at(name);
+
+  // Requests and the commit are made from this thread, as they're tied to the
+  // load running on it; everything in between can run on any worker
+  std::vector<Resource::ResourceFuture<Resource::Character>> playerCharacters;
   for (auto& charName : desc.playerCharacters) {
-    Resource::Character *pc = State::getResourceManager().getResource<Resource::Character>(charName);
-    resource->addPlayerCharacter(pc);
+    playerCharacters.push_back(State::getResourceManager().getResourceAsync<Resource::Character>(charName));
   }
 
+  // Parts published to a feed may already be drawn when a later one fails,
+  // so the feed keeps what was staged
+  std::shared_ptr<Mortar::Scene::SceneFeed> feed = takeSceneFeed(name);
+
+  Readers::NUPReader::Listener listener;
+  if (feed) {
+    listener.splinesRead = [&feed] (const Resource::Scene *scene) {
+      feed->publishSplines(scene);
+    };
+    listener.texturesRead = [&feed] (const std::vector<Resource::Texture *>& textures) {
+      feed->publishTextures(textures);
+    };
+    listener.vertexBuffersRead = [&feed] (const std::vector<Resource::VertexBuffer *>& vertexBuffers) {
+      feed->publishVertexBuffers(vertexBuffers);
+    };
+    listener.meshBlockRead = [&feed] (const std::vector<Resource::Mesh *>& meshes, const std::vector<Resource::Instance *>& instances) {
+      feed->publishMeshes(meshes, instances);
+    };
+    listener.staticBatchesBuilt = [&feed] (const std::vector<Resource::Mesh *>& meshes) {
+      feed->publishMeshes(meshes, {});
+    };
+  }
+
+  Mortar::Resource::Scene *resource;
+  try {
+    resource = Jobs::runTask(State::getJobSystem(), readScene(State::getJobSystem(), context, desc, playerCharacters, feed ? &listener : nullptr));
+  } catch (...) {
+    if (feed) {
+      feed->retain(context);
+    }
+
+    throw;
+  }
+
+  context.commit();
+
   return resource;
 }
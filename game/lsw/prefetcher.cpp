@@ -0,0 +1,175 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <vector>
+
+#if defined(__unix__)
+#include <sys/resource.h>
+#endif
+
+#include "../../log.hpp"
+#include "../../resource/manager.hpp"
+#include "../../state.hpp"
+#include "prefetcher.hpp"
+
+using namespace Mortar::Game::LSW;
+
+// Pages are touched in slices of this size, with a pause after each
+#define PREFETCH_SLICE (1 << 20)
+#define PREFETCH_PAUSE std::chrono::milliseconds(1)
+#define PREFETCH_PAGE_SIZE 4096
+
+#define PREFETCH_POLL std::chrono::milliseconds(10)
+
+Prefetcher::~Prefetcher() {
+  this->shutDown();
+}
+
+void Prefetcher::initialize() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->running) {
+    return;
+  }
+
+  this->stopping = false;
+  this->running = true;
+  this->thread = std::thread(&Prefetcher::run, this);
+}
+
+void Prefetcher::shutDown() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!this->running) {
+      return;
+    }
+
+    this->stopping = true;
+    this->pending -= this->queue.size();
+    this->queue.clear();
+  }
+
+  this->condition.notify_all();
+  this->thread.join();
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->running = false;
+}
+
+void Prefetcher::prefetch(const std::string& scene, bool preload) {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!this->running) {
+      return;
+    }
+
+    this->queue.push_back({ scene, preload });
+    this->pending++;
+  }
+
+  this->condition.notify_one();
+}
+
+bool Prefetcher::isBusy() const {
+  return this->pending > 0;
+}
+
+void Prefetcher::run() {
+#if defined(__unix__)
+  // 19 is the highest nice value, so the lowest priority. Linux keeps a nice
+  // value per thread, so this only lowers our own.
+  setpriority(PRIO_PROCESS, 0, 19);
+#endif
+
+  while (true) {
+    Request request;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->condition.wait(lock, [this] () {
+        return this->stopping || !this->queue.empty();
+      });
+
+      if (this->stopping) {
+        return;
+      }
+
+      request = this->queue.front();
+      this->queue.pop_front();
+    }
+
+    try {
+      SceneManifest manifest = getSceneManifest(request.scene);
+      DEBUG("prefetching %s: %zu files, %llu bytes", request.scene.c_str(), manifest.files.size(), (unsigned long long)manifest.size);
+
+      for (auto& file : manifest.files) {
+        if (this->stopping) {
+          break;
+        }
+
+        this->warm(file);
+      }
+
+      if (request.preload && !this->stopping) {
+        Resource::ResourceManager& resourceManager = State::getResourceManager();
+
+        // Loaded on the job system like any other request. This thread only
+        // polls for it rather than helping run jobs at its low priority, then
+        // lets go so the cache decides how long it stays.
+        Resource::ResourceFuture<Resource::Scene> future = resourceManager.getResourceAsync<Resource::Scene>(request.scene);
+        while (!future.isReady()) {
+          std::this_thread::sleep_for(PREFETCH_POLL);
+        }
+
+        future.get();
+        resourceManager.releaseResource(request.scene);
+      }
+    } catch (std::exception& e) {
+      DEBUG("unable to prefetch %s (%s)", request.scene.c_str(), e.what());
+    }
+
+    this->pending--;
+  }
+}
+
+void Prefetcher::warm(const SceneManifest::File& file) {
+  std::unique_ptr<Stream> stream = openDataFile(file.path);
+
+  // Mapped files have one byte of each page read to fault it in; anything
+  // else is read through in slices and thrown away
+  const uint8_t *data = stream->data();
+  if (data) {
+    size_t size = stream->size();
+    volatile uint8_t sink = 0;
+
+    for (size_t offset = 0; offset < size && !this->stopping; offset += PREFETCH_SLICE) {
+      size_t end = std::min(size, offset + PREFETCH_SLICE);
+      for (size_t page = offset; page < end; page += PREFETCH_PAGE_SIZE) {
+        sink = sink + data[page];
+      }
+
+      std::this_thread::sleep_for(PREFETCH_PAUSE);
+    }
+
+    return;
+  }
+
+  std::vector<uint8_t> slice(PREFETCH_SLICE);
+  while (!this->stopping && stream->read(slice.data(), 1, slice.size()) == slice.size()) {
+    std::this_thread::sleep_for(PREFETCH_PAUSE);
+  }
+}
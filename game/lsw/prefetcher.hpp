@@ -0,0 +1,74 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MORTAR_GAME_LSW_PREFETCHER_H
+#define MORTAR_GAME_LSW_PREFETCHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "loaders/loaders.hpp"
+
+namespace Mortar::Game::LSW {
+  // Reads upcoming scenes' files ahead of time on a low priority thread of
+  // its own, so they come out of the page cache when the scene is loaded.
+  // Reading is paced so it doesn't compete with loads that are needed now.
+  class Prefetcher {
+    public:
+      Prefetcher() = default;
+      ~Prefetcher();
+
+      Prefetcher(const Prefetcher&) = delete;
+      Prefetcher& operator=(const Prefetcher&) = delete;
+
+      void initialize();
+
+      // Drops anything still queued and waits for the current file
+      void shutDown();
+
+      // Queues a scene's files to be read. With preload set, the scene is
+      // then loaded into the resource cache and released, so switching to it
+      // is only a lookup unless the memory budget has evicted it since.
+      void prefetch(const std::string& scene, bool preload = false);
+
+      // Scenes queued or being read
+      bool isBusy() const;
+
+    private:
+      struct Request {
+        std::string scene;
+        bool preload;
+      };
+
+      void run();
+      void warm(const SceneManifest::File& file);
+
+      std::thread thread;
+
+      mutable std::mutex mutex;
+      std::condition_variable condition;
+      std::deque<Request> queue;
+      bool running = false;
+
+      std::atomic<bool> stopping { false };
+      std::atomic<unsigned> pending { 0 };
+  };
+}
+
+#endif
@@ -14,12 +14,15 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <assert.h>
 #include <bitset>
 #include <cstdio>
 #include <stdexcept>
+#include <vector>
 
 #include "../../../log.hpp"
+#include "../../../profiler.hpp"
 #include "../../../state.hpp"
 #include "anim.hpp"
 
@@ -64,16 +67,11 @@ inline Mortar::Resource::Animation::KeyframeType translateKeyframeType(uint8_t t
   }
 }
 
-Mortar::Resource::Animation *AnimReader::read(Stream& stream) {
-  Mortar::Resource::ResourceManager resourceManager = Mortar::State::getResourceManager();
-  Mortar::Resource::Animation *animation = resourceManager.createResource<Mortar::Resource::Animation>();
-
-  struct LSWAnimFileHeader fileHeader;
+static void readHeaders(Stream& stream, struct LSWAnimFileHeader& fileHeader, struct LSWAnimDataHeader& dataHeader) {
   fileHeader.version = stream.readUint32();
   fileHeader.globalAdjust = stream.readUint32();
   fileHeader.dataHeaderOffset = stream.readUint32();
 
-  struct LSWAnimDataHeader dataHeader;
   stream.seek(fileHeader.dataHeaderOffset - fileHeader.globalAdjust, SEEK_SET);
   dataHeader.lengthInFrames = stream.readFloat();
   dataHeader.elementCount = stream.readUint16();
@@ -85,6 +83,26 @@ Mortar::Resource::Animation *AnimReader::read(Stream& stream) {
   dataHeader.channelsOffset = stream.readUint32();
   dataHeader.keyframeTypesOffset = stream.readUint32();
   dataHeader.flagsOffset = stream.readUint32();
+}
+
+Mortar::Resource::Animation::Header AnimReader::readHeader(Stream& stream) {
+  PROFILE_ZONE("AnimReader::readHeader");
+
+  struct LSWAnimFileHeader fileHeader;
+  struct LSWAnimDataHeader dataHeader;
+  readHeaders(stream, fileHeader, dataHeader);
+
+  return { dataHeader.lengthInFrames, dataHeader.elementCount, dataHeader.intervalCount };
+}
+
+Mortar::Resource::Animation *AnimReader::read(Mortar::Resource::LoadContext& context, Stream& stream) {
+  PROFILE_ZONE("AnimReader::read");
+
+  Mortar::Resource::Animation *animation = context.createResource<Mortar::Resource::Animation>();
+
+  struct LSWAnimFileHeader fileHeader;
+  struct LSWAnimDataHeader dataHeader;
+  readHeaders(stream, fileHeader, dataHeader);
 
   animation->setLength(dataHeader.lengthInFrames);
   animation->setIntervalCount(dataHeader.intervalCount);
@@ -138,8 +156,11 @@ Mortar::Resource::Animation *AnimReader::read(Stream& stream) {
     assert(lswChannels[i].dataOffset != 0);
   }
 
+  std::vector<Mortar::Resource::Animation::Channel *> stagedChannels;
+  std::vector<std::vector<float>> stagedData;
+
   for (int i = 0; i < dataHeader.elementCount; i++) {
-    Mortar::Resource::Animation::Element *element = resourceManager.createResource<Mortar::Resource::Animation::Element>();
+    Mortar::Resource::Animation::Element *element = context.createResource<Mortar::Resource::Animation::Element>();
     animation->addElement(element);
 
     uint32_t flags = elementFlags.at(i);
@@ -151,7 +172,7 @@ Mortar::Resource::Animation *AnimReader::read(Stream& stream) {
     for (int j = 0; j < dataHeader.channelsPerElementCount; j++) {
       unsigned channelIdx = i * dataHeader.channelsPerElementCount + j;
 
-      Mortar::Resource::Animation::Channel *channel = resourceManager.createResource<Mortar::Resource::Animation::Channel>();
+      Mortar::Resource::Animation::Channel *channel = context.createResource<Mortar::Resource::Animation::Channel>();
       element->addChannel(channel);
 
       Mortar::Resource::Animation::KeyframeType keyframeType = translateKeyframeType(keyframeTypes[channelIdx]);
@@ -193,12 +214,12 @@ Mortar::Resource::Animation *AnimReader::read(Stream& stream) {
       if (keyframeType == Mortar::Resource::Animation::KeyframeType::FLOAT) {
         unsigned floatCount = (keyframeCount + 1) * 4;
 
-        float *data = (float *)calloc(floatCount, sizeof(float));
-        for (int k = 0; k < floatCount; k++) {
-          data[k] = stream.readFloat();
-        }
+        // Only kept resident if the animation can't be baked
+        std::vector<float>& data = stagedData.emplace_back(floatCount);
+        stream.readArray(data.data(), floatCount);
 
-        channel->setData(data, floatCount * sizeof(float));
+        stagedChannels.push_back(channel);
+        channel->setData(data.data(), floatCount * sizeof(float));
       } else {
         DEBUG("unimplemented keyframe type %d", keyframeType);
         throw std::runtime_error("unimplemented keyframe type");
@@ -206,5 +227,19 @@ Mortar::Resource::Animation *AnimReader::read(Stream& stream) {
     }
   }
 
+  animation->bake(Mortar::State::animTolerance);
+
+  for (size_t i = 0; i < stagedChannels.size(); i++) {
+    if (animation->isBaked()) {
+      stagedChannels[i]->setData(nullptr, 0);
+      continue;
+    }
+
+    float *data = context.allocateArray<Resource::Animation::Channel, float>(stagedData[i].size());
+    std::copy(stagedData[i].begin(), stagedData[i].end(), data);
+
+    stagedChannels[i]->setData(data, stagedData[i].size() * sizeof(float));
+  }
+
   return animation;
 }
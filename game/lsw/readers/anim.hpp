@@ -17,13 +17,17 @@
 #ifndef MORTAR_LSW_READERS_ANIM_H
 #define MORTAR_LSW_READERS_ANIM_H
 
+#include "../../../resource/loadcontext.hpp"
 #include "../../../streams/stream.hpp"
 #include "../../../resource/types/anim.hpp"
 
 namespace Mortar::Game::LSW::Readers {
   class AnimReader {
     public:
-      static Resource::Animation *read(Stream& stream);
+      static Resource::Animation *read(Resource::LoadContext& context, Stream& stream);
+
+      // Reads no further than the header, for clips that aren't loaded yet
+      static Resource::Animation::Header readHeader(Stream& stream);
   };
 }
 
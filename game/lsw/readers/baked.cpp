@@ -0,0 +1,827 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <bit>
+#include <forward_list>
+#include <fstream>
+#include <stdexcept>
+#include <string.h>
+#include <string>
+#include <tsl/sparse_map.h>
+#include <type_traits>
+#include <vector>
+
+#include "../../../profiler.hpp"
+#include "../../../resource/types/instance.hpp"
+#include "../../../resource/types/joint.hpp"
+#include "../../../resource/types/layer.hpp"
+#include "../../../resource/types/material.hpp"
+#include "../../../resource/types/mesh.hpp"
+#include "../../../resource/types/model.hpp"
+#include "../../../resource/types/spline.hpp"
+#include "../../../resource/types/texture.hpp"
+#include "../../../resource/types/vertex.hpp"
+#include "baked.hpp"
+#include "common.hpp"
+
+using namespace Mortar::Game::LSW::Readers;
+
+#define BAKED_MAGIC 0x4b41424d // "MBAK"
+
+// Bump whenever the records change, or whatever the readers derive at load
+// does, such as index order or vertex packing
+#define BAKED_VERSION 4
+
+#define BAKED_PAGE_SIZE 4096
+#define BAKED_BLOB_ALIGNMENT 64
+
+enum class BakedKind : uint32_t {
+  SCENE = 1,
+  CHARACTER = 2,
+};
+
+struct BakedHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t kind;
+  uint32_t recordsSize;
+  uint32_t sourceKeyLow;
+  uint32_t sourceKeyHigh;
+  uint32_t blobsOffset;
+  uint32_t blobsSize;
+};
+
+template <>
+struct StructLayout<BakedHeader> {
+  static constexpr size_t size = 0x20;
+  static constexpr auto fields = std::tuple {
+    field(&BakedHeader::magic,         0x0),
+    field(&BakedHeader::version,       0x4),
+    field(&BakedHeader::kind,          0x8),
+    field(&BakedHeader::recordsSize,   0xc),
+    field(&BakedHeader::sourceKeyLow,  0x10),
+    field(&BakedHeader::sourceKeyHigh, 0x14),
+    field(&BakedHeader::blobsOffset,   0x18),
+    field(&BakedHeader::blobsSize,     0x1c),
+  };
+};
+
+// Objects are numbered as they're written and referred to by number, plus
+// one so that zero can stand for null. Everything is written before anything
+// refers to it.
+class BakedArchiveWriter {
+  public:
+    void putUint32(uint32_t value) {
+      for (int i = 0; i < 4; i++) {
+        this->records.push_back((value >> (i * 8)) & 0xff);
+      }
+    }
+
+    void putFloat(float value) {
+      this->putUint32(std::bit_cast<uint32_t>(value));
+    }
+
+    void putFloats(const float *values, size_t count) {
+      for (size_t i = 0; i < count; i++) {
+        this->putFloat(values[i]);
+      }
+    }
+
+    void putVector(const Mortar::Math::Vector& v) {
+      this->putFloats(&v.x, 4);
+    }
+
+    void putString(std::string_view string) {
+      this->putUint32(string.size());
+      this->records.insert(this->records.end(), string.begin(), string.end());
+    }
+
+    void putBlob(const void *data, size_t size) {
+      if (!data) {
+        size = 0;
+      }
+
+      this->blobsSize = (this->blobsSize + BAKED_BLOB_ALIGNMENT - 1) / BAKED_BLOB_ALIGNMENT * BAKED_BLOB_ALIGNMENT;
+      this->blobs.push_back({ data, size, this->blobsSize });
+
+      this->putUint32(this->blobsSize);
+      this->putUint32(size);
+
+      this->blobsSize += size;
+    }
+
+    void define(const Mortar::Resource::Resource *object) {
+      this->objects[object] = ++this->objectCount;
+    }
+
+    bool isDefined(const Mortar::Resource::Resource *object) const {
+      return this->objects.contains(object);
+    }
+
+    void putRef(const Mortar::Resource::Resource *object) {
+      if (!object) {
+        this->putUint32(0);
+      } else if (!this->objects.contains(object)) {
+        throw std::runtime_error("baked object refers to one that wasn't written");
+      } else {
+        this->putUint32(this->objects.at(object));
+      }
+    }
+
+    void save(const std::filesystem::path& path, BakedKind kind, uint64_t sourceKey) const;
+
+  private:
+    struct Blob {
+      const void *data;
+      size_t size;
+      size_t offset;
+    };
+
+    std::vector<uint8_t> records;
+    std::vector<Blob> blobs;
+    size_t blobsSize = 0;
+
+    tsl::sparse_map<const Mortar::Resource::Resource *, uint32_t> objects;
+    uint32_t objectCount = 0;
+};
+
+static void putHeaderField(std::vector<uint8_t>& out, size_t offset, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out[offset + i] = (value >> (i * 8)) & 0xff;
+  }
+}
+
+void BakedArchiveWriter::save(const std::filesystem::path& path, BakedKind kind, uint64_t sourceKey) const {
+  size_t blobsOffset = StructLayout<BakedHeader>::size + this->records.size();
+  blobsOffset = (blobsOffset + BAKED_PAGE_SIZE - 1) / BAKED_PAGE_SIZE * BAKED_PAGE_SIZE;
+
+  if (blobsOffset + this->blobsSize > UINT32_MAX) {
+    throw std::runtime_error("baked file too large");
+  }
+
+  std::vector<uint8_t> header (StructLayout<BakedHeader>::size);
+  putHeaderField(header, 0x0, BAKED_MAGIC);
+  putHeaderField(header, 0x4, BAKED_VERSION);
+  putHeaderField(header, 0x8, (uint32_t)kind);
+  putHeaderField(header, 0xc, this->records.size());
+  putHeaderField(header, 0x10, sourceKey & 0xffffffff);
+  putHeaderField(header, 0x14, sourceKey >> 32);
+  putHeaderField(header, 0x18, blobsOffset);
+  putHeaderField(header, 0x1c, this->blobsSize);
+
+  std::filesystem::create_directories(path.parent_path());
+
+  std::filesystem::path temporaryPath = path;
+  temporaryPath += ".tmp";
+
+  {
+    std::ofstream out (temporaryPath, std::ios::binary | std::ios::trunc);
+    out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+    out.write((const char *)header.data(), header.size());
+    out.write((const char *)this->records.data(), this->records.size());
+
+    std::vector<char> padding (BAKED_PAGE_SIZE, 0);
+    size_t position = header.size() + this->records.size();
+    out.write(padding.data(), blobsOffset - position);
+    position = blobsOffset;
+
+    for (auto& blob : this->blobs) {
+      out.write(padding.data(), blobsOffset + blob.offset - position);
+      out.write((const char *)blob.data, blob.size);
+      position = blobsOffset + blob.offset + blob.size;
+    }
+  }
+
+  std::filesystem::rename(temporaryPath, path);
+}
+
+class BakedArchiveReader {
+  public:
+    BakedArchiveReader(Mortar::Resource::LoadContext& context, Stream& stream)
+      : context { context }, stream { stream } {};
+
+    // Checks the header and leaves the stream at the first record
+    bool open(BakedKind kind, uint64_t sourceKey) {
+      this->stream.seek(0, SEEK_SET);
+      struct BakedHeader header = this->stream.readStruct<BakedHeader>();
+
+      if (header.magic != BAKED_MAGIC || header.version != BAKED_VERSION || header.kind != (uint32_t)kind) {
+        return false;
+      }
+
+      if ((((uint64_t)header.sourceKeyHigh << 32) | header.sourceKeyLow) != sourceKey) {
+        return false;
+      }
+
+      this->recordsEnd = StructLayout<BakedHeader>::size + header.recordsSize;
+      this->blobsOffset = header.blobsOffset;
+      this->blobsSize = header.blobsSize;
+
+      if (this->recordsEnd > this->blobsOffset) {
+        throw std::runtime_error("baked file is damaged");
+      }
+
+      return true;
+    }
+
+    uint32_t getUint32() {
+      this->checkRecord(sizeof(uint32_t));
+      return this->stream.readUint32();
+    }
+
+    float getFloat() {
+      return std::bit_cast<float>(this->getUint32());
+    }
+
+    // Reads how many records of elementSize bytes follow, checking they fit
+    // in the records left before anything is sized by it
+    uint32_t getCount(size_t elementSize) {
+      uint32_t count = this->getUint32();
+      this->checkRecord((uint64_t)count * elementSize);
+
+      return count;
+    }
+
+    void getFloats(float *values, size_t count) {
+      this->checkRecord(count * sizeof(float));
+      this->stream.readArray(values, count);
+    }
+
+    Mortar::Math::Vector getVector() {
+      Mortar::Math::Vector v;
+      this->getFloats(&v.x, 4);
+
+      return v;
+    }
+
+    // Copied into the load's arena, so it lives as long as its resources
+    const char *getString() {
+      uint32_t length = this->getUint32();
+      this->checkRecord(length);
+
+      char *string = this->context.allocateArray<char>(length + 1);
+      this->stream.readArray(string, length);
+
+      return string;
+    }
+
+    // Blobs are referenced in a mapped file's image, and copied otherwise.
+    // Returns the blob's size in bytes.
+    template <typename T>
+    uint32_t getBlob(T *target) {
+      typedef std::remove_const_t<std::remove_pointer_t<decltype(target->getData())>> E;
+
+      uint32_t offset = this->getUint32();
+      uint32_t size = this->getUint32();
+
+      if (offset > this->blobsSize || size > this->blobsSize - offset || size % sizeof(E)) {
+        throw std::runtime_error("baked file is damaged");
+      }
+
+      long blobOffset = this->blobsOffset + offset;
+      size_t count = size / sizeof(E);
+
+      std::shared_ptr<const void> backing = this->stream.getBacking();
+      if (backing && this->stream.canView<E>(blobOffset, count)) {
+        target->setData(this->stream.view<E>(blobOffset, count).data(), backing);
+      } else {
+        long position = this->stream.tell();
+        this->stream.seek(blobOffset, SEEK_SET);
+
+        E *data = new E[count];
+        this->stream.readArray(data, count);
+        target->setData(data);
+
+        this->stream.seek(position, SEEK_SET);
+      }
+
+      this->context.accountSize<T>(size);
+
+      return size;
+    }
+
+    template <Mortar::Resource::ResourceType T>
+    T *create() {
+      T *object = this->context.createResource<T>();
+      this->objects.push_back(object);
+
+      return object;
+    }
+
+    // Only a damaged file can name an object of another type, and the
+    // version check keeps out files written by other builds
+    template <typename T>
+    T *getRef() {
+      uint32_t idx = this->getUint32();
+      if (!idx) {
+        return nullptr;
+      }
+
+      return static_cast<T *>(this->objects.at(idx - 1));
+    }
+
+    Mortar::Resource::LoadContext& getContext() {
+      return this->context;
+    }
+
+  private:
+    void checkRecord(size_t size) {
+      long position = this->stream.tell();
+      if (position < 0 || (size_t)position > this->recordsEnd || size > this->recordsEnd - position) {
+        throw std::runtime_error("baked file is damaged");
+      }
+    }
+
+    Mortar::Resource::LoadContext& context;
+    Stream& stream;
+
+    size_t recordsEnd = 0;
+    size_t blobsOffset = 0;
+    size_t blobsSize = 0;
+
+    std::vector<Mortar::Resource::Resource *> objects;
+};
+
+static uint32_t getVertexLayoutIdx(const Mortar::Resource::VertexLayout& vertexLayout) {
+  auto layouts = MeshesReader::getVertexLayouts();
+  auto layout = std::find(layouts.begin(), layouts.end(), &vertexLayout);
+
+  return layout == layouts.end() ? UINT32_MAX : layout - layouts.begin();
+}
+
+static const Mortar::Resource::VertexLayout& getVertexLayout(uint32_t idx) {
+  if (idx == UINT32_MAX) {
+    return Mortar::Resource::VertexLayout::EMPTY;
+  }
+
+  return *MeshesReader::getVertexLayouts()[std::min<size_t>(idx, MeshesReader::getVertexLayouts().size() - 1)];
+}
+
+/* Models. Meshes reach materials, textures and vertex buffers the model's
+ * own lists don't hold, such as compacted copies, so everything they refer
+ * to is written first. */
+static void writeModel(BakedArchiveWriter& archive, const Mortar::Resource::Model *model) {
+  std::vector<const Mortar::Resource::Texture *> textures;
+  std::vector<const Mortar::Resource::VertexBuffer *> vertexBuffers;
+  std::vector<const Mortar::Resource::Material *> materials;
+
+  tsl::sparse_map<const void *, bool> seen;
+  auto addOnce = [&] (auto& list, auto object) {
+    if (object && !seen.contains(object)) {
+      seen[object] = true;
+      list.push_back(object);
+    }
+  };
+
+  for (auto texture : model->getTextures()) {
+    addOnce(textures, texture);
+  }
+
+  for (auto vertexBuffer : model->getVertexBuffers()) {
+    addOnce(vertexBuffers, vertexBuffer);
+  }
+
+  for (auto mesh : model->getMeshes()) {
+    addOnce(materials, mesh->getMaterial());
+    addOnce(vertexBuffers, mesh->getVertexBuffer());
+  }
+
+  for (auto material : materials) {
+    addOnce(textures, material->getTexture());
+  }
+
+  archive.putUint32(textures.size());
+  for (auto texture : textures) {
+    archive.define(texture);
+
+    archive.putUint32(texture->getIsCompressed());
+    archive.putUint32(texture->getFormat());
+    archive.putUint32(texture->getInternalFormat());
+    archive.putUint32(texture->getWidth());
+    archive.putUint32(texture->getHeight());
+
+    archive.putUint32(texture->getLevels().size());
+    for (auto level : texture->getLevels()) {
+      archive.putUint32(level->getLevel());
+      archive.putBlob(level->getData(), level->getSize());
+    }
+  }
+
+  archive.putUint32(vertexBuffers.size());
+  for (auto vertexBuffer : vertexBuffers) {
+    archive.define(vertexBuffer);
+    archive.putBlob(vertexBuffer->getData(), vertexBuffer->getSize());
+  }
+
+  archive.putUint32(materials.size());
+  for (auto material : materials) {
+    archive.define(material);
+
+    archive.putUint32(material->isAlphaBlended());
+    archive.putUint32(material->isDynamicallyLit());
+    archive.putFloats(material->getColor(), 3);
+    archive.putRef(material->getTexture());
+  }
+
+  archive.putUint32(model->getMeshes().size());
+  for (auto mesh : model->getMeshes()) {
+    archive.define(mesh);
+
+    archive.putRef(mesh->getMaterial());
+    archive.putRef(mesh->getVertexBuffer());
+    archive.putUint32(getVertexLayoutIdx(mesh->getVertexLayout()));
+    archive.putUint32((uint32_t)mesh->getShaderType());
+    archive.putUint32(mesh->getUsesPaletteIndices());
+    archive.putVector(mesh->getBounds().center);
+    archive.putVector(mesh->getBounds().extents);
+
+    archive.putUint32(mesh->getSurfaces().size());
+    for (auto surface : mesh->getSurfaces()) {
+      const Mortar::Resource::IndexBuffer *indexBuffer = surface->getIndexBuffer();
+
+      archive.putUint32((uint32_t)surface->getPrimitiveType());
+      archive.putUint32(surface->getSkinTransformCount());
+
+      archive.putUint32(surface->getSkinTransformIndices().size());
+      for (auto idx : surface->getSkinTransformIndices()) {
+        archive.putUint32(idx);
+      }
+
+      archive.putUint32(indexBuffer->getCount());
+      archive.putBlob(indexBuffer->getData(), indexBuffer->getCount() * sizeof(uint16_t));
+
+      archive.putUint32(surface->getLods().size());
+      for (auto lod : surface->getLods()) {
+        archive.putUint32(lod->getCount());
+        archive.putBlob(lod->getData(), lod->getCount() * sizeof(uint16_t));
+      }
+    }
+  }
+
+  archive.putUint32(model->getTextures().size());
+  for (auto texture : model->getTextures()) {
+    archive.putRef(texture);
+  }
+
+  archive.putUint32(model->getVertexBuffers().size());
+  for (auto vertexBuffer : model->getVertexBuffers()) {
+    archive.putRef(vertexBuffer);
+  }
+}
+
+static Mortar::Resource::Model *readModel(BakedArchiveReader& archive) {
+  using namespace Mortar::Resource;
+
+  Model *model = archive.getContext().createResource<Model>();
+
+  uint32_t textureCount = archive.getUint32();
+  for (uint32_t i = 0; i < textureCount; i++) {
+    Texture *texture = archive.create<Texture>();
+
+    texture->setIsCompressed(archive.getUint32());
+    texture->setFormat(archive.getUint32());
+    texture->setInternalFormat(archive.getUint32());
+    texture->setWidth(archive.getUint32());
+    texture->setHeight(archive.getUint32());
+
+    uint32_t levelCount = archive.getUint32();
+    for (uint32_t j = 0; j < levelCount; j++) {
+      Texture::Level *level = archive.getContext().createResource<Texture::Level>();
+
+      level->setLevel(archive.getUint32());
+      level->setSize(archive.getBlob(level));
+
+      texture->addLevel(level);
+    }
+
+    texture->computeContentHash();
+  }
+
+  uint32_t vertexBufferCount = archive.getUint32();
+  for (uint32_t i = 0; i < vertexBufferCount; i++) {
+    VertexBuffer *vertexBuffer = archive.create<VertexBuffer>();
+    vertexBuffer->setSize(archive.getBlob(vertexBuffer));
+    vertexBuffer->computeContentHash();
+  }
+
+  uint32_t materialCount = archive.getUint32();
+  for (uint32_t i = 0; i < materialCount; i++) {
+    Material *material = archive.create<Material>();
+
+    material->setIsAlphaBlended(archive.getUint32());
+    material->setIsDynamicallyLit(archive.getUint32());
+
+    float color[3];
+    archive.getFloats(color, 3);
+    material->setColor(color[0], color[1], color[2]);
+
+    material->setTexture(archive.getRef<Texture>());
+  }
+
+  uint32_t meshCount = archive.getUint32();
+  for (uint32_t i = 0; i < meshCount; i++) {
+    Mesh *mesh = archive.create<Mesh>();
+    model->addMesh(mesh);
+
+    mesh->setMaterial(archive.getRef<Material>());
+    mesh->setVertexBuffer(archive.getRef<VertexBuffer>());
+    mesh->setVertexLayout(getVertexLayout(archive.getUint32()));
+    mesh->setShaderType((ShaderType)archive.getUint32());
+    mesh->setUsesPaletteIndices(archive.getUint32());
+
+    Mortar::Math::AABB bounds;
+    bounds.center = archive.getVector();
+    bounds.extents = archive.getVector();
+    mesh->setBounds(bounds);
+
+    uint32_t surfaceCount = archive.getUint32();
+    for (uint32_t j = 0; j < surfaceCount; j++) {
+      Surface *surface = archive.getContext().createResource<Surface>();
+      mesh->addSurface(surface);
+
+      surface->setPrimitiveType((PrimitiveType)archive.getUint32());
+      surface->setSkinTransformCount(archive.getUint32());
+
+      std::vector<ushort> skinTransformIndices (archive.getCount(sizeof(uint32_t)));
+      for (auto& idx : skinTransformIndices) {
+        idx = archive.getUint32();
+      }
+      surface->setSkinTransformIndices(skinTransformIndices);
+
+      IndexBuffer *indexBuffer = archive.getContext().createResource<IndexBuffer>();
+      surface->setIndexBuffer(indexBuffer);
+
+      uint32_t count = archive.getUint32();
+      if (archive.getBlob(indexBuffer) != count * sizeof(uint16_t)) {
+        throw std::runtime_error("baked file is damaged");
+      }
+      indexBuffer->setCount(count);
+
+      uint32_t lodCount = archive.getUint32();
+      if (lodCount >= Mesh::MAX_LODS) {
+        throw std::runtime_error("baked file is damaged");
+      }
+
+      for (uint32_t k = 0; k < lodCount; k++) {
+        IndexBuffer *lod = archive.getContext().createResource<IndexBuffer>();
+        surface->addLod(lod);
+
+        uint32_t lodIndexCount = archive.getUint32();
+        if (archive.getBlob(lod) != lodIndexCount * sizeof(uint16_t)) {
+          throw std::runtime_error("baked file is damaged");
+        }
+        lod->setCount(lodIndexCount);
+      }
+    }
+  }
+
+  uint32_t modelTextureCount = archive.getUint32();
+  for (uint32_t i = 0; i < modelTextureCount; i++) {
+    model->addTexture(archive.getRef<Texture>());
+  }
+
+  uint32_t modelVertexBufferCount = archive.getUint32();
+  for (uint32_t i = 0; i < modelVertexBufferCount; i++) {
+    model->addVertexBuffer(archive.getRef<VertexBuffer>());
+  }
+
+  return model;
+}
+
+/* Scenes. Player characters are loads of their own and aren't baked here. */
+void BakedWriter::write(const Resource::Scene *scene, const std::filesystem::path& path, uint64_t sourceKey) {
+  BakedArchiveWriter archive;
+
+  writeModel(archive, scene->getModel());
+
+  archive.putUint32(scene->getInstances().size());
+  for (auto instance : scene->getInstances()) {
+    archive.putFloats(instance->getWorldTransform().f, 12);
+
+    std::vector<const Resource::Mesh *> meshes (instance->getMeshes().begin(), instance->getMeshes().end());
+    archive.putUint32(meshes.size());
+    for (auto mesh : meshes) {
+      archive.putRef(mesh);
+    }
+  }
+
+  archive.putUint32(scene->getSplines().size());
+  for (auto& spline : scene->getSplines()) {
+    archive.putString(spline.name);
+
+    archive.putUint32(spline.spline->getVertexCount());
+    for (size_t i = 0; i < spline.spline->getVertexCount(); i++) {
+      archive.putVector(spline.spline->getVertex(i));
+    }
+  }
+
+  archive.save(path, BakedKind::SCENE, sourceKey);
+}
+
+bool BakedReader::read(Resource::LoadContext& context, Resource::Scene *scene, Stream& stream, uint64_t sourceKey) {
+  PROFILE_ZONE("BakedReader::read scene");
+
+  BakedArchiveReader archive (context, stream);
+  if (!archive.open(BakedKind::SCENE, sourceKey)) {
+    return false;
+  }
+
+  scene->setModel(readModel(archive));
+
+  uint32_t instanceCount = archive.getUint32();
+  for (uint32_t i = 0; i < instanceCount; i++) {
+    Resource::Instance *instance = context.createResource<Resource::Instance>();
+    scene->addInstance(instance);
+
+    Math::Affine worldTransform;
+    archive.getFloats(worldTransform.f, 12);
+    instance->setWorldTransform(worldTransform);
+
+    std::vector<Resource::Mesh *> meshes (archive.getCount(sizeof(uint32_t)));
+    for (auto& mesh : meshes) {
+      mesh = archive.getRef<Resource::Mesh>();
+    }
+
+    instance->setMeshes(std::forward_list<Resource::Mesh *>(meshes.begin(), meshes.end()));
+  }
+
+  uint32_t splineCount = archive.getUint32();
+  for (uint32_t i = 0; i < splineCount; i++) {
+    const char *name = archive.getString();
+
+    Resource::Spline *spline = context.createResource<Resource::Spline>();
+    scene->addSpline(name, spline);
+
+    uint32_t vertexCount = archive.getUint32();
+    for (uint32_t j = 0; j < vertexCount; j++) {
+      spline->addVertex(archive.getVector());
+    }
+  }
+
+  return true;
+}
+
+/* Characters. Animation headers come from the clips themselves, which are
+ * read on demand, so only the HGP's graph is baked. */
+void BakedWriter::write(const Resource::Character *character, const std::filesystem::path& path, uint64_t sourceKey) {
+  BakedArchiveWriter archive;
+
+  writeModel(archive, character->getModel());
+
+  archive.putUint32(character->getJoints().size());
+  for (auto joint : character->getJoints()) {
+    archive.putString(joint->getName());
+    archive.putUint32(joint->getParentIdx());
+    archive.putFloats(joint->getTransform().f, 12);
+    archive.putVector(joint->getAttachmentPoint());
+    archive.putUint32(joint->getIsRelativeToAttachment());
+  }
+
+  archive.putUint32(character->getRestPose().size());
+  for (auto& pose : character->getRestPose()) {
+    archive.putFloats(&pose.rotation.x, 4);
+    archive.putVector(pose.translation);
+    archive.putVector(pose.scale);
+  }
+
+  archive.putUint32(character->getSkinTransforms().size());
+  for (auto& skinTransform : character->getSkinTransforms()) {
+    archive.putFloats(skinTransform.f, 12);
+  }
+
+  archive.putUint32(character->getLayers().size());
+  for (auto layer : character->getLayers()) {
+    archive.putUint32(layer->getKinematicMeshes().size());
+    for (auto kinematic : layer->getKinematicMeshes()) {
+      archive.putRef(kinematic->getMesh());
+      archive.putUint32(kinematic->getJointIdx());
+    }
+
+    archive.putUint32(layer->getSkinMeshes().size());
+    for (auto mesh : layer->getSkinMeshes()) {
+      archive.putRef(mesh);
+    }
+
+    archive.putUint32(layer->getDeformableSkinMeshes().size());
+    for (auto mesh : layer->getDeformableSkinMeshes()) {
+      archive.putRef(mesh);
+    }
+  }
+
+  archive.putUint32(character->getLocators().size());
+  for (auto locator : character->getLocators()) {
+    archive.putFloats(locator->getTransform().f, 16);
+    archive.putUint32(locator->getJointIdx());
+  }
+
+  archive.putUint32(character->getExternalLocatorMap().size());
+  for (auto& mapping : character->getExternalLocatorMap()) {
+    archive.putUint32(mapping.first);
+    archive.putUint32(mapping.second);
+  }
+
+  archive.save(path, BakedKind::CHARACTER, sourceKey);
+}
+
+bool BakedReader::read(Resource::LoadContext& context, Resource::Character *character, Stream& stream, uint64_t sourceKey) {
+  PROFILE_ZONE("BakedReader::read character");
+
+  BakedArchiveReader archive (context, stream);
+  if (!archive.open(BakedKind::CHARACTER, sourceKey)) {
+    return false;
+  }
+
+  character->setModel(readModel(archive));
+
+  uint32_t jointCount = archive.getUint32();
+  for (uint32_t i = 0; i < jointCount; i++) {
+    Resource::Joint *joint = context.createResource<Resource::Joint>();
+    character->addJoint(joint);
+
+    joint->setName(archive.getString());
+    joint->setParentIdx((int32_t)archive.getUint32());
+
+    Math::Affine transform;
+    archive.getFloats(transform.f, 12);
+    joint->setTransform(transform);
+
+    Math::Vector attachment = archive.getVector();
+    joint->setAttachmentPoint(attachment);
+
+    joint->setIsRelativeToAttachment(archive.getUint32());
+  }
+
+  std::vector<Math::QTS> restPose (archive.getCount(12 * sizeof(float)));
+  for (auto& pose : restPose) {
+    archive.getFloats(&pose.rotation.x, 4);
+    pose.translation = archive.getVector();
+    pose.scale = archive.getVector();
+  }
+  character->setRestPose(restPose);
+
+  uint32_t skinTransformCount = archive.getUint32();
+  for (uint32_t i = 0; i < skinTransformCount; i++) {
+    Math::Affine skinTransform;
+    archive.getFloats(skinTransform.f, 12);
+    character->addSkinTransform(skinTransform);
+  }
+
+  uint32_t layerCount = archive.getUint32();
+  for (uint32_t i = 0; i < layerCount; i++) {
+    Resource::Layer *layer = context.createResource<Resource::Layer>();
+    character->addLayer(layer);
+
+    uint32_t kinematicCount = archive.getUint32();
+    for (uint32_t j = 0; j < kinematicCount; j++) {
+      Resource::KinematicMesh *kinematic = context.createResource<Resource::KinematicMesh>();
+
+      kinematic->setMesh(archive.getRef<Resource::Mesh>());
+      kinematic->setJointIdx(archive.getUint32());
+      layer->addKinematicMesh(kinematic);
+    }
+
+    uint32_t skinCount = archive.getUint32();
+    for (uint32_t j = 0; j < skinCount; j++) {
+      layer->addSkinMesh(archive.getRef<Resource::Mesh>());
+    }
+
+    uint32_t deformableCount = archive.getUint32();
+    for (uint32_t j = 0; j < deformableCount; j++) {
+      layer->addDeformableSkinMesh(archive.getRef<Resource::Mesh>());
+    }
+  }
+
+  uint32_t locatorCount = archive.getUint32();
+  for (uint32_t i = 0; i < locatorCount; i++) {
+    Resource::Character::Locator *locator = context.createResource<Resource::Character::Locator>();
+    character->addLocator(locator);
+
+    Math::Matrix transform;
+    archive.getFloats(transform.f, 16);
+    locator->setTransform(transform);
+    locator->setJointIdx(archive.getUint32());
+  }
+
+  uint32_t mappingCount = archive.getUint32();
+  for (uint32_t i = 0; i < mappingCount; i++) {
+    uint32_t external = archive.getUint32();
+    character->addExternalLocatorMapping(external, archive.getUint32());
+  }
+
+  return true;
+}
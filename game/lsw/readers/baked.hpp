@@ -0,0 +1,53 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_LSW_READERS_BAKED_H
+#define MORTAR_LSW_READERS_BAKED_H
+
+#include <filesystem>
+#include <stdint.h>
+
+#include "../../../resource/loadcontext.hpp"
+#include "../../../streams/stream.hpp"
+#include "../../../resource/types/character.hpp"
+#include "../../../resource/types/scene.hpp"
+
+namespace Mortar::Game::LSW::Readers {
+  // Baked files hold a decoded scene or character graph in the engine's own
+  // layout, so a later load rebuilds the resources without parsing the
+  // original file. The small per-object records come first; vertex, index
+  // and texture data follow in a page-aligned block and are referenced in
+  // place when the file is mapped.
+  //
+  // Each file is stamped with a key for the source it was baked from and a
+  // format version; any other key or version is treated as stale.
+  class BakedReader {
+    public:
+      // Returns false if the file is stale; throws if it's damaged
+      static bool read(Resource::LoadContext& context, Resource::Scene *scene, Stream& stream, uint64_t sourceKey);
+      static bool read(Resource::LoadContext& context, Resource::Character *character, Stream& stream, uint64_t sourceKey);
+  };
+
+  class BakedWriter {
+    public:
+      // Writes through a temporary file, so a failed write leaves any
+      // earlier file in place
+      static void write(const Resource::Scene *scene, const std::filesystem::path& path, uint64_t sourceKey);
+      static void write(const Resource::Character *character, const std::filesystem::path& path, uint64_t sourceKey);
+  };
+}
+
+#endif
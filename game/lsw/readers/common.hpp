@@ -18,8 +18,12 @@
 #define MORTAR_LSW_READERS_COMMON_H
 
 #include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tsl/sparse_map.h>
 
-#include "../../../state.hpp"
+#include "../../../resource/loadcontext.hpp"
 #include "../../../streams/stream.hpp"
 #include "../../../resource/types/material.hpp"
 #include "../../../resource/types/mesh.hpp"
@@ -27,24 +31,52 @@
 #include "../../../resource/types/vertex.hpp"
 
 namespace Mortar::Game::LSW::Readers {
+  // Names read while loading one asset. Each distinct name is stored once, in
+  // the load's arena, so the views handed out live as long as its resources
+  // and are NUL-terminated. Names are identified by their hashName().
+  class StringTable {
+    public:
+      StringTable(Resource::LoadContext& context)
+        : context { context } {};
+
+      // Reads the string at the stream's position
+      std::string_view read(Stream& stream);
+
+      std::string_view intern(std::string_view name);
+
+      // Empty if the name hasn't been interned
+      std::string_view find(uint64_t hash) const;
+
+    private:
+      Resource::LoadContext& context;
+
+      tsl::sparse_map<uint64_t, std::string_view> names;
+
+      // Strings are read into here before they're interned
+      std::string scratch;
+  };
+
   class MaterialsReader {
     public:
-      static void read(std::vector<Resource::Material *>& materials, Stream& stream, uint32_t bodyOffset, const std::vector<Resource::Texture *>& textures);
+      static void read(Resource::LoadContext& context, std::vector<Resource::Material *>& materials, Stream& stream, uint32_t bodyOffset, const std::vector<Resource::Texture *>& textures);
   };
 
   class TexturesReader {
     public:
-      static void read(std::vector<Resource::Texture *>& textures, Stream& stream, uint32_t texturesOffset);
+      static void read(Resource::LoadContext& context, std::vector<Resource::Texture *>& textures, Stream& stream, uint32_t texturesOffset);
   };
 
   class VertexBufferReader {
     public:
-      static void read(std::vector<Resource::VertexBuffer *>& vertexBuffers, Stream& stream, uint32_t bodyOffset);
+      static void read(Resource::LoadContext& context, std::vector<Resource::VertexBuffer *>& vertexBuffers, Stream& stream, uint32_t bodyOffset);
   };
 
   class MeshesReader {
     public:
-      static void read(std::vector<Resource::Mesh *>& meshes, Stream& stream, uint32_t bodyOffset, const std::vector<Resource::Material *>& materials, const std::vector<Resource::VertexBuffer *>& vertexBuffers);
+      // Every layout meshes may be given, so they can be referred to by index
+      static std::span<const Resource::VertexLayout *const> getVertexLayouts();
+
+      static void read(Resource::LoadContext& context, std::vector<Resource::Mesh *>& meshes, Stream& stream, uint32_t bodyOffset, const std::vector<Resource::Material *>& materials, const std::vector<Resource::VertexBuffer *>& vertexBuffers);
   };
 }
 
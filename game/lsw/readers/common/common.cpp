@@ -15,12 +15,14 @@
  */
 
 #include <map>
+#include <memory>
 #include <stdexcept>
 #include <stdint.h>
 #include <vector>
 
+#include "../../../../jobs/jobsystem.hpp"
 #include "../../../../log.hpp"
-#include "../../../../state.hpp"
+#include "../../../../profiler.hpp"
 #include "../../../../streams/memorystream.hpp"
 #include "../../../../resource/types/material.hpp"
 #include "../../../../resource/types/mesh.hpp"
@@ -38,6 +40,16 @@ struct LSWVertexBlock {
   uint32_t offset;
 };
 
+template <>
+struct StructLayout<LSWVertexBlock> {
+  static constexpr size_t size = 0xc;
+  static constexpr auto fields = std::tuple {
+    field(&LSWVertexBlock::size,   0x0),
+    field(&LSWVertexBlock::id,     0x4),
+    field(&LSWVertexBlock::offset, 0x8),
+  };
+};
+
 struct LSWVertexHeader {
   uint32_t num_vertex_blocks;
 
@@ -52,6 +64,14 @@ struct LSWTextureBlockHeader {
   uint32_t unk_0004[4];
 };
 
+template <>
+struct StructLayout<LSWTextureBlockHeader> {
+  static constexpr size_t size = 0x14;
+  static constexpr auto fields = std::tuple {
+    field(&LSWTextureBlockHeader::offset, 0x0),
+  };
+};
+
 struct LSWTextureHeader {
   uint32_t texture_block_offset;
   uint32_t texture_block_size;
@@ -130,8 +150,9 @@ void readMaterial(Stream &stream, LSWMaterial *material) {
   material->effectType = stream.readUint8();
 }
 
-void MaterialsReader::read(std::vector<Resource::Material *>& materials, Stream &stream, uint32_t bodyOffset, const std::vector<Resource::Texture *>& textures) {
-  Resource::ResourceManager resourceManager = State::getResourceManager();
+void MaterialsReader::read(Resource::LoadContext& context, std::vector<Resource::Material *>& materials, Stream &stream, uint32_t bodyOffset, const std::vector<Resource::Texture *>& textures) {
+  PROFILE_ZONE("MaterialsReader::read");
+
 
   struct LSWMaterialHeader material_header;
 
@@ -149,7 +170,7 @@ void MaterialsReader::read(std::vector<Resource::Material *>& materials, Stream
 
   /* Initialize per-model materials, consisting of a color and index to an in-model texture. */
   for (int i = 0; i < material_header.num_materials; i++) {
-    Resource::Material *material = resourceManager.createResource<Resource::Material>();
+    Resource::Material *material = context.createResource<Resource::Material>();
 
     struct LSWMaterial lswMaterial;
 
@@ -174,7 +195,9 @@ void MaterialsReader::read(std::vector<Resource::Material *>& materials, Stream
   delete[] material_header.material_offsets;
 }
 
-void TexturesReader::read(std::vector<Resource::Texture *>& textures, Stream &stream, uint32_t texturesOffset) {
+void TexturesReader::read(Resource::LoadContext& context, std::vector<Resource::Texture *>& textures, Stream &stream, uint32_t texturesOffset) {
+  PROFILE_ZONE("TexturesReader::read");
+
   struct LSWTextureHeader texture_header;
 
   texture_header.texture_block_offset = stream.readUint32();
@@ -188,40 +211,84 @@ void TexturesReader::read(std::vector<Resource::Texture *>& textures, Stream &st
   stream.seek(4 * sizeof(uint32_t), SEEK_CUR);
   texture_header.texture_block_headers = new struct LSWTextureBlockHeader[texture_header.num_textures];
 
+  stream.readStructs(texture_header.texture_block_headers, texture_header.num_textures);
+
+  /* A rough maximum for file size is calculated from per-texture offsets. */
+  std::vector<long> textureOffsets (texture_header.num_textures);
+  std::vector<size_t> textureSizes (texture_header.num_textures);
+
+  bool canSlice = true;
   for (int i = 0; i < texture_header.num_textures; i++) {
-    texture_header.texture_block_headers[i].offset = stream.readUint32();
+    textureOffsets[i] = texturesOffset + texture_header.texture_block_offset + texture_header.texture_block_headers[i].offset;
+
+    if (i < texture_header.num_textures - 1) {
+      textureSizes[i] = texture_header.texture_block_headers[i + 1].offset - texture_header.texture_block_headers[i].offset;
+    } else {
+      textureSizes[i] = texture_header.texture_block_size - texture_header.texture_block_headers[i].offset;
+    }
+
+    canSlice = canSlice && stream.canView<uint8_t>(textureOffsets[i], textureSizes[i]);
+  }
+
+  delete[] texture_header.texture_block_headers;
+
+  size_t firstTexture = textures.size();
+  textures.resize(firstTexture + texture_header.num_textures);
+
+  /* Parse inline DDS files sliced straight out of the file image, one job
+   * per texture, each with its own context. Levels reference the image in
+   * place when it has a backing owner, and are copied out otherwise. */
+  Jobs::JobSystem *jobSystem = context.getResourceManager().getJobSystem();
+  if (canSlice && jobSystem && jobSystem->getWorkerCount() && texture_header.num_textures > 1) {
+    std::shared_ptr<const void> backing = stream.getBacking();
+    std::vector<std::unique_ptr<Resource::LoadContext>> textureContexts (texture_header.num_textures);
+
+    jobSystem->parallelFor(texture_header.num_textures, 1, [&] (size_t i) {
+      textureContexts[i] = std::make_unique<Resource::LoadContext>(context.getResourceManager());
 
-    stream.seek(4 * sizeof(uint32_t), SEEK_CUR);
+      auto textureStream = MemoryStream(stream.view<uint8_t>(textureOffsets[i], textureSizes[i]).data(), textureSizes[i], backing);
+
+      textures[firstTexture + i] = DDSReader::read(*textureContexts[i], textureStream);
+    });
+
+    for (auto& textureContext : textureContexts) {
+      context.absorb(*textureContext);
+    }
+
+    return;
   }
 
   /* Read inline DDS textures. */
   for (int i = 0; i < texture_header.num_textures; i++) {
-    stream.seek(texturesOffset + texture_header.texture_block_offset + texture_header.texture_block_headers[i].offset, SEEK_SET);
+    long textureOffset = textureOffsets[i];
+    size_t size = textureSizes[i];
 
-    size_t size;
+    Resource::Texture *texture;
 
-    /* A rough maximum for file size is calculated from per-texture offsets. */
-    if (i < texture_header.num_textures - 1) {
-      size = texture_header.texture_block_headers[i + 1].offset - texture_header.texture_block_headers[i].offset;
+    /* Slice inline DDS files straight out of the file image when possible. */
+    if (canSlice) {
+      auto textureStream = MemoryStream(stream.view<uint8_t>(textureOffset, size).data(), size, stream.getBacking());
+
+      texture = DDSReader::read(context, textureStream);
     } else {
-      size = texture_header.texture_block_size - texture_header.texture_block_headers[i].offset;
-    }
+      stream.seek(textureOffset, SEEK_SET);
 
-    uint8_t *texture_data = new uint8_t[size];
-    for (int j = 0; j < size; j++) {
-      texture_data[j] = stream.readUint8();
-    }
+      std::vector<uint8_t> textureData (size);
+      stream.readArray(textureData.data(), size);
 
-    auto textureStream = MemoryStream(texture_data, size);
+      // Without a backing owner the DDS reader copies each level out
+      auto textureStream = MemoryStream(textureData.data(), size);
 
-    Resource::Texture *texture = DDSReader::read(textureStream);
-    textures.push_back(texture);
-  }
+      texture = DDSReader::read(context, textureStream);
+    }
 
-  delete[] texture_header.texture_block_headers;
+    textures[firstTexture + i] = texture;
+  }
 }
 
-void VertexBufferReader::read(std::vector<Resource::VertexBuffer *>& vertexBuffers, Stream &stream, uint32_t vertexHeaderOffset) {
+void VertexBufferReader::read(Resource::LoadContext& context, std::vector<Resource::VertexBuffer *>& vertexBuffers, Stream &stream, uint32_t vertexHeaderOffset) {
+  PROFILE_ZONE("VertexBufferReader::read");
+
   struct LSWVertexHeader vertex_header;
 
   vertex_header.num_vertex_blocks = stream.readUint32();
@@ -234,25 +301,31 @@ void VertexBufferReader::read(std::vector<Resource::VertexBuffer *>& vertexBuffe
 
   vertex_header.blocks = new struct LSWVertexBlock[vertex_header.num_vertex_blocks];
 
-  for (int i = 0; i < vertex_header.num_vertex_blocks; i++) {
-    vertex_header.blocks[i].size = stream.readUint32();
-    vertex_header.blocks[i].id = stream.readUint32();
-    vertex_header.blocks[i].offset = stream.readUint32();
-  }
+  stream.readStructs(vertex_header.blocks, vertex_header.num_vertex_blocks);
 
   /* Read vertex blocks into individual, indexed buffers. */
    for (int i = 0; i < vertex_header.num_vertex_blocks; i++) {
-    Resource::VertexBuffer *vertexBuffer = State::getResourceManager().createResource<Resource::VertexBuffer>();
+    Resource::VertexBuffer *vertexBuffer = context.createResource<Resource::VertexBuffer>();
     vertexBuffers.push_back(vertexBuffer);
 
     vertexBuffer->setSize(vertex_header.blocks[i].size);
 
-    stream.seek(vertexHeaderOffset + vertex_header.blocks[i].offset, SEEK_SET);
+    long blockOffset = vertexHeaderOffset + vertex_header.blocks[i].offset;
+    std::shared_ptr<const void> backing = stream.getBacking();
+    if (backing && stream.canView<uint8_t>(blockOffset, vertex_header.blocks[i].size)) {
+      vertexBuffer->setData(stream.view<uint8_t>(blockOffset, vertex_header.blocks[i].size).data(), backing);
+    } else {
+      stream.seek(blockOffset, SEEK_SET);
+
+      auto data = new uint8_t[vertex_header.blocks[i].size];
+      stream.readArray(data, vertex_header.blocks[i].size);
+
+      vertexBuffer->setData(data);
+    }
 
-    auto data = new uint8_t[vertex_header.blocks[i].size];
-    stream.read(data, sizeof(uint8_t), vertex_header.blocks[i].size);
+    vertexBuffer->computeContentHash();
 
-    vertexBuffer->setData(data);
+    context.accountSize<Resource::VertexBuffer>(vertex_header.blocks[i].size);
   }
 
   delete[] vertex_header.blocks;
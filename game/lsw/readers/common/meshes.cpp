@@ -14,11 +14,16 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <math.h>
 #include <stdexcept>
+#include <string.h>
 #include <tsl/sparse_map.h>
 
 #include "../../../../log.hpp"
-#include "../../../../state.hpp"
+#include "../../../../profiler.hpp"
+#include "../../../../resource/meshlod.hpp"
+#include "../../../../resource/meshoptimizer.hpp"
 #include "../../../../resource/types/mesh.hpp"
 #include "../common.hpp"
 
@@ -84,39 +89,254 @@ struct LSWSurface {
   uint32_t unk_004C;
 };
 
-static tsl::sparse_map<uint32_t, Mortar::Resource::VertexLayout> vertexLayouts {
+template <>
+struct StructLayout<LSWMeshHeader> {
+  static constexpr size_t size = 0x14;
+  static constexpr auto fields = std::tuple {
+    field(&LSWMeshHeader::mesh_offset, 0xc),
+  };
+};
+
+template <>
+struct StructLayout<LSWMesh> {
+  static constexpr size_t size = 0x40;
+  static constexpr auto fields = std::tuple {
+    field(&LSWMesh::next_offset,    0x0),
+    field(&LSWMesh::materialIdx,    0x8),
+    field(&LSWMesh::vertexType,     0xc),
+    field(&LSWMesh::vertexBlockIdx, 0x1c),
+    field(&LSWMesh::unk_0024,       0x24),
+    field(&LSWMesh::surfacesOffset, 0x30),
+    field(&LSWMesh::unk_0038,       0x38),
+    field(&LSWMesh::unk_003C,       0x3c),
+  };
+};
+
+template <>
+struct StructLayout<LSWSurface> {
+  static constexpr size_t size = 0x50;
+  static constexpr auto fields = std::tuple {
+    field(&LSWSurface::next_offset,         0x0),
+    field(&LSWSurface::primitiveType,       0x4),
+    field(&LSWSurface::elementCount,        0x8),
+    field(&LSWSurface::elementsOffset,      0xc),
+    field(&LSWSurface::num_skin_matrices,   0x14),
+    field(&LSWSurface::skin_matrix_indices, 0x16),
+  };
+};
+
+static constexpr Mortar::Resource::VertexLayout staticVertexLayout {
+  36,
   {
-    0x59, {
-      36,
-      {
-        { Mortar::Resource::VertexUsage::POSITION,  Mortar::Resource::VertexDataType::VEC3,     0x0  },
-        { Mortar::Resource::VertexUsage::NORMAL,    Mortar::Resource::VertexDataType::VEC3,     0xc  },
-        { Mortar::Resource::VertexUsage::COLOR,     Mortar::Resource::VertexDataType::D3DCOLOR, 0x18 },
-        { Mortar::Resource::VertexUsage::TEX_COORD, Mortar::Resource::VertexDataType::VEC2,     0x1c },
+    { Mortar::Resource::VertexUsage::POSITION,  Mortar::Resource::VertexDataType::VEC3,     0x0  },
+    { Mortar::Resource::VertexUsage::NORMAL,    Mortar::Resource::VertexDataType::VEC3,     0xc  },
+    { Mortar::Resource::VertexUsage::COLOR,     Mortar::Resource::VertexDataType::D3DCOLOR, 0x18 },
+    { Mortar::Resource::VertexUsage::TEX_COORD, Mortar::Resource::VertexDataType::VEC2,     0x1c },
+  }
+};
+
+static constexpr Mortar::Resource::VertexLayout skinnedVertexLayout {
+  56,
+  {
+    { Mortar::Resource::VertexUsage::POSITION,      Mortar::Resource::VertexDataType::VEC3,     0x0  },
+    { Mortar::Resource::VertexUsage::BLEND_WEIGHTS, Mortar::Resource::VertexDataType::VEC2,     0xc  },
+    { Mortar::Resource::VertexUsage::BLEND_INDICES, Mortar::Resource::VertexDataType::VEC3,     0x14 },
+    { Mortar::Resource::VertexUsage::NORMAL,        Mortar::Resource::VertexDataType::VEC3,     0x20 },
+    { Mortar::Resource::VertexUsage::COLOR,         Mortar::Resource::VertexDataType::D3DCOLOR, 0x2c },
+    { Mortar::Resource::VertexUsage::TEX_COORD,     Mortar::Resource::VertexDataType::VEC2,     0x30 },
+  }
+};
+
+static constexpr Mortar::Resource::VertexLayout compactStaticVertexLayout = staticVertexLayout.getCompactLayout();
+static constexpr Mortar::Resource::VertexLayout compactSkinnedVertexLayout = skinnedVertexLayout.getCompactLayout();
+
+static_assert(compactStaticVertexLayout.getStride() == 24);
+static_assert(compactSkinnedVertexLayout.getStride() == 32);
+
+static constexpr const Mortar::Resource::VertexLayout *vertexLayouts[] {
+  &staticVertexLayout,
+  &skinnedVertexLayout,
+  &compactStaticVertexLayout,
+  &compactSkinnedVertexLayout,
+};
+
+std::span<const Mortar::Resource::VertexLayout *const> MeshesReader::getVertexLayouts() {
+  return vertexLayouts;
+}
+
+const Mortar::Resource::VertexLayout& getVertexLayoutFromMesh(LSWMesh& mesh) {
+  switch (mesh.vertexType) {
+    case 0x59:
+      return staticVertexLayout;
+    case 0x5d:
+      return skinnedVertexLayout;
+    default:
+      throw std::runtime_error("unimplemented vertex layout");
+  }
+}
+
+static const Mortar::Resource::VertexLayout& getCompactVertexLayout(const Mortar::Resource::VertexLayout& vertexLayout) {
+  if (&vertexLayout == &staticVertexLayout) {
+    return compactStaticVertexLayout;
+  } else if (&vertexLayout == &skinnedVertexLayout) {
+    return compactSkinnedVertexLayout;
+  }
+
+  return vertexLayout;
+}
+
+// Each vertex block is converted once per layout reading it, and a block
+// with values the compact formats can't hold is left as it is
+struct CompactVertexBuffer {
+  const Mortar::Resource::VertexBuffer *source;
+  const Mortar::Resource::VertexLayout *sourceLayout;
+  Mortar::Resource::VertexBuffer *compact;
+
+  // The converted vertices, and every surface's indices into them, for
+  // reordering once all the meshes are read
+  uint8_t *data;
+  std::vector<std::span<uint16_t>> indexLists;
+
+  // The meshes drawing from it, and the surface each index list belongs to
+  std::vector<Mortar::Resource::Mesh *> meshes;
+  std::vector<const Mortar::Resource::Surface *> surfaces;
+};
+
+static Mortar::Resource::VertexBuffer *getCompactVertexBuffer(Mortar::Resource::LoadContext& context, std::vector<CompactVertexBuffer>& compactBuffers, Mortar::Resource::VertexBuffer *vertexBuffer, const Mortar::Resource::VertexLayout& vertexLayout) {
+  for (auto& compactBuffer : compactBuffers) {
+    if (compactBuffer.source == vertexBuffer && compactBuffer.sourceLayout == &vertexLayout) {
+      return compactBuffer.compact;
+    }
+  }
+
+  const Mortar::Resource::VertexLayout& compactLayout = getCompactVertexLayout(vertexLayout);
+  size_t vertexCount = vertexBuffer->getSize() / vertexLayout.getStride();
+
+  Mortar::Resource::VertexBuffer *compact = nullptr;
+  uint8_t *data = nullptr;
+  if (&compactLayout != &vertexLayout && vertexBuffer->getData()) {
+    size_t size = vertexCount * compactLayout.getStride();
+    data = new uint8_t[size];
+
+    if (Mortar::Resource::convertVertices(vertexLayout, compactLayout, vertexBuffer->getData(), vertexCount, data)) {
+      compact = context.createResource<Mortar::Resource::VertexBuffer>();
+      compact->setSize(size);
+      compact->setData(data);
+
+      context.accountSize<Mortar::Resource::VertexBuffer>(size);
+    } else {
+      delete[] data;
+      data = nullptr;
+    }
+  }
+
+  compactBuffers.push_back({ vertexBuffer, &vertexLayout, compact, data, {}, {}, {} });
+
+  return compact;
+}
+
+// Surfaces address at most 16 palette entries, through a table of their own.
+// Rewriting the blend indices to the entries themselves lets a whole mesh
+// draw at once; a vertex that surfaces resolve differently is copied. The
+// block is left alone if the entries don't fit in a byte, or the copies
+// overflow 16-bit indices.
+static bool remapBlendIndices(Mortar::Resource::LoadContext& context, CompactVertexBuffer& compact, size_t& vertexCount) {
+  size_t stride = compactSkinnedVertexLayout.getStride();
+
+  std::span<const Mortar::Resource::VertexLayout::VertexProperty> properties = compactSkinnedVertexLayout.getProperties();
+  auto blendIndices = std::find_if(properties.begin(), properties.end(), [](const auto& property) {
+    return property.getUsage() == Mortar::Resource::VertexUsage::BLEND_INDICES;
+  });
+
+  if (blendIndices == properties.end() || blendIndices->getDataType() != Mortar::Resource::VertexDataType::UBYTE_VEC4) {
+    return false;
+  }
+
+  // Every version of each vertex, by its packed palette indices, and the
+  // vertices the copies are made from
+  std::vector<std::vector<std::pair<uint32_t, uint16_t>>> versions(vertexCount);
+  std::vector<uint16_t> copySources;
+  std::vector<std::vector<uint16_t>> remappedLists(compact.indexLists.size());
+
+  for (size_t i = 0; i < compact.indexLists.size(); i++) {
+    const std::vector<ushort>& table = compact.surfaces[i]->getSkinTransformIndices();
+
+    for (uint16_t vertex : compact.indexLists[i]) {
+      if (vertex >= vertexCount) {
+        return false;
+      }
+
+      const uint8_t *localIndices = compact.data + vertex * stride + blendIndices->getOffset();
+
+      uint32_t packed = 0;
+      for (int j = 0; j < 3; j++) {
+        if (localIndices[j] >= table.size() || table[localIndices[j]] > 0xff) {
+          return false;
+        }
+
+        packed |= table[localIndices[j]] << (8 * j);
       }
+
+      auto& vertexVersions = versions[vertex];
+      auto version = std::find_if(vertexVersions.begin(), vertexVersions.end(), [packed](const auto& version) {
+        return version.first == packed;
+      });
+
+      uint16_t remapped;
+      if (version != vertexVersions.end()) {
+        remapped = version->second;
+      } else if (vertexVersions.empty()) {
+        remapped = vertex;
+        vertexVersions.push_back({ packed, remapped });
+      } else {
+        if (vertexCount + copySources.size() > 0xffff) {
+          return false;
+        }
+
+        remapped = vertexCount + copySources.size();
+        copySources.push_back(vertex);
+        vertexVersions.push_back({ packed, remapped });
+      }
+
+      remappedLists[i].push_back(remapped);
     }
-  },
-  {
-    0x5d, {
-      56,
-      {
-        { Mortar::Resource::VertexUsage::POSITION,      Mortar::Resource::VertexDataType::VEC3,     0x0  },
-        { Mortar::Resource::VertexUsage::BLEND_WEIGHTS, Mortar::Resource::VertexDataType::VEC2,     0xc  },
-        { Mortar::Resource::VertexUsage::BLEND_INDICES, Mortar::Resource::VertexDataType::VEC3,     0x14 },
-        { Mortar::Resource::VertexUsage::NORMAL,        Mortar::Resource::VertexDataType::VEC3,     0x20 },
-        { Mortar::Resource::VertexUsage::COLOR,         Mortar::Resource::VertexDataType::D3DCOLOR, 0x2c },
-        { Mortar::Resource::VertexUsage::TEX_COORD,     Mortar::Resource::VertexDataType::VEC2,     0x30 },
+  }
+
+  if (!copySources.empty()) {
+    size_t count = vertexCount + copySources.size();
+    uint8_t *data = new uint8_t[count * stride];
+
+    memcpy(data, compact.data, vertexCount * stride);
+    for (size_t i = 0; i < copySources.size(); i++) {
+      memcpy(data + (vertexCount + i) * stride, compact.data + copySources[i] * stride, stride);
+    }
+
+    compact.compact->setData(data);
+    delete[] compact.data;
+    compact.data = data;
+
+    context.accountSize<Mortar::Resource::VertexBuffer>(copySources.size() * stride);
+    vertexCount = count;
+  }
+
+  for (auto& vertexVersions : versions) {
+    for (auto& [packed, vertex] : vertexVersions) {
+      uint8_t *indices = compact.data + vertex * stride + blendIndices->getOffset();
+      for (int j = 0; j < 3; j++) {
+        indices[j] = (packed >> (8 * j)) & 0xff;
       }
     }
-  },
-};
+  }
 
-const Mortar::Resource::VertexLayout& getVertexLayoutFromMesh(LSWMesh& mesh) {
-  if (!vertexLayouts.contains(mesh.vertexType)) {
-    throw std::runtime_error("unimplemented vertex layout");
+  for (size_t i = 0; i < compact.indexLists.size(); i++) {
+    std::copy(remappedLists[i].begin(), remappedLists[i].end(), compact.indexLists[i].begin());
+  }
+
+  for (auto mesh : compact.meshes) {
+    mesh->setUsesPaletteIndices(true);
   }
 
-  return vertexLayouts.at(mesh.vertexType);
+  return true;
 }
 
 Mortar::Resource::ShaderType getShaderTypeFromMesh(LSWMesh& mesh, const Mortar::Resource::Material *material) {
@@ -125,7 +345,7 @@ Mortar::Resource::ShaderType getShaderTypeFromMesh(LSWMesh& mesh, const Mortar::
 
   if (skinned) {
     if (blended) {
-      DEBUG("WARNING: blended, skinned geometry is not implemented");
+      WARNING("blended, skinned geometry is not implemented");
 
       return Mortar::Resource::ShaderType::INVALID;
     }
@@ -150,69 +370,103 @@ Mortar::Resource::ShaderType getShaderTypeFromMesh(LSWMesh& mesh, const Mortar::
 
 const struct LSWSurface readSurfaceInfo(Stream &stream, const uint32_t bodyOffset, uint32_t surfaceOffset) {
   stream.seek(bodyOffset + surfaceOffset, SEEK_SET);
-  struct LSWSurface surface;
 
-  surface.next_offset = stream.readUint32();
-  surface.primitiveType = stream.readUint32();
+  return stream.readStruct<LSWSurface>();
+}
 
-  surface.elementCount = stream.readUint16();
+tsl::sparse_map<uint32_t, Mortar::Resource::PrimitiveType> primitiveTypes {
+  { 1, Mortar::Resource::PrimitiveType::LINE_LIST },
+  { 2, Mortar::Resource::PrimitiveType::TRIANGLE_LIST },
+  { 3, Mortar::Resource::PrimitiveType::TRIANGLE_STRIP },
+  { 4, Mortar::Resource::PrimitiveType::LINE_LIST },
+  { 5, Mortar::Resource::PrimitiveType::TRIANGLE_LIST },
+  { 6, Mortar::Resource::PrimitiveType::TRIANGLE_STRIP },
+};
 
-  stream.seek(sizeof(uint16_t), SEEK_CUR);
+// Running totals for the ACMR report
+struct IndexOptimizationStats {
+  size_t triangleCount = 0;
+  float missesBefore = 0.0f;
+  float missesAfter = 0.0f;
+};
 
-  surface.elementsOffset = stream.readUint32();
+// Triangles become lists, so surfaces can be drawn together, ordered for the
+// vertex cache. Every surface's indices end up in the load's arena, where
+// they can be rewritten again when their vertices are reordered.
+static std::span<uint16_t> optimizeIndices(Mortar::Resource::LoadContext& context, Mortar::Resource::Surface *surface, Mortar::Resource::IndexBuffer *indexBuffer, IndexOptimizationStats& stats) {
+  std::span<const uint16_t> source(indexBuffer->getData(), indexBuffer->getCount());
+
+  std::vector<uint16_t> indices;
+  switch (surface->getPrimitiveType()) {
+    case Mortar::Resource::PrimitiveType::TRIANGLE_STRIP:
+      indices = Mortar::Resource::triangulateStrip(source);
+      break;
+    case Mortar::Resource::PrimitiveType::TRIANGLE_LIST:
+      indices.assign(source.begin(), source.begin() + source.size() / 3 * 3);
+      break;
+    case Mortar::Resource::PrimitiveType::LINE_LIST:
+      indices.assign(source.begin(), source.end());
+      break;
+  }
 
-	stream.seek(sizeof(uint32_t), SEEK_CUR);
+  if (surface->getPrimitiveType() != Mortar::Resource::PrimitiveType::LINE_LIST) {
+    size_t triangleCount = indices.size() / 3;
+    size_t vertexCount = indices.empty() ? 0 : *std::max_element(indices.begin(), indices.end()) + 1;
 
-	surface.num_skin_matrices = stream.readUint8();
+    stats.triangleCount += triangleCount;
+    stats.missesBefore += Mortar::Resource::calculateACMR(indices) * triangleCount;
 
-	stream.seek(sizeof(uint8_t), SEEK_CUR);
+    Mortar::Resource::optimizeVertexCache(indices, vertexCount);
 
-  for (int i = 0; i < 16; i++) {
-    surface.skin_matrix_indices[i] = stream.readUint16();
+    stats.missesAfter += Mortar::Resource::calculateACMR(indices) * triangleCount;
+    surface->setPrimitiveType(Mortar::Resource::PrimitiveType::TRIANGLE_LIST);
   }
 
-  // We can safely skip reading the rest of the unknown fields as we'll seek to
-  // the next surface or elsewhere after this
+  uint16_t *data = context.allocateArray<Mortar::Resource::IndexBuffer, uint16_t>(indices.size());
+  std::copy(indices.begin(), indices.end(), data);
 
-  return surface;
-}
+  indexBuffer->setData(data, nullptr);
+  indexBuffer->setCount(indices.size());
 
-tsl::sparse_map<uint32_t, Mortar::Resource::PrimitiveType> primitiveTypes {
-  { 1, Mortar::Resource::PrimitiveType::LINE_LIST },
-  { 2, Mortar::Resource::PrimitiveType::TRIANGLE_LIST },
-  { 3, Mortar::Resource::PrimitiveType::TRIANGLE_STRIP },
-  { 4, Mortar::Resource::PrimitiveType::LINE_LIST },
-  { 5, Mortar::Resource::PrimitiveType::TRIANGLE_LIST },
-  { 6, Mortar::Resource::PrimitiveType::TRIANGLE_STRIP },
-};
+  return std::span(data, indices.size());
+}
 
-void processSurfaces(Stream &stream, const uint32_t bodyOffset, uint32_t surfacesOffset, Mortar::Resource::Mesh *mesh) {
-  Mortar::Resource::ResourceManager resourceManager = Mortar::State::getResourceManager();
+static void processSurfaces(Mortar::Resource::LoadContext& context, Stream &stream, const uint32_t bodyOffset, uint32_t surfacesOffset, Mortar::Resource::Mesh *mesh, IndexOptimizationStats& stats, std::vector<std::span<uint16_t>>& indexLists) {
 
   uint32_t nextOffset = surfacesOffset;
   unsigned i = 0;
   do {
-    Mortar::Resource::Surface *surface = resourceManager.createResource<Mortar::Resource::Surface>();
+    Mortar::Resource::Surface *surface = context.createResource<Mortar::Resource::Surface>();
     mesh->addSurface(surface);
 
     struct LSWSurface lswSurface = readSurfaceInfo(stream, bodyOffset, nextOffset);
 
-    stream.seek(bodyOffset + lswSurface.elementsOffset, SEEK_SET);
+    Mortar::Resource::IndexBuffer *indexBuffer = context.createResource<Mortar::Resource::IndexBuffer>();
 
-    uint16_t *elementData = new uint16_t[lswSurface.elementCount];
-    for (int i = 0; i < lswSurface.elementCount; i++) {
-      elementData[i] = stream.readUint16();
-    }
+    indexBuffer->setCount(lswSurface.elementCount);
 
-    Mortar::Resource::IndexBuffer *indexBuffer = resourceManager.createResource<Mortar::Resource::IndexBuffer>();
+    // Reference index data in place when the file image is resident
+    long elementsOffset = bodyOffset + lswSurface.elementsOffset;
+    std::shared_ptr<const void> backing = stream.getBacking();
+    if (backing && stream.canView<uint16_t>(elementsOffset, lswSurface.elementCount)) {
+      indexBuffer->setData(stream.view<uint16_t>(elementsOffset, lswSurface.elementCount).data(), backing);
+    } else {
+      stream.seek(elementsOffset, SEEK_SET);
 
-    indexBuffer->setCount(lswSurface.elementCount);
-    indexBuffer->setData(elementData);
+      uint16_t *elementData = new uint16_t[lswSurface.elementCount];
+      stream.readArray(elementData, lswSurface.elementCount);
+
+      indexBuffer->setData(elementData);
+    }
+
+    context.accountSize<Mortar::Resource::IndexBuffer>(lswSurface.elementCount * sizeof(uint16_t));
 
     surface->setIndexBuffer(indexBuffer);
 
     surface->setPrimitiveType(primitiveTypes.at(lswSurface.primitiveType));
 
+    indexLists.push_back(optimizeIndices(context, surface, indexBuffer, stats));
+
     surface->setSkinTransformCount(lswSurface.num_skin_matrices);
 
     std::vector<ushort> indices(std::begin(lswSurface.skin_matrix_indices), std::end(lswSurface.skin_matrix_indices));
@@ -223,55 +477,83 @@ void processSurfaces(Stream &stream, const uint32_t bodyOffset, uint32_t surface
   } while (nextOffset);
 }
 
-const struct LSWMesh readMeshInfo(Stream &stream, const uint32_t body_offset, uint32_t mesh_offset) {
-  stream.seek(body_offset + mesh_offset, SEEK_SET);
-  struct LSWMesh mesh;
+// Only vertices some surface indexes count, since vertex blocks are shared
+// between meshes
+static Mortar::Math::AABB calculateBounds(const Mortar::Resource::Mesh *mesh) {
+  const Mortar::Resource::VertexLayout& vertexLayout = mesh->getVertexLayout();
+  const Mortar::Resource::VertexBuffer *vertexBuffer = mesh->getVertexBuffer();
 
-  mesh.next_offset = stream.readUint32();
+  std::span<const Mortar::Resource::VertexLayout::VertexProperty> properties = vertexLayout.getProperties();
+  auto position = std::find_if(properties.begin(), properties.end(), [](const auto& property) {
+    return property.getUsage() == Mortar::Resource::VertexUsage::POSITION;
+  });
 
-  stream.seek(1 * sizeof(uint32_t), SEEK_CUR);
-
-  mesh.materialIdx = stream.readUint32();
-  mesh.vertexType = stream.readUint32();
+  size_t stride = vertexLayout.getStride();
+  if (position == properties.end() || position->getOffset() + 3 * sizeof(float) > stride || !vertexBuffer->getData()) {
+    return Mortar::Math::AABB();
+  }
 
-  stream.seek(3 * sizeof(uint32_t), SEEK_CUR);
+  size_t vertexCount = vertexBuffer->getSize() / stride;
+  const uint8_t *positions = vertexBuffer->getData() + position->getOffset();
 
-  mesh.vertexBlockIdx = stream.readUint32();
+  float min[3] = { INFINITY, INFINITY, INFINITY };
+  float max[3] = { -INFINITY, -INFINITY, -INFINITY };
+  bool found = false;
 
-  stream.seek(1 * sizeof(uint32_t), SEEK_CUR);
+  for (auto surface : mesh->getSurfaces()) {
+    const Mortar::Resource::IndexBuffer *indexBuffer = surface->getIndexBuffer();
+    const uint16_t *indices = indexBuffer->getData();
 
-  mesh.unk_0024 = stream.readUint32();
+    for (unsigned i = 0; i < indexBuffer->getCount(); i++) {
+      if (indices[i] >= vertexCount) {
+        continue;
+      }
 
-  stream.seek(2 * sizeof(uint32_t), SEEK_CUR);
+      float vertex[3];
+      memcpy(vertex, positions + indices[i] * stride, sizeof(vertex));
 
-  mesh.surfacesOffset = stream.readUint32();
+      for (int j = 0; j < 3; j++) {
+        min[j] = std::min(min[j], vertex[j]);
+        max[j] = std::max(max[j], vertex[j]);
+      }
 
-  stream.seek(4, SEEK_CUR);
+      found = true;
+    }
+  }
 
-  mesh.unk_0038 = stream.readUint32();
-  mesh.unk_003C = stream.readUint32();
+  if (!found) {
+    return Mortar::Math::AABB();
+  }
 
-  return mesh;
+  return Mortar::Math::AABB::fromMinMax(
+    Mortar::Math::Vector(min[0], min[1], min[2], 1.0f),
+    Mortar::Math::Vector(max[0], max[1], max[2], 1.0f));
 }
 
-void MeshesReader::read(std::vector<Resource::Mesh *>& meshes, Stream &stream, uint32_t bodyOffset, const std::vector<Resource::Material *>& materials, const std::vector<Resource::VertexBuffer *>& vertexBuffers) {
-  Resource::ResourceManager resourceManager = State::getResourceManager();
+const struct LSWMesh readMeshInfo(Stream &stream, const uint32_t body_offset, uint32_t mesh_offset) {
+  stream.seek(body_offset + mesh_offset, SEEK_SET);
+
+  return stream.readStruct<LSWMesh>();
+}
 
-  struct LSWMeshHeader mesh_header;
+void MeshesReader::read(Resource::LoadContext& context, std::vector<Resource::Mesh *>& meshes, Stream &stream, uint32_t bodyOffset, const std::vector<Resource::Material *>& materials, const std::vector<Resource::VertexBuffer *>& vertexBuffers) {
+  PROFILE_ZONE("MeshesReader::read");
 
-  stream.seek(3 * sizeof(uint32_t), SEEK_CUR);
 
-  mesh_header.mesh_offset = stream.readUint32();
+  struct LSWMeshHeader mesh_header = stream.readStruct<LSWMeshHeader>();
 
   if (!mesh_header.mesh_offset) {
     return;
   }
 
+  std::vector<CompactVertexBuffer> compactBuffers;
+  IndexOptimizationStats stats;
+
   uint32_t nextOffset = mesh_header.mesh_offset;
   do {
     struct LSWMesh lswMesh = readMeshInfo(stream, bodyOffset, nextOffset);
 
-    Resource::Mesh *mesh = resourceManager.createResource<Resource::Mesh>();
+    Resource::Mesh *mesh = context.createResource<Resource::Mesh>();
     meshes.push_back(mesh);
 
     Resource::Material *material = materials.at(lswMesh.materialIdx);
@@ -280,14 +562,71 @@ void MeshesReader::read(std::vector<Resource::Mesh *>& meshes, Stream &stream, u
     Resource::ShaderType shaderType = getShaderTypeFromMesh(lswMesh, material);
     mesh->setShaderType(shaderType);
 
+    // Meshes draw from their block repacked to the compact layout where
+    // it converts
     const Resource::VertexLayout& vertexLayout = getVertexLayoutFromMesh(lswMesh);
-    mesh->setVertexLayout(vertexLayout);
-
     Resource::VertexBuffer *vertexBuffer = vertexBuffers.at(lswMesh.vertexBlockIdx - 1);
-    mesh->setVertexBuffer(vertexBuffer);
 
-    processSurfaces(stream, bodyOffset, lswMesh.surfacesOffset, mesh);
+    Resource::VertexBuffer *compactBuffer = getCompactVertexBuffer(context, compactBuffers, vertexBuffer, vertexLayout);
+    if (compactBuffer) {
+      mesh->setVertexLayout(getCompactVertexLayout(vertexLayout));
+      mesh->setVertexBuffer(compactBuffer);
+    } else {
+      mesh->setVertexLayout(vertexLayout);
+      mesh->setVertexBuffer(vertexBuffer);
+    }
+
+    std::vector<std::span<uint16_t>> indexLists;
+    processSurfaces(context, stream, bodyOffset, lswMesh.surfacesOffset, mesh, stats, indexLists);
+
+    if (compactBuffer) {
+      for (auto& compact : compactBuffers) {
+        if (compact.compact == compactBuffer) {
+          compact.indexLists.insert(compact.indexLists.end(), indexLists.begin(), indexLists.end());
+          compact.meshes.push_back(mesh);
+          compact.surfaces.insert(compact.surfaces.end(), mesh->getSurfaces().begin(), mesh->getSurfaces().end());
+        }
+      }
+    }
+
+    mesh->setBounds(calculateBounds(mesh));
 
     nextOffset = lswMesh.next_offset;
   } while (nextOffset);
+
+  size_t remappedCount = 0;
+
+  // Converted blocks belong to these meshes alone, so their vertices can be
+  // put in the order the surfaces first use them
+  for (auto& compact : compactBuffers) {
+    if (!compact.compact) {
+      continue;
+    }
+
+    size_t stride = getCompactVertexLayout(*compact.sourceLayout).getStride();
+    size_t vertexCount = compact.compact->getSize() / stride;
+
+    if (compact.sourceLayout == &skinnedVertexLayout && remapBlendIndices(context, compact, vertexCount)) {
+      remappedCount += compact.meshes.size();
+    }
+
+    size_t usedCount = Resource::optimizeVertexFetch(compact.indexLists, compact.data, vertexCount, stride);
+
+    compact.compact->setSize(usedCount * stride);
+    compact.compact->computeContentHash();
+  }
+
+  // Simplified levels are taken from the final index order, so they keep
+  // to the vertices the reorder above kept
+  for (auto mesh : meshes) {
+    Resource::generateMeshLods(context, mesh);
+  }
+
+  if (remappedCount) {
+    DEBUG("%zu skinned meshes index their palettes directly", remappedCount);
+  }
+
+  if (stats.triangleCount) {
+    DEBUG("%zu triangles, ACMR %.3f before optimization, %.3f after", stats.triangleCount, stats.missesBefore / stats.triangleCount, stats.missesAfter / stats.triangleCount);
+  }
 }
@@ -0,0 +1,56 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+#include <string.h>
+
+#include "../../../../resource/name.hpp"
+#include "../common.hpp"
+
+using namespace Mortar::Game::LSW::Readers;
+
+std::string_view StringTable::read(Stream& stream) {
+  stream.readString(this->scratch);
+
+  return this->intern(this->scratch);
+}
+
+std::string_view StringTable::intern(std::string_view name) {
+  uint64_t hash = Resource::hashName(name);
+
+  auto found = this->names.find(hash);
+  if (found != this->names.end()) {
+    if (found->second != name) {
+      throw std::runtime_error("names have the same hash");
+    }
+
+    return found->second;
+  }
+
+  char *copy = this->context.allocateArray<char>(name.size() + 1);
+  memcpy(copy, name.data(), name.size());
+
+  std::string_view interned (copy, name.size());
+  this->names.insert({ hash, interned });
+
+  return interned;
+}
+
+std::string_view StringTable::find(uint64_t hash) const {
+  auto found = this->names.find(hash);
+
+  return found != this->names.end() ? found->second : std::string_view();
+}
@@ -14,11 +14,12 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <stdio.h>
 #include <stdint.h>
 
 #include "../../../log.hpp"
-#include "../../../state.hpp"
+#include "../../../profiler.hpp"
 #include "dds.hpp"
 
 using namespace Mortar::Game::LSW::Readers;
@@ -68,65 +69,137 @@ struct DDSHeader {
   uint32_t reserved2;
 };
 
-Mortar::Resource::Texture *DDSReader::read(Stream &stream) {
-  Resource::ResourceManager resourceManager = State::getResourceManager();
-  Resource::Texture *texture = resourceManager.createResource<Resource::Texture>();
+template <>
+struct FieldCodec<DDSPixelFormat> {
+  static constexpr size_t size = 0x20;
+
+  static inline void decode(const uint8_t *data, DDSPixelFormat& out) {
+    FieldCodec<uint32_t>::decode(data + 0x0, out.size);
+    FieldCodec<uint32_t>::decode(data + 0x4, out.flags);
+    FieldCodec<uint32_t>::decode(data + 0x8, out.fourCC);
+    FieldCodec<uint32_t>::decode(data + 0xc, out.num_bits);
+    FieldCodec<uint32_t>::decode(data + 0x10, out.red_bitmask);
+    FieldCodec<uint32_t>::decode(data + 0x14, out.green_bitmask);
+    FieldCodec<uint32_t>::decode(data + 0x18, out.blue_bitmask);
+    FieldCodec<uint32_t>::decode(data + 0x1c, out.alpha_bitmask);
+  }
+};
 
-  struct DDSHeader file_header;
+template <>
+struct StructLayout<DDSHeader> {
+  static constexpr size_t size = 0x80;
+  static constexpr auto fields = std::tuple {
+    field(&DDSHeader::tag,         0x0),
+    field(&DDSHeader::header_size, 0x4),
+    field(&DDSHeader::flags,       0x8),
+    field(&DDSHeader::height,      0xc),
+    field(&DDSHeader::width,       0x10),
+    field(&DDSHeader::num_levels,  0x1c),
+    field(&DDSHeader::format,      0x4c),
+  };
+};
 
-  file_header.tag = stream.readUint32();
-  file_header.header_size = stream.readUint32();
-  file_header.flags = stream.readUint32();
-  file_header.height = stream.readUint32();
-  file_header.width = stream.readUint32();
+// How a DDS file's levels are sized and which GL formats they upload as. All
+// of these go to GL as stored, so nothing is decompressed or swizzled here.
+struct DDSTextureFormat {
+  bool compressed;
 
-  /* Pitch and depth are currently unused. */
-  stream.seek(2 * sizeof(uint32_t), SEEK_CUR);
+  // Bytes per 4x4 block when compressed, per pixel otherwise
+  unsigned unitSize;
 
-  file_header.num_levels = stream.readUint32();
+  GLenum format;
+  GLint internalFormat;
+};
 
-  stream.seek(11 * sizeof(uint32_t), SEEK_CUR);
+static bool getTextureFormat(const DDSPixelFormat& pixelFormat, DDSTextureFormat& textureFormat) {
+  if (pixelFormat.flags & DDS_HAS_FOURCC) {
+    switch (pixelFormat.fourCC) {
+      case DDS_FORMAT_DXT1:
+        // Opaque unless the file says it uses DXT1's one-bit alpha
+        textureFormat = { true, 8, GL_NONE, (pixelFormat.flags & DDS_HAS_ALPHA) ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT };
+        return true;
+      case DDS_FORMAT_DXT3:
+        textureFormat = { true, 16, GL_NONE, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT };
+        return true;
+      case DDS_FORMAT_DXT5:
+        textureFormat = { true, 16, GL_NONE, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT };
+        return true;
+      default:
+        return false;
+    }
+  }
 
-  file_header.format.size = stream.readUint32();
-  file_header.format.flags = stream.readUint32();
-  file_header.format.fourCC = stream.readUint32();
+  // 32-bit RGB(A) in either channel order; files without an alpha mask
+  // still upload as RGBA, as the padding byte is never sampled
+  if ((pixelFormat.flags & DDS_IS_RGB) && pixelFormat.num_bits == 32 && pixelFormat.green_bitmask == 0x0000ff00) {
+    if (pixelFormat.red_bitmask == 0x00ff0000 && pixelFormat.blue_bitmask == 0x000000ff) {
+      textureFormat = { false, 4, GL_BGRA, GL_RGBA8 };
+      return true;
+    } else if (pixelFormat.red_bitmask == 0x000000ff && pixelFormat.blue_bitmask == 0x00ff0000) {
+      textureFormat = { false, 4, GL_RGBA, GL_RGBA8 };
+      return true;
+    }
+  }
 
-  stream.seek(128, SEEK_SET);
+  return false;
+}
 
-  if (file_header.format.flags & DDS_HAS_FOURCC) {
-    switch (file_header.format.fourCC) {
-      case DDS_FORMAT_DXT3:
-        texture->setIsCompressed(true);
-        // texture->format = GL_BGRA;
-        texture->setInternalFormat(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT);
+Mortar::Resource::Texture *DDSReader::read(Resource::LoadContext& context, Stream &stream) {
+  PROFILE_ZONE("DDSReader::read");
+
+  struct DDSHeader file_header = stream.readStruct<DDSHeader>();
+
+  DDSTextureFormat textureFormat;
+  if (!getTextureFormat(file_header.format, textureFormat)) {
+    fprintf(stderr, "Unrecognized DDS format: flags %#x, fourCC %#x, %u bits\n", file_header.format.flags, file_header.format.fourCC, file_header.format.num_bits);
+    return nullptr;
+  }
 
-        /* Read in mipmap levels one by one. */
-        for (int i = 0; i < file_header.num_levels; i++) {
-          Resource::Texture::Level *level = resourceManager.createResource<Resource::Texture::Level>();
+  Resource::Texture *texture = context.createResource<Resource::Texture>();
 
-          level->setLevel(i);
-          level->setSize((((file_header.width >> i) + 3) >> 2) * (((file_header.height >> i) + 3) >> 2) * 16);
+  texture->setIsCompressed(textureFormat.compressed);
+  texture->setFormat(textureFormat.format);
+  texture->setInternalFormat(textureFormat.internalFormat);
 
-          uint8_t *data = new uint8_t[level->getSize()];
+  // Files without mipmaps may leave the count at zero
+  unsigned levelCount = std::max<uint32_t>(file_header.num_levels, 1);
 
-          for (int j = 0; j < level->getSize(); j++) {
-            data[j] = stream.readUint8();
-          }
+  stream.seek(128, SEEK_SET);
 
-          level->setData(data);
+  /* Read in mipmap levels one by one. */
+  for (unsigned i = 0; i < levelCount; i++) {
+    Resource::Texture::Level *level = context.createResource<Resource::Texture::Level>();
 
-          texture->addLevel(level);
-        }
+    unsigned width = std::max<uint32_t>(file_header.width >> i, 1);
+    unsigned height = std::max<uint32_t>(file_header.height >> i, 1);
 
-        break;
-      default:
-        fprintf(stderr, "Unrecognized fourCC: %d\n", file_header.format.fourCC);
-        return nullptr;
+    level->setLevel(i);
+    if (textureFormat.compressed) {
+      level->setSize(((width + 3) >> 2) * ((height + 3) >> 2) * textureFormat.unitSize);
+    } else {
+      level->setSize(width * height * textureFormat.unitSize);
     }
+
+    long levelOffset = stream.tell();
+    std::shared_ptr<const void> backing = stream.getBacking();
+    if (backing && stream.canView<uint8_t>(levelOffset, level->getSize())) {
+      level->setData(stream.view<uint8_t>(levelOffset, level->getSize()).data(), backing);
+      stream.seek(level->getSize(), SEEK_CUR);
+    } else {
+      uint8_t *data = new uint8_t[level->getSize()];
+      stream.readArray(data, level->getSize());
+
+      level->setData(data);
+    }
+
+    context.accountSize<Resource::Texture::Level>(level->getSize());
+
+    texture->addLevel(level);
   }
 
   texture->setWidth(file_header.width);
   texture->setHeight(file_header.height);
+  texture->computeContentHash();
 
   return texture;
 }
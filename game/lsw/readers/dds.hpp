@@ -17,13 +17,14 @@
 #ifndef MORTAR_LSW_READERS_DDS_H
 #define MORTAR_LSW_READERS_DDS_H
 
+#include "../../../resource/loadcontext.hpp"
 #include "../../../streams/stream.hpp"
 #include "../../../resource/types/texture.hpp"
 
 namespace Mortar::Game::LSW::Readers {
   class DDSReader {
     public:
-      static Resource::Texture *read(Stream &stream);
+      static Resource::Texture *read(Resource::LoadContext& context, Stream &stream);
   };
 }
 
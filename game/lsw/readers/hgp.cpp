@@ -17,10 +17,11 @@
 #include <iterator>
 #include <stdint.h>
 #include <stdio.h>
+#include <string_view>
 
 #include "../../../log.hpp"
-#include "../../../state.hpp"
 #include "../../../math/matrix.hpp"
+#include "../../../profiler.hpp"
 #include "../../../streams/filestream.hpp"
 #include "../../../streams/memorystream.hpp"
 #include "../../../resource/types/joint.hpp"
@@ -116,61 +117,88 @@ struct HGPLocator {
   uint8_t unk_0045[11];
 };
 
-const uint32_t BODY_OFFSET = 0x30;
+template <>
+struct StructLayout<HGPHeader> {
+  static constexpr size_t size = 0x30;
+  static constexpr auto fields = std::tuple {
+    field(&HGPHeader::strings_offset,         0x4),
+    field(&HGPHeader::texture_header_offset,  0x8),
+    field(&HGPHeader::material_header_offset, 0xc),
+    field(&HGPHeader::vertex_header_offset,   0x14),
+    field(&HGPHeader::model_header_offset,    0x18),
+  };
+};
 
-void HGPReader::read(Resource::Character *character, Stream& stream) {
-  Resource::ResourceManager resourceManager = State::getResourceManager();
-  Resource::Model *model = resourceManager.createResource<Resource::Model>();
-  character->setModel(model);
+template <>
+struct StructLayout<HGPModelHeader> {
+  static constexpr size_t size = 0xb0;
+  static constexpr auto fields = std::tuple {
+    field(&HGPModelHeader::skeleton_offset,          0x14),
+    field(&HGPModelHeader::rest_pose_offset,         0x18),
+    field(&HGPModelHeader::skin_transforms_offset,   0x1c),
+    field(&HGPModelHeader::joint_index_map_offset,   0x20),
+    field(&HGPModelHeader::layer_header_offset,      0x24),
+    field(&HGPModelHeader::locators_offset,          0x28),
+    field(&HGPModelHeader::locator_index_map_offset, 0x2c),
+    field(&HGPModelHeader::string_table_adjust,      0x30),
+    field(&HGPModelHeader::num_joints,               0x7c),
+    field(&HGPModelHeader::num_joint_indices,        0x7d),
+    field(&HGPModelHeader::num_layers,               0x7e),
+    field(&HGPModelHeader::num_locators,             0x7f),
+    field(&HGPModelHeader::num_locator_indices,      0x80),
+  };
+};
 
-  /* Read in HGP header at the top of the file. */
-  stream.seek(0, SEEK_SET);
-  struct HGPHeader file_header;
+template <>
+struct StructLayout<HGPLayerHeader> {
+  static constexpr size_t size = 0x14;
+  static constexpr auto fields = std::tuple {
+    field(&HGPLayerHeader::name_offset,              0x0),
+    field(&HGPLayerHeader::mesh_header_list_offsets, 0x4),
+  };
+};
+
+template <>
+struct StructLayout<HGPJoint> {
+  static constexpr size_t size = 0x60;
+  static constexpr auto fields = std::tuple {
+    field(&HGPJoint::transformation_mtx, 0x0),
+    field(&HGPJoint::attachment,         0x40),
+    field(&HGPJoint::name_offset,        0x4c),
+    field(&HGPJoint::parent_idx,         0x50),
+    field(&HGPJoint::flags,              0x51),
+  };
+};
+
+template <>
+struct StructLayout<HGPLocator> {
+  static constexpr size_t size = 0x50;
+  static constexpr auto fields = std::tuple {
+    field(&HGPLocator::transform, 0x0),
+    field(&HGPLocator::jointIdx,  0x44),
+  };
+};
 
-  stream.seek(4, SEEK_CUR);
+const uint32_t BODY_OFFSET = 0x30;
 
-  file_header.strings_offset = stream.readUint32();
-  file_header.texture_header_offset = stream.readUint32();
-  file_header.material_header_offset = stream.readUint32();
+void HGPReader::read(Resource::LoadContext& context, Resource::Character *character, Stream& stream) {
+  PROFILE_ZONE("HGPReader::read");
 
-  stream.seek(sizeof(uint32_t), SEEK_CUR);
+  Resource::Model *model = context.createResource<Resource::Model>();
+  character->setModel(model);
 
-  file_header.vertex_header_offset = stream.readUint32();
-  file_header.model_header_offset = stream.readUint32();
+  /* Read in HGP header at the top of the file. */
+  stream.seek(0, SEEK_SET);
+  struct HGPHeader file_header = stream.readStruct<HGPHeader>();
 
   /* Read in additional model information. */
   stream.seek(BODY_OFFSET + file_header.model_header_offset, SEEK_SET);
-  struct HGPModelHeader model_header;
-
-  stream.seek(5 * sizeof(uint32_t), SEEK_CUR);
-
-  model_header.skeleton_offset = stream.readUint32();
-  model_header.rest_pose_offset = stream.readUint32();
-  model_header.skin_transforms_offset = stream.readUint32();
-  model_header.joint_index_map_offset = stream.readUint32();
-  model_header.layer_header_offset = stream.readUint32();
-  model_header.locators_offset = stream.readUint32();
-  model_header.locator_index_map_offset = stream.readUint32();
-  model_header.string_table_adjust = stream.readUint32();
-
-  stream.seek(sizeof(uint32_t), SEEK_CUR);
-  stream.seek(sizeof(float), SEEK_CUR);
-  stream.seek(sizeof(uint32_t), SEEK_CUR);
-  stream.seek(sizeof(float), SEEK_CUR);
-  stream.seek(sizeof(uint32_t), SEEK_CUR);
-  stream.seek(9 * sizeof(float), SEEK_CUR);
-  stream.seek(4 * sizeof(uint32_t), SEEK_CUR);
-
-  model_header.num_joints = stream.readUint8();
-  model_header.num_joint_indices = stream.readUint8();
-  model_header.num_layers = stream.readUint8();
-  model_header.num_locators = stream.readUint8();
-  model_header.num_locator_indices = stream.readUint8();
+  struct HGPModelHeader model_header = stream.readStruct<HGPModelHeader>();
 
   /* Read texture block information. */
   stream.seek(BODY_OFFSET + file_header.texture_header_offset, SEEK_SET);
   std::vector<Resource::Texture *> textures;
-  TexturesReader::read(textures, stream, BODY_OFFSET + file_header.texture_header_offset + 12);
+  TexturesReader::read(context, textures, stream, BODY_OFFSET + file_header.texture_header_offset + 12);
   for (auto texture : textures) {
     model->addTexture(texture);
   }
@@ -178,12 +206,12 @@ void HGPReader::read(Resource::Character *character, Stream& stream) {
   /* Read materials. */
   stream.seek(BODY_OFFSET + file_header.material_header_offset, SEEK_SET);
   std::vector<Resource::Material *> materials;
-  MaterialsReader::read(materials, stream, BODY_OFFSET, textures);
+  MaterialsReader::read(context, materials, stream, BODY_OFFSET, textures);
 
   /* Read vertex data. */
   stream.seek(BODY_OFFSET + file_header.vertex_header_offset, SEEK_SET);
   std::vector<Resource::VertexBuffer *> vertexBuffers;
-  VertexBufferReader::read(vertexBuffers, stream, BODY_OFFSET + file_header.vertex_header_offset);
+  VertexBufferReader::read(context, vertexBuffers, stream, BODY_OFFSET + file_header.vertex_header_offset);
   for (auto vertexBuffer : vertexBuffers) {
     model->addVertexBuffer(vertexBuffer);
   }
@@ -192,41 +220,31 @@ void HGPReader::read(Resource::Character *character, Stream& stream) {
   std::vector<HGPJoint> hgpJoints (model_header.num_joints);
 
   stream.seek(BODY_OFFSET + model_header.skeleton_offset, SEEK_SET);
-  for (int i = 0; i < model_header.num_joints; i++) {
-    struct HGPJoint& hgpJoint = hgpJoints.at(i);
+  stream.readStructs(hgpJoints.data(), model_header.num_joints);
 
-    hgpJoint.transformation_mtx = Math::Matrix::fromStream(stream);
-    hgpJoint.attachment = Math::Vector::fromStream(stream, 1.0);
-    hgpJoint.name_offset = stream.readUint32();
-    hgpJoint.parent_idx = stream.readInt8();
-    hgpJoint.flags = stream.readUint8();
-
-    stream.seek(2 * sizeof(uint8_t), SEEK_CUR);
-    stream.seek(3 * sizeof(uint32_t), SEEK_CUR);
-  }
-
-  std::vector<Math::Matrix> restPose (model_header.num_joints);
+  std::vector<Math::QTS> restPose (model_header.num_joints);
 
   stream.seek(BODY_OFFSET + model_header.rest_pose_offset, SEEK_SET);
   for (int i = 0; i < model_header.num_joints; i++) {
-    restPose[i] = Math::Matrix::fromStream(stream);
+    restPose[i] = Math::QTS(Math::Matrix::fromStream(stream));
   }
 
   character->setRestPose(restPose);
 
+  StringTable strings (context);
   for (int i = 0; i < model_header.num_joints; i++) {
     HGPJoint& hgpJoint = hgpJoints[i];
 
     stream.seek(BODY_OFFSET + file_header.strings_offset + file_header.strings_offset - model_header.string_table_adjust - model_header.skeleton_offset + hgpJoint.name_offset, SEEK_SET);
-    char *jointName = stream.readString();
+    std::string_view jointName = strings.read(stream);
 
-    Resource::Joint *joint = resourceManager.createResource<Resource::Joint>();
+    Resource::Joint *joint = context.createResource<Resource::Joint>();
     character->addJoint(joint);
 
-    joint->setName(jointName);
+    joint->setName(jointName.data());
 
     joint->setParentIdx(hgpJoint.parent_idx);
-    joint->setTransform(hgpJoint.transformation_mtx);
+    joint->setTransform(Math::Affine(hgpJoint.transformation_mtx));
 
     joint->setAttachmentPoint(hgpJoint.attachment);
 
@@ -236,27 +254,20 @@ void HGPReader::read(Resource::Character *character, Stream& stream) {
   /* Read in information necessary for processing layers and meshes. */
   stream.seek(BODY_OFFSET + model_header.skin_transforms_offset, SEEK_SET);
   for (int i = 0; i < model_header.num_joints; i++) {
-    auto mtx = Math::Matrix::fromStream(stream);
-    character->addSkinTransform(mtx);
+    character->addSkinTransform(Math::Affine(Math::Matrix::fromStream(stream)));
   }
 
   stream.seek(BODY_OFFSET + model_header.layer_header_offset, SEEK_SET);
   std::vector<HGPLayerHeader> layer_headers (model_header.num_layers);
 
-  for (int i = 0; i < model_header.num_layers; i++) {
-    layer_headers[i].name_offset = stream.readUint32();
-
-    for (int j = 0; j < 4; j++) {
-      layer_headers[i].mesh_header_list_offsets[j] = stream.readUint32();
-    }
-  }
+  stream.readStructs(layer_headers.data(), model_header.num_layers);
 
     /* Break the layers down into meshes and add those to the model's list. */
   for (int i = 0; i < model_header.num_layers; i++) {
     // stream.seek(BODY_OFFSET + layer_headers[i].name_offset, SEEK_SET);
-    // char *layerName = stream.readString();
+    // std::string_view layerName = strings.read(stream);
 
-    Resource::Layer *layer = resourceManager.createResource<Resource::Layer>();
+    Resource::Layer *layer = context.createResource<Resource::Layer>();
     character->addLayer(layer);
 
     for (int j = 0; j < 4; j++) {
@@ -268,10 +279,7 @@ void HGPReader::read(Resource::Character *character, Stream& stream) {
 
       if (j % 2 == 0) {
         std::vector<uint32_t> mesh_header_offsets (model_header.num_joints);
-
-        for (unsigned k = 0; k < model_header.num_joints; k++) {
-          mesh_header_offsets[k] = stream.readUint32();
-        }
+        stream.readArray(mesh_header_offsets.data(), model_header.num_joints);
 
         for (unsigned k = 0; k < model_header.num_joints; k++) {
           if (!mesh_header_offsets[k]) {
@@ -282,9 +290,9 @@ void HGPReader::read(Resource::Character *character, Stream& stream) {
 
           stream.seek(BODY_OFFSET + mesh_header_offsets[k], SEEK_SET);
           std::vector<Resource::Mesh *> meshes;
-          MeshesReader::read(meshes, stream, BODY_OFFSET, materials, vertexBuffers);
+          MeshesReader::read(context, meshes, stream, BODY_OFFSET, materials, vertexBuffers);
           for (auto mesh : meshes) {
-            auto kinematic = resourceManager.createResource<Resource::KinematicMesh>();
+            auto kinematic = context.createResource<Resource::KinematicMesh>();
 
             model->addMesh(mesh);
 
@@ -295,7 +303,7 @@ void HGPReader::read(Resource::Character *character, Stream& stream) {
         }
       } else if (j == 1) {
         std::vector<Resource::Mesh *> skinMeshes;
-        MeshesReader::read(skinMeshes, stream, BODY_OFFSET, materials, vertexBuffers);
+        MeshesReader::read(context, skinMeshes, stream, BODY_OFFSET, materials, vertexBuffers);
         for (auto mesh : skinMeshes) {
           model->addMesh(mesh);
           layer->addSkinMesh(mesh);
@@ -303,7 +311,7 @@ void HGPReader::read(Resource::Character *character, Stream& stream) {
       }
       else if (j == 3) {
         std::vector<Resource::Mesh *> deformableSkinMeshes;
-        MeshesReader::read(deformableSkinMeshes, stream, BODY_OFFSET, materials, vertexBuffers);
+        MeshesReader::read(context, deformableSkinMeshes, stream, BODY_OFFSET, materials, vertexBuffers);
         for (auto mesh : deformableSkinMeshes) {
           model->addMesh(mesh);
           layer->addDeformableSkinMesh(mesh);
@@ -312,18 +320,13 @@ void HGPReader::read(Resource::Character *character, Stream& stream) {
     }
   }
 
-  stream.seek(BODY_OFFSET + model_header.locators_offset, SEEK_SET);
-  for (int i = 0; i < model_header.num_locators; i++) {
-    HGPLocator hgpLocator;
-    hgpLocator.transform = Math::Matrix::fromStream(stream);
+  std::vector<HGPLocator> hgpLocators (model_header.num_locators);
 
-    stream.seek(sizeof(uint32_t), SEEK_CUR);
-
-    hgpLocator.jointIdx = stream.readUint8();
-
-    stream.seek(11 * sizeof(uint8_t), SEEK_CUR);
+  stream.seek(BODY_OFFSET + model_header.locators_offset, SEEK_SET);
+  stream.readStructs(hgpLocators.data(), model_header.num_locators);
 
-    Resource::Character::Locator *locator = resourceManager.createResource<Resource::Character::Locator>();
+  for (auto& hgpLocator : hgpLocators) {
+    Resource::Character::Locator *locator = context.createResource<Resource::Character::Locator>();
     character->addLocator(locator);
 
     locator->setTransform(hgpLocator.transform);
@@ -17,13 +17,14 @@
 #ifndef MORTAR_LSW_READERS_HGP_H
 #define MORTAR_LSW_READERS_HGP_H
 
+#include "../../../resource/loadcontext.hpp"
 #include "../../../streams/stream.hpp"
 #include "../../../resource/types/character.hpp"
 
 namespace Mortar::Game::LSW::Readers {
   class HGPReader {
     public:
-      static void read(Resource::Character *character, Stream& stream);
+      static void read(Resource::LoadContext& context, Resource::Character *character, Stream& stream);
   };
 }
 
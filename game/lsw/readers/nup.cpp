@@ -15,10 +15,18 @@
  */
 
 #include <forward_list>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
 
+#include "../../../jobs/jobsystem.hpp"
 #include "../../../log.hpp"
 #include "../../../math/matrix.hpp"
+#include "../../../profiler.hpp"
+#include "../../../resource/staticbatch.hpp"
+#include "../../../streams/memorystream.hpp"
 #include "dds.hpp"
 #include "nup.hpp"
 #include "common.hpp"
@@ -83,53 +91,169 @@ struct NUPSpline {
   uint32_t verticesOffset;
 };
 
+template <>
+struct StructLayout<NUPHeader> {
+  static constexpr size_t size = 0x28;
+  static constexpr auto fields = std::tuple {
+    field(&NUPHeader::strings_offset,         0x4),
+    field(&NUPHeader::texture_header_offset,  0x8),
+    field(&NUPHeader::material_header_offset, 0xc),
+    field(&NUPHeader::vertex_header_offset,   0x14),
+    field(&NUPHeader::model_header_offset,    0x18),
+    field(&NUPHeader::instances_offset,       0x1c),
+  };
+};
+
+template <>
+struct StructLayout<NUPModelHeader> {
+  static constexpr size_t size = 0x1d8;
+  static constexpr auto fields = std::tuple {
+    field(&NUPModelHeader::num_materials,           0xc),
+    field(&NUPModelHeader::num_mesh_blocks,         0x10),
+    field(&NUPModelHeader::mesh_header_list_offset, 0x14),
+    field(&NUPModelHeader::num_instances,           0x18),
+    field(&NUPModelHeader::num_special_objects,     0x20),
+    field(&NUPModelHeader::num_splines,             0x28),
+    field(&NUPModelHeader::splines_offset,          0x2c),
+  };
+};
+
+template <>
+struct StructLayout<NUPInstance> {
+  static constexpr size_t size = 0x50;
+  static constexpr auto fields = std::tuple {
+    field(&NUPInstance::transformation, 0x0),
+    field(&NUPInstance::mesh_idx,       0x40),
+    field(&NUPInstance::matrix_offset,  0x48),
+  };
+};
+
+template <>
+struct StructLayout<NUPSpline> {
+  static constexpr size_t size = 0xc;
+  static constexpr auto fields = std::tuple {
+    field(&NUPSpline::vertexCount,    0x0),
+    field(&NUPSpline::nameOffset,     0x4),
+    field(&NUPSpline::verticesOffset, 0x8),
+  };
+};
+
 const int BODY_OFFSET = 0x40;
 
-void NUPReader::read(Mortar::Resource::Scene *scene, Stream &stream) {
-  Resource::ResourceManager resourceManager = State::getResourceManager();
-  Resource::Model *model = resourceManager.createResource<Resource::Model>();
+// Mesh blocks only share the already-read materials and vertex buffers, so
+// over a memory-backed stream each is decoded as its own job, with its own
+// cursor into the image and its own context. The contexts are merged back in
+// block order, so resources come out in the same order as a serial read.
+// They're merged even if a block fails, as blocks already read may have been
+// handed to blockRead.
+static void readMeshBlocks(Mortar::Resource::LoadContext& context, std::vector<std::vector<Mortar::Resource::Mesh *>>& blockMeshes, Stream& stream, const std::vector<uint32_t>& meshHeaderOffsets, const std::vector<Mortar::Resource::Material *>& materials, const std::vector<Mortar::Resource::VertexBuffer *>& vertexBuffers, const std::function<void (size_t)>& blockRead) {
+  blockMeshes.resize(meshHeaderOffsets.size());
+
+  Mortar::Jobs::JobSystem *jobSystem = context.getResourceManager().getJobSystem();
+  if (!jobSystem || !jobSystem->getWorkerCount() || !stream.data() || meshHeaderOffsets.size() < 2) {
+    for (size_t i = 0; i < meshHeaderOffsets.size(); i++) {
+      stream.seek(BODY_OFFSET + meshHeaderOffsets[i], SEEK_SET);
+      MeshesReader::read(context, blockMeshes[i], stream, BODY_OFFSET, materials, vertexBuffers);
+      blockRead(i);
+    }
+
+    return;
+  }
+
+  std::vector<std::unique_ptr<Mortar::Resource::LoadContext>> blockContexts (meshHeaderOffsets.size());
+
+  auto absorbBlocks = [&] () {
+    for (auto& blockContext : blockContexts) {
+      if (blockContext) {
+        context.absorb(*blockContext);
+      }
+    }
+  };
+
+  try {
+    jobSystem->parallelFor(meshHeaderOffsets.size(), 1, [&] (size_t i) {
+      blockContexts[i] = std::make_unique<Mortar::Resource::LoadContext>(context.getResourceManager());
+
+      MemoryStream cursor (stream.data(), stream.size(), stream.getBacking());
+      cursor.seek(BODY_OFFSET + meshHeaderOffsets[i], SEEK_SET);
+
+      MeshesReader::read(*blockContexts[i], blockMeshes[i], cursor, BODY_OFFSET, materials, vertexBuffers);
+      blockRead(i);
+    });
+  } catch (...) {
+    absorbBlocks();
+    throw;
+  }
+
+  absorbBlocks();
+}
+
+void NUPReader::read(Resource::LoadContext& context, Mortar::Resource::Scene *scene, Stream &stream, const Listener *listener) {
+  PROFILE_ZONE("NUPReader::read");
+
+  Resource::Model *model = context.createResource<Resource::Model>();
   scene->setModel(model);
 
   /* Read in NUP header at the top of the file. */
   stream.seek(0, SEEK_SET);
-  struct NUPHeader file_header;
+  struct NUPHeader file_header = stream.readStruct<NUPHeader>();
 
-  stream.seek(4, SEEK_CUR);
+  /* Read in additional model information. */
+  stream.seek(BODY_OFFSET + file_header.model_header_offset, SEEK_SET);
+  struct NUPModelHeader model_header = stream.readStruct<NUPModelHeader>();
 
-  file_header.strings_offset = stream.readUint32();
-  file_header.texture_header_offset = stream.readUint32();
-  file_header.material_header_offset = stream.readUint32();
+  // Splines come first, as they're all a camera needs to be placed while
+  // the rest is read
+  std::vector<NUPSpline> nupSplines (model_header.num_splines);
 
-  stream.seek(sizeof(uint32_t), SEEK_CUR);
+  stream.seek(BODY_OFFSET + model_header.splines_offset, SEEK_SET);
+  stream.readStructs(nupSplines.data(), model_header.num_splines);
 
-  file_header.vertex_header_offset = stream.readUint32();
-  file_header.model_header_offset = stream.readUint32();
-  file_header.instances_offset = stream.readUint32();
+  StringTable strings (context);
+  for (int i = 0; i < model_header.num_splines; i++) {
+    stream.seek(BODY_OFFSET + nupSplines[i].nameOffset, SEEK_SET);
+    std::string_view splineName = strings.read(stream);
 
-  /* Read in additional model information. */
-  stream.seek(BODY_OFFSET + file_header.model_header_offset, SEEK_SET);
-  struct NUPModelHeader model_header;
+    Resource::Spline *spline = context.createResource<Resource::Spline>();
 
-  stream.seek(3 * sizeof(uint32_t), SEEK_CUR);
+    scene->addSpline(splineName, spline);
+
+    stream.seek(BODY_OFFSET + nupSplines[i].verticesOffset, SEEK_SET);
+    for (int j = 0; j < nupSplines[i].vertexCount; j++) {
+      Math::Vector vertex = Math::Vector::fromStream(stream, 1.0f);
+      spline->addVertex(vertex);
+    }
+  }
 
-  model_header.num_materials = stream.readUint32();
-  model_header.num_mesh_blocks = stream.readUint32();
-  model_header.mesh_header_list_offset = stream.readUint32();
-  model_header.num_instances = stream.readUint32();
+  if (listener && listener->splinesRead) {
+    listener->splinesRead(scene);
+  }
 
-  stream.seek(sizeof(uint32_t), SEEK_CUR);
+  // Instances are placed up front, and given their meshes as each block is
+  // read
+  stream.seek(BODY_OFFSET + file_header.instances_offset, SEEK_SET);
+  std::vector<NUPInstance> instances_data (model_header.num_instances);
+  stream.readStructs(instances_data.data(), model_header.num_instances);
 
-  model_header.num_special_objects = stream.readUint32();
+  std::vector<std::vector<Resource::Instance *>> blockInstances (model_header.num_mesh_blocks);
+  for (int i = 0; i < model_header.num_instances; i++) {
+    Resource::Instance *instance = context.createResource<Resource::Instance>();
+    scene->addInstance(instance);
 
-  stream.seek(sizeof(uint32_t), SEEK_CUR);
+    if (instances_data[i].matrix_offset) {
+      stream.seek(BODY_OFFSET + instances_data[i].matrix_offset, SEEK_SET);
+      instance->setWorldTransform(Math::Affine(Math::Matrix::fromStream(stream)));
+    } else {
+      instance->setWorldTransform(Math::Affine(instances_data[i].transformation));
+    }
 
-  model_header.num_splines = stream.readUint32();
-  model_header.splines_offset = stream.readUint32();
+    blockInstances.at(instances_data[i].mesh_idx).push_back(instance);
+  }
 
   /* Read texture block information. */
   stream.seek(BODY_OFFSET + file_header.texture_header_offset, SEEK_SET);
   std::vector<Resource::Texture *> textures;
-  TexturesReader::read(textures, stream, BODY_OFFSET + file_header.texture_header_offset + 12);
+  TexturesReader::read(context, textures, stream, BODY_OFFSET + file_header.texture_header_offset + 12);
   for (auto texture : textures) {
     model->addTexture(texture);
   }
@@ -137,99 +261,71 @@ void NUPReader::read(Mortar::Resource::Scene *scene, Stream &stream) {
   /* Read materials. */
   stream.seek(BODY_OFFSET + file_header.material_header_offset, SEEK_SET);
   std::vector<Resource::Material *> materials;
-  MaterialsReader::read(materials, stream, BODY_OFFSET, textures);
+  MaterialsReader::read(context, materials, stream, BODY_OFFSET, textures);
 
   /* Read vertex data. */
   stream.seek(BODY_OFFSET + file_header.vertex_header_offset, SEEK_SET);
   std::vector<Resource::VertexBuffer *> vertexBuffers;
-  VertexBufferReader::read(vertexBuffers, stream, BODY_OFFSET + file_header.vertex_header_offset);
+  VertexBufferReader::read(context, vertexBuffers, stream, BODY_OFFSET + file_header.vertex_header_offset);
   for (auto vertexBuffer : vertexBuffers) {
     model->addVertexBuffer(vertexBuffer);
   }
 
-  /* Break the layers down into meshes and add those to the model's list. */
-  stream.seek(BODY_OFFSET + model_header.mesh_header_list_offset, SEEK_SET);
-  uint32_t *mesh_header_offsets = new uint32_t[model_header.num_mesh_blocks];
-
-  for (int i = 0; i < model_header.num_mesh_blocks; i++) {
-    mesh_header_offsets[i] = stream.readUint32();
+  if (listener && listener->vertexBuffersRead) {
+    listener->vertexBuffersRead(vertexBuffers);
   }
 
-  std::vector<std::forward_list<Resource::Mesh *>> meshes;
-  for (int i = 0; i < model_header.num_mesh_blocks; i++) {
-    stream.seek(BODY_OFFSET + mesh_header_offsets[i], SEEK_SET);
-
-    std::vector<Resource::Mesh *> blockMeshes;
-    MeshesReader::read(blockMeshes, stream, BODY_OFFSET, materials, vertexBuffers);
+  /* Break the layers down into meshes and add those to the model's list. */
+  stream.seek(BODY_OFFSET + model_header.mesh_header_list_offset, SEEK_SET);
+  std::vector<uint32_t> mesh_header_offsets (model_header.num_mesh_blocks);
+  stream.readArray(mesh_header_offsets.data(), model_header.num_mesh_blocks);
 
+  // Each instance is in exactly one block's list, so blocks read in
+  // parallel never touch the same one
+  std::vector<std::vector<Resource::Mesh *>> blockMeshes;
+  readMeshBlocks(context, blockMeshes, stream, mesh_header_offsets, materials, vertexBuffers, [&] (size_t i) {
     std::forward_list<Resource::Mesh *> meshList;
-    for (auto mesh : blockMeshes) {
-      model->addMesh(mesh);
+    for (auto mesh : blockMeshes[i]) {
       meshList.push_front(mesh);
     }
-    meshes.push_back(meshList);
-  }
-
-  delete [] mesh_header_offsets;
 
-  stream.seek(BODY_OFFSET + file_header.instances_offset, SEEK_SET);
-  NUPInstance *instances_data = new NUPInstance[model_header.num_instances];
-
-  for (int i = 0; i < model_header.num_instances; i++) {
-    instances_data[i].transformation = Math::Matrix::fromStream(stream);
-    instances_data[i].mesh_idx = stream.readUint16();
-
-    stream.seek(sizeof(uint16_t), SEEK_CUR);
-    stream.seek(sizeof(uint32_t), SEEK_CUR);
-
-    instances_data[i].matrix_offset = stream.readUint32();
+    for (auto instance : blockInstances[i]) {
+      instance->setMeshes(meshList);
+    }
 
-    stream.seek(sizeof(uint32_t), SEEK_CUR);
+    if (listener && listener->meshBlockRead) {
+      listener->meshBlockRead(blockMeshes[i], blockInstances[i]);
+    }
+  });
+
+  // Small static instances are merged once every block is in. Meshes only
+  // merged ones placed are left out of the model, so they aren't uploaded
+  // again.
+  std::vector<Resource::Mesh *> batchedMeshes = Resource::batchStaticInstances(context, scene);
+  if (listener && listener->staticBatchesBuilt) {
+    listener->staticBatchesBuilt(batchedMeshes);
   }
 
-  for (int i = 0; i < model_header.num_instances; i++) {
-    Resource::Instance *instance = resourceManager.createResource<Resource::Instance>();
-    scene->addInstance(instance);
+  std::unordered_set<const Resource::Mesh *> placedMeshes;
+  for (auto instance : scene->getInstances()) {
+    placedMeshes.insert(instance->getMeshes().begin(), instance->getMeshes().end());
+  }
 
-    if (instances_data[i].matrix_offset) {
-      stream.seek(BODY_OFFSET + instances_data[i].matrix_offset, SEEK_SET);
-      Math::Matrix transform = Math::Matrix::fromStream(stream);
-      instance->setWorldTransform(transform);
-    } else {
-      instance->setWorldTransform(instances_data[i].transformation);
+  for (auto& meshes : blockMeshes) {
+    for (auto mesh : meshes) {
+      if (batchedMeshes.empty() || placedMeshes.contains(mesh)) {
+        model->addMesh(mesh);
+      }
     }
-
-    instance->setMeshes(meshes.at(instances_data[i].mesh_idx));
   }
 
-  delete [] instances_data;
-
-  std::vector<NUPSpline> nupSplines (model_header.num_splines);
-
-  stream.seek(BODY_OFFSET + model_header.splines_offset, SEEK_SET);
-  for (int i = 0; i < model_header.num_splines; i++) {
-    struct NUPSpline& spline = nupSplines[i];
-
-    spline.vertexCount = stream.readUint16();
-
-    stream.seek(sizeof(uint16_t), SEEK_CUR);
-
-    spline.nameOffset = stream.readUint32();
-    spline.verticesOffset = stream.readUint32();
+  for (auto mesh : batchedMeshes) {
+    model->addMesh(mesh);
   }
 
-  for (int i = 0; i < model_header.num_splines; i++) {
-    stream.seek(BODY_OFFSET + nupSplines[i].nameOffset, SEEK_SET);
-    char *splineName = stream.readString();
-
-    Resource::Spline *spline = resourceManager.createResource<Resource::Spline>();
-
-    scene->addSpline(splineName, spline);
-
-    stream.seek(BODY_OFFSET + nupSplines[i].verticesOffset, SEEK_SET);
-    for (int j = 0; j < nupSplines[i].vertexCount; j++) {
-      Math::Vector vertex = Math::Vector::fromStream(stream, 1.0f);
-      spline->addVertex(vertex);
-    }
+  // Textures are reported last, so their uploads queue behind the geometry's
+  // and the scene takes shape in its material colors first
+  if (listener && listener->texturesRead) {
+    listener->texturesRead(textures);
   }
 }
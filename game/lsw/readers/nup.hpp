@@ -17,13 +17,34 @@
 #ifndef MORTAR_LSW_READERS_NUP_H
 #define MORTAR_LSW_READERS_NUP_H
 
+#include <functional>
+#include <vector>
+
+#include "../../../resource/loadcontext.hpp"
 #include "../../../streams/stream.hpp"
 #include "../../../resource/types/scene.hpp"
 
 namespace Mortar::Game::LSW::Readers {
   class NUPReader {
     public:
-      static void read(Resource::Scene *scene, Stream &stream);
+      // Told about parts of the scene as soon as they're read, so it can be
+      // drawn before the read is done. Any of these may be left empty. Mesh
+      // blocks are reported from whichever job read them.
+      struct Listener {
+        std::function<void (const Resource::Scene *)> splinesRead;
+        std::function<void (const std::vector<Resource::Texture *>&)> texturesRead;
+        std::function<void (const std::vector<Resource::VertexBuffer *>&)> vertexBuffersRead;
+
+        // A block's meshes, and the instances placing them
+        std::function<void (const std::vector<Resource::Mesh *>&, const std::vector<Resource::Instance *>&)> meshBlockRead;
+
+        // Meshes merged from small instances after every block is read. The
+        // scene's instances are replaced to place them, instead of the
+        // instances blocks reported.
+        std::function<void (const std::vector<Resource::Mesh *>&)> staticBatchesBuilt;
+      };
+
+      static void read(Resource::LoadContext& context, Resource::Scene *scene, Stream &stream, const Listener *listener = nullptr);
   };
 }
 
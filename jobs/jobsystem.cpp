@@ -0,0 +1,104 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "jobsystem.hpp"
+
+using namespace Mortar::Jobs;
+
+void JobSystem::initialize(unsigned int workerCount) {
+  if (workerCount == 0) {
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    workerCount = std::max(hardwareThreads, 2u) - 1;
+  }
+
+  this->stopping = false;
+
+  for (unsigned int i = 0; i < workerCount; i++) {
+    this->workers.emplace_back(&JobSystem::workerMain, this);
+  }
+}
+
+void JobSystem::shutDown() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopping = true;
+  }
+
+  this->available.notify_all();
+
+  for (auto& worker : this->workers) {
+    worker.join();
+  }
+
+  this->workers.clear();
+}
+
+unsigned int JobSystem::getWorkerCount() const {
+  return this->workers.size();
+}
+
+void JobSystem::enqueue(Job job) {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->queue.push_back(std::move(job));
+  }
+
+  this->available.notify_one();
+}
+
+bool JobSystem::runPending() {
+  Job job;
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->queue.empty()) {
+      return false;
+    }
+
+    job = std::move(this->queue.front());
+    this->queue.pop_front();
+  }
+
+  job();
+
+  return true;
+}
+
+void JobSystem::workerMain() {
+  while (true) {
+    Job job;
+
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->available.wait(lock, [this] () {
+        return this->stopping || !this->queue.empty();
+      });
+
+      // Drain what's queued before stopping so no future is left unfulfilled
+      if (this->queue.empty()) {
+        return;
+      }
+
+      job = std::move(this->queue.front());
+      this->queue.pop_front();
+    }
+
+    // Exceptions are captured by the job's packaged_task
+    job();
+  }
+}
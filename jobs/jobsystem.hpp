@@ -0,0 +1,172 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_JOBS_JOBSYSTEM_H
+#define MORTAR_JOBS_JOBSYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Mortar::Jobs {
+  // JobSystem runs submitted jobs on a fixed set of worker threads. Threads
+  // waiting on a job's future through wait() run queued jobs in the meantime,
+  // so jobs can wait on other jobs without starving the workers. Without any
+  // workers, jobs simply run on whichever thread waits for them.
+  class JobSystem {
+    public:
+      // Starts the workers; zero picks one fewer than the hardware threads.
+      void initialize(unsigned int workerCount = 0);
+      void shutDown();
+
+      template <typename F>
+      std::shared_future<std::invoke_result_t<F>> submit(F&& job);
+
+      template <typename T>
+      T wait(const std::shared_future<T>& future);
+
+      // Calls body(i) for every i below count and returns once all calls are
+      // done. Chunks of indices are claimed from a shared counter by the
+      // calling thread and by any workers free to help, so uneven chunks
+      // balance out. The caller never runs unrelated queued jobs here.
+      template <typename F>
+      void parallelFor(size_t count, size_t chunkSize, F&& body);
+
+      unsigned int getWorkerCount() const;
+
+    private:
+      typedef std::function<void ()> Job;
+
+      void enqueue(Job job);
+      void workerMain();
+
+      // Runs one queued job on the calling thread, if there are any
+      bool runPending();
+
+      std::vector<std::thread> workers;
+
+      std::mutex mutex;
+      std::condition_variable available;
+      std::deque<Job> queue;
+      bool stopping = false;
+  };
+
+  template <typename F>
+  std::shared_future<std::invoke_result_t<F>> JobSystem::submit(F&& job) {
+    typedef std::invoke_result_t<F> R;
+
+    // std::function needs a copyable target and packaged_task isn't one
+    auto task = std::make_shared<std::packaged_task<R ()>>(std::forward<F>(job));
+    std::shared_future<R> future = task->get_future().share();
+
+    this->enqueue([task] () {
+      (*task)();
+    });
+
+    return future;
+  }
+
+  template <typename T>
+  T JobSystem::wait(const std::shared_future<T>& future) {
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      if (!this->runPending()) {
+        // Whatever we're waiting on is running elsewhere, but it may queue
+        // more work, so check back rather than blocking outright
+        future.wait_for(std::chrono::milliseconds(1));
+      }
+    }
+
+    return future.get();
+  }
+
+  template <typename F>
+  void JobSystem::parallelFor(size_t count, size_t chunkSize, F&& body) {
+    struct Loop {
+      size_t count;
+      size_t chunkSize;
+      size_t chunkCount;
+      std::remove_reference_t<F> *body;
+
+      std::atomic<size_t> nextChunk = 0;
+      std::atomic<size_t> finishedChunks = 0;
+
+      std::mutex errorMutex;
+      std::exception_ptr error;
+    };
+
+    chunkSize = std::max<size_t>(chunkSize, 1);
+    size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+    if (chunkCount == 0) {
+      return;
+    }
+
+    // Helpers that only start after the loop is over find no chunks left, so
+    // they must not touch anything but the shared state
+    auto state = std::make_shared<Loop>();
+    state->count = count;
+    state->chunkSize = chunkSize;
+    state->chunkCount = chunkCount;
+    state->body = &body;
+
+    auto runChunks = [state] () {
+      for (size_t chunk = state->nextChunk++; chunk < state->chunkCount; chunk = state->nextChunk++) {
+        size_t end = std::min(state->count, (chunk + 1) * state->chunkSize);
+
+        try {
+          for (size_t i = chunk * state->chunkSize; i < end; i++) {
+            (*state->body)(i);
+          }
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(state->errorMutex);
+          if (!state->error) {
+            state->error = std::current_exception();
+          }
+        }
+
+        state->finishedChunks++;
+      }
+    };
+
+    // The calling thread takes chunks too, so it needs one fewer helper
+    size_t helperCount = std::min<size_t>(this->workers.size(), chunkCount - 1);
+    for (size_t i = 0; i < helperCount; i++) {
+      this->enqueue(runChunks);
+    }
+
+    runChunks();
+
+    // Only chunks already claimed by workers are left, and they're short
+    while (state->finishedChunks < chunkCount) {
+      std::this_thread::yield();
+    }
+
+    if (state->error) {
+      std::rethrow_exception(state->error);
+    }
+  }
+}
+
+#endif
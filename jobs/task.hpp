@@ -0,0 +1,282 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_JOBS_TASK_H
+#define MORTAR_JOBS_TASK_H
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "jobsystem.hpp"
+
+namespace Mortar::Jobs {
+  template <typename T>
+  class Task;
+
+  namespace Detail {
+    template <typename T>
+    struct TaskResult {
+      std::optional<T> value;
+
+      void return_value(T result) {
+        this->value.emplace(std::move(result));
+      }
+
+      T take() {
+        return std::move(*this->value);
+      }
+    };
+
+    template <>
+    struct TaskResult<void> {
+      void return_void() {}
+      void take() {}
+    };
+  }
+
+  // A coroutine producing a T. Tasks start when first awaited, or when
+  // handed to runTask(), and then run on whichever thread resumes them: the
+  // one that started them until their first suspension, and afterwards the
+  // worker that finished what they were waiting on. Anything a task throws
+  // is rethrown to whoever awaits it.
+  template <typename T = void>
+  class Task {
+    public:
+      struct promise_type : Detail::TaskResult<T> {
+        std::exception_ptr error;
+
+        // Resumed once the task finishes; without one, completion is set
+        std::coroutine_handle<> continuation;
+        std::shared_ptr<std::promise<void>> completion;
+
+        Task get_return_object() {
+          return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+          return {};
+        }
+
+        auto final_suspend() noexcept {
+          struct FinalAwaiter {
+            bool await_ready() noexcept {
+              return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+              promise_type& promise = handle.promise();
+              if (promise.continuation) {
+                return promise.continuation;
+              }
+
+              // The task may be destroyed as soon as this is set, so the
+              // completion is held here until it's done with
+              if (std::shared_ptr<std::promise<void>> completion = promise.completion) {
+                completion->set_value();
+              }
+
+              return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+          };
+
+          return FinalAwaiter {};
+        }
+
+        void unhandled_exception() {
+          this->error = std::current_exception();
+        }
+      };
+
+      Task(Task&& other)
+        : handle { std::exchange(other.handle, nullptr) } {};
+
+      Task& operator=(Task&& other) {
+        if (this != &other) {
+          if (this->handle) {
+            this->handle.destroy();
+          }
+
+          this->handle = std::exchange(other.handle, nullptr);
+        }
+
+        return *this;
+      }
+
+      ~Task() {
+        if (this->handle) {
+          this->handle.destroy();
+        }
+      }
+
+      Task(const Task&) = delete;
+      Task& operator=(const Task&) = delete;
+
+      // Starts the task, suspending the awaiting coroutine until it's done
+      auto operator co_await() && {
+        struct Awaiter {
+          std::coroutine_handle<promise_type> handle;
+
+          bool await_ready() {
+            return false;
+          }
+
+          std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+            this->handle.promise().continuation = awaiting;
+            return this->handle;
+          }
+
+          T await_resume() {
+            promise_type& promise = this->handle.promise();
+            if (promise.error) {
+              std::rethrow_exception(promise.error);
+            }
+
+            return promise.take();
+          }
+        };
+
+        return Awaiter { this->handle };
+      }
+
+      template <typename U>
+      friend U runTask(JobSystem& jobSystem, Task<U> task);
+
+    private:
+      explicit Task(std::coroutine_handle<promise_type> handle)
+        : handle { handle } {};
+
+      std::coroutine_handle<promise_type> handle;
+  };
+
+  // Runs a task to completion from outside any coroutine. The calling thread
+  // runs queued jobs until it's done, as JobSystem::wait() does.
+  template <typename T>
+  T runTask(JobSystem& jobSystem, Task<T> task) {
+    typename Task<T>::promise_type& promise = task.handle.promise();
+
+    promise.completion = std::make_shared<std::promise<void>>();
+    std::shared_future<void> done = promise.completion->get_future().share();
+
+    task.handle.resume();
+    jobSystem.wait(done);
+
+    if (promise.error) {
+      std::rethrow_exception(promise.error);
+    }
+
+    return promise.take();
+  }
+
+  // Suspends the awaiting coroutine and resumes it as a job, freeing the
+  // thread it was running on
+  inline auto schedule(JobSystem& jobSystem) {
+    struct Awaiter {
+      JobSystem& jobSystem;
+
+      bool await_ready() {
+        return false;
+      }
+
+      void await_suspend(std::coroutine_handle<> handle) {
+        this->jobSystem.submit([handle] () {
+          handle.resume();
+        });
+      }
+
+      void await_resume() {}
+    };
+
+    return Awaiter { jobSystem };
+  }
+
+  // A job started as soon as it's made, for a coroutine to await later. Jobs
+  // started together run in parallel, and awaiting one that's still running
+  // suspends the coroutine rather than the thread, to be resumed by the
+  // worker that finishes it.
+  template <typename T>
+  class AsyncJob {
+    public:
+      template <typename F>
+      AsyncJob(JobSystem& jobSystem, F&& job)
+        : state { std::make_shared<State>() } {
+        jobSystem.submit([state = this->state, job = std::forward<F>(job)] () mutable {
+          try {
+            if constexpr (std::is_void_v<T>) {
+              job();
+            } else {
+              state->value.emplace(job());
+            }
+          } catch (...) {
+            state->error = std::current_exception();
+          }
+
+          // Whoever gets here second resumes the coroutine: either it's
+          // already waiting, or it'll find the job done and not wait
+          void *waiting = state->waiting.exchange(DONE, std::memory_order_acq_rel);
+          if (waiting) {
+            std::coroutine_handle<>::from_address(waiting).resume();
+          }
+        });
+      }
+
+      bool await_ready() const {
+        return this->state->waiting.load(std::memory_order_acquire) == DONE;
+      }
+
+      bool await_suspend(std::coroutine_handle<> handle) {
+        void *expected = nullptr;
+        return this->state->waiting.compare_exchange_strong(expected, handle.address(), std::memory_order_acq_rel);
+      }
+
+      T await_resume() {
+        if (this->state->error) {
+          std::rethrow_exception(this->state->error);
+        }
+
+        if constexpr (!std::is_void_v<T>) {
+          return std::move(*this->state->value);
+        }
+      }
+
+    private:
+      // Any address no coroutine frame can have
+      static inline char doneMarker;
+      static inline void *const DONE = &doneMarker;
+
+      struct State {
+        std::conditional_t<std::is_void_v<T>, bool, std::optional<T>> value;
+        std::exception_ptr error;
+        std::atomic<void *> waiting { nullptr };
+      };
+
+      std::shared_ptr<State> state;
+  };
+
+  template <typename F>
+  AsyncJob<std::invoke_result_t<F>> async(JobSystem& jobSystem, F&& job) {
+    return AsyncJob<std::invoke_result_t<F>>(jobSystem, std::forward<F>(job));
+  }
+}
+
+#endif
@@ -0,0 +1,229 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// Bytes of messages per thread waiting to be printed
+#define RING_CAPACITY (1 << 16)
+
+// Longest message kept; anything past it is cut off
+#define MESSAGE_CAPACITY 8192
+
+namespace {
+  // A single producer, single consumer byte ring. Each message is its length
+  // followed by its text, and may wrap around the end.
+  struct Ring {
+    std::array<char, RING_CAPACITY> bytes;
+
+    // Bytes ever written and ever read; only the owning thread moves head,
+    // only the writer thread moves tail
+    std::atomic<uint64_t> head { 0 };
+    std::atomic<uint64_t> tail { 0 };
+    std::atomic<uint64_t> dropped { 0 };
+
+    void copyIn(uint64_t position, const void *data, size_t size) {
+      size_t offset = position % RING_CAPACITY;
+      size_t first = std::min<size_t>(size, RING_CAPACITY - offset);
+
+      memcpy(&this->bytes[offset], data, first);
+      memcpy(&this->bytes[0], (const char *)data + first, size - first);
+    }
+
+    void copyOut(uint64_t position, void *data, size_t size) const {
+      size_t offset = position % RING_CAPACITY;
+      size_t first = std::min<size_t>(size, RING_CAPACITY - offset);
+
+      memcpy(data, &this->bytes[offset], first);
+      memcpy((char *)data + first, &this->bytes[0], size - first);
+    }
+  };
+
+  class Writer {
+    public:
+      Writer()
+        : thread { &Writer::run, this } {
+        this->thread.detach();
+      }
+
+      Ring *addRing() {
+        std::lock_guard<std::mutex> lock(this->ringsMutex);
+
+        this->rings.push_back(std::make_unique<Ring>());
+        return this->rings.back().get();
+      }
+
+      // Doesn't take the lock, so a writing thread never waits for one
+      void notify() {
+        this->wake.notify_one();
+      }
+
+      void flush() {
+        std::lock_guard<std::mutex> lock(this->drainMutex);
+        this->drain();
+      }
+
+    private:
+      void run() {
+        std::unique_lock<std::mutex> lock(this->wakeMutex);
+
+        while (true) {
+          // Notifies can be missed, as writers don't lock, so this polls too
+          this->wake.wait_for(lock, std::chrono::milliseconds(10));
+
+          std::lock_guard<std::mutex> drainLock(this->drainMutex);
+          this->drain();
+        }
+      }
+
+      void drain() {
+        std::vector<Ring *> rings;
+        {
+          std::lock_guard<std::mutex> lock(this->ringsMutex);
+          for (auto& ring : this->rings) {
+            rings.push_back(ring.get());
+          }
+        }
+
+        for (Ring *ring : rings) {
+          uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+          uint64_t head = ring->head.load(std::memory_order_acquire);
+
+          while (tail < head) {
+            uint32_t length;
+            ring->copyOut(tail, &length, sizeof(length));
+            ring->copyOut(tail + sizeof(length), this->message.data(), length);
+            tail += sizeof(length) + length;
+
+            fwrite(this->message.data(), 1, length, stderr);
+          }
+
+          ring->tail.store(tail, std::memory_order_release);
+
+          uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+          if (dropped > 0) {
+            fprintf(stderr, "%llu log messages dropped\n", (unsigned long long)dropped);
+          }
+        }
+
+        fflush(stderr);
+      }
+
+      // Rings are never freed, so messages from threads that have exited are
+      // still printed
+      std::mutex ringsMutex;
+      std::vector<std::unique_ptr<Ring>> rings;
+
+      std::array<char, MESSAGE_CAPACITY> message;
+
+      std::mutex wakeMutex;
+      std::condition_variable wake;
+      std::mutex drainMutex;
+
+      std::thread thread;
+  };
+
+  std::terminate_handler previousTerminate = nullptr;
+
+  // Never destroyed, as threads may still log while statics are torn down;
+  // whatever is left is printed at exit, or before an uncaught exception
+  // ends the process, as what led up to it matters most then
+  Writer& getWriter() {
+    static Writer *writer = [] {
+      Writer *writer = new Writer();
+      atexit([] { Mortar::Log::flush(); });
+
+      previousTerminate = std::set_terminate([] {
+        Mortar::Log::flush();
+
+        if (previousTerminate) {
+          previousTerminate();
+        }
+        abort();
+      });
+
+      return writer;
+    }();
+
+    return *writer;
+  }
+
+  thread_local Ring *threadRing = nullptr;
+}
+
+void Mortar::Log::write(int level, const char *format, ...) {
+  Writer& writer = getWriter();
+  if (!threadRing) {
+    threadRing = writer.addRing();
+  }
+
+  char message[MESSAGE_CAPACITY];
+  const char *prefix = level == MORTAR_LOG_LEVEL_WARNING ? "WARNING: " : "";
+  size_t prefixLength = strlen(prefix);
+  memcpy(message, prefix, prefixLength);
+
+  va_list args;
+  va_start(args, format);
+  int formatted = vsnprintf(message + prefixLength, sizeof(message) - prefixLength - 1, format, args);
+  va_end(args);
+
+  uint32_t length = prefixLength + std::clamp<int>(formatted, 0, sizeof(message) - prefixLength - 2);
+  message[length++] = '\n';
+
+  // Warnings are printed before returning, so they survive a crash that
+  // follows them; they're rare enough that waiting costs nothing
+  bool isUrgent = level >= MORTAR_LOG_LEVEL_WARNING;
+
+  Ring *ring = threadRing;
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  uint64_t tail = ring->tail.load(std::memory_order_acquire);
+
+  if (isUrgent && RING_CAPACITY - (head - tail) < sizeof(length) + length) {
+    writer.flush();
+    tail = ring->tail.load(std::memory_order_acquire);
+  }
+
+  if (RING_CAPACITY - (head - tail) < sizeof(length) + length) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  ring->copyIn(head, &length, sizeof(length));
+  ring->copyIn(head + sizeof(length), message, length);
+  ring->head.store(head + sizeof(length) + length, std::memory_order_release);
+
+  if (isUrgent) {
+    writer.flush();
+  } else {
+    writer.notify();
+  }
+}
+
+void Mortar::Log::flush() {
+  getWriter().flush();
+}
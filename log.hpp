@@ -13,7 +13,46 @@
  * You should have received a copy of the GNU General Public License
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
+#ifndef MORTAR_LOG_H
+#define MORTAR_LOG_H
 
 #include <stdio.h>
 
-#define DEBUG(format, ...) fprintf(stderr, __FILE__ ",%d: " format "\n", __LINE__ __VA_OPT__(,) __VA_ARGS__)
+#define MORTAR_LOG_LEVEL_TRACE 0
+#define MORTAR_LOG_LEVEL_DEBUG 1
+#define MORTAR_LOG_LEVEL_WARNING 2
+#define MORTAR_LOG_LEVEL_NONE 3
+
+// Messages below the minimum level compile to nothing, arguments included.
+// Per-frame tracing is only kept in builds with asserts unless the
+// MORTAR_LOG_LEVEL CMake option says otherwise.
+#ifndef MORTAR_LOG_LEVEL
+#ifdef NDEBUG
+#define MORTAR_LOG_LEVEL MORTAR_LOG_LEVEL_DEBUG
+#else
+#define MORTAR_LOG_LEVEL MORTAR_LOG_LEVEL_TRACE
+#endif
+#endif
+
+#define MORTAR_LOG(level, format, ...) do { \
+    if constexpr (level >= MORTAR_LOG_LEVEL) { \
+      Mortar::Log::write(level, __FILE__ ",%d: " format, __LINE__ __VA_OPT__(,) __VA_ARGS__); \
+    } \
+  } while (0)
+
+#define TRACE(format, ...) MORTAR_LOG(MORTAR_LOG_LEVEL_TRACE, format __VA_OPT__(,) __VA_ARGS__)
+#define DEBUG(format, ...) MORTAR_LOG(MORTAR_LOG_LEVEL_DEBUG, format __VA_OPT__(,) __VA_ARGS__)
+#define WARNING(format, ...) MORTAR_LOG(MORTAR_LOG_LEVEL_WARNING, format __VA_OPT__(,) __VA_ARGS__)
+
+namespace Mortar::Log {
+  // Formats the message into the calling thread's ring for the writer thread
+  // to print. Below WARNING it never waits on stderr, and if the ring is
+  // full the message is dropped and counted. Warnings are printed, along with
+  // everything before them, before this returns.
+  void write(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+  // Waits until every message written so far has been printed
+  void flush();
+}
+
+#endif
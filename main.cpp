@@ -18,50 +18,334 @@
 
 #include <GL/gl.h>
 #include <SDL2/SDL_keycode.h>
+#include <algorithm>
+#include <memory>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "game/lsw/game.hpp"
 #include "render/gl/renderer.hpp"
+#include "render/null/renderer.hpp"
+#include "render/recording/renderer.hpp"
+#ifdef MORTAR_VULKAN
+#include "render/vulkan/renderer.hpp"
+#endif
 #include "log.hpp"
+#include "profiler.hpp"
 #include "state.hpp"
 
+// Window size unless --window gives another
 #define WIDTH 800
 #define HEIGHT 600
 
+// Frames 'c' captures for replaying
+#define CAPTURE_FRAMES 300
+
 using namespace Mortar;
 
+static void printPercentiles(const char *phase, std::vector<float> times) {
+  if (times.empty()) {
+    return;
+  }
+
+  std::sort(times.begin(), times.end());
+  auto percentile = [&] (float p) { return times[std::min<size_t>(times.size() * p, times.size() - 1)]; };
+
+  printf("%-8s p50 %.3fms p90 %.3fms p99 %.3fms max %.3fms\n", phase, percentile(0.5f), percentile(0.9f), percentile(0.99f), times.back());
+}
+
+// Loads a scene and simulates a set number of frames with no window or GPU,
+// then prints what loading and each phase of the frames cost. Every frame is
+// a whole fixed step, so runs on different machines simulate the same thing.
+// With prefetch set, the prefetcher reads and preloads the scene first.
+// Nothing's prefetched behind it, so the frames are measured undisturbed.
+static int runHeadless(const char *sceneName, unsigned frameCount, bool prefetch) {
+  State::getJobSystem().initialize();
+  State::getResourceManager().initialize(&State::getJobSystem());
+
+  State::getDisplayManager().initialize(DisplayManager::GraphicsAPI::NONE, WIDTH, HEIGHT);
+
+  auto renderer = Render::Null::Renderer();
+  State::getSceneManager().initialize(&renderer);
+
+  auto game = Game::LSW::Game();
+  game.setStartScene("");
+  game.setPrefetchNextScene(false);
+  game.initialize();
+
+  float msPerCount = 1000.0f / SDL_GetPerformanceFrequency();
+
+  float prefetchTime = 0.0f;
+  if (prefetch) {
+    uint64_t prefetchStart = SDL_GetPerformanceCounter();
+    game.prefetchScene(sceneName);
+    while (game.isPrefetching()) {
+      SDL_Delay(1);
+    }
+    prefetchTime = (SDL_GetPerformanceCounter() - prefetchStart) * msPerCount;
+  }
+
+  uint64_t loadStart = SDL_GetPerformanceCounter();
+  game.loadScene(sceneName);
+  float loadTime = (SDL_GetPerformanceCounter() - loadStart) * msPerCount;
+
+  Clock& clock = State::getClock();
+  clock.initialize();
+
+  std::vector<float> frameTimes, animateTimes, collectTimes, waitTimes;
+  frameTimes.reserve(frameCount);
+  animateTimes.reserve(frameCount);
+  collectTimes.reserve(frameCount);
+  waitTimes.reserve(frameCount);
+
+  for (unsigned i = 0; i < frameCount; i++) {
+    uint64_t frameStart = SDL_GetPerformanceCounter();
+
+    clock.update(clock.getStepDuration());
+    State::getSceneManager().render();
+
+    frameTimes.push_back((SDL_GetPerformanceCounter() - frameStart) * msPerCount);
+
+    const Scene::FrameTimings& timings = State::getSceneManager().getFrameTimings();
+    animateTimes.push_back(timings.animateTime);
+    collectTimes.push_back(timings.collectTime);
+    waitTimes.push_back(timings.waitTime);
+  }
+
+  std::string memoryReport = State::getResourceManager().getMemoryReport().toString();
+
+  game.shutDown();
+  State::getJobSystem().shutDown();
+  State::getSceneManager().shutDown();
+  State::getResourceManager().shutDown();
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  printf("scene %s, %u frames\n", sceneName, frameCount);
+  if (prefetch) {
+    printf("prefetch %.3fms\n", prefetchTime);
+  }
+  printf("load     %.3fms\n", loadTime);
+  printPercentiles("frame", frameTimes);
+  printPercentiles("animate", animateTimes);
+  printPercentiles("collect", collectTimes);
+  printPercentiles("wait", waitTimes);
+  printf("peak rss %ld KiB\n", usage.ru_maxrss);
+  printf("%s", memoryReport.c_str());
+
+  return 0;
+}
+
 int main(int argc, char **argv) {
+  // --headless runs a benchmark of the named scene instead of the game, for
+  // --frames frames. --prefetch has the prefetcher read the scene first, so
+  // its load can be set against a cold one.
+  const char *headlessScene = nullptr;
+  unsigned headlessFrames = 1000;
+  bool headlessPrefetch = false;
+  unsigned frameRateCap = 0;
+
+  // --window WxH sizes the window, and --render-scale draws at a fraction of
+  // it. --dynamic-res ms starts with the scale steered to keep GPU frames
+  // under that many milliseconds, which 'd' toggles.
+  unsigned windowWidth = WIDTH;
+  unsigned windowHeight = HEIGHT;
+  Render::ResolutionController::Settings resolution;
+
+  // --progressive-load draws scenes as they're read off disk
+  bool progressiveLoad = false;
+
+  // --texture-budget MiB caps the GPU memory streamed texture levels take
+  uint64_t textureBudget = Render::GL::Renderer::DEFAULT_TEXTURE_BUDGET;
+
+  // --memory-budget MiB caps what unused named resources stay cached in
+  size_t memoryBudget = Resource::ResourceManager::DEFAULT_MEMORY_BUDGET;
+
+  // --telemetry path writes a line of counters a second to the file, and
+  // --telemetry-port port sends them to that UDP port on this machine
+  Telemetry::Settings telemetry;
+
+  // --gpu-palettes composes skin palettes in a compute shader rather than on
+  // the CPU, where GL 4.3 is available
+  bool gpuPalettes = false;
+
+  // --vulkan draws with the Vulkan renderer, where it's built, in place of GL
+  bool useVulkan = false;
+
+  // --capture path is where 'b' saves what 'c' captured, and what it replays
+  // when nothing's been captured this run, so builds can be compared over
+  // the same frames
+  const char *capturePath = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--progressive-load") == 0) {
+      progressiveLoad = true;
+    } else if (strcmp(argv[i], "--gpu-palettes") == 0) {
+      gpuPalettes = true;
+    } else if (strcmp(argv[i], "--vulkan") == 0) {
+      useVulkan = true;
+    } else if (strcmp(argv[i], "--prefetch") == 0) {
+      headlessPrefetch = true;
+    } else if (i + 1 == argc) {
+      break;
+    } else if (strcmp(argv[i], "--headless") == 0) {
+      headlessScene = argv[++i];
+    } else if (strcmp(argv[i], "--frames") == 0) {
+      headlessFrames = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--max-fps") == 0) {
+      frameRateCap = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--window") == 0) {
+      if (sscanf(argv[++i], "%ux%u", &windowWidth, &windowHeight) != 2) {
+        windowWidth = WIDTH;
+        windowHeight = HEIGHT;
+      }
+    } else if (strcmp(argv[i], "--render-scale") == 0) {
+      resolution.scale = atof(argv[++i]);
+      resolution.minScale = std::min(resolution.minScale, resolution.scale);
+    } else if (strcmp(argv[i], "--dynamic-res") == 0) {
+      resolution.dynamic = true;
+      resolution.targetFrameTime = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--texture-budget") == 0) {
+      textureBudget = strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+    } else if (strcmp(argv[i], "--memory-budget") == 0) {
+      memoryBudget = strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+    } else if (strcmp(argv[i], "--telemetry") == 0) {
+      telemetry.path = argv[++i];
+    } else if (strcmp(argv[i], "--telemetry-port") == 0) {
+      telemetry.port = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--capture") == 0) {
+      capturePath = argv[++i];
+    }
+  }
+
+  State::getResourceManager().setMemoryBudget(memoryBudget);
+
+  if (headlessScene) {
+    return runHeadless(headlessScene, headlessFrames, headlessPrefetch);
+  }
+
   if (SDL_Init(SDL_INIT_VIDEO)) {
     DEBUG("failed to initialize SDL");
     return -1;
   }
 
-  State::getResourceManager().initialize();
+  State::getJobSystem().initialize();
+  State::getResourceManager().initialize(&State::getJobSystem());
+
+#ifndef MORTAR_VULKAN
+  if (useVulkan) {
+    DEBUG("built without the Vulkan renderer; drawing with GL");
+    useVulkan = false;
+  }
+#endif
+
+  DisplayManager& displayManager = State::getDisplayManager();
+  displayManager.initialize(useVulkan ? Mortar::DisplayManager::GraphicsAPI::VULKAN : Mortar::DisplayManager::GraphicsAPI::OPENGL, windowWidth, windowHeight);
 
-  State::getDisplayManager().initialize(Mortar::DisplayManager::GraphicsAPI::OPENGL, WIDTH, HEIGHT);
+  // --max-fps caps the frame rate, e.g. where power draw has to stay low
+  displayManager.setFrameRateCap(frameRateCap);
 
-  auto renderer = Render::GL::Renderer();
+  // Only the backend in use is made. Resolution scaling, texture budgets
+  // and GPU palettes are GL's alone, so they're left null under Vulkan.
+  std::unique_ptr<Render::GL::Renderer> glRenderer;
+  Render::Renderer *baseRenderer = nullptr;
+#ifdef MORTAR_VULKAN
+  std::unique_ptr<Render::Vulkan::Renderer> vulkanRenderer;
+  if (useVulkan) {
+    vulkanRenderer = std::make_unique<Render::Vulkan::Renderer>();
+    baseRenderer = vulkanRenderer.get();
+  }
+#endif
+
+  if (!baseRenderer) {
+    glRenderer = std::make_unique<Render::GL::Renderer>();
+    baseRenderer = glRenderer.get();
+    glRenderer->setResolution(resolution);
+    glRenderer->setTextureBudget(textureBudget);
+    glRenderer->setGPUPalettes(gpuPalettes);
+  } else if (resolution.scale != 1.0f || resolution.dynamic || textureBudget != Render::GL::Renderer::DEFAULT_TEXTURE_BUDGET || gpuPalettes) {
+    DEBUG("--render-scale, --dynamic-res, --texture-budget and --gpu-palettes only apply to the GL renderer");
+  }
+
+  // Frames the renderer draws can be captured and replayed to it
+  auto renderer = Render::Recording::Renderer(baseRenderer);
   State::getSceneManager().initialize(&renderer);
 
   auto game = Game::LSW::Game();
+  game.setProgressiveLoad(progressiveLoad);
   game.initialize();
 
+  if (!telemetry.path.empty() || telemetry.port) {
+    State::getTelemetry().start(telemetry);
+  }
+
   // Start the clock
   State::getClock().initialize();
 
+  // 'o' shows the renderer's costs in the title bar, and 'm' the memory
+  // resources take, refreshed a few times a second so they stay readable.
+  // 'm' also prints the full memory report.
+  bool showStats = false;
+  bool showMemory = false;
+  uint32_t statsShownAt = 0;
+
+  // 'c' captures the next few frames, and 'b' switches between replaying
+  // them in a loop and running the scene. Each pass through them is set
+  // against what the frames cost when recorded.
+  Render::Capture capture;
+  bool replaying = false;
+  size_t replayFrame = 0;
+  Render::RenderStats replayCost {};
+  Render::RenderStats recordedCost {};
+
   // Game loop
   bool shouldClose = false;
   while (!shouldClose) {
     State::getClock().update();
-    State::getSceneManager().render();
+    game.update();
+
+    if (replaying) {
+      State::getSceneManager().replay(capture, replayFrame);
+
+      Render::RenderStats stats = State::getSceneManager().getRenderStats();
+      const Render::RenderStats& recorded = capture.getFrame(replayFrame).stats;
+      replayCost.gpuFrameTime += stats.gpuFrameTime;
+      replayCost.submitTime += stats.submitTime;
+      replayCost.drawCalls += stats.drawCalls;
+      recordedCost.gpuFrameTime += recorded.gpuFrameTime;
+      recordedCost.submitTime += recorded.submitTime;
+      recordedCost.drawCalls += recorded.drawCalls;
+
+      replayFrame = (replayFrame + 1) % capture.getFrameCount();
+      if (replayFrame == 0) {
+        float frames = capture.getFrameCount();
+        DEBUG("replay: gpu %.2f ms (recorded %.2f), submit %.2f ms (recorded %.2f), %.0f draw calls (recorded %.0f)",
+          replayCost.gpuFrameTime / frames, recordedCost.gpuFrameTime / frames, replayCost.submitTime / frames,
+          recordedCost.submitTime / frames, replayCost.drawCalls / frames, recordedCost.drawCalls / frames);
+
+        replayCost = {};
+        recordedCost = {};
+      }
+    } else {
+      State::getSceneManager().render();
+    }
+
+    if (State::getTelemetry().isRunning()) {
+      State::getTelemetry().recordFrame(State::getSceneManager().getFrameTimings(), State::getSceneManager().getRenderStats());
+    }
 
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
-      if (event.type == SDL_KEYDOWN) {
+      if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+        displayManager.setWindowDimensions(event.window.data1, event.window.data2);
+      } else if (event.type == SDL_KEYDOWN) {
         if (event.key.keysym.sym == SDLK_ESCAPE || event.key.keysym.sym == SDLK_q) {
           shouldClose = true;
         } else if (event.key.keysym.sym == SDLK_a) {
@@ -70,6 +354,99 @@ int main(int argc, char **argv) {
           State::animRate = State::animRate == 30.0f ? 1.0f : 30.0f;
         } else if (event.key.keysym.sym == SDLK_p) {
           State::printNextFrame = true;
+        } else if (event.key.keysym.sym == SDLK_v) {
+          switch (displayManager.getSwapInterval()) {
+            case DisplayManager::SwapInterval::VSYNC:
+              displayManager.setSwapInterval(DisplayManager::SwapInterval::ADAPTIVE);
+              break;
+            case DisplayManager::SwapInterval::ADAPTIVE:
+              displayManager.setSwapInterval(DisplayManager::SwapInterval::IMMEDIATE);
+              break;
+            case DisplayManager::SwapInterval::IMMEDIATE:
+              displayManager.setSwapInterval(DisplayManager::SwapInterval::VSYNC);
+              break;
+          };
+          DEBUG("swap interval %d", static_cast<int>(displayManager.getSwapInterval()));
+#ifdef MORTAR_PROFILE
+        } else if (event.key.keysym.sym == SDLK_t) {
+          if (Profiler::writeChromeTrace("mortar-trace.json")) {
+            DEBUG("wrote mortar-trace.json");
+          }
+#endif
+        } else if (event.key.keysym.sym == SDLK_f) {
+          DisplayManager::FrameStats stats = displayManager.getFrameStats();
+          DEBUG("frame time avg %.2fms, min %.2fms, max %.2fms, 99%% %.2fms", stats.average * 1000.0f, stats.minimum * 1000.0f, stats.maximum * 1000.0f, stats.percentile99 * 1000.0f);
+        } else if (event.key.keysym.sym == SDLK_o) {
+          showStats = !showStats;
+          if (!showStats && !showMemory) {
+            SDL_SetWindowTitle(displayManager.getWindow(), "Mortar Engine");
+          }
+        } else if (event.key.keysym.sym == SDLK_m) {
+          showMemory = !showMemory;
+          if (showMemory) {
+            DEBUG("%s", State::getResourceManager().getMemoryReport().toString().c_str());
+          } else if (!showStats) {
+            SDL_SetWindowTitle(displayManager.getWindow(), "Mortar Engine");
+          }
+        } else if (event.key.keysym.sym == SDLK_c) {
+          renderer.startRecording(CAPTURE_FRAMES);
+          replaying = false;
+          DEBUG("capturing %d frames", CAPTURE_FRAMES);
+        } else if (event.key.keysym.sym == SDLK_b) {
+          if (replaying) {
+            replaying = false;
+            DEBUG("running the scene");
+          } else {
+            // Frames recorded since the last 'c' replace the last capture
+            Render::Capture recorded = renderer.takeCapture();
+            try {
+              if (recorded.getFrameCount()) {
+                capture = std::move(recorded);
+                if (capturePath) {
+                  capture.save(capturePath, State::getResourceManager());
+                  DEBUG("saved capture to %s", capturePath);
+                }
+              } else if (capturePath && !capture.getFrameCount()) {
+                capture = Render::Capture::load(capturePath, State::getResourceManager());
+              }
+            } catch (std::runtime_error& e) {
+              WARNING("%s", e.what());
+            }
+
+            replaying = capture.getFrameCount() != 0;
+            replayFrame = 0;
+            replayCost = {};
+            recordedCost = {};
+            DEBUG("replaying %zu frames", capture.getFrameCount());
+          }
+        } else if (event.key.keysym.sym == SDLK_d) {
+          if (!glRenderer) {
+            DEBUG("dynamic resolution needs the GL renderer");
+            continue;
+          }
+
+          Render::ResolutionController::Settings settings = glRenderer->getResolution();
+          settings.dynamic = !settings.dynamic;
+          glRenderer->setResolution(settings);
+          DEBUG("dynamic resolution %d", settings.dynamic);
+        } else if (event.key.keysym.sym == SDLK_z) {
+          Scene::SceneManager& sceneManager = State::getSceneManager();
+          switch (sceneManager.getDepthMode()) {
+            case Render::DepthMode::STATE_SORTED:
+              sceneManager.setDepthMode(Render::DepthMode::FRONT_TO_BACK);
+              break;
+            case Render::DepthMode::FRONT_TO_BACK:
+              sceneManager.setDepthMode(Render::DepthMode::PREPASS);
+              break;
+            case Render::DepthMode::PREPASS:
+              sceneManager.setDepthMode(Render::DepthMode::STATE_SORTED);
+              break;
+          };
+          DEBUG("depth mode %d", static_cast<int>(sceneManager.getDepthMode()));
+        } else if (event.key.keysym.sym == SDLK_h) {
+          Scene::SceneManager& sceneManager = State::getSceneManager();
+          sceneManager.setOcclusionCulling(!sceneManager.getOcclusionCulling());
+          DEBUG("occlusion culling %d", sceneManager.getOcclusionCulling());
         } else if (event.key.keysym.sym == SDLK_i) {
           switch (State::interpolate) {
             case State::InterpolateType::NONE:
@@ -84,10 +461,50 @@ int main(int argc, char **argv) {
         shouldClose = true;
       }
     }
+
+    if ((showStats || showMemory) && SDL_GetTicks() - statsShownAt >= 250) {
+      Render::RenderStats stats = State::getSceneManager().getRenderStats();
+
+      char title[512] = "Mortar Engine";
+      size_t length = strlen(title);
+
+      if (showStats) {
+        length += snprintf(title + length, sizeof(title) - length, " | %ux%u | cpu %.2fms gpu %.2fms (upload %.2f palette %.2f prepass %.2f static %.2f skinned %.2f alpha %.2f) | %u draws %llu tris %u changes %llu KiB",
+          stats.renderWidth, stats.renderHeight, stats.submitTime, stats.gpuFrameTime, stats.uploadTime, stats.paletteTime, stats.prepassTime, stats.opaqueStaticTime, stats.opaqueSkinnedTime, stats.alphaTime,
+          stats.drawCalls, (unsigned long long)stats.triangles, stats.stateChanges, (unsigned long long)(stats.bytesUploaded / 1024));
+
+        const Scene::CullStats& cull = State::getSceneManager().getCullStats();
+        if (length < sizeof(title)) {
+          length += snprintf(title + length, sizeof(title) - length, " | static %u culled frustum %u occlusion %u (%u occluders %u tris)",
+            cull.sceneDraws, cull.frustumRejected, cull.occlusionRejected, cull.occluders, cull.occluderTriangles);
+        }
+      }
+
+      if (showMemory && glRenderer && length < sizeof(title)) {
+        snprintf(title + length, sizeof(title) - length, " | resident %.1f MiB | gpu buffers %.1f MiB textures %.1f/%.0f MiB (%u levels in %u out)",
+          State::getResourceManager().getResidentSize() / (1024.0 * 1024.0), stats.bufferMemory / (1024.0 * 1024.0), stats.textureMemory / (1024.0 * 1024.0),
+          glRenderer->getTextureBudget() / (1024.0 * 1024.0), stats.textureLevelsStreamed, stats.textureLevelsEvicted);
+      } else if (showMemory && length < sizeof(title)) {
+        snprintf(title + length, sizeof(title) - length, " | resident %.1f MiB | gpu buffers %.1f MiB textures %.1f MiB",
+          State::getResourceManager().getResidentSize() / (1024.0 * 1024.0), stats.bufferMemory / (1024.0 * 1024.0), stats.textureMemory / (1024.0 * 1024.0));
+      }
+
+      SDL_SetWindowTitle(displayManager.getWindow(), title);
+      statsShownAt = SDL_GetTicks();
+    }
+
+    displayManager.pace();
   }
 
-  State::getResourceManager().shutDown();
+  game.shutDown();
+  State::getTelemetry().stop();
+
+  // Let any outstanding loads finish before their resources are freed
+  State::getJobSystem().shutDown();
+
+  // The render thread may still be drawing resources the manager frees
   State::getSceneManager().shutDown();
+  State::getResourceManager().shutDown();
 
   SDL_Quit();
 
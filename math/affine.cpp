@@ -0,0 +1,70 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "affine.hpp"
+#include "kernels.hpp"
+
+using namespace Mortar::Math;
+
+Affine::Affine(const Matrix& M) {
+#if defined(MORTAR_SSE)
+  __m128 row0 = _mm_load_ps(M.m[0]);
+  __m128 row1 = _mm_load_ps(M.m[1]);
+  __m128 row2 = _mm_load_ps(M.m[2]);
+  __m128 row3 = _mm_load_ps(M.m[3]);
+
+  _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+  _mm_store_ps(this->m[0], row0);
+  _mm_store_ps(this->m[1], row1);
+  _mm_store_ps(this->m[2], row2);
+#elif defined(MORTAR_NEON)
+  float32x4x4_t columns = vld4q_f32(M.f);
+
+  vst1q_f32(this->m[0], columns.val[0]);
+  vst1q_f32(this->m[1], columns.val[1]);
+  vst1q_f32(this->m[2], columns.val[2]);
+#else
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 4; j++) {
+      this->m[i][j] = M.m[j][i];
+    }
+  }
+#endif
+}
+
+Matrix Affine::toMatrix() const {
+  Matrix out;
+
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 4; j++) {
+      out.m[j][i] = this->m[i][j];
+    }
+  }
+
+  return out;
+}
+
+Vector Affine::getTranslation() const {
+  return Vector(this->m[0][3], this->m[1][3], this->m[2][3], 1.0f);
+}
+
+Affine Affine::operator*(const Affine& B) const {
+  Affine out;
+  multiplyInto(*this, B, out);
+
+  return out;
+}
@@ -0,0 +1,54 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_MATH_AFFINE_H
+#define MORTAR_MATH_AFFINE_H
+
+#include "matrix.hpp"
+
+namespace Mortar::Math {
+  // A Matrix whose last column is always (0, 0, 0, 1), as every transform but
+  // a projection is. It's kept as the other three columns, each of them one
+  // SIMD register, which are also what a GLSL mat3x4 holds; multiplying two
+  // takes 36 multiplies rather than 64, and storing one 48 bytes.
+  class alignas(16) Affine {
+    public:
+      Affine()
+        : m {
+            { 1.0f, 0.0f, 0.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f, 0.0f },
+            { 0.0f, 0.0f, 1.0f, 0.0f }
+          } {};
+
+      // Drops the last column, which is assumed to be (0, 0, 0, 1)
+      explicit Affine(const Matrix& M);
+
+      Matrix toMatrix() const;
+
+      Vector getTranslation() const;
+
+      // Row vectors, like Matrix: this transform, then B
+      Affine operator*(const Affine& B) const;
+
+      union {
+        // m[i] is column i of the equivalent Matrix
+        float m[3][4];
+        float f[12];
+      };
+  };
+}
+
+#endif
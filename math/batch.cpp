@@ -0,0 +1,60 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+
+#include "batch.hpp"
+#include "kernels.hpp"
+
+using namespace Mortar::Math;
+
+void Mortar::Math::multiplyEach(std::span<const Matrix> a, std::span<const Matrix> b, std::span<Matrix> out) {
+  assert(a.size() >= out.size() && b.size() >= out.size());
+
+  for (size_t i = 0; i < out.size(); i++) {
+    multiplyInto(a[i], b[i], out[i]);
+  }
+}
+
+void Mortar::Math::multiplyEach(std::span<const Affine> a, std::span<const Matrix> b, std::span<Affine> out) {
+  assert(a.size() >= out.size() && b.size() >= out.size());
+
+  for (size_t i = 0; i < out.size(); i++) {
+    multiplyInto(a[i], Affine(b[i]), out[i]);
+  }
+}
+
+void Mortar::Math::multiplyHierarchy(std::span<const Matrix> local, std::span<const int> parents, const Matrix& root, std::span<Matrix> out) {
+  assert(local.size() >= out.size() && parents.size() >= out.size());
+
+  for (size_t i = 0; i < out.size(); i++) {
+    int parentIdx = parents[i];
+    assert(parentIdx < (int)i);
+
+    multiplyInto(local[i], parentIdx == -1 ? root : out[parentIdx], out[i]);
+  }
+}
+
+void Mortar::Math::multiplyHierarchy(std::span<const QTS> local, std::span<const int> parents, const Matrix& root, std::span<Matrix> out) {
+  assert(local.size() >= out.size() && parents.size() >= out.size());
+
+  for (size_t i = 0; i < out.size(); i++) {
+    int parentIdx = parents[i];
+    assert(parentIdx < (int)i);
+
+    multiplyInto(local[i].toMatrix(), parentIdx == -1 ? root : out[parentIdx], out[i]);
+  }
+}
@@ -0,0 +1,39 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_MATH_BATCH_H
+#define MORTAR_MATH_BATCH_H
+
+#include <span>
+
+#include "affine.hpp"
+#include "matrix.hpp"
+#include "qts.hpp"
+
+namespace Mortar::Math {
+  // out[i] = a[i] * b[i] for every i, such as skin transforms by joints
+  void multiplyEach(std::span<const Matrix> a, std::span<const Matrix> b, std::span<Matrix> out);
+  void multiplyEach(std::span<const Affine> a, std::span<const Matrix> b, std::span<Affine> out);
+
+  // out[i] = local[i] * out[parents[i]], or local[i] * root where the parent
+  // is -1. Parents must come before their children, as joints do.
+  void multiplyHierarchy(std::span<const Matrix> local, std::span<const int> parents, const Matrix& root, std::span<Matrix> out);
+
+  // The same, converting each local pose to a Matrix as it's composed
+  void multiplyHierarchy(std::span<const QTS> local, std::span<const int> parents, const Matrix& root, std::span<Matrix> out);
+}
+
+#endif
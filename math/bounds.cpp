@@ -0,0 +1,182 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MORTAR_SSE
+#endif
+
+#include "bounds.hpp"
+
+using namespace Mortar::Math;
+
+AABB AABB::fromMinMax(const Vector& min, const Vector& max) {
+  AABB box;
+
+  box.center = Vector((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f, 1.0f);
+  box.extents = Vector((max.x - min.x) * 0.5f, (max.y - min.y) * 0.5f, (max.z - min.z) * 0.5f, 0.0f);
+
+  return box;
+}
+
+bool AABB::isEmpty() const {
+  return this->extents.x < 0.0f;
+}
+
+AABB AABB::transform(const Matrix& M) const {
+  if (this->isEmpty()) {
+    return *this;
+  }
+
+  AABB out;
+
+  out.center = this->center * M;
+
+  // Each output extent is the box's extents projected onto that axis
+  const Vector& e = this->extents;
+  out.extents.x = e.x * fabsf(M._11) + e.y * fabsf(M._21) + e.z * fabsf(M._31);
+  out.extents.y = e.x * fabsf(M._12) + e.y * fabsf(M._22) + e.z * fabsf(M._32);
+  out.extents.z = e.x * fabsf(M._13) + e.y * fabsf(M._23) + e.z * fabsf(M._33);
+  out.extents.w = 0.0f;
+
+  return out;
+}
+
+AABB AABB::merge(const AABB& other) const {
+  if (this->isEmpty()) {
+    return other;
+  }
+
+  if (other.isEmpty()) {
+    return *this;
+  }
+
+  Vector min {
+    fminf(this->center.x - this->extents.x, other.center.x - other.extents.x),
+    fminf(this->center.y - this->extents.y, other.center.y - other.extents.y),
+    fminf(this->center.z - this->extents.z, other.center.z - other.extents.z),
+    1.0f,
+  };
+
+  Vector max {
+    fmaxf(this->center.x + this->extents.x, other.center.x + other.extents.x),
+    fmaxf(this->center.y + this->extents.y, other.center.y + other.extents.y),
+    fmaxf(this->center.z + this->extents.z, other.center.z + other.extents.z),
+    1.0f,
+  };
+
+  return AABB::fromMinMax(min, max);
+}
+
+bool AABB::contains(const Vector& point) const {
+  return !this->isEmpty()
+    && fabsf(point.x - this->center.x) <= this->extents.x
+    && fabsf(point.y - this->center.y) <= this->extents.y
+    && fabsf(point.z - this->center.z) <= this->extents.z;
+}
+
+bool AABB::intersects(const AABB& other) const {
+  return !this->isEmpty() && !other.isEmpty()
+    && fabsf(other.center.x - this->center.x) <= this->extents.x + other.extents.x
+    && fabsf(other.center.y - this->center.y) <= this->extents.y + other.extents.y
+    && fabsf(other.center.z - this->center.z) <= this->extents.z + other.extents.z;
+}
+
+Frustum::Frustum(const Matrix& M) {
+  // Gribb-Hartmann: with row vectors, clip coordinate j is the dot product
+  // with column j, and each plane is the w column plus or minus another
+  const float sign[6] = { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f };
+  const int column[6] = { 0, 0, 1, 1, 2, 2 };
+
+  for (int i = 0; i < 6; i++) {
+    int j = column[i];
+
+    this->a[i] = M.m[0][3] + sign[i] * M.m[0][j];
+    this->b[i] = M.m[1][3] + sign[i] * M.m[1][j];
+    this->c[i] = M.m[2][3] + sign[i] * M.m[2][j];
+    this->d[i] = M.m[3][3] + sign[i] * M.m[3][j];
+  }
+
+  for (int i = 6; i < 8; i++) {
+    this->a[i] = 0.0f;
+    this->b[i] = 0.0f;
+    this->c[i] = 0.0f;
+    this->d[i] = 1.0f;
+  }
+}
+
+bool Frustum::intersects(const AABB& box) const {
+  return this->classify(box) != Containment::OUTSIDE;
+}
+
+Frustum::Containment Frustum::classify(const AABB& box) const {
+  if (box.isEmpty()) {
+    return Containment::OUTSIDE;
+  }
+
+  // A box is outside when, for some plane, its center is further behind the
+  // plane than the box's projected radius, and inside when it's at least
+  // that far in front of every plane
+  bool inside = true;
+
+#ifdef MORTAR_SSE
+  __m128 cx = _mm_set1_ps(box.center.x);
+  __m128 cy = _mm_set1_ps(box.center.y);
+  __m128 cz = _mm_set1_ps(box.center.z);
+  __m128 ex = _mm_set1_ps(box.extents.x);
+  __m128 ey = _mm_set1_ps(box.extents.y);
+  __m128 ez = _mm_set1_ps(box.extents.z);
+
+  __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+  for (int i = 0; i < 8; i += 4) {
+    __m128 pa = _mm_load_ps(this->a + i);
+    __m128 pb = _mm_load_ps(this->b + i);
+    __m128 pc = _mm_load_ps(this->c + i);
+    __m128 pd = _mm_load_ps(this->d + i);
+
+    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pa, cx), _mm_mul_ps(pb, cy)), _mm_add_ps(_mm_mul_ps(pc, cz), pd));
+    __m128 radius = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(_mm_and_ps(pa, absMask), ex), _mm_mul_ps(_mm_and_ps(pb, absMask), ey)),
+      _mm_mul_ps(_mm_and_ps(pc, absMask), ez));
+
+    if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()))) {
+      return Containment::OUTSIDE;
+    }
+
+    if (_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps()))) {
+      inside = false;
+    }
+  }
+#else
+  for (int i = 0; i < 6; i++) {
+    float distance = this->a[i] * box.center.x + this->b[i] * box.center.y + this->c[i] * box.center.z + this->d[i];
+    float radius = fabsf(this->a[i]) * box.extents.x + fabsf(this->b[i]) * box.extents.y + fabsf(this->c[i]) * box.extents.z;
+
+    if (distance + radius < 0.0f) {
+      return Containment::OUTSIDE;
+    }
+
+    if (distance - radius < 0.0f) {
+      inside = false;
+    }
+  }
+#endif
+
+  return inside ? Containment::INSIDE : Containment::INTERSECTS;
+}
@@ -0,0 +1,77 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_MATH_BOUNDS_H
+#define MORTAR_MATH_BOUNDS_H
+
+#include "matrix.hpp"
+
+namespace Mortar::Math {
+  // Axis-aligned box stored as center and half-extents, which is what both
+  // transforming and plane tests want
+  class AABB {
+    public:
+      AABB()
+        : center { 0.0f, 0.0f, 0.0f, 1.0f },
+          extents { -1.0f, -1.0f, -1.0f, 0.0f } {};
+
+      static AABB fromMinMax(const Vector& min, const Vector& max);
+
+      // An empty box is never visible and transforms to an empty box
+      bool isEmpty() const;
+
+      // The box around this box after transform, for row vectors
+      AABB transform(const Matrix& M) const;
+
+      // The smallest box around both
+      AABB merge(const AABB& other) const;
+
+      bool contains(const Vector& point) const;
+
+      // Whether the boxes share any point, touching included
+      bool intersects(const AABB& other) const;
+
+      Vector center;
+      Vector extents;
+  };
+
+  // The six clip planes of a view-projection matrix, kept as structure of
+  // arrays so four planes are tested against a box at once
+  class Frustum {
+    public:
+      enum class Containment {
+        OUTSIDE,
+        INTERSECTS,
+        INSIDE,
+      };
+
+      Frustum(const Matrix& projViewMtx);
+
+      bool intersects(const AABB& box) const;
+
+      // Also tells boxes wholly inside apart, so hierarchies can stop testing
+      Containment classify(const AABB& box) const;
+
+    private:
+      // Two groups of four; the last two slots always pass
+      alignas(16) float a[8];
+      alignas(16) float b[8];
+      alignas(16) float c[8];
+      alignas(16) float d[8];
+  };
+}
+
+#endif
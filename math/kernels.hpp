@@ -0,0 +1,170 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_MATH_KERNELS_H
+#define MORTAR_MATH_KERNELS_H
+
+// Per-instruction-set kernels shared by the math sources; not for use
+// outside math/
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MORTAR_AVX
+#define MORTAR_SSE
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MORTAR_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MORTAR_NEON
+#endif
+
+#include "affine.hpp"
+#include "matrix.hpp"
+
+namespace Mortar::Math {
+  // out = A * B. Rows are combinations of B's rows, weighted by the matching
+  // row of A; out may be A or B.
+  inline void multiplyInto(const Matrix& A, const Matrix& B, Matrix& out) {
+#if defined(MORTAR_AVX)
+    // Two rows at a time, with each of B's rows repeated in both halves
+    __m256 b0 = _mm256_broadcast_ps((const __m128 *)B.m[0]);
+    __m256 b1 = _mm256_broadcast_ps((const __m128 *)B.m[1]);
+    __m256 b2 = _mm256_broadcast_ps((const __m128 *)B.m[2]);
+    __m256 b3 = _mm256_broadcast_ps((const __m128 *)B.m[3]);
+
+    for (int i = 0; i < 4; i += 2) {
+      __m256 a = _mm256_loadu_ps(A.m[i]);
+
+      __m256 row = _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+      row = _mm256_add_ps(row, _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+      row = _mm256_add_ps(row, _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+      row = _mm256_add_ps(row, _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+
+      _mm256_storeu_ps(out.m[i], row);
+    }
+#elif defined(MORTAR_SSE)
+    __m128 b0 = _mm_load_ps(B.m[0]);
+    __m128 b1 = _mm_load_ps(B.m[1]);
+    __m128 b2 = _mm_load_ps(B.m[2]);
+    __m128 b3 = _mm_load_ps(B.m[3]);
+
+    for (int i = 0; i < 4; i++) {
+      __m128 a = _mm_load_ps(A.m[i]);
+
+      __m128 row = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+      row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+      row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+      row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+
+      _mm_store_ps(out.m[i], row);
+    }
+#elif defined(MORTAR_NEON)
+    float32x4_t b0 = vld1q_f32(B.m[0]);
+    float32x4_t b1 = vld1q_f32(B.m[1]);
+    float32x4_t b2 = vld1q_f32(B.m[2]);
+    float32x4_t b3 = vld1q_f32(B.m[3]);
+
+    for (int i = 0; i < 4; i++) {
+      float32x4_t a = vld1q_f32(A.m[i]);
+
+      float32x4_t row = vmulq_n_f32(b0, vgetq_lane_f32(a, 0));
+      row = vmlaq_n_f32(row, b1, vgetq_lane_f32(a, 1));
+      row = vmlaq_n_f32(row, b2, vgetq_lane_f32(a, 2));
+      row = vmlaq_n_f32(row, b3, vgetq_lane_f32(a, 3));
+
+      vst1q_f32(out.m[i], row);
+    }
+#else
+    // Written to a copy, as out may be either input
+    Matrix product;
+
+    product._11 = A._11 * B._11 + A._12 * B._21 + A._13 * B._31 + A._14 * B._41;
+    product._12 = A._11 * B._12 + A._12 * B._22 + A._13 * B._32 + A._14 * B._42;
+    product._13 = A._11 * B._13 + A._12 * B._23 + A._13 * B._33 + A._14 * B._43;
+    product._14 = A._11 * B._14 + A._12 * B._24 + A._13 * B._34 + A._14 * B._44;
+
+    product._21 = A._21 * B._11 + A._22 * B._21 + A._23 * B._31 + A._24 * B._41;
+    product._22 = A._21 * B._12 + A._22 * B._22 + A._23 * B._32 + A._24 * B._42;
+    product._23 = A._21 * B._13 + A._22 * B._23 + A._23 * B._33 + A._24 * B._43;
+    product._24 = A._21 * B._14 + A._22 * B._24 + A._23 * B._34 + A._24 * B._44;
+
+    product._31 = A._31 * B._11 + A._32 * B._21 + A._33 * B._31 + A._34 * B._41;
+    product._32 = A._31 * B._12 + A._32 * B._22 + A._33 * B._32 + A._34 * B._42;
+    product._33 = A._31 * B._13 + A._32 * B._23 + A._33 * B._33 + A._34 * B._43;
+    product._34 = A._31 * B._14 + A._32 * B._24 + A._33 * B._34 + A._34 * B._44;
+
+    product._41 = A._41 * B._11 + A._42 * B._21 + A._43 * B._31 + A._44 * B._41;
+    product._42 = A._41 * B._12 + A._42 * B._22 + A._43 * B._32 + A._44 * B._42;
+    product._43 = A._41 * B._13 + A._42 * B._23 + A._43 * B._33 + A._44 * B._43;
+    product._44 = A._41 * B._14 + A._42 * B._24 + A._43 * B._34 + A._44 * B._44;
+
+    out = product;
+#endif
+  }
+
+  // The same for affine transforms. Each column of out is a combination of
+  // A's columns, weighted by the matching column of B, plus B's translation.
+  inline void multiplyInto(const Affine& A, const Affine& B, Affine& out) {
+#if defined(MORTAR_SSE)
+    __m128 a0 = _mm_load_ps(A.m[0]);
+    __m128 a1 = _mm_load_ps(A.m[1]);
+    __m128 a2 = _mm_load_ps(A.m[2]);
+    __m128 translationMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+
+    for (int i = 0; i < 3; i++) {
+      __m128 b = _mm_load_ps(B.m[i]);
+
+      __m128 column = _mm_mul_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0)), a0);
+      column = _mm_add_ps(column, _mm_mul_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1)), a1));
+      column = _mm_add_ps(column, _mm_mul_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2)), a2));
+      column = _mm_add_ps(column, _mm_and_ps(b, translationMask));
+
+      _mm_store_ps(out.m[i], column);
+    }
+#elif defined(MORTAR_NEON)
+    float32x4_t a0 = vld1q_f32(A.m[0]);
+    float32x4_t a1 = vld1q_f32(A.m[1]);
+    float32x4_t a2 = vld1q_f32(A.m[2]);
+
+    for (int i = 0; i < 3; i++) {
+      float32x4_t b = vld1q_f32(B.m[i]);
+
+      float32x4_t column = vmulq_n_f32(a0, vgetq_lane_f32(b, 0));
+      column = vmlaq_n_f32(column, a1, vgetq_lane_f32(b, 1));
+      column = vmlaq_n_f32(column, a2, vgetq_lane_f32(b, 2));
+      column = vsetq_lane_f32(vgetq_lane_f32(column, 3) + vgetq_lane_f32(b, 3), column, 3);
+
+      vst1q_f32(out.m[i], column);
+    }
+#else
+    // Written to a copy, as out may be either input
+    Affine product;
+
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 4; j++) {
+        product.m[i][j] = B.m[i][0] * A.m[0][j] + B.m[i][1] * A.m[1][j] + B.m[i][2] * A.m[2][j];
+      }
+
+      product.m[i][3] += B.m[i][3];
+    }
+
+    out = product;
+#endif
+  }
+}
+
+#endif
@@ -18,6 +18,7 @@
 #include <memory>
 #include <string.h>
 
+#include "kernels.hpp"
 #include "matrix.hpp"
 
 using namespace Mortar::Math;
@@ -28,26 +29,7 @@ Matrix::Matrix(std::array<float, 16> list)  {
 
 Matrix Matrix::operator*(const Matrix& B) const {
   Matrix out;
-
-  out._11 = this->_11 * B._11 + this->_12 * B._21 + this->_13 * B._31 + this->_14 * B._41;
-  out._12 = this->_11 * B._12 + this->_12 * B._22 + this->_13 * B._32 + this->_14 * B._42;
-  out._13 = this->_11 * B._13 + this->_12 * B._23 + this->_13 * B._33 + this->_14 * B._43;
-  out._14 = this->_11 * B._14 + this->_12 * B._24 + this->_13 * B._34 + this->_14 * B._44;
-
-  out._21 = this->_21 * B._11 + this->_22 * B._21 + this->_23 * B._31 + this->_24 * B._41;
-  out._22 = this->_21 * B._12 + this->_22 * B._22 + this->_23 * B._32 + this->_24 * B._42;
-  out._23 = this->_21 * B._13 + this->_22 * B._23 + this->_23 * B._33 + this->_24 * B._43;
-  out._24 = this->_21 * B._14 + this->_22 * B._24 + this->_23 * B._34 + this->_24 * B._44;
-
-  out._31 = this->_31 * B._11 + this->_32 * B._21 + this->_33 * B._31 + this->_34 * B._41;
-  out._32 = this->_31 * B._12 + this->_32 * B._22 + this->_33 * B._32 + this->_34 * B._42;
-  out._33 = this->_31 * B._13 + this->_32 * B._23 + this->_33 * B._33 + this->_34 * B._43;
-  out._34 = this->_31 * B._14 + this->_32 * B._24 + this->_33 * B._34 + this->_34 * B._44;
-
-  out._41 = this->_41 * B._11 + this->_42 * B._21 + this->_43 * B._31 + this->_44 * B._41;
-  out._42 = this->_41 * B._12 + this->_42 * B._22 + this->_43 * B._32 + this->_44 * B._42;
-  out._43 = this->_41 * B._13 + this->_42 * B._23 + this->_43 * B._33 + this->_44 * B._43;
-  out._44 = this->_41 * B._14 + this->_42 * B._24 + this->_43 * B._34 + this->_44 * B._44;
+  multiplyInto(*this, B, out);
 
   return out;
 }
@@ -55,8 +37,8 @@ Matrix Matrix::operator*(const Matrix& B) const {
 Matrix Matrix::rotationY(float theta) {
   Matrix out;
 
-  float sinTheta = sin(theta);
-  float cosTheta = cos(theta);
+  float sinTheta = sinf(theta);
+  float cosTheta = cosf(theta);
 
   out._11 = cosTheta;
   out._13 = sinTheta;
@@ -69,15 +51,41 @@ Matrix Matrix::rotationY(float theta) {
 Matrix Matrix::rotationZYX(float alpha, float beta, float gamma) {
   Matrix out;
 
-  float sinAlpha = sin(alpha);
-  float cosAlpha = cos(alpha);
+  float sinAlpha = sinf(alpha);
+  float cosAlpha = cosf(alpha);
 
-  float sinBeta = sin(beta);
-  float cosBeta = cos(beta);
+  float sinBeta = sinf(beta);
+  float cosBeta = cosf(beta);
 
-  float sinGamma = sin(gamma);
-  float cosGamma = cos(gamma);
+  float sinGamma = sinf(gamma);
+  float cosGamma = cosf(gamma);
 
+  // The last row stays the identity's
+#if defined(MORTAR_SSE)
+  // The first two rows are the same pair of vectors, weighted by gamma's
+  // cosine and sine the other way around
+  __m128 p = _mm_set_ps(0.0f, sinAlpha * cosBeta, sinAlpha * sinBeta, cosAlpha);
+  __m128 q = _mm_set_ps(0.0f, sinBeta, -cosBeta, 0.0f);
+  __m128 sinGammas = _mm_set1_ps(sinGamma);
+  __m128 cosGammas = _mm_set1_ps(cosGamma);
+
+  _mm_store_ps(out.m[0], _mm_add_ps(_mm_mul_ps(cosGammas, p), _mm_mul_ps(sinGammas, q)));
+  _mm_store_ps(out.m[1], _mm_sub_ps(_mm_mul_ps(sinGammas, p), _mm_mul_ps(cosGammas, q)));
+  _mm_store_ps(out.m[2], _mm_set_ps(0.0f, cosAlpha * cosBeta, cosAlpha * sinBeta, -sinAlpha));
+#elif defined(MORTAR_NEON)
+  float pValues[4] = { cosAlpha, sinAlpha * sinBeta, sinAlpha * cosBeta, 0.0f };
+  float qValues[4] = { 0.0f, -cosBeta, sinBeta, 0.0f };
+  float32x4_t p = vld1q_f32(pValues);
+  float32x4_t q = vld1q_f32(qValues);
+
+  vst1q_f32(out.m[0], vmlaq_n_f32(vmulq_n_f32(p, cosGamma), q, sinGamma));
+  vst1q_f32(out.m[1], vmlsq_n_f32(vmulq_n_f32(p, sinGamma), q, cosGamma));
+
+  out._31 = -sinAlpha;
+  out._32 = cosAlpha * sinBeta;
+  out._33 = cosAlpha * cosBeta;
+  out._34 = 0.0f;
+#else
   out._11 = cosAlpha * cosGamma;
   out._12 = sinAlpha * sinBeta * cosGamma - cosBeta * sinGamma;
   out._13 = sinBeta * sinGamma + sinAlpha * cosBeta * cosGamma;
@@ -92,11 +100,7 @@ Matrix Matrix::rotationZYX(float alpha, float beta, float gamma) {
   out._32 = cosAlpha * sinBeta;
   out._33 = cosAlpha * cosBeta;
   out._34 = 0.0f;
-
-  out._41 = 0.0f;
-  out._42 = 0.0f;
-  out._43 = 0.0f;
-  out._44 = 1.0f;
+#endif
 
   return out;
 }
@@ -177,6 +181,27 @@ void Matrix::translate(Vector translation) {
 }
 
 void Matrix::transpose() {
+#if defined(MORTAR_SSE)
+  __m128 row0 = _mm_load_ps(this->m[0]);
+  __m128 row1 = _mm_load_ps(this->m[1]);
+  __m128 row2 = _mm_load_ps(this->m[2]);
+  __m128 row3 = _mm_load_ps(this->m[3]);
+
+  _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+  _mm_store_ps(this->m[0], row0);
+  _mm_store_ps(this->m[1], row1);
+  _mm_store_ps(this->m[2], row2);
+  _mm_store_ps(this->m[3], row3);
+#elif defined(MORTAR_NEON)
+  // De-interleaving loads gather each column into a register
+  float32x4x4_t columns = vld4q_f32(this->f);
+
+  vst1q_f32(this->m[0], columns.val[0]);
+  vst1q_f32(this->m[1], columns.val[1]);
+  vst1q_f32(this->m[2], columns.val[2]);
+  vst1q_f32(this->m[3], columns.val[3]);
+#else
   float tmp;
 
   tmp = this->_12;
@@ -202,6 +227,7 @@ void Matrix::transpose() {
   tmp = this->_34;
   this->_34 = this->_43;
   this->_43 = tmp;
+#endif
 }
 
 std::string Matrix::toString() {
@@ -225,10 +251,16 @@ Vector Vector::operator-() const {
 Vector Vector::operator-(const Vector &b) const {
   Vector out;
 
+#if defined(MORTAR_SSE)
+  _mm_store_ps(&out.x, _mm_sub_ps(_mm_load_ps(&this->x), _mm_load_ps(&b.x)));
+#elif defined(MORTAR_NEON)
+  vst1q_f32(&out.x, vsubq_f32(vld1q_f32(&this->x), vld1q_f32(&b.x)));
+#else
   out.x = this->x - b.x;
   out.y = this->y - b.y;
   out.z = this->z - b.z;
   out.w = this->w - b.w;
+#endif
 
   return out;
 }
@@ -236,21 +268,46 @@ Vector Vector::operator-(const Vector &b) const {
 Vector Vector::operator+(const Vector &b) const {
   Vector out;
 
+#if defined(MORTAR_SSE)
+  _mm_store_ps(&out.x, _mm_add_ps(_mm_load_ps(&this->x), _mm_load_ps(&b.x)));
+#elif defined(MORTAR_NEON)
+  vst1q_f32(&out.x, vaddq_f32(vld1q_f32(&this->x), vld1q_f32(&b.x)));
+#else
   out.x = this->x + b.x;
   out.y = this->y + b.y;
   out.z = this->z + b.z;
   out.w = this->w + b.w;
+#endif
 
   return out;
 }
 
+// The matrix's rows weighted by the vector's components
 Vector Vector::operator*(const Matrix &M) const {
   Vector out;
 
+#if defined(MORTAR_SSE)
+  __m128 v = _mm_load_ps(&this->x);
+
+  __m128 row = _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), _mm_load_ps(M.m[0]));
+  row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), _mm_load_ps(M.m[1])));
+  row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), _mm_load_ps(M.m[2])));
+  row = _mm_add_ps(row, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)), _mm_load_ps(M.m[3])));
+
+  _mm_store_ps(&out.x, row);
+#elif defined(MORTAR_NEON)
+  float32x4_t row = vmulq_n_f32(vld1q_f32(M.m[0]), this->x);
+  row = vmlaq_n_f32(row, vld1q_f32(M.m[1]), this->y);
+  row = vmlaq_n_f32(row, vld1q_f32(M.m[2]), this->z);
+  row = vmlaq_n_f32(row, vld1q_f32(M.m[3]), this->w);
+
+  vst1q_f32(&out.x, row);
+#else
   out.x = this->x * M._11 + this->y * M._21 + this->z * M._31 + this->w * M._41;
   out.y = this->x * M._12 + this->y * M._22 + this->z * M._32 + this->w * M._42;
   out.z = this->x * M._13 + this->y * M._23 + this->z * M._33 + this->w * M._43;
   out.w = this->x * M._14 + this->y * M._24 + this->z * M._34 + this->w * M._44;
+#endif
 
   return out;
 }
@@ -27,7 +27,10 @@
 namespace Mortar::Math {
   class Matrix;
 
-  class Vector {
+  // Vectors and matrices are 16-byte aligned so their rows load straight
+  // into SIMD registers; the layout is otherwise plain floats, so both can
+  // still be copied out for GL as is
+  class alignas(16) Vector {
     public:
       Vector(float x, float y, float z, float w)
         : x { x }, y { y }, z { z }, w { w } {};
@@ -96,7 +99,7 @@ namespace Mortar::Math {
       float w;
   };
 
-  class Matrix {
+  class alignas(16) Matrix {
     public:
       Matrix()
         : Matrix {
@@ -173,4 +176,27 @@ namespace Mortar::Math {
   };
 }
 
+// Matrices are stored as 16 floats; vectors in files are points given as
+// three floats, with w implied
+template <>
+struct FieldCodec<Mortar::Math::Matrix> {
+  static constexpr size_t size = 16 * sizeof(float);
+
+  static inline void decode(const uint8_t *data, Mortar::Math::Matrix& out) {
+    FieldCodec<float[16]>::decode(data, out.f);
+  }
+};
+
+template <>
+struct FieldCodec<Mortar::Math::Vector> {
+  static constexpr size_t size = 3 * sizeof(float);
+
+  static inline void decode(const uint8_t *data, Mortar::Math::Vector& out) {
+    FieldCodec<float>::decode(data, out.x);
+    FieldCodec<float>::decode(data + 4, out.y);
+    FieldCodec<float>::decode(data + 8, out.z);
+    out.w = 1.0f;
+  }
+};
+
 #endif
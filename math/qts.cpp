@@ -0,0 +1,88 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include "qts.hpp"
+
+using namespace Mortar::Math;
+
+QTS::QTS(const Matrix& M) {
+  // Each row is an axis scaled by that axis' scale
+  Matrix rotationMtx;
+  float scales[3];
+  for (int i = 0; i < 3; i++) {
+    scales[i] = sqrtf(M.m[i][0] * M.m[i][0] + M.m[i][1] * M.m[i][1] + M.m[i][2] * M.m[i][2]);
+
+    float invScale = scales[i] > 0.0f ? 1.0f / scales[i] : 0.0f;
+    for (int j = 0; j < 3; j++) {
+      rotationMtx.m[i][j] = M.m[i][j] * invScale;
+    }
+  }
+
+  const float (*m)[4] = rotationMtx.m;
+  float determinant = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+  if (determinant < 0.0f) {
+    scales[0] = -scales[0];
+    for (int j = 0; j < 3; j++) {
+      rotationMtx.m[0][j] = -rotationMtx.m[0][j];
+    }
+  }
+
+  this->rotation = Quaternion::fromRotation(rotationMtx);
+  this->translation = Vector(M._41, M._42, M._43, 1.0f);
+  this->scale = Vector(scales[0], scales[1], scales[2], 0.0f);
+}
+
+Matrix QTS::toMatrix() const {
+  Matrix out = this->rotation.toMatrix();
+  out.scale(this->scale.x, this->scale.y, this->scale.z);
+  out.setTranslation(this->translation);
+
+  return out;
+}
+
+Affine QTS::toAffine() const {
+  float x = this->rotation.x, y = this->rotation.y, z = this->rotation.z, w = this->rotation.w;
+  float sx = this->scale.x, sy = this->scale.y, sz = this->scale.z;
+
+  // Columns of toMatrix(), written out directly
+  Affine out;
+  out.m[0][0] = sx * (1.0f - 2.0f * (y * y + z * z));
+  out.m[0][1] = sy * 2.0f * (x * y + z * w);
+  out.m[0][2] = sz * 2.0f * (x * z - y * w);
+  out.m[0][3] = this->translation.x;
+
+  out.m[1][0] = sx * 2.0f * (x * y - z * w);
+  out.m[1][1] = sy * (1.0f - 2.0f * (x * x + z * z));
+  out.m[1][2] = sz * 2.0f * (y * z + x * w);
+  out.m[1][3] = this->translation.y;
+
+  out.m[2][0] = sx * 2.0f * (x * z + y * w);
+  out.m[2][1] = sy * 2.0f * (y * z - x * w);
+  out.m[2][2] = sz * (1.0f - 2.0f * (x * x + y * y));
+  out.m[2][3] = this->translation.z;
+
+  return out;
+}
+
+Vector QTS::transformPoint(const Vector& point) const {
+  Vector scaled(point.x * this->scale.x, point.y * this->scale.y, point.z * this->scale.z, 0.0f);
+  Vector out = this->rotation.rotate(scaled) + this->translation * point.w;
+  out.w = point.w;
+
+  return out;
+}
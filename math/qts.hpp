@@ -0,0 +1,50 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_MATH_QTS_H
+#define MORTAR_MATH_QTS_H
+
+#include "affine.hpp"
+#include "matrix.hpp"
+#include "quaternion.hpp"
+
+namespace Mortar::Math {
+  // A transform kept as its rotation, translation and scale, which is how
+  // joints are posed: row vectors are scaled, then rotated, then translated.
+  // Poses blend and compose this way without trig or decomposition, so they
+  // only become matrices where a hierarchy is composed.
+  class alignas(16) QTS {
+    public:
+      QTS()
+        : rotation {}, translation { 0.0f, 0.0f, 0.0f, 1.0f }, scale { 1.0f, 1.0f, 1.0f, 0.0f } {};
+
+      // Decomposes an affine Matrix. Shear is lost, and a mirror is taken on
+      // the first axis' scale.
+      explicit QTS(const Matrix& M);
+
+      Matrix toMatrix() const;
+      Affine toAffine() const;
+
+      // point * toMatrix(); w passes through
+      Vector transformPoint(const Vector& point) const;
+
+      Quaternion rotation;
+      Vector translation;
+      Vector scale;
+  };
+}
+
+#endif
@@ -0,0 +1,138 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include "quaternion.hpp"
+
+using namespace Mortar::Math;
+
+Quaternion Quaternion::rotationZYX(float alpha, float beta, float gamma) {
+  float sinAlpha, cosAlpha, sinBeta, cosBeta, sinGamma, cosGamma;
+  sinCos(0.5f * alpha, sinAlpha, cosAlpha);
+  sinCos(0.5f * beta, sinBeta, cosBeta);
+  sinCos(0.5f * gamma, sinGamma, cosGamma);
+
+  // Gamma about Z, of alpha about Y, of beta about X
+  return Quaternion(
+    cosGamma * cosAlpha * sinBeta - sinGamma * sinAlpha * cosBeta,
+    cosGamma * sinAlpha * cosBeta + sinGamma * cosAlpha * sinBeta,
+    sinGamma * cosAlpha * cosBeta - cosGamma * sinAlpha * sinBeta,
+    cosGamma * cosAlpha * cosBeta + sinGamma * sinAlpha * sinBeta
+  );
+}
+
+Quaternion Quaternion::fromRotation(const Matrix& M) {
+  Quaternion q;
+
+  float trace = M.m[0][0] + M.m[1][1] + M.m[2][2];
+  if (trace > 0.0f) {
+    float s = 0.5f / sqrtf(trace + 1.0f);
+    q.x = (M.m[2][1] - M.m[1][2]) * s;
+    q.y = (M.m[0][2] - M.m[2][0]) * s;
+    q.z = (M.m[1][0] - M.m[0][1]) * s;
+    q.w = 0.25f / s;
+  } else if (M.m[0][0] > M.m[1][1] && M.m[0][0] > M.m[2][2]) {
+    float s = 2.0f * sqrtf(1.0f + M.m[0][0] - M.m[1][1] - M.m[2][2]);
+    q.x = 0.25f * s;
+    q.y = (M.m[0][1] + M.m[1][0]) / s;
+    q.z = (M.m[0][2] + M.m[2][0]) / s;
+    q.w = (M.m[2][1] - M.m[1][2]) / s;
+  } else if (M.m[1][1] > M.m[2][2]) {
+    float s = 2.0f * sqrtf(1.0f + M.m[1][1] - M.m[0][0] - M.m[2][2]);
+    q.x = (M.m[0][1] + M.m[1][0]) / s;
+    q.y = 0.25f * s;
+    q.z = (M.m[1][2] + M.m[2][1]) / s;
+    q.w = (M.m[0][2] - M.m[2][0]) / s;
+  } else {
+    float s = 2.0f * sqrtf(1.0f + M.m[2][2] - M.m[0][0] - M.m[1][1]);
+    q.x = (M.m[0][2] + M.m[2][0]) / s;
+    q.y = (M.m[1][2] + M.m[2][1]) / s;
+    q.z = 0.25f * s;
+    q.w = (M.m[1][0] - M.m[0][1]) / s;
+  }
+
+  return q;
+}
+
+Quaternion Quaternion::normalize(const Quaternion& q) {
+  float invMagnitude = 1.0f / sqrtf(dot(q, q));
+
+  return Quaternion(q.x * invMagnitude, q.y * invMagnitude, q.z * invMagnitude, q.w * invMagnitude);
+}
+
+Quaternion Quaternion::slerp(const Quaternion& a, const Quaternion& b, float t) {
+  float cosTheta = dot(a, b);
+  float sign = cosTheta < 0.0f ? -1.0f : 1.0f;
+  cosTheta = fabsf(cosTheta);
+
+  float aWeight = 1.0f - t;
+  float bWeight = t;
+  if (cosTheta < 0.9995f) {
+    float theta = acosf(cosTheta);
+    float invSinTheta = 1.0f / sinf(theta);
+
+    aWeight = sinf((1.0f - t) * theta) * invSinTheta;
+    bWeight = sinf(t * theta) * invSinTheta;
+  }
+  bWeight *= sign;
+
+  return normalize(Quaternion(a.x * aWeight + b.x * bWeight, a.y * aWeight + b.y * bWeight, a.z * aWeight + b.z * bWeight, a.w * aWeight + b.w * bWeight));
+}
+
+Quaternion Quaternion::nlerp(const Quaternion& a, const Quaternion& b, float t) {
+  float aWeight = 1.0f - t;
+  float bWeight = dot(a, b) < 0.0f ? -t : t;
+
+  return normalize(Quaternion(a.x * aWeight + b.x * bWeight, a.y * aWeight + b.y * bWeight, a.z * aWeight + b.z * bWeight, a.w * aWeight + b.w * bWeight));
+}
+
+Quaternion Quaternion::conjugate() const {
+  return Quaternion(-this->x, -this->y, -this->z, this->w);
+}
+
+Quaternion Quaternion::operator*(const Quaternion& b) const {
+  return Quaternion(
+    this->w * b.x + this->x * b.w + this->y * b.z - this->z * b.y,
+    this->w * b.y - this->x * b.z + this->y * b.w + this->z * b.x,
+    this->w * b.z + this->x * b.y - this->y * b.x + this->z * b.w,
+    this->w * b.w - this->x * b.x - this->y * b.y - this->z * b.z
+  );
+}
+
+Vector Quaternion::rotate(const Vector& v) const {
+  // Row vectors turn the other way to the column vectors the usual
+  // v + 2w(u x v) + 2u x (u x v) is written for, so u is negated
+  Vector u(-this->x, -this->y, -this->z, 0.0f);
+  Vector direction(v.x, v.y, v.z, 0.0f);
+
+  Vector t = Vector::cross(u, direction) * 2.0f;
+  Vector out = direction + t * this->w + Vector::cross(u, t);
+  out.w = v.w;
+
+  return out;
+}
+
+Matrix Quaternion::toMatrix() const {
+  float x = this->x, y = this->y, z = this->z, w = this->w;
+
+  return Matrix({
+    1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y - z * w), 2.0f * (x * z + y * w), 0.0f,
+    2.0f * (x * y + z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z - x * w), 0.0f,
+    2.0f * (x * z - y * w), 2.0f * (y * z + x * w), 1.0f - 2.0f * (x * x + y * y), 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f
+  });
+}
@@ -0,0 +1,98 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_MATH_QUATERNION_H
+#define MORTAR_MATH_QUATERNION_H
+
+#include "matrix.hpp"
+
+namespace Mortar::Math {
+  // Sine and cosine at once, by polynomials on the angle reduced to
+  // [-pi/2, pi/2]. Good to about 2e-7 for angles within [-pi, pi], but the
+  // reduction is done in floats, so the error grows with the angle: about
+  // 5e-6 by 100 radians and 5e-5 by 1000. Several times cheaper than the
+  // libm calls, which reduce exactly over the whole float range.
+  inline void sinCos(float theta, float& sine, float& cosine) {
+    constexpr float PI = 3.14159265f;
+    constexpr float INV_TWO_PI = 0.159154943f;
+
+    float quotient = theta * INV_TWO_PI;
+    quotient = (float)(int)(quotient + (quotient >= 0.0f ? 0.5f : -0.5f));
+
+    float y = theta - 2.0f * PI * quotient;
+    float sign = 1.0f;
+    if (y > 0.5f * PI) {
+      y = PI - y;
+      sign = -1.0f;
+    } else if (y < -0.5f * PI) {
+      y = -PI - y;
+      sign = -1.0f;
+    }
+
+    float y2 = y * y;
+    sine = (((((-2.3889859e-08f * y2 + 2.7525562e-06f) * y2 - 1.9840874e-04f) * y2 + 8.3333310e-03f) * y2 - 1.6666667e-01f) * y2 + 1.0f) * y;
+    cosine = sign * (((((-2.6051615e-07f * y2 + 2.4760495e-05f) * y2 - 1.3888378e-03f) * y2 + 4.1666638e-02f) * y2 - 0.5f) * y2 + 1.0f);
+  }
+
+  // A rotation as (x, y, z, w). Quaternions compose like the matrices they
+  // stand for: (q * r).toMatrix() is q.toMatrix() * r.toMatrix().
+  class alignas(16) Quaternion {
+    public:
+      Quaternion(float x, float y, float z, float w)
+        : x { x }, y { y }, z { z }, w { w } {};
+
+      Quaternion()
+        : Quaternion { 0.0f, 0.0f, 0.0f, 1.0f } {};
+
+      // The rotation of Matrix::rotationZYX(alpha, beta, gamma), from three
+      // half-angle sinCos() rather than six calls to libm
+      static Quaternion rotationZYX(float alpha, float beta, float gamma);
+
+      // The rotation of an orthonormal Matrix, which mustn't mirror
+      static Quaternion fromRotation(const Matrix& M);
+
+      static inline float dot(const Quaternion& a, const Quaternion& b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+      }
+
+      static Quaternion normalize(const Quaternion& q);
+
+      // Along the shorter arc, falling back to a normalized lerp where the
+      // rotations are too close for the sines to be accurate
+      static Quaternion slerp(const Quaternion& a, const Quaternion& b, float t);
+
+      // A normalized lerp along the shorter arc; close to slerp() for nearby
+      // rotations, and cheaper
+      static Quaternion nlerp(const Quaternion& a, const Quaternion& b, float t);
+
+      // The inverse rotation, as transposing the matrix gives
+      Quaternion conjugate() const;
+
+      Quaternion operator*(const Quaternion& b) const;
+
+      // v * toMatrix(), for a direction; w passes through
+      Vector rotate(const Vector& v) const;
+
+      Matrix toMatrix() const;
+
+      float x;
+      float y;
+      float z;
+      float w;
+  };
+}
+
+#endif
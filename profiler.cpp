@@ -0,0 +1,220 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "profiler.hpp"
+
+#ifdef MORTAR_PROFILE
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <tsl/sparse_map.h>
+#include <vector>
+
+#include "log.hpp"
+
+// Zones per thread kept for export
+#define RING_CAPACITY (1 << 16)
+
+namespace {
+  // Fields are atomic so the exporter can read a ring while its thread
+  // writes it; relaxed accesses cost nothing extra on the platforms we run on.
+  // Counter samples keep their value in end.
+  struct Event {
+    std::atomic<const char *> name;
+    std::atomic<uint64_t> start;
+    std::atomic<uint64_t> end;
+    std::atomic<bool> isCounter;
+  };
+
+  struct Ring {
+    std::array<Event, RING_CAPACITY> events;
+
+    // Zones ever written; the slot for the next is count % RING_CAPACITY
+    std::atomic<uint64_t> count { 0 };
+    unsigned threadId;
+  };
+
+  // Rings are never freed, so zones from threads that have exited can still
+  // be exported
+  std::mutex ringsMutex;
+  std::vector<std::unique_ptr<Ring>> rings;
+
+  thread_local Ring *threadRing = nullptr;
+
+  Ring *getThreadRing() {
+    if (!threadRing) {
+      std::lock_guard<std::mutex> lock(ringsMutex);
+
+      rings.push_back(std::make_unique<Ring>());
+      threadRing = rings.back().get();
+      threadRing->threadId = rings.size() - 1;
+    }
+
+    return threadRing;
+  }
+
+  void append(const char *name, uint64_t start, uint64_t end, bool isCounter) {
+    Ring *ring = getThreadRing();
+
+    uint64_t count = ring->count.load(std::memory_order_relaxed);
+    Event& event = ring->events[count % RING_CAPACITY];
+
+    event.name.store(name, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    event.isCounter.store(isCounter, std::memory_order_relaxed);
+
+    ring->count.store(count + 1, std::memory_order_release);
+  }
+
+  // The oldest event still intact once the ring's been read. The thread may
+  // be part way through the slot after its newest, which holds the oldest,
+  // so that one is given up as well.
+  uint64_t getOldestIntact(const Ring *ring) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = ring->count.load(std::memory_order_relaxed);
+
+    return after >= RING_CAPACITY ? after - RING_CAPACITY + 1 : 0;
+  }
+
+  void writeEscaped(FILE *file, const char *string) {
+    for (const char *c = string; *c; c++) {
+      if (*c == '"' || *c == '\\') {
+        fputc('\\', file);
+      }
+
+      fputc(*c, file);
+    }
+  }
+}
+
+uint64_t Mortar::Profiler::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Mortar::Profiler::record(const char *name, uint64_t start, uint64_t end) {
+  append(name, start, end, false);
+}
+
+void Mortar::Profiler::counter(const char *name, uint64_t value) {
+  append(name, now(), value, true);
+}
+
+bool Mortar::Profiler::writeChromeTrace(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    DEBUG("unable to open %s for the trace", path);
+    return false;
+  }
+
+  struct Copy {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+    bool isCounter;
+  };
+
+  std::vector<Copy> copies;
+  bool first = true;
+
+  fputs("{\"traceEvents\":[\n", file);
+
+  std::lock_guard<std::mutex> lock(ringsMutex);
+  for (auto& ring : rings) {
+    uint64_t count = ring->count.load(std::memory_order_acquire);
+    uint64_t oldest = count > RING_CAPACITY ? count - RING_CAPACITY : 0;
+
+    copies.clear();
+    for (uint64_t i = oldest; i < count; i++) {
+      Event& event = ring->events[i % RING_CAPACITY];
+      copies.push_back({ event.name.load(std::memory_order_relaxed), event.start.load(std::memory_order_relaxed), event.end.load(std::memory_order_relaxed), event.isCounter.load(std::memory_order_relaxed) });
+    }
+
+    // Anything the thread wrote over while we copied is dropped
+    uint64_t intact = getOldestIntact(ring.get());
+    size_t skip = intact > oldest ? std::min<uint64_t>(intact - oldest, copies.size()) : 0;
+
+    for (size_t i = skip; i < copies.size(); i++) {
+      const Copy& copy = copies[i];
+
+      fputs(first ? "" : ",\n", file);
+      fputs("{\"name\":\"", file);
+      writeEscaped(file, copy.name);
+      if (copy.isCounter) {
+        fprintf(file, "\",\"ph\":\"C\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%llu}}", ring->threadId, copy.start / 1000.0, (unsigned long long)copy.end);
+      } else {
+        fprintf(file, "\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", ring->threadId, copy.start / 1000.0, (copy.end - copy.start) / 1000.0);
+      }
+
+      first = false;
+    }
+  }
+
+  fputs("\n]}\n", file);
+
+  return fclose(file) == 0;
+}
+
+void Mortar::Profiler::totalZones(uint64_t start, uint64_t end, std::vector<ZoneTotal>& totals) {
+  totals.clear();
+
+  tsl::sparse_map<const char *, size_t> indices;
+  std::vector<std::pair<const char *, uint64_t>> copies;
+
+  std::lock_guard<std::mutex> lock(ringsMutex);
+  for (auto& ring : rings) {
+    uint64_t count = ring->count.load(std::memory_order_acquire);
+    uint64_t oldest = count > RING_CAPACITY ? count - RING_CAPACITY : 0;
+
+    // Zones are written as they end, so the span's are the newest few
+    copies.clear();
+    uint64_t i = count;
+    for (; i > oldest; i--) {
+      Event& event = ring->events[(i - 1) % RING_CAPACITY];
+      uint64_t zoneStart = event.start.load(std::memory_order_relaxed);
+      uint64_t zoneEnd = event.end.load(std::memory_order_relaxed);
+
+      if (event.isCounter.load(std::memory_order_relaxed)) {
+        continue;
+      } else if (zoneEnd < start) {
+        break;
+      } else if (zoneEnd < end) {
+        copies.push_back({ event.name.load(std::memory_order_relaxed), zoneEnd - zoneStart });
+      }
+    }
+
+    // Newest first, so anything the thread wrote over is at the back
+    if (getOldestIntact(ring.get()) > i) {
+      continue;
+    }
+
+    for (auto& [name, duration] : copies) {
+      auto index = indices.find(name);
+      if (index == indices.end()) {
+        index = indices.insert({ name, totals.size() }).first;
+        totals.push_back({ name, 0, 0 });
+      }
+
+      ZoneTotal& total = totals[index->second];
+      total.count++;
+      total.duration += duration;
+    }
+  }
+}
+#endif
@@ -0,0 +1,84 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MORTAR_PROFILER_H
+#define MORTAR_PROFILER_H
+
+#include <stdint.h>
+#include <vector>
+
+// Scoped zones for seeing where frame time goes. They compile to nothing
+// unless MORTAR_PROFILE is defined, which the MORTAR_PROFILE CMake option
+// does. Names must be string literals, as only their address is kept.
+#ifdef MORTAR_PROFILE
+#define MORTAR_PROFILE_CONCAT_(a, b) a##b
+#define MORTAR_PROFILE_CONCAT(a, b) MORTAR_PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) Mortar::Profiler::Zone MORTAR_PROFILE_CONCAT(profileZone, __LINE__) { name }
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#endif
+
+#ifdef MORTAR_PROFILE
+namespace Mortar::Profiler {
+  // Nanoseconds on a steady clock
+  uint64_t now();
+
+  // Appends a finished zone to the calling thread's ring. Each thread only
+  // ever writes its own ring, so this takes no locks; when a ring is full,
+  // the oldest zones are overwritten.
+  void record(const char *name, uint64_t start, uint64_t end);
+
+  // Appends a sample of a named value, such as a frame's draw calls, shown
+  // as a graph alongside the zones
+  void counter(const char *name, uint64_t value);
+
+  // Writes every zone still held, from every thread, as Chrome trace event
+  // JSON for chrome://tracing or Perfetto. Safe to call while other threads
+  // record; zones overwritten during the copy are left out.
+  bool writeChromeTrace(const char *path);
+
+  // How many times a zone ended in a span of time, over every thread, and
+  // the nanoseconds spent in it, including any zones nested inside
+  struct ZoneTotal {
+    const char *name;
+    uint64_t count;
+    uint64_t duration;
+  };
+
+  // Replaces the totals with those of zones that ended in [start, end).
+  // Threads that wrote over the span's zones while they were read are left
+  // out.
+  void totalZones(uint64_t start, uint64_t end, std::vector<ZoneTotal>& totals);
+
+  class Zone {
+    public:
+      Zone(const char *name)
+        : name { name }, start { now() } {};
+
+      ~Zone() {
+        record(this->name, this->start, now());
+      }
+
+      Zone(const Zone&) = delete;
+      Zone& operator=(const Zone&) = delete;
+
+    private:
+      const char *name;
+      uint64_t start;
+  };
+}
+#endif
+
+#endif
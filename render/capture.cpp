@@ -0,0 +1,392 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <stdexcept>
+#include <tsl/sparse_map.h>
+
+#include "../resource/manager.hpp"
+#include "capture.hpp"
+#include "framepacket.hpp"
+
+using namespace Mortar::Render;
+
+// Saved captures are written in the host's byte order, as they're compared
+// between builds on one machine. The version changes with the layout.
+static const uint32_t CAPTURE_MAGIC = 0x5041434d;
+static const uint32_t CAPTURE_VERSION = 1;
+
+// The fewest bytes each record takes, for checking counts against the file
+static const size_t FRAME_SIZE = 232;
+static const size_t DRAW_SIZE = 88;
+static const size_t PALETTE_SIZE = 72;
+
+namespace {
+  class CaptureWriter {
+    public:
+      CaptureWriter(const std::string& path)
+        : out { path, std::ios::binary | std::ios::trunc } {
+        this->out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+      }
+
+      template <typename T>
+      void put(T value) {
+        this->out.write((const char *)&value, sizeof(T));
+      }
+
+      void putFloats(const float *values, size_t count) {
+        this->out.write((const char *)values, count * sizeof(float));
+      }
+
+      void putString(const std::string& string) {
+        this->put<uint32_t>(string.size());
+        this->out.write(string.data(), string.size());
+      }
+
+    private:
+      std::ofstream out;
+  };
+
+  class CaptureReader {
+    public:
+      CaptureReader(const std::string& path)
+        : in { path, std::ios::binary | std::ios::ate } {
+        this->in.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        this->size = this->in.tellg();
+        this->in.seekg(0);
+      }
+
+      template <typename T>
+      T get() {
+        T value;
+        this->in.read((char *)&value, sizeof(T));
+        return value;
+      }
+
+      void getFloats(float *values, size_t count) {
+        this->in.read((char *)values, count * sizeof(float));
+      }
+
+      // Reads a count of elements that follow, checking they fit in what's
+      // left of the file before anything is allocated for them
+      uint32_t getCount(size_t elementSize) {
+        uint32_t count = this->get<uint32_t>();
+        if (count > (this->size - (size_t)this->in.tellg()) / elementSize) {
+          throw std::runtime_error("capture is truncated");
+        }
+
+        return count;
+      }
+
+      void getString(std::string& string) {
+        string.resize(this->getCount(1));
+        this->in.read(string.data(), string.size());
+      }
+
+    private:
+      std::ifstream in;
+      size_t size;
+  };
+
+  // Resources are saved once each in a table, and draws and palettes refer
+  // to them by their index in it
+  template <typename T>
+  class ResourceTable {
+    public:
+      uint32_t add(const T *resource) {
+        auto [it, inserted] = this->indices.try_emplace(resource, this->resources.size());
+        if (inserted) {
+          this->resources.push_back(resource);
+        }
+
+        return it->second;
+      }
+
+      void write(CaptureWriter& writer, Mortar::Resource::ResourceManager& resourceManager) const {
+        std::vector<Mortar::Resource::ResourceLocation> locations = resourceManager.locateResources(this->resources);
+
+        writer.put<uint32_t>(locations.size());
+        for (auto& location : locations) {
+          if (location.name.empty()) {
+            throw std::runtime_error("capture references a resource no named load committed");
+          }
+
+          writer.putString(location.name);
+          writer.put<uint32_t>(location.index);
+        }
+      }
+
+      static std::vector<const T *> read(CaptureReader& reader, Mortar::Resource::ResourceManager& resourceManager) {
+        std::vector<const T *> resources (reader.getCount(2 * sizeof(uint32_t)));
+
+        Mortar::Resource::ResourceLocation location;
+        for (auto& resource : resources) {
+          reader.getString(location.name);
+          location.index = reader.get<uint32_t>();
+
+          resource = resourceManager.findResource<T>(location);
+          if (resource == nullptr) {
+            throw std::runtime_error("capture references " + location.name + " #" + std::to_string(location.index) + ", which isn't loaded");
+          }
+        }
+
+        return resources;
+      }
+
+    private:
+      std::vector<const Mortar::Resource::Resource *> resources;
+      tsl::sparse_map<const T *, uint32_t> indices;
+  };
+}
+
+static void writeStats(CaptureWriter& writer, const RenderStats& stats) {
+  writer.putFloats(&stats.uploadTime, 1);
+  writer.putFloats(&stats.paletteTime, 1);
+  writer.putFloats(&stats.prepassTime, 1);
+  writer.putFloats(&stats.opaqueStaticTime, 1);
+  writer.putFloats(&stats.opaqueSkinnedTime, 1);
+  writer.putFloats(&stats.alphaTime, 1);
+  writer.putFloats(&stats.gpuFrameTime, 1);
+  writer.putFloats(&stats.submitTime, 1);
+  writer.put<uint32_t>(stats.renderWidth);
+  writer.put<uint32_t>(stats.renderHeight);
+  writer.put<uint32_t>(stats.drawCalls);
+  writer.put<uint64_t>(stats.triangles);
+  writer.put<uint32_t>(stats.stateChanges);
+  writer.put<uint64_t>(stats.bytesUploaded);
+  writer.put<uint64_t>(stats.bufferMemory);
+  writer.put<uint64_t>(stats.textureMemory);
+  writer.put<uint32_t>(stats.textureLevelsStreamed);
+  writer.put<uint32_t>(stats.textureLevelsEvicted);
+}
+
+static void readStats(CaptureReader& reader, RenderStats& stats) {
+  reader.getFloats(&stats.uploadTime, 1);
+  reader.getFloats(&stats.paletteTime, 1);
+  reader.getFloats(&stats.prepassTime, 1);
+  reader.getFloats(&stats.opaqueStaticTime, 1);
+  reader.getFloats(&stats.opaqueSkinnedTime, 1);
+  reader.getFloats(&stats.alphaTime, 1);
+  reader.getFloats(&stats.gpuFrameTime, 1);
+  reader.getFloats(&stats.submitTime, 1);
+  stats.renderWidth = reader.get<uint32_t>();
+  stats.renderHeight = reader.get<uint32_t>();
+  stats.drawCalls = reader.get<uint32_t>();
+  stats.triangles = reader.get<uint64_t>();
+  stats.stateChanges = reader.get<uint32_t>();
+  stats.bytesUploaded = reader.get<uint64_t>();
+  stats.bufferMemory = reader.get<uint64_t>();
+  stats.textureMemory = reader.get<uint64_t>();
+  stats.textureLevelsStreamed = reader.get<uint32_t>();
+  stats.textureLevelsEvicted = reader.get<uint32_t>();
+}
+
+void Capture::record(const FramePacket& packet) {
+  Frame& frame = this->frames.emplace_back();
+  frame.view = packet.getView();
+  frame.projection = packet.getProjection();
+  frame.depthMode = packet.getDepthMode();
+
+  std::span<const RenderQueue::Item> items = packet.getQueue().getItems();
+  frame.draws.reserve(items.size());
+
+  // Draws of one actor share a palette in the packet, and in the capture
+  tsl::sparse_map<const Resource::SkinPalette *, int32_t> paletteIndices;
+  tsl::sparse_map<const Resource::GeomObject *, uint32_t> drawIndices;
+
+  for (const RenderQueue::Item& item : items) {
+    const Resource::SkinPalette *palette = item.geom->getSkinPalette();
+    int32_t paletteIdx = -1;
+
+    if (palette) {
+      auto cached = paletteIndices.find(palette);
+      if (cached != paletteIndices.end()) {
+        paletteIdx = cached->second;
+      } else {
+        paletteIdx = frame.palettes.size();
+        paletteIndices[palette] = paletteIdx;
+
+        frame.palettes.push_back({ palette->getTransforms(), palette->getCharacter(), palette->getRootTransform() });
+      }
+    }
+
+    if (!packet.getPrepass().empty()) {
+      drawIndices[item.geom] = frame.draws.size();
+    }
+
+    frame.draws.push_back({ item.key, item.geom->getMesh(), item.geom->getWorldTransform(), paletteIdx, item.geom->getLodLevel(), item.geom->getScreenSize() });
+  }
+
+  for (const FramePacket::PrepassDraw& draw : packet.getPrepass()) {
+    frame.prepass.push_back(drawIndices.at(draw.geom));
+  }
+}
+
+void Capture::setStats(const RenderStats& stats) {
+  if (!this->frames.empty()) {
+    this->frames.back().stats = stats;
+  }
+}
+
+void Capture::save(const std::string& path, Resource::ResourceManager& resourceManager) const {
+  ResourceTable<Resource::Mesh> meshes;
+  ResourceTable<Resource::Character> characters;
+
+  for (const Frame& frame : this->frames) {
+    for (const Draw& draw : frame.draws) {
+      meshes.add(draw.mesh);
+    }
+
+    for (const Palette& palette : frame.palettes) {
+      if (palette.character) {
+        characters.add(palette.character);
+      }
+    }
+  }
+
+  try {
+    CaptureWriter writer (path);
+    writer.put<uint32_t>(CAPTURE_MAGIC);
+    writer.put<uint32_t>(CAPTURE_VERSION);
+
+    meshes.write(writer, resourceManager);
+    characters.write(writer, resourceManager);
+
+    writer.put<uint32_t>(this->frames.size());
+    for (const Frame& frame : this->frames) {
+      writer.putFloats(frame.view.f, 16);
+      writer.putFloats(frame.projection.f, 16);
+      writer.put<uint32_t>((uint32_t)frame.depthMode);
+      writeStats(writer, frame.stats);
+
+      writer.put<uint32_t>(frame.draws.size());
+      for (const Draw& draw : frame.draws) {
+        // Keys pack handles, which differ between runs, but they're only
+        // kept for the order the draws are already in
+        writer.put<uint64_t>(draw.key);
+        writer.put<uint32_t>(meshes.add(draw.mesh));
+        writer.putFloats(draw.worldTransform.f, 16);
+        writer.put<int32_t>(draw.palette);
+        writer.put<uint32_t>(draw.lodLevel);
+        writer.putFloats(&draw.screenSize, 1);
+      }
+
+      writer.put<uint32_t>(frame.palettes.size());
+      for (const Palette& palette : frame.palettes) {
+        writer.put<uint32_t>(palette.transforms.size());
+        for (const Math::Affine& transform : palette.transforms) {
+          writer.putFloats(transform.f, 12);
+        }
+
+        writer.put<uint32_t>(palette.character ? characters.add(palette.character) + 1 : 0);
+        writer.putFloats(palette.rootTransform.f, 16);
+      }
+
+      writer.put<uint32_t>(frame.prepass.size());
+      for (uint32_t drawIdx : frame.prepass) {
+        writer.put<uint32_t>(drawIdx);
+      }
+    }
+  } catch (std::ios_base::failure&) {
+    throw std::runtime_error("unable to write capture to " + path);
+  }
+}
+
+Capture Capture::load(const std::string& path, Resource::ResourceManager& resourceManager) {
+  Capture capture;
+
+  try {
+    CaptureReader reader (path);
+    if (reader.get<uint32_t>() != CAPTURE_MAGIC || reader.get<uint32_t>() != CAPTURE_VERSION) {
+      throw std::runtime_error(path + " isn't a capture this build reads");
+    }
+
+    std::vector<const Resource::Mesh *> meshes = ResourceTable<Resource::Mesh>::read(reader, resourceManager);
+    std::vector<const Resource::Character *> characters = ResourceTable<Resource::Character>::read(reader, resourceManager);
+
+    capture.frames.resize(reader.getCount(FRAME_SIZE));
+    for (Frame& frame : capture.frames) {
+      reader.getFloats(frame.view.f, 16);
+      reader.getFloats(frame.projection.f, 16);
+
+      uint32_t depthMode = reader.get<uint32_t>();
+      if (depthMode > (uint32_t)DepthMode::PREPASS) {
+        throw std::runtime_error("capture has an unknown depth mode");
+      }
+
+      frame.depthMode = (DepthMode)depthMode;
+      readStats(reader, frame.stats);
+
+      frame.draws.resize(reader.getCount(DRAW_SIZE));
+      for (Draw& draw : frame.draws) {
+        draw.key = reader.get<uint64_t>();
+        draw.mesh = meshes.at(reader.get<uint32_t>());
+        reader.getFloats(draw.worldTransform.f, 16);
+        draw.palette = reader.get<int32_t>();
+        draw.lodLevel = reader.get<uint32_t>();
+        reader.getFloats(&draw.screenSize, 1);
+
+        if (draw.lodLevel >= Resource::Mesh::MAX_LODS) {
+          throw std::runtime_error("capture has a draw with an unknown LOD");
+        }
+      }
+
+      frame.palettes.resize(reader.getCount(PALETTE_SIZE));
+      for (Palette& palette : frame.palettes) {
+        palette.transforms.resize(reader.getCount(12 * sizeof(float)));
+        for (Math::Affine& transform : palette.transforms) {
+          reader.getFloats(transform.f, 12);
+        }
+
+        uint32_t character = reader.get<uint32_t>();
+        palette.character = character ? characters.at(character - 1) : nullptr;
+        reader.getFloats(palette.rootTransform.f, 16);
+      }
+
+      for (const Draw& draw : frame.draws) {
+        if (draw.palette < -1 || draw.palette >= (int32_t)frame.palettes.size()) {
+          throw std::runtime_error("capture has a draw with no palette");
+        }
+      }
+
+      frame.prepass.resize(reader.getCount(sizeof(uint32_t)));
+      for (uint32_t& drawIdx : frame.prepass) {
+        drawIdx = reader.get<uint32_t>();
+        if (drawIdx >= frame.draws.size()) {
+          throw std::runtime_error("capture has a pre-pass draw out of range");
+        }
+      }
+    }
+  } catch (std::out_of_range&) {
+    throw std::runtime_error("capture references a resource it doesn't list");
+  } catch (std::ios_base::failure&) {
+    throw std::runtime_error("unable to read capture from " + path);
+  }
+
+  return capture;
+}
+
+void Capture::clear() {
+  this->frames.clear();
+}
+
+size_t Capture::getFrameCount() const {
+  return this->frames.size();
+}
+
+const Capture::Frame& Capture::getFrame(size_t idx) const {
+  return this->frames.at(idx);
+}
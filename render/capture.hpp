@@ -0,0 +1,110 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_CAPTURE_H
+#define MORTAR_RENDER_CAPTURE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../math/affine.hpp"
+#include "../math/matrix.hpp"
+#include "../resource/types/character.hpp"
+#include "../resource/types/mesh.hpp"
+#include "renderqueue.hpp"
+#include "renderstats.hpp"
+
+namespace Mortar::Resource {
+  class ResourceManager;
+}
+
+namespace Mortar::Render {
+  class FramePacket;
+
+  // Frames as the renderer was given them, for drawing again later with the
+  // scene out of the way. Each frame keeps its draws in their sorted order
+  // with their keys, and each palette once, so replaying one doesn't build
+  // or sort anything.
+  //
+  // Meshes and characters are referenced rather than copied, so a capture
+  // can only be replayed while the resources it was recorded from are loaded.
+  // Saved, they're named by the load that committed them instead, so the
+  // same frames can be replayed by another build over the same assets and
+  // its costs set against the recorded ones.
+  class Capture {
+    public:
+      struct Draw {
+        uint64_t key;
+        const Resource::Mesh *mesh;
+        Math::Matrix worldTransform;
+
+        // Index into the frame's palettes, or -1 for unskinned draws
+        int32_t palette;
+
+        unsigned lodLevel;
+        float screenSize;
+      };
+
+      struct Palette {
+        std::vector<Math::Affine> transforms;
+
+        // Set when the palette holds a local pose
+        const Resource::Character *character;
+        Math::Matrix rootTransform;
+      };
+
+      struct Frame {
+        Math::Matrix view;
+        Math::Matrix projection;
+
+        DepthMode depthMode;
+
+        std::vector<Draw> draws;
+        std::vector<Palette> palettes;
+
+        // Indices into draws of the depth pre-pass, in the order drawn
+        std::vector<uint32_t> prepass;
+
+        // What the renderer reported just after drawing the frame
+        RenderStats stats;
+      };
+
+      // Copies a sorted packet in as the next frame
+      void record(const FramePacket& packet);
+
+      // Sets the stats of the frame recorded last
+      void setStats(const RenderStats& stats);
+
+      // Throws if a referenced resource wasn't committed by a named load, or
+      // the file can't be written
+      void save(const std::string& path, Resource::ResourceManager& resourceManager) const;
+
+      // Throws if the file isn't a capture this build reads, or a resource it
+      // names isn't loaded
+      static Capture load(const std::string& path, Resource::ResourceManager& resourceManager);
+
+      void clear();
+
+      size_t getFrameCount() const;
+      const Frame& getFrame(size_t idx) const;
+
+    private:
+      std::vector<Frame> frames;
+  };
+}
+
+#endif
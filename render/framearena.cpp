@@ -0,0 +1,90 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <stdlib.h>
+
+#include "framearena.hpp"
+
+using namespace Mortar::Render;
+
+FrameArena::~FrameArena() {
+  for (auto& block : this->blocks) {
+    free(block.data);
+  }
+}
+
+void *FrameArena::allocate(size_t size, size_t alignment) {
+  // Blocks come from malloc, so their alignment covers every type we put in
+  // here but nothing beyond it
+  if (alignment > alignof(max_align_t)) {
+    throw std::bad_alloc();
+  }
+
+  if (!this->blocks.empty()) {
+    Block& block = this->blocks.back();
+
+    uintptr_t start = reinterpret_cast<uintptr_t>(block.data) + block.used;
+    size_t padding = (alignment - start % alignment) % alignment;
+
+    if (block.used + padding + size <= block.size) {
+      block.used += padding + size;
+
+      return block.data + block.used - size;
+    }
+  }
+
+  size_t newSize = std::max(size, this->blockSize);
+
+  uint8_t *data = static_cast<uint8_t *>(malloc(newSize));
+  if (data == nullptr) {
+    throw std::bad_alloc();
+  }
+
+  this->blocks.push_back({ data, newSize, size });
+
+  return data;
+}
+
+void FrameArena::reset() {
+  if (this->blocks.size() > 1) {
+    size_t size = 0;
+    for (auto& block : this->blocks) {
+      size += block.size;
+      free(block.data);
+    }
+    this->blocks.clear();
+
+    uint8_t *data = static_cast<uint8_t *>(malloc(size));
+    if (data == nullptr) {
+      throw std::bad_alloc();
+    }
+
+    this->blocks.push_back({ data, size, 0 });
+  }
+
+  for (auto& block : this->blocks) {
+    block.used = 0;
+  }
+}
+
+size_t FrameArena::getUsedSize() const {
+  size_t size = 0;
+  for (auto& block : this->blocks) {
+    size += block.used;
+  }
+
+  return size;
+}
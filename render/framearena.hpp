@@ -0,0 +1,117 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MORTAR_RENDER_FRAMEARENA_H
+#define MORTAR_RENDER_FRAMEARENA_H
+
+#include <new>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+namespace Mortar::Render {
+  // Bump allocator for one frame's transient data. Everything is freed at
+  // once by reset(), which keeps the storage; if a frame outgrew it, the
+  // blocks are merged into one big enough, so steady frames never reach
+  // malloc. Each frame packet has its own, so the frame being built never
+  // frees what the frame being drawn is reading.
+  class FrameArena {
+    public:
+      static const size_t DEFAULT_BLOCK_SIZE = 256 * 1024;
+
+      FrameArena(size_t blockSize = DEFAULT_BLOCK_SIZE)
+        : blockSize { blockSize } {};
+      ~FrameArena();
+
+      FrameArena(const FrameArena&) = delete;
+      FrameArena& operator=(const FrameArena&) = delete;
+
+      void *allocate(size_t size, size_t alignment);
+      void reset();
+
+      // Uninitialized storage for count plain values, valid until reset()
+      template <typename T>
+      std::span<T> allocateSpan(size_t count);
+
+      template <typename T>
+      std::span<T> copySpan(std::span<const T> values);
+
+      // Bytes handed out since the last reset
+      size_t getUsedSize() const;
+
+    private:
+      struct Block {
+        uint8_t *data;
+        size_t size;
+        size_t used;
+      };
+
+      size_t blockSize;
+      std::vector<Block> blocks;
+  };
+
+  template <typename T>
+  std::span<T> FrameArena::allocateSpan(size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>, "frame arena values are never destroyed");
+
+    return { static_cast<T *>(this->allocate(sizeof(T) * count, alignof(T))), count };
+  }
+
+  template <typename T>
+  std::span<T> FrameArena::copySpan(std::span<const T> values) {
+    std::span<T> copy = this->allocateSpan<T>(values.size());
+    memcpy(copy.data(), values.data(), values.size_bytes());
+
+    return copy;
+  }
+
+  // Lets standard containers allocate from a frame arena. Deallocation does
+  // nothing, so a container must be cleared or rebuilt before the arena is
+  // reset.
+  template <typename T>
+  class FrameAllocator {
+    public:
+      typedef T value_type;
+
+      FrameAllocator(FrameArena *arena)
+        : arena { arena } {};
+
+      template <typename U>
+      FrameAllocator(const FrameAllocator<U>& other)
+        : arena { other.arena } {};
+
+      T *allocate(size_t count) {
+        return static_cast<T *>(this->arena->allocate(sizeof(T) * count, alignof(T)));
+      }
+
+      void deallocate(T *, size_t) {}
+
+      template <typename U>
+      bool operator==(const FrameAllocator<U>& other) const {
+        return this->arena == other.arena;
+      }
+
+    private:
+      template <typename U>
+      friend class FrameAllocator;
+
+      FrameArena *arena;
+  };
+}
+
+#endif
@@ -0,0 +1,148 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+
+#include "framepacket.hpp"
+
+using namespace Mortar::Render;
+
+void FramePacket::initialize(Resource::ResourceManager& resourceManager) {
+  this->geomPool = resourceManager.createResourcePool<Resource::GeomObject>(1024);
+  this->palettePool = resourceManager.createResourcePool<Resource::SkinPalette>(64);
+}
+
+void FramePacket::begin(const Math::Matrix& view, const Math::Matrix& projection, DepthMode depthMode) {
+  this->view = view;
+  this->projection = projection;
+  this->depthMode = depthMode;
+
+  this->queue.clear(depthMode);
+  this->prepass.clear();
+
+  this->palettes.reset();
+  this->arena.reset();
+  this->palettes.emplace(0, std::hash<const Resource::SkinPalette *>(), std::equal_to<const Resource::SkinPalette *>(), FrameAllocator<PaletteCopy>(&this->arena));
+  this->geomPool->reset();
+  this->palettePool->reset();
+}
+
+void FramePacket::push(const Resource::GeomObject *geom, float depth, bool isStatic) {
+  Resource::GeomObject *copy = this->geomPool->getResource();
+  copy->reset();
+
+  copy->setMesh(geom->getMesh());
+  copy->setWorldTransform(geom->getWorldTransform());
+  copy->setLodLevel(geom->getLodLevel());
+  copy->setScreenSize(geom->getScreenSize());
+
+  const Resource::SkinPalette *palette = geom->getSkinPalette();
+  if (palette) {
+    auto cached = this->palettes->find(palette);
+    if (cached != this->palettes->end()) {
+      copy->setSkinPalette(cached->second);
+    } else {
+      Resource::SkinPalette *paletteCopy = this->palettePool->getResource();
+
+      // Assigning keeps the pooled palette's storage from frame to frame
+      paletteCopy->getTransforms() = palette->getTransforms();
+      if (palette->getIsLocalPose()) {
+        paletteCopy->setLocalPose(palette->getCharacter(), palette->getRootTransform());
+      } else {
+        paletteCopy->clearLocalPose();
+      }
+
+      (*this->palettes)[palette] = paletteCopy;
+      copy->setSkinPalette(paletteCopy);
+    }
+  }
+
+  this->queue.push(copy, depth);
+
+  if (isStatic && this->depthMode == DepthMode::PREPASS && !palette && !geom->getMesh()->getMaterial()->isAlphaBlended()) {
+    this->prepass.push_back({ depth, copy });
+  }
+}
+
+void FramePacket::sort() {
+  this->queue.sort();
+
+  std::sort(this->prepass.begin(), this->prepass.end(), [](const PrepassDraw& a, const PrepassDraw& b) {
+    return a.depth < b.depth;
+  });
+}
+
+void FramePacket::replay(const Capture::Frame& frame) {
+  this->begin(frame.view, frame.projection, frame.depthMode);
+
+  std::span<Resource::SkinPalette *> palettes = this->arena.allocateSpan<Resource::SkinPalette *>(frame.palettes.size());
+  for (size_t i = 0; i < frame.palettes.size(); i++) {
+    const Capture::Palette& captured = frame.palettes[i];
+    Resource::SkinPalette *palette = this->palettePool->getResource();
+
+    palette->getTransforms() = captured.transforms;
+    if (captured.character) {
+      palette->setLocalPose(captured.character, captured.rootTransform);
+    } else {
+      palette->clearLocalPose();
+    }
+
+    palettes[i] = palette;
+  }
+
+  for (const Capture::Draw& draw : frame.draws) {
+    Resource::GeomObject *copy = this->geomPool->getResource();
+    copy->reset();
+
+    copy->setMesh(draw.mesh);
+    copy->setWorldTransform(draw.worldTransform);
+    copy->setLodLevel(draw.lodLevel);
+    copy->setScreenSize(draw.screenSize);
+    if (draw.palette >= 0) {
+      copy->setSkinPalette(palettes[draw.palette]);
+    }
+
+    this->queue.pushKeyed(copy, draw.key);
+  }
+
+  std::span<const RenderQueue::Item> items = this->queue.getItems();
+  for (uint32_t drawIdx : frame.prepass) {
+    this->prepass.push_back({ 0.0f, items[drawIdx].geom });
+  }
+}
+
+const Mortar::Math::Matrix& FramePacket::getView() const {
+  return this->view;
+}
+
+const Mortar::Math::Matrix& FramePacket::getProjection() const {
+  return this->projection;
+}
+
+Mortar::Render::DepthMode FramePacket::getDepthMode() const {
+  return this->depthMode;
+}
+
+const RenderQueue& FramePacket::getQueue() const {
+  return this->queue;
+}
+
+std::span<const FramePacket::PrepassDraw> FramePacket::getPrepass() const {
+  return this->prepass;
+}
+
+FrameArena& FramePacket::getArena() {
+  return this->arena;
+}
@@ -0,0 +1,91 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MORTAR_RENDER_FRAMEPACKET_H
+#define MORTAR_RENDER_FRAMEPACKET_H
+
+#include <optional>
+#include <span>
+#include <tsl/sparse_map.h>
+#include <vector>
+
+#include "../math/matrix.hpp"
+#include "../resource/manager.hpp"
+#include "../resource/pool.hpp"
+#include "../resource/types/geom.hpp"
+#include "../resource/types/palette.hpp"
+#include "capture.hpp"
+#include "framearena.hpp"
+#include "renderqueue.hpp"
+
+namespace Mortar::Render {
+  // Everything the renderer reads to draw one frame. Draws and their palettes
+  // are copied in as they're pushed, so the scene can go on to the next frame
+  // while this one is drawn. Copies come out of pools that are reset when
+  // the packet is reused, and anything else that only lives for the frame
+  // comes out of the packet's arena.
+  class FramePacket {
+    public:
+      struct PrepassDraw {
+        float depth;
+        const Resource::GeomObject *geom;
+      };
+
+      void initialize(Resource::ResourceManager& resourceManager);
+
+      void begin(const Math::Matrix& view, const Math::Matrix& projection, DepthMode depthMode = DepthMode::STATE_SORTED);
+
+      // depth is the draw's distance from the camera. Static draws are also
+      // drawn in the depth pre-pass, where the frame has one and they're
+      // opaque and unskinned.
+      void push(const Resource::GeomObject *geom, float depth, bool isStatic = false);
+      void sort();
+
+      // Begins the packet as a captured frame, with its draws already in
+      // order
+      void replay(const Capture::Frame& frame);
+
+      const Math::Matrix& getView() const;
+      const Math::Matrix& getProjection() const;
+      DepthMode getDepthMode() const;
+      const RenderQueue& getQueue() const;
+
+      // Front-to-back once sorted; empty unless the mode is PREPASS
+      std::span<const PrepassDraw> getPrepass() const;
+
+      // Reset by begin(), so nothing allocated from it outlives the frame
+      FrameArena& getArena();
+
+    private:
+      Math::Matrix view;
+      Math::Matrix projection;
+      DepthMode depthMode;
+      RenderQueue queue;
+      std::vector<PrepassDraw> prepass;
+
+      Resource::ResourcePool<Resource::GeomObject> *geomPool;
+      Resource::ResourcePool<Resource::SkinPalette> *palettePool;
+
+      FrameArena arena;
+
+      // Every draw of an actor shares its palette, and so do their copies.
+      // Rebuilt in the arena each frame.
+      typedef std::pair<const Resource::SkinPalette *const, Resource::SkinPalette *> PaletteCopy;
+      typedef tsl::sparse_map<const Resource::SkinPalette *, Resource::SkinPalette *, std::hash<const Resource::SkinPalette *>, std::equal_to<const Resource::SkinPalette *>, FrameAllocator<PaletteCopy>> PaletteMap;
+      std::optional<PaletteMap> palettes;
+  };
+}
+
+#endif
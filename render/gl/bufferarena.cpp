@@ -0,0 +1,133 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include "bufferarena.hpp"
+
+using namespace Mortar::Render::GL;
+
+void BufferArena::shutDown() {
+  for (auto& page : this->pages) {
+    glDeleteBuffers(1, &page.buffer);
+  }
+
+  this->pages.clear();
+}
+
+bool BufferArena::allocateFrom(Page& page, GLsizeiptr size, GLsizeiptr alignment, Allocation& allocation) {
+  for (auto range = page.freeRanges.begin(); range != page.freeRanges.end(); range++) {
+    GLintptr start = range->first;
+    GLintptr end = start + range->second;
+
+    GLintptr aligned = (start + alignment - 1) / alignment * alignment;
+    if (aligned + size > end) {
+      continue;
+    }
+
+    page.freeRanges.erase(range);
+
+    if (aligned > start) {
+      page.freeRanges[start] = aligned - start;
+    }
+
+    if (aligned + size < end) {
+      page.freeRanges[aligned + size] = end - (aligned + size);
+    }
+
+    allocation = { page.buffer, aligned, size };
+    return true;
+  }
+
+  return false;
+}
+
+BufferArena::Allocation BufferArena::allocate(GLsizeiptr size, GLsizeiptr alignment, const void *data) {
+  Allocation allocation;
+
+  bool found = false;
+  for (auto& page : this->pages) {
+    if (this->allocateFrom(page, size, alignment, allocation)) {
+      found = true;
+      break;
+    }
+  }
+
+  if (!found) {
+    Page page;
+    page.size = std::max(this->pageSize, size);
+    page.freeRanges[0] = page.size;
+
+    glGenBuffers(1, &page.buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, page.buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, page.size, nullptr, GL_STATIC_DRAW);
+
+    this->pages.push_back(page);
+    this->allocateFrom(this->pages.back(), size, alignment, allocation);
+  }
+
+  // The copy target leaves the bound vertex array's element buffer alone
+  if (data) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.offset, size, data);
+  }
+
+  return allocation;
+}
+
+void BufferArena::release(const Allocation& allocation) {
+  auto page = std::find_if(this->pages.begin(), this->pages.end(), [&](const Page& page) {
+    return page.buffer == allocation.buffer;
+  });
+
+  if (page == this->pages.end()) {
+    throw std::runtime_error("released allocation from unknown buffer");
+  }
+
+  GLintptr start = allocation.offset;
+  GLsizeiptr length = allocation.size;
+
+  auto next = page->freeRanges.lower_bound(start);
+  if (next != page->freeRanges.end() && start + length == next->first) {
+    length += next->second;
+    next = page->freeRanges.erase(next);
+  }
+
+  if (next != page->freeRanges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == start) {
+      start = prev->first;
+      length += prev->second;
+      page->freeRanges.erase(prev);
+    }
+  }
+
+  page->freeRanges[start] = length;
+}
+
+GLsizeiptr BufferArena::getReservedSize() const {
+  GLsizeiptr size = 0;
+  for (auto& page : this->pages) {
+    size += page.size;
+  }
+
+  return size;
+}
@@ -0,0 +1,68 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_GL_BUFFERARENA_H
+#define MORTAR_RENDER_GL_BUFFERARENA_H
+
+#include <GL/gl.h>
+#include <map>
+#include <vector>
+
+namespace Mortar::Render::GL {
+  // Suballocates static data out of a few large GL buffers, so that many
+  // resources share one buffer binding. Pages are carved first-fit and freed
+  // ranges coalesce with their neighbours; pages live until shutDown.
+  class BufferArena {
+    public:
+      struct Allocation {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+      };
+
+      static constexpr GLsizeiptr DEFAULT_PAGE_SIZE = 4 * 1024 * 1024;
+
+      BufferArena(GLsizeiptr pageSize = DEFAULT_PAGE_SIZE)
+        : pageSize { pageSize } {};
+
+      void shutDown();
+
+      // Offsets are a multiple of alignment, which needn't be a power of two
+      // so that vertex data can be placed on a whole vertex. Without data, the
+      // range is left for the caller to fill.
+      Allocation allocate(GLsizeiptr size, GLsizeiptr alignment, const void *data);
+      void release(const Allocation& allocation);
+
+      // Bytes of every page, used or not
+      GLsizeiptr getReservedSize() const;
+
+    private:
+      struct Page {
+        GLuint buffer;
+        GLsizeiptr size;
+
+        // offset -> length
+        std::map<GLintptr, GLsizeiptr> freeRanges;
+      };
+
+      bool allocateFrom(Page& page, GLsizeiptr size, GLsizeiptr alignment, Allocation& allocation);
+
+      GLsizeiptr pageSize;
+      std::vector<Page> pages;
+  };
+}
+
+#endif
@@ -0,0 +1,104 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+
+#include "gputimer.hpp"
+
+using namespace Mortar::Render::GL;
+
+void GPUTimer::initialize() {
+  for (auto& frame : this->frames) {
+    glGenQueries(frame.queries.size(), frame.queries.data());
+    frame.markCount = 0;
+    frame.isRecorded = false;
+  }
+
+  this->current = 0;
+  this->isRecording = false;
+  this->times = {};
+}
+
+void GPUTimer::shutDown() {
+  for (auto& frame : this->frames) {
+    glDeleteQueries(frame.queries.size(), frame.queries.data());
+  }
+}
+
+void GPUTimer::beginFrame() {
+  Frame& frame = this->frames[this->current];
+
+  if (frame.isRecorded) {
+    GLint isAvailable = GL_FALSE;
+    glGetQueryObjectiv(frame.queries[frame.markCount], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+
+    if (isAvailable) {
+      this->readBack(frame);
+    }
+  }
+
+  frame.markCount = 0;
+  frame.isRecorded = false;
+  this->isRecording = true;
+}
+
+void GPUTimer::beginPass(Pass pass) {
+  Frame& frame = this->frames[this->current];
+
+  if (!this->isRecording || frame.markCount == MAX_MARKS) {
+    return;
+  }
+
+  if (frame.markCount > 0 && frame.passes[frame.markCount - 1] == pass) {
+    return;
+  }
+
+  glQueryCounter(frame.queries[frame.markCount], GL_TIMESTAMP);
+  frame.passes[frame.markCount++] = pass;
+}
+
+void GPUTimer::endFrame() {
+  Frame& frame = this->frames[this->current];
+
+  if (!this->isRecording) {
+    return;
+  }
+
+  // The last query closes the last pass
+  if (frame.markCount > 0) {
+    glQueryCounter(frame.queries[frame.markCount], GL_TIMESTAMP);
+    frame.isRecorded = true;
+  }
+
+  this->current = (this->current + 1) % FRAME_LATENCY;
+  this->isRecording = false;
+}
+
+void GPUTimer::readBack(Frame& frame) {
+  std::array<GLuint64, MAX_MARKS + 1> stamps;
+  for (size_t i = 0; i <= frame.markCount; i++) {
+    glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &stamps[i]);
+  }
+
+  this->times.passes.fill(0.0f);
+  for (size_t i = 0; i < frame.markCount; i++) {
+    this->times.passes[static_cast<size_t>(frame.passes[i])] += (stamps[i + 1] - stamps[i]) / 1000000.0f;
+  }
+
+  this->times.frame = (stamps[frame.markCount] - stamps[0]) / 1000000.0f;
+}
@@ -0,0 +1,85 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MORTAR_RENDER_GL_GPUTIMER_H
+#define MORTAR_RENDER_GL_GPUTIMER_H
+
+#include <GL/gl.h>
+#include <array>
+#include <cstddef>
+
+namespace Mortar::Render::GL {
+  // Times the passes of a frame on the GPU with timestamp queries. Results
+  // are read back FRAME_LATENCY frames later, by which point they're almost
+  // always available, so reading them never stalls the pipeline. A frame
+  // whose queries still aren't done is dropped rather than waited on.
+  //
+  // A timestamp is taken whenever the pass changes, and the time up to the
+  // next one goes to that pass, so passes may be entered more than once per
+  // frame. Past MAX_MARKS changes, time goes to the last pass marked.
+  class GPUTimer {
+    public:
+      enum class Pass {
+        UPLOADS,
+        PALETTES,
+        DEPTH_PREPASS,
+        OPAQUE_STATIC,
+        OPAQUE_SKINNED,
+        ALPHA,
+        PASS_COUNT,
+      };
+
+      static constexpr size_t PASS_COUNT = static_cast<size_t>(Pass::PASS_COUNT);
+      static constexpr size_t FRAME_LATENCY = 4;
+      static constexpr size_t MAX_MARKS = 64;
+
+      struct Times {
+        // Milliseconds
+        std::array<float, PASS_COUNT> passes;
+        float frame;
+      };
+
+      void initialize();
+      void shutDown();
+
+      // Reads back the oldest frame's queries, then starts on this frame's
+      void beginFrame();
+      void beginPass(Pass pass);
+      void endFrame();
+
+      // From the latest frame read back
+      const Times& getTimes() const {
+        return this->times;
+      }
+
+    private:
+      struct Frame {
+        std::array<GLuint, MAX_MARKS + 1> queries;
+        std::array<Pass, MAX_MARKS> passes;
+        size_t markCount = 0;
+        bool isRecorded = false;
+      };
+
+      void readBack(Frame& frame);
+
+      std::array<Frame, FRAME_LATENCY> frames;
+      size_t current = 0;
+      bool isRecording = false;
+
+      Times times {};
+  };
+}
+
+#endif
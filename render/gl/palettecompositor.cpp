@@ -0,0 +1,225 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <stdexcept>
+
+#include "../../log.hpp"
+#include "../../resource/types/character.hpp"
+#include "palettecompositor.hpp"
+#include "uniformbuffer.hpp"
+
+#define COMPOSE_GROUP_SIZE 64
+
+#define GLSL(...) #__VA_ARGS__ "\n"
+#define MORTAR_XSTR(x) #x
+#define MORTAR_STR(x) MORTAR_XSTR(x)
+
+using namespace Mortar::Render::GL;
+
+// Row vectors, so a joint's world transform is its local transform times each
+// ancestor's in turn and then the root, matching the CPU path. Transforms are
+// stored as Math::Affine, whose three columns make a column-major mat3x4
+static const char *composeSource =
+  "#version 430\n"
+  "layout(local_size_x = " MORTAR_STR(COMPOSE_GROUP_SIZE) ") in;\n"
+  GLSL(
+    layout(std430, binding = 0) readonly buffer PoseMatrices {
+      mat3x4 poseMatrices[];
+    };
+
+    layout(std430, binding = 1) readonly buffer JointParents {
+      int jointParents[];
+    };
+
+    layout(std430, binding = 2) writeonly buffer PaletteOutput {
+      mat3x4 skinPalette[];
+    };
+
+    mat4 toMatrix(mat3x4 m) {
+      return mat4(m[0], m[1], m[2], vec4(0, 0, 0, 1));
+    }
+
+    // The root transform, followed by each joint's local transform
+    uniform int rootIndex;
+    uniform int skinBase;
+    uniform int parentBase;
+    uniform int jointCount;
+
+    void main() {
+      int joint = int(gl_GlobalInvocationID.x);
+      if (joint >= jointCount) {
+        return;
+      }
+
+      mat4 world = toMatrix(poseMatrices[rootIndex + 1 + joint]);
+      for (int parent = jointParents[parentBase + joint]; parent != -1; parent = jointParents[parentBase + parent]) {
+        world = world * toMatrix(poseMatrices[rootIndex + 1 + parent]);
+      }
+      world = world * toMatrix(poseMatrices[rootIndex]);
+
+      skinPalette[joint] = mat3x4(toMatrix(poseMatrices[skinBase + joint]) * world);
+    }
+  );
+
+void PaletteCompositor::initialize(bool enabled) {
+  this->supported = false;
+  if (!enabled) {
+    return;
+  }
+
+  GLint major, minor;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+  this->supported = major > 4 || (major == 4 && minor >= 3);
+  if (!this->supported) {
+    DEBUG("GL %d.%d has no compute shaders; skin palettes are built on the CPU", major, minor);
+    return;
+  }
+
+  GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+  glShaderSource(shader, 1, &composeSource, nullptr);
+  glCompileShader(shader);
+
+  GLint success;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (!success) {
+    char infoLog[512];
+    glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+    DEBUG("failed to compile shader: %s", infoLog);
+    throw std::runtime_error("failed to compile palette compute shader");
+  }
+
+  this->program = glCreateProgram();
+  glAttachShader(this->program, shader);
+  glLinkProgram(this->program);
+  glDeleteShader(shader);
+
+  glGetProgramiv(this->program, GL_LINK_STATUS, &success);
+  if (!success) {
+    throw std::runtime_error("failed to link palette compute shader");
+  }
+
+  this->rootIndexLocation = glGetUniformLocation(this->program, "rootIndex");
+  this->skinBaseLocation = glGetUniformLocation(this->program, "skinBase");
+  this->parentBaseLocation = glGetUniformLocation(this->program, "parentBase");
+  this->jointCountLocation = glGetUniformLocation(this->program, "jointCount");
+
+  glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &this->alignment);
+
+  glGenBuffers(1, &this->poseBuffer);
+  glGenBuffers(1, &this->parentBuffer);
+}
+
+void PaletteCompositor::shutDown() {
+  if (this->program != 0) {
+    glDeleteProgram(this->program);
+    glDeleteBuffers(1, &this->poseBuffer);
+    glDeleteBuffers(1, &this->parentBuffer);
+
+    this->program = 0;
+    this->poseBuffer = 0;
+    this->parentBuffer = 0;
+  }
+
+  this->supported = false;
+}
+
+bool PaletteCompositor::isSupported() const {
+  return this->supported;
+}
+
+GLint PaletteCompositor::getAlignment() const {
+  return this->alignment;
+}
+
+void PaletteCompositor::beginFrame() {
+  this->poseMatrices.clear();
+  this->jointParents.clear();
+  this->jobs.clear();
+  this->skeletons.clear();
+}
+
+void PaletteCompositor::addPalette(const Resource::SkinPalette& palette, GLintptr offset) {
+  const Resource::Character *character = palette.getCharacter();
+  const std::vector<Math::Affine>& pose = palette.getTransforms();
+
+  if (pose.size() > MAX_PALETTE_SIZE) {
+    throw std::runtime_error("skin palette too large");
+  } else if (pose.empty()) {
+    return;
+  }
+
+  // Characters' skeletons go up once per frame, however many actors share them
+  const Resource::ResourceHandle& handle = character->getHandle();
+  if (!this->skeletons.contains(handle)) {
+    const std::vector<Resource::Joint *>& joints = character->getJoints();
+    Skeleton skeleton { static_cast<GLint>(this->poseMatrices.size() / 12), static_cast<GLint>(this->jointParents.size()) };
+
+    for (size_t i = 0; i < joints.size(); i++) {
+      const Math::Affine& skinTransform = character->getSkinTransform(i);
+
+      this->poseMatrices.insert(this->poseMatrices.end(), skinTransform.f, skinTransform.f + 12);
+      this->jointParents.push_back(joints[i]->getParentIdx());
+    }
+
+    this->skeletons[handle] = skeleton;
+  }
+
+  const Skeleton& skeleton = this->skeletons.at(handle);
+  Job job { static_cast<GLint>(this->poseMatrices.size() / 12), skeleton.skinBase, skeleton.parentBase, static_cast<GLint>(pose.size()), offset };
+
+  Math::Affine root(palette.getRootTransform());
+  this->poseMatrices.insert(this->poseMatrices.end(), root.f, root.f + 12);
+  for (auto& transform : pose) {
+    this->poseMatrices.insert(this->poseMatrices.end(), transform.f, transform.f + 12);
+  }
+
+  this->jobs.push_back(job);
+}
+
+void PaletteCompositor::dispatch(GLuint output) {
+  if (this->jobs.empty()) {
+    return;
+  }
+
+  // Orphaned like the uniform buffer, so last frame's dispatches never stall
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->poseBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, this->poseMatrices.size() * sizeof(float), this->poseMatrices.data(), GL_STREAM_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->parentBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, this->jointParents.size() * sizeof(int32_t), this->jointParents.data(), GL_STREAM_DRAW);
+
+  glUseProgram(this->program);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, this->poseBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, this->parentBuffer);
+
+  for (auto& job : this->jobs) {
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 2, output, job.offset, job.jointCount * 12 * sizeof(float));
+
+    glUniform1i(this->rootIndexLocation, job.rootIndex);
+    glUniform1i(this->skinBaseLocation, job.skinBase);
+    glUniform1i(this->parentBaseLocation, job.parentBase);
+    glUniform1i(this->jointCountLocation, job.jointCount);
+
+    glDispatchCompute((job.jointCount + COMPOSE_GROUP_SIZE - 1) / COMPOSE_GROUP_SIZE, 1, 1);
+  }
+
+  // Draws read the palettes back through uniform blocks
+  glMemoryBarrier(GL_UNIFORM_BARRIER_BIT);
+}
@@ -0,0 +1,92 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_GL_PALETTECOMPOSITOR_H
+#define MORTAR_RENDER_GL_PALETTECOMPOSITOR_H
+
+#include <GL/gl.h>
+#include <cstdint>
+#include <vector>
+
+#include "../../resource/handlemap.hpp"
+#include "../../resource/types/palette.hpp"
+
+namespace Mortar::Render::GL {
+  // Builds skin palettes from local poses in a compute shader: each joint
+  // walks its parent chain, then applies its skin transform. It's only used
+  // when asked for; otherwise, or on contexts older than GL 4.3, which have
+  // no compute, palettes are built on the CPU.
+  class PaletteCompositor {
+    public:
+      PaletteCompositor()
+        : program { 0 },
+          poseBuffer { 0 },
+          parentBuffer { 0 },
+          alignment { 1 },
+          supported { false } {};
+
+      void initialize(bool enabled);
+      void shutDown();
+
+      bool isSupported() const;
+
+      // What palette output offsets must be a multiple of
+      GLint getAlignment() const;
+
+      void beginFrame();
+
+      // Queues the palette to be written at offset into the output buffer
+      void addPalette(const Resource::SkinPalette& palette, GLintptr offset);
+
+      // Writes every queued palette; output must be uploaded already, as the
+      // palettes are written over it
+      void dispatch(GLuint output);
+
+    private:
+      struct Job {
+        GLint rootIndex;
+        GLint skinBase;
+        GLint parentBase;
+        GLint jointCount;
+        GLintptr offset;
+      };
+
+      // Where a character's skin transforms and parents were staged
+      struct Skeleton {
+        GLint skinBase;
+        GLint parentBase;
+      };
+
+      GLuint program;
+      GLint rootIndexLocation;
+      GLint skinBaseLocation;
+      GLint parentBaseLocation;
+      GLint jointCountLocation;
+
+      GLuint poseBuffer;
+      GLuint parentBuffer;
+      GLint alignment;
+      bool supported;
+
+      // Affine transforms and parent indices for the frame
+      std::vector<float> poseMatrices;
+      std::vector<int32_t> jointParents;
+      std::vector<Job> jobs;
+      Resource::HandleMap<Skeleton> skeletons;
+  };
+}
+
+#endif
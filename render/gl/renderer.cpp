@@ -17,19 +17,23 @@
 #define GL_GLEXT_PROTOTYPES
 
 #include <GL/gl.h>
+#include <SDL2/SDL_timer.h>
 #include <SDL2/SDL_video.h>
+#include <algorithm>
 #include <assert.h>
+#include <cmath>
 #include <stdexcept>
+#include <string.h>
 #include <tsl/sparse_map.h>
 #include <vector>
 
 #include "../../log.hpp"
+#include "../../profiler.hpp"
 #include "../../state.hpp"
 #include "renderer.hpp"
 #include "shader.hpp"
+#include "uniformbuffer.hpp"
 
-#define WIDTH 800
-#define HEIGHT 600
 
 using namespace Mortar::Render::GL;
 
@@ -53,57 +57,87 @@ static inline GLenum getGLPrimitiveType(Mortar::Resource::PrimitiveType mortarTy
   return primitiveTypeMap.at(mortarType);
 }
 
-const tsl::sparse_map<Mortar::Resource::VertexUsage, std::string> vertexUsageMap = {
-  { Mortar::Resource::VertexUsage::BLEND_INDICES, "blendIndices" },
-  { Mortar::Resource::VertexUsage::BLEND_WEIGHTS, "blendWeights" },
-  { Mortar::Resource::VertexUsage::COLOR,         "color"        },
-  { Mortar::Resource::VertexUsage::NORMAL,        "normal"       },
-  { Mortar::Resource::VertexUsage::POSITION,      "position"     },
-  { Mortar::Resource::VertexUsage::TEX_COORD,     "texCoord"     },
-};
+static inline uint64_t countTriangles(GLenum primitiveType, GLsizei count) {
+  switch (primitiveType) {
+    case GL_TRIANGLES:
+      return count / 3;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN:
+      return count > 2 ? count - 2 : 0;
+    default:
+      return 0;
+  }
+}
 
-static inline const char *getVertexPropertyParamName(Mortar::Resource::VertexUsage vertexUsage) {
-  if (!vertexUsageMap.contains(vertexUsage)) {
-    throw std::runtime_error("unrecognized vertex usage");
+static constexpr const char *getVertexPropertyParamName(Mortar::Resource::VertexUsage vertexUsage) {
+  switch (vertexUsage) {
+    case Mortar::Resource::VertexUsage::BLEND_INDICES:
+      return "blendIndices";
+    case Mortar::Resource::VertexUsage::BLEND_WEIGHTS:
+      return "blendWeights";
+    case Mortar::Resource::VertexUsage::COLOR:
+      return "color";
+    case Mortar::Resource::VertexUsage::NORMAL:
+      return "normal";
+    case Mortar::Resource::VertexUsage::POSITION:
+      return "position";
+    case Mortar::Resource::VertexUsage::TEX_COORD:
+      return "texCoord";
   }
 
-  return vertexUsageMap.at(vertexUsage).c_str();
+  throw std::runtime_error("unrecognized vertex usage");
 }
 
 struct GLVertexPropertyType {
   GLenum type;
   GLint size;
+  GLboolean normalized;
 };
 
-const tsl::sparse_map<Mortar::Resource::VertexDataType, struct GLVertexPropertyType> vertexDataTypeMap = {
-  {
-    Mortar::Resource::VertexDataType::D3DCOLOR,
-    { GL_UNSIGNED_BYTE, GL_BGRA }
-  },
+static constexpr struct GLVertexPropertyType getVertexPropertyType(Mortar::Resource::VertexDataType vertexDataType) {
+  switch (vertexDataType) {
+    case Mortar::Resource::VertexDataType::D3DCOLOR:
+      return { GL_UNSIGNED_BYTE, GL_BGRA, GL_TRUE };
+    case Mortar::Resource::VertexDataType::VEC2:
+      return { GL_FLOAT, 2, GL_FALSE };
+    case Mortar::Resource::VertexDataType::VEC3:
+      return { GL_FLOAT, 3, GL_FALSE };
+    case Mortar::Resource::VertexDataType::INT_2_10_10_10:
+      return { GL_INT_2_10_10_10_REV, 4, GL_TRUE };
+    case Mortar::Resource::VertexDataType::HALF_VEC2:
+      return { GL_HALF_FLOAT, 2, GL_FALSE };
+    case Mortar::Resource::VertexDataType::UBYTE_VEC4:
+      return { GL_UNSIGNED_BYTE, 4, GL_FALSE };
+    case Mortar::Resource::VertexDataType::UNORM16_VEC2:
+      return { GL_UNSIGNED_SHORT, 2, GL_TRUE };
+  }
+
+  throw std::runtime_error("unrecognized vertex data type");
+}
+
+// Fixed directional lights, shared by the lit programs
+static const FrameBlock frameLights = {
+  {},
   {
-    Mortar::Resource::VertexDataType::VEC2,
-    { GL_FLOAT, 2 }
+    { 1.0f, 0.0f,  0.0f, 0.0f },
+    { 0.0f, 1.0f,  0.0f, 0.0f },
+    { 0.0f, 0.0f, -1.0f, 0.0f },
   },
   {
-    Mortar::Resource::VertexDataType::VEC3,
-    { GL_FLOAT, 3 }
+    { 1.0f, 1.0f, 1.0f, 0.0f },
+    { 1.0f, 1.0f, 1.0f, 0.0f },
+    { 1.0f, 1.0f, 1.0f, 0.0f },
   },
+  { 0.4f, 0.4f, 0.4f, 0.0f },
 };
 
-static inline const struct GLVertexPropertyType& getVertexPropertyType(Mortar::Resource::VertexDataType vertexDataType) {
-  if (!vertexDataTypeMap.contains(vertexDataType)) {
-    throw std::runtime_error("unrecognized vertex data type");
-  }
-
-  return vertexDataTypeMap.at(vertexDataType);
-}
-
 void Renderer::initialize() {
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+  // 3.3 for packed 2:10:10:10 vertex attributes
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
 
-  SDL_GLContext context = SDL_GL_CreateContext(State::getDisplayManager().getWindow());
+  this->context = SDL_GL_CreateContext(State::getDisplayManager().getWindow());
 
   glEnable(GL_DEBUG_OUTPUT);
   glDebugMessageCallback(glDebugCallback, nullptr);
@@ -111,151 +145,789 @@ void Renderer::initialize() {
   glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DEBUG_SEVERITY_HIGH, 0, nullptr, GL_TRUE);
   glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DEBUG_SEVERITY_MEDIUM, 0, nullptr, GL_TRUE);
 
+  GLint major, minor;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  this->separateVertexFormats = major > 4 || (major == 4 && minor >= 3);
+
   this->shaderManager.initialize();
+  this->uniformBuffer.initialize();
+  this->paletteCompositor.initialize(this->gpuPalettes);
+  this->renderTarget.initialize();
+  this->textureUnits.initialize();
+  this->uploadQueue.initialize(&this->textureUnits);
+  this->gpuTimer.initialize();
+  this->programSamplers.fill(-1);
 
   this->isInitialized = true;
 }
 
 void Renderer::shutDown() {
+  this->gpuTimer.shutDown();
+  this->uploadQueue.shutDown();
+  this->pendingMeshes.clear();
+  this->pendingTextures.clear();
+  this->requestedTextures.clear();
+  this->streamingTextures.clear();
+  this->uniformBuffer.shutDown();
+  this->paletteCompositor.shutDown();
+  this->renderTarget.shutDown();
+  this->textureUnits.shutDown();
   this->shaderManager.shutDown();
 
-  GLuint *textureIds = new GLuint[this->textureIds.size()];
-  GLuint *textureIdPtr = textureIds;
-  for (auto texture = this->textureIds.begin(); texture != this->textureIds.end(); texture++, textureIdPtr++) {
-    *textureIdPtr = texture->second;
+  for (auto& shared : this->sharedTextures) {
+    glDeleteTextures(1, &shared.second.name);
   }
-  glDeleteTextures(this->textureIds.size(), textureIds);
-  delete[] textureIds;
 
-  GLuint *vertexArrayIds = new GLuint[this->vertexArrayIds.size()];
-  GLuint *vertexArrayIdPtr = vertexArrayIds;
-  for (auto vertexArray = this->vertexArrayIds.begin(); vertexArray != this->vertexArrayIds.end(); vertexArray++, vertexArrayIdPtr++) {
-    *vertexArrayIdPtr = vertexArray->second;
+  glDeleteVertexArrays(this->vertexArrayNames.size(), this->vertexArrayNames.data());
+
+  this->sharedTextures.clear();
+  this->textureKeys.clear();
+  this->textureNames.clear();
+  this->textureReady.clear();
+  this->textureMemory = 0;
+
+  for (auto& vertexArena : this->vertexArenas) {
+    this->vertexArenas.at(vertexArena.first).shutDown();
   }
-  glDeleteVertexArrays(this->vertexArrayIds.size(), vertexArrayIds);
-  delete[] vertexArrayIds;
+  this->indexArena.shutDown();
+
+  this->vertexArrays.clear();
+  this->vertexArrayNames.clear();
+  this->vertexBindings.clear();
+  this->vertexArenas.clear();
+  this->sharedVertexData.clear();
+  this->vertexBufferKeys.clear();
+  this->meshRecords.clear();
+  this->surfaceRecords.clear();
+
+  this->vertexBufferSlots.clear();
+  this->meshSlots.clear();
+  this->surfaceSlots.clear();
+  this->textureSlots.clear();
+}
 
-  GLuint *vertexBufferIds = new GLuint[this->vertexBufferIds.size()];
-  GLuint *vertexBufferIdPtr = vertexBufferIds;
-  for (auto vertexBuffer = this->vertexBufferIds.begin(); vertexBuffer != this->vertexBufferIds.end(); vertexBuffer++, vertexBufferIdPtr++) {
-    *vertexBufferIdPtr = vertexBuffer->second;
+void Renderer::acquireContext() {
+  SDL_GL_MakeCurrent(State::getDisplayManager().getWindow(), this->context);
+}
+
+void Renderer::releaseContext() {
+  SDL_GL_MakeCurrent(State::getDisplayManager().getWindow(), nullptr);
+}
+
+uint64_t Renderer::getContentKey(uint64_t contentHash) {
+  // Hashes take the top bit, so they never meet the counter
+  if (contentHash) {
+    return contentHash | (1ull << 63);
   }
-  glDeleteBuffers(this->vertexBufferIds.size(), vertexBufferIds);
-  delete[] vertexBufferIds;
 
-  GLuint *elementBufferIds = new GLuint[this->elementBufferIds.size()];
-  GLuint *elementBufferIdPtr = elementBufferIds;
-  for (auto elementBuffer = this->elementBufferIds.begin(); elementBuffer != this->elementBufferIds.end(); elementBuffer++, elementBufferIdPtr++) {
-    *elementBufferIdPtr = elementBuffer->second;
+  return this->nextUniqueKey++;
+}
+
+const Renderer::VertexAllocation& Renderer::uploadVertexBuffer(const Resource::VertexBuffer *vertexBuffer, unsigned stride) {
+  uint32_t slot = this->vertexBufferSlots.add(vertexBuffer);
+  this->vertexBufferKeys.resize(this->vertexBufferSlots.getCapacity(), 0);
+
+  uint64_t& key = this->vertexBufferKeys[slot];
+  if (!key) {
+    key = this->getContentKey(vertexBuffer->getContentHash());
+    this->sharedVertexData[key].users.push_back({ vertexBuffer->getHandle(), vertexBuffer });
+  }
+
+  SharedVertexData& shared = this->sharedVertexData.at(key);
+  for (auto& allocation : shared.allocations) {
+    if (allocation.stride == stride) {
+      return allocation;
+    }
   }
-  glDeleteBuffers(this->elementBufferIds.size(), elementBufferIds);
-  delete[] elementBufferIds;
+
+  BufferArena& arena = this->vertexArenas[stride];
+  shared.allocations.push_back({ stride, arena.allocate(vertexBuffer->getSize(), stride, nullptr) });
+
+  const ContentUser<Resource::VertexBuffer>& uploader = shared.users.front();
+  const BufferArena::Allocation& allocation = shared.allocations.back().allocation;
+  this->uploadQueue.pushBuffer(uploader.handle, allocation.buffer, allocation.offset, allocation.size, uploader.resource->getData());
+
+  return shared.allocations.back();
 }
 
-void Renderer::registerMeshes(const std::vector<const Resource::Mesh *>& meshes) {
-  /* Initialize a vertex array for each mesh. */
-  GLuint *vertexArrayIds = new GLuint[meshes.size()];
-  GLuint *vertexArrayIdPtr = vertexArrayIds;
-  glGenVertexArrays(meshes.size(), vertexArrayIds);
+void Renderer::releaseVertexBuffer(uint32_t slot, const Resource::ResourceHandle& handle) {
+  uint64_t key = this->vertexBufferKeys[slot];
+  SharedVertexData& shared = this->sharedVertexData.at(key);
+
+  bool wasUploading = shared.users.front().handle == handle && this->uploadQueue.isPending(handle);
+  this->uploadQueue.cancel(handle);
+
+  std::erase_if(shared.users, [&handle] (const ContentUser<Resource::VertexBuffer>& user) {
+    return user.handle == handle;
+  });
+
+  if (shared.users.empty()) {
+    for (auto& allocation : shared.allocations) {
+      this->vertexArenas.at(allocation.stride).release(allocation.allocation);
+    }
+
+    this->sharedVertexData.erase(key);
+  } else if (wasUploading) {
+    const ContentUser<Resource::VertexBuffer>& uploader = shared.users.front();
+    for (auto& allocation : shared.allocations) {
+      this->uploadQueue.pushBuffer(uploader.handle, allocation.allocation.buffer, allocation.allocation.offset, allocation.allocation.size, uploader.resource->getData());
+    }
+  }
+
+  this->vertexBufferKeys[slot] = 0;
+}
+
+size_t Renderer::VertexArrayKeyHash::operator()(const VertexArrayKey& key) const noexcept {
+  size_t h1 = std::hash<GLuint>{}(key.buffer);
+  size_t h2 = std::hash<const void *>{}(key.vertexLayout);
+
+  return h1 ^ (h2 << 1);
+}
 
-  for (auto mesh = meshes.begin(); mesh != meshes.end(); mesh++, vertexArrayIdPtr++) {
-    GLuint vertexBufferId = this->vertexBufferIds.at((*mesh)->getVertexBuffer()->getHandle());
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferId);
+const Renderer::VertexBindings& Renderer::getVertexBindings(const Resource::VertexLayout& vertexLayout) {
+  auto cached = this->vertexBindings.find(&vertexLayout);
+  if (cached != this->vertexBindings.end()) {
+    return cached->second;
+  }
+
+  VertexBindings bindings {};
+  for (auto& property : vertexLayout.getProperties()) {
+    GLint attr = ShaderManager::getAttribLocation(getVertexPropertyParamName(property.getUsage()));
+    if (attr == -1) {
+      continue;
+    }
+
+    const struct GLVertexPropertyType glType = getVertexPropertyType(property.getDataType());
+    bindings.bindings[bindings.count++] = { static_cast<GLuint>(attr), glType.size, glType.type, glType.normalized, static_cast<GLintptr>(property.getOffset()) };
+  }
+
+  return this->vertexBindings[&vertexLayout] = bindings;
+}
+
+GLuint Renderer::getVertexArray(GLuint buffer, const Resource::VertexLayout& vertexLayout) {
+  VertexArrayKey key { this->separateVertexFormats ? 0 : buffer, &vertexLayout };
+
+  auto vertexArray = this->vertexArrays.find(key);
+  if (vertexArray != this->vertexArrays.end()) {
+    return vertexArray->second;
+  }
+
+  GLuint vertexArrayId;
+  glGenVertexArrays(1, &vertexArrayId);
+  glBindVertexArray(vertexArrayId);
+
+  // Attribute locations are fixed across programs, so one vertex array
+  // serves every shader
+  GLsizei stride = vertexLayout.getStride();
+  const VertexBindings& bindings = this->getVertexBindings(vertexLayout);
+  if (this->separateVertexFormats) {
+    for (size_t i = 0; i < bindings.count; i++) {
+      const VertexBinding& binding = bindings.bindings[i];
+
+      glVertexAttribFormat(binding.location, binding.size, binding.type, binding.normalized, static_cast<GLuint>(binding.offset));
+      glVertexAttribBinding(binding.location, 0);
+      glEnableVertexAttribArray(binding.location);
+    }
+  } else {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    for (size_t i = 0; i < bindings.count; i++) {
+      const VertexBinding& binding = bindings.bindings[i];
 
-    glBindVertexArray(*vertexArrayIdPtr);
-    this->vertexArrayIds[(*mesh)->getHandle()] = *vertexArrayIdPtr;
+      glVertexAttribPointer(binding.location, binding.size, binding.type, binding.normalized, stride, (GLvoid *)binding.offset);
+      glEnableVertexAttribArray(binding.location);
+    }
+  }
 
-    Resource::ShaderType shaderType = (*mesh)->getShaderType();
-    GLuint shaderProgram = this->shaderManager.getShaderProgram(shaderType);
+  this->vertexArrays[key] = vertexArrayId;
+  this->vertexArrayNames.push_back(vertexArrayId);
 
-    const Resource::VertexLayout& vertexLayout = (*mesh)->getVertexLayout();
+  return vertexArrayId;
+}
 
+void Renderer::registerMeshes(const std::vector<const Resource::Mesh *>& meshes) {
+  for (auto mesh : meshes) {
+    const Resource::VertexLayout& vertexLayout = mesh->getVertexLayout();
     unsigned stride = vertexLayout.getStride();
-    const std::vector<Resource::VertexLayout::VertexProperty>& vertexProperties = vertexLayout.getProperties();
-    for (auto& property : vertexProperties) {
-      const char *attribName = getVertexPropertyParamName(property.getUsage());
-      GLint attr = glGetAttribLocation(shaderProgram, attribName);
-      if (attr == -1) {
-        continue;
-      }
 
-      const struct GLVertexPropertyType glType = getVertexPropertyType(property.getDataType());
-      glVertexAttribPointer(attr, glType.size, glType.type, GL_TRUE, stride, (GLvoid *)property.getOffset());
-      glEnableVertexAttribArray(attr);
+    const VertexAllocation& vertexAllocation = this->uploadVertexBuffer(mesh->getVertexBuffer(), stride);
+
+    MeshRecord record;
+    record.vertexArray = this->getVertexArray(vertexAllocation.allocation.buffer, vertexLayout);
+    record.baseVertex = vertexAllocation.allocation.offset / stride;
+    if (this->separateVertexFormats) {
+      record.vertexBuffer = vertexAllocation.allocation.buffer;
+      record.vertexStride = stride;
     }
 
-    const std::vector<Resource::Surface *>& surfaces = (*mesh)->getSurfaces();
+    // Pack every surface's indices back to back in one allocation
+    record.isReady = false;
+    std::vector<GLushort>& indices = record.pendingIndices;
 
-    GLuint *elementBufferIds = new GLuint[surfaces.size()];
-    GLuint *elementBufferIdPtr = elementBufferIds;
-    glGenBuffers(surfaces.size(), elementBufferIds);
+    const std::vector<Resource::Surface *>& surfaces = mesh->getSurfaces();
+    for (auto surface : surfaces) {
+      const Resource::IndexBuffer *indexBuffer = surface->getIndexBuffer();
 
-    for (auto surface = surfaces.begin(); surface != surfaces.end(); surface++, elementBufferIdPtr++) {
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *elementBufferIdPtr);
-      this->elementBufferIds[(*surface)->getHandle()] = *elementBufferIdPtr;
+      SurfaceRecord surfaceRecord;
+      surfaceRecord.primitiveType = getGLPrimitiveType(surface->getPrimitiveType());
 
-      const Resource::IndexBuffer *indexBuffer = (*surface)->getIndexBuffer();
+      const std::vector<Resource::IndexBuffer *>& lods = surface->getLods();
+      for (unsigned level = 0; level < Resource::Mesh::MAX_LODS; level++) {
+        if (level > lods.size()) {
+          surfaceRecord.counts[level] = surfaceRecord.counts[level - 1];
+          surfaceRecord.firstIndices[level] = surfaceRecord.firstIndices[level - 1];
+          continue;
+        }
+
+        const Resource::IndexBuffer *levelIndices = level ? lods[level - 1] : indexBuffer;
+        surfaceRecord.counts[level] = levelIndices->getCount();
+        surfaceRecord.firstIndices[level] = indices.size() * sizeof(GLushort);
+
+        indices.insert(indices.end(), levelIndices->getData(), levelIndices->getData() + levelIndices->getCount());
+      }
+
+      uint32_t surfaceSlot = this->surfaceSlots.add(surface);
+      this->surfaceRecords.resize(this->surfaceSlots.getCapacity());
 
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indexBuffer->getCount(), indexBuffer->getData(), GL_STATIC_DRAW);
+      this->surfaceRecords[surfaceSlot] = surfaceRecord;
+      record.surfaces.push_back(surface->getHandle());
     }
 
-    delete[] elementBufferIds;
+    record.indices = this->indexArena.allocate(indices.size() * sizeof(GLushort), sizeof(GLushort), nullptr);
+    for (auto surface : surfaces) {
+      for (GLintptr& firstIndex : this->surfaceRecords[surface->getRenderSlot()].firstIndices) {
+        firstIndex += record.indices.offset;
+      }
+    }
+
+    uint32_t meshSlot = this->meshSlots.add(mesh);
+    this->meshRecords.resize(this->meshSlots.getCapacity());
+
+    // Moving the record keeps the indices where they are, so the queue can
+    // read them from there
+    MeshRecord& stored = this->meshRecords[meshSlot] = std::move(record);
+    this->uploadQueue.pushBuffer(mesh->getHandle(), stored.indices.buffer, stored.indices.offset, stored.indices.size, stored.pendingIndices.data());
+
+    this->pendingMeshes.push_back({
+      mesh->getHandle(),
+      meshSlot,
+      this->vertexBufferKeys[mesh->getVertexBuffer()->getRenderSlot()],
+    });
   }
 
-  delete[] vertexArrayIds;
+  glBindVertexArray(0);
+}
+
+static Mortar::Render::GL::UploadQueue::TextureLevel getLevelTarget(const Mortar::Resource::Texture *texture, const Mortar::Resource::Texture::Level *level) {
+  return {
+    static_cast<GLint>(level->getLevel()),
+    std::max<GLsizei>(texture->getWidth() >> level->getLevel(), 1),
+    std::max<GLsizei>(texture->getHeight() >> level->getLevel(), 1),
+    static_cast<GLenum>(texture->getInternalFormat()),
+    texture->getFormat(),
+    texture->getIsCompressed(),
+  };
 }
 
 void Renderer::registerTextures(const std::vector<const Resource::Texture *> &textures) {
-  GLuint *textureIds = new GLuint[textures.size()];
-  GLuint *textureIdPtr = textureIds;
-  glGenTextures(textures.size(), textureIds);
+  // Nothing is read out of an unpack buffer while storage is allocated
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  std::vector<GLuint> released;
+
+  for (auto texture : textures) {
+    uint32_t slot = this->textureSlots.add(texture);
+    this->textureNames.resize(this->textureSlots.getCapacity(), 0);
+    this->textureKeys.resize(this->textureSlots.getCapacity(), 0);
+    this->textureReady.resize(this->textureSlots.getCapacity(), 0);
+
+    // Registering a texture again replaces what was made for it
+    if (this->textureKeys[slot]) {
+      this->releaseTexture(slot, texture->getHandle(), released);
+    }
 
-  size_t start = this->textureSamplers.size();
+    uint64_t key = this->getContentKey(texture->getContentHash());
+    if (!this->sharedTextures.contains(key)) {
+      this->sharedTextures[key] = this->createTexture(texture);
+    }
 
-  for (int i = start; i < start + textures.size(); i++, textureIdPtr++) {
-    const Resource::Texture *texture = textures.at(i - start);
+    SharedTexture& shared = this->sharedTextures.at(key);
+    shared.users.push_back({ texture->getHandle(), texture });
 
-    glActiveTexture(GL_TEXTURE0 + i);
-    glBindTexture(GL_TEXTURE_2D, *textureIdPtr);
+    this->textureNames[slot] = shared.name;
+    this->textureKeys[slot] = key;
+    this->textureReady[slot] = 0;
+    this->pendingTextures.push_back(texture->getHandle());
+  }
 
-    this->textureSamplers[texture->getHandle()] = i;
-    this->textureIds[texture->getHandle()] = *textureIdPtr;
+  glDeleteTextures(released.size(), released.data());
+}
 
-    const std::vector<Resource::Texture::Level *>& levels = texture->getLevels();
-    for (auto level : levels) {
-      GLsizei width = texture->getWidth() >> level->getLevel();
-      GLsizei height = texture->getHeight() >> level->getLevel();
+// Allocates a level's storage, or frees it, with the texture bound. Either
+// way the data goes to GL as stored, with no conversion here.
+static void setLevelStorage(const Mortar::Resource::Texture *texture, const Mortar::Resource::Texture::Level *level, bool allocate) {
+  Mortar::Render::GL::UploadQueue::TextureLevel target = getLevelTarget(texture, level);
+  if (!allocate) {
+    target.width = 0;
+    target.height = 0;
+  }
 
-      if (!texture->getIsCompressed()) {
-        throw std::runtime_error("not expecting uncompressed data");
+  if (target.isCompressed) {
+    glCompressedTexImage2D(GL_TEXTURE_2D, target.level, target.internalFormat, target.width, target.height, 0, allocate ? level->getSize() : 0, nullptr);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, target.level, target.internalFormat, target.width, target.height, 0, target.format, GL_UNSIGNED_BYTE, nullptr);
+  }
+}
+
+// Levels no bigger than this a side are uploaded with the texture and kept
+static constexpr size_t PINNED_LEVEL_SIZE = 64;
+
+// Levels queued for streaming per frame, on top of the upload queue's own
+// per-frame budget
+static constexpr unsigned MAX_STREAMED_LEVELS = 8;
+
+Renderer::SharedTexture Renderer::createTexture(const Resource::Texture *texture) {
+  const std::vector<Resource::Texture::Level *>& levels = texture->getLevels();
+
+  SharedTexture shared {};
+  shared.levelCount = levels.size();
+  shared.pinnedLevel = 0;
+  while (shared.pinnedLevel + 1 < shared.levelCount && std::max(texture->getWidth(), texture->getHeight()) >> shared.pinnedLevel > PINNED_LEVEL_SIZE) {
+    shared.pinnedLevel++;
+  }
+  shared.baseLevel = shared.pinnedLevel;
+  shared.allocatedLevel = shared.pinnedLevel;
+  shared.wantedFrame = 0;
+  shared.neededFrame = this->frameNumber;
+
+  glGenTextures(1, &shared.name);
+
+  // Allocating makes the texture resident in some unit like any bind
+  this->textureUnits.bind(shared.name);
+
+  for (unsigned i = shared.pinnedLevel; i < shared.levelCount; i++) {
+    setLevelStorage(texture, levels[i], true);
+    shared.size += levels[i]->getSize();
+  }
+
+  // Only the base level is sampled, so the levels above it can come and go
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, shared.baseLevel);
+
+  this->textureMemory += shared.size;
+  this->queueTextureUpload(texture, shared);
+
+  return shared;
+}
+
+void Renderer::queueTextureUpload(const Resource::Texture *texture, const SharedTexture& shared) {
+  // Smallest first, so the pinned levels are ready before a streamed one
+  const std::vector<Resource::Texture::Level *>& levels = texture->getLevels();
+  for (unsigned i = shared.levelCount; i-- > shared.allocatedLevel;) {
+    this->uploadQueue.pushTextureLevel(texture->getHandle(), shared.name, getLevelTarget(texture, levels[i]), levels[i]->getSize(), levels[i]->getData());
+  }
+}
+
+void Renderer::requestTextureLevel(const Resource::Texture *texture, float screenSize) {
+  uint32_t slot = texture->getRenderSlot();
+  if (slot == Resource::Resource::NO_RENDER_SLOT || slot >= this->textureKeys.size() || !this->textureKeys[slot]) {
+    return;
+  }
+
+  uint64_t key = this->textureKeys[slot];
+  SharedTexture& shared = this->sharedTextures.at(key);
+  if (!shared.levelCount) {
+    return;
+  }
+
+  // Textures are taken to span their mesh's bounds once, so the level with
+  // about as many texels as the bounds cover pixels is wanted
+  float pixels = screenSize * 2.0f * this->frameStats.renderHeight;
+  float texels = std::max(texture->getWidth(), texture->getHeight());
+  unsigned level = shared.levelCount - 1;
+  if (pixels >= 1.0f) {
+    level = std::min<unsigned>(std::max(std::floor(std::log2(texels / pixels)), 0.0f), level);
+  }
+
+  if (shared.wantedFrame != this->frameNumber) {
+    shared.wantedFrame = this->frameNumber;
+    shared.wantedLevel = level;
+    this->requestedTextures.push_back(key);
+  } else {
+    shared.wantedLevel = std::min(shared.wantedLevel, level);
+  }
+
+  if (level <= shared.baseLevel) {
+    shared.neededFrame = this->frameNumber;
+  }
+}
+
+void Renderer::streamTextureLevels() {
+  PROFILE_ZONE("Renderer::streamTextureLevels");
+
+  // The most starved textures go first
+  std::sort(this->requestedTextures.begin(), this->requestedTextures.end(), [this] (uint64_t a, uint64_t b) {
+    const SharedTexture& sharedA = this->sharedTextures.at(a);
+    const SharedTexture& sharedB = this->sharedTextures.at(b);
+    return (int)sharedA.allocatedLevel - (int)sharedA.wantedLevel > (int)sharedB.allocatedLevel - (int)sharedB.wantedLevel;
+  });
+
+  uint64_t budget = this->textureBudget.load();
+  unsigned streamed = 0;
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  for (uint64_t key : this->requestedTextures) {
+    SharedTexture& shared = this->sharedTextures.at(key);
+    if (streamed == MAX_STREAMED_LEVELS) {
+      break;
+    }
+
+    // One level at a time, and only once the last one is in
+    if (shared.wantedLevel >= shared.allocatedLevel || shared.allocatedLevel != shared.baseLevel) {
+      continue;
+    }
+
+    const Resource::Texture *texture = shared.users.front().resource;
+    const Resource::Texture::Level *level = texture->getLevels()[shared.allocatedLevel - 1];
+
+    bool hasRoom = true;
+    while (this->textureMemory + level->getSize() > budget && hasRoom) {
+      hasRoom = this->evictTextureLevel(key);
+    }
+
+    if (!hasRoom) {
+      break;
+    }
+
+    shared.allocatedLevel--;
+    this->textureUnits.bind(shared.name);
+    setLevelStorage(texture, level, true);
+
+    shared.size += level->getSize();
+    this->textureMemory += level->getSize();
+
+    this->uploadQueue.pushTextureLevel(texture->getHandle(), shared.name, getLevelTarget(texture, level), level->getSize(), level->getData());
+    this->streamingTextures.push_back(key);
+    streamed++;
+  }
+
+  this->frameStats.textureLevelsStreamed += streamed;
+  this->requestedTextures.clear();
+}
+
+bool Renderer::evictTextureLevel(uint64_t exceptKey) {
+  // Only textures whose top level wasn't needed this frame give it up
+  SharedTexture *victim = nullptr;
+  for (auto& entry : this->sharedTextures) {
+    SharedTexture& shared = this->sharedTextures.at(entry.first);
+    if (entry.first == exceptKey || shared.baseLevel >= shared.pinnedLevel || shared.allocatedLevel != shared.baseLevel || shared.neededFrame == this->frameNumber) {
+      continue;
+    }
+
+    if (!victim || shared.neededFrame < victim->neededFrame) {
+      victim = &shared;
+    }
+  }
+
+  if (!victim) {
+    return false;
+  }
+
+  const Resource::Texture *texture = victim->users.front().resource;
+  const Resource::Texture::Level *level = texture->getLevels()[victim->baseLevel];
+
+  victim->baseLevel++;
+  victim->allocatedLevel++;
+
+  this->textureUnits.bind(victim->name);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, victim->baseLevel);
+  setLevelStorage(texture, level, false);
+
+  victim->size -= level->getSize();
+  this->textureMemory -= level->getSize();
+  this->frameStats.textureLevelsEvicted++;
+
+  return true;
+}
+
+void Renderer::setTextureBudget(uint64_t budget) {
+  this->textureBudget = budget;
+}
+
+uint64_t Renderer::getTextureBudget() const {
+  return this->textureBudget;
+}
+
+void Renderer::setGPUPalettes(bool enabled) {
+  this->gpuPalettes = enabled;
+}
+
+void Renderer::releaseTexture(uint32_t slot, const Resource::ResourceHandle& handle, std::vector<GLuint>& released) {
+  uint64_t key = this->textureKeys[slot];
+  SharedTexture& shared = this->sharedTextures.at(key);
+
+  bool wasUploading = shared.users.front().handle == handle && this->uploadQueue.isPending(handle);
+  this->uploadQueue.cancel(handle);
+
+  std::erase_if(shared.users, [&handle] (const ContentUser<Resource::Texture>& user) {
+    return user.handle == handle;
+  });
+
+  if (shared.users.empty()) {
+    this->textureUnits.evict(shared.name);
+    released.push_back(shared.name);
+
+    this->textureMemory -= shared.size;
+    this->sharedTextures.erase(key);
+  } else if (wasUploading) {
+    this->queueTextureUpload(shared.users.front().resource, shared);
+  }
+
+  this->textureNames[slot] = 0;
+  this->textureKeys[slot] = 0;
+  this->textureReady[slot] = 0;
+}
+
+void Renderer::registerVertexBuffers(const std::vector<const Resource::VertexBuffer *> &) {
+  // Vertex data is packed by stride, which only the meshes know, so it's
+  // uploaded as the meshes using it are registered
+}
+
+void Renderer::unregisterResources(const std::vector<Resource::ResourceHandle>& handles) {
+  std::vector<GLuint> textureIds;
+
+  for (auto& handle : handles) {
+    // Shared content checks for its uploader's copies before they're
+    // cancelled
+    uint32_t slot = this->textureSlots.remove(handle);
+    if (slot != Resource::Resource::NO_RENDER_SLOT) {
+      this->releaseTexture(slot, handle, textureIds);
+    }
+
+    slot = this->meshSlots.remove(handle);
+    if (slot != Resource::Resource::NO_RENDER_SLOT) {
+      MeshRecord& record = this->meshRecords[slot];
+
+      this->indexArena.release(record.indices);
+      for (auto& surfaceHandle : record.surfaces) {
+        this->surfaceSlots.remove(surfaceHandle);
       }
 
-      glCompressedTexImage2D(GL_TEXTURE_2D, level->getLevel(), texture->getInternalFormat(), width, height, 0, level->getSize(), level->getData());
+      record = MeshRecord();
     }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    slot = this->vertexBufferSlots.remove(handle);
+    if (slot != Resource::Resource::NO_RENDER_SLOT) {
+      this->releaseVertexBuffer(slot, handle);
+    }
+
+    this->uploadQueue.cancel(handle);
   }
 
-  delete[] textureIds;
+  // Deleted together, as one call
+  glDeleteTextures(textureIds.size(), textureIds.data());
+
+  std::erase_if(this->pendingMeshes, [this] (const PendingMesh& pending) {
+    return this->meshSlots.find(pending.mesh) == Resource::Resource::NO_RENDER_SLOT;
+  });
+
+  std::erase_if(this->pendingTextures, [this] (const Resource::ResourceHandle& pending) {
+    return this->textureSlots.find(pending) == Resource::Resource::NO_RENDER_SLOT;
+  });
+}
+
+bool Renderer::isMeshReady(const Resource::ResourceHandle& mesh) const {
+  uint32_t slot = this->meshSlots.find(mesh);
+
+  return slot != Resource::Resource::NO_RENDER_SLOT && this->meshRecords[slot].isReady;
 }
 
-void Renderer::registerVertexBuffers(const std::vector<const Resource::VertexBuffer *> &vertexBuffers) {
-  GLuint *vertexBufferIds = new GLuint[vertexBuffers.size()];
-  GLuint *vertexBufferIdPtr = vertexBufferIds;
-  glGenBuffers(vertexBuffers.size(), vertexBufferIds);
+bool Renderer::isTextureReady(const Resource::Texture *texture) const {
+  uint32_t slot = texture->getRenderSlot();
+
+  return slot != Resource::Resource::NO_RENDER_SLOT && slot < this->textureReady.size() && this->textureReady[slot];
+}
+
+void Renderer::updatePendingUploads() {
+  // Streamed levels are sampled once they're in
+  std::erase_if(this->streamingTextures, [this] (uint64_t key) {
+    if (!this->sharedTextures.contains(key)) {
+      return true;
+    }
+
+    SharedTexture& shared = this->sharedTextures.at(key);
+    if (this->uploadQueue.isPending(shared.users.front().handle)) {
+      return false;
+    }
+
+    shared.baseLevel = shared.allocatedLevel;
+    this->textureUnits.bind(shared.name);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, shared.baseLevel);
+
+    return true;
+  });
+
+  std::erase_if(this->pendingTextures, [this] (const Resource::ResourceHandle& pending) {
+    uint32_t slot = this->textureSlots.find(pending);
+
+    const SharedTexture& shared = this->sharedTextures.at(this->textureKeys[slot]);
+    if (this->uploadQueue.isPending(shared.users.front().handle)) {
+      return false;
+    }
 
-  /* Initialize all vertex buffers. */
-  for (auto vertexBuffer = vertexBuffers.begin(); vertexBuffer != vertexBuffers.end(); vertexBuffer++, vertexBufferIdPtr++) {
-    glBindBuffer(GL_ARRAY_BUFFER, *vertexBufferIdPtr);
-    this->vertexBufferIds[(*vertexBuffer)->getHandle()] = *vertexBufferIdPtr;
+    this->textureReady[slot] = 1;
+
+    return true;
+  });
+
+  std::erase_if(this->pendingMeshes, [this] (const PendingMesh& pending) {
+    if (this->uploadQueue.isPending(pending.mesh)) {
+      return false;
+    }
+
+    auto vertexData = this->sharedVertexData.find(pending.vertexKey);
+    if (vertexData != this->sharedVertexData.end() && this->uploadQueue.isPending(vertexData->second.users.front().handle)) {
+      return false;
+    }
 
-    glBufferData(GL_ARRAY_BUFFER, (*vertexBuffer)->getSize(), (*vertexBuffer)->getData(), GL_STATIC_DRAW);
+    MeshRecord& record = this->meshRecords[pending.meshSlot];
+    record.isReady = true;
+    record.pendingIndices.clear();
+    record.pendingIndices.shrink_to_fit();
+
+    return true;
+  });
+}
+
+bool Renderer::composesSkinPalettes() const {
+  return this->paletteCompositor.isSupported();
+}
+
+Mortar::Render::RenderStats Renderer::getRenderStats() const {
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+
+  return this->stats;
+}
+
+void Renderer::endFrame() {
+  this->gpuTimer.endFrame();
+
+  const GPUTimer::Times& times = this->gpuTimer.getTimes();
+  this->frameStats.uploadTime = times.passes[static_cast<size_t>(GPUTimer::Pass::UPLOADS)];
+  this->frameStats.paletteTime = times.passes[static_cast<size_t>(GPUTimer::Pass::PALETTES)];
+  this->frameStats.prepassTime = times.passes[static_cast<size_t>(GPUTimer::Pass::DEPTH_PREPASS)];
+  this->frameStats.opaqueStaticTime = times.passes[static_cast<size_t>(GPUTimer::Pass::OPAQUE_STATIC)];
+  this->frameStats.opaqueSkinnedTime = times.passes[static_cast<size_t>(GPUTimer::Pass::OPAQUE_SKINNED)];
+  this->frameStats.alphaTime = times.passes[static_cast<size_t>(GPUTimer::Pass::ALPHA)];
+  this->frameStats.gpuFrameTime = times.frame;
+  this->resolution.update(times.frame);
+  this->frameStats.submitTime = (SDL_GetPerformanceCounter() - this->frameStart) * 1000.0f / SDL_GetPerformanceFrequency();
+
+  this->frameStats.bufferMemory = this->indexArena.getReservedSize();
+  for (auto& arena : this->vertexArenas) {
+    this->frameStats.bufferMemory += arena.second.getReservedSize();
   }
+  this->frameStats.textureMemory = this->textureMemory;
+
+#ifdef MORTAR_PROFILE
+  Profiler::counter("gpu uploads (us)", this->frameStats.uploadTime * 1000.0f);
+  Profiler::counter("gpu palettes (us)", this->frameStats.paletteTime * 1000.0f);
+  Profiler::counter("gpu depth prepass (us)", this->frameStats.prepassTime * 1000.0f);
+  Profiler::counter("gpu opaque static (us)", this->frameStats.opaqueStaticTime * 1000.0f);
+  Profiler::counter("gpu opaque skinned (us)", this->frameStats.opaqueSkinnedTime * 1000.0f);
+  Profiler::counter("gpu alpha (us)", this->frameStats.alphaTime * 1000.0f);
+  Profiler::counter("gpu frame (us)", this->frameStats.gpuFrameTime * 1000.0f);
+  Profiler::counter("draw calls", this->frameStats.drawCalls);
+  Profiler::counter("triangles", this->frameStats.triangles);
+  Profiler::counter("state changes", this->frameStats.stateChanges);
+  Profiler::counter("bytes uploaded", this->frameStats.bytesUploaded);
+  Profiler::counter("gpu buffer memory", this->frameStats.bufferMemory);
+  Profiler::counter("gpu texture memory", this->frameStats.textureMemory);
+  Profiler::counter("texture levels streamed", this->frameStats.textureLevelsStreamed);
+  Profiler::counter("texture levels evicted", this->frameStats.textureLevelsEvicted);
+#endif
+
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+  this->stats = this->frameStats;
+}
+
+void Renderer::setResolution(const ResolutionController::Settings& settings) {
+  std::lock_guard<std::mutex> lock(this->resolutionMutex);
+  this->pendingResolution = settings;
+}
 
-  delete[] vertexBufferIds;
+Mortar::Render::ResolutionController::Settings Renderer::getResolution() const {
+  std::lock_guard<std::mutex> lock(this->resolutionMutex);
+  return this->pendingResolution ? *this->pendingResolution : this->resolution.getSettings();
 }
 
-void Renderer::renderGeometry(const std::list<const Resource::GeomObject *>& geometry) {
+void Renderer::bindFrameTarget() {
+  {
+    std::lock_guard<std::mutex> lock(this->resolutionMutex);
+    if (this->pendingResolution) {
+      this->resolution.setSettings(*this->pendingResolution);
+      this->pendingResolution.reset();
+    }
+  }
+
+  // Read every frame, so a resized window resizes the target with it
+  DisplayManager& displayManager = State::getDisplayManager();
+  this->windowWidth = displayManager.getWidth();
+  this->windowHeight = displayManager.getHeight();
+
+  float scale = this->resolution.getScale();
+  unsigned width = std::max<long>(std::lround(this->windowWidth * scale), 1);
+  unsigned height = std::max<long>(std::lround(this->windowHeight * scale), 1);
+
+  // At full size there's nothing to filter, so the window is drawn to
+  // directly and the copy is saved
+  this->isOffscreen = width != this->windowWidth || height != this->windowHeight;
+  if (this->isOffscreen) {
+    this->renderTarget.resize(width, height);
+    this->renderTarget.bind();
+  } else {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width, height);
+  }
+
+  this->frameStats.renderWidth = width;
+  this->frameStats.renderHeight = height;
+}
+
+void Renderer::drawSurfaces(const Resource::Mesh *mesh, const MeshRecord& record, unsigned lodLevel) {
+  const std::vector<Resource::Surface *>& surfaces = mesh->getSurfaces();
+
+  // Surfaces sharing every uniform only differ in their index range, so each
+  // run with the same primitive type is a single multi-draw
+  for (auto surface = surfaces.begin(); surface != surfaces.end();) {
+    GLenum primitiveType = this->surfaceRecords[(*surface)->getRenderSlot()].primitiveType;
+
+    this->drawCounts.clear();
+    this->drawIndices.clear();
+    this->drawBaseVertices.clear();
+
+    for (; surface != surfaces.end(); surface++) {
+      const SurfaceRecord& surfaceRecord = this->surfaceRecords[(*surface)->getRenderSlot()];
+      if (surfaceRecord.primitiveType != primitiveType) {
+        break;
+      }
+
+      this->drawCounts.push_back(surfaceRecord.counts[lodLevel]);
+      this->drawIndices.push_back((GLvoid *)surfaceRecord.firstIndices[lodLevel]);
+      this->drawBaseVertices.push_back(record.baseVertex);
+      this->frameStats.triangles += countTriangles(primitiveType, surfaceRecord.counts[lodLevel]);
+    }
+
+    glMultiDrawElementsBaseVertex(primitiveType, this->drawCounts.data(), GL_UNSIGNED_SHORT, this->drawIndices.data(), this->drawCounts.size(), this->drawBaseVertices.data());
+    this->frameStats.drawCalls++;
+  }
+}
+
+void Renderer::renderGeometry(const FramePacket& packet) {
+  PROFILE_ZONE("Renderer::renderGeometry");
+
   if (!this->isInitialized) {
     DEBUG("renderer not initialized");
   }
@@ -264,129 +936,397 @@ void Renderer::renderGeometry(const std::list<const Resource::GeomObject *>& geo
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
   /* Initialize transformation matrices. */
-  const Math::Matrix& proj = State::getDisplayManager().getPerspectiveTransform();
-  const Math::Matrix& view = State::getCamera().getViewTransform();
+  const Math::Matrix& proj = packet.getProjection();
+  const Math::Matrix& view = packet.getView();
 
+  this->frameStart = SDL_GetPerformanceCounter();
+  this->frameStats = {};
+  this->frameNumber++;
+  this->gpuTimer.beginFrame();
+
+  this->bindFrameTarget();
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  if (geometry.empty()) {
+  // Some of the frame goes to uploads, whether or not anything is drawn
+  this->gpuTimer.beginPass(GPUTimer::Pass::UPLOADS);
+  this->frameStats.bytesUploaded += this->uploadQueue.process();
+  this->updatePendingUploads();
+
+  std::span<const RenderQueue::Item> items = packet.getQueue().getItems();
+  if (items.empty()) {
+    this->endFrame();
     return;
   }
 
   Math::Matrix projViewMtx = view * d3dTransform * proj;
 
-  for (auto geom : geometry) {
-    const Resource::Mesh *mesh = geom->getMesh();
+  // Pack every block for the frame up front so they go out in one upload
+  this->uniformBuffer.beginFrame();
 
-    GLuint shaderProgram = this->shaderManager.getShaderProgram(mesh->getShaderType());
-    glUseProgram(shaderProgram);
+  FrameBlock frameBlock = frameLights;
+  memcpy(frameBlock.projViewMtx, projViewMtx.f, sizeof(frameBlock.projViewMtx));
+  GLintptr frameOffset = this->uniformBuffer.push(frameBlock);
 
-    // /* Pull out attribute and uniform locations. */
-    GLint tex_unif = glGetUniformLocation(shaderProgram, "materialTex");
-    GLint has_tex_unif = glGetUniformLocation(shaderProgram, "hasTexture");
+  this->batches.clear();
+  this->skinOffsets.clear();
+  this->paletteOffsets.clear();
+  this->paletteCompositor.beginFrame();
 
-    GLint projViewMtxUnif = glGetUniformLocation(shaderProgram, "projViewMtx");
-    GLint worldTransformUnif = glGetUniformLocation(shaderProgram, "meshTransformMtx");
+  for (auto item = items.begin(); item != items.end();) {
+    const Resource::GeomObject *geom = item->geom;
+    const Resource::Mesh *mesh = geom->getMesh();
+    const Resource::Material *material = mesh->getMaterial();
 
-    GLint color_unif = glGetUniformLocation(shaderProgram, "materialColor");
-    GLint multipliers_unif = glGetUniformLocation(shaderProgram, "colorMultipliers");
-    GLint skinMtcesUnif = glGetUniformLocation(shaderProgram, "skinTransformMtces");
+    // Meshes still uploading are left out until they're complete. Every
+    // mesh drawn has been registered, so it has a slot.
+    assert(mesh->getRenderSlot() < this->meshRecords.size());
+    const MeshRecord& record = this->meshRecords[mesh->getRenderSlot()];
+    if (!record.isReady) {
+      item++;
+      continue;
+    }
 
-    // if (renderObject.shaderType == UNLIT) {
-    //   glUniform2fv(alphaAnimUVUnif, 1, renderObject.material.alphaAnimUV);
-    // }
+    Resource::ShaderType shaderType = mesh->getShaderType();
 
-    glUniformMatrix4fv(projViewMtxUnif, 1, GL_FALSE, projViewMtx.f);
+    // Sorting leaves repeated placements of a mesh next to each other, so a
+    // run of them becomes one instanced draw
+    auto runEnd = item + 1;
+    if (this->shaderManager.hasInstancedProgram(shaderType)) {
+      while (runEnd != items.end() && runEnd->geom->getMesh() == mesh && runEnd->geom->getLodLevel() == geom->getLodLevel() && runEnd - item < INSTANCE_BATCH_SIZE) {
+        runEnd++;
+      }
+    }
 
-    const Resource::Material *material = mesh->getMaterial();
+    DrawBatch batch { mesh, &record, static_cast<unsigned>(runEnd - item), 0, 0, 0, -1, geom->getLodLevel() };
+    if (batch.instanceCount > 1) {
+      batch.features |= INSTANCED;
+    }
 
-    float adjustedColor[3];
-    memcpy(adjustedColor, material->getColor(), 3 * sizeof(float));
+    ObjectBlock objectBlock {};
+    memcpy(objectBlock.meshTransformMtx, geom->getWorldTransform().f, sizeof(objectBlock.meshTransformMtx));
+    memcpy(objectBlock.materialColor, material->getColor(), 3 * sizeof(float));
+
+    // float colorMultipliers[2] = {1.0f, 1.0f};
+    // if (renderObject.material.flags & Model::Material::USE_VERTEX_COLOR) {
+    //   colorMultipliers[0] = 1.0f;
+    //   colorMultipliers[1] = 0.0f;
+    // }
 
     /* Ensure that fragment colors come from the right place. */
     const Resource::Texture *texture = material->getTexture();
     if (texture) {
-      GLuint sampler = this->textureSamplers.at(texture->getHandle());
+      this->requestTextureLevel(texture, geom->getScreenSize());
+    }
 
-      glUniform1i(tex_unif, sampler);
-      glUniform1i(has_tex_unif, 1);
+    if (texture && this->isTextureReady(texture)) {
+      batch.features |= TEXTURED;
 
       for (int i = 0; i < 3; i++) {
-        adjustedColor[i] *= 0.5f;
+        objectBlock.materialColor[i] *= 0.5f;
       }
-    } else {
-      glUniform1i(has_tex_unif, 0);
     }
 
-    if (material->isAlphaBlended()) {
-      glEnable(GL_BLEND);
-      // glEnable(GL_ALPHA_TEST);
-      glBlendEquation(GL_FUNC_ADD);
-      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-      // glAlphaFunc(GL_GEQUAL, (float)((renderObject.material.rawFlags >> 0x17 & 0xff) << 1) / 255.0);
-      glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_FALSE);
-      glDepthMask(GL_FALSE);
+    // Meshes whose blend indices were rewritten at load skip the per-surface
+    // remap tables
+    if (mesh->getUsesPaletteIndices() && this->shaderManager.supportsFeatures(shaderType, PALETTE_INDEXED)) {
+      batch.features |= PALETTE_INDEXED;
     }
 
-    // float colorMultipliers[2] = {1.0f, 1.0f};
-    // if (renderObject.material.flags & Model::Material::USE_VERTEX_COLOR) {
-    //   colorMultipliers[0] = 1.0f;
-    //   colorMultipliers[1] = 0.0f;
-    // }
+    batch.objectOffset = this->uniformBuffer.push(objectBlock);
 
-    /* Set per-mesh material color and transformation matrix. */
-    glUniform3fv(color_unif, 1, adjustedColor);
+    if (batch.instanceCount > 1) {
+      InstanceBlock instanceBlock;
+      for (unsigned i = 0; i < batch.instanceCount; i++) {
+        memcpy(instanceBlock.instanceTransforms[i], item[i].geom->getWorldTransform().f, 16 * sizeof(float));
+      }
 
-    if (worldTransformUnif != -1) {
-      glUniformMatrix4fv(worldTransformUnif, 1, GL_FALSE, geom->getWorldTransform().f);
+      batch.instanceOffset = this->uniformBuffer.push(instanceBlock);
     }
 
-    Resource::ResourceHandle meshHandle = mesh->getHandle();
+    this->batches.push_back(batch);
+    item = runEnd;
 
-    GLuint vertexArrayId = this->vertexArrayIds.at(meshHandle);
-    glBindVertexArray(vertexArrayId);
+    const ShaderManager::ShaderProgram& shaderProgram = this->shaderManager.getProgram(shaderType, batch.features);
+    if (!shaderProgram.hasUniformBlock(UniformBlock::PALETTE)) {
+      continue;
+    }
 
-    std::vector<Math::Matrix> skinTransforms = geom->getSkinTransforms();
+    // Each palette goes up once per frame, however many meshes share it
+    const Resource::SkinPalette *palette = geom->getSkinPalette();
+    if (!palette) {
+      throw std::runtime_error("skinned geometry without a palette");
+    }
 
-    const std::vector<Resource::Surface *>& surfaces = mesh->getSurfaces();
-    for (auto surface : surfaces) {
-      if (skinMtcesUnif != -1) {
-        const std::vector<ushort>& indices = surface->getSkinTransformIndices();
-        unsigned count = surface->getSkinTransformCount();
-
-        assert(count <= 16);
-
-        float floats[256];
-        float *floatPtr = floats;
-        for (int i = 0; i < count; i++, floatPtr += 16) {
-          if (State::printNextFrame && surface->getIndexBuffer()->getCount() == 30) {
-            DEBUG("index at %d is %d", i, indices.at(i));
-            DEBUG("base 0x%lx, 0x%lx", (unsigned long)floats, (unsigned long)floatPtr);
-          }
-
-          const float *transform = skinTransforms.at(indices.at(i)).f;
-          memcpy(floatPtr, transform, 16 * sizeof(float));
+    const Resource::ResourceHandle& paletteHandle = palette->getHandle();
+    if (!this->paletteOffsets.contains(paletteHandle) && palette->getIsLocalPose()) {
+      GLintptr paletteOffset = this->uniformBuffer.reserve(sizeof(PaletteBlock), this->paletteCompositor.getAlignment());
+
+      this->paletteCompositor.addPalette(*palette, paletteOffset);
+      this->paletteOffsets[paletteHandle] = paletteOffset;
+    } else if (!this->paletteOffsets.contains(paletteHandle)) {
+      const std::vector<Math::Affine>& transforms = palette->getTransforms();
+      if (transforms.size() > MAX_PALETTE_SIZE) {
+        throw std::runtime_error("skin palette too large");
+      }
+
+      PaletteBlock paletteBlock;
+      for (size_t i = 0; i < transforms.size(); i++) {
+        memcpy(paletteBlock.skinPalette[i], transforms[i].f, 12 * sizeof(float));
+      }
+
+      this->paletteOffsets[paletteHandle] = this->uniformBuffer.push(paletteBlock);
+    }
+
+    this->batches.back().paletteOffset = this->paletteOffsets.at(paletteHandle);
+
+    if (batch.features & PALETTE_INDEXED) {
+      continue;
+    }
+
+    for (auto surface : mesh->getSurfaces()) {
+      const std::vector<ushort>& indices = surface->getSkinTransformIndices();
+      unsigned count = surface->getSkinTransformCount();
+
+      assert(count <= 16);
+
+      SkinBlock skinBlock {};
+      for (unsigned i = 0; i < count; i++) {
+        if (State::printNextFrame && surface->getIndexBuffer()->getCount() == 30) {
+          TRACE("index at %u is %d", i, indices.at(i));
         }
 
-        glUniformMatrix4fv(skinMtcesUnif, count, GL_TRUE, floats);
+        skinBlock.skinIndices[i / 4][i % 4] = indices.at(i);
       }
 
-      Resource::ResourceHandle surfaceHandle = surface->getHandle();
+      this->skinOffsets.push_back(this->uniformBuffer.push(skinBlock));
+    }
+  }
+
+  this->streamTextureLevels();
+
+  // Depth-only draws only read their transforms
+  std::span<const FramePacket::PrepassDraw> prepass = packet.getPrepass();
+
+  this->prepassOffsets.clear();
+  for (const FramePacket::PrepassDraw& draw : prepass) {
+    ObjectBlock objectBlock {};
+    memcpy(objectBlock.meshTransformMtx, draw.geom->getWorldTransform().f, sizeof(objectBlock.meshTransformMtx));
+
+    this->prepassOffsets.push_back(this->uniformBuffer.push(objectBlock));
+  }
+
+  this->uniformBuffer.upload();
+  this->frameStats.bytesUploaded += this->uniformBuffer.getSize();
+
+  this->gpuTimer.beginPass(GPUTimer::Pass::PALETTES);
+  this->paletteCompositor.dispatch(this->uniformBuffer.getBuffer());
+  this->uniformBuffer.bind(UniformBlock::FRAME, frameOffset, sizeof(FrameBlock));
+
+  // Draws arrive sorted by state, so only changes are sent to GL
+  const ShaderManager::ShaderProgram *currentProgram = nullptr;
+  GLuint currentVertexArray = 0;
+  GLuint currentVertexBuffer = 0;
+  GLuint currentElementBuffer = 0;
+  bool blendEnabled = false;
+
+  // Static geometry goes down front-to-back with color writes off, so the
+  // color pass below shades only the fragments that end up visible
+  if (!prepass.empty()) {
+    this->gpuTimer.beginPass(GPUTimer::Pass::DEPTH_PREPASS);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
-      GLuint elementBufferId = this->elementBufferIds.at(surfaceHandle);
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBufferId);
+    for (size_t i = 0; i < prepass.size(); i++) {
+      const Resource::Mesh *mesh = prepass[i].geom->getMesh();
+      Resource::ShaderType shaderType = mesh->getShaderType();
 
-      GLenum glPrimitiveType = getGLPrimitiveType(surface->getPrimitiveType());
-      glDrawElements(glPrimitiveType, surface->getIndexBuffer()->getCount(), GL_UNSIGNED_SHORT, 0);
+      const MeshRecord& record = this->meshRecords[mesh->getRenderSlot()];
+      if (!record.isReady || !this->shaderManager.supportsFeatures(shaderType, DEPTH_ONLY)) {
+        continue;
+      }
+
+      const ShaderManager::ShaderProgram& shaderProgram = this->shaderManager.getProgram(shaderType, DEPTH_ONLY);
+      if (&shaderProgram != currentProgram) {
+        glUseProgram(shaderProgram.getShaderProgram());
+        currentProgram = &shaderProgram;
+        this->frameStats.stateChanges++;
+      }
+
+      this->uniformBuffer.bind(UniformBlock::OBJECT, this->prepassOffsets[i], sizeof(ObjectBlock));
+
+      if (record.vertexArray != currentVertexArray) {
+        glBindVertexArray(record.vertexArray);
+        currentVertexArray = record.vertexArray;
+        currentVertexBuffer = 0;
+        currentElementBuffer = 0;
+        this->frameStats.stateChanges++;
+      }
+
+      if (record.vertexBuffer != currentVertexBuffer) {
+        glBindVertexBuffer(0, record.vertexBuffer, 0, record.vertexStride);
+        currentVertexBuffer = record.vertexBuffer;
+        this->frameStats.stateChanges++;
+      }
+
+      if (record.indices.buffer != currentElementBuffer) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, record.indices.buffer);
+        currentElementBuffer = record.indices.buffer;
+        this->frameStats.stateChanges++;
+      }
+
+      this->drawSurfaces(mesh, record, prepass[i].geom->getLodLevel());
+    }
+
+    // Pre-passed fragments come back at exactly the depth they left
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthFunc(GL_LEQUAL);
+  }
+
+  auto skinOffset = this->skinOffsets.begin();
+  GLintptr currentPalette = -1;
+
+  for (auto& batch : this->batches) {
+    const Resource::Mesh *mesh = batch.mesh;
+    bool instanced = batch.instanceCount > 1;
+
+    Resource::ShaderType shaderType = mesh->getShaderType();
+    const ShaderManager::ShaderProgram& shaderProgram = this->shaderManager.getProgram(shaderType, batch.features);
+    if (&shaderProgram != currentProgram) {
+      glUseProgram(shaderProgram.getShaderProgram());
+      currentProgram = &shaderProgram;
+      this->frameStats.stateChanges++;
     }
 
+    const Resource::Material *material = mesh->getMaterial();
+    bool isSkinned = shaderProgram.hasUniformBlock(UniformBlock::PALETTE);
+
     if (material->isAlphaBlended()) {
-      glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-      glDepthMask(GL_TRUE);
-      glDisable(GL_BLEND);
-      // glDisable(GL_ALPHA_TEST);
+      this->gpuTimer.beginPass(GPUTimer::Pass::ALPHA);
+    } else {
+      this->gpuTimer.beginPass(isSkinned ? GPUTimer::Pass::OPAQUE_SKINNED : GPUTimer::Pass::OPAQUE_STATIC);
     }
+
+    this->uniformBuffer.bind(UniformBlock::OBJECT, batch.objectOffset, sizeof(ObjectBlock));
+    if (instanced) {
+      this->uniformBuffer.bind(UniformBlock::INSTANCE, batch.instanceOffset, sizeof(InstanceBlock));
+    }
+
+    // if (renderObject.shaderType == UNLIT) {
+    //   glUniform2fv(alphaAnimUVUnif, 1, renderObject.material.alphaAnimUV);
+    // }
+
+    // Uniform values live in the program, so the last sampler set on each
+    // program is remembered across frames
+    if (batch.features & TEXTURED) {
+      const Resource::Texture *texture = material->getTexture();
+      GLint sampler = this->textureUnits.bind(this->textureNames[texture->getRenderSlot()]);
+
+      GLint& programSampler = this->programSamplers[ShaderManager::getVariantIndex(shaderType, batch.features)];
+      if (programSampler != sampler) {
+        glUniform1i(shaderProgram.getUniformLocation(Uniform::MATERIAL_TEX), sampler);
+        programSampler = sampler;
+        this->frameStats.stateChanges++;
+      }
+    }
+
+    if (material->isAlphaBlended() != blendEnabled) {
+      blendEnabled = material->isAlphaBlended();
+      this->frameStats.stateChanges++;
+
+      if (blendEnabled) {
+        glEnable(GL_BLEND);
+        // glEnable(GL_ALPHA_TEST);
+        glBlendEquation(GL_FUNC_ADD);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        // glAlphaFunc(GL_GEQUAL, (float)((renderObject.material.rawFlags >> 0x17 & 0xff) << 1) / 255.0);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+      } else {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+        // glDisable(GL_ALPHA_TEST);
+      }
+    }
+
+    const MeshRecord& record = *batch.record;
+
+    // The element and vertex buffer bindings belong to the vertex array
+    if (record.vertexArray != currentVertexArray) {
+      glBindVertexArray(record.vertexArray);
+      currentVertexArray = record.vertexArray;
+      currentVertexBuffer = 0;
+      currentElementBuffer = 0;
+      this->frameStats.stateChanges++;
+    }
+
+    if (record.vertexBuffer != currentVertexBuffer) {
+      glBindVertexBuffer(0, record.vertexBuffer, 0, record.vertexStride);
+      currentVertexBuffer = record.vertexBuffer;
+      this->frameStats.stateChanges++;
+    }
+
+    if (record.indices.buffer != currentElementBuffer) {
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, record.indices.buffer);
+      currentElementBuffer = record.indices.buffer;
+      this->frameStats.stateChanges++;
+    }
+
+    const std::vector<Resource::Surface *>& surfaces = mesh->getSurfaces();
+
+    if (isSkinned) {
+      if (batch.paletteOffset != currentPalette) {
+        this->uniformBuffer.bind(UniformBlock::PALETTE, batch.paletteOffset, sizeof(PaletteBlock));
+        currentPalette = batch.paletteOffset;
+      }
+
+      if (batch.features & PALETTE_INDEXED) {
+        this->drawSurfaces(mesh, record, batch.lodLevel);
+        continue;
+      }
+
+      for (auto surface : surfaces) {
+        const SurfaceRecord& surfaceRecord = this->surfaceRecords[surface->getRenderSlot()];
+        GLsizei count = surfaceRecord.counts[batch.lodLevel];
+
+        this->uniformBuffer.bind(UniformBlock::SKIN, *skinOffset++, sizeof(SkinBlock));
+        glDrawElementsBaseVertex(surfaceRecord.primitiveType, count, GL_UNSIGNED_SHORT, (GLvoid *)surfaceRecord.firstIndices[batch.lodLevel], record.baseVertex);
+
+        this->frameStats.drawCalls++;
+        this->frameStats.triangles += countTriangles(surfaceRecord.primitiveType, count);
+      }
+    } else if (instanced) {
+      for (auto surface : surfaces) {
+        const SurfaceRecord& surfaceRecord = this->surfaceRecords[surface->getRenderSlot()];
+        GLsizei count = surfaceRecord.counts[batch.lodLevel];
+
+        glDrawElementsInstancedBaseVertex(surfaceRecord.primitiveType, count, GL_UNSIGNED_SHORT, (GLvoid *)surfaceRecord.firstIndices[batch.lodLevel], batch.instanceCount, record.baseVertex);
+
+        this->frameStats.drawCalls++;
+        this->frameStats.triangles += countTriangles(surfaceRecord.primitiveType, count) * batch.instanceCount;
+      }
+    } else {
+      this->drawSurfaces(mesh, record, batch.lodLevel);
+    }
+  }
+
+  // Leave the default state for whatever draws next frame
+  if (blendEnabled) {
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
   }
 
+  if (!prepass.empty()) {
+    glDepthFunc(GL_LESS);
+  }
+
+  if (this->isOffscreen) {
+    this->renderTarget.present(this->windowWidth, this->windowHeight);
+  }
+
+  this->endFrame();
+
+  PROFILE_ZONE("swap");
+  State::getDisplayManager().applySwapInterval();
   SDL_GL_SwapWindow(State::getDisplayManager().getWindow());
 }
@@ -18,12 +18,28 @@
 #define MORTAR_RENDER_GL_RENDERER_H
 
 #include <SDL2/SDL.h>
-#include <list>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
 #include <tsl/sparse_map.h>
 
 #include "../../math/matrix.hpp"
+#include "../../resource/handlemap.hpp"
 #include "../renderer.hpp"
+#include "../renderqueue.hpp"
+#include "../resolution.hpp"
+#include "bufferarena.hpp"
+#include "gputimer.hpp"
+#include "palettecompositor.hpp"
+#include "rendertarget.hpp"
 #include "shader.hpp"
+#include "slottable.hpp"
+#include "textureunits.hpp"
+#include "uniformbuffer.hpp"
+#include "uploadqueue.hpp"
 
 namespace Mortar::Render::GL {
   class Renderer : public Mortar::Render::Renderer {
@@ -34,21 +50,303 @@ namespace Mortar::Render::GL {
       void initialize() override;
       void shutDown() override;
 
+      void acquireContext() override;
+      void releaseContext() override;
+
       void registerMeshes(const std::vector<const Resource::Mesh *>& meshes) override;
       void registerTextures(const std::vector<const Resource::Texture *>& textures) override;
       void registerVertexBuffers(const std::vector<const Resource::VertexBuffer *>& vertexBuffers) override;
 
-      void renderGeometry(const std::list<const Resource::GeomObject *>& geometry) override;
+      void unregisterResources(const std::vector<Resource::ResourceHandle>& handles) override;
+
+      bool isMeshReady(const Resource::ResourceHandle& mesh) const override;
+
+      bool composesSkinPalettes() const override;
+
+      void renderGeometry(const FramePacket& packet) override;
+
+      RenderStats getRenderStats() const override;
+
+      // Safe to call from any thread; taken up at the start of the next
+      // frame
+      void setResolution(const ResolutionController::Settings& settings);
+      ResolutionController::Settings getResolution() const;
+
+      // Texture levels beyond the few smallest are uploaded as draws need
+      // them, and the least recently needed are dropped to stay within this
+      // many bytes. Safe to call from any thread.
+      static constexpr uint64_t DEFAULT_TEXTURE_BUDGET = 256 * 1024 * 1024;
+      void setTextureBudget(uint64_t budget);
+      uint64_t getTextureBudget() const;
+
+      // Composes skin palettes in a compute shader where GL 4.3 allows,
+      // instead of on the CPU. Takes effect at initialize().
+      void setGPUPalettes(bool enabled);
 
     private:
       ShaderManager shaderManager;
       bool isInitialized;
 
-      tsl::sparse_map<Resource::ResourceHandle, GLuint> elementBufferIds;
-      tsl::sparse_map<Resource::ResourceHandle, GLuint> textureIds;
-      tsl::sparse_map<Resource::ResourceHandle, GLuint> textureSamplers;
-      tsl::sparse_map<Resource::ResourceHandle, GLuint> vertexArrayIds;
-      tsl::sparse_map<Resource::ResourceHandle, GLuint> vertexBufferIds;
+      SDL_GLContext context = nullptr;
+
+      // Where a vertex buffer's data was placed for one stride; a buffer read
+      // with two layouts of different strides is uploaded once for each
+      struct VertexAllocation {
+        unsigned stride;
+        BufferArena::Allocation allocation;
+      };
+
+      // All of a mesh's index data is one allocation, so a mesh binds a
+      // single element buffer. A mesh is drawn once its indices and its
+      // vertex buffer have been uploaded; its packed indices are kept until
+      // then. Its texture isn't waited on, see textureReady.
+      struct MeshRecord {
+        GLuint vertexArray;
+        GLint baseVertex;
+
+        // Bound apart from the vertex array where formats are separate, and
+        // zero otherwise
+        GLuint vertexBuffer = 0;
+        GLsizei vertexStride = 0;
+
+        BufferArena::Allocation indices;
+        std::vector<Resource::ResourceHandle> surfaces;
+
+        bool isReady = false;
+        std::vector<GLushort> pendingIndices;
+      };
+
+      // Levels a surface has no index set for repeat its coarsest one
+      struct SurfaceRecord {
+        GLenum primitiveType;
+        GLsizei counts[Resource::Mesh::MAX_LODS];
+        GLintptr firstIndices[Resource::Mesh::MAX_LODS];
+      };
+
+      // A layout's attributes resolved to GL once. Every program binds the
+      // same attribute locations, so one table serves all of them.
+      struct VertexBinding {
+        GLuint location;
+        GLint size;
+        GLenum type;
+        GLboolean normalized;
+        GLintptr offset;
+      };
+
+      struct VertexBindings {
+        std::array<VertexBinding, Resource::VertexLayout::MAX_PROPERTIES> bindings;
+        size_t count;
+      };
+
+      struct VertexArrayKey {
+        GLuint buffer;
+        const Resource::VertexLayout *vertexLayout;
+
+        bool operator==(const VertexArrayKey& other) const = default;
+      };
+
+      struct VertexArrayKeyHash {
+        size_t operator()(const VertexArrayKey& key) const noexcept;
+      };
+
+      const VertexAllocation& uploadVertexBuffer(const Resource::VertexBuffer *vertexBuffer, unsigned stride);
+      const VertexBindings& getVertexBindings(const Resource::VertexLayout& vertexLayout);
+      GLuint getVertexArray(GLuint buffer, const Resource::VertexLayout& vertexLayout);
+
+      // Index data, and vertex data keyed by stride so that every vertex
+      // lands on a whole-vertex offset and can be addressed by base vertex
+      BufferArena indexArena;
+      tsl::sparse_map<unsigned, BufferArena> vertexArenas;
+
+      // Everything made for a registered resource is kept in arrays indexed
+      // by its render slot, so draws never hash a handle
+      SlotTable vertexBufferSlots;
+      SlotTable meshSlots;
+      SlotTable surfaceSlots;
+      SlotTable textureSlots;
+
+      std::vector<MeshRecord> meshRecords;
+      std::vector<SurfaceRecord> surfaceRecords;
+
+      // Vertex arrays are shared by every mesh with the same buffer and
+      // layout, keyed by both; layouts are static, so by address. Attribute
+      // locations are the same in every program, so programs share them too.
+      // From GL 4.3 the buffer is bound apart from the attribute formats, and
+      // a layout's one vertex array serves every buffer.
+      bool separateVertexFormats = false;
+      tsl::sparse_map<const Resource::VertexLayout *, VertexBindings> vertexBindings;
+      tsl::sparse_map<VertexArrayKey, GLuint, VertexArrayKeyHash> vertexArrays;
+      std::vector<GLuint> vertexArrayNames;
+
+      // Resources with the same content hash share what's made for them on
+      // the GPU, under a key for that content. It's uploaded from the first
+      // of them registered; if that one goes while its copies are still
+      // queued, they're queued again from the next, so no copy reads freed
+      // data. Resources without a hash get a key of their own.
+      template <typename T>
+      struct ContentUser {
+        Resource::ResourceHandle handle;
+        const T *resource;
+      };
+
+      uint64_t nextUniqueKey = 1;
+      uint64_t getContentKey(uint64_t contentHash);
+
+      struct SharedVertexData {
+        std::vector<VertexAllocation> allocations;
+        std::vector<ContentUser<Resource::VertexBuffer>> users;
+      };
+
+      struct SharedTexture {
+        GLuint name;
+
+        // As the allocated levels' data sizes, which is what the driver
+        // allocates for compressed formats and close to it otherwise
+        uint64_t size;
+
+        std::vector<ContentUser<Resource::Texture>> users;
+
+        // Levels from pinnedLevel down always have storage. Draws sample
+        // from baseLevel; allocatedLevel is the finest level with storage,
+        // and is only finer than baseLevel while it uploads.
+        unsigned levelCount;
+        unsigned pinnedLevel;
+        unsigned baseLevel;
+        unsigned allocatedLevel;
+
+        // The finest level asked for by this frame's draws, and the last
+        // frame that sampled baseLevel at full detail
+        unsigned wantedLevel;
+        uint64_t wantedFrame;
+        uint64_t neededFrame;
+      };
+
+      tsl::sparse_map<uint64_t, SharedVertexData> sharedVertexData;
+      tsl::sparse_map<uint64_t, SharedTexture> sharedTextures;
+
+      // Zero in free slots
+      std::vector<uint64_t> vertexBufferKeys;
+      std::vector<uint64_t> textureKeys;
+
+      void releaseVertexBuffer(uint32_t slot, const Resource::ResourceHandle& handle);
+      SharedTexture createTexture(const Resource::Texture *texture);
+      void queueTextureUpload(const Resource::Texture *texture, const SharedTexture& shared);
+      void releaseTexture(uint32_t slot, const Resource::ResourceHandle& handle, std::vector<GLuint>& released);
+
+      // The shared texture's name, or zero, by slot
+      std::vector<GLuint> textureNames;
+
+      // Set once a texture's levels have all been uploaded. Until then, and
+      // for textures that aren't registered yet, draws using it are colored
+      // by their material alone. Uploads go out in the order they're queued,
+      // so textures registered with their meshes are ready before them.
+      std::vector<uint8_t> textureReady;
+      std::vector<Resource::ResourceHandle> pendingTextures;
+
+      bool isTextureReady(const Resource::Texture *texture) const;
+
+      uint64_t textureMemory = 0;
+      TextureUnitCache textureUnits;
+
+      // Counts frames drawn, for telling when textures were last needed
+      uint64_t frameNumber = 0;
+
+      std::atomic<uint64_t> textureBudget = DEFAULT_TEXTURE_BUDGET;
+
+      // Keys of the textures draws asked for this frame, and of those with
+      // a level uploading
+      std::vector<uint64_t> requestedTextures;
+      std::vector<uint64_t> streamingTextures;
+
+      // Notes the level a draw of the given size would sample
+      void requestTextureLevel(const Resource::Texture *texture, float screenSize);
+
+      // Queues the next finer level of the textures asked for beyond what
+      // they hold, evicting others' top levels to make room
+      void streamTextureLevels();
+      bool evictTextureLevel(uint64_t exceptKey);
+
+      // Storage is allocated as resources are registered, and filled over
+      // the following frames
+      UploadQueue uploadQueue;
+
+      // Meshes still waiting on uploads, and the resources they wait on. Only
+      // handles are kept, as a mesh may be freed before it's ever drawn.
+      struct PendingMesh {
+        Resource::ResourceHandle mesh;
+        uint32_t meshSlot;
+        uint64_t vertexKey;
+      };
+
+      std::vector<PendingMesh> pendingMeshes;
+
+      // Marks the meshes and textures whose uploads have finished
+      void updatePendingUploads();
+
+      // One draw call per surface; consecutive placements of the same
+      // unskinned mesh share a batch and are drawn instanced
+      struct DrawBatch {
+        const Resource::Mesh *mesh;
+        const MeshRecord *record;
+        unsigned instanceCount;
+        // ShaderFeature bits of the program variant drawn with
+        uint32_t features;
+        GLintptr objectOffset;
+        GLintptr instanceOffset;
+        GLintptr paletteOffset;
+        // Every placement in an instanced run draws at the same level
+        unsigned lodLevel;
+      };
+
+      // Per-frame uniform blocks, and each draw's offset into them
+      UniformBuffer uniformBuffer;
+      std::vector<DrawBatch> batches;
+      std::vector<GLintptr> skinOffsets;
+      std::vector<GLintptr> prepassOffsets;
+      Resource::HandleMap<GLintptr> paletteOffsets;
+
+      // Builds palettes holding local poses, when asked to and compute is
+      // available
+      PaletteCompositor paletteCompositor;
+      bool gpuPalettes = false;
+
+      // Scratch for glMultiDrawElementsBaseVertex
+      std::vector<GLsizei> drawCounts;
+      std::vector<const GLvoid *> drawIndices;
+      std::vector<GLint> drawBaseVertices;
+
+      // Draws every surface of an unskinned mesh once at the given level,
+      // its vertex array and uniforms already bound
+      void drawSurfaces(const Resource::Mesh *mesh, const MeshRecord& record, unsigned lodLevel);
+
+      // Texture unit last given to each program's materialTex sampler,
+      // indexed by shader variant
+      std::array<GLint, ShaderManager::VARIANT_COUNT> programSamplers;
+
+      // Counted over the frame being drawn, then published for other threads
+      GPUTimer gpuTimer;
+      RenderStats frameStats;
+      uint64_t frameStart;
+
+      mutable std::mutex statsMutex;
+      RenderStats stats {};
+
+      void endFrame();
+
+      // Below full resolution, frames are drawn to renderTarget and filtered
+      // up to the window as they're presented
+      RenderTarget renderTarget;
+      ResolutionController resolution;
+      bool isOffscreen = false;
+      unsigned windowWidth = 0;
+      unsigned windowHeight = 0;
+
+      mutable std::mutex resolutionMutex;
+      std::optional<ResolutionController::Settings> pendingResolution;
+
+      // Applies resolution changes and binds the framebuffer the frame is
+      // drawn to, sized for the window as it is now
+      void bindFrameTarget();
 
       const Math::Matrix d3dTransform;
   };
@@ -0,0 +1,95 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <stdexcept>
+
+#include "rendertarget.hpp"
+
+using namespace Mortar::Render::GL;
+
+void RenderTarget::initialize() {
+  glGenFramebuffers(1, &this->framebuffer);
+  glGenTextures(1, &this->colorTexture);
+  glGenRenderbuffers(1, &this->depthBuffer);
+
+  glBindTexture(GL_TEXTURE_2D, this->colorTexture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  this->width = 0;
+  this->height = 0;
+}
+
+void RenderTarget::shutDown() {
+  glDeleteFramebuffers(1, &this->framebuffer);
+  glDeleteTextures(1, &this->colorTexture);
+  glDeleteRenderbuffers(1, &this->depthBuffer);
+
+  this->framebuffer = 0;
+  this->colorTexture = 0;
+  this->depthBuffer = 0;
+}
+
+void RenderTarget::resize(unsigned width, unsigned height) {
+  if (width == this->width && height == this->height) {
+    return;
+  }
+
+  this->width = width;
+  this->height = height;
+
+  glBindTexture(GL_TEXTURE_2D, this->colorTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+  glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->colorTexture, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    throw std::runtime_error("incomplete render target");
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+unsigned RenderTarget::getWidth() const {
+  return this->width;
+}
+
+unsigned RenderTarget::getHeight() const {
+  return this->height;
+}
+
+void RenderTarget::bind() {
+  glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+  glViewport(0, 0, this->width, this->height);
+}
+
+void RenderTarget::present(unsigned windowWidth, unsigned windowHeight) {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(0, 0, windowWidth, windowHeight);
+}
@@ -0,0 +1,52 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MORTAR_RENDER_GL_RENDERTARGET_H
+#define MORTAR_RENDER_GL_RENDERTARGET_H
+
+#include <GL/gl.h>
+
+namespace Mortar::Render::GL {
+  // An offscreen color and depth target for drawing below the window's
+  // resolution, filtered up to the window when it's presented
+  class RenderTarget {
+    public:
+      void initialize();
+      void shutDown();
+
+      // Reallocates the attachments when the size changes
+      void resize(unsigned width, unsigned height);
+
+      unsigned getWidth() const;
+      unsigned getHeight() const;
+
+      // Directs draws to the target, at its full size
+      void bind();
+
+      // Stretches the color attachment over the window's framebuffer, which
+      // is left bound
+      void present(unsigned windowWidth, unsigned windowHeight);
+
+    private:
+      GLuint framebuffer = 0;
+      GLuint colorTexture = 0;
+      GLuint depthBuffer = 0;
+
+      unsigned width = 0;
+      unsigned height = 0;
+  };
+}
+
+#endif
@@ -17,25 +17,88 @@
 #define GL_GLEXT_PROTOTYPES
 
 #include <GL/gl.h>
+#include <filesystem>
+#include <fstream>
 #include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <tsl/sparse_map.h>
 #include <vector>
 
 #include "../../log.hpp"
+#include "../../resource/name.hpp"
 #include "../../resource/types/shader.hpp"
 #include "shader.hpp"
+#include "uniformbuffer.hpp"
 
 using namespace Mortar::Render::GL;
 
-#define GLSL(src) "#version 150\n" #src
-
-const char *unlitVertexSource = GLSL(
-  uniform mat4 projViewMtx;
-  uniform mat4 meshTransformMtx;
+// The version line is prepended at compile time, ahead of uniformBlocksSource
+#define GLSL(...) #__VA_ARGS__ "\n"
+
+#define MORTAR_XSTR(x) #x
+#define MORTAR_STR(x) MORTAR_XSTR(x)
+
+// Every stage sees the same std140 block declarations, mirrored by the
+// structs in uniformbuffer.hpp; blocks a stage doesn't use are inactive
+const char *uniformBlocksSource = GLSL(
+  layout(std140) uniform FrameBlock {
+    mat4 projViewMtx;
+    vec4 lightDirections[3];
+    vec4 lightColors[3];
+    vec4 ambientColor;
+  };
+
+  layout(std140) uniform ObjectBlock {
+    mat4 meshTransformMtx;
+    vec4 materialColor;
+    vec2 colorMultipliers;
+  };
+
+  layout(std140) uniform SkinBlock {
+    ivec4 skinIndices[4];
+  };
+
+  layout(std140) uniform PaletteBlock {
+    mat3x4 skinPalette[MAX_PALETTE_SIZE];
+  };
+);
 
-  uniform vec3 materialColor;
-  uniform vec2 colorMultipliers;
-  uniform vec2 alphaAnimUV;
+// Skinned vertex stages look their transforms up through here, so palette
+// indexed variants never touch SkinBlock
+const char *skinTransformSource =
+  "#ifdef PALETTE_INDEXED\n"
+  "mat3x4 getSkinTransform(int blendIndex) { return skinPalette[blendIndex]; }\n"
+  "#else\n"
+  "mat3x4 getSkinTransform(int blendIndex) { return skinPalette[skinIndices[blendIndex >> 2][blendIndex & 3]]; }\n"
+  "#endif\n";
+
+// Vertex stages get their mesh transform from here, so the same source builds
+// both the per-draw and the instanced variant of a program. Positions are
+// invariant so that depth-only variants match the depth pre-pass exactly.
+const char *meshTransformSource =
+  "invariant gl_Position;\n"
+  "#ifdef INSTANCED\n"
+  "layout(std140) uniform InstanceBlock {\n"
+  "  mat4 instanceTransforms[" MORTAR_STR(INSTANCE_BATCH_SIZE) "];\n"
+  "};\n"
+  "mat4 getMeshTransform() { return instanceTransforms[gl_InstanceID]; }\n"
+  "#else\n"
+  "mat4 getMeshTransform() { return meshTransformMtx; }\n"
+  "#endif\n";
+
+// Fragment stages pick their output with IF_TEXTURED, so untextured variants
+// never sample the material texture
+const char *materialTextureSource =
+  "#ifdef TEXTURED\n"
+  "uniform sampler2D materialTex;\n"
+  "#define IF_TEXTURED(textured, untextured) (textured)\n"
+  "#else\n"
+  "#define IF_TEXTURED(textured, untextured) (untextured)\n"
+  "#endif\n";
 
+const char *unlitVertexSource = GLSL(
   in vec3 position;
   in vec4 color;
   in vec2 texCoord;
@@ -48,18 +111,15 @@ const char *unlitVertexSource = GLSL(
     fragTexCoord = texCoord;
 
     vec3 adjustedVertColor = colorMultipliers.x * vec3(color.xyz);
-    vec3 adjustedMatColor = colorMultipliers.y * materialColor;
+    vec3 adjustedMatColor = colorMultipliers.y * materialColor.rgb;
 
     fragColor = vec4(adjustedVertColor + adjustedMatColor, color.w);
 
-    gl_Position = projViewMtx * meshTransformMtx * vec4(position, 1.0);
+    gl_Position = projViewMtx * getMeshTransform() * vec4(position, 1.0);
   }
 );
 
 const GLchar *unlitFragmentSource = GLSL(
-  uniform sampler2D materialTex;
-  uniform int hasTexture;
-
   in vec2 fragTexCoord;
   in vec4 fragColor;
 
@@ -67,21 +127,11 @@ const GLchar *unlitFragmentSource = GLSL(
 
   void main()
   {
-    vec4 texColor = texture(materialTex, fragTexCoord);
-
-    vec4 combinedColor = (texColor * fragColor);
-
-    outColor = mix(fragColor, combinedColor, hasTexture) * 2;
+    outColor = IF_TEXTURED(texture(materialTex, fragTexCoord) * fragColor, fragColor) * 2;
   }
 );
 
 const GLchar *skinVertexSource = GLSL(
-  uniform mat4 projViewMtx;
-	uniform mat4 skinTransformMtces[16];
-
-  uniform vec3 materialColor;
-  uniform vec2 colorMultipliers;
-
   in vec3 position;
 	in vec2 blendWeights;
 	in vec3 blendIndices;
@@ -101,22 +151,22 @@ const GLchar *skinVertexSource = GLSL(
     float weight2 = 1 - blendWeights.x - blendWeights.y;
 
     vec4 normal4 = vec4(normal, 0.0f);
-    vec3 normalBlend0 = (normal4 * skinTransformMtces[intBlendIndices.x] * blendWeights.x).xyz;
-    vec3 normalBlend1 = (normal4 * skinTransformMtces[intBlendIndices.y] * blendWeights.y).xyz;
-    vec3 normalBlend2 = (normal4 * skinTransformMtces[intBlendIndices.z] * weight2).xyz;
+    vec3 normalBlend0 = (normal4 * getSkinTransform(intBlendIndices.x) * blendWeights.x).xyz;
+    vec3 normalBlend1 = (normal4 * getSkinTransform(intBlendIndices.y) * blendWeights.y).xyz;
+    vec3 normalBlend2 = (normal4 * getSkinTransform(intBlendIndices.z) * weight2).xyz;
 
     vec3 transformedNormal = normalBlend0 + normalBlend1 + normalBlend2;
 
-    vec3 light0Color = max(dot(normalize(vec3(1.0, 0.0, 0.0)), transformedNormal), 0) * vec3(1.0, 1.0, 1.0);
-    vec3 light1Color = max(dot(normalize(vec3(0.0, 1.0, 0.0)), transformedNormal), 0) * vec3(1.0, 1.0, 1.0);
-    vec3 light2Color = max(dot(normalize(vec3(0.0, 0.0, -1.0)), transformedNormal), 0) * vec3(1.0, 1.0, 1.0);
+    vec3 light0Color = max(dot(lightDirections[0].xyz, transformedNormal), 0) * lightColors[0].rgb;
+    vec3 light1Color = max(dot(lightDirections[1].xyz, transformedNormal), 0) * lightColors[1].rgb;
+    vec3 light2Color = max(dot(lightDirections[2].xyz, transformedNormal), 0) * lightColors[2].rgb;
 
-    fragColor = vec4(materialColor * (light0Color, light1Color, light2Color + vec3(0.4, 0.4, 0.4)), color.w);
+    fragColor = vec4(materialColor.rgb * (light0Color, light1Color, light2Color + ambientColor.rgb), color.w);
 
     vec4 position4 = vec4(position, 1.0f);
-    vec3 positionBlend0 = (position4 * skinTransformMtces[intBlendIndices.x] * blendWeights.x).xyz;
-    vec3 positionBlend1 = (position4 * skinTransformMtces[intBlendIndices.y] * blendWeights.y).xyz;
-    vec3 positionBlend2 = (position4 * skinTransformMtces[intBlendIndices.z] * weight2).xyz;
+    vec3 positionBlend0 = (position4 * getSkinTransform(intBlendIndices.x) * blendWeights.x).xyz;
+    vec3 positionBlend1 = (position4 * getSkinTransform(intBlendIndices.y) * blendWeights.y).xyz;
+    vec3 positionBlend2 = (position4 * getSkinTransform(intBlendIndices.z) * weight2).xyz;
 
     vec3 transformedPosition = positionBlend0 + positionBlend1 + positionBlend2;
 
@@ -125,9 +175,6 @@ const GLchar *skinVertexSource = GLSL(
 );
 
 const GLchar *skinFragmentSource = GLSL(
-  uniform sampler2D materialTex;
-  uniform int hasTexture;
-
   in vec4 fragColor;
   in vec2 fragTexCoord;
 
@@ -135,22 +182,11 @@ const GLchar *skinFragmentSource = GLSL(
 
   void main()
   {
-    vec4 texColor = texture(materialTex, fragTexCoord);
-
-    vec4 combinedTexColor = texColor * fragColor * 2;
-    vec4 scaledFragColor = vec4(fragColor.xyz, fragColor.w * 2);
-
-    outColor = mix(scaledFragColor, combinedTexColor, hasTexture);
+    outColor = IF_TEXTURED(texture(materialTex, fragTexCoord) * fragColor * 2, vec4(fragColor.xyz, fragColor.w * 2));
   }
 );
 
 const GLchar *basicVertexSource = GLSL(
-  uniform mat4 projViewMtx;
-  uniform mat4 meshTransformMtx;
-
-  uniform vec3 materialColor;
-  uniform vec2 colorMultipliers;
-
   in vec3 position;
   in vec3 normal;
   in vec4 color;
@@ -163,22 +199,19 @@ const GLchar *basicVertexSource = GLSL(
   {
     fragTexCoord = texCoord;
 
-    vec3 transformedNormal = (meshTransformMtx * vec4(normal, 0.0)).xyz;
+    vec3 transformedNormal = (getMeshTransform() * vec4(normal, 0.0)).xyz;
 
-    vec3 light0Color = max(dot(normalize(vec3(1.0, 0.0, 0.0)), transformedNormal), 0) * vec3(1.0, 1.0, 1.0);
-    vec3 light1Color = max(dot(normalize(vec3(0.0, 1.0, 0.0)), transformedNormal), 0) * vec3(1.0, 1.0, 1.0);
-    vec3 light2Color = max(dot(normalize(vec3(0.0, 0.0, -1.0)), transformedNormal), 0) * vec3(1.0, 1.0, 1.0);
+    vec3 light0Color = max(dot(lightDirections[0].xyz, transformedNormal), 0) * lightColors[0].rgb;
+    vec3 light1Color = max(dot(lightDirections[1].xyz, transformedNormal), 0) * lightColors[1].rgb;
+    vec3 light2Color = max(dot(lightDirections[2].xyz, transformedNormal), 0) * lightColors[2].rgb;
 
-    fragColor = vec4(materialColor * (light0Color, light1Color, light2Color + vec3(0.4, 0.4, 0.4)), color.w);
+    fragColor = vec4(materialColor.rgb * (light0Color, light1Color, light2Color + ambientColor.rgb), color.w);
 
-    gl_Position = projViewMtx * meshTransformMtx * vec4(position, 1.0);
+    gl_Position = projViewMtx * getMeshTransform() * vec4(position, 1.0);
   }
 );
 
 const GLchar *basicFragmentSource = GLSL(
-  uniform sampler2D materialTex;
-  uniform int hasTexture;
-
   in vec4 fragColor;
   in vec2 fragTexCoord;
 
@@ -186,12 +219,14 @@ const GLchar *basicFragmentSource = GLSL(
 
   void main()
   {
-    vec4 texColor = texture(materialTex, fragTexCoord);
-
-    vec4 combinedTexColor = texColor * fragColor * 2;
-    vec4 scaledFragColor = vec4(fragColor.xyz, fragColor.w * 2);
+    outColor = IF_TEXTURED(texture(materialTex, fragTexCoord) * fragColor * 2, vec4(fragColor.xyz, fragColor.w * 2));
+  }
+);
 
-    outColor = mix(scaledFragColor, combinedTexColor, hasTexture);
+// Replaces the fragment stage of DEPTH_ONLY variants
+const GLchar *depthOnlyFragmentSource = GLSL(
+  void main()
+  {
   }
 );
 
@@ -201,6 +236,62 @@ const GLchar *shaderSources[Mortar::Resource::getShaderCount()][2] = {
   { basicVertexSource, basicFragmentSource },
 };
 
+// The ShaderFeature bits each shader type can be built with; programs that
+// skin can't be instanced
+const uint32_t supportedFeatures[Mortar::Resource::getShaderCount()] = {
+  INSTANCED | TEXTURED | DEPTH_ONLY,
+  TEXTURED | PALETTE_INDEXED,
+  INSTANCED | TEXTURED | DEPTH_ONLY,
+};
+
+// Indexed by ShaderFeature bit
+const char *featureNames[] = {
+  "INSTANCED",
+  "TEXTURED",
+  "DEPTH_ONLY",
+  "PALETTE_INDEXED",
+};
+
+// Linked programs are kept here between runs, named by their cache key
+const std::filesystem::path programCachePath { "cache/shaders" };
+
+// Bound before linking so every program, instanced or not, agrees on the
+// attribute locations baked into a mesh's vertex array
+const char *attribNames[] = {
+  "position",
+  "color",
+  "texCoord",
+  "normal",
+  "blendWeights",
+  "blendIndices",
+};
+
+// Indexed by Uniform
+const char *uniformNames[static_cast<size_t>(Uniform::UNIFORM_COUNT)] = {
+  "materialTex",
+};
+
+// Indexed by UniformBlock
+const char *uniformBlockNames[static_cast<size_t>(UniformBlock::BLOCK_COUNT)] = {
+  "FrameBlock",
+  "ObjectBlock",
+  "SkinBlock",
+  "InstanceBlock",
+  "PaletteBlock",
+};
+
+// Arrays are reported by their first element, e.g. "skinTransformMtces[0]"
+static std::string stripArraySuffix(const char *name) {
+  std::string str { name };
+
+  size_t bracket = str.find('[');
+  if (bracket != std::string::npos) {
+    str.resize(bracket);
+  }
+
+  return str;
+}
+
 int checkCompileStatus(GLuint shader) {
   int success;
   glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
@@ -231,26 +322,79 @@ void ShaderManager::ShaderProgram::shutDown() {
   }
 }
 
-void ShaderManager::ShaderProgram::initialize(const GLchar *vertexShaderSrc, const GLchar *fragmentShaderSrc) {
+void ShaderManager::ShaderProgram::initialize(const GLchar *vertexShaderSrc, const GLchar *fragmentShaderSrc, uint32_t features, bool useCache) {
+  std::string header = "#version 150\n#define MAX_PALETTE_SIZE " MORTAR_STR(MAX_PALETTE_SIZE) "\n";
+  for (size_t i = 0; i < sizeof(featureNames) / sizeof(*featureNames); i++) {
+    if (features & (1 << i)) {
+      header += "#define ";
+      header += featureNames[i];
+      header += "\n";
+    }
+  }
+
+  const GLchar *vertexSources[] = { header.c_str(), uniformBlocksSource, meshTransformSource, skinTransformSource, vertexShaderSrc };
+  const GLchar *fragmentSources[] = { header.c_str(), uniformBlocksSource, materialTextureSource, (features & DEPTH_ONLY) ? depthOnlyFragmentSource : fragmentShaderSrc };
+
+  // A binary is only good for the driver that built it, so the driver's
+  // identity is part of the key along with the sources
+  uint64_t key = 0;
+  if (useCache) {
+    std::string identity;
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+      identity += (const char *)glGetString(name);
+      identity += '\n';
+    }
+
+    for (auto source : vertexSources) {
+      identity += source;
+    }
+
+    for (auto source : fragmentSources) {
+      identity += source;
+    }
+
+    key = Resource::hashName(identity);
+  }
+
+  if (!useCache || !this->loadBinary(key)) {
+    this->compile(vertexSources, std::size(vertexSources), fragmentSources, std::size(fragmentSources), useCache);
+
+    if (useCache) {
+      this->saveBinary(key);
+    }
+  }
+
+  this->reflect();
+}
+
+void ShaderManager::ShaderProgram::compile(const GLchar * const *vertexSources, size_t vertexCount, const GLchar * const *fragmentSources, size_t fragmentCount, bool retrievable) {
   /* Compile and link shaders. */
   this->vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(this->vertexShader, 1, &vertexShaderSrc, NULL);
+  glShaderSource(this->vertexShader, vertexCount, vertexSources, NULL);
   glCompileShader(this->vertexShader);
   if (checkCompileStatus(this->vertexShader) == -1) {
     throw std::runtime_error("failed to compile vertex shader");
   }
 
   this->fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(this->fragmentShader, 1, &fragmentShaderSrc, NULL);
+  glShaderSource(this->fragmentShader, fragmentCount, fragmentSources, NULL);
   glCompileShader(this->fragmentShader);
   if (checkCompileStatus(this->fragmentShader) == -1) {
-    throw std::runtime_error("failed to compile vertex shader");
+    throw std::runtime_error("failed to compile fragment shader");
   }
 
   this->program = glCreateProgram();
   glAttachShader(this->program, vertexShader);
   glAttachShader(this->program, fragmentShader);
   glBindFragDataLocation(this->program, 0, "outColor");
+  for (GLuint i = 0; i < sizeof(attribNames) / sizeof(*attribNames); i++) {
+    glBindAttribLocation(this->program, i, attribNames[i]);
+  }
+
+  if (retrievable) {
+    glProgramParameteri(this->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+
   glLinkProgram(this->program);
 
   int success;
@@ -258,42 +402,216 @@ void ShaderManager::ShaderProgram::initialize(const GLchar *vertexShaderSrc, con
   if (!success) {
     char infoLog[512];
     glGetProgramInfoLog(this->program, 512, NULL, infoLog);
+    DEBUG("failed to link shaders: %s", infoLog);
     throw std::runtime_error("failed to link shaders");
   }
 
   DEBUG("created program %d, successful link: %d", this->program, success);
 }
 
-GLuint ShaderManager::ShaderProgram::getShaderProgram() {
+// A cached binary is its format followed by the driver's bytes
+bool ShaderManager::ShaderProgram::loadBinary(uint64_t key) {
+  char name[24];
+  snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+
+  std::ifstream in (std::filesystem::path(programCachePath).append(name), std::ios::binary);
+  if (!in) {
+    return false;
+  }
+
+  GLenum format;
+  std::vector<char> binary { std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+  if (binary.size() <= sizeof(format)) {
+    return false;
+  }
+
+  memcpy(&format, binary.data(), sizeof(format));
+
+  this->program = glCreateProgram();
+  glProgramBinary(this->program, format, binary.data() + sizeof(format), binary.size() - sizeof(format));
+
+  // Drivers may refuse binaries from before an update; those are rebuilt
+  int success;
+  glGetProgramiv(this->program, GL_LINK_STATUS, &success);
+  if (!success) {
+    DEBUG("discarding stale program binary %s", name);
+    glDeleteProgram(this->program);
+    this->program = -1;
+    return false;
+  }
+
+  DEBUG("loaded program %d from binary %s", this->program, name);
+  return true;
+}
+
+// Failures are only logged, as the cache is never required
+void ShaderManager::ShaderProgram::saveBinary(uint64_t key) {
+  GLint length = 0;
+  glGetProgramiv(this->program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  GLenum format;
+  std::vector<char> binary (sizeof(format) + length);
+  glGetProgramBinary(this->program, length, &length, &format, binary.data() + sizeof(format));
+  memcpy(binary.data(), &format, sizeof(format));
+  binary.resize(sizeof(format) + length);
+
+  char name[24];
+  snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+
+  std::filesystem::path path = std::filesystem::path(programCachePath).append(name);
+  std::filesystem::path temporaryPath = path;
+  temporaryPath += ".tmp";
+
+  try {
+    std::filesystem::create_directories(programCachePath);
+
+    {
+      std::ofstream out (temporaryPath, std::ios::binary | std::ios::trunc);
+      out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+      out.write(binary.data(), binary.size());
+    }
+
+    std::filesystem::rename(temporaryPath, path);
+  } catch (const std::exception& e) {
+    DEBUG("failed to save program binary %s: %s", name, e.what());
+  }
+}
+
+void ShaderManager::ShaderProgram::reflect() {
+  GLchar name[256];
+  GLsizei length;
+  GLint size;
+  GLenum type;
+
+  tsl::sparse_map<std::string, GLint> uniforms;
+
+  GLint uniformCount;
+  glGetProgramiv(this->program, GL_ACTIVE_UNIFORMS, &uniformCount);
+  for (GLint i = 0; i < uniformCount; i++) {
+    glGetActiveUniform(this->program, i, sizeof(name), &length, &size, &type, name);
+    uniforms[stripArraySuffix(name)] = glGetUniformLocation(this->program, name);
+  }
+
+  for (size_t i = 0; i < static_cast<size_t>(Uniform::UNIFORM_COUNT); i++) {
+    auto location = uniforms.find(uniformNames[i]);
+    this->uniformLocations[i] = location != uniforms.end() ? location->second : -1;
+  }
+
+  GLint attribCount;
+  glGetProgramiv(this->program, GL_ACTIVE_ATTRIBUTES, &attribCount);
+  for (GLint i = 0; i < attribCount; i++) {
+    glGetActiveAttrib(this->program, i, sizeof(name), &length, &size, &type, name);
+    this->attribLocations[stripArraySuffix(name)] = glGetAttribLocation(this->program, name);
+  }
+
+  // Blocks always use the binding point matching their UniformBlock value
+  for (size_t i = 0; i < static_cast<size_t>(UniformBlock::BLOCK_COUNT); i++) {
+    GLuint blockIndex = glGetUniformBlockIndex(this->program, uniformBlockNames[i]);
+
+    this->uniformBlocks[i] = blockIndex != GL_INVALID_INDEX;
+    if (this->uniformBlocks[i]) {
+      glUniformBlockBinding(this->program, blockIndex, i);
+    }
+  }
+}
+
+GLuint ShaderManager::ShaderProgram::getShaderProgram() const {
   return this->program;
 }
 
-ShaderManager::ShaderManager() {
-  this->shaderPrograms.resize(Mortar::Resource::getShaderCount());
-  for (auto program = this->shaderPrograms.begin(); program != this->shaderPrograms.end(); program++) {
-    *program = new ShaderProgram();
+GLint ShaderManager::ShaderProgram::getUniformLocation(Uniform uniform) const {
+  return this->uniformLocations[static_cast<size_t>(uniform)];
+}
+
+bool ShaderManager::ShaderProgram::hasUniformBlock(UniformBlock block) const {
+  return this->uniformBlocks[static_cast<size_t>(block)];
+}
+
+GLint ShaderManager::ShaderProgram::getAttribLocation(const std::string& name) const {
+  auto location = this->attribLocations.find(name);
+  if (location == this->attribLocations.end()) {
+    return -1;
   }
+
+  return location->second;
 }
 
+ShaderManager::ShaderManager()
+  : programs(VARIANT_COUNT, nullptr),
+    useBinaryCache { false } {}
+
 void ShaderManager::initialize() {
-  for (int i = 0; i < this->shaderPrograms.size(); i++) {
-    this->shaderPrograms[i]->initialize(shaderSources[i][0], shaderSources[i][1]);
-  }
+  GLint formatCount = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+  this->useBinaryCache = formatCount > 0;
+
+  // Variants are built as draws first ask for them
 }
 
 void ShaderManager::shutDown() {
-  for (auto program : this->shaderPrograms) {
-    program->shutDown();
-    delete program;
+  for (auto& program : this->programs) {
+    if (program) {
+      program->shutDown();
+      delete program;
+      program = nullptr;
+    }
   }
+}
 
-  this->shaderPrograms.clear();
+GLuint ShaderManager::getShaderProgram(Resource::ShaderType shaderType, uint32_t features) {
+  return this->getProgram(shaderType, features).getShaderProgram();
 }
 
-GLuint ShaderManager::getShaderProgram(Resource::ShaderType shaderType) {
+const ShaderManager::ShaderProgram& ShaderManager::getProgram(Resource::ShaderType shaderType, uint32_t features) {
   if (shaderType == Resource::ShaderType::INVALID) {
     throw std::runtime_error("invalid shader type");
   }
 
-  return this->shaderPrograms[static_cast<size_t>(shaderType)]->getShaderProgram();
+  if (!this->supportsFeatures(shaderType, features)) {
+    throw std::runtime_error("shader type has no variant with these features");
+  }
+
+  ShaderProgram *&program = this->programs[getVariantIndex(shaderType, features)];
+  if (program) {
+    return *program;
+  }
+
+  size_t index = static_cast<size_t>(shaderType);
+
+  ShaderProgram *newProgram = new ShaderProgram();
+  try {
+    newProgram->initialize(shaderSources[index][0], shaderSources[index][1], features, this->useBinaryCache);
+  } catch (...) {
+    newProgram->shutDown();
+    delete newProgram;
+    throw;
+  }
+
+  program = newProgram;
+  return *newProgram;
+}
+
+bool ShaderManager::supportsFeatures(Resource::ShaderType shaderType, uint32_t features) const {
+  if (shaderType == Resource::ShaderType::INVALID) {
+    return false;
+  }
+
+  return (supportedFeatures[static_cast<size_t>(shaderType)] & features) == features;
+}
+
+bool ShaderManager::hasInstancedProgram(Resource::ShaderType shaderType) const {
+  return this->supportsFeatures(shaderType, INSTANCED);
+}
+
+GLint ShaderManager::getAttribLocation(const std::string& name) {
+  for (size_t i = 0; i < sizeof(attribNames) / sizeof(*attribNames); i++) {
+    if (name == attribNames[i]) {
+      return (GLint)i;
+    }
+  }
+
+  return -1;
 }
@@ -18,21 +18,40 @@
 #define MORTAR_RENDER_GL_SHADER_H
 
 #include <GL/gl.h>
+#include <stdint.h>
+#include <string>
+#include <tsl/sparse_map.h>
 #include <vector>
 
 #include "../../resource/types/shader.hpp"
+#include "uniformbuffer.hpp"
 
 namespace Mortar::Render::GL {
-  class ShaderManager {
-    public:
-      ShaderManager();
+  // Uniforms set outside the uniform blocks, with locations cached at link
+  // time; samplers can't live in a block
+  enum class Uniform {
+    MATERIAL_TEX,
+    UNIFORM_COUNT,
+  };
 
-      void initialize();
-      void shutDown();
-
-      GLuint getShaderProgram(Mortar::Resource::ShaderType shaderType);
+  // Optional features of a shader, each compiled in as a #define of the same
+  // name; a program exists for every combination a shader type supports
+  enum ShaderFeature : uint32_t {
+    // Mesh transforms come from InstanceBlock, indexed by gl_InstanceID
+    INSTANCED = 1 << 0,
+    // The material texture is sampled; without it only vertex and material
+    // colors are used
+    TEXTURED = 1 << 1,
+    // Only depth is written, for the pre-pass; the fragment stage is empty
+    DEPTH_ONLY = 1 << 2,
+    // Blend indices address PaletteBlock directly, without a SkinBlock, so
+    // every surface of a mesh draws together
+    PALETTE_INDEXED = 1 << 3,
+    FEATURE_BITS = 4,
+  };
 
-    private:
+  class ShaderManager {
+    public:
       class ShaderProgram {
         public:
           ShaderProgram()
@@ -40,18 +59,73 @@ namespace Mortar::Render::GL {
               vertexShader { -1 },
               fragmentShader { -1 } {};
 
-          void initialize(const char *vertexShaderSrc, const char *fragmentShaderSrc);
+          // Loads the program from the binary cache when a copy built from
+          // the same sources by the same driver is there, otherwise compiles
+          // it and stores the result
+          void initialize(const char *vertexShaderSrc, const char *fragmentShaderSrc, uint32_t features, bool useCache);
           void shutDown();
 
-          GLuint getShaderProgram();
+          GLuint getShaderProgram() const;
+
+          // -1 where the program doesn't use the uniform or attribute
+          GLint getUniformLocation(Uniform uniform) const;
+          GLint getAttribLocation(const std::string& name) const;
+
+          bool hasUniformBlock(UniformBlock block) const;
 
         private:
+          // Records the location of every active uniform and attribute and
+          // assigns the uniform block bindings
+          void reflect();
+
+          void compile(const char * const *vertexSources, size_t vertexCount, const char * const *fragmentSources, size_t fragmentCount, bool retrievable);
+          bool loadBinary(uint64_t key);
+          void saveBinary(uint64_t key);
+
           GLint program;
           GLint vertexShader;
           GLint fragmentShader;
+
+          GLint uniformLocations[static_cast<size_t>(Uniform::UNIFORM_COUNT)];
+          tsl::sparse_map<std::string, GLint> attribLocations;
+
+          bool uniformBlocks[static_cast<size_t>(UniformBlock::BLOCK_COUNT)];
       };
 
-      std::vector<ShaderProgram *> shaderPrograms;
+      ShaderManager();
+
+      void initialize();
+      void shutDown();
+
+      GLuint getShaderProgram(Mortar::Resource::ShaderType shaderType, uint32_t features = 0);
+
+      // The variant of a shader with the given ShaderFeature bits, compiled
+      // on first use. Throws for features the shader type doesn't support.
+      const ShaderProgram& getProgram(Mortar::Resource::ShaderType shaderType, uint32_t features = 0);
+
+      // Whether the shader type has variants with all of these features;
+      // skinned programs can't be instanced
+      bool supportsFeatures(Mortar::Resource::ShaderType shaderType, uint32_t features) const;
+      bool hasInstancedProgram(Mortar::Resource::ShaderType shaderType) const;
+
+      // Every variant of every shader type has a dense index below
+      // VARIANT_COUNT, for per-program state kept outside the program
+      static constexpr size_t VARIANT_COUNT = Mortar::Resource::getShaderCount() << FEATURE_BITS;
+
+      static constexpr size_t getVariantIndex(Mortar::Resource::ShaderType shaderType, uint32_t features) {
+        return (static_cast<size_t>(shaderType) << FEATURE_BITS) | features;
+      }
+
+      // The location every program binds the named attribute to, or -1 for
+      // an attribute no shader declares
+      static GLint getAttribLocation(const std::string& name);
+
+    private:
+      // Indexed by variant, null until first asked for
+      std::vector<ShaderProgram *> programs;
+
+      // Off where the driver offers no binary formats
+      bool useBinaryCache;
 };
 }
 
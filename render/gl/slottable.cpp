@@ -0,0 +1,67 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "slottable.hpp"
+
+using namespace Mortar::Render::GL;
+
+uint32_t SlotTable::add(const Resource::Resource *resource) {
+  const uint32_t *existing = this->slots.find(resource->getHandle());
+  if (existing) {
+    return *existing;
+  }
+
+  uint32_t slot;
+  if (!this->freeSlots.empty()) {
+    slot = this->freeSlots.back();
+    this->freeSlots.pop_back();
+  } else {
+    slot = this->capacity++;
+  }
+
+  this->slots[resource->getHandle()] = slot;
+  resource->setRenderSlot(slot);
+
+  return slot;
+}
+
+uint32_t SlotTable::remove(const Resource::ResourceHandle& handle) {
+  const uint32_t *existing = this->slots.find(handle);
+  if (!existing) {
+    return Resource::Resource::NO_RENDER_SLOT;
+  }
+
+  uint32_t slot = *existing;
+  this->slots.erase(handle);
+  this->freeSlots.push_back(slot);
+
+  return slot;
+}
+
+uint32_t SlotTable::find(const Resource::ResourceHandle& handle) const {
+  const uint32_t *existing = this->slots.find(handle);
+
+  return existing ? *existing : Resource::Resource::NO_RENDER_SLOT;
+}
+
+uint32_t SlotTable::getCapacity() const {
+  return this->capacity;
+}
+
+void SlotTable::clear() {
+  this->slots.clear();
+  this->freeSlots.clear();
+  this->capacity = 0;
+}
@@ -0,0 +1,55 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MORTAR_RENDER_GL_SLOTTABLE_H
+#define MORTAR_RENDER_GL_SLOTTABLE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "../../resource/handlemap.hpp"
+#include "../../resource/resource.hpp"
+
+namespace Mortar::Render::GL {
+  // Hands out dense slots to one kind of registered resource, reusing those
+  // of unregistered ones, so what's made for each resource can live in plain
+  // arrays indexed by the slot the resource carries. Slots are only looked up
+  // by handle where the resource may already be gone, as on unregistering.
+  class SlotTable {
+    public:
+      // The resource's slot, giving it one if it has none
+      uint32_t add(const Resource::Resource *resource);
+
+      // Frees the slot of the resource with this handle for reuse, and
+      // returns it; NO_RENDER_SLOT if the handle had none
+      uint32_t remove(const Resource::ResourceHandle& handle);
+
+      // NO_RENDER_SLOT for handles without a slot
+      uint32_t find(const Resource::ResourceHandle& handle) const;
+
+      // One past the highest slot given out; arrays indexed by slot need to
+      // be this long
+      uint32_t getCapacity() const;
+
+      void clear();
+
+    private:
+      Resource::HandleMap<uint32_t> slots;
+      std::vector<uint32_t> freeSlots;
+      uint32_t capacity = 0;
+  };
+}
+
+#endif
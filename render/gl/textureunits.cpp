@@ -0,0 +1,83 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+
+#include "textureunits.hpp"
+
+using namespace Mortar::Render::GL;
+
+void TextureUnitCache::initialize() {
+  GLint unitCount;
+  glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &unitCount);
+
+  this->units.assign(unitCount, { 0, 0 });
+  this->textureUnits.clear();
+  this->useCount = 0;
+}
+
+void TextureUnitCache::shutDown() {
+  this->units.clear();
+  this->textureUnits.clear();
+}
+
+GLint TextureUnitCache::bind(GLuint texture) {
+  this->useCount++;
+
+  auto cached = this->textureUnits.find(texture);
+  if (cached != this->textureUnits.end()) {
+    GLint unit = cached->second;
+    this->units[unit].lastUse = this->useCount;
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    return unit;
+  }
+
+  // Empty units have never been used, so they're picked first
+  GLint unit = 0;
+  for (size_t i = 1; i < this->units.size(); i++) {
+    if (this->units[i].lastUse < this->units[unit].lastUse) {
+      unit = (GLint)i;
+    }
+  }
+
+  Unit& slot = this->units[unit];
+  if (slot.texture) {
+    this->textureUnits.erase(slot.texture);
+  }
+
+  slot.texture = texture;
+  slot.lastUse = this->useCount;
+  this->textureUnits[texture] = unit;
+
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D, texture);
+
+  return unit;
+}
+
+void TextureUnitCache::evict(GLuint texture) {
+  auto cached = this->textureUnits.find(texture);
+  if (cached == this->textureUnits.end()) {
+    return;
+  }
+
+  // Deleting the texture unbinds it; the unit becomes the first to reuse
+  this->units[cached->second] = { 0, 0 };
+  this->textureUnits.erase(cached);
+}
@@ -0,0 +1,53 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_GL_TEXTUREUNITS_H
+#define MORTAR_RENDER_GL_TEXTUREUNITS_H
+
+#include <GL/gl.h>
+#include <cstdint>
+#include <tsl/sparse_map.h>
+#include <vector>
+
+namespace Mortar::Render::GL {
+  // Binds textures to units on demand. A texture keeps its unit until the
+  // unit is needed for another texture, and the least recently used unit is
+  // the one given up, so draws sorted by texture rarely rebind.
+  class TextureUnitCache {
+    public:
+      void initialize();
+      void shutDown();
+
+      // Returns the unit the texture is bound to, binding it if needed. The
+      // unit is left active.
+      GLint bind(GLuint texture);
+
+      // Forgets a texture that's about to be deleted
+      void evict(GLuint texture);
+
+    private:
+      struct Unit {
+        GLuint texture;
+        uint64_t lastUse;
+      };
+
+      std::vector<Unit> units;
+      tsl::sparse_map<GLuint, GLint> textureUnits;
+      uint64_t useCount = 0;
+  };
+}
+
+#endif
@@ -0,0 +1,60 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+
+#include "uniformbuffer.hpp"
+
+using namespace Mortar::Render::GL;
+
+void UniformBuffer::initialize() {
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &this->alignment);
+  glGenBuffers(1, &this->buffer);
+}
+
+void UniformBuffer::shutDown() {
+  if (this->buffer != 0) {
+    glDeleteBuffers(1, &this->buffer);
+    this->buffer = 0;
+  }
+
+  this->capacity = 0;
+  this->staging.clear();
+  this->staging.shrink_to_fit();
+}
+
+void UniformBuffer::beginFrame() {
+  this->staging.clear();
+}
+
+void UniformBuffer::upload() {
+  GLsizeiptr size = this->staging.size();
+  if (size > this->capacity) {
+    this->capacity = size;
+  }
+
+  glBindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+
+  // Orphan last frame's storage before writing this frame's blocks
+  glBufferData(GL_UNIFORM_BUFFER, this->capacity, nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, size, this->staging.data());
+}
+
+void UniformBuffer::bind(UniformBlock block, GLintptr offset, GLsizeiptr size) {
+  glBindBufferRange(GL_UNIFORM_BUFFER, static_cast<GLuint>(block), this->buffer, offset, size);
+}
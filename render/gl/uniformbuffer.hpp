@@ -0,0 +1,149 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_GL_UNIFORMBUFFER_H
+#define MORTAR_RENDER_GL_UNIFORMBUFFER_H
+
+#include <GL/gl.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+// Keep InstanceBlock and PaletteBlock within the 16KiB every GL
+// implementation allows
+#define INSTANCE_BATCH_SIZE 64
+#define MAX_PALETTE_SIZE 128
+
+namespace Mortar::Render::GL {
+  // Binding points, shared by every program
+  enum class UniformBlock {
+    FRAME,
+    OBJECT,
+    SKIN,
+    INSTANCE,
+    PALETTE,
+    BLOCK_COUNT,
+  };
+
+  // CPU mirrors of the std140 blocks declared in shader.cpp
+
+  struct FrameBlock {
+    float projViewMtx[16];
+    float lightDirections[3][4];
+    float lightColors[3][4];
+    float ambientColor[4];
+  };
+
+  struct ObjectBlock {
+    float meshTransformMtx[16];
+    float materialColor[4];
+    float colorMultipliers[2];
+    int32_t padding[2];
+  };
+
+  // Maps a surface's blend indices into its actor's palette; std140 pads
+  // int arrays to 16 bytes, so four indices share each element
+  struct SkinBlock {
+    int32_t skinIndices[4][4];
+  };
+
+  struct PaletteBlock {
+    // The palette's Affine columns, a GLSL mat3x4 each
+    float skinPalette[MAX_PALETTE_SIZE][12];
+  };
+
+  struct InstanceBlock {
+    float instanceTransforms[INSTANCE_BATCH_SIZE][16];
+  };
+
+  static_assert(sizeof(FrameBlock) == 176);
+  static_assert(sizeof(ObjectBlock) == 96);
+  static_assert(sizeof(SkinBlock) == 64);
+  static_assert(sizeof(PaletteBlock) == 6144);
+  static_assert(sizeof(InstanceBlock) == 4096);
+
+  // Collects a frame's worth of blocks in a staging buffer, then uploads them
+  // with a single orphaning glBufferData so the driver never has to wait on
+  // the previous frame's draws. Each draw binds its block with
+  // glBindBufferRange.
+  class UniformBuffer {
+    public:
+      UniformBuffer()
+        : buffer { 0 },
+          capacity { 0 },
+          alignment { 256 } {};
+
+      void initialize();
+      void shutDown();
+
+      void beginFrame();
+
+      template <typename T>
+      GLintptr push(const T& block) {
+        GLintptr offset = roundUp(this->staging.size(), this->alignment);
+
+        this->staging.resize(offset + sizeof(T));
+        memcpy(this->staging.data() + offset, &block, sizeof(T));
+
+        return offset;
+      }
+
+      // Leaves room for a block written on the GPU, at an offset that's a
+      // multiple of both the given alignment and the buffer's own
+      GLintptr reserve(GLsizeiptr size, GLint alignment = 0) {
+        if (alignment > 0) {
+          alignment = std::lcm(alignment, this->alignment);
+        } else {
+          alignment = this->alignment;
+        }
+
+        GLintptr offset = roundUp(this->staging.size(), alignment);
+
+        this->staging.resize(offset + size);
+
+        return offset;
+      }
+
+      void upload();
+
+      // Bytes staged this frame
+      GLsizeiptr getSize() const {
+        return this->staging.size();
+      }
+
+      GLuint getBuffer() const {
+        return this->buffer;
+      }
+
+      void bind(UniformBlock block, GLintptr offset, GLsizeiptr size);
+
+    private:
+      GLuint buffer;
+      GLsizeiptr capacity;
+      GLint alignment;
+
+      std::vector<uint8_t> staging;
+
+      // Offset alignments are only required to be positive, not powers of two
+      static GLintptr roundUp(size_t offset, GLint alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+      }
+  };
+}
+
+#endif
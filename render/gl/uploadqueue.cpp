@@ -0,0 +1,245 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <algorithm>
+#include <string.h>
+
+#include "../../profiler.hpp"
+#include "uploadqueue.hpp"
+
+using namespace Mortar::Render::GL;
+
+void UploadQueue::initialize(TextureUnitCache *textureUnits, GLsizeiptr stagingSize) {
+  this->textureUnits = textureUnits;
+  this->stagingSize = stagingSize;
+
+  glGenBuffers(1, &this->staging);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->staging);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, this->stagingSize, nullptr, GL_STREAM_DRAW);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  this->head = 0;
+  this->used = 0;
+}
+
+void UploadQueue::shutDown() {
+  for (auto& batch : this->batches) {
+    glDeleteSync(batch.fence);
+  }
+
+  if (this->staging != 0) {
+    glDeleteBuffers(1, &this->staging);
+    this->staging = 0;
+  }
+
+  this->batches.clear();
+  this->queue.clear();
+  this->pending.clear();
+}
+
+void UploadQueue::pushBuffer(const Resource::ResourceHandle& owner, GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data) {
+  if (size == 0 || data == nullptr) {
+    return;
+  }
+
+  this->queue.push_back({ owner, buffer, offset, size, data, false, {} });
+  this->pending[owner]++;
+}
+
+void UploadQueue::pushTextureLevel(const Resource::ResourceHandle& owner, GLuint texture, const TextureLevel& level, GLsizeiptr size, const void *data) {
+  if (size == 0 || data == nullptr) {
+    return;
+  }
+
+  this->queue.push_back({ owner, texture, 0, size, data, true, level });
+  this->pending[owner]++;
+}
+
+bool UploadQueue::isPending(const Resource::ResourceHandle& owner) const {
+  return this->pending.contains(owner);
+}
+
+void UploadQueue::cancel(const Resource::ResourceHandle& owner) {
+  if (!this->pending.contains(owner)) {
+    return;
+  }
+
+  std::erase_if(this->queue, [&owner] (const Copy& copy) {
+    return copy.owner == owner;
+  });
+
+  this->pending.erase(owner);
+}
+
+void UploadQueue::release(const Resource::ResourceHandle& owner) {
+  if (!this->pending.contains(owner)) {
+    return;
+  }
+
+  if (--this->pending.at(owner) == 0) {
+    this->pending.erase(owner);
+  }
+}
+
+void UploadQueue::retire() {
+  while (!this->batches.empty()) {
+    Batch& batch = this->batches.front();
+
+    GLenum status = glClientWaitSync(batch.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+
+    glDeleteSync(batch.fence);
+    this->used -= batch.consumed;
+    for (auto& owner : batch.owners) {
+      this->release(owner);
+    }
+
+    this->batches.pop_front();
+  }
+}
+
+bool UploadQueue::reserve(GLsizeiptr size, GLintptr& offset, GLsizeiptr& consumed) {
+  size = (size + 15) & ~15;
+
+  if (this->used == 0) {
+    this->head = 0;
+  }
+
+  // The oldest byte still in flight; the ring is full when it meets head
+  GLintptr tail = ((this->head - this->used) % this->stagingSize + this->stagingSize) % this->stagingSize;
+  bool wraps = this->used == 0 || this->head > tail;
+  GLintptr end = wraps ? this->stagingSize : tail;
+
+  if (this->head + size <= end) {
+    offset = this->head;
+    this->head = (this->head + size) % this->stagingSize;
+    this->used += size;
+    consumed += size;
+
+    return true;
+  }
+
+  // Skip what's left at the end and start over from the beginning
+  if (this->used > 0 && wraps && size <= tail) {
+    GLsizeiptr skipped = this->stagingSize - this->head;
+
+    offset = 0;
+    this->head = size;
+    this->used += skipped + size;
+    consumed += skipped + size;
+
+    return true;
+  }
+
+  return false;
+}
+
+void UploadQueue::issue(const Copy& copy, const void *source, bool staged) {
+  if (copy.isTexture) {
+    const TextureLevel& level = copy.level;
+
+    this->textureUnits->bind(copy.target);
+
+    if (level.isCompressed) {
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, level.level, 0, 0, level.width, level.height, level.internalFormat, copy.size, source);
+    } else {
+      glTexSubImage2D(GL_TEXTURE_2D, level.level, 0, 0, level.width, level.height, level.format, GL_UNSIGNED_BYTE, source);
+    }
+
+    return;
+  }
+
+  // The copy targets leave the bound vertex array's element buffer alone
+  glBindBuffer(GL_COPY_WRITE_BUFFER, copy.target);
+
+  if (staged) {
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)source, copy.offset, copy.size);
+  } else {
+    glBufferSubData(GL_COPY_WRITE_BUFFER, copy.offset, copy.size, source);
+  }
+}
+
+GLsizeiptr UploadQueue::process(GLsizeiptr budget) {
+  PROFILE_ZONE("UploadQueue::process");
+
+  this->retire();
+
+  if (this->queue.empty()) {
+    return 0;
+  }
+
+  Batch batch { nullptr, 0, {} };
+  GLsizeiptr issued = 0;
+
+  glBindBuffer(GL_COPY_READ_BUFFER, this->staging);
+
+  while (!this->queue.empty()) {
+    const Copy& copy = this->queue.front();
+    if (issued > 0 && issued + copy.size > budget) {
+      break;
+    }
+
+    // Copies too large for the ring go straight from client memory
+    const void *source = copy.data;
+    bool staged = copy.size <= this->stagingSize;
+
+    GLintptr offset = 0;
+    if (staged && !this->reserve(copy.size, offset, batch.consumed)) {
+      break;
+    }
+
+    if (staged) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->staging);
+
+      // The fences keep us clear of ranges GL may still be reading, so the
+      // mapping needn't synchronize
+      void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, copy.size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+      if (mapped) {
+        memcpy(mapped, copy.data, copy.size);
+      }
+
+      if (mapped && glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+        source = (const void *)offset;
+      } else {
+        staged = false;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      }
+    } else {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    this->issue(copy, source, staged);
+
+    batch.owners.push_back(copy.owner);
+    issued += copy.size;
+    this->queue.pop_front();
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (batch.owners.empty()) {
+    return 0;
+  }
+
+  batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  this->batches.push_back(std::move(batch));
+
+  return issued;
+}
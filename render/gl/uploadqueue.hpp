@@ -0,0 +1,117 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MORTAR_RENDER_GL_UPLOADQUEUE_H
+#define MORTAR_RENDER_GL_UPLOADQUEUE_H
+
+#include <GL/gl.h>
+#include <deque>
+#include <vector>
+
+#include "../../resource/handlemap.hpp"
+#include "../../resource/resource.hpp"
+#include "textureunits.hpp"
+
+namespace Mortar::Render::GL {
+  // Streams uploads into storage allocated up front, a budget's worth each
+  // frame, so registering a model never stalls a frame on all of its data.
+  // Data is staged in a ring in one pixel unpack buffer and copied from there
+  // on the GPU. Each frame's copies are fenced; an owner is uploaded once the
+  // fences covering all of its copies have signalled, and only then is their
+  // staging space reused.
+  class UploadQueue {
+    public:
+      static constexpr GLsizeiptr DEFAULT_STAGING_SIZE = 16 * 1024 * 1024;
+      static constexpr GLsizeiptr DEFAULT_FRAME_BUDGET = 4 * 1024 * 1024;
+
+      struct TextureLevel {
+        GLint level;
+        GLsizei width;
+        GLsizei height;
+        GLenum internalFormat;
+        GLenum format;
+        bool isCompressed;
+      };
+
+      // Textures are bound through the unit cache, like any other bind
+      void initialize(TextureUnitCache *textureUnits, GLsizeiptr stagingSize = DEFAULT_STAGING_SIZE);
+      void shutDown();
+
+      // Queues a copy into a range of a buffer or into a whole texture level.
+      // The data must stay valid until its owner is uploaded or cancelled.
+      void pushBuffer(const Resource::ResourceHandle& owner, GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data);
+      void pushTextureLevel(const Resource::ResourceHandle& owner, GLuint texture, const TextureLevel& level, GLsizeiptr size, const void *data);
+
+      // Retires finished copies, then issues queued ones until the budget is
+      // spent. At least one is issued whenever the ring has room, so copies
+      // larger than the budget still go out, a frame of their own each.
+      // Returns the bytes issued.
+      GLsizeiptr process(GLsizeiptr budget = DEFAULT_FRAME_BUDGET);
+
+      // Whether any of an owner's copies are queued or still in flight
+      bool isPending(const Resource::ResourceHandle& owner) const;
+
+      // Drops an owner's queued copies, for resources about to be freed.
+      // Copies already issued finish, but no longer hold the owner pending.
+      void cancel(const Resource::ResourceHandle& owner);
+
+    private:
+      struct Copy {
+        Resource::ResourceHandle owner;
+        GLuint target;
+        GLintptr offset;
+        GLsizeiptr size;
+        const void *data;
+
+        bool isTexture;
+        TextureLevel level;
+      };
+
+      // The copies issued in one call to process, and how much of the ring
+      // they took, including any space skipped to wrap around
+      struct Batch {
+        GLsync fence;
+        GLsizeiptr consumed;
+        std::vector<Resource::ResourceHandle> owners;
+      };
+
+      void retire();
+      void release(const Resource::ResourceHandle& owner);
+
+      // Takes a 16-byte aligned, contiguous range from the ring
+      bool reserve(GLsizeiptr size, GLintptr& offset, GLsizeiptr& consumed);
+
+      // Sources are offsets into the staging buffer when staged, and client
+      // memory otherwise
+      void issue(const Copy& copy, const void *source, bool staged);
+
+      TextureUnitCache *textureUnits = nullptr;
+
+      GLuint staging = 0;
+      GLsizeiptr stagingSize = 0;
+
+      // Next free byte of the ring, and how much of it is in flight
+      GLintptr head = 0;
+      GLsizeiptr used = 0;
+
+      std::deque<Copy> queue;
+      std::deque<Batch> batches;
+
+      // Copies outstanding per owner, queued or in flight
+      Resource::HandleMap<unsigned> pending;
+  };
+}
+
+#endif
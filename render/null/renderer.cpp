@@ -0,0 +1,51 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include "renderer.hpp"
+
+using namespace Mortar::Render::Null;
+
+void Renderer::initialize() {}
+
+void Renderer::shutDown() {}
+
+void Renderer::acquireContext() {}
+
+void Renderer::releaseContext() {}
+
+void Renderer::registerMeshes(const std::vector<const Resource::Mesh *>&) {}
+
+void Renderer::registerTextures(const std::vector<const Resource::Texture *>&) {}
+
+void Renderer::registerVertexBuffers(const std::vector<const Resource::VertexBuffer *>&) {}
+
+void Renderer::unregisterResources(const std::vector<Resource::ResourceHandle>&) {}
+
+bool Renderer::isMeshReady(const Resource::ResourceHandle&) const {
+  return true;
+}
+
+bool Renderer::composesSkinPalettes() const {
+  return false;
+}
+
+void Renderer::renderGeometry(const FramePacket&) {}
+
+Mortar::Render::RenderStats Renderer::getRenderStats() const {
+  return {};
+}
@@ -0,0 +1,53 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_NULL_RENDERER_H
+#define MORTAR_RENDER_NULL_RENDERER_H
+
+#include <vector>
+
+#include "../renderer.hpp"
+
+namespace Mortar::Render::Null {
+  // Takes registrations and frames and draws nothing, for running the
+  // simulation where there's no GPU. Every mesh is ready as soon as it's
+  // registered, and skin palettes are composed by the caller, so the CPU
+  // does all the work it would do for a renderer that can't compose them.
+  class Renderer : public Mortar::Render::Renderer {
+    public:
+      void initialize() override;
+      void shutDown() override;
+
+      void acquireContext() override;
+      void releaseContext() override;
+
+      void registerMeshes(const std::vector<const Resource::Mesh *>& meshes) override;
+      void registerTextures(const std::vector<const Resource::Texture *>& textures) override;
+      void registerVertexBuffers(const std::vector<const Resource::VertexBuffer *>& vertexBuffers) override;
+
+      void unregisterResources(const std::vector<Resource::ResourceHandle>& handles) override;
+
+      bool isMeshReady(const Resource::ResourceHandle& mesh) const override;
+
+      bool composesSkinPalettes() const override;
+
+      void renderGeometry(const FramePacket& packet) override;
+
+      RenderStats getRenderStats() const override;
+  };
+}
+
+#endif
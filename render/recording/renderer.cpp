@@ -0,0 +1,106 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "../framepacket.hpp"
+#include "renderer.hpp"
+
+using namespace Mortar::Render::Recording;
+
+void Renderer::initialize() {
+  this->renderer->initialize();
+}
+
+void Renderer::shutDown() {
+  this->renderer->shutDown();
+}
+
+void Renderer::acquireContext() {
+  this->renderer->acquireContext();
+}
+
+void Renderer::releaseContext() {
+  this->renderer->releaseContext();
+}
+
+void Renderer::registerMeshes(const std::vector<const Resource::Mesh *>& meshes) {
+  this->renderer->registerMeshes(meshes);
+}
+
+void Renderer::registerTextures(const std::vector<const Resource::Texture *>& textures) {
+  this->renderer->registerTextures(textures);
+}
+
+void Renderer::registerVertexBuffers(const std::vector<const Resource::VertexBuffer *>& vertexBuffers) {
+  this->renderer->registerVertexBuffers(vertexBuffers);
+}
+
+void Renderer::unregisterResources(const std::vector<Resource::ResourceHandle>& handles) {
+  this->renderer->unregisterResources(handles);
+}
+
+bool Renderer::isMeshReady(const Resource::ResourceHandle& mesh) const {
+  return this->renderer->isMeshReady(mesh);
+}
+
+bool Renderer::composesSkinPalettes() const {
+  return this->renderer->composesSkinPalettes();
+}
+
+void Renderer::renderGeometry(const FramePacket& packet) {
+  bool recorded = false;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->framesToRecord) {
+      this->capture.record(packet);
+      this->framesToRecord--;
+      recorded = true;
+    }
+  }
+
+  this->renderer->renderGeometry(packet);
+
+  // Does nothing if the capture was taken while the frame was drawn
+  if (recorded) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->capture.setStats(this->renderer->getRenderStats());
+  }
+}
+
+Mortar::Render::RenderStats Renderer::getRenderStats() const {
+  return this->renderer->getRenderStats();
+}
+
+void Renderer::startRecording(unsigned frameCount) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->capture.clear();
+  this->framesToRecord = frameCount;
+}
+
+bool Renderer::isRecording() const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->framesToRecord != 0;
+}
+
+Mortar::Render::Capture Renderer::takeCapture() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->framesToRecord = 0;
+
+  return std::exchange(this->capture, Capture());
+}
@@ -0,0 +1,72 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_RECORDING_RENDERER_H
+#define MORTAR_RENDER_RECORDING_RENDERER_H
+
+#include <mutex>
+#include <vector>
+
+#include "../capture.hpp"
+#include "../renderer.hpp"
+
+namespace Mortar::Render::Recording {
+  // Passes everything through to another renderer, copying the frames it's
+  // given into a capture while recording. Recording is started and the
+  // capture taken from the simulation thread; frames are recorded on the
+  // thread drawing them.
+  class Renderer : public Mortar::Render::Renderer {
+    public:
+      Renderer(Mortar::Render::Renderer *renderer)
+        : renderer { renderer } {};
+
+      void initialize() override;
+      void shutDown() override;
+
+      void acquireContext() override;
+      void releaseContext() override;
+
+      void registerMeshes(const std::vector<const Resource::Mesh *>& meshes) override;
+      void registerTextures(const std::vector<const Resource::Texture *>& textures) override;
+      void registerVertexBuffers(const std::vector<const Resource::VertexBuffer *>& vertexBuffers) override;
+
+      void unregisterResources(const std::vector<Resource::ResourceHandle>& handles) override;
+
+      bool isMeshReady(const Resource::ResourceHandle& mesh) const override;
+
+      bool composesSkinPalettes() const override;
+
+      void renderGeometry(const FramePacket& packet) override;
+
+      RenderStats getRenderStats() const override;
+
+      // Records the next frameCount frames drawn, dropping any earlier capture
+      void startRecording(unsigned frameCount);
+      bool isRecording() const;
+
+      // Hands over what's been recorded so far, stopping the recording
+      Capture takeCapture();
+
+    private:
+      Mortar::Render::Renderer *renderer;
+
+      mutable std::mutex mutex;
+      Capture capture;
+      unsigned framesToRecord = 0;
+  };
+}
+
+#endif
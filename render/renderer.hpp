@@ -17,13 +17,15 @@
 #ifndef MORTAR_RENDER_RENDERER_H
 #define MORTAR_RENDER_RENDERER_H
 
-#include <list>
+#include <cstdint>
 #include <vector>
 
 #include "../resource/types/geom.hpp"
 #include "../resource/types/mesh.hpp"
 #include "../resource/types/texture.hpp"
 #include "../resource/types/vertex.hpp"
+#include "framepacket.hpp"
+#include "renderstats.hpp"
 
 namespace Mortar::Render {
   class Renderer {
@@ -31,11 +33,32 @@ namespace Mortar::Render {
       virtual void initialize() = 0;
       virtual void shutDown() = 0;
 
+      // The renderer is used from one thread at a time; these hand its
+      // context from the thread that initialized it to the one drawing
+      virtual void acquireContext() = 0;
+      virtual void releaseContext() = 0;
+
       virtual void registerMeshes(const std::vector<const Resource::Mesh *>& meshes) = 0;
       virtual void registerTextures(const std::vector<const Resource::Texture *>& textures) = 0;
       virtual void registerVertexBuffers(const std::vector<const Resource::VertexBuffer *>& vertexBuffers) = 0;
 
-      virtual void renderGeometry(const std::list<const Resource::GeomObject *>& geometry) = 0;
+      // Frees whatever was created for the given resources; handles that were
+      // never registered are ignored
+      virtual void unregisterResources(const std::vector<Resource::ResourceHandle>& handles) = 0;
+
+      // Registered meshes may take a few frames to upload; they aren't drawn
+      // until then
+      virtual bool isMeshReady(const Resource::ResourceHandle& mesh) const = 0;
+
+      // Whether skin palettes may hold local poses, leaving the renderer to
+      // compose the skeleton and apply the skin transforms
+      virtual bool composesSkinPalettes() const = 0;
+
+      // Draws the packet's queue in order; it's expected to be sorted already
+      virtual void renderGeometry(const FramePacket& packet) = 0;
+
+      // As of the last frame drawn; safe to call from any thread
+      virtual RenderStats getRenderStats() const = 0;
   };
 }
 
@@ -0,0 +1,126 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bit>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+#include "renderqueue.hpp"
+
+using namespace Mortar::Render;
+
+// Handle indices are dense within a type, so the low bits of one tell live
+// resources apart until there are more of them than the field holds.
+// Collisions only cost a redundant state change, never a wrong draw.
+static inline uint64_t handleBits(const Mortar::Resource::Resource *resource, unsigned bits) {
+  if (!resource) {
+    return 0;
+  }
+
+  return resource->getHandle().getIndex() & ((1ull << bits) - 1);
+}
+
+// Positive floats order the same as their bit patterns, so the top bits of
+// the pattern give a monotonic, logarithmically spaced depth
+static inline uint64_t depthBits(float depth) {
+  if (!(depth > 0.0f)) {
+    return 0;
+  }
+
+  return std::bit_cast<uint32_t>(depth) >> 16;
+}
+
+uint64_t RenderQueue::makeKey(const Resource::GeomObject *geom, float depth) const {
+  const Resource::Mesh *mesh = geom->getMesh();
+  const Resource::Material *material = mesh->getMaterial();
+
+  uint64_t shader = static_cast<uint64_t>(mesh->getShaderType()) & 0x7f;
+  uint64_t texture = handleBits(material->getTexture(), 16);
+  uint64_t meshBits = handleBits(mesh, 24);
+  uint64_t depthKey = depthBits(depth);
+
+  if (material->isAlphaBlended()) {
+    return (1ull << 63) | ((~depthKey & 0xffff) << 47) | (shader << 40) | (texture << 24) | meshBits;
+  }
+
+  if (this->depthMode == DepthMode::FRONT_TO_BACK) {
+    return (shader << 56) | (depthKey << 40) | (texture << 24) | meshBits;
+  }
+
+  return (shader << 56) | (texture << 40) | (meshBits << 16) | depthKey;
+}
+
+void RenderQueue::clear(DepthMode depthMode) {
+  this->depthMode = depthMode;
+  this->items.clear();
+}
+
+void RenderQueue::push(const Resource::GeomObject *geom, float depth) {
+  this->items.push_back({ this->makeKey(geom, depth), geom });
+}
+
+void RenderQueue::pushKeyed(const Resource::GeomObject *geom, uint64_t key) {
+  this->items.push_back({ key, geom });
+}
+
+void RenderQueue::sort() {
+  size_t count = this->items.size();
+  if (count < 2) {
+    return;
+  }
+
+  this->scratch.resize(count);
+
+  // LSD radix sort, one byte per pass; passes where every key has the same
+  // digit are skipped
+  Item *src = this->items.data();
+  Item *dst = this->scratch.data();
+
+  for (unsigned shift = 0; shift < 64; shift += 8) {
+    size_t counts[256];
+    memset(counts, 0, sizeof(counts));
+
+    for (size_t i = 0; i < count; i++) {
+      counts[(src[i].key >> shift) & 0xff]++;
+    }
+
+    if (counts[(src[0].key >> shift) & 0xff] == count) {
+      continue;
+    }
+
+    size_t offset = 0;
+    for (unsigned digit = 0; digit < 256; digit++) {
+      size_t digitCount = counts[digit];
+      counts[digit] = offset;
+      offset += digitCount;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      dst[counts[(src[i].key >> shift) & 0xff]++] = src[i];
+    }
+
+    std::swap(src, dst);
+  }
+
+  if (src != this->items.data()) {
+    this->items.swap(this->scratch);
+  }
+}
+
+std::span<const RenderQueue::Item> RenderQueue::getItems() const {
+  return this->items;
+}
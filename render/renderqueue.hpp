@@ -0,0 +1,84 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_RENDERQUEUE_H
+#define MORTAR_RENDER_RENDERQUEUE_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "../resource/types/geom.hpp"
+
+namespace Mortar::Render {
+  // How a frame's opaque draws make use of the depth buffer. Which wins
+  // depends on the scene's overdraw and the GPU's fill rate, so it's chosen
+  // per scene.
+  enum class DepthMode {
+    // Grouped by state, front-to-back only between placements of a mesh
+    STATE_SORTED,
+    // Front-to-back within each shader, so early depth testing rejects more
+    // fragments at the cost of more texture changes
+    FRONT_TO_BACK,
+    // State sorted, after static geometry has been drawn depth-only so that
+    // each covered pixel is shaded once
+    PREPASS,
+  };
+
+  // A frame's draws, ordered by a packed sort key so that draws sharing state
+  // end up adjacent. Opaque keys are, from the top bit down:
+  //
+  //   pass (1) | shader (7) | texture (16) | mesh (24) | depth (16)
+  //
+  // with depth front-to-back, or with DepthMode::FRONT_TO_BACK:
+  //
+  //   pass (1) | shader (7) | depth (16) | texture (16) | mesh (24)
+  //
+  // Alpha-blended draws sort after every opaque draw, with the depth moved up
+  // to just below the pass and inverted so they're drawn back-to-front:
+  //
+  //   pass (1) | ~depth (16) | shader (7) | texture (16) | mesh (24)
+  class RenderQueue {
+    public:
+      struct Item {
+        uint64_t key;
+        const Resource::GeomObject *geom;
+      };
+
+      // Empties the queue; draws pushed after are keyed for depthMode
+      void clear(DepthMode depthMode = DepthMode::STATE_SORTED);
+
+      // depth is the draw's distance from the camera
+      void push(const Resource::GeomObject *geom, float depth);
+
+      // Adds a draw whose key was made earlier, as for a replayed frame
+      void pushKeyed(const Resource::GeomObject *geom, uint64_t key);
+
+      // Radix sorts the items by key
+      void sort();
+
+      std::span<const Item> getItems() const;
+
+    private:
+      uint64_t makeKey(const Resource::GeomObject *geom, float depth) const;
+
+      DepthMode depthMode = DepthMode::STATE_SORTED;
+      std::vector<Item> items;
+      std::vector<Item> scratch;
+  };
+}
+
+#endif
@@ -0,0 +1,58 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_RENDERSTATS_H
+#define MORTAR_RENDER_RENDERSTATS_H
+
+#include <cstdint>
+
+namespace Mortar::Render {
+  // What a recent frame cost, to tell CPU submission from GPU raster. GPU
+  // times lag the counters by the few frames their queries take to come back.
+  struct RenderStats {
+    // GPU milliseconds per pass, and for the whole frame
+    float uploadTime;
+    float paletteTime;
+    float prepassTime;
+    float opaqueStaticTime;
+    float opaqueSkinnedTime;
+    float alphaTime;
+    float gpuFrameTime;
+
+    // CPU milliseconds spent building and submitting the frame
+    float submitTime;
+
+    // Size the frame was drawn at, before being scaled to the window
+    unsigned renderWidth;
+    unsigned renderHeight;
+
+    unsigned drawCalls;
+    uint64_t triangles;
+    unsigned stateChanges;
+    uint64_t bytesUploaded;
+
+    // Estimated bytes of GPU memory held for registered geometry and
+    // textures, as of the end of the frame
+    uint64_t bufferMemory;
+    uint64_t textureMemory;
+
+    // Texture levels queued to stream in, and dropped to stay in budget
+    unsigned textureLevelsStreamed;
+    unsigned textureLevelsEvicted;
+  };
+}
+
+#endif
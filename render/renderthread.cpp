@@ -0,0 +1,208 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+
+#include "../profiler.hpp"
+#include "renderthread.hpp"
+
+using namespace Mortar::Render;
+
+void RenderThread::initialize(Renderer *renderer, Resource::ResourceManager& resourceManager) {
+  this->renderer = renderer;
+
+  renderer->initialize();
+  this->composesPalettes = renderer->composesSkinPalettes();
+
+  for (auto& packet : this->packets) {
+    packet.initialize(resourceManager);
+  }
+
+  this->writeIdx = 0;
+  this->submitted = nullptr;
+  this->drawing = nullptr;
+  this->stopping = false;
+
+  renderer->releaseContext();
+  this->thread = std::thread(&RenderThread::run, this);
+}
+
+void RenderThread::shutDown() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopping = true;
+  }
+
+  this->condition.notify_all();
+  this->thread.join();
+
+  this->commands.clear();
+  this->submittedCommands.clear();
+  this->readyMeshes.clear();
+}
+
+void RenderThread::registerMeshes(const std::vector<const Resource::Mesh *>& meshes) {
+  std::vector<Resource::ResourceHandle> handles;
+  for (auto mesh : meshes) {
+    handles.push_back(mesh->getHandle());
+  }
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->commands.push_back([this, meshes, handles] (Renderer& renderer) {
+    renderer.registerMeshes(meshes);
+    this->uploadingMeshes.insert(this->uploadingMeshes.end(), handles.begin(), handles.end());
+  });
+}
+
+void RenderThread::registerTextures(const std::vector<const Resource::Texture *>& textures) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->commands.push_back([textures] (Renderer& renderer) {
+    renderer.registerTextures(textures);
+  });
+}
+
+void RenderThread::registerVertexBuffers(const std::vector<const Resource::VertexBuffer *>& vertexBuffers) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->commands.push_back([vertexBuffers] (Renderer& renderer) {
+    renderer.registerVertexBuffers(vertexBuffers);
+  });
+}
+
+void RenderThread::unregisterResources(const std::vector<Resource::ResourceHandle>& handles, std::vector<std::shared_ptr<void>> retired) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  // The command holds the memory, and commands outlive their frame
+  this->commands.push_back([this, handles, retired = std::move(retired)] (Renderer& renderer) {
+    renderer.unregisterResources(handles);
+
+    std::erase_if(this->uploadingMeshes, [&handles] (const Resource::ResourceHandle& mesh) {
+      return std::find(handles.begin(), handles.end(), mesh) != handles.end();
+    });
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (auto& handle : handles) {
+      this->readyMeshes.erase(handle);
+    }
+  });
+}
+
+bool RenderThread::isMeshReady(const Resource::ResourceHandle& mesh) const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  return this->readyMeshes.contains(mesh);
+}
+
+bool RenderThread::composesSkinPalettes() const {
+  return this->composesPalettes;
+}
+
+RenderStats RenderThread::getRenderStats() const {
+  return this->renderer->getRenderStats();
+}
+
+FramePacket& RenderThread::getPacket() {
+  PROFILE_ZONE("wait for packet");
+
+  FramePacket *packet = &this->packets[this->writeIdx];
+
+  // The packet two frames back may still be on screen
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->condition.wait(lock, [this, packet] () {
+    return this->drawing != packet && this->submitted != packet;
+  });
+
+  return *packet;
+}
+
+void RenderThread::submit() {
+  PROFILE_ZONE("submit packet");
+
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->condition.wait(lock, [this] () {
+      return this->submitted == nullptr;
+    });
+
+    this->submitted = &this->packets[this->writeIdx];
+    this->submittedCommands.insert(this->submittedCommands.end(), std::make_move_iterator(this->commands.begin()), std::make_move_iterator(this->commands.end()));
+    this->commands.clear();
+  }
+
+  this->condition.notify_all();
+  this->writeIdx ^= 1;
+}
+
+void RenderThread::run() {
+  this->renderer->acquireContext();
+
+  std::vector<Command> frameCommands;
+  std::vector<Resource::ResourceHandle> ready;
+
+  while (true) {
+    FramePacket *packet;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->condition.wait(lock, [this] () {
+        return this->stopping || this->submitted != nullptr;
+      });
+
+      if (this->stopping) {
+        break;
+      }
+
+      packet = this->drawing = this->submitted;
+      this->submitted = nullptr;
+      frameCommands.swap(this->submittedCommands);
+    }
+
+    this->condition.notify_all();
+
+    PROFILE_ZONE("render frame");
+
+    for (auto& command : frameCommands) {
+      command(*this->renderer);
+    }
+
+    this->renderer->renderGeometry(*packet);
+
+    // Kept until the frame is drawn, so what they hold outlives its reads
+    frameCommands.clear();
+
+    // Meshes that finished uploading become drawable for the next frame
+    ready.clear();
+    std::erase_if(this->uploadingMeshes, [this, &ready] (const Resource::ResourceHandle& mesh) {
+      if (!this->renderer->isMeshReady(mesh)) {
+        return false;
+      }
+
+      ready.push_back(mesh);
+      return true;
+    });
+
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      for (auto& mesh : ready) {
+        this->readyMeshes[mesh] = true;
+      }
+
+      this->drawing = nullptr;
+    }
+
+    this->condition.notify_all();
+  }
+
+  this->renderer->shutDown();
+  this->renderer->releaseContext();
+}
@@ -0,0 +1,102 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MORTAR_RENDER_RENDERTHREAD_H
+#define MORTAR_RENDER_RENDERTHREAD_H
+
+#include <array>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../resource/handlemap.hpp"
+#include "../resource/manager.hpp"
+#include "framepacket.hpp"
+#include "renderer.hpp"
+
+namespace Mortar::Render {
+  // Runs a renderer on a thread of its own, which owns its context. The
+  // simulation fills one frame packet while the other is drawn, so posing the
+  // next frame overlaps submitting this one.
+  //
+  // Registrations are queued and run on the render thread ahead of the next
+  // packet submitted. Everything here is called from the simulation thread.
+  class RenderThread {
+    public:
+      // Initializes the renderer here, then hands its context to the thread
+      void initialize(Renderer *renderer, Resource::ResourceManager& resourceManager);
+
+      // Waits for the frame being drawn, then shuts the renderer down on the
+      // render thread
+      void shutDown();
+
+      void registerMeshes(const std::vector<const Resource::Mesh *>& meshes);
+      void registerTextures(const std::vector<const Resource::Texture *>& textures);
+      void registerVertexBuffers(const std::vector<const Resource::VertexBuffer *>& vertexBuffers);
+
+      // Retired memory is held until the frame the unregistering goes ahead
+      // of has been drawn, as the renderer may read the resources until then
+      void unregisterResources(const std::vector<Resource::ResourceHandle>& handles, std::vector<std::shared_ptr<void>> retired = {});
+
+      // As of the last frame drawn
+      bool isMeshReady(const Resource::ResourceHandle& mesh) const;
+
+      bool composesSkinPalettes() const;
+
+      // As of the last frame drawn
+      RenderStats getRenderStats() const;
+
+      // The packet to fill for the next frame
+      FramePacket& getPacket();
+
+      // Hands the packet over to be drawn. Waits if the last one hasn't been
+      // picked up yet, so the simulation runs at most a frame ahead.
+      void submit();
+
+    private:
+      typedef std::function<void (Renderer&)> Command;
+
+      void run();
+
+      Renderer *renderer = nullptr;
+      bool composesPalettes = false;
+
+      std::thread thread;
+
+      std::array<FramePacket, 2> packets;
+      size_t writeIdx = 0;
+
+      // Guards everything below, which both threads touch
+      mutable std::mutex mutex;
+      std::condition_variable condition;
+
+      FramePacket *submitted = nullptr;
+      FramePacket *drawing = nullptr;
+      std::vector<Command> submittedCommands;
+      bool stopping = false;
+
+      // Commands queued since the last submit
+      std::vector<Command> commands;
+
+      // Registered meshes still uploading, and those that are done
+      std::vector<Resource::ResourceHandle> uploadingMeshes;
+      Resource::HandleMap<bool> readyMeshes;
+  };
+}
+
+#endif
@@ -0,0 +1,85 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cmath>
+
+#include "resolution.hpp"
+
+using namespace Mortar::Render;
+
+// GPU times lag a few frames behind, so a change isn't judged until times
+// drawn at the new scale have come back
+static const unsigned SETTLE_FRAMES = 12;
+
+// Weight of each new frame time in the running average
+static const float SMOOTHING = 0.1f;
+
+// Largest change to the scale at once, going down and going up
+static const float MAX_DECREASE = 0.15f;
+static const float MAX_INCREASE = 0.05f;
+
+// Scale only goes up once frames come in this far under the target
+static const float INCREASE_THRESHOLD = 0.85f;
+
+void ResolutionController::setSettings(const Settings& settings) {
+  this->settings = settings;
+  this->scale = std::clamp(settings.scale, settings.minScale, settings.maxScale);
+  this->averageFrameTime = 0.0f;
+  this->framesSinceChange = 0;
+}
+
+const ResolutionController::Settings& ResolutionController::getSettings() const {
+  return this->settings;
+}
+
+float ResolutionController::update(float gpuFrameTime) {
+  if (!this->settings.dynamic || gpuFrameTime <= 0.0f) {
+    return this->scale;
+  }
+
+  if (this->averageFrameTime == 0.0f) {
+    this->averageFrameTime = gpuFrameTime;
+  } else {
+    this->averageFrameTime += (gpuFrameTime - this->averageFrameTime) * SMOOTHING;
+  }
+
+  if (++this->framesSinceChange < SETTLE_FRAMES) {
+    return this->scale;
+  }
+
+  // Raster cost goes with the pixel count, the square of the scale
+  float target = this->settings.targetFrameTime;
+  float step = std::sqrt(target / this->averageFrameTime);
+
+  float newScale = this->scale;
+  if (this->averageFrameTime > target) {
+    newScale *= std::max(step, 1.0f - MAX_DECREASE);
+  } else if (this->averageFrameTime < target * INCREASE_THRESHOLD) {
+    newScale *= std::min(step, 1.0f + MAX_INCREASE);
+  }
+
+  newScale = std::clamp(newScale, this->settings.minScale, this->settings.maxScale);
+  if (std::abs(newScale - this->scale) >= 0.01f) {
+    this->scale = newScale;
+    this->framesSinceChange = 0;
+  }
+
+  return this->scale;
+}
+
+float ResolutionController::getScale() const {
+  return this->scale;
+}
@@ -0,0 +1,57 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MORTAR_RENDER_RESOLUTION_H
+#define MORTAR_RENDER_RESOLUTION_H
+
+namespace Mortar::Render {
+  // Picks the fraction of the window's width and height to render at. With
+  // dynamic resolution on, it's steered by recent GPU frame times to hold
+  // them under a target: the scale moves only after the times have settled,
+  // drops quickly when over the target and climbs back slowly, so it doesn't
+  // oscillate.
+  class ResolutionController {
+    public:
+      struct Settings {
+        // The fixed scale, or the starting one when dynamic
+        float scale = 1.0f;
+        bool dynamic = false;
+
+        // GPU milliseconds per frame to stay under
+        float targetFrameTime = 16.0f;
+
+        float minScale = 0.5f;
+        float maxScale = 1.0f;
+      };
+
+      void setSettings(const Settings& settings);
+      const Settings& getSettings() const;
+
+      // Takes the GPU time of a finished frame, or zero while none has come
+      // back yet, and returns the scale for the next
+      float update(float gpuFrameTime);
+
+      float getScale() const;
+
+    private:
+      Settings settings;
+
+      float scale = 1.0f;
+      float averageFrameTime = 0.0f;
+      unsigned framesSinceChange = 0;
+  };
+}
+
+#endif
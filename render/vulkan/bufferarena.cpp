@@ -0,0 +1,122 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include "bufferarena.hpp"
+
+using namespace Mortar::Render::Vulkan;
+
+void BufferArena::initialize(Device *device, VkBufferUsageFlags usage, VkDeviceSize pageSize) {
+  this->device = device;
+  this->usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  this->pageSize = pageSize;
+}
+
+void BufferArena::shutDown() {
+  for (auto& page : this->pages) {
+    this->device->destroyBuffer(page.buffer);
+  }
+
+  this->pages.clear();
+}
+
+bool BufferArena::allocateFrom(Page& page, VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation) {
+  for (auto range = page.freeRanges.begin(); range != page.freeRanges.end(); range++) {
+    VkDeviceSize start = range->first;
+    VkDeviceSize end = start + range->second;
+
+    VkDeviceSize aligned = (start + alignment - 1) / alignment * alignment;
+    if (aligned + size > end) {
+      continue;
+    }
+
+    page.freeRanges.erase(range);
+
+    if (aligned > start) {
+      page.freeRanges[start] = aligned - start;
+    }
+
+    if (aligned + size < end) {
+      page.freeRanges[aligned + size] = end - (aligned + size);
+    }
+
+    allocation = { page.buffer.buffer, aligned, size };
+    return true;
+  }
+
+  return false;
+}
+
+BufferArena::Allocation BufferArena::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+  Allocation allocation;
+
+  for (auto& page : this->pages) {
+    if (this->allocateFrom(page, size, alignment, allocation)) {
+      return allocation;
+    }
+  }
+
+  Page page;
+  page.buffer = this->device->createBuffer(std::max(this->pageSize, size), this->usage, false);
+  page.freeRanges[0] = page.buffer.size;
+
+  this->pages.push_back(page);
+  this->allocateFrom(this->pages.back(), size, alignment, allocation);
+
+  return allocation;
+}
+
+void BufferArena::release(const Allocation& allocation) {
+  auto page = std::find_if(this->pages.begin(), this->pages.end(), [&](const Page& page) {
+    return page.buffer.buffer == allocation.buffer;
+  });
+
+  if (page == this->pages.end()) {
+    throw std::runtime_error("released allocation from unknown buffer");
+  }
+
+  VkDeviceSize start = allocation.offset;
+  VkDeviceSize length = allocation.size;
+
+  auto next = page->freeRanges.lower_bound(start);
+  if (next != page->freeRanges.end() && start + length == next->first) {
+    length += next->second;
+    next = page->freeRanges.erase(next);
+  }
+
+  if (next != page->freeRanges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == start) {
+      start = prev->first;
+      length += prev->second;
+      page->freeRanges.erase(prev);
+    }
+  }
+
+  page->freeRanges[start] = length;
+}
+
+VkDeviceSize BufferArena::getReservedSize() const {
+  VkDeviceSize size = 0;
+  for (auto& page : this->pages) {
+    size += page.buffer.size;
+  }
+
+  return size;
+}
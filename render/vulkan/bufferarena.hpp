@@ -0,0 +1,69 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_VULKAN_BUFFERARENA_H
+#define MORTAR_RENDER_VULKAN_BUFFERARENA_H
+
+#include <map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "device.hpp"
+
+namespace Mortar::Render::Vulkan {
+  // Suballocates static data out of a few large device-local buffers, as the
+  // GL arena does, so that many resources share one buffer binding. Pages
+  // are carved first-fit and freed ranges coalesce with their neighbours;
+  // pages live until shutDown. Data is filled in through the upload queue.
+  class BufferArena {
+    public:
+      struct Allocation {
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        VkDeviceSize size;
+      };
+
+      static constexpr VkDeviceSize DEFAULT_PAGE_SIZE = 4 * 1024 * 1024;
+
+      void initialize(Device *device, VkBufferUsageFlags usage, VkDeviceSize pageSize = DEFAULT_PAGE_SIZE);
+      void shutDown();
+
+      // Offsets are a multiple of alignment, which needn't be a power of two
+      // so that vertex data can be placed on a whole vertex
+      Allocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+      void release(const Allocation& allocation);
+
+      // Bytes of every page, used or not
+      VkDeviceSize getReservedSize() const;
+
+    private:
+      struct Page {
+        Buffer buffer;
+
+        // offset -> length
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+      };
+
+      bool allocateFrom(Page& page, VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation);
+
+      Device *device = nullptr;
+      VkBufferUsageFlags usage = 0;
+      VkDeviceSize pageSize = DEFAULT_PAGE_SIZE;
+      std::vector<Page> pages;
+  };
+}
+
+#endif
@@ -0,0 +1,301 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <SDL2/SDL_vulkan.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../../log.hpp"
+#include "device.hpp"
+
+using namespace Mortar::Render::Vulkan;
+
+void Mortar::Render::Vulkan::check(VkResult result, const char *call) {
+  if (result != VK_SUCCESS) {
+    throw std::runtime_error(std::string(call) + " failed with " + std::to_string(result));
+  }
+}
+
+void Device::initialize(SDL_Window *window) {
+  // SDL knows which surface extensions its window needs
+  unsigned extensionCount = 0;
+  if (!SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, nullptr)) {
+    throw std::runtime_error("failed to list vulkan instance extensions");
+  }
+
+  std::vector<const char *> extensions(extensionCount);
+  SDL_Vulkan_GetInstanceExtensions(window, &extensionCount, extensions.data());
+
+  VkApplicationInfo appInfo {};
+  appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  appInfo.pApplicationName = "mortar";
+  appInfo.pEngineName = "mortar";
+  appInfo.apiVersion = VK_API_VERSION_1_1;
+
+  VkInstanceCreateInfo instanceInfo {};
+  instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  instanceInfo.pApplicationInfo = &appInfo;
+  instanceInfo.enabledExtensionCount = extensions.size();
+  instanceInfo.ppEnabledExtensionNames = extensions.data();
+
+  check(vkCreateInstance(&instanceInfo, nullptr, &this->instance), "vkCreateInstance");
+
+  if (!SDL_Vulkan_CreateSurface(window, this->instance, &this->surface)) {
+    throw std::runtime_error("failed to create vulkan surface");
+  }
+
+  uint32_t deviceCount = 0;
+  vkEnumeratePhysicalDevices(this->instance, &deviceCount, nullptr);
+  std::vector<VkPhysicalDevice> devices(deviceCount);
+  vkEnumeratePhysicalDevices(this->instance, &deviceCount, devices.data());
+
+  // The first device with a queue that can both draw and present, preferring
+  // a discrete GPU over an integrated one
+  for (auto candidate : devices) {
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, families.data());
+
+    for (uint32_t i = 0; i < familyCount; i++) {
+      VkBool32 presents = VK_FALSE;
+      vkGetPhysicalDeviceSurfaceSupportKHR(candidate, i, this->surface, &presents);
+      if (!(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) || !presents) {
+        continue;
+      }
+
+      VkPhysicalDeviceProperties candidateProperties;
+      vkGetPhysicalDeviceProperties(candidate, &candidateProperties);
+
+      bool isDiscrete = candidateProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+      if (this->physicalDevice == VK_NULL_HANDLE || (isDiscrete && this->properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)) {
+        this->physicalDevice = candidate;
+        this->properties = candidateProperties;
+        this->queueFamily = i;
+      }
+
+      break;
+    }
+  }
+
+  if (this->physicalDevice == VK_NULL_HANDLE) {
+    throw std::runtime_error("no vulkan device can draw to the window");
+  }
+
+  DEBUG("using vulkan device %s", this->properties.deviceName);
+
+  vkGetPhysicalDeviceMemoryProperties(this->physicalDevice, &this->memoryProperties);
+
+  // Textures stay in the S3TC formats they're read in
+  VkPhysicalDeviceFeatures supported;
+  vkGetPhysicalDeviceFeatures(this->physicalDevice, &supported);
+  if (!supported.textureCompressionBC) {
+    throw std::runtime_error("vulkan device lacks BC texture compression");
+  }
+
+  VkPhysicalDeviceFeatures features {};
+  features.textureCompressionBC = VK_TRUE;
+
+  float priority = 1.0f;
+  VkDeviceQueueCreateInfo queueInfo {};
+  queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queueInfo.queueFamilyIndex = this->queueFamily;
+  queueInfo.queueCount = 1;
+  queueInfo.pQueuePriorities = &priority;
+
+  const char *deviceExtensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+
+  VkDeviceCreateInfo deviceInfo {};
+  deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  deviceInfo.queueCreateInfoCount = 1;
+  deviceInfo.pQueueCreateInfos = &queueInfo;
+  deviceInfo.enabledExtensionCount = std::size(deviceExtensions);
+  deviceInfo.ppEnabledExtensionNames = deviceExtensions;
+  deviceInfo.pEnabledFeatures = &features;
+
+  check(vkCreateDevice(this->physicalDevice, &deviceInfo, nullptr, &this->device), "vkCreateDevice");
+  vkGetDeviceQueue(this->device, this->queueFamily, 0, &this->queue);
+}
+
+void Device::shutDown() {
+  if (this->device != VK_NULL_HANDLE) {
+    vkDestroyDevice(this->device, nullptr);
+    this->device = VK_NULL_HANDLE;
+  }
+
+  if (this->surface != VK_NULL_HANDLE) {
+    vkDestroySurfaceKHR(this->instance, this->surface, nullptr);
+    this->surface = VK_NULL_HANDLE;
+  }
+
+  if (this->instance != VK_NULL_HANDLE) {
+    vkDestroyInstance(this->instance, nullptr);
+    this->instance = VK_NULL_HANDLE;
+  }
+
+  this->physicalDevice = VK_NULL_HANDLE;
+  this->queue = VK_NULL_HANDLE;
+}
+
+VkInstance Device::getInstance() const {
+  return this->instance;
+}
+
+VkSurfaceKHR Device::getSurface() const {
+  return this->surface;
+}
+
+VkPhysicalDevice Device::getPhysicalDevice() const {
+  return this->physicalDevice;
+}
+
+VkDevice Device::getDevice() const {
+  return this->device;
+}
+
+VkQueue Device::getQueue() const {
+  return this->queue;
+}
+
+uint32_t Device::getQueueFamily() const {
+  return this->queueFamily;
+}
+
+const VkPhysicalDeviceLimits& Device::getLimits() const {
+  return this->properties.limits;
+}
+
+uint32_t Device::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const {
+  for (uint32_t i = 0; i < this->memoryProperties.memoryTypeCount; i++) {
+    if ((typeBits & (1 << i)) && (this->memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+      return i;
+    }
+  }
+
+  throw std::runtime_error("no suitable vulkan memory type");
+}
+
+VkDeviceMemory Device::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties) {
+  VkMemoryAllocateInfo allocateInfo {};
+  allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize = requirements.size;
+  allocateInfo.memoryTypeIndex = this->findMemoryType(requirements.memoryTypeBits, properties);
+
+  VkDeviceMemory memory;
+  check(vkAllocateMemory(this->device, &allocateInfo, nullptr, &memory), "vkAllocateMemory");
+
+  return memory;
+}
+
+Buffer Device::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, bool hostVisible) {
+  Buffer buffer;
+  buffer.size = size;
+
+  VkBufferCreateInfo bufferInfo {};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  check(vkCreateBuffer(this->device, &bufferInfo, nullptr, &buffer.buffer), "vkCreateBuffer");
+
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(this->device, buffer.buffer, &requirements);
+
+  VkMemoryPropertyFlags properties = hostVisible ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  buffer.memory = this->allocate(requirements, properties);
+  vkBindBufferMemory(this->device, buffer.buffer, buffer.memory, 0);
+
+  if (hostVisible) {
+    check(vkMapMemory(this->device, buffer.memory, 0, size, 0, &buffer.mapped), "vkMapMemory");
+  }
+
+  return buffer;
+}
+
+void Device::destroyBuffer(Buffer& buffer) {
+  if (buffer.buffer != VK_NULL_HANDLE) {
+    vkDestroyBuffer(this->device, buffer.buffer, nullptr);
+  }
+
+  // Freeing memory unmaps it
+  if (buffer.memory != VK_NULL_HANDLE) {
+    vkFreeMemory(this->device, buffer.memory, nullptr);
+  }
+
+  buffer = Buffer {};
+}
+
+Image Device::createImage(VkFormat format, uint32_t width, uint32_t height, uint32_t levels, VkImageUsageFlags usage, VkImageAspectFlags aspect) {
+  Image image;
+
+  VkImageCreateInfo imageInfo {};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = format;
+  imageInfo.extent = { width, height, 1 };
+  imageInfo.mipLevels = levels;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage = usage;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  check(vkCreateImage(this->device, &imageInfo, nullptr, &image.image), "vkCreateImage");
+
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(this->device, image.image, &requirements);
+
+  image.memory = this->allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  image.size = requirements.size;
+  vkBindImageMemory(this->device, image.image, image.memory, 0);
+
+  VkImageViewCreateInfo viewInfo {};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image.image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = format;
+  viewInfo.subresourceRange = { aspect, 0, levels, 0, 1 };
+
+  check(vkCreateImageView(this->device, &viewInfo, nullptr, &image.view), "vkCreateImageView");
+
+  return image;
+}
+
+void Device::destroyImage(Image& image) {
+  if (image.view != VK_NULL_HANDLE) {
+    vkDestroyImageView(this->device, image.view, nullptr);
+  }
+
+  if (image.image != VK_NULL_HANDLE) {
+    vkDestroyImage(this->device, image.image, nullptr);
+  }
+
+  if (image.memory != VK_NULL_HANDLE) {
+    vkFreeMemory(this->device, image.memory, nullptr);
+  }
+
+  image = Image {};
+}
+
+bool Device::supportsVertexFormat(VkFormat format) const {
+  VkFormatProperties formatProperties;
+  vkGetPhysicalDeviceFormatProperties(this->physicalDevice, format, &formatProperties);
+
+  return formatProperties.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT;
+}
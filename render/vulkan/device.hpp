@@ -0,0 +1,85 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_VULKAN_DEVICE_H
+#define MORTAR_RENDER_VULKAN_DEVICE_H
+
+#include <SDL2/SDL.h>
+#include <vulkan/vulkan.h>
+
+namespace Mortar::Render::Vulkan {
+  // Throws with the call's name when a Vulkan call fails
+  void check(VkResult result, const char *call);
+
+  struct Buffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+
+    // Set for host-visible buffers, which stay mapped for their lifetime
+    void *mapped = nullptr;
+  };
+
+  struct Image {
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+  };
+
+  // The instance, the window's surface and the one device and queue that
+  // draws to it. The queue is picked to both draw and present, which every
+  // desktop driver offers, so there's no ownership to hand between queues.
+  class Device {
+    public:
+      void initialize(SDL_Window *window);
+      void shutDown();
+
+      VkInstance getInstance() const;
+      VkSurfaceKHR getSurface() const;
+      VkPhysicalDevice getPhysicalDevice() const;
+      VkDevice getDevice() const;
+      VkQueue getQueue() const;
+      uint32_t getQueueFamily() const;
+      const VkPhysicalDeviceLimits& getLimits() const;
+
+      // Host-visible buffers are coherent and mapped; others are device-local
+      Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, bool hostVisible);
+      void destroyBuffer(Buffer& buffer);
+
+      // A 2D image with memory of its own and a view of every level
+      Image createImage(VkFormat format, uint32_t width, uint32_t height, uint32_t levels, VkImageUsageFlags usage, VkImageAspectFlags aspect);
+      void destroyImage(Image& image);
+
+      bool supportsVertexFormat(VkFormat format) const;
+
+    private:
+      uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const;
+      VkDeviceMemory allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties);
+
+      VkInstance instance = VK_NULL_HANDLE;
+      VkSurfaceKHR surface = VK_NULL_HANDLE;
+      VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+      VkDevice device = VK_NULL_HANDLE;
+      VkQueue queue = VK_NULL_HANDLE;
+      uint32_t queueFamily = 0;
+
+      VkPhysicalDeviceProperties properties {};
+      VkPhysicalDeviceMemoryProperties memoryProperties {};
+  };
+}
+
+#endif
@@ -0,0 +1,413 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iterator>
+#include <stdexcept>
+
+#include "../../log.hpp"
+#include "pipelines.hpp"
+
+using namespace Mortar::Render::Vulkan;
+
+// SPIR-V built from shaders/ by glslc at build time, as C initializer lists
+static const uint32_t unlitVertexCode[] =
+#include "render/vulkan/shaders/unlit.vert.inc"
+;
+
+static const uint32_t skinVertexCode[] =
+#include "render/vulkan/shaders/skin.vert.inc"
+;
+
+static const uint32_t basicVertexCode[] =
+#include "render/vulkan/shaders/basic.vert.inc"
+;
+
+static const uint32_t unlitFragmentCode[] =
+#include "render/vulkan/shaders/unlit.frag.inc"
+;
+
+static const uint32_t litFragmentCode[] =
+#include "render/vulkan/shaders/lit.frag.inc"
+;
+
+struct ShaderCode {
+  const uint32_t *code;
+  size_t size;
+};
+
+// Indexed by shader type; skinned and basic meshes share a fragment stage,
+// as they do in GL
+static const ShaderCode shaderCode[Mortar::Resource::getShaderCount()][2] = {
+  { { unlitVertexCode, sizeof(unlitVertexCode) }, { unlitFragmentCode, sizeof(unlitFragmentCode) } },
+  { { skinVertexCode, sizeof(skinVertexCode) }, { litFragmentCode, sizeof(litFragmentCode) } },
+  { { basicVertexCode, sizeof(basicVertexCode) }, { litFragmentCode, sizeof(litFragmentCode) } },
+};
+
+// The ShaderFeature bits each shader type can be built with
+static const uint32_t supportedFeatures[Mortar::Resource::getShaderCount()] = {
+  TEXTURED | DEPTH_ONLY,
+  TEXTURED | PALETTE_INDEXED,
+  TEXTURED | DEPTH_ONLY,
+};
+
+// Input locations in blocks.glsl, in the order the GL programs bind them
+static constexpr uint32_t getVertexLocation(Mortar::Resource::VertexUsage vertexUsage) {
+  switch (vertexUsage) {
+    case Mortar::Resource::VertexUsage::POSITION:
+      return 0;
+    case Mortar::Resource::VertexUsage::COLOR:
+      return 1;
+    case Mortar::Resource::VertexUsage::TEX_COORD:
+      return 2;
+    case Mortar::Resource::VertexUsage::NORMAL:
+      return 3;
+    case Mortar::Resource::VertexUsage::BLEND_WEIGHTS:
+      return 4;
+    case Mortar::Resource::VertexUsage::BLEND_INDICES:
+      return 5;
+  }
+
+  throw std::runtime_error("unrecognized vertex usage");
+}
+
+static constexpr uint32_t VERTEX_LOCATION_COUNT = 6;
+
+// As the GL renderer reads each type; D3DCOLOR's BGRA order is the format's
+static constexpr VkFormat getVertexFormat(Mortar::Resource::VertexDataType vertexDataType) {
+  switch (vertexDataType) {
+    case Mortar::Resource::VertexDataType::D3DCOLOR:
+      return VK_FORMAT_B8G8R8A8_UNORM;
+    case Mortar::Resource::VertexDataType::VEC2:
+      return VK_FORMAT_R32G32_SFLOAT;
+    case Mortar::Resource::VertexDataType::VEC3:
+      return VK_FORMAT_R32G32B32_SFLOAT;
+    case Mortar::Resource::VertexDataType::INT_2_10_10_10:
+      return VK_FORMAT_A2B10G10R10_SNORM_PACK32;
+    case Mortar::Resource::VertexDataType::HALF_VEC2:
+      return VK_FORMAT_R16G16_SFLOAT;
+    case Mortar::Resource::VertexDataType::UBYTE_VEC4:
+      return VK_FORMAT_R8G8B8A8_USCALED;
+    case Mortar::Resource::VertexDataType::UNORM16_VEC2:
+      return VK_FORMAT_R16G16_UNORM;
+  }
+
+  throw std::runtime_error("unrecognized vertex data type");
+}
+
+static VkPrimitiveTopology getTopology(Mortar::Resource::PrimitiveType primitiveType) {
+  switch (primitiveType) {
+    case Mortar::Resource::PrimitiveType::LINE_LIST:
+      return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+    case Mortar::Resource::PrimitiveType::TRIANGLE_LIST:
+      return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    case Mortar::Resource::PrimitiveType::TRIANGLE_STRIP:
+      return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+  }
+
+  throw std::runtime_error("unrecognized primitive type");
+}
+
+size_t PipelineKeyHash::operator()(const PipelineKey& key) const noexcept {
+  size_t h = std::hash<const void *>{}(key.vertexLayout);
+  h ^= (static_cast<size_t>(key.shaderType) << 1) ^ (static_cast<size_t>(key.features) << 4) ^ (static_cast<size_t>(key.primitiveType) << 8);
+  h ^= (static_cast<size_t>(key.alphaBlended) << 10) ^ (static_cast<size_t>(key.afterPrepass) << 11);
+
+  return h;
+}
+
+VkShaderModule PipelineCache::createModule(const uint32_t *code, size_t size) {
+  VkShaderModuleCreateInfo moduleInfo {};
+  moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  moduleInfo.codeSize = size;
+  moduleInfo.pCode = code;
+
+  VkShaderModule module;
+  check(vkCreateShaderModule(this->device->getDevice(), &moduleInfo, nullptr, &module), "vkCreateShaderModule");
+
+  return module;
+}
+
+void PipelineCache::initialize(Device *device, VkRenderPass renderPass) {
+  this->device = device;
+  this->renderPass = renderPass;
+
+  VkDevice vkDevice = device->getDevice();
+
+  // Textures are sampled as GL samples them: the finest level only, nearest
+  // when minified and filtered when magnified
+  VkSamplerCreateInfo samplerInfo {};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_LINEAR;
+  samplerInfo.minFilter = VK_FILTER_NEAREST;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.minLod = 0.0f;
+  samplerInfo.maxLod = 0.0f;
+
+  check(vkCreateSampler(vkDevice, &samplerInfo, nullptr, &this->sampler), "vkCreateSampler");
+
+  VkDescriptorSetLayoutBinding frameBindings[3] {};
+  frameBindings[0] = { static_cast<uint32_t>(FrameBinding::FRAME_BLOCK), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr };
+  frameBindings[1] = { static_cast<uint32_t>(FrameBinding::OBJECTS), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr };
+  frameBindings[2] = { static_cast<uint32_t>(FrameBinding::PALETTES), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr };
+
+  VkDescriptorSetLayoutBinding materialBinding { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, &this->sampler };
+
+  VkDescriptorSetLayoutCreateInfo setLayoutInfo {};
+  setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  setLayoutInfo.bindingCount = 3;
+  setLayoutInfo.pBindings = frameBindings;
+  check(vkCreateDescriptorSetLayout(vkDevice, &setLayoutInfo, nullptr, &this->setLayouts[static_cast<size_t>(DescriptorSet::FRAME)]), "vkCreateDescriptorSetLayout");
+
+  setLayoutInfo.bindingCount = 1;
+  setLayoutInfo.pBindings = &materialBinding;
+  check(vkCreateDescriptorSetLayout(vkDevice, &setLayoutInfo, nullptr, &this->setLayouts[static_cast<size_t>(DescriptorSet::MATERIAL)]), "vkCreateDescriptorSetLayout");
+
+  VkPushConstantRange pushConstants { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants) };
+
+  VkPipelineLayoutCreateInfo layoutInfo {};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layoutInfo.setLayoutCount = this->setLayouts.size();
+  layoutInfo.pSetLayouts = this->setLayouts.data();
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &pushConstants;
+  check(vkCreatePipelineLayout(vkDevice, &layoutInfo, nullptr, &this->layout), "vkCreatePipelineLayout");
+
+  for (auto& code : shaderCode) {
+    this->vertexModules.push_back(this->createModule(code[0].code, code[0].size));
+    this->fragmentModules.push_back(this->createModule(code[1].code, code[1].size));
+  }
+}
+
+void PipelineCache::shutDown() {
+  VkDevice vkDevice = this->device->getDevice();
+
+  for (auto& pipeline : this->pipelines) {
+    vkDestroyPipeline(vkDevice, pipeline.second, nullptr);
+  }
+
+  for (auto module : this->vertexModules) {
+    vkDestroyShaderModule(vkDevice, module, nullptr);
+  }
+
+  for (auto module : this->fragmentModules) {
+    vkDestroyShaderModule(vkDevice, module, nullptr);
+  }
+
+  if (this->layout != VK_NULL_HANDLE) {
+    vkDestroyPipelineLayout(vkDevice, this->layout, nullptr);
+  }
+
+  for (auto& setLayout : this->setLayouts) {
+    if (setLayout != VK_NULL_HANDLE) {
+      vkDestroyDescriptorSetLayout(vkDevice, setLayout, nullptr);
+    }
+  }
+
+  if (this->sampler != VK_NULL_HANDLE) {
+    vkDestroySampler(vkDevice, this->sampler, nullptr);
+  }
+
+  this->pipelines.clear();
+  this->vertexInputs.clear();
+  this->vertexModules.clear();
+  this->fragmentModules.clear();
+  this->setLayouts = {};
+  this->layout = VK_NULL_HANDLE;
+  this->sampler = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::supportsFeatures(Resource::ShaderType shaderType, uint32_t features) const {
+  if (shaderType == Resource::ShaderType::INVALID) {
+    return false;
+  }
+
+  return (supportedFeatures[static_cast<size_t>(shaderType)] & features) == features;
+}
+
+VkPipelineLayout PipelineCache::getLayout() const {
+  return this->layout;
+}
+
+VkDescriptorSetLayout PipelineCache::getSetLayout(DescriptorSet set) const {
+  return this->setLayouts[static_cast<size_t>(set)];
+}
+
+const PipelineCache::VertexInput& PipelineCache::getVertexInput(const Resource::VertexLayout& vertexLayout) {
+  auto cached = this->vertexInputs.find(&vertexLayout);
+  if (cached != this->vertexInputs.end()) {
+    return cached->second;
+  }
+
+  VertexInput input;
+  input.bindings.push_back({ 0, static_cast<uint32_t>(vertexLayout.getStride()), VK_VERTEX_INPUT_RATE_VERTEX });
+
+  bool hasLocation[VERTEX_LOCATION_COUNT] = {};
+  for (auto& property : vertexLayout.getProperties()) {
+    VkFormat format = getVertexFormat(property.getDataType());
+    if (!this->device->supportsVertexFormat(format)) {
+      throw std::runtime_error("vertex format unsupported by the vulkan device");
+    }
+
+    uint32_t location = getVertexLocation(property.getUsage());
+    input.attributes.push_back({ location, 0, format, static_cast<uint32_t>(property.getOffset()) });
+    hasLocation[location] = true;
+  }
+
+  // Every stage declares every input, so the rest read the defaults
+  bool usesDefaults = false;
+  for (uint32_t location = 0; location < VERTEX_LOCATION_COUNT; location++) {
+    if (!hasLocation[location]) {
+      input.attributes.push_back({ location, DEFAULTS_BINDING, VK_FORMAT_R32G32B32A32_SFLOAT, 0 });
+      usesDefaults = true;
+    }
+  }
+
+  if (usesDefaults) {
+    input.bindings.push_back({ DEFAULTS_BINDING, 0, VK_VERTEX_INPUT_RATE_VERTEX });
+  }
+
+  return this->vertexInputs[&vertexLayout] = std::move(input);
+}
+
+VkPipeline PipelineCache::getPipeline(const PipelineKey& key) {
+  auto cached = this->pipelines.find(key);
+  if (cached != this->pipelines.end()) {
+    return cached->second;
+  }
+
+  if (!this->supportsFeatures(key.shaderType, key.features)) {
+    throw std::runtime_error("shader type has no variant with these features");
+  }
+
+  size_t shaderIndex = static_cast<size_t>(key.shaderType);
+  bool depthOnly = key.features & DEPTH_ONLY;
+
+  VkBool32 specializationData[2] = { (key.features & TEXTURED) != 0, (key.features & PALETTE_INDEXED) != 0 };
+  VkSpecializationMapEntry specializationEntries[2] = {
+    { 0, 0, sizeof(VkBool32) },
+    { 1, sizeof(VkBool32), sizeof(VkBool32) },
+  };
+
+  VkSpecializationInfo specialization {};
+  specialization.mapEntryCount = 2;
+  specialization.pMapEntries = specializationEntries;
+  specialization.dataSize = sizeof(specializationData);
+  specialization.pData = specializationData;
+
+  VkPipelineShaderStageCreateInfo stages[2] {};
+  stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  stages[0].module = this->vertexModules[shaderIndex];
+  stages[0].pName = "main";
+  stages[0].pSpecializationInfo = &specialization;
+
+  stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  stages[1].module = this->fragmentModules[shaderIndex];
+  stages[1].pName = "main";
+  stages[1].pSpecializationInfo = &specialization;
+
+  const VertexInput& input = this->getVertexInput(*key.vertexLayout);
+
+  VkPipelineVertexInputStateCreateInfo vertexInput {};
+  vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInput.vertexBindingDescriptionCount = input.bindings.size();
+  vertexInput.pVertexBindingDescriptions = input.bindings.data();
+  vertexInput.vertexAttributeDescriptionCount = input.attributes.size();
+  vertexInput.pVertexAttributeDescriptions = input.attributes.data();
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly {};
+  inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly.topology = getTopology(key.primitiveType);
+
+  VkPipelineViewportStateCreateInfo viewport {};
+  viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewport.viewportCount = 1;
+  viewport.scissorCount = 1;
+
+  // Nothing is culled, as in GL
+  VkPipelineRasterizationStateCreateInfo rasterization {};
+  rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+  rasterization.cullMode = VK_CULL_MODE_NONE;
+  rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  rasterization.lineWidth = 1.0f;
+
+  VkPipelineMultisampleStateCreateInfo multisample {};
+  multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  VkPipelineDepthStencilStateCreateInfo depthStencil {};
+  depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencil.depthTestEnable = VK_TRUE;
+  depthStencil.depthWriteEnable = !key.alphaBlended;
+  depthStencil.depthCompareOp = key.afterPrepass ? VK_COMPARE_OP_LESS_OR_EQUAL : VK_COMPARE_OP_LESS;
+
+  // Blended draws leave the destination alpha alone, as in GL
+  VkPipelineColorBlendAttachmentState blendAttachment {};
+  if (depthOnly) {
+    blendAttachment.colorWriteMask = 0;
+  } else if (key.alphaBlended) {
+    blendAttachment.blendEnable = VK_TRUE;
+    blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT;
+  } else {
+    blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  }
+
+  VkPipelineColorBlendStateCreateInfo colorBlend {};
+  colorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  colorBlend.attachmentCount = 1;
+  colorBlend.pAttachments = &blendAttachment;
+
+  VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+  VkPipelineDynamicStateCreateInfo dynamic {};
+  dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamic.dynamicStateCount = std::size(dynamicStates);
+  dynamic.pDynamicStates = dynamicStates;
+
+  VkGraphicsPipelineCreateInfo pipelineInfo {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount = depthOnly ? 1 : 2;
+  pipelineInfo.pStages = stages;
+  pipelineInfo.pVertexInputState = &vertexInput;
+  pipelineInfo.pInputAssemblyState = &inputAssembly;
+  pipelineInfo.pViewportState = &viewport;
+  pipelineInfo.pRasterizationState = &rasterization;
+  pipelineInfo.pMultisampleState = &multisample;
+  pipelineInfo.pDepthStencilState = &depthStencil;
+  pipelineInfo.pColorBlendState = &colorBlend;
+  pipelineInfo.pDynamicState = &dynamic;
+  pipelineInfo.layout = this->layout;
+  pipelineInfo.renderPass = this->renderPass;
+  pipelineInfo.subpass = 0;
+
+  VkPipeline pipeline;
+  check(vkCreateGraphicsPipelines(this->device->getDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline), "vkCreateGraphicsPipelines");
+
+  DEBUG("created vulkan pipeline for shader %zu, features %u", shaderIndex, key.features);
+
+  return this->pipelines[key] = pipeline;
+}
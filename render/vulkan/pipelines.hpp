@@ -0,0 +1,154 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_VULKAN_PIPELINES_H
+#define MORTAR_RENDER_VULKAN_PIPELINES_H
+
+#include <array>
+#include <cstdint>
+#include <tsl/sparse_map.h>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "../../resource/types/mesh.hpp"
+#include "../../resource/types/shader.hpp"
+#include "../../resource/types/vertex.hpp"
+#include "device.hpp"
+
+namespace Mortar::Render::Vulkan {
+  // Optional features of a shader, each a specialization constant of the
+  // same name. Every draw reads its transform by instance index, so there's
+  // no instanced variant; a run of placements is a run of objects.
+  enum ShaderFeature : uint32_t {
+    // The material texture is sampled; without it only vertex and material
+    // colors are used
+    TEXTURED = 1 << 0,
+    // Only depth is written, for the pre-pass; there's no fragment stage
+    DEPTH_ONLY = 1 << 1,
+    // Blend indices address the palette directly, without the push
+    // constants' remap table, so every surface of a mesh draws together
+    PALETTE_INDEXED = 1 << 2,
+  };
+
+  // CPU mirrors of the blocks declared in shaders/blocks.glsl
+
+  // Laid out as the GL FrameBlock
+  struct FrameBlock {
+    float projViewMtx[16];
+    float lightDirections[3][4];
+    float lightColors[3][4];
+    float ambientColor[4];
+  };
+
+  struct ObjectData {
+    float meshTransformMtx[16];
+    float materialColor[4];
+    float colorMultipliers[2];
+    int32_t padding[2];
+  };
+
+  // The palette's Affine columns, a GLSL mat3x4 each
+  struct PaletteEntry {
+    float columns[12];
+  };
+
+  struct DrawConstants {
+    uint32_t paletteBase;
+    int32_t skinIndices[16];
+  };
+
+  static_assert(sizeof(FrameBlock) == 176);
+  static_assert(sizeof(ObjectData) == 96);
+  static_assert(sizeof(PaletteEntry) == 48);
+  static_assert(sizeof(DrawConstants) == 68);
+
+  // Set 0 holds the frame's blocks and set 1 a material's texture
+  enum class DescriptorSet {
+    FRAME,
+    MATERIAL,
+  };
+
+  enum class FrameBinding {
+    FRAME_BLOCK,
+    OBJECTS,
+    PALETTES,
+  };
+
+  // What a pipeline is built for. Layouts are static, so they're keyed by
+  // address, as in the GL renderer's vertex array table.
+  struct PipelineKey {
+    Resource::ShaderType shaderType;
+    uint32_t features;
+    const Resource::VertexLayout *vertexLayout;
+    Resource::PrimitiveType primitiveType;
+    bool alphaBlended;
+
+    // After a depth pre-pass, opaque fragments pass at the depth they left
+    bool afterPrepass;
+
+    bool operator==(const PipelineKey& other) const = default;
+  };
+
+  struct PipelineKeyHash {
+    size_t operator()(const PipelineKey& key) const noexcept;
+  };
+
+  // Builds pipelines as draws first ask for them and keeps them for the
+  // renderer's lifetime. Every pipeline shares one layout, so descriptor sets
+  // and push constants stay bound across pipeline changes. Not thread-safe;
+  // pipelines are looked up before commands are recorded.
+  class PipelineCache {
+    public:
+      void initialize(Device *device, VkRenderPass renderPass);
+      void shutDown();
+
+      VkPipeline getPipeline(const PipelineKey& key);
+
+      bool supportsFeatures(Resource::ShaderType shaderType, uint32_t features) const;
+
+      VkPipelineLayout getLayout() const;
+      VkDescriptorSetLayout getSetLayout(DescriptorSet set) const;
+
+      // Vertex inputs missing from a layout read a stride-0 binding holding
+      // (0, 0, 0, 1), as GL gives attributes without an array
+      static constexpr uint32_t DEFAULTS_BINDING = 1;
+
+    private:
+      struct VertexInput {
+        std::vector<VkVertexInputBindingDescription> bindings;
+        std::vector<VkVertexInputAttributeDescription> attributes;
+      };
+
+      const VertexInput& getVertexInput(const Resource::VertexLayout& vertexLayout);
+      VkShaderModule createModule(const uint32_t *code, size_t size);
+
+      Device *device = nullptr;
+      VkRenderPass renderPass = VK_NULL_HANDLE;
+
+      VkSampler sampler = VK_NULL_HANDLE;
+      std::array<VkDescriptorSetLayout, 2> setLayouts {};
+      VkPipelineLayout layout = VK_NULL_HANDLE;
+
+      // Indexed by shader type
+      std::vector<VkShaderModule> vertexModules;
+      std::vector<VkShaderModule> fragmentModules;
+
+      tsl::sparse_map<const Resource::VertexLayout *, VertexInput> vertexInputs;
+      tsl::sparse_map<PipelineKey, VkPipeline, PipelineKeyHash> pipelines;
+  };
+}
+
+#endif
@@ -0,0 +1,1059 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <SDL2/SDL_timer.h>
+#include <algorithm>
+#include <assert.h>
+#include <stdexcept>
+#include <string.h>
+
+#include "../../log.hpp"
+#include "../../profiler.hpp"
+#include "../../state.hpp"
+#include "renderer.hpp"
+
+using namespace Mortar::Render::Vulkan;
+
+static inline uint64_t countTriangles(Mortar::Resource::PrimitiveType primitiveType, uint32_t count) {
+  switch (primitiveType) {
+    case Mortar::Resource::PrimitiveType::TRIANGLE_LIST:
+      return count / 3;
+    case Mortar::Resource::PrimitiveType::TRIANGLE_STRIP:
+      return count > 2 ? count - 2 : 0;
+    default:
+      return 0;
+  }
+}
+
+// Textures are read in GL's terms; these are the formats Vulkan knows them by
+static VkFormat getTextureFormat(const Mortar::Resource::Texture *texture) {
+  if (texture->getIsCompressed()) {
+    switch (texture->getInternalFormat()) {
+      case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+      case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+      case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        return VK_FORMAT_BC2_UNORM_BLOCK;
+      case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return VK_FORMAT_BC3_UNORM_BLOCK;
+    }
+  } else {
+    switch (texture->getFormat()) {
+      case GL_BGRA:
+        return VK_FORMAT_B8G8R8A8_UNORM;
+      case GL_RGBA:
+        return VK_FORMAT_R8G8B8A8_UNORM;
+    }
+  }
+
+  throw std::runtime_error("texture format unsupported by the vulkan renderer");
+}
+
+// Fixed directional lights, shared by the lit shaders
+static const FrameBlock frameLights = {
+  {},
+  {
+    { 1.0f, 0.0f,  0.0f, 0.0f },
+    { 0.0f, 1.0f,  0.0f, 0.0f },
+    { 0.0f, 0.0f, -1.0f, 0.0f },
+  },
+  {
+    { 1.0f, 1.0f, 1.0f, 0.0f },
+    { 1.0f, 1.0f, 1.0f, 0.0f },
+    { 1.0f, 1.0f, 1.0f, 0.0f },
+  },
+  { 0.4f, 0.4f, 0.4f, 0.0f },
+};
+
+// Material sets per pool; pools are added as they fill
+static constexpr uint32_t MATERIAL_POOL_SIZE = 256;
+
+// Starting sizes of each frame's object and palette buffers
+static constexpr VkDeviceSize INITIAL_FRAME_BUFFER_SIZE = 256 * 1024;
+
+static const VkBufferUsageFlags frameBufferUsage[] = {
+  VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+};
+
+void Renderer::initialize() {
+  this->device.initialize(State::getDisplayManager().getWindow());
+  this->swapchain.initialize(&this->device);
+  this->pipelineCache.initialize(&this->device, this->swapchain.getRenderPass());
+  this->uploadQueue.initialize(&this->device);
+
+  VkDevice vkDevice = this->device.getDevice();
+
+  this->indexArena.initialize(&this->device, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+  static const float defaults[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+  this->vertexDefaults = this->device.createBuffer(sizeof(defaults), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, true);
+  memcpy(this->vertexDefaults.mapped, defaults, sizeof(defaults));
+
+  VkDescriptorPoolSize framePoolSizes[] = {
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, FRAMES_IN_FLIGHT },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * FRAMES_IN_FLIGHT },
+  };
+
+  VkDescriptorPoolCreateInfo framePoolInfo {};
+  framePoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  framePoolInfo.maxSets = FRAMES_IN_FLIGHT;
+  framePoolInfo.poolSizeCount = std::size(framePoolSizes);
+  framePoolInfo.pPoolSizes = framePoolSizes;
+  check(vkCreateDescriptorPool(vkDevice, &framePoolInfo, nullptr, &this->framePool), "vkCreateDescriptorPool");
+
+  VkDescriptorSetLayout frameSetLayout = this->pipelineCache.getSetLayout(DescriptorSet::FRAME);
+
+  for (auto& frame : this->frames) {
+    VkFenceCreateInfo fenceInfo {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    check(vkCreateFence(vkDevice, &fenceInfo, nullptr, &frame.fence), "vkCreateFence");
+
+    VkSemaphoreCreateInfo semaphoreInfo {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    check(vkCreateSemaphore(vkDevice, &semaphoreInfo, nullptr, &frame.acquired), "vkCreateSemaphore");
+
+    VkCommandPoolCreateInfo poolInfo {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = this->device.getQueueFamily();
+    check(vkCreateCommandPool(vkDevice, &poolInfo, nullptr, &frame.pool), "vkCreateCommandPool");
+
+    VkCommandBufferAllocateInfo commandsInfo {};
+    commandsInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandsInfo.commandPool = frame.pool;
+    commandsInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandsInfo.commandBufferCount = 1;
+    check(vkAllocateCommandBuffers(vkDevice, &commandsInfo, &frame.commands), "vkAllocateCommandBuffers");
+
+    VkDescriptorSetAllocateInfo setInfo {};
+    setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    setInfo.descriptorPool = this->framePool;
+    setInfo.descriptorSetCount = 1;
+    setInfo.pSetLayouts = &frameSetLayout;
+    check(vkAllocateDescriptorSets(vkDevice, &setInfo, &frame.descriptorSet), "vkAllocateDescriptorSets");
+
+    // Every binding has a buffer from the start, so the set is always whole
+    FrameBlock frameBlock = frameLights;
+    this->writeFrameBuffer(frame, frame.frameBlock, FrameBinding::FRAME_BLOCK, &frameBlock, sizeof(frameBlock));
+    this->writeFrameBuffer(frame, frame.objects, FrameBinding::OBJECTS, nullptr, INITIAL_FRAME_BUFFER_SIZE);
+    this->writeFrameBuffer(frame, frame.palettes, FrameBinding::PALETTES, nullptr, INITIAL_FRAME_BUFFER_SIZE);
+
+    frame.serial = 0;
+  }
+
+  // The white texture is the only upload that's waited on, as it's bound
+  // from the first frame
+  this->whiteImage = this->device.createImage(VK_FORMAT_R8G8B8A8_UNORM, 1, 1, 1, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+  this->whiteSet = this->allocateMaterialSet(this->whiteImage.view, this->whitePool);
+
+  static const uint8_t white[4] = { 0xff, 0xff, 0xff, 0xff };
+  Resource::ResourceHandle noOwner;
+  this->uploadQueue.pushTextureLevel(noOwner, this->whiteImage.image, { 0, 1, 1 }, sizeof(white), white);
+
+  FrameResources& frame = this->frames[0];
+  VkCommandBufferBeginInfo beginInfo {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  check(vkBeginCommandBuffer(frame.commands, &beginInfo), "vkBeginCommandBuffer");
+
+  this->uploadQueue.process(frame.commands, 0, 0);
+  check(vkEndCommandBuffer(frame.commands), "vkEndCommandBuffer");
+
+  VkSubmitInfo submitInfo {};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &frame.commands;
+  check(vkQueueSubmit(this->device.getQueue(), 1, &submitInfo, VK_NULL_HANDLE), "vkQueueSubmit");
+  vkQueueWaitIdle(this->device.getQueue());
+
+  this->isInitialized = true;
+}
+
+void Renderer::shutDown() {
+  VkDevice vkDevice = this->device.getDevice();
+  vkDeviceWaitIdle(vkDevice);
+
+  this->completedSerial = this->serial;
+  this->releaseRetired();
+
+  this->uploadQueue.shutDown();
+  this->pendingMeshes.clear();
+  this->pendingTextures.clear();
+
+  for (auto& shared : this->sharedTextures) {
+    Image image = shared.second.image;
+    this->device.destroyImage(image);
+  }
+
+  this->device.destroyImage(this->whiteImage);
+  this->device.destroyBuffer(this->vertexDefaults);
+
+  // Destroying the pools frees every set taken from them
+  for (auto pool : this->materialPools) {
+    vkDestroyDescriptorPool(vkDevice, pool, nullptr);
+  }
+
+  this->sharedTextures.clear();
+  this->textureRecords.clear();
+  this->materialPools.clear();
+  this->textureMemory = 0;
+  this->whitePool = VK_NULL_HANDLE;
+  this->whiteSet = VK_NULL_HANDLE;
+
+  for (auto& vertexArena : this->vertexArenas) {
+    this->vertexArenas.at(vertexArena.first).shutDown();
+  }
+  this->indexArena.shutDown();
+
+  this->vertexArenas.clear();
+  this->sharedVertexData.clear();
+  this->vertexBufferKeys.clear();
+  this->meshRecords.clear();
+
+  for (auto& frame : this->frames) {
+    for (auto& chunk : frame.chunks) {
+      vkDestroyCommandPool(vkDevice, chunk.pool, nullptr);
+    }
+
+    this->device.destroyBuffer(frame.frameBlock);
+    this->device.destroyBuffer(frame.objects);
+    this->device.destroyBuffer(frame.palettes);
+
+    vkDestroyCommandPool(vkDevice, frame.pool, nullptr);
+    vkDestroySemaphore(vkDevice, frame.acquired, nullptr);
+    vkDestroyFence(vkDevice, frame.fence, nullptr);
+
+    frame = FrameResources {};
+  }
+
+  vkDestroyDescriptorPool(vkDevice, this->framePool, nullptr);
+  this->framePool = VK_NULL_HANDLE;
+
+  this->pipelineCache.shutDown();
+  this->swapchain.shutDown();
+  this->device.shutDown();
+
+  this->isInitialized = false;
+}
+
+// Vulkan objects aren't tied to a thread, so there's no context to hand over
+void Renderer::acquireContext() {
+}
+
+void Renderer::releaseContext() {
+}
+
+uint64_t Renderer::getContentKey(uint64_t contentHash) {
+  // Hashes take the top bit, so they never meet the counter
+  if (contentHash) {
+    return contentHash | (1ull << 63);
+  }
+
+  return this->nextUniqueKey++;
+}
+
+void Renderer::retire(BufferArena& arena, const BufferArena::Allocation& allocation) {
+  this->retired.push_back({ this->serial, &arena, allocation, {}, VK_NULL_HANDLE, VK_NULL_HANDLE });
+}
+
+void Renderer::releaseRetired() {
+  while (!this->retired.empty() && this->retired.front().serial <= this->completedSerial) {
+    Retired& entry = this->retired.front();
+
+    if (entry.arena) {
+      entry.arena->release(entry.allocation);
+    }
+
+    if (entry.descriptorSet != VK_NULL_HANDLE) {
+      vkFreeDescriptorSets(this->device.getDevice(), entry.pool, 1, &entry.descriptorSet);
+    }
+
+    this->device.destroyImage(entry.image);
+    this->retired.pop_front();
+  }
+}
+
+const Renderer::VertexAllocation& Renderer::uploadVertexBuffer(const Resource::VertexBuffer *vertexBuffer, unsigned stride) {
+  uint64_t& key = this->vertexBufferKeys[vertexBuffer->getHandle()];
+  if (!key) {
+    key = this->getContentKey(vertexBuffer->getContentHash());
+    this->sharedVertexData[key].users.push_back({ vertexBuffer->getHandle(), vertexBuffer });
+  }
+
+  SharedVertexData& shared = this->sharedVertexData.at(key);
+  for (auto& allocation : shared.allocations) {
+    if (allocation.stride == stride) {
+      return allocation;
+    }
+  }
+
+  if (!this->vertexArenas.contains(stride)) {
+    this->vertexArenas[stride].initialize(&this->device, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  }
+
+  BufferArena& arena = this->vertexArenas.at(stride);
+  shared.allocations.push_back({ stride, arena.allocate(vertexBuffer->getSize(), stride) });
+
+  const ContentUser<Resource::VertexBuffer>& uploader = shared.users.front();
+  const BufferArena::Allocation& allocation = shared.allocations.back().allocation;
+  this->uploadQueue.pushBuffer(uploader.handle, allocation.buffer, allocation.offset, allocation.size, uploader.resource->getData());
+
+  return shared.allocations.back();
+}
+
+void Renderer::releaseVertexBuffer(const Resource::ResourceHandle& handle) {
+  uint64_t key = this->vertexBufferKeys.at(handle);
+  SharedVertexData& shared = this->sharedVertexData.at(key);
+
+  bool wasUploading = shared.users.front().handle == handle && this->uploadQueue.isPending(handle);
+  this->uploadQueue.cancel(handle);
+
+  std::erase_if(shared.users, [&handle] (const ContentUser<Resource::VertexBuffer>& user) {
+    return user.handle == handle;
+  });
+
+  if (shared.users.empty()) {
+    for (auto& allocation : shared.allocations) {
+      this->retire(this->vertexArenas.at(allocation.stride), allocation.allocation);
+    }
+
+    this->sharedVertexData.erase(key);
+  } else if (wasUploading) {
+    const ContentUser<Resource::VertexBuffer>& uploader = shared.users.front();
+    for (auto& allocation : shared.allocations) {
+      this->uploadQueue.pushBuffer(uploader.handle, allocation.allocation.buffer, allocation.allocation.offset, allocation.allocation.size, uploader.resource->getData());
+    }
+  }
+
+  this->vertexBufferKeys.erase(handle);
+}
+
+void Renderer::registerMeshes(const std::vector<const Resource::Mesh *>& meshes) {
+  for (auto mesh : meshes) {
+    // Meshes never change once loaded, so registering one again keeps what
+    // was made for it
+    if (this->meshRecords.contains(mesh->getHandle())) {
+      continue;
+    }
+
+    unsigned stride = mesh->getVertexLayout().getStride();
+    const VertexAllocation& vertexAllocation = this->uploadVertexBuffer(mesh->getVertexBuffer(), stride);
+
+    MeshRecord record;
+    record.vertexBuffer = vertexAllocation.allocation.buffer;
+    record.baseVertex = vertexAllocation.allocation.offset / stride;
+    record.vertexKey = this->vertexBufferKeys.at(mesh->getVertexBuffer()->getHandle());
+
+    // Pack every surface's indices back to back in one allocation
+    std::vector<uint16_t>& indices = record.pendingIndices;
+
+    for (auto surface : mesh->getSurfaces()) {
+      SurfaceRecord surfaceRecord;
+      surfaceRecord.primitiveType = surface->getPrimitiveType();
+
+      const std::vector<Resource::IndexBuffer *>& lods = surface->getLods();
+      for (unsigned level = 0; level < Resource::Mesh::MAX_LODS; level++) {
+        if (level > lods.size()) {
+          surfaceRecord.counts[level] = surfaceRecord.counts[level - 1];
+          surfaceRecord.firstIndices[level] = surfaceRecord.firstIndices[level - 1];
+          continue;
+        }
+
+        const Resource::IndexBuffer *levelIndices = level ? lods[level - 1] : surface->getIndexBuffer();
+        surfaceRecord.counts[level] = levelIndices->getCount();
+        surfaceRecord.firstIndices[level] = indices.size();
+
+        indices.insert(indices.end(), levelIndices->getData(), levelIndices->getData() + levelIndices->getCount());
+      }
+
+      record.surfaces.push_back(surfaceRecord);
+    }
+
+    record.indices = this->indexArena.allocate(indices.size() * sizeof(uint16_t), sizeof(uint16_t));
+    for (auto& surfaceRecord : record.surfaces) {
+      for (uint32_t& firstIndex : surfaceRecord.firstIndices) {
+        firstIndex += record.indices.offset / sizeof(uint16_t);
+      }
+    }
+
+    // Moving the record keeps the indices where they are, so the queue can
+    // read them from there
+    MeshRecord& stored = this->meshRecords[mesh->getHandle()] = std::move(record);
+    this->uploadQueue.pushBuffer(mesh->getHandle(), stored.indices.buffer, stored.indices.offset, stored.indices.size, stored.pendingIndices.data());
+
+    this->pendingMeshes.push_back(mesh->getHandle());
+  }
+}
+
+void Renderer::registerTextures(const std::vector<const Resource::Texture *>& textures) {
+  for (auto texture : textures) {
+    // Registering a texture again replaces what was made for it
+    if (this->textureRecords.contains(texture->getHandle())) {
+      this->releaseTexture(texture->getHandle());
+    }
+
+    uint64_t key = this->getContentKey(texture->getContentHash());
+    if (!this->sharedTextures.contains(key)) {
+      this->sharedTextures[key] = this->createTexture(texture);
+    }
+
+    this->sharedTextures.at(key).users.push_back({ texture->getHandle(), texture });
+    this->textureRecords[texture->getHandle()] = { key, false };
+    this->pendingTextures.push_back(texture->getHandle());
+  }
+}
+
+VkDescriptorSet Renderer::allocateMaterialSet(VkImageView view, VkDescriptorPool& pool) {
+  VkDevice vkDevice = this->device.getDevice();
+  VkDescriptorSetLayout setLayout = this->pipelineCache.getSetLayout(DescriptorSet::MATERIAL);
+
+  VkDescriptorSetAllocateInfo setInfo {};
+  setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  setInfo.descriptorSetCount = 1;
+  setInfo.pSetLayouts = &setLayout;
+
+  VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  VkResult result = VK_ERROR_OUT_OF_POOL_MEMORY;
+  if (!this->materialPools.empty()) {
+    setInfo.descriptorPool = this->materialPools.back();
+    result = vkAllocateDescriptorSets(vkDevice, &setInfo, &descriptorSet);
+  }
+
+  // A full pool is left to drain as its textures go
+  if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+    VkDescriptorPoolSize poolSize { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MATERIAL_POOL_SIZE };
+
+    VkDescriptorPoolCreateInfo poolInfo {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    poolInfo.maxSets = MATERIAL_POOL_SIZE;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+
+    VkDescriptorPool newPool;
+    check(vkCreateDescriptorPool(vkDevice, &poolInfo, nullptr, &newPool), "vkCreateDescriptorPool");
+    this->materialPools.push_back(newPool);
+
+    setInfo.descriptorPool = newPool;
+    result = vkAllocateDescriptorSets(vkDevice, &setInfo, &descriptorSet);
+  }
+
+  check(result, "vkAllocateDescriptorSets");
+  pool = setInfo.descriptorPool;
+
+  // The sampler is immutable in the layout, so only the view is written
+  VkDescriptorImageInfo imageInfo { VK_NULL_HANDLE, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+  VkWriteDescriptorSet write {};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = descriptorSet;
+  write.dstBinding = 0;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.pImageInfo = &imageInfo;
+  vkUpdateDescriptorSets(vkDevice, 1, &write, 0, nullptr);
+
+  return descriptorSet;
+}
+
+Renderer::SharedTexture Renderer::createTexture(const Resource::Texture *texture) {
+  const std::vector<Resource::Texture::Level *>& levels = texture->getLevels();
+
+  SharedTexture shared {};
+  shared.image = this->device.createImage(getTextureFormat(texture), texture->getWidth(), texture->getHeight(), std::max<size_t>(levels.size(), 1), VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+  shared.descriptorSet = this->allocateMaterialSet(shared.image.view, shared.pool);
+
+  this->textureMemory += shared.image.size;
+  this->queueTextureUpload(texture, shared);
+
+  return shared;
+}
+
+void Renderer::queueTextureUpload(const Resource::Texture *texture, const SharedTexture& shared) {
+  // Smallest first, as in GL, so the cheap levels aren't held up
+  const std::vector<Resource::Texture::Level *>& levels = texture->getLevels();
+  for (size_t i = levels.size(); i-- > 0;) {
+    const Resource::Texture::Level *level = levels[i];
+
+    UploadQueue::TextureLevel target {
+      level->getLevel(),
+      std::max<uint32_t>(texture->getWidth() >> level->getLevel(), 1),
+      std::max<uint32_t>(texture->getHeight() >> level->getLevel(), 1),
+    };
+
+    this->uploadQueue.pushTextureLevel(texture->getHandle(), shared.image.image, target, level->getSize(), level->getData());
+  }
+}
+
+void Renderer::releaseTexture(const Resource::ResourceHandle& handle) {
+  uint64_t key = this->textureRecords.at(handle).key;
+  SharedTexture& shared = this->sharedTextures.at(key);
+
+  bool wasUploading = shared.users.front().handle == handle && this->uploadQueue.isPending(handle);
+  this->uploadQueue.cancel(handle);
+
+  std::erase_if(shared.users, [&handle] (const ContentUser<Resource::Texture>& user) {
+    return user.handle == handle;
+  });
+
+  if (shared.users.empty()) {
+    this->retired.push_back({ this->serial, nullptr, {}, shared.image, shared.pool, shared.descriptorSet });
+
+    this->textureMemory -= shared.image.size;
+    this->sharedTextures.erase(key);
+  } else if (wasUploading) {
+    this->queueTextureUpload(shared.users.front().resource, shared);
+  }
+
+  this->textureRecords.erase(handle);
+}
+
+void Renderer::registerVertexBuffers(const std::vector<const Resource::VertexBuffer *>&) {
+  // Vertex data is packed by stride, which only the meshes know, so it's
+  // uploaded as the meshes using it are registered
+}
+
+void Renderer::unregisterResources(const std::vector<Resource::ResourceHandle>& handles) {
+  for (auto& handle : handles) {
+    // Shared content checks for its uploader's copies before they're
+    // cancelled
+    if (this->textureRecords.contains(handle)) {
+      this->releaseTexture(handle);
+    }
+
+    MeshRecord *record = this->meshRecords.find(handle);
+    if (record) {
+      this->retire(this->indexArena, record->indices);
+      this->meshRecords.erase(handle);
+    }
+
+    if (this->vertexBufferKeys.contains(handle)) {
+      this->releaseVertexBuffer(handle);
+    }
+
+    this->uploadQueue.cancel(handle);
+  }
+
+  std::erase_if(this->pendingMeshes, [this] (const Resource::ResourceHandle& pending) {
+    return !this->meshRecords.contains(pending);
+  });
+
+  std::erase_if(this->pendingTextures, [this] (const Resource::ResourceHandle& pending) {
+    return !this->textureRecords.contains(pending);
+  });
+}
+
+bool Renderer::isMeshReady(const Resource::ResourceHandle& mesh) const {
+  const MeshRecord *record = this->meshRecords.find(mesh);
+
+  return record && record->isReady;
+}
+
+bool Renderer::composesSkinPalettes() const {
+  return false;
+}
+
+void Renderer::updatePendingUploads() {
+  std::erase_if(this->pendingTextures, [this] (const Resource::ResourceHandle& pending) {
+    TextureRecord& record = this->textureRecords.at(pending);
+
+    const SharedTexture& shared = this->sharedTextures.at(record.key);
+    if (this->uploadQueue.isPending(shared.users.front().handle)) {
+      return false;
+    }
+
+    record.isReady = true;
+
+    return true;
+  });
+
+  std::erase_if(this->pendingMeshes, [this] (const Resource::ResourceHandle& pending) {
+    if (this->uploadQueue.isPending(pending)) {
+      return false;
+    }
+
+    MeshRecord& record = this->meshRecords.at(pending);
+
+    auto vertexData = this->sharedVertexData.find(record.vertexKey);
+    if (vertexData != this->sharedVertexData.end() && this->uploadQueue.isPending(vertexData->second.users.front().handle)) {
+      return false;
+    }
+
+    record.isReady = true;
+    record.pendingIndices.clear();
+    record.pendingIndices.shrink_to_fit();
+
+    return true;
+  });
+}
+
+Mortar::Render::RenderStats Renderer::getRenderStats() const {
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+
+  return this->stats;
+}
+
+void Renderer::endFrame() {
+  this->frameStats.submitTime = (SDL_GetPerformanceCounter() - this->frameStart) * 1000.0f / SDL_GetPerformanceFrequency();
+
+  this->frameStats.bufferMemory = this->indexArena.getReservedSize();
+  for (auto& arena : this->vertexArenas) {
+    this->frameStats.bufferMemory += arena.second.getReservedSize();
+  }
+  this->frameStats.textureMemory = this->textureMemory;
+
+#ifdef MORTAR_PROFILE
+  Profiler::counter("draw calls", this->frameStats.drawCalls);
+  Profiler::counter("triangles", this->frameStats.triangles);
+  Profiler::counter("state changes", this->frameStats.stateChanges);
+  Profiler::counter("bytes uploaded", this->frameStats.bytesUploaded);
+  Profiler::counter("gpu buffer memory", this->frameStats.bufferMemory);
+  Profiler::counter("gpu texture memory", this->frameStats.textureMemory);
+#endif
+
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+  this->stats = this->frameStats;
+}
+
+void Renderer::writeFrameBuffer(FrameResources& frame, Buffer& buffer, FrameBinding binding, const void *data, VkDeviceSize size) {
+  if (size > buffer.size) {
+    // Grown by half again, so a scene that keeps growing doesn't reallocate
+    // every frame
+    VkDeviceSize newSize = std::max(size, buffer.size + buffer.size / 2);
+
+    this->device.destroyBuffer(buffer);
+    buffer = this->device.createBuffer(newSize, frameBufferUsage[static_cast<size_t>(binding)], true);
+
+    VkDescriptorBufferInfo bufferInfo { buffer.buffer, 0, VK_WHOLE_SIZE };
+
+    VkWriteDescriptorSet write {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = frame.descriptorSet;
+    write.dstBinding = static_cast<uint32_t>(binding);
+    write.descriptorCount = 1;
+    write.descriptorType = binding == FrameBinding::FRAME_BLOCK ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(this->device.getDevice(), 1, &write, 0, nullptr);
+  }
+
+  if (data) {
+    memcpy(buffer.mapped, data, size);
+  }
+}
+
+void Renderer::preparePipelines(DrawBatch& batch, const PipelineKey& key) {
+  batch.pipelines.fill(VK_NULL_HANDLE);
+
+  for (auto& surface : batch.record->surfaces) {
+    VkPipeline& pipeline = batch.pipelines[static_cast<size_t>(surface.primitiveType)];
+    if (pipeline == VK_NULL_HANDLE) {
+      PipelineKey surfaceKey = key;
+      surfaceKey.primitiveType = surface.primitiveType;
+      pipeline = this->pipelineCache.getPipeline(surfaceKey);
+    }
+  }
+}
+
+void Renderer::prepareBatches(const FramePacket& packet) {
+  PROFILE_ZONE("Renderer::prepareBatches");
+
+  this->prepassBatches.clear();
+  this->batches.clear();
+  this->objects.clear();
+  this->paletteEntries.clear();
+  this->skinConstants.clear();
+  this->paletteBases.clear();
+
+  // Static geometry goes down front-to-back with color writes off, so the
+  // color pass shades only the fragments that end up visible
+  std::span<const FramePacket::PrepassDraw> prepass = packet.getPrepass();
+  for (const FramePacket::PrepassDraw& draw : prepass) {
+    const Resource::Mesh *mesh = draw.geom->getMesh();
+    Resource::ShaderType shaderType = mesh->getShaderType();
+
+    const MeshRecord *record = this->meshRecords.find(mesh->getHandle());
+    if (!record || !record->isReady || !this->pipelineCache.supportsFeatures(shaderType, DEPTH_ONLY)) {
+      continue;
+    }
+
+    // Depth-only draws only read their transforms
+    ObjectData object {};
+    memcpy(object.meshTransformMtx, draw.geom->getWorldTransform().f, sizeof(object.meshTransformMtx));
+
+    DrawBatch batch { mesh, record, 1, static_cast<uint32_t>(this->objects.size()), 0, 0, DEPTH_ONLY, draw.geom->getLodLevel(), false, this->whiteSet, {} };
+    this->preparePipelines(batch, { shaderType, DEPTH_ONLY, &mesh->getVertexLayout(), Resource::PrimitiveType::TRIANGLE_LIST, false, false });
+
+    this->objects.push_back(object);
+    this->prepassBatches.push_back(batch);
+  }
+
+  bool afterPrepass = !prepass.empty();
+
+  std::span<const RenderQueue::Item> items = packet.getQueue().getItems();
+  for (auto item = items.begin(); item != items.end();) {
+    const Resource::GeomObject *geom = item->geom;
+    const Resource::Mesh *mesh = geom->getMesh();
+    const Resource::Material *material = mesh->getMaterial();
+
+    // Meshes still uploading are left out until they're complete
+    const MeshRecord *record = this->meshRecords.find(mesh->getHandle());
+    if (!record || !record->isReady) {
+      item++;
+      continue;
+    }
+
+    Resource::ShaderType shaderType = mesh->getShaderType();
+    bool isSkinned = shaderType == Resource::ShaderType::SKIN;
+
+    // Sorting leaves repeated placements of a mesh next to each other, so a
+    // run of them becomes one instanced draw. Skinned meshes read a palette
+    // per placement, so they're drawn one at a time.
+    auto runEnd = item + 1;
+    if (!isSkinned) {
+      while (runEnd != items.end() && runEnd->geom->getMesh() == mesh && runEnd->geom->getLodLevel() == geom->getLodLevel()) {
+        runEnd++;
+      }
+    }
+
+    DrawBatch batch { mesh, record, static_cast<unsigned>(runEnd - item), static_cast<uint32_t>(this->objects.size()), 0, 0, 0, geom->getLodLevel(), isSkinned, this->whiteSet, {} };
+
+    ObjectData object {};
+    memcpy(object.materialColor, material->getColor(), 3 * sizeof(float));
+
+    /* Ensure that fragment colors come from the right place. */
+    const Resource::Texture *texture = material->getTexture();
+    const TextureRecord *textureRecord = texture ? this->textureRecords.find(texture->getHandle()) : nullptr;
+    if (textureRecord && textureRecord->isReady) {
+      batch.features |= TEXTURED;
+      batch.material = this->sharedTextures.at(textureRecord->key).descriptorSet;
+
+      for (int i = 0; i < 3; i++) {
+        object.materialColor[i] *= 0.5f;
+      }
+    }
+
+    // Meshes whose blend indices were rewritten at load skip the per-surface
+    // remap tables
+    if (mesh->getUsesPaletteIndices() && this->pipelineCache.supportsFeatures(shaderType, PALETTE_INDEXED)) {
+      batch.features |= PALETTE_INDEXED;
+    }
+
+    for (auto placement = item; placement != runEnd; placement++) {
+      memcpy(object.meshTransformMtx, placement->geom->getWorldTransform().f, sizeof(object.meshTransformMtx));
+      this->objects.push_back(object);
+    }
+
+    item = runEnd;
+
+    if (isSkinned) {
+      // Each palette goes up once per frame, however many meshes share it
+      const Resource::SkinPalette *palette = geom->getSkinPalette();
+      if (!palette) {
+        throw std::runtime_error("skinned geometry without a palette");
+      }
+
+      uint32_t *paletteBase = this->paletteBases.find(palette->getHandle());
+      if (!paletteBase) {
+        paletteBase = &(this->paletteBases[palette->getHandle()] = this->paletteEntries.size());
+
+        for (const Math::Affine& transform : palette->getTransforms()) {
+          PaletteEntry entry;
+          memcpy(entry.columns, transform.f, sizeof(entry.columns));
+          this->paletteEntries.push_back(entry);
+        }
+      }
+
+      batch.paletteBase = *paletteBase;
+
+      if (!(batch.features & PALETTE_INDEXED)) {
+        batch.firstSkinConstants = this->skinConstants.size();
+
+        for (auto surface : mesh->getSurfaces()) {
+          const std::vector<ushort>& indices = surface->getSkinTransformIndices();
+          unsigned count = surface->getSkinTransformCount();
+
+          assert(count <= 16);
+
+          DrawConstants constants {};
+          constants.paletteBase = batch.paletteBase;
+          for (unsigned i = 0; i < count; i++) {
+            constants.skinIndices[i] = indices.at(i);
+          }
+
+          this->skinConstants.push_back(constants);
+        }
+      }
+    }
+
+    this->preparePipelines(batch, { shaderType, batch.features, &mesh->getVertexLayout(), Resource::PrimitiveType::TRIANGLE_LIST, material->isAlphaBlended(), afterPrepass });
+    this->batches.push_back(batch);
+  }
+}
+
+void Renderer::recordChunk(FrameResources& frame, size_t index, VkFramebuffer framebuffer) {
+  const Chunk& chunk = this->chunks[index];
+  ChunkCommands& chunkCommands = frame.chunks[index];
+  VkCommandBuffer commands = chunkCommands.commands;
+  RenderStats& stats = chunkCommands.stats;
+
+  stats = {};
+
+  VkCommandBufferInheritanceInfo inheritance {};
+  inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritance.renderPass = this->swapchain.getRenderPass();
+  inheritance.subpass = 0;
+  inheritance.framebuffer = framebuffer;
+
+  VkCommandBufferBeginInfo beginInfo {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  beginInfo.pInheritanceInfo = &inheritance;
+  check(vkBeginCommandBuffer(commands, &beginInfo), "vkBeginCommandBuffer");
+
+  // Secondary buffers inherit no state, so each sets up its own
+  VkExtent2D extent = this->swapchain.getExtent();
+  VkViewport viewport { 0.0f, 0.0f, (float)extent.width, (float)extent.height, 0.0f, 1.0f };
+  VkRect2D scissor { { 0, 0 }, extent };
+  vkCmdSetViewport(commands, 0, 1, &viewport);
+  vkCmdSetScissor(commands, 0, 1, &scissor);
+
+  VkPipelineLayout layout = this->pipelineCache.getLayout();
+  vkCmdBindDescriptorSets(commands, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, static_cast<uint32_t>(DescriptorSet::FRAME), 1, &frame.descriptorSet, 0, nullptr);
+
+  VkDeviceSize defaultsOffset = 0;
+  vkCmdBindVertexBuffers(commands, PipelineCache::DEFAULTS_BINDING, 1, &this->vertexDefaults.buffer, &defaultsOffset);
+
+  // Draws arrive sorted by state, so only changes are recorded
+  VkPipeline currentPipeline = VK_NULL_HANDLE;
+  VkDescriptorSet currentMaterial = VK_NULL_HANDLE;
+  VkBuffer currentVertexBuffer = VK_NULL_HANDLE;
+  VkBuffer currentIndexBuffer = VK_NULL_HANDLE;
+  uint32_t currentPalette = UINT32_MAX;
+
+  for (size_t i = chunk.begin; i < chunk.end; i++) {
+    const DrawBatch& batch = (*chunk.batches)[i];
+    const MeshRecord& record = *batch.record;
+
+    if (batch.material != currentMaterial) {
+      vkCmdBindDescriptorSets(commands, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, static_cast<uint32_t>(DescriptorSet::MATERIAL), 1, &batch.material, 0, nullptr);
+      currentMaterial = batch.material;
+      stats.stateChanges++;
+    }
+
+    if (record.vertexBuffer != currentVertexBuffer) {
+      VkDeviceSize offset = 0;
+      vkCmdBindVertexBuffers(commands, 0, 1, &record.vertexBuffer, &offset);
+      currentVertexBuffer = record.vertexBuffer;
+      stats.stateChanges++;
+    }
+
+    if (record.indices.buffer != currentIndexBuffer) {
+      vkCmdBindIndexBuffer(commands, record.indices.buffer, 0, VK_INDEX_TYPE_UINT16);
+      currentIndexBuffer = record.indices.buffer;
+      stats.stateChanges++;
+    }
+
+    bool remapsSkin = batch.isSkinned && !(batch.features & PALETTE_INDEXED);
+    if (batch.isSkinned && !remapsSkin && batch.paletteBase != currentPalette) {
+      vkCmdPushConstants(commands, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &batch.paletteBase);
+      currentPalette = batch.paletteBase;
+    }
+
+    for (size_t s = 0; s < record.surfaces.size(); s++) {
+      const SurfaceRecord& surface = record.surfaces[s];
+
+      VkPipeline pipeline = batch.pipelines[static_cast<size_t>(surface.primitiveType)];
+      if (pipeline != currentPipeline) {
+        vkCmdBindPipeline(commands, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        currentPipeline = pipeline;
+        stats.stateChanges++;
+      }
+
+      if (remapsSkin) {
+        vkCmdPushConstants(commands, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants), &this->skinConstants[batch.firstSkinConstants + s]);
+        currentPalette = UINT32_MAX;
+      }
+
+      // Each placement's object is picked by its instance index
+      uint32_t count = surface.counts[batch.lodLevel];
+      vkCmdDrawIndexed(commands, count, batch.instanceCount, surface.firstIndices[batch.lodLevel], record.baseVertex, batch.firstObject);
+
+      stats.drawCalls++;
+      stats.triangles += countTriangles(surface.primitiveType, count) * batch.instanceCount;
+    }
+  }
+
+  check(vkEndCommandBuffer(commands), "vkEndCommandBuffer");
+}
+
+void Renderer::renderGeometry(const FramePacket& packet) {
+  PROFILE_ZONE("Renderer::renderGeometry");
+
+  if (!this->isInitialized) {
+    DEBUG("renderer not initialized");
+  }
+
+  VkDevice vkDevice = this->device.getDevice();
+
+  this->frameStart = SDL_GetPerformanceCounter();
+  this->frameStats = {};
+
+  // The slot's last frame must be done before anything it holds is reused
+  FrameResources& frame = this->frames[this->frameIndex];
+  {
+    PROFILE_ZONE("wait for frame");
+    check(vkWaitForFences(vkDevice, 1, &frame.fence, VK_TRUE, UINT64_MAX), "vkWaitForFences");
+  }
+
+  this->completedSerial = std::max(this->completedSerial, frame.serial);
+  this->releaseRetired();
+
+  VkExtent2D extent = this->swapchain.getExtent();
+  this->frameStats.renderWidth = extent.width;
+  this->frameStats.renderHeight = extent.height;
+
+  uint32_t imageIndex;
+  if (!this->swapchain.acquire(frame.acquired, imageIndex)) {
+    this->endFrame();
+    return;
+  }
+
+  VkFramebuffer framebuffer = this->swapchain.getFramebuffer(imageIndex);
+  extent = this->swapchain.getExtent();
+  this->frameStats.renderWidth = extent.width;
+  this->frameStats.renderHeight = extent.height;
+
+  check(vkResetFences(vkDevice, 1, &frame.fence), "vkResetFences");
+  frame.serial = ++this->serial;
+
+  vkResetCommandPool(vkDevice, frame.pool, 0);
+
+  VkCommandBufferBeginInfo beginInfo {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  check(vkBeginCommandBuffer(frame.commands, &beginInfo), "vkBeginCommandBuffer");
+
+  // Copies are recorded ahead of the render pass, whether or not anything
+  // is drawn
+  this->frameStats.bytesUploaded += this->uploadQueue.process(frame.commands, frame.serial, this->completedSerial);
+  this->updatePendingUploads();
+
+  this->prepareBatches(packet);
+
+  Math::Matrix projViewMtx = packet.getView() * d3dTransform * packet.getProjection() * clipTransform;
+
+  FrameBlock frameBlock = frameLights;
+  memcpy(frameBlock.projViewMtx, projViewMtx.f, sizeof(frameBlock.projViewMtx));
+
+  this->writeFrameBuffer(frame, frame.frameBlock, FrameBinding::FRAME_BLOCK, &frameBlock, sizeof(frameBlock));
+  this->writeFrameBuffer(frame, frame.objects, FrameBinding::OBJECTS, this->objects.data(), this->objects.size() * sizeof(ObjectData));
+  this->writeFrameBuffer(frame, frame.palettes, FrameBinding::PALETTES, this->paletteEntries.data(), this->paletteEntries.size() * sizeof(PaletteEntry));
+  this->frameStats.bytesUploaded += sizeof(frameBlock) + this->objects.size() * sizeof(ObjectData) + this->paletteEntries.size() * sizeof(PaletteEntry);
+
+  // The pre-pass is chunked on its own so it's executed first
+  this->chunks.clear();
+  for (auto list : { &this->prepassBatches, &this->batches }) {
+    for (size_t begin = 0; begin < list->size(); begin += BATCHES_PER_CHUNK) {
+      this->chunks.push_back({ list, begin, std::min(begin + BATCHES_PER_CHUNK, list->size()) });
+    }
+  }
+
+  while (frame.chunks.size() < this->chunks.size()) {
+    ChunkCommands chunkCommands {};
+
+    VkCommandPoolCreateInfo poolInfo {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = this->device.getQueueFamily();
+    check(vkCreateCommandPool(vkDevice, &poolInfo, nullptr, &chunkCommands.pool), "vkCreateCommandPool");
+
+    VkCommandBufferAllocateInfo commandsInfo {};
+    commandsInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandsInfo.commandPool = chunkCommands.pool;
+    commandsInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    commandsInfo.commandBufferCount = 1;
+    check(vkAllocateCommandBuffers(vkDevice, &commandsInfo, &chunkCommands.commands), "vkAllocateCommandBuffers");
+
+    frame.chunks.push_back(chunkCommands);
+  }
+
+  std::vector<VkCommandBuffer> secondaries;
+  for (size_t i = 0; i < this->chunks.size(); i++) {
+    vkResetCommandPool(vkDevice, frame.chunks[i].pool, 0);
+    secondaries.push_back(frame.chunks[i].commands);
+  }
+
+  {
+    PROFILE_ZONE("record chunks");
+    State::getJobSystem().parallelFor(this->chunks.size(), 1, [this, &frame, framebuffer] (size_t i) {
+      this->recordChunk(frame, i, framebuffer);
+    });
+  }
+
+  for (size_t i = 0; i < this->chunks.size(); i++) {
+    const RenderStats& chunkStats = frame.chunks[i].stats;
+    this->frameStats.drawCalls += chunkStats.drawCalls;
+    this->frameStats.triangles += chunkStats.triangles;
+    this->frameStats.stateChanges += chunkStats.stateChanges;
+  }
+
+  VkClearValue clearValues[2] {};
+  clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+  clearValues[1].depthStencil = { 1.0f, 0 };
+
+  VkRenderPassBeginInfo renderPassInfo {};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  renderPassInfo.renderPass = this->swapchain.getRenderPass();
+  renderPassInfo.framebuffer = framebuffer;
+  renderPassInfo.renderArea = { { 0, 0 }, extent };
+  renderPassInfo.clearValueCount = 2;
+  renderPassInfo.pClearValues = clearValues;
+
+  vkCmdBeginRenderPass(frame.commands, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  if (!secondaries.empty()) {
+    vkCmdExecuteCommands(frame.commands, secondaries.size(), secondaries.data());
+  }
+  vkCmdEndRenderPass(frame.commands);
+
+  check(vkEndCommandBuffer(frame.commands), "vkEndCommandBuffer");
+
+  VkSemaphore renderFinished = this->swapchain.getRenderFinished(imageIndex);
+  VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+  VkSubmitInfo submitInfo {};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.waitSemaphoreCount = 1;
+  submitInfo.pWaitSemaphores = &frame.acquired;
+  submitInfo.pWaitDstStageMask = &waitStage;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &frame.commands;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &renderFinished;
+  check(vkQueueSubmit(this->device.getQueue(), 1, &submitInfo, frame.fence), "vkQueueSubmit");
+
+  this->frameIndex = (this->frameIndex + 1) % FRAMES_IN_FLIGHT;
+
+  this->endFrame();
+
+  PROFILE_ZONE("present");
+  this->swapchain.present(imageIndex);
+}
@@ -0,0 +1,287 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_VULKAN_RENDERER_H
+#define MORTAR_RENDER_VULKAN_RENDERER_H
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <tsl/sparse_map.h>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "../../math/matrix.hpp"
+#include "../../resource/handlemap.hpp"
+#include "../renderer.hpp"
+#include "../renderqueue.hpp"
+#include "bufferarena.hpp"
+#include "device.hpp"
+#include "pipelines.hpp"
+#include "swapchain.hpp"
+#include "uploadqueue.hpp"
+
+namespace Mortar::Render::Vulkan {
+  // Draws the same frames as the GL renderer, with each frame's sorted queue
+  // split into chunks that are recorded into secondary command buffers on
+  // the job system's workers. Everything a chunk reads, down to its
+  // pipelines and descriptor sets, is resolved serially beforehand, so
+  // recording touches nothing shared. Skin palettes are always composed on
+  // the CPU, and every texture level is uploaded with its texture.
+  class Renderer : public Mortar::Render::Renderer {
+    public:
+      Renderer() :
+        d3dTransform { Math::Matrix::diagonal(1.0f, 1.0f, -1.0f) },
+        clipTransform { std::array<float, 16> {
+          1.0f,  0.0f, 0.0f, 0.0f,
+          0.0f, -1.0f, 0.0f, 0.0f,
+          0.0f,  0.0f, 0.5f, 0.0f,
+          0.0f,  0.0f, 0.5f, 1.0f,
+        } } {};
+
+      void initialize() override;
+      void shutDown() override;
+
+      void acquireContext() override;
+      void releaseContext() override;
+
+      void registerMeshes(const std::vector<const Resource::Mesh *>& meshes) override;
+      void registerTextures(const std::vector<const Resource::Texture *>& textures) override;
+      void registerVertexBuffers(const std::vector<const Resource::VertexBuffer *>& vertexBuffers) override;
+
+      void unregisterResources(const std::vector<Resource::ResourceHandle>& handles) override;
+
+      bool isMeshReady(const Resource::ResourceHandle& mesh) const override;
+
+      bool composesSkinPalettes() const override;
+
+      void renderGeometry(const FramePacket& packet) override;
+
+      RenderStats getRenderStats() const override;
+
+      // Frames recorded while the GPU is still drawing earlier ones
+      static constexpr unsigned FRAMES_IN_FLIGHT = 2;
+
+      // Batches recorded per secondary command buffer; small enough that a
+      // frame splits across the workers, large enough that each buffer is
+      // worth its submission
+      static constexpr size_t BATCHES_PER_CHUNK = 64;
+
+    private:
+      Device device;
+      Swapchain swapchain;
+      PipelineCache pipelineCache;
+      UploadQueue uploadQueue;
+      bool isInitialized = false;
+
+      // Resources with the same content hash share what's made for them on
+      // the GPU, under a key for that content, as in the GL renderer
+      template <typename T>
+      struct ContentUser {
+        Resource::ResourceHandle handle;
+        const T *resource;
+      };
+
+      uint64_t nextUniqueKey = 1;
+      uint64_t getContentKey(uint64_t contentHash);
+
+      // Vertex data is placed by stride so that every vertex lands on a
+      // whole-vertex offset and can be addressed by base vertex
+      struct VertexAllocation {
+        unsigned stride;
+        BufferArena::Allocation allocation;
+      };
+
+      struct SharedVertexData {
+        std::vector<VertexAllocation> allocations;
+        std::vector<ContentUser<Resource::VertexBuffer>> users;
+      };
+
+      BufferArena indexArena;
+      tsl::sparse_map<unsigned, BufferArena> vertexArenas;
+      tsl::sparse_map<uint64_t, SharedVertexData> sharedVertexData;
+      Resource::HandleMap<uint64_t> vertexBufferKeys;
+
+      const VertexAllocation& uploadVertexBuffer(const Resource::VertexBuffer *vertexBuffer, unsigned stride);
+      void releaseVertexBuffer(const Resource::ResourceHandle& handle);
+
+      // Levels a surface has no index set for repeat its coarsest one
+      struct SurfaceRecord {
+        Resource::PrimitiveType primitiveType;
+        uint32_t counts[Resource::Mesh::MAX_LODS];
+        uint32_t firstIndices[Resource::Mesh::MAX_LODS];
+      };
+
+      // All of a mesh's index data is one allocation; its packed indices are
+      // kept until they've been uploaded
+      struct MeshRecord {
+        VkBuffer vertexBuffer;
+        int32_t baseVertex;
+        uint64_t vertexKey;
+
+        BufferArena::Allocation indices;
+        std::vector<SurfaceRecord> surfaces;
+
+        bool isReady = false;
+        std::vector<uint16_t> pendingIndices;
+      };
+
+      Resource::HandleMap<MeshRecord> meshRecords;
+      std::vector<Resource::ResourceHandle> pendingMeshes;
+
+      // Each texture's descriptor set is written once, as it's created, and
+      // kept until the texture goes; sets come from pools made as they fill
+      struct SharedTexture {
+        Image image;
+        VkDescriptorPool pool;
+        VkDescriptorSet descriptorSet;
+        std::vector<ContentUser<Resource::Texture>> users;
+      };
+
+      struct TextureRecord {
+        uint64_t key;
+        bool isReady;
+      };
+
+      tsl::sparse_map<uint64_t, SharedTexture> sharedTextures;
+      Resource::HandleMap<TextureRecord> textureRecords;
+      std::vector<Resource::ResourceHandle> pendingTextures;
+      uint64_t textureMemory = 0;
+
+      std::vector<VkDescriptorPool> materialPools;
+      VkDescriptorSet allocateMaterialSet(VkImageView view, VkDescriptorPool& pool);
+
+      SharedTexture createTexture(const Resource::Texture *texture);
+      void queueTextureUpload(const Resource::Texture *texture, const SharedTexture& shared);
+      void releaseTexture(const Resource::ResourceHandle& handle);
+
+      // Bound for draws without a texture ready, which never sample it
+      Image whiteImage;
+      VkDescriptorPool whitePool = VK_NULL_HANDLE;
+      VkDescriptorSet whiteSet = VK_NULL_HANDLE;
+
+      // The stride-0 vertex input defaults
+      Buffer vertexDefaults;
+
+      // Marks the meshes and textures whose uploads have finished
+      void updatePendingUploads();
+
+      // Frames are numbered as they're recorded; what's freed while a frame
+      // that may use it is in flight waits here for that frame to complete
+      uint64_t serial = 0;
+      uint64_t completedSerial = 0;
+
+      struct Retired {
+        uint64_t serial;
+        BufferArena *arena;
+        BufferArena::Allocation allocation;
+        Image image;
+        VkDescriptorPool pool;
+        VkDescriptorSet descriptorSet;
+      };
+
+      std::deque<Retired> retired;
+      void retire(BufferArena& arena, const BufferArena::Allocation& allocation);
+      void releaseRetired();
+
+      // Each chunk has a command pool of its own, so whichever thread
+      // records it needs no lock
+      struct ChunkCommands {
+        VkCommandPool pool;
+        VkCommandBuffer commands;
+        RenderStats stats;
+      };
+
+      // Everything a frame in flight holds until its fence signals. The
+      // frame's blocks go into its own host-visible buffers, read through its
+      // own descriptor set.
+      struct FrameResources {
+        VkFence fence;
+        VkSemaphore acquired;
+        VkCommandPool pool;
+        VkCommandBuffer commands;
+        uint64_t serial;
+
+        Buffer frameBlock;
+        Buffer objects;
+        Buffer palettes;
+        VkDescriptorSet descriptorSet;
+
+        std::vector<ChunkCommands> chunks;
+      };
+
+      std::array<FrameResources, FRAMES_IN_FLIGHT> frames {};
+      unsigned frameIndex = 0;
+      VkDescriptorPool framePool = VK_NULL_HANDLE;
+
+      // Grows one of a frame's buffers to hold size bytes, pointing its
+      // descriptor at the new one, then fills it
+      void writeFrameBuffer(FrameResources& frame, Buffer& buffer, FrameBinding binding, const void *data, VkDeviceSize size);
+
+      // One batch per placement, or per run of placements of the same
+      // unskinned mesh, which draw instanced. Pipelines are by primitive
+      // type, for the types the mesh's surfaces use.
+      struct DrawBatch {
+        const Resource::Mesh *mesh;
+        const MeshRecord *record;
+        unsigned instanceCount;
+        uint32_t firstObject;
+        uint32_t paletteBase;
+        uint32_t firstSkinConstants;
+        uint32_t features;
+        unsigned lodLevel;
+        bool isSkinned;
+        VkDescriptorSet material;
+        std::array<VkPipeline, 3> pipelines;
+      };
+
+      std::vector<DrawBatch> prepassBatches;
+      std::vector<DrawBatch> batches;
+      std::vector<ObjectData> objects;
+      std::vector<PaletteEntry> paletteEntries;
+      std::vector<DrawConstants> skinConstants;
+      Resource::HandleMap<uint32_t> paletteBases;
+
+      // Resolves everything the frame's draws read, in queue order
+      void prepareBatches(const FramePacket& packet);
+      void preparePipelines(DrawBatch& batch, const PipelineKey& key);
+
+      // Chunks cover the pre-pass batches and then the rest, never both
+      struct Chunk {
+        const std::vector<DrawBatch> *batches;
+        size_t begin;
+        size_t end;
+      };
+
+      std::vector<Chunk> chunks;
+      void recordChunk(FrameResources& frame, size_t index, VkFramebuffer framebuffer);
+
+      // Counted over the frame being drawn, then published for other threads
+      RenderStats frameStats;
+      uint64_t frameStart;
+
+      mutable std::mutex statsMutex;
+      RenderStats stats {};
+
+      void endFrame();
+
+      // GL's clip space, then Vulkan's: y flipped, and depth from 0 to 1
+      const Math::Matrix d3dTransform;
+      const Math::Matrix clipTransform;
+  };
+}
+
+#endif
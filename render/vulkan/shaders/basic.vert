@@ -0,0 +1,21 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "blocks.glsl"
+
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) out vec4 fragColor;
+
+void main()
+{
+  fragTexCoord = texCoord;
+
+  vec3 transformedNormal = (getMeshTransform() * vec4(normal, 0.0)).xyz;
+
+  vec3 light2Color = max(dot(lightDirections[2].xyz, transformedNormal), 0) * lightColors[2].rgb;
+
+  // The GL programs sum only the last light with the ambient
+  fragColor = vec4(getMaterialColor().rgb * (light2Color + ambientColor.rgb), color.w);
+
+  gl_Position = projViewMtx * getMeshTransform() * vec4(position, 1.0);
+}
@@ -0,0 +1,51 @@
+// Shared by every stage, and mirrored by the structs in pipelines.hpp. Each
+// draw's object is indexed by its instance, so an instanced run is a run of
+// consecutive objects.
+
+layout(set = 0, binding = 0, std140) uniform FrameBlock {
+  mat4 projViewMtx;
+  vec4 lightDirections[3];
+  vec4 lightColors[3];
+  vec4 ambientColor;
+};
+
+struct ObjectData {
+  mat4 meshTransformMtx;
+  vec4 materialColor;
+  vec2 colorMultipliers;
+};
+
+layout(set = 0, binding = 1, std430) readonly buffer ObjectBlock {
+  ObjectData objects[];
+};
+
+layout(set = 0, binding = 2, std430) readonly buffer PaletteBlock {
+  mat3x4 skinPalette[];
+};
+
+// Where the draw's palette starts, and the surface's map from blend indices
+// into it where the mesh isn't palette indexed
+layout(push_constant) uniform DrawConstants {
+  uint paletteBase;
+  int skinIndices[16];
+};
+
+layout(constant_id = 0) const bool TEXTURED = false;
+layout(constant_id = 1) const bool PALETTE_INDEXED = false;
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 texCoord;
+layout(location = 3) in vec3 normal;
+layout(location = 4) in vec2 blendWeights;
+layout(location = 5) in vec3 blendIndices;
+
+invariant gl_Position;
+
+mat4 getMeshTransform() { return objects[gl_InstanceIndex].meshTransformMtx; }
+vec4 getMaterialColor() { return objects[gl_InstanceIndex].materialColor; }
+vec2 getColorMultipliers() { return objects[gl_InstanceIndex].colorMultipliers; }
+
+mat3x4 getSkinTransform(int blendIndex) {
+  return skinPalette[paletteBase + (PALETTE_INDEXED ? blendIndex : skinIndices[blendIndex])];
+}
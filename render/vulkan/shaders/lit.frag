@@ -0,0 +1,15 @@
+#version 450
+
+layout(constant_id = 0) const bool TEXTURED = false;
+
+layout(set = 1, binding = 0) uniform sampler2D materialTex;
+
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) in vec4 fragColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+  outColor = TEXTURED ? texture(materialTex, fragTexCoord) * fragColor * 2 : vec4(fragColor.xyz, fragColor.w * 2);
+}
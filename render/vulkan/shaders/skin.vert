@@ -0,0 +1,37 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "blocks.glsl"
+
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) out vec4 fragColor;
+
+void main()
+{
+  fragTexCoord = texCoord;
+
+  ivec3 intBlendIndices = ivec3(blendIndices);
+
+  float weight2 = 1 - blendWeights.x - blendWeights.y;
+
+  vec4 normal4 = vec4(normal, 0.0f);
+  vec3 normalBlend0 = (normal4 * getSkinTransform(intBlendIndices.x) * blendWeights.x).xyz;
+  vec3 normalBlend1 = (normal4 * getSkinTransform(intBlendIndices.y) * blendWeights.y).xyz;
+  vec3 normalBlend2 = (normal4 * getSkinTransform(intBlendIndices.z) * weight2).xyz;
+
+  vec3 transformedNormal = normalBlend0 + normalBlend1 + normalBlend2;
+
+  vec3 light2Color = max(dot(lightDirections[2].xyz, transformedNormal), 0) * lightColors[2].rgb;
+
+  // The GL programs sum only the last light with the ambient
+  fragColor = vec4(getMaterialColor().rgb * (light2Color + ambientColor.rgb), color.w);
+
+  vec4 position4 = vec4(position, 1.0f);
+  vec3 positionBlend0 = (position4 * getSkinTransform(intBlendIndices.x) * blendWeights.x).xyz;
+  vec3 positionBlend1 = (position4 * getSkinTransform(intBlendIndices.y) * blendWeights.y).xyz;
+  vec3 positionBlend2 = (position4 * getSkinTransform(intBlendIndices.z) * weight2).xyz;
+
+  vec3 transformedPosition = positionBlend0 + positionBlend1 + positionBlend2;
+
+  gl_Position = projViewMtx * vec4(transformedPosition, 1.0);
+}
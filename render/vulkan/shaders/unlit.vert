@@ -0,0 +1,19 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "blocks.glsl"
+
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) out vec4 fragColor;
+
+void main()
+{
+  fragTexCoord = texCoord;
+
+  vec3 adjustedVertColor = getColorMultipliers().x * vec3(color.xyz);
+  vec3 adjustedMatColor = getColorMultipliers().y * getMaterialColor().rgb;
+
+  fragColor = vec4(adjustedVertColor + adjustedMatColor, color.w);
+
+  gl_Position = projViewMtx * getMeshTransform() * vec4(position, 1.0);
+}
@@ -0,0 +1,350 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../../log.hpp"
+#include "../../state.hpp"
+#include "swapchain.hpp"
+
+using namespace Mortar::Render::Vulkan;
+
+void Swapchain::initialize(Device *device) {
+  this->device = device;
+
+  VkPhysicalDevice physicalDevice = device->getPhysicalDevice();
+
+  // Unnormalized BGRA like the GL window's, unless the surface can't take it
+  uint32_t formatCount = 0;
+  vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, device->getSurface(), &formatCount, nullptr);
+  std::vector<VkSurfaceFormatKHR> formats(formatCount);
+  vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, device->getSurface(), &formatCount, formats.data());
+
+  bool hasBGRA = std::any_of(formats.begin(), formats.end(), [] (const VkSurfaceFormatKHR& format) {
+    return format.format == VK_FORMAT_B8G8R8A8_UNORM || format.format == VK_FORMAT_UNDEFINED;
+  });
+
+  if (!hasBGRA && !formats.empty()) {
+    this->colorFormat = formats.front().format;
+  }
+
+  for (VkFormat candidate : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM }) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, candidate, &properties);
+    if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+      this->depthFormat = candidate;
+      break;
+    }
+  }
+
+  if (this->depthFormat == VK_FORMAT_UNDEFINED) {
+    throw std::runtime_error("no vulkan depth format");
+  }
+
+  VkAttachmentDescription attachments[2] {};
+  attachments[0].format = this->colorFormat;
+  attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+  attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  attachments[1].format = this->depthFormat;
+  attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+  attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference colorReference { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+  VkAttachmentReference depthReference { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+  VkSubpassDescription subpass {};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &colorReference;
+  subpass.pDepthStencilAttachment = &depthReference;
+
+  // The image is written only once it's been acquired, and the depth buffer
+  // once the last frame's tests are done with it
+  VkSubpassDependency dependency {};
+  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependency.dstSubpass = 0;
+  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  VkRenderPassCreateInfo renderPassInfo {};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = 2;
+  renderPassInfo.pAttachments = attachments;
+  renderPassInfo.subpassCount = 1;
+  renderPassInfo.pSubpasses = &subpass;
+  renderPassInfo.dependencyCount = 1;
+  renderPassInfo.pDependencies = &dependency;
+
+  check(vkCreateRenderPass(device->getDevice(), &renderPassInfo, nullptr, &this->renderPass), "vkCreateRenderPass");
+
+  this->isStale = true;
+}
+
+void Swapchain::shutDown() {
+  this->destroy();
+
+  if (this->swapchain != VK_NULL_HANDLE) {
+    vkDestroySwapchainKHR(this->device->getDevice(), this->swapchain, nullptr);
+    this->swapchain = VK_NULL_HANDLE;
+  }
+
+  if (this->renderPass != VK_NULL_HANDLE) {
+    vkDestroyRenderPass(this->device->getDevice(), this->renderPass, nullptr);
+    this->renderPass = VK_NULL_HANDLE;
+  }
+}
+
+VkPresentModeKHR Swapchain::choosePresentMode(DisplayManager::SwapInterval interval) const {
+  uint32_t modeCount = 0;
+  vkGetPhysicalDeviceSurfacePresentModesKHR(this->device->getPhysicalDevice(), this->device->getSurface(), &modeCount, nullptr);
+  std::vector<VkPresentModeKHR> modes(modeCount);
+  vkGetPhysicalDeviceSurfacePresentModesKHR(this->device->getPhysicalDevice(), this->device->getSurface(), &modeCount, modes.data());
+
+  auto hasMode = [&modes] (VkPresentModeKHR mode) {
+    return std::find(modes.begin(), modes.end(), mode) != modes.end();
+  };
+
+  // FIFO is always there, so every interval falls back to plain vsync
+  switch (interval) {
+    case DisplayManager::SwapInterval::ADAPTIVE:
+      if (hasMode(VK_PRESENT_MODE_FIFO_RELAXED_KHR)) {
+        return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+      }
+
+      DEBUG("adaptive vsync unsupported, using vsync");
+      break;
+    case DisplayManager::SwapInterval::IMMEDIATE:
+      if (hasMode(VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+        return VK_PRESENT_MODE_IMMEDIATE_KHR;
+      }
+
+      if (hasMode(VK_PRESENT_MODE_MAILBOX_KHR)) {
+        return VK_PRESENT_MODE_MAILBOX_KHR;
+      }
+
+      DEBUG("unable to present without vsync");
+      break;
+    case DisplayManager::SwapInterval::VSYNC:
+      break;
+  }
+
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+void Swapchain::create() {
+  VkDevice vkDevice = this->device->getDevice();
+
+  VkSurfaceCapabilitiesKHR capabilities;
+  check(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(this->device->getPhysicalDevice(), this->device->getSurface(), &capabilities), "vkGetPhysicalDeviceSurfaceCapabilitiesKHR");
+
+  // Surfaces that leave the size to us are sized as the window manager
+  // last told us
+  this->extent = capabilities.currentExtent;
+  if (this->extent.width == UINT32_MAX) {
+    this->extent.width = std::clamp<uint32_t>(this->width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+    this->extent.height = std::clamp<uint32_t>(this->height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+  }
+
+  VkSwapchainKHR oldSwapchain = this->swapchain;
+  this->swapchain = VK_NULL_HANDLE;
+
+  // Minimized windows have nothing to draw to until they're restored
+  if (this->extent.width == 0 || this->extent.height == 0) {
+    if (oldSwapchain != VK_NULL_HANDLE) {
+      vkDestroySwapchainKHR(vkDevice, oldSwapchain, nullptr);
+    }
+
+    return;
+  }
+
+  uint32_t imageCount = capabilities.minImageCount + 1;
+  if (capabilities.maxImageCount) {
+    imageCount = std::min(imageCount, capabilities.maxImageCount);
+  }
+
+  VkSwapchainCreateInfoKHR swapchainInfo {};
+  swapchainInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+  swapchainInfo.surface = this->device->getSurface();
+  swapchainInfo.minImageCount = imageCount;
+  swapchainInfo.imageFormat = this->colorFormat;
+  swapchainInfo.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+  swapchainInfo.imageExtent = this->extent;
+  swapchainInfo.imageArrayLayers = 1;
+  swapchainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  swapchainInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  swapchainInfo.preTransform = capabilities.currentTransform;
+  swapchainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+  swapchainInfo.presentMode = this->choosePresentMode(this->interval);
+  swapchainInfo.clipped = VK_TRUE;
+  swapchainInfo.oldSwapchain = oldSwapchain;
+
+  check(vkCreateSwapchainKHR(vkDevice, &swapchainInfo, nullptr, &this->swapchain), "vkCreateSwapchainKHR");
+
+  if (oldSwapchain != VK_NULL_HANDLE) {
+    vkDestroySwapchainKHR(vkDevice, oldSwapchain, nullptr);
+  }
+
+  vkGetSwapchainImagesKHR(vkDevice, this->swapchain, &imageCount, nullptr);
+  std::vector<VkImage> images(imageCount);
+  vkGetSwapchainImagesKHR(vkDevice, this->swapchain, &imageCount, images.data());
+
+  this->depth = this->device->createImage(this->depthFormat, this->extent.width, this->extent.height, 1, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+  for (VkImage image : images) {
+    VkImageViewCreateInfo viewInfo {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = this->colorFormat;
+    viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    VkImageView view;
+    check(vkCreateImageView(vkDevice, &viewInfo, nullptr, &view), "vkCreateImageView");
+    this->views.push_back(view);
+
+    VkImageView attachments[] = { view, this->depth.view };
+
+    VkFramebufferCreateInfo framebufferInfo {};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = this->renderPass;
+    framebufferInfo.attachmentCount = 2;
+    framebufferInfo.pAttachments = attachments;
+    framebufferInfo.width = this->extent.width;
+    framebufferInfo.height = this->extent.height;
+    framebufferInfo.layers = 1;
+
+    VkFramebuffer framebuffer;
+    check(vkCreateFramebuffer(vkDevice, &framebufferInfo, nullptr, &framebuffer), "vkCreateFramebuffer");
+    this->framebuffers.push_back(framebuffer);
+
+    VkSemaphoreCreateInfo semaphoreInfo {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkSemaphore semaphore;
+    check(vkCreateSemaphore(vkDevice, &semaphoreInfo, nullptr, &semaphore), "vkCreateSemaphore");
+    this->renderFinished.push_back(semaphore);
+  }
+}
+
+// Leaves the swapchain itself, so the next one can be made from it
+void Swapchain::destroy() {
+  VkDevice vkDevice = this->device->getDevice();
+
+  for (auto framebuffer : this->framebuffers) {
+    vkDestroyFramebuffer(vkDevice, framebuffer, nullptr);
+  }
+
+  for (auto view : this->views) {
+    vkDestroyImageView(vkDevice, view, nullptr);
+  }
+
+  for (auto semaphore : this->renderFinished) {
+    vkDestroySemaphore(vkDevice, semaphore, nullptr);
+  }
+
+  this->device->destroyImage(this->depth);
+
+  this->framebuffers.clear();
+  this->views.clear();
+  this->renderFinished.clear();
+}
+
+bool Swapchain::acquire(VkSemaphore acquired, uint32_t& imageIndex) {
+  // Read every frame, so a resized window or a new swap interval rebuilds
+  // the images before they're drawn to
+  DisplayManager& displayManager = State::getDisplayManager();
+  unsigned width = displayManager.getWidth();
+  unsigned height = displayManager.getHeight();
+  DisplayManager::SwapInterval interval = displayManager.getSwapInterval();
+
+  if (this->isStale || width != this->width || height != this->height || interval != this->interval) {
+    vkDeviceWaitIdle(this->device->getDevice());
+
+    this->width = width;
+    this->height = height;
+    this->interval = interval;
+    this->isStale = false;
+
+    this->destroy();
+    this->create();
+  }
+
+  if (this->swapchain == VK_NULL_HANDLE) {
+    this->isStale = true;
+    return false;
+  }
+
+  VkResult result = vkAcquireNextImageKHR(this->device->getDevice(), this->swapchain, UINT64_MAX, acquired, VK_NULL_HANDLE, &imageIndex);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    this->isStale = true;
+    return false;
+  }
+
+  if (result == VK_SUBOPTIMAL_KHR) {
+    this->isStale = true;
+  } else {
+    check(result, "vkAcquireNextImageKHR");
+  }
+
+  return true;
+}
+
+void Swapchain::present(uint32_t imageIndex) {
+  VkPresentInfoKHR presentInfo {};
+  presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+  presentInfo.waitSemaphoreCount = 1;
+  presentInfo.pWaitSemaphores = &this->renderFinished[imageIndex];
+  presentInfo.swapchainCount = 1;
+  presentInfo.pSwapchains = &this->swapchain;
+  presentInfo.pImageIndices = &imageIndex;
+
+  VkResult result = vkQueuePresentKHR(this->device->getQueue(), &presentInfo);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+    this->isStale = true;
+  } else {
+    check(result, "vkQueuePresentKHR");
+  }
+}
+
+VkRenderPass Swapchain::getRenderPass() const {
+  return this->renderPass;
+}
+
+VkFramebuffer Swapchain::getFramebuffer(uint32_t imageIndex) const {
+  return this->framebuffers[imageIndex];
+}
+
+VkSemaphore Swapchain::getRenderFinished(uint32_t imageIndex) const {
+  return this->renderFinished[imageIndex];
+}
+
+VkExtent2D Swapchain::getExtent() const {
+  return this->extent;
+}
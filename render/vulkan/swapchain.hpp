@@ -0,0 +1,80 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RENDER_VULKAN_SWAPCHAIN_H
+#define MORTAR_RENDER_VULKAN_SWAPCHAIN_H
+
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "../../display.hpp"
+#include "device.hpp"
+
+namespace Mortar::Render::Vulkan {
+  // The window's images, a depth buffer shared by all of them, and the one
+  // render pass every frame is drawn in. Rebuilt when the window is resized,
+  // when the swap interval changes, and when presenting finds the images no
+  // longer match the surface.
+  class Swapchain {
+    public:
+      void initialize(Device *device);
+      void shutDown();
+
+      // Takes the next image to draw to, signalling acquired once it's free.
+      // False while the window has no area to draw.
+      bool acquire(VkSemaphore acquired, uint32_t& imageIndex);
+
+      // Waits on the image's render-finished semaphore before presenting
+      void present(uint32_t imageIndex);
+
+      // Cleared to black and far depth, and left ready to present
+      VkRenderPass getRenderPass() const;
+      VkFramebuffer getFramebuffer(uint32_t imageIndex) const;
+      VkSemaphore getRenderFinished(uint32_t imageIndex) const;
+      VkExtent2D getExtent() const;
+
+    private:
+      void create();
+      void destroy();
+
+      VkPresentModeKHR choosePresentMode(DisplayManager::SwapInterval interval) const;
+
+      Device *device = nullptr;
+
+      VkFormat colorFormat = VK_FORMAT_B8G8R8A8_UNORM;
+      VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+      VkRenderPass renderPass = VK_NULL_HANDLE;
+
+      VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+      VkExtent2D extent {};
+      Image depth;
+
+      std::vector<VkImageView> views;
+      std::vector<VkFramebuffer> framebuffers;
+
+      // Per image rather than per frame, as an image's semaphore is only
+      // free again once it's been acquired anew
+      std::vector<VkSemaphore> renderFinished;
+
+      // What the images were built for, to tell when to rebuild
+      unsigned width = 0;
+      unsigned height = 0;
+      DisplayManager::SwapInterval interval = DisplayManager::SwapInterval::VSYNC;
+      bool isStale = true;
+  };
+}
+
+#endif
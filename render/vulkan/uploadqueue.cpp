@@ -0,0 +1,237 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <string.h>
+
+#include "../../profiler.hpp"
+#include "uploadqueue.hpp"
+
+using namespace Mortar::Render::Vulkan;
+
+void UploadQueue::initialize(Device *device, VkDeviceSize stagingSize) {
+  this->device = device;
+  this->staging = device->createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
+
+  this->head = 0;
+  this->used = 0;
+}
+
+// Only called once the device is idle, so nothing staged is still read
+void UploadQueue::shutDown() {
+  for (auto& batch : this->batches) {
+    for (auto& buffer : batch.oversized) {
+      this->device->destroyBuffer(buffer);
+    }
+  }
+
+  this->device->destroyBuffer(this->staging);
+
+  this->batches.clear();
+  this->queue.clear();
+  this->pending.clear();
+}
+
+void UploadQueue::pushBuffer(const Resource::ResourceHandle& owner, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, const void *data) {
+  if (size == 0 || data == nullptr) {
+    return;
+  }
+
+  this->queue.push_back({ owner, buffer, VK_NULL_HANDLE, offset, size, data, {} });
+  this->pending[owner]++;
+}
+
+void UploadQueue::pushTextureLevel(const Resource::ResourceHandle& owner, VkImage image, const TextureLevel& level, VkDeviceSize size, const void *data) {
+  if (size == 0 || data == nullptr) {
+    return;
+  }
+
+  this->queue.push_back({ owner, VK_NULL_HANDLE, image, 0, size, data, level });
+  this->pending[owner]++;
+}
+
+bool UploadQueue::isPending(const Resource::ResourceHandle& owner) const {
+  return this->pending.contains(owner);
+}
+
+void UploadQueue::cancel(const Resource::ResourceHandle& owner) {
+  if (!this->pending.contains(owner)) {
+    return;
+  }
+
+  std::erase_if(this->queue, [&owner] (const Copy& copy) {
+    return copy.owner == owner;
+  });
+
+  this->pending.erase(owner);
+}
+
+void UploadQueue::release(const Resource::ResourceHandle& owner) {
+  if (!this->pending.contains(owner)) {
+    return;
+  }
+
+  if (--this->pending.at(owner) == 0) {
+    this->pending.erase(owner);
+  }
+}
+
+void UploadQueue::retire(uint64_t completedSerial) {
+  while (!this->batches.empty() && this->batches.front().serial <= completedSerial) {
+    Batch& batch = this->batches.front();
+
+    this->used -= batch.consumed;
+    for (auto& owner : batch.owners) {
+      this->release(owner);
+    }
+
+    for (auto& buffer : batch.oversized) {
+      this->device->destroyBuffer(buffer);
+    }
+
+    this->batches.pop_front();
+  }
+}
+
+bool UploadQueue::reserve(VkDeviceSize size, VkDeviceSize& offset, VkDeviceSize& consumed) {
+  size = (size + 15) & ~(VkDeviceSize)15;
+
+  if (this->used == 0) {
+    this->head = 0;
+  }
+
+  // The oldest byte still in flight; the ring is full when it meets head
+  VkDeviceSize tail = (this->head + this->staging.size - this->used % this->staging.size) % this->staging.size;
+  bool wraps = this->used == 0 || this->head > tail;
+  VkDeviceSize end = wraps ? this->staging.size : tail;
+
+  if (this->head + size <= end) {
+    offset = this->head;
+    this->head = (this->head + size) % this->staging.size;
+    this->used += size;
+    consumed += size;
+
+    return true;
+  }
+
+  // Skip what's left at the end and start over from the beginning
+  if (this->used > 0 && wraps && size <= tail) {
+    VkDeviceSize skipped = this->staging.size - this->head;
+
+    offset = 0;
+    this->head = size;
+    this->used += skipped + size;
+    consumed += skipped + size;
+
+    return true;
+  }
+
+  return false;
+}
+
+void UploadQueue::record(VkCommandBuffer commands, const Copy& copy, VkBuffer source, VkDeviceSize sourceOffset) {
+  if (copy.buffer != VK_NULL_HANDLE) {
+    VkBufferCopy region { sourceOffset, copy.offset, copy.size };
+    vkCmdCopyBuffer(commands, source, copy.buffer, 1, &region);
+
+    return;
+  }
+
+  // Each level goes from undefined to sampled on its own, so levels can
+  // arrive over several frames
+  VkImageMemoryBarrier barrier {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = copy.image;
+  barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, copy.level.level, 1, 0, 1 };
+
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  vkCmdPipelineBarrier(commands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkBufferImageCopy region {};
+  region.bufferOffset = sourceOffset;
+  region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, copy.level.level, 0, 1 };
+  region.imageExtent = { copy.level.width, copy.level.height, 1 };
+  vkCmdCopyBufferToImage(commands, source, copy.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  vkCmdPipelineBarrier(commands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+VkDeviceSize UploadQueue::process(VkCommandBuffer commands, uint64_t serial, uint64_t completedSerial, VkDeviceSize budget) {
+  PROFILE_ZONE("UploadQueue::process");
+
+  this->retire(completedSerial);
+
+  if (this->queue.empty()) {
+    return 0;
+  }
+
+  Batch batch { serial, 0, {}, {} };
+  VkDeviceSize issued = 0;
+  bool copiedBuffers = false;
+
+  while (!this->queue.empty()) {
+    const Copy& copy = this->queue.front();
+    if (issued > 0 && issued + copy.size > budget) {
+      break;
+    }
+
+    // Copies too large for the ring get a staging buffer of their own,
+    // freed with the batch
+    VkBuffer source = this->staging.buffer;
+    VkDeviceSize offset = 0;
+    if (copy.size > this->staging.size) {
+      batch.oversized.push_back(this->device->createBuffer(copy.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true));
+      source = batch.oversized.back().buffer;
+      memcpy(batch.oversized.back().mapped, copy.data, copy.size);
+    } else if (this->reserve(copy.size, offset, batch.consumed)) {
+      memcpy((uint8_t *)this->staging.mapped + offset, copy.data, copy.size);
+    } else {
+      break;
+    }
+
+    this->record(commands, copy, source, offset);
+
+    copiedBuffers |= copy.buffer != VK_NULL_HANDLE;
+    batch.owners.push_back(copy.owner);
+    issued += copy.size;
+    this->queue.pop_front();
+  }
+
+  // One barrier covers every buffer copy before any draw reads them
+  if (copiedBuffers) {
+    VkMemoryBarrier barrier {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    vkCmdPipelineBarrier(commands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  if (batch.owners.empty()) {
+    return 0;
+  }
+
+  this->batches.push_back(std::move(batch));
+
+  return issued;
+}
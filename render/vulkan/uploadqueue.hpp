@@ -0,0 +1,113 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MORTAR_RENDER_VULKAN_UPLOADQUEUE_H
+#define MORTAR_RENDER_VULKAN_UPLOADQUEUE_H
+
+#include <deque>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "../../resource/handlemap.hpp"
+#include "../../resource/resource.hpp"
+#include "device.hpp"
+
+namespace Mortar::Render::Vulkan {
+  // Streams uploads into storage allocated up front, a budget's worth each
+  // frame, like the GL queue. Data is staged in a ring in one host-visible
+  // buffer and copied from there by commands recorded ahead of the frame's
+  // render pass. Each frame's copies are tagged with its serial; an owner is
+  // uploaded once the frames covering all of its copies have completed, and
+  // only then is their staging space reused.
+  class UploadQueue {
+    public:
+      static constexpr VkDeviceSize DEFAULT_STAGING_SIZE = 16 * 1024 * 1024;
+      static constexpr VkDeviceSize DEFAULT_FRAME_BUDGET = 4 * 1024 * 1024;
+
+      struct TextureLevel {
+        uint32_t level;
+        uint32_t width;
+        uint32_t height;
+      };
+
+      void initialize(Device *device, VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+      void shutDown();
+
+      // Queues a copy into a range of a buffer or into a whole image level.
+      // The data must stay valid until its owner is uploaded or cancelled.
+      void pushBuffer(const Resource::ResourceHandle& owner, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, const void *data);
+      void pushTextureLevel(const Resource::ResourceHandle& owner, VkImage image, const TextureLevel& level, VkDeviceSize size, const void *data);
+
+      // Retires the copies of frames up to completedSerial, then records
+      // queued ones into commands until the budget is spent, for the frame
+      // with the given serial. At least one is recorded whenever the ring has
+      // room, so copies larger than the budget still go out, a frame of their
+      // own each. Image levels are left ready to sample. Returns the bytes
+      // recorded.
+      VkDeviceSize process(VkCommandBuffer commands, uint64_t serial, uint64_t completedSerial, VkDeviceSize budget = DEFAULT_FRAME_BUDGET);
+
+      // Whether any of an owner's copies are queued or still in flight
+      bool isPending(const Resource::ResourceHandle& owner) const;
+
+      // Drops an owner's queued copies, for resources about to be freed.
+      // Copies already recorded finish, but no longer hold the owner pending.
+      void cancel(const Resource::ResourceHandle& owner);
+
+    private:
+      struct Copy {
+        Resource::ResourceHandle owner;
+        VkBuffer buffer;
+        VkImage image;
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        const void *data;
+        TextureLevel level;
+      };
+
+      // The copies recorded for one frame, how much of the ring they took,
+      // including any space skipped to wrap around, and any buffers made for
+      // copies too large for the ring
+      struct Batch {
+        uint64_t serial;
+        VkDeviceSize consumed;
+        std::vector<Resource::ResourceHandle> owners;
+        std::vector<Buffer> oversized;
+      };
+
+      void retire(uint64_t completedSerial);
+      void release(const Resource::ResourceHandle& owner);
+
+      // Takes a 16-byte aligned, contiguous range from the ring
+      bool reserve(VkDeviceSize size, VkDeviceSize& offset, VkDeviceSize& consumed);
+
+      void record(VkCommandBuffer commands, const Copy& copy, VkBuffer source, VkDeviceSize sourceOffset);
+
+      Device *device = nullptr;
+
+      Buffer staging;
+
+      // Next free byte of the ring, and how much of it is in flight
+      VkDeviceSize head = 0;
+      VkDeviceSize used = 0;
+
+      std::deque<Copy> queue;
+      std::deque<Batch> batches;
+
+      // Copies outstanding per owner, queued or in flight
+      Resource::HandleMap<unsigned> pending;
+  };
+}
+
+#endif
@@ -0,0 +1,81 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "arena.hpp"
+
+using namespace Mortar::Resource;
+
+Arena::~Arena() {
+  // Newest first, so nothing outlives what was created before it
+  for (auto it = this->destructors.rbegin(); it != this->destructors.rend(); it++) {
+    it->destroy(it->object);
+  }
+
+  for (auto& block : this->blocks) {
+    free(block.data);
+  }
+}
+
+void *Arena::allocate(size_t size, size_t alignment) {
+  // Blocks come from malloc, so their alignment covers every type we put in
+  // here but nothing beyond it
+  if (alignment > alignof(max_align_t)) {
+    throw std::bad_alloc();
+  }
+
+  if (!this->blocks.empty()) {
+    Block& block = this->blocks.back();
+
+    uintptr_t start = reinterpret_cast<uintptr_t>(block.data) + block.used;
+    size_t padding = (alignment - start % alignment) % alignment;
+
+    if (block.used + padding + size <= block.size) {
+      block.used += padding + size;
+
+      return block.data + block.used - size;
+    }
+  }
+
+  // Large allocations get a block of their own, slotted in behind the current
+  // one so its free tail stays usable
+  bool dedicated = size > this->blockSize / 4;
+  size_t newSize = dedicated ? size : this->blockSize;
+
+  uint8_t *data = static_cast<uint8_t *>(malloc(newSize));
+  if (data == nullptr) {
+    throw std::bad_alloc();
+  }
+
+  Block block { data, newSize, size };
+  if (dedicated && !this->blocks.empty()) {
+    this->blocks.insert(this->blocks.end() - 1, block);
+  } else {
+    this->blocks.push_back(block);
+  }
+
+  return data;
+}
+
+size_t Arena::getReservedSize() const {
+  size_t total = 0;
+  for (auto& block : this->blocks) {
+    total += block.size;
+  }
+
+  return total;
+}
@@ -0,0 +1,109 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RESOURCE_ARENA_H
+#define MORTAR_RESOURCE_ARENA_H
+
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Mortar::Resource {
+  // Arena is a monotonic allocator for everything one asset load creates.
+  // Allocations are carved sequentially out of large blocks and are never
+  // freed individually; destroying the arena runs the destructors of objects
+  // made with create() and releases every block at once.
+  class Arena {
+    public:
+      static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+      Arena(size_t blockSize = DEFAULT_BLOCK_SIZE)
+        : blockSize { blockSize } {};
+      ~Arena();
+
+      Arena(const Arena&) = delete;
+      Arena& operator=(const Arena&) = delete;
+
+      void *allocate(size_t size, size_t alignment);
+
+      // Constructs an object in the arena, to be destroyed with it
+      template <typename T, typename... Args>
+      T *create(Args&&... args);
+
+      // Destroys an object already constructed in storage from allocate()
+      // along with the arena
+      template <typename T>
+      void own(T *object);
+
+      // Zeroed storage for count plain values, e.g. keyframe data
+      template <typename T>
+      T *allocateArray(size_t count);
+
+      // Bytes reserved from the system, including unused block tails
+      size_t getReservedSize() const;
+
+    private:
+      struct Block {
+        uint8_t *data;
+        size_t size;
+        size_t used;
+      };
+
+      struct Destructor {
+        void (*destroy)(void *);
+        void *object;
+      };
+
+      size_t blockSize;
+
+      std::vector<Block> blocks;
+      std::vector<Destructor> destructors;
+  };
+
+  template <typename T, typename... Args>
+  T *Arena::create(Args&&... args) {
+    void *storage = this->allocate(sizeof(T), alignof(T));
+    T *object = new (storage) T(std::forward<Args>(args)...);
+    this->own(object);
+
+    return object;
+  }
+
+  template <typename T>
+  void Arena::own(T *object) {
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      this->destructors.push_back({ [] (void *ptr) {
+        static_cast<T *>(ptr)->~T();
+      }, object });
+    }
+  }
+
+  template <typename T>
+  T *Arena::allocateArray(size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>, "arena arrays are never destroyed");
+
+    void *storage = this->allocate(sizeof(T) * count, alignof(T));
+    memset(storage, 0, sizeof(T) * count);
+
+    return static_cast<T *>(storage);
+  }
+}
+
+#endif
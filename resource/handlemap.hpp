@@ -0,0 +1,130 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RESOURCE_HANDLEMAP_H
+#define MORTAR_RESOURCE_HANDLEMAP_H
+
+#include <array>
+#include <stdexcept>
+#include <stdint.h>
+#include <tsl/sparse_map.h>
+#include <vector>
+
+#include "resource.hpp"
+
+namespace Mortar::Resource {
+  // Maps handles to values with an array per type, indexed by the handle's
+  // index and checked against its generation. A handle whose index is still
+  // held by an older generation, as when a resource is freed before its
+  // entry is erased, pushes the older one aside into a small overflow map,
+  // so both stay reachable by their own handles.
+  template <typename V>
+  class HandleMap {
+    public:
+      bool contains(const ResourceHandle& handle) const {
+        return this->find(handle) != nullptr;
+      }
+
+      // Null for handles without an entry
+      V *find(const ResourceHandle& handle) {
+        std::vector<Entry>& entries = this->entries[handle.getType()];
+        uint32_t index = handle.getIndex();
+        if (index < entries.size() && entries[index].handle == handle.getValue()) {
+          return &entries[index].value;
+        }
+
+        if (this->overflow.empty()) {
+          return nullptr;
+        }
+
+        auto existing = this->overflow.find(handle.getValue());
+        return existing != this->overflow.end() ? &this->overflow.at(handle.getValue()) : nullptr;
+      }
+
+      const V *find(const ResourceHandle& handle) const {
+        return const_cast<HandleMap *>(this)->find(handle);
+      }
+
+      V& at(const ResourceHandle& handle) {
+        V *value = this->find(handle);
+        if (!value) {
+          throw std::out_of_range("no entry for handle");
+        }
+
+        return *value;
+      }
+
+      const V& at(const ResourceHandle& handle) const {
+        return const_cast<HandleMap *>(this)->at(handle);
+      }
+
+      // The handle's entry, value-initialized if it had none
+      V& operator[](const ResourceHandle& handle) {
+        V *value = this->find(handle);
+        if (value) {
+          return *value;
+        }
+
+        std::vector<Entry>& entries = this->entries[handle.getType()];
+        uint32_t index = handle.getIndex();
+        if (index >= entries.size()) {
+          entries.resize(index + 1);
+        }
+
+        Entry& entry = entries[index];
+        if (entry.handle) {
+          this->overflow[entry.handle] = std::move(entry.value);
+        }
+
+        entry.handle = handle.getValue();
+        entry.value = V {};
+
+        return entry.value;
+      }
+
+      // Whether there was an entry to erase
+      bool erase(const ResourceHandle& handle) {
+        std::vector<Entry>& entries = this->entries[handle.getType()];
+        uint32_t index = handle.getIndex();
+        if (index < entries.size() && entries[index].handle == handle.getValue()) {
+          entries[index] = Entry {};
+          return true;
+        }
+
+        return !this->overflow.empty() && this->overflow.erase(handle.getValue());
+      }
+
+      void clear() {
+        for (auto& entries : this->entries) {
+          entries.clear();
+        }
+
+        this->overflow.clear();
+      }
+
+    private:
+      struct Entry {
+        // Zero in free entries
+        uint32_t handle = 0;
+        V value {};
+      };
+
+      std::array<std::vector<Entry>, ResourceHandle::MAX_TYPES> entries;
+      tsl::sparse_map<uint32_t, V> overflow;
+  };
+}
+
+#endif
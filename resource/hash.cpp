@@ -0,0 +1,107 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bit>
+#include <string.h>
+
+#include "hash.hpp"
+
+static constexpr uint64_t PRIME_1 = 0x9e3779b185ebca87;
+static constexpr uint64_t PRIME_2 = 0xc2b2ae3d27d4eb4f;
+static constexpr uint64_t PRIME_3 = 0x165667b19e3779f9;
+static constexpr uint64_t PRIME_4 = 0x85ebca77c2b2ae63;
+static constexpr uint64_t PRIME_5 = 0x27d4eb2f165667c5;
+
+// Resource data is little-endian, as is every host so far
+static inline uint64_t read64(const uint8_t *data) {
+  uint64_t value;
+  memcpy(&value, data, sizeof(value));
+
+  return value;
+}
+
+static inline uint32_t read32(const uint8_t *data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+
+  return value;
+}
+
+static inline uint64_t round(uint64_t accumulator, uint64_t input) {
+  accumulator += input * PRIME_2;
+  accumulator = std::rotl(accumulator, 31);
+
+  return accumulator * PRIME_1;
+}
+
+static inline uint64_t mergeRound(uint64_t hash, uint64_t accumulator) {
+  hash ^= round(0, accumulator);
+
+  return hash * PRIME_1 + PRIME_4;
+}
+
+uint64_t Mortar::Resource::hashContent(const void *data, size_t size, uint64_t seed) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  const uint8_t *end = bytes + size;
+
+  uint64_t hash;
+  if (size >= 32) {
+    // Four independent lanes, so the multiplies overlap
+    uint64_t lanes[4] = { seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1 };
+
+    const uint8_t *limit = end - 32;
+    do {
+      for (int i = 0; i < 4; i++) {
+        lanes[i] = round(lanes[i], read64(bytes + i * 8));
+      }
+
+      bytes += 32;
+    } while (bytes <= limit);
+
+    hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+    for (int i = 0; i < 4; i++) {
+      hash = mergeRound(hash, lanes[i]);
+    }
+  } else {
+    hash = seed + PRIME_5;
+  }
+
+  hash += size;
+
+  for (; bytes + 8 <= end; bytes += 8) {
+    hash ^= round(0, read64(bytes));
+    hash = std::rotl(hash, 27) * PRIME_1 + PRIME_4;
+  }
+
+  if (bytes + 4 <= end) {
+    hash ^= read32(bytes) * PRIME_1;
+    hash = std::rotl(hash, 23) * PRIME_2 + PRIME_3;
+    bytes += 4;
+  }
+
+  for (; bytes < end; bytes++) {
+    hash ^= *bytes * PRIME_5;
+    hash = std::rotl(hash, 11) * PRIME_1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME_2;
+  hash ^= hash >> 29;
+  hash *= PRIME_3;
+  hash ^= hash >> 32;
+
+  return hash;
+}
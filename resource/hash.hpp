@@ -0,0 +1,30 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RESOURCE_HASH_H
+#define MORTAR_RESOURCE_HASH_H
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace Mortar::Resource {
+  // XXH64 over a blob of resource data, such as a texture level, to find
+  // copies of the same content. Unlike hashName() it reads eight bytes at a
+  // time, as it's meant for megabytes. Hashes chain through the seed.
+  uint64_t hashContent(const void *data, size_t size, uint64_t seed = 0);
+}
+
+#endif
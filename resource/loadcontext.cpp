@@ -0,0 +1,76 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "loadcontext.hpp"
+
+using namespace Mortar::Resource;
+
+Arena& LoadContext::getArena() {
+  if (this->arenas.empty()) {
+    this->arenas.push_back(std::make_unique<Arena>());
+  }
+
+  return *this->arenas.front();
+}
+
+void LoadContext::absorb(LoadContext& other) {
+  this->staged.insert(this->staged.end(), other.staged.begin(), other.staged.end());
+  other.staged.clear();
+
+  // Keep our own arena at the front so later allocations still land in it
+  this->getArena();
+  for (auto& arena : other.arenas) {
+    this->arenas.push_back(std::move(arena));
+  }
+
+  other.arenas.clear();
+
+  this->externalSize += other.externalSize;
+  other.externalSize = 0;
+
+  for (auto& size : other.sizes) {
+    this->sizes[size.first] += size.second;
+  }
+
+  other.sizes.clear();
+
+  this->arenaSize += other.arenaSize;
+  other.arenaSize = 0;
+}
+
+void LoadContext::commit() {
+  // Block tails, alignment padding and arrays of no particular owner
+  size_t reservedSize = 0;
+  for (auto& arena : this->arenas) {
+    reservedSize += arena->getReservedSize();
+  }
+
+  if (reservedSize > this->arenaSize) {
+    this->sizes[typeid(Arena)] += reservedSize - this->arenaSize;
+  }
+
+  this->manager.commitLoad(this->staged, this->arenas, this->externalSize, this->sizes);
+
+  this->staged.clear();
+  this->arenas.clear();
+  this->externalSize = 0;
+  this->sizes.clear();
+  this->arenaSize = 0;
+}
+
+ResourceManager& LoadContext::getResourceManager() {
+  return this->manager;
+}
@@ -0,0 +1,115 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RESOURCE_LOADCONTEXT_H
+#define MORTAR_RESOURCE_LOADCONTEXT_H
+
+#include <memory>
+#include <typeindex>
+#include <vector>
+
+#include "arena.hpp"
+#include "manager.hpp"
+#include "resource.hpp"
+
+namespace Mortar::Resource {
+  // LoadContext collects the resources created while loading one asset. They
+  // are allocated from the load's own arena, so a whole asset's graph sits
+  // together in a few large blocks, and stay private to the load until
+  // commit() hands them and the arena to the manager in one batch. If the
+  // load fails before that, they are freed with the context.
+  // A context is only ever used by one thread at a time.
+  class LoadContext {
+    public:
+      LoadContext(ResourceManager& manager)
+        : manager { manager } {};
+
+      LoadContext(const LoadContext&) = delete;
+      LoadContext& operator=(const LoadContext&) = delete;
+
+      template <ResourceType T>
+      T *createResource();
+
+      // Zeroed storage for data owned by this load's resources. Naming the
+      // owning resource type counts the array towards it in memory reports;
+      // otherwise it's counted with the arena's unused space.
+      template <typename T>
+      T *allocateArray(size_t count);
+      template <ResourceType Owner, typename T>
+      T *allocateArray(size_t count);
+
+      // Counts memory resources of type Owner hold outside the arena, such as
+      // vertex and texture data, towards the manager's memory budget
+      template <ResourceType Owner>
+      void accountSize(size_t size);
+
+      // Takes over everything another context has staged, such as one used by
+      // part of the load that ran as a separate job
+      void absorb(LoadContext& other);
+
+      void commit();
+
+      ResourceManager& getResourceManager();
+
+    private:
+      Arena& getArena();
+
+      ResourceManager& manager;
+
+      std::vector<Resource *> staged;
+
+      // The first is this context's own; the rest came from absorb()
+      std::vector<std::unique_ptr<Arena>> arenas;
+
+      size_t externalSize = 0;
+
+      // Bytes by owning type, and how many of them are in the arenas
+      SizesByType sizes;
+      size_t arenaSize = 0;
+  };
+
+  template <ResourceType T>
+  T *LoadContext::createResource() {
+    T *resource = this->manager.constructResource<T>(this->getArena());
+    this->staged.push_back(resource);
+
+    this->sizes[typeid(T)] += sizeof(T);
+    this->arenaSize += sizeof(T);
+
+    return resource;
+  }
+
+  template <typename T>
+  T *LoadContext::allocateArray(size_t count) {
+    return this->getArena().allocateArray<T>(count);
+  }
+
+  template <ResourceType Owner, typename T>
+  T *LoadContext::allocateArray(size_t count) {
+    this->sizes[typeid(Owner)] += sizeof(T) * count;
+    this->arenaSize += sizeof(T) * count;
+
+    return this->getArena().allocateArray<T>(count);
+  }
+
+  template <ResourceType Owner>
+  void LoadContext::accountSize(size_t size) {
+    this->sizes[typeid(Owner)] += size;
+    this->externalSize += size;
+  }
+}
+
+#endif
@@ -14,18 +14,537 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
+
+#include "../log.hpp"
 #include "manager.hpp"
 
 using namespace Mortar::Resource;
 
-void ResourceManager::initialize() {}
+thread_local ResourceManager::LoadRecord *ResourceManager::currentLoad = nullptr;
+
+void ResourceManager::initialize(Jobs::JobSystem *jobSystem) {
+  this->jobSystem = jobSystem;
+}
 
 void ResourceManager::shutDown() {
-  for (auto resource : this->resources) {
-    delete resource.second;
+  for (auto& table : this->resourceTables) {
+    std::lock_guard<std::mutex> lock(table.mutex);
+
+    for (auto resource : table.resources) {
+      if (resource && resource->arena == nullptr) {
+        delete resource;
+      }
+    }
+
+    table.resources.clear();
   }
 
+  // Everything left is arena-allocated; this frees it a block at a time
+  for (auto& shard : this->namedShards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    shard.entries.clear();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->lruMutex);
+    this->lru.clear();
+  }
+
+  this->residentSize = 0;
+
+  {
+    std::lock_guard<std::mutex> lock(this->arenasMutex);
+    this->arenas.clear();
+    this->unnamedSize = 0;
+    this->unnamedSizes.clear();
+  }
+
+  std::lock_guard<std::mutex> lock(this->poolsMutex);
+
   for (auto pool : this->resourcePools) {
     delete pool;
   }
+
+  this->resourcePools.clear();
+}
+
+void ResourceManager::setRetireHandler(std::function<void (std::shared_ptr<void>)> handler) {
+  std::unique_lock<std::shared_mutex> lock(this->loadersMutex);
+  this->retireHandler = std::move(handler);
+}
+
+void ResourceManager::destroyResource(Resource *resource) {
+  {
+    ResourceTable& table = this->getTable(resource->getHandle());
+    std::lock_guard<std::mutex> lock(table.mutex);
+
+    uint32_t index = resource->getHandle().getIndex();
+    if (index < table.resources.size() && table.resources[index] == resource) {
+      table.resources[index] = nullptr;
+    }
+  }
+
+  delete resource;
+}
+
+void ResourceManager::registerResources(const std::vector<Resource *>& batch) {
+  std::array<std::vector<Resource *>, ResourceHandle::MAX_TYPES> sorted;
+  for (auto resource : batch) {
+    sorted[resource->getHandle().getType()].push_back(resource);
+  }
+
+  for (size_t i = 0; i < ResourceHandle::MAX_TYPES; i++) {
+    if (sorted[i].empty()) {
+      continue;
+    }
+
+    ResourceTable& table = this->resourceTables[i];
+    std::lock_guard<std::mutex> lock(table.mutex);
+
+    for (auto resource : sorted[i]) {
+      insertResource(table, resource);
+    }
+  }
+}
+
+void ResourceManager::insertResource(ResourceTable& table, Resource *resource) {
+  uint32_t index = resource->getHandle().getIndex();
+  if (index >= table.resources.size()) {
+    table.resources.resize(index + 1, nullptr);
+  }
+
+  table.resources[index] = resource;
+}
+
+void ResourceManager::commitLoad(std::vector<Resource *>& resources, std::vector<std::unique_ptr<Arena>>& arenas, size_t externalSize, const SizesByType& sizes) {
+  this->registerResources(resources);
+
+  size_t size = externalSize;
+  for (auto& arena : arenas) {
+    size += arena->getReservedSize();
+  }
+
+  if (currentLoad == nullptr) {
+    std::lock_guard<std::mutex> lock(this->arenasMutex);
+
+    for (auto& arena : arenas) {
+      this->arenas.push_back(std::move(arena));
+    }
+
+    this->unnamedSize += size;
+    for (auto& typeSize : sizes) {
+      this->unnamedSizes[typeSize.first] += typeSize.second;
+    }
+
+    return;
+  }
+
+  for (auto& arena : arenas) {
+    currentLoad->arenas.push_back(std::move(arena));
+  }
+
+  currentLoad->resources.insert(currentLoad->resources.end(), resources.begin(), resources.end());
+  currentLoad->size += size;
+  for (auto& typeSize : sizes) {
+    currentLoad->sizes[typeSize.first] += typeSize.second;
+  }
+
+  this->residentSize += size;
+}
+
+std::shared_future<Resource *> ResourceManager::acquireResource(const std::string& name, std::type_index type, bool loadIfAbsent) {
+  NamedShard& shard = this->getShard(name);
+  std::unique_lock<std::mutex> lock(shard.mutex);
+
+  if (shard.entries.contains(name)) {
+    NamedEntry& entry = shard.entries.at(name);
+
+    if (entry.refCount++ == 0 && entry.evictable) {
+      std::lock_guard<std::mutex> lruLock(this->lruMutex);
+      this->lru.erase(entry.lruPosition);
+      entry.evictable = false;
+    }
+
+    if (currentLoad != nullptr) {
+      currentLoad->dependencies.push_back(name);
+    }
+
+    return entry.future;
+  }
+
+  ResourceLoader<> loader;
+  {
+    std::shared_lock<std::shared_mutex> loadersLock(this->loadersMutex);
+    if (!loadIfAbsent || !this->loaders.contains(type)) {
+      throw std::runtime_error("named resource does not exist and can't be loaded");
+    }
+
+    loader = this->loaders.at(type);
+  }
+
+  NamedEntry& entry = shard.entries[name];
+  entry.refCount = 1;
+
+  if (currentLoad != nullptr) {
+    currentLoad->dependencies.push_back(name);
+  }
+
+  auto load = [this, loader, name] () {
+    return this->runLoad(name, loader);
+  };
+
+  // The shard lock is still held, so the load can't finish and look for its
+  // entry before the future has been stored in it
+  if (this->jobSystem != nullptr) {
+    entry.future = this->jobSystem->submit(load);
+
+    return entry.future;
+  }
+
+  std::packaged_task<Resource *()> task(load);
+  entry.future = task.get_future().share();
+
+  std::shared_future<Resource *> future = entry.future;
+
+  lock.unlock();
+  task();
+
+  return future;
+}
+
+Resource *ResourceManager::runLoad(const std::string& name, const ResourceLoader<>& loader) {
+  NamedShard& shard = this->getShard(name);
+
+  auto record = std::make_unique<LoadRecord>();
+
+  // Loads nest when a loader waits on another and runs it on this thread
+  LoadRecord *parent = currentLoad;
+  currentLoad = record.get();
+
+  Resource *resource;
+  try {
+    resource = loader(name);
+  } catch (...) {
+    currentLoad = parent;
+
+    // Let a later request retry the load
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.entries.erase(name);
+    }
+
+    // Release anything the loader committed before failing
+    this->evict(std::move(record));
+
+    throw;
+  }
+
+  currentLoad = parent;
+
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    NamedEntry& entry = shard.entries.at(name);
+    entry.resource = resource;
+    entry.record = std::move(record);
+
+    // Everyone who asked for it may have let go while it was loading
+    if (entry.refCount == 0) {
+      std::lock_guard<std::mutex> lruLock(this->lruMutex);
+      this->lru.push_front(name);
+      entry.lruPosition = this->lru.begin();
+      entry.evictable = true;
+    }
+  }
+
+  this->enforceBudget();
+
+  return resource;
+}
+
+void ResourceManager::releaseResource(const std::string& name) {
+  NamedShard& shard = this->getShard(name);
+
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Already gone if the load failed
+    if (!shard.entries.contains(name)) {
+      return;
+    }
+
+    NamedEntry& entry = shard.entries.at(name);
+    if (entry.refCount == 0) {
+      throw std::runtime_error("named resource released more often than it was requested");
+    }
+
+    if (--entry.refCount == 0 && entry.resource != nullptr) {
+      std::lock_guard<std::mutex> lruLock(this->lruMutex);
+      this->lru.push_front(name);
+      entry.lruPosition = this->lru.begin();
+      entry.evictable = true;
+    }
+  }
+
+  this->enforceBudget();
+}
+
+void ResourceManager::enforceBudget() {
+  while (this->residentSize > this->memoryBudget) {
+    std::string victim;
+    {
+      std::lock_guard<std::mutex> lruLock(this->lruMutex);
+      if (this->lru.empty()) {
+        return;
+      }
+
+      victim = this->lru.back();
+    }
+
+    std::unique_ptr<LoadRecord> record;
+    {
+      NamedShard& shard = this->getShard(victim);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      std::lock_guard<std::mutex> lruLock(this->lruMutex);
+
+      // Someone may have taken it or another thread evicted it meanwhile
+      if (!shard.entries.contains(victim) || !shard.entries.at(victim).evictable) {
+        continue;
+      }
+
+      NamedEntry& entry = shard.entries.at(victim);
+      this->lru.erase(entry.lruPosition);
+      record = std::move(entry.record);
+
+      shard.entries.erase(victim);
+    }
+
+    DEBUG("evicting %s", victim.c_str());
+    this->evict(std::move(record));
+  }
+}
+
+void ResourceManager::evict(std::unique_ptr<LoadRecord> record) {
+  {
+    std::shared_lock<std::shared_mutex> lock(this->loadersMutex);
+
+    for (auto resource : record->resources) {
+      auto handlers = this->evictionHandlers.find(typeid(*resource));
+      if (handlers == this->evictionHandlers.end()) {
+        continue;
+      }
+
+      for (auto& handler : handlers->second) {
+        handler(resource);
+      }
+    }
+  }
+
+  std::array<std::vector<Resource *>, ResourceHandle::MAX_TYPES> sorted;
+  for (auto resource : record->resources) {
+    sorted[resource->getHandle().getType()].push_back(resource);
+  }
+
+  for (size_t i = 0; i < ResourceHandle::MAX_TYPES; i++) {
+    if (sorted[i].empty()) {
+      continue;
+    }
+
+    ResourceTable& table = this->resourceTables[i];
+    std::lock_guard<std::mutex> lock(table.mutex);
+
+    for (auto resource : sorted[i]) {
+      uint32_t index = resource->getHandle().getIndex();
+      if (index < table.resources.size() && table.resources[index] == resource) {
+        table.resources[index] = nullptr;
+      }
+    }
+  }
+
+  this->residentSize -= record->size;
+
+  std::vector<std::string> dependencies = std::move(record->dependencies);
+
+  // Destroys the resources along with their arenas, here or once whoever
+  // retires them is done
+  std::shared_ptr<LoadRecord> retired = std::move(record);
+  {
+    std::shared_lock<std::shared_mutex> lock(this->loadersMutex);
+    if (this->retireHandler) {
+      this->retireHandler(std::move(retired));
+    }
+  }
+  retired.reset();
+
+  for (auto& dependency : dependencies) {
+    this->releaseResource(dependency);
+  }
+}
+
+void ResourceManager::setMemoryBudget(size_t bytes) {
+  this->memoryBudget = bytes;
+
+  this->enforceBudget();
+}
+
+size_t ResourceManager::getMemoryBudget() const {
+  return this->memoryBudget;
+}
+
+size_t ResourceManager::getResidentSize() const {
+  return this->residentSize;
+}
+
+std::vector<ResourceLocation> ResourceManager::locateResources(const std::vector<const Resource *>& resources) {
+  std::vector<ResourceLocation> locations (resources.size(), { "", 0 });
+
+  tsl::sparse_map<const Resource *, size_t> wanted;
+  for (size_t i = 0; i < resources.size(); i++) {
+    wanted[resources[i]] = i;
+  }
+
+  for (auto& shard : this->namedShards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    for (auto& entry : shard.entries) {
+      const LoadRecord *record = entry.second.record.get();
+      if (record == nullptr) {
+        continue;
+      }
+
+      for (size_t i = 0; i < record->resources.size(); i++) {
+        auto found = wanted.find(record->resources[i]);
+        if (found != wanted.end()) {
+          locations[found->second] = { entry.first, (uint32_t)i };
+        }
+      }
+    }
+  }
+
+  return locations;
+}
+
+Resource *ResourceManager::findResource(const ResourceLocation& location, uint32_t type) {
+  NamedShard& shard = this->getShard(location.name);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  auto entry = shard.entries.find(location.name);
+  if (entry == shard.entries.end() || entry->second.record == nullptr) {
+    return nullptr;
+  }
+
+  const std::vector<Resource *>& committed = entry->second.record->resources;
+  if (location.index >= committed.size() || committed[location.index]->getHandle().getType() != type) {
+    return nullptr;
+  }
+
+  return committed[location.index];
+}
+
+MemoryReport ResourceManager::getMemoryReport() {
+  MemoryReport report { {}, {}, 0 };
+  SizesByType sizes;
+
+  for (auto& shard : this->namedShards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Loads still running haven't got a record yet
+    for (auto& entry : shard.entries) {
+      const LoadRecord *record = entry.second.record.get();
+      if (record == nullptr) {
+        continue;
+      }
+
+      report.assets.push_back({ entry.first, record->size, entry.second.refCount != 0 });
+      for (auto& typeSize : record->sizes) {
+        sizes[typeSize.first] += typeSize.second;
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->arenasMutex);
+
+    if (this->unnamedSize) {
+      report.assets.push_back({ "", this->unnamedSize, true });
+    }
+
+    for (auto& typeSize : this->unnamedSizes) {
+      sizes[typeSize.first] += typeSize.second;
+    }
+  }
+
+  for (auto& typeSize : sizes) {
+    report.types.push_back({ typeSize.first, typeSize.second });
+  }
+
+  for (auto& asset : report.assets) {
+    report.total += asset.size;
+  }
+
+  std::sort(report.types.begin(), report.types.end(), [] (const MemoryReport::TypeSize& a, const MemoryReport::TypeSize& b) {
+    return a.size > b.size;
+  });
+
+  std::sort(report.assets.begin(), report.assets.end(), [] (const MemoryReport::AssetSize& a, const MemoryReport::AssetSize& b) {
+    return a.size > b.size;
+  });
+
+  return report;
+}
+
+std::string MemoryReport::getTypeName(std::type_index type) {
+#ifdef __GNUG__
+  int status;
+  char *demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+  if (status == 0) {
+    std::string name = demangled;
+    free(demangled);
+
+    return name;
+  }
+#endif
+
+  return type.name();
+}
+
+std::string MemoryReport::toString() const {
+  std::string out;
+  char line[256];
+
+  snprintf(line, sizeof(line), "%.2f MiB resident\n", this->total / (1024.0 * 1024.0));
+  out += line;
+
+  for (auto& type : this->types) {
+    snprintf(line, sizeof(line), "  %10.1f KiB  %s\n", type.size / 1024.0, getTypeName(type.type).c_str());
+    out += line;
+  }
+
+  for (auto& asset : this->assets) {
+    snprintf(line, sizeof(line), "  %10.1f KiB  %s%s\n", asset.size / 1024.0, asset.name.empty() ? "(unnamed)" : asset.name.c_str(), asset.isHeld ? "" : " (cached)");
+    out += line;
+  }
+
+  return out;
+}
+
+ResourceManager::ResourceTable& ResourceManager::getTable(const ResourceHandle& handle) {
+  return this->resourceTables[handle.getType()];
+}
+
+ResourceManager::NamedShard& ResourceManager::getShard(const std::string& name) {
+  return this->namedShards[std::hash<std::string>{}(name) % SHARD_COUNT];
+}
+
+Mortar::Jobs::JobSystem *ResourceManager::getJobSystem() const {
+  return this->jobSystem;
 }
@@ -17,43 +17,271 @@
 #ifndef MORTAR_RESOURCE_MANAGER_H
 #define MORTAR_RESOURCE_MANAGER_H
 
-#include <forward_list>
+#include <array>
+#include <atomic>
 #include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
+#include <stdint.h>
+#include <string>
 #include <tsl/sparse_map.h>
+#include <typeindex>
 #include <vector>
 
+#include "../jobs/jobsystem.hpp"
+#include "arena.hpp"
 #include "pool.hpp"
 #include "resource.hpp"
 
 namespace Mortar::Resource {
+  // ResourceFuture refers to a named resource that may still be loading
+  template <ResourceType T>
+  class ResourceFuture {
+    public:
+      ResourceFuture(Jobs::JobSystem *jobSystem, std::shared_future<Resource *> future)
+        : jobSystem { jobSystem }, future { future } {};
+
+      // Blocks until the resource is loaded, running other queued jobs in the
+      // meantime. Rethrows anything the loader threw.
+      T *get() const;
+
+      bool isReady() const;
+
+    private:
+      Jobs::JobSystem *jobSystem;
+      std::shared_future<Resource *> future;
+  };
+
+  template <ResourceType T = Resource>
+  using EvictionHandler = std::function<void (const T *)>;
+
+  typedef tsl::sparse_map<std::type_index, size_t> SizesByType;
+
+  // Memory held by loaded resources, largest first. Arena space no type
+  // claimed is counted under Arena.
+  struct MemoryReport {
+    struct TypeSize {
+      std::type_index type;
+      size_t size;
+    };
+
+    struct AssetSize {
+      // Empty for resources loaded outside of any named load
+      std::string name;
+      size_t size;
+
+      // Whether anyone holds the asset, or it's only cached
+      bool isHeld;
+    };
+
+    std::vector<TypeSize> types;
+    std::vector<AssetSize> assets;
+    size_t total;
+
+    std::string toString() const;
+
+    // Demangled where the compiler mangles them
+    static std::string getTypeName(std::type_index type);
+  };
+
+  // Names a resource a named load committed by the load's name and its
+  // position among what the load committed. Loaders commit in the same order
+  // given the same assets, so it outlives the run, unlike a handle.
+  struct ResourceLocation {
+    // Empty for resources no named load committed
+    std::string name;
+    uint32_t index;
+  };
+
   class ResourceManager {
     public:
-      void initialize();
+      // Loaders run on the given job system; without one, loads happen
+      // synchronously on the calling thread
+      void initialize(Jobs::JobSystem *jobSystem = nullptr);
       void shutDown();
 
       template <ResourceType T>
       void registerResourceLoader(ResourceLoader<T> loader);
 
+      // Called for each resource of type T as it's evicted, from whichever
+      // thread triggered the eviction, while the resource is still intact
+      template <ResourceType T>
+      void registerEvictionHandler(EvictionHandler<T> handler);
+
+      // Evicted loads' memory is handed here rather than freed, for when
+      // something may still be reading it, and goes with the last reference.
+      // Without one, it's freed as the load is evicted.
+      void setRetireHandler(std::function<void (std::shared_ptr<void>)> handler);
+
       template <ResourceType T>
       T *createResource();
 
+      // Frees a resource createResource() made
+      void destroyResource(Resource *resource);
+
+      // The resource a handle names, or null once it's been freed or if it
+      // names another type. Only resources created here or committed by a
+      // load are found, not pooled ones.
+      template <ResourceType T>
+      T *resolve(const ResourceHandle& handle);
+
+      // Pools grow by chunkSize resources whenever they run out
       template <ResourceType T>
-      ResourcePool<T> *createResourcePool(size_t size);
+      ResourcePool<T> *createResourcePool(size_t chunkSize);
 
+      // Each successful request for a named resource takes a reference to it,
+      // which is given back with releaseResource(). A load that requests other
+      // named resources holds on to them until it is itself evicted.
       template <ResourceType T>
       T *getResource(const std::string& name, bool loadIfAbsent = true);
 
+      // Starts loading a named resource in the background. Requests for a name
+      // that is already loading share the same load.
+      template <ResourceType T>
+      ResourceFuture<T> getResourceAsync(const std::string& name, bool loadIfAbsent = true);
+
+      // Named resources nobody holds stay cached until the memory they occupy
+      // exceeds the budget, then go least recently released first
+      void releaseResource(const std::string& name);
+
+      // Enough to keep a level's shared characters and a neighbouring scene
+      // cached; --memory-budget gives another
+      static constexpr size_t DEFAULT_MEMORY_BUDGET = 512 * 1024 * 1024;
+
+      void setMemoryBudget(size_t bytes);
+      size_t getMemoryBudget() const;
+      size_t getResidentSize() const;
+
+      MemoryReport getMemoryReport();
+
+      // Locates each of the resources in one pass over the loaded entries
+      std::vector<ResourceLocation> locateResources(const std::vector<const Resource *>& resources);
+
+      // The resource at a location, or null if its load isn't resident or it
+      // holds something else there
+      template <ResourceType T>
+      T *findResource(const ResourceLocation& location);
+
+      Jobs::JobSystem *getJobSystem() const;
+
+      friend class LoadContext;
+
     private:
-      tsl::sparse_map<ResourceHandle, Resource *> resources;
+      // Everything one named load committed, released together on eviction
+      struct LoadRecord {
+        std::vector<Resource *> resources;
+        std::vector<std::unique_ptr<Arena>> arenas;
+        std::vector<std::string> dependencies;
+        size_t size = 0;
+        SizesByType sizes;
+      };
+
+      struct NamedEntry {
+        // Null until the load finishes
+        Resource *resource = nullptr;
+        std::shared_future<Resource *> future;
+        std::unique_ptr<LoadRecord> record;
+
+        unsigned refCount = 0;
+
+        // Unreferenced loaded entries sit in the LRU list
+        bool evictable = false;
+        std::list<std::string>::iterator lruPosition;
+      };
+
+      // Allocates a resource in the given arena without registering it
+      template <ResourceType T>
+      T *constructResource(Arena& arena);
+
+      // Registers a batch of resources, taking each shard's lock once
+      void registerResources(const std::vector<Resource *>& batch);
+
+      // Takes over what a LoadContext staged, attributing it to the named load
+      // running on this thread, if any
+      void commitLoad(std::vector<Resource *>& resources, std::vector<std::unique_ptr<Arena>>& arenas, size_t externalSize, const SizesByType& sizes);
+
+      std::shared_future<Resource *> acquireResource(const std::string& name, std::type_index type, bool loadIfAbsent);
+      Resource *runLoad(const std::string& name, const ResourceLoader<>& loader);
+
+      Resource *findResource(const ResourceLocation& location, uint32_t type);
+
+      void enforceBudget();
+      void evict(std::unique_ptr<LoadRecord> record);
+
+      // Loaders create resources from several threads at once. Resources are
+      // kept in an array per type indexed by handle, each with its own lock;
+      // named entries are split into shards by key hash. Where both are
+      // needed, a shard's lock is always taken before lruMutex.
+      static const size_t SHARD_COUNT = 16;
+
+      struct ResourceTable {
+        std::mutex mutex;
+        std::vector<Resource *> resources;
+      };
+
+      struct NamedShard {
+        std::mutex mutex;
+        tsl::sparse_map<std::string, NamedEntry> entries;
+      };
+
+      ResourceTable& getTable(const ResourceHandle& handle);
+      NamedShard& getShard(const std::string& name);
+
+      // Files the resource under its handle's index
+      static void insertResource(ResourceTable& table, Resource *resource);
+
+      // The named load running on this thread
+      static thread_local LoadRecord *currentLoad;
+
+      Jobs::JobSystem *jobSystem = nullptr;
+
+      std::array<ResourceTable, ResourceHandle::MAX_TYPES> resourceTables;
+      std::array<NamedShard, SHARD_COUNT> namedShards;
+
+      std::mutex lruMutex;
+      std::list<std::string> lru;
+
+      std::atomic<size_t> memoryBudget { DEFAULT_MEMORY_BUDGET };
+      std::atomic<size_t> residentSize { 0 };
+
+      // Loaders and handlers are registered up front and then only looked up
+      std::shared_mutex loadersMutex;
       tsl::sparse_map<std::type_index, ResourceLoader<>> loaders;
-      tsl::sparse_map<std::string, Resource *> namedResources;
+      tsl::sparse_map<std::type_index, std::vector<EvictionHandler<>>> evictionHandlers;
+      std::function<void (std::shared_ptr<void>)> retireHandler;
+
+      // Arenas committed outside of any named load, and what they hold
+      std::mutex arenasMutex;
+      std::vector<std::unique_ptr<Arena>> arenas;
+      size_t unnamedSize = 0;
+      SizesByType unnamedSizes;
 
-      std::vector<ResourcePool<> *> resourcePools;
+      std::mutex poolsMutex;
+      std::vector<ResourcePoolBase *> resourcePools;
   };
 
+  template <ResourceType T>
+  T *ResourceFuture<T>::get() const {
+    if (this->jobSystem == nullptr) {
+      return static_cast<T *>(this->future.get());
+    }
+
+    return static_cast<T *>(this->jobSystem->wait(this->future));
+  }
+
+  template <ResourceType T>
+  bool ResourceFuture<T>::isReady() const {
+    return this->future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  }
+
   template <ResourceType T>
   void ResourceManager::registerResourceLoader(ResourceLoader<T> loader) {
+    std::unique_lock<std::shared_mutex> lock(this->loadersMutex);
+
     if (loaders.contains(typeid(T))) {
       throw std::runtime_error("resource loader already registered for type");
     }
@@ -61,47 +289,87 @@ namespace Mortar::Resource {
     loaders[typeid(T)] = loader;
   }
 
+  template <ResourceType T>
+  void ResourceManager::registerEvictionHandler(EvictionHandler<T> handler) {
+    std::unique_lock<std::shared_mutex> lock(this->loadersMutex);
+
+    this->evictionHandlers[typeid(T)].push_back([handler] (const Resource *resource) {
+      handler(static_cast<const T *>(resource));
+    });
+  }
+
+  template <ResourceType T>
+  T *ResourceManager::constructResource(Arena& arena) {
+    auto handle = ResourceHandle(ResourceHandle::getTypeId<T>());
+
+    // Constructed here rather than by the arena, as resource constructors are
+    // only open to us
+    void *storage = arena.allocate(sizeof(T), alignof(T));
+    T *resource = new (storage) T(handle);
+    arena.own(resource);
+
+    resource->arena = &arena;
+
+    return resource;
+  }
+
   template <ResourceType T>
   T *ResourceManager::createResource() {
-    auto handle = ResourceHandle(typeid(T));
+    auto handle = ResourceHandle(ResourceHandle::getTypeId<T>());
+
+    T *resource = new T(handle);
 
-    auto resource = new T(handle);
-    this->resources[handle] = resource;
+    ResourceTable& table = this->getTable(handle);
+    std::lock_guard<std::mutex> lock(table.mutex);
+    insertResource(table, resource);
 
     return resource;
   }
 
   template <ResourceType T>
-  ResourcePool<T> *ResourceManager::createResourcePool(size_t size) {
-    std::forward_list<T *> resources (size);
+  T *ResourceManager::resolve(const ResourceHandle& handle) {
+    if (handle.getType() != ResourceHandle::getTypeId<T>()) {
+      return nullptr;
+    }
 
-    std::generate(resources.begin(), resources.end(), [] () {
-      auto handle = ResourceHandle(typeid(T));
+    ResourceTable& table = this->getTable(handle);
+    std::lock_guard<std::mutex> lock(table.mutex);
 
-      return new T(handle);
-    });
+    uint32_t index = handle.getIndex();
+    if (index >= table.resources.size() || !table.resources[index] || !(table.resources[index]->getHandle() == handle)) {
+      return nullptr;
+    }
+
+    return static_cast<T *>(table.resources[index]);
+  }
+
+  template <ResourceType T>
+  T *ResourceManager::findResource(const ResourceLocation& location) {
+    return static_cast<T *>(this->findResource(location, ResourceHandle::getTypeId<T>()));
+  }
+
+  template <ResourceType T>
+  ResourcePool<T> *ResourceManager::createResourcePool(size_t chunkSize) {
+    auto pool = new ResourcePool<T>(chunkSize, [] (void *storage) {
+      auto handle = ResourceHandle(ResourceHandle::getTypeId<T>());
 
-    auto pool = new ResourcePool<T>(resources);
+      return new (storage) T(handle);
+    });
 
-    this->resourcePools.push_back(reinterpret_cast<ResourcePool<> *>(pool));
+    std::lock_guard<std::mutex> lock(this->poolsMutex);
+    this->resourcePools.push_back(pool);
 
     return pool;
   }
 
   template <ResourceType T>
   T *ResourceManager::getResource(const std::string& name, bool loadIfAbsent) {
-    if (this->namedResources.contains(name)) {
-      return static_cast<T *>(this->namedResources.at(name));
-    }
-
-    if (!loadIfAbsent || !this->loaders.contains(typeid(T))) {
-      throw std::runtime_error("named resource does not exist and can't be loaded");
-    }
-
-    auto loader = this->loaders.at(typeid(T));
-    T *resource = static_cast<T *>(loader(name));
+    return this->getResourceAsync<T>(name, loadIfAbsent).get();
+  }
 
-    return resource;
+  template <ResourceType T>
+  ResourceFuture<T> ResourceManager::getResourceAsync(const std::string& name, bool loadIfAbsent) {
+    return ResourceFuture<T>(this->jobSystem, this->acquireResource(name, typeid(T), loadIfAbsent));
   }
 }
 
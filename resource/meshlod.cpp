@@ -0,0 +1,90 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <math.h>
+
+#include "../profiler.hpp"
+#include "meshlod.hpp"
+#include "meshoptimizer.hpp"
+
+using namespace Mortar::Resource;
+
+// Each simplified level aims for this share of the full index count, and
+// may move the surface by at most this share of the bounding radius
+static constexpr float LOD_INDEX_RATIOS[Mesh::MAX_LODS - 1] = { 0.5f, 0.25f };
+static constexpr float LOD_MAX_ERRORS[Mesh::MAX_LODS - 1] = { 0.01f, 0.03f };
+
+// A level must drop at least this share of the indices of the one before
+static constexpr float MIN_LOD_SAVING = 0.2f;
+
+// Surfaces smaller than this are already cheap
+static constexpr unsigned MIN_LOD_INDICES = 96;
+
+void Mortar::Resource::generateMeshLods(LoadContext& context, Mesh *mesh) {
+  PROFILE_ZONE("generateMeshLods");
+
+  const VertexLayout& layout = mesh->getVertexLayout();
+  const VertexBuffer *vertexBuffer = mesh->getVertexBuffer();
+  if (!vertexBuffer || !vertexBuffer->getData() || !layout.getStride() || mesh->getBounds().isEmpty()) {
+    return;
+  }
+
+  std::span<const VertexLayout::VertexProperty> properties = layout.getProperties();
+  auto position = std::find_if(properties.begin(), properties.end(), [](const auto& property) {
+    return property.getUsage() == VertexUsage::POSITION;
+  });
+  if (position == properties.end() || position->getDataType() != VertexDataType::VEC3) {
+    return;
+  }
+
+  const uint8_t *positions = vertexBuffer->getData() + position->getOffset();
+  size_t vertexCount = vertexBuffer->getSize() / layout.getStride();
+
+  const Math::Vector& extents = mesh->getBounds().extents;
+  float radius = sqrtf(extents.x * extents.x + extents.y * extents.y + extents.z * extents.z);
+
+  for (auto surface : mesh->getSurfaces()) {
+    const IndexBuffer *indexBuffer = surface->getIndexBuffer();
+    if (surface->getPrimitiveType() != PrimitiveType::TRIANGLE_LIST || !surface->getLods().empty() || !indexBuffer->getData() || indexBuffer->getCount() < MIN_LOD_INDICES) {
+      continue;
+    }
+
+    std::span<const uint16_t> full(indexBuffer->getData(), indexBuffer->getCount());
+    size_t previousCount = full.size();
+
+    for (unsigned level = 0; level < Mesh::MAX_LODS - 1; level++) {
+      size_t targetCount = (size_t)(full.size() * LOD_INDEX_RATIOS[level]) / 3 * 3;
+      std::vector<uint16_t> indices = simplifyIndices(full, positions, layout.getStride(), vertexCount, targetCount, radius * LOD_MAX_ERRORS[level]);
+
+      if (indices.empty() || indices.size() > previousCount * (1.0f - MIN_LOD_SAVING)) {
+        break;
+      }
+
+      optimizeVertexCache(indices, vertexCount);
+
+      IndexBuffer *lod = context.createResource<IndexBuffer>();
+      uint16_t *data = context.allocateArray<IndexBuffer, uint16_t>(indices.size());
+      std::copy(indices.begin(), indices.end(), data);
+
+      lod->setCount(indices.size());
+      lod->setData(data, nullptr);
+      surface->addLod(lod);
+
+      previousCount = indices.size();
+    }
+  }
+}
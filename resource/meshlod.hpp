@@ -0,0 +1,30 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RESOURCE_MESHLOD_H
+#define MORTAR_RESOURCE_MESHLOD_H
+
+#include "loadcontext.hpp"
+#include "types/mesh.hpp"
+
+namespace Mortar::Resource {
+  // Adds simplified index sets to a mesh's triangle list surfaces, drawn
+  // from its existing vertices. Levels that save too little over the one
+  // before are left out, so a mesh may end up with none.
+  void generateMeshLods(LoadContext& context, Mesh *mesh);
+}
+
+#endif
@@ -0,0 +1,510 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "meshoptimizer.hpp"
+
+// Forsyth's cache model and scoring constants
+#define CACHE_SIZE 32
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+std::vector<uint16_t> Mortar::Resource::triangulateStrip(std::span<const uint16_t> strip) {
+  std::vector<uint16_t> triangles;
+  if (strip.size() < 3) {
+    return triangles;
+  }
+
+  triangles.reserve((strip.size() - 2) * 3);
+
+  // Odd triangles are wound the other way round
+  for (size_t i = 0; i + 2 < strip.size(); i++) {
+    uint16_t a = strip[i], b = strip[i + 1], c = strip[i + 2];
+    if (a == b || b == c || a == c) {
+      continue;
+    }
+
+    if (i & 1) {
+      std::swap(a, b);
+    }
+
+    triangles.push_back(a);
+    triangles.push_back(b);
+    triangles.push_back(c);
+  }
+
+  return triangles;
+}
+
+static float getVertexScore(int cachePosition, unsigned liveTriangles) {
+  if (liveTriangles == 0) {
+    return -1.0f;
+  }
+
+  // The last triangle's vertices get a fixed score, so the next triangle
+  // doesn't just reuse its edge and strip along
+  float score = 0.0f;
+  if (cachePosition >= 0 && cachePosition < 3) {
+    score = LAST_TRIANGLE_SCORE;
+  } else if (cachePosition >= 3) {
+    score = powf(1.0f - (cachePosition - 3) * (1.0f / (CACHE_SIZE - 3)), CACHE_DECAY_POWER);
+  }
+
+  // Vertices with few triangles left are finished off before they're lost
+  return score + VALENCE_BOOST_SCALE * powf((float)liveTriangles, -VALENCE_BOOST_POWER);
+}
+
+void Mortar::Resource::optimizeVertexCache(std::span<uint16_t> indices, size_t vertexCount) {
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount < 2) {
+    return;
+  }
+
+  // Each vertex's live triangles, packed; a triangle is removed from its
+  // vertices' lists as it's emitted
+  std::vector<uint32_t> liveTriangles(vertexCount, 0);
+  for (size_t i = 0; i < triangleCount * 3; i++) {
+    liveTriangles[indices[i]]++;
+  }
+
+  std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; v++) {
+    firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+  }
+
+  std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+  std::vector<uint32_t> filled(vertexCount, 0);
+  for (size_t t = 0; t < triangleCount; t++) {
+    for (int k = 0; k < 3; k++) {
+      uint16_t v = indices[t * 3 + k];
+      vertexTriangles[firstTriangle[v] + filled[v]++] = t;
+    }
+  }
+
+  std::vector<int> cachePositions(vertexCount, -1);
+  std::vector<float> vertexScores(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) {
+    vertexScores[v] = getVertexScore(-1, liveTriangles[v]);
+  }
+
+  std::vector<float> triangleScores(triangleCount);
+  std::vector<bool> isEmitted(triangleCount, false);
+  for (size_t t = 0; t < triangleCount; t++) {
+    triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+  }
+
+  std::vector<uint16_t> output;
+  output.reserve(triangleCount * 3);
+
+  // Three more than the cache, for a triangle's vertices pushed on before
+  // the oldest fall off
+  uint16_t cache[CACHE_SIZE + 3];
+  size_t cacheCount = 0;
+
+  size_t nextUnemitted = 0;
+  long bestTriangle = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+
+  while (output.size() < triangleCount * 3) {
+    // Nothing in the cache has triangles left, so start anywhere new
+    if (bestTriangle < 0) {
+      while (isEmitted[nextUnemitted]) {
+        nextUnemitted++;
+      }
+      bestTriangle = nextUnemitted;
+    }
+
+    const uint16_t *triangle = &indices[bestTriangle * 3];
+    isEmitted[bestTriangle] = true;
+
+    uint16_t newCache[CACHE_SIZE + 3];
+    size_t newCacheCount = 0;
+
+    for (int k = 0; k < 3; k++) {
+      uint16_t v = triangle[k];
+      output.push_back(v);
+      newCache[newCacheCount++] = v;
+
+      uint32_t *live = &vertexTriangles[firstTriangle[v]];
+      uint32_t *liveEnd = live + liveTriangles[v];
+      *std::find(live, liveEnd, (uint32_t)bestTriangle) = *(liveEnd - 1);
+      liveTriangles[v]--;
+    }
+
+    for (size_t i = 0; i < cacheCount; i++) {
+      uint16_t v = cache[i];
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+        newCache[newCacheCount++] = v;
+      }
+    }
+
+    // Vertices that fell out of the cache lose their position score
+    for (size_t i = CACHE_SIZE; i < newCacheCount; i++) {
+      cachePositions[newCache[i]] = -1;
+      vertexScores[newCache[i]] = getVertexScore(-1, liveTriangles[newCache[i]]);
+    }
+
+    cacheCount = std::min<size_t>(newCacheCount, CACHE_SIZE);
+    memcpy(cache, newCache, cacheCount * sizeof(uint16_t));
+
+    for (size_t i = 0; i < cacheCount; i++) {
+      cachePositions[cache[i]] = i;
+      vertexScores[cache[i]] = getVertexScore(i, liveTriangles[cache[i]]);
+    }
+
+    // Only triangles of cached vertices changed score
+    bestTriangle = -1;
+    float bestScore = -1.0f;
+    for (size_t i = 0; i < cacheCount; i++) {
+      uint16_t v = cache[i];
+
+      for (uint32_t j = 0; j < liveTriangles[v]; j++) {
+        uint32_t t = vertexTriangles[firstTriangle[v] + j];
+        const uint16_t *other = &indices[t * 3];
+
+        triangleScores[t] = vertexScores[other[0]] + vertexScores[other[1]] + vertexScores[other[2]];
+        if (triangleScores[t] > bestScore) {
+          bestScore = triangleScores[t];
+          bestTriangle = t;
+        }
+      }
+    }
+  }
+
+  std::copy(output.begin(), output.end(), indices.begin());
+}
+
+float Mortar::Resource::calculateACMR(std::span<const uint16_t> indices) {
+  size_t triangleCount = indices.size() / 3;
+  if (!triangleCount) {
+    return 0.0f;
+  }
+
+  // A vertex is still cached while fewer than the cache's size of misses
+  // have come after its own
+  std::vector<size_t> missedAt(65536, SIZE_MAX);
+  size_t misses = 0;
+  for (uint16_t v : indices) {
+    if (missedAt[v] == SIZE_MAX || misses - missedAt[v] >= ACMR_CACHE_SIZE) {
+      missedAt[v] = misses++;
+    }
+  }
+
+  return (float)misses / triangleCount;
+}
+
+size_t Mortar::Resource::optimizeVertexFetch(std::span<const std::span<uint16_t>> indexLists, uint8_t *vertices, size_t vertexCount, size_t stride) {
+  for (auto& indices : indexLists) {
+    for (uint16_t v : indices) {
+      if (v >= vertexCount) {
+        return vertexCount;
+      }
+    }
+  }
+
+  std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+  uint32_t nextVertex = 0;
+  for (auto& indices : indexLists) {
+    for (uint16_t& v : indices) {
+      if (remap[v] == UINT32_MAX) {
+        remap[v] = nextVertex++;
+      }
+      v = remap[v];
+    }
+  }
+
+  std::vector<uint8_t> reordered(nextVertex * stride);
+  for (size_t v = 0; v < vertexCount; v++) {
+    if (remap[v] != UINT32_MAX) {
+      memcpy(&reordered[remap[v] * stride], vertices + v * stride, stride);
+    }
+  }
+  memcpy(vertices, reordered.data(), reordered.size());
+
+  return nextVertex;
+}
+
+// Rounds of collapses simplifyIndices() makes; each round collapses a set of
+// edges that share no triangles, then rescores
+#define SIMPLIFY_MAX_PASSES 16
+
+// A collapse is refused if it turns a triangle's normal by more than about
+// 80 degrees
+#define SIMPLIFY_MIN_NORMAL_DOT 0.2f
+
+// Sum of squared distances to a set of planes, as the symmetric 4x4 matrix
+// of their outer products: xx xy xz xw yy yz yw zz zw ww
+struct Quadric {
+  double q[10] = {};
+
+  void addPlane(double a, double b, double c, double d) {
+    double plane[4] = { a, b, c, d };
+    int k = 0;
+    for (int i = 0; i < 4; i++) {
+      for (int j = i; j < 4; j++) {
+        this->q[k++] += plane[i] * plane[j];
+      }
+    }
+  }
+
+  void add(const Quadric& other) {
+    for (int i = 0; i < 10; i++) {
+      this->q[i] += other.q[i];
+    }
+  }
+
+  double getError(const float *p) const {
+    double x = p[0], y = p[1], z = p[2];
+
+    return this->q[0] * x * x + 2 * this->q[1] * x * y + 2 * this->q[2] * x * z + 2 * this->q[3] * x
+      + this->q[4] * y * y + 2 * this->q[5] * y * z + 2 * this->q[6] * y
+      + this->q[7] * z * z + 2 * this->q[8] * z
+      + this->q[9];
+  }
+};
+
+static void getNormal(const float *a, const float *b, const float *c, float *normal) {
+  float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+  float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+  normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+  normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+  normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+}
+
+static inline uint32_t getEdgeKey(uint16_t a, uint16_t b) {
+  return a < b ? (uint32_t)a << 16 | b : (uint32_t)b << 16 | a;
+}
+
+std::vector<uint16_t> Mortar::Resource::simplifyIndices(std::span<const uint16_t> indices, const uint8_t *positions, size_t stride, size_t vertexCount, size_t targetIndexCount, float maxError) {
+  std::vector<uint16_t> result(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+
+  for (uint16_t index : result) {
+    if (index >= vertexCount) {
+      return result;
+    }
+  }
+
+  std::vector<float> points(vertexCount * 3);
+  for (size_t i = 0; i < vertexCount; i++) {
+    memcpy(&points[i * 3], positions + i * stride, 3 * sizeof(float));
+  }
+
+  // Each vertex starts with the planes of the triangles around it
+  std::vector<Quadric> quadrics(vertexCount);
+  for (size_t i = 0; i < result.size(); i += 3) {
+    float normal[3];
+    getNormal(&points[result[i] * 3], &points[result[i + 1] * 3], &points[result[i + 2] * 3], normal);
+
+    float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if (length == 0.0f) {
+      continue;
+    }
+
+    double a = normal[0] / length, b = normal[1] / length, c = normal[2] / length;
+    const float *p = &points[result[i] * 3];
+    double d = -(a * p[0] + b * p[1] + c * p[2]);
+
+    for (int j = 0; j < 3; j++) {
+      quadrics[result[i + j]].addPlane(a, b, c, d);
+    }
+  }
+
+  // Edges only one triangle uses are open, and their ends are locked
+  std::vector<uint8_t> isLocked(vertexCount, 0);
+  {
+    std::vector<uint32_t> edges;
+    edges.reserve(result.size());
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (int j = 0; j < 3; j++) {
+        edges.push_back(getEdgeKey(result[i + j], result[i + (j + 1) % 3]));
+      }
+    }
+
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size();) {
+      size_t j = i + 1;
+      while (j < edges.size() && edges[j] == edges[i]) {
+        j++;
+      }
+
+      if (j - i == 1) {
+        isLocked[edges[i] >> 16] = 1;
+        isLocked[edges[i] & 0xffff] = 1;
+      }
+
+      i = j;
+    }
+  }
+
+  struct Collapse {
+    double cost;
+    uint16_t from;
+    uint16_t to;
+  };
+
+  double maxCost = (double)maxError * maxError;
+
+  std::vector<Collapse> collapses;
+  std::vector<uint32_t> edges;
+  std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+  std::vector<uint32_t> vertexTriangles;
+  std::vector<uint8_t> isTouched(vertexCount);
+  std::vector<uint16_t> remap(vertexCount);
+
+  for (int pass = 0; pass < SIMPLIFY_MAX_PASSES && result.size() > targetIndexCount; pass++) {
+    edges.clear();
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (int j = 0; j < 3; j++) {
+        edges.push_back(getEdgeKey(result[i + j], result[i + (j + 1) % 3]));
+      }
+    }
+
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    // Each edge collapses whichever way costs less
+    collapses.clear();
+    for (uint32_t edge : edges) {
+      uint16_t a = edge >> 16, b = edge & 0xffff;
+
+      Quadric merged = quadrics[a];
+      merged.add(quadrics[b]);
+
+      double costAB = isLocked[a] ? INFINITY : merged.getError(&points[b * 3]);
+      double costBA = isLocked[b] ? INFINITY : merged.getError(&points[a * 3]);
+
+      if (costAB <= costBA && costAB <= maxCost) {
+        collapses.push_back({ costAB, a, b });
+      } else if (costBA < costAB && costBA <= maxCost) {
+        collapses.push_back({ costBA, b, a });
+      }
+    }
+
+    if (collapses.empty()) {
+      break;
+    }
+
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+      return a.cost < b.cost;
+    });
+
+    // The triangles around each vertex, for the flip test
+    std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+    for (uint16_t index : result) {
+      triangleOffsets[index + 1]++;
+    }
+    for (size_t i = 0; i < vertexCount; i++) {
+      triangleOffsets[i + 1] += triangleOffsets[i];
+    }
+
+    vertexTriangles.resize(result.size());
+    {
+      std::vector<uint32_t> cursor(triangleOffsets.begin(), triangleOffsets.end() - 1);
+      for (size_t i = 0; i < result.size(); i++) {
+        vertexTriangles[cursor[result[i]]++] = i / 3;
+      }
+    }
+
+    std::fill(isTouched.begin(), isTouched.end(), 0);
+    for (size_t i = 0; i < vertexCount; i++) {
+      remap[i] = i;
+    }
+
+    // Collapses in a round don't share triangles, so none of them sees a
+    // neighbor the round has already moved
+    size_t trianglesLeft = result.size() / 3;
+    size_t collapsed = 0;
+
+    for (const Collapse& collapse : collapses) {
+      if (trianglesLeft * 3 <= targetIndexCount) {
+        break;
+      }
+
+      if (isTouched[collapse.from] || isTouched[collapse.to]) {
+        continue;
+      }
+
+      bool isFlipped = false;
+      unsigned removed = 0;
+
+      for (uint32_t i = triangleOffsets[collapse.from]; i < triangleOffsets[collapse.from + 1] && !isFlipped; i++) {
+        const uint16_t *triangle = &result[vertexTriangles[i] * 3];
+        if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+          removed++;
+          continue;
+        }
+
+        const float *before[3], *after[3];
+        for (int j = 0; j < 3; j++) {
+          before[j] = &points[triangle[j] * 3];
+          after[j] = triangle[j] == collapse.from ? &points[collapse.to * 3] : before[j];
+        }
+
+        float normalBefore[3], normalAfter[3];
+        getNormal(before[0], before[1], before[2], normalBefore);
+        getNormal(after[0], after[1], after[2], normalAfter);
+
+        float dot = normalBefore[0] * normalAfter[0] + normalBefore[1] * normalAfter[1] + normalBefore[2] * normalAfter[2];
+        float lengths = sqrtf((normalBefore[0] * normalBefore[0] + normalBefore[1] * normalBefore[1] + normalBefore[2] * normalBefore[2])
+          * (normalAfter[0] * normalAfter[0] + normalAfter[1] * normalAfter[1] + normalAfter[2] * normalAfter[2]));
+
+        isFlipped = dot <= SIMPLIFY_MIN_NORMAL_DOT * lengths;
+      }
+
+      if (isFlipped) {
+        continue;
+      }
+
+      for (uint32_t i = triangleOffsets[collapse.from]; i < triangleOffsets[collapse.from + 1]; i++) {
+        const uint16_t *triangle = &result[vertexTriangles[i] * 3];
+        for (int j = 0; j < 3; j++) {
+          isTouched[triangle[j]] = 1;
+        }
+      }
+
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to].add(quadrics[collapse.from]);
+
+      trianglesLeft -= removed;
+      collapsed++;
+    }
+
+    if (!collapsed) {
+      break;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      uint16_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+      if (a == b || b == c || a == c) {
+        continue;
+      }
+
+      result[kept++] = a;
+      result[kept++] = b;
+      result[kept++] = c;
+    }
+
+    result.resize(kept);
+  }
+
+  return result;
+}
@@ -0,0 +1,59 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RESOURCE_MESHOPTIMIZER_H
+#define MORTAR_RESOURCE_MESHOPTIMIZER_H
+
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Mortar::Resource {
+  // Load-time index and vertex reordering for triangle meshes
+
+  // The FIFO post-transform cache calculateACMR() models
+  constexpr size_t ACMR_CACHE_SIZE = 16;
+
+  // The same triangles as a list, with each one's winding kept. Degenerate
+  // triangles, which strips use to join runs, are dropped.
+  std::vector<uint16_t> triangulateStrip(std::span<const uint16_t> strip);
+
+  // Reorders a triangle list's triangles for the post-transform vertex
+  // cache, after Tom Forsyth's linear-speed vertex cache optimisation
+  void optimizeVertexCache(std::span<uint16_t> indices, size_t vertexCount);
+
+  // Average cache misses per triangle; 0.5 is about the best a mesh can do,
+  // and 3 is no reuse at all
+  float calculateACMR(std::span<const uint16_t> indices);
+
+  // Orders vertices by first use across every index list drawing from them,
+  // and drops the ones none use. Indices are rewritten to match. Returns the
+  // new vertex count, or vertexCount untouched where an index is out of
+  // range.
+  size_t optimizeVertexFetch(std::span<const std::span<uint16_t>> indexLists, uint8_t *vertices, size_t vertexCount, size_t stride);
+
+  // A coarser triangle list over the same vertices, by quadric error edge
+  // collapse after Garland and Heckbert. Vertices only ever collapse onto
+  // others, so no vertex data is needed. Vertices on open edges, which
+  // include attribute seams, stay where they are. Stops at targetIndexCount,
+  // or before a collapse would move the surface by more than maxError.
+  // positions points at the first vertex's position, three floats, with
+  // stride bytes between vertices.
+  std::vector<uint16_t> simplifyIndices(std::span<const uint16_t> indices, const uint8_t *positions, size_t stride, size_t vertexCount, size_t targetIndexCount, float maxError);
+}
+
+#endif
@@ -0,0 +1,36 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RESOURCE_NAME_H
+#define MORTAR_RESOURCE_NAME_H
+
+#include <stdint.h>
+#include <string_view>
+
+namespace Mortar::Resource {
+  // FNV-1a over a resource's name, exactly as written. It's constexpr so
+  // names known up front can be hashed at compile time.
+  constexpr uint64_t hashName(std::string_view name) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : name) {
+      hash = (hash ^ (uint8_t)c) * 0x100000001b3;
+    }
+
+    return hash;
+  }
+}
+
+#endif
@@ -17,52 +17,199 @@
 #ifndef MORTAR_RESOURCE_POOL_H
 #define MORTAR_RESOURCE_POOL_H
 
-#include <forward_list>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <new>
 #include <stdexcept>
+#include <vector>
 
 #include "resource.hpp"
 
 namespace Mortar::Resource {
+  // Lets the manager own pools of any type
+  class ResourcePoolBase {
+    public:
+      virtual ~ResourcePoolBase() = default;
+  };
+
+  // ResourcePool hands out preconstructed resources from contiguous chunks,
+  // growing by a chunk at a time when every resource is in use. Resources are
+  // returned one by one or all at once with reset(), e.g. at the end of a frame.
   template <ResourceType T = Resource>
-  class ResourcePool {
+  class ResourcePool : public ResourcePoolBase {
     public:
-      ~ResourcePool();
+      ~ResourcePool() override = default;
+
+      ResourcePool(const ResourcePool&) = delete;
+      ResourcePool& operator=(const ResourcePool&) = delete;
 
       T *getResource();
+      void releaseResource(T *resource);
+
+      // Returns every resource to the pool, then shrinks it if the policy says so
       void reset();
 
+      size_t getCapacity() const;
+      size_t getInUseCount() const;
+
+      // Most resources ever in use at once
+      size_t getHighWaterMark() const;
+
+      // With a non-zero window, reset() frees chunks that no reset in the last
+      // window resets needed. Disabled by default.
+      void setShrinkWindow(unsigned resets);
+
       friend class ResourceManager;
 
     protected:
-      ResourcePool(std::forward_list<T *> resources)
-        : resources { resources },
-          iter { this->resources.begin() } {};
+      typedef std::function<T *(void *)> Constructor;
+
+      ResourcePool(size_t chunkSize, Constructor construct);
+
+    private:
+      struct ChunkDeleter {
+        size_t count;
+
+        void operator()(T *chunk) const;
+      };
+
+      typedef std::unique_ptr<T, ChunkDeleter> Chunk;
+
+      void addChunk();
+
+      // Fills the free list so resources come out in address order
+      void refillFreeList();
 
-      std::forward_list<T *> resources;
-      typename std::forward_list<T *>::iterator iter;
+      size_t chunkSize;
+      Constructor construct;
+
+      std::vector<Chunk> chunks;
+      std::vector<T *> freeList;
+
+      size_t inUseCount = 0;
+      size_t highWaterMark = 0;
+
+      unsigned shrinkWindow = 0;
+      unsigned resetsSincePeak = 0;
+      size_t windowPeak = 0;
   };
 
   template <ResourceType T>
-  ResourcePool<T>::~ResourcePool() {
-    for (auto resource : this->resources) {
-      delete resource;
+  ResourcePool<T>::ResourcePool(size_t chunkSize, Constructor construct)
+    : chunkSize { chunkSize },
+      construct { construct } {
+    if (chunkSize == 0) {
+      throw std::runtime_error("pool chunk size must not be zero");
+    }
+
+    this->addChunk();
+    this->refillFreeList();
+  }
+
+  template <ResourceType T>
+  void ResourcePool<T>::ChunkDeleter::operator()(T *chunk) const {
+    for (size_t i = 0; i < this->count; i++) {
+      chunk[i].~T();
+    }
+
+    ::operator delete(static_cast<void *>(chunk), std::align_val_t(alignof(T)));
+  }
+
+  template <ResourceType T>
+  void ResourcePool<T>::addChunk() {
+    void *storage = ::operator new(sizeof(T) * this->chunkSize, std::align_val_t(alignof(T)));
+    T *chunk = static_cast<T *>(storage);
+
+    size_t constructed = 0;
+    try {
+      for (; constructed < this->chunkSize; constructed++) {
+        this->construct(chunk + constructed);
+      }
+    } catch (...) {
+      ChunkDeleter { constructed }(chunk);
+      throw;
+    }
+
+    this->chunks.push_back(Chunk(chunk, ChunkDeleter { this->chunkSize }));
+  }
+
+  template <ResourceType T>
+  void ResourcePool<T>::refillFreeList() {
+    this->freeList.clear();
+    this->freeList.reserve(this->chunks.size() * this->chunkSize);
+
+    for (auto chunk = this->chunks.rbegin(); chunk != this->chunks.rend(); chunk++) {
+      for (size_t i = this->chunkSize; i > 0; i--) {
+        this->freeList.push_back(chunk->get() + i - 1);
+      }
     }
   }
 
   template <ResourceType T>
   T *ResourcePool<T>::getResource() {
-    if (this->iter == this->resources.end()) {
-      throw std::runtime_error("out of resources in pool");
+    if (this->freeList.empty()) {
+      this->addChunk();
+
+      T *chunk = this->chunks.back().get();
+      for (size_t i = this->chunkSize; i > 0; i--) {
+        this->freeList.push_back(chunk + i - 1);
+      }
     }
 
-    T *resource = (*this->iter);
-    this->iter++;
+    T *resource = this->freeList.back();
+    this->freeList.pop_back();
+
+    this->inUseCount++;
+    this->highWaterMark = std::max(this->highWaterMark, this->inUseCount);
+    this->windowPeak = std::max(this->windowPeak, this->inUseCount);
+
     return resource;
   }
 
+  template <ResourceType T>
+  void ResourcePool<T>::releaseResource(T *resource) {
+    this->freeList.push_back(resource);
+    this->inUseCount--;
+  }
+
   template <ResourceType T>
   void ResourcePool<T>::reset() {
-    this->iter = this->resources.begin();
+    if (this->shrinkWindow != 0 && ++this->resetsSincePeak >= this->shrinkWindow) {
+      // Keep enough chunks for the busiest reset in the window, and at least one
+      size_t needed = std::max<size_t>(1, (this->windowPeak + this->chunkSize - 1) / this->chunkSize);
+      if (this->chunks.size() > needed) {
+        this->chunks.resize(needed);
+      }
+
+      this->resetsSincePeak = 0;
+      this->windowPeak = 0;
+    }
+
+    this->inUseCount = 0;
+    this->refillFreeList();
+  }
+
+  template <ResourceType T>
+  size_t ResourcePool<T>::getCapacity() const {
+    return this->chunks.size() * this->chunkSize;
+  }
+
+  template <ResourceType T>
+  size_t ResourcePool<T>::getInUseCount() const {
+    return this->inUseCount;
+  }
+
+  template <ResourceType T>
+  size_t ResourcePool<T>::getHighWaterMark() const {
+    return this->highWaterMark;
+  }
+
+  template <ResourceType T>
+  void ResourcePool<T>::setShrinkWindow(unsigned resets) {
+    this->shrinkWindow = resets;
+    this->resetsSincePeak = 0;
+    this->windowPeak = this->inUseCount;
   }
 }
 
@@ -14,16 +14,121 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <tsl/sparse_map.h>
+#include <vector>
+
 #include "resource.hpp"
 
 using namespace Mortar::Resource;
 
-std::size_t ResourceHandle::nextId = 0;
+// Freed indices wait behind this many others before they're reused, so a
+// generation only wraps after that many frees of the type times its range
+static constexpr size_t MIN_FREE_INDICES = 1024;
+
+namespace {
+  struct HandleType {
+    std::mutex mutex;
+    std::vector<uint8_t> generations;
+    std::deque<uint32_t> freeIndices;
+  };
+
+  std::mutex typesMutex;
+  tsl::sparse_map<std::type_index, uint32_t> typeIds;
+  HandleType handleTypes[ResourceHandle::MAX_TYPES];
+}
+
+ResourceHandle::ResourceHandle(uint32_t type) {
+  HandleType& handleType = handleTypes[type];
+  std::lock_guard<std::mutex> lock(handleType.mutex);
+
+  uint32_t index;
+  if (handleType.freeIndices.size() > MIN_FREE_INDICES) {
+    index = handleType.freeIndices.front();
+    handleType.freeIndices.pop_front();
+  } else if (handleType.generations.size() < MAX_INDICES) {
+    index = handleType.generations.size();
+    handleType.generations.push_back(0);
+  } else if (!handleType.freeIndices.empty()) {
+    index = handleType.freeIndices.front();
+    handleType.freeIndices.pop_front();
+  } else {
+    throw std::runtime_error("too many resources of one type");
+  }
+
+  uint32_t generation = handleType.generations[index];
+  this->value = (generation << (TYPE_BITS + INDEX_BITS)) | (type << INDEX_BITS) | index;
+}
+
+uint32_t ResourceHandle::registerType(std::type_index type) {
+  std::lock_guard<std::mutex> lock(typesMutex);
+
+  auto existing = typeIds.find(type);
+  if (existing != typeIds.end()) {
+    return existing->second;
+  }
+
+  // Type zero is left unused, so no handle is all zeroes
+  uint32_t id = typeIds.size() + 1;
+  if (id >= MAX_TYPES) {
+    throw std::runtime_error("too many resource types");
+  }
+
+  typeIds[type] = id;
+  return id;
+}
+
+void ResourceHandle::release(const ResourceHandle& handle) {
+  if (!handle.value) {
+    return;
+  }
+
+  HandleType& handleType = handleTypes[handle.getType()];
+  std::lock_guard<std::mutex> lock(handleType.mutex);
+
+  uint8_t& generation = handleType.generations[handle.getIndex()];
+  if (generation != handle.getGeneration()) {
+    return;
+  }
+
+  generation++;
+  handleType.freeIndices.push_back(handle.getIndex());
+}
 
 bool ResourceHandle::operator==(const ResourceHandle &other) const {
-  return this->id == other.id && this->type == other.type;
+  return this->value == other.value;
+}
+
+uint32_t ResourceHandle::getValue() const {
+  return this->value;
+}
+
+uint32_t ResourceHandle::getIndex() const {
+  return this->value & (MAX_INDICES - 1);
+}
+
+uint32_t ResourceHandle::getType() const {
+  return (this->value >> INDEX_BITS) & (MAX_TYPES - 1);
+}
+
+uint32_t ResourceHandle::getGeneration() const {
+  return this->value >> (TYPE_BITS + INDEX_BITS);
+}
+
+Resource::~Resource() {
+  ResourceHandle::release(this->handle);
 }
 
 const ResourceHandle& Resource::getHandle() const {
   return this->handle;
 }
+
+uint32_t Resource::getRenderSlot() const {
+  return this->renderSlot;
+}
+
+void Resource::setRenderSlot(uint32_t slot) const {
+  this->renderSlot = slot;
+}
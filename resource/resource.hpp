@@ -17,37 +17,82 @@
 #ifndef MORTAR_RESOURCE_H
 #define MORTAR_RESOURCE_H
 
+#include <atomic>
 #include <functional>
+#include <stdint.h>
 #include <string>
 #include <typeindex>
 
 namespace Mortar::Resource {
-  // ResourceHandle is an opaque unique identifier for resources
+  class Arena;
+
+  // ResourceHandle is an opaque unique identifier for resources. It packs a
+  // generation, a type and an index into 32 bits; indices are dense within
+  // each type, so tables keyed by handle can be plain arrays. A freed
+  // handle's index is reused under the next generation, which tells a stale
+  // handle from the one now holding the index.
   class ResourceHandle {
     public:
+      static constexpr unsigned INDEX_BITS = 19;
+      static constexpr unsigned TYPE_BITS = 5;
+      static constexpr unsigned GENERATION_BITS = 8;
+
+      static constexpr uint32_t MAX_INDICES = 1u << INDEX_BITS;
+      static constexpr uint32_t MAX_TYPES = 1u << TYPE_BITS;
+
+      // Names no resource; every real handle is non-zero
+      constexpr ResourceHandle()
+        : value { 0 } {};
+
       bool operator==(const ResourceHandle& other) const;
 
-      friend std::hash<ResourceHandle>;
+      // The whole handle, for packing into keys
+      uint32_t getValue() const;
+
+      uint32_t getIndex() const;
+      uint32_t getType() const;
+      uint32_t getGeneration() const;
+
+      friend class Resource;
       friend class ResourceManager;
 
     private:
       // Restrict construction of ResourceHandles; only the ResourceManager
       // should be creating new ones
-      ResourceHandle(std::type_index type)
-        : id { ResourceHandle::nextId++ }, type { type } {};
+      explicit ResourceHandle(uint32_t type);
+
+      // Types are numbered from one as they're first given a handle
+      template <typename T>
+      static uint32_t getTypeId() {
+        static const uint32_t id = ResourceHandle::registerType(typeid(T));
+        return id;
+      }
 
-      static std::size_t nextId;
+      static uint32_t registerType(std::type_index type);
 
-      std::size_t id;
-      std::type_index type;
+      // Returns the index for reuse under the next generation
+      static void release(const ResourceHandle& handle);
+
+      uint32_t value;
   };
 
   class Resource {
     public:
-      virtual ~Resource() = default;
+      virtual ~Resource();
+
+      Resource(const Resource&) = delete;
+      Resource& operator=(const Resource&) = delete;
 
       const ResourceHandle& getHandle() const;
 
+      // Index a renderer gave the resource on registering it, so draws can
+      // find what was made for it without a lookup. Only the render thread
+      // sets or reads it.
+      static constexpr uint32_t NO_RENDER_SLOT = UINT32_MAX;
+
+      uint32_t getRenderSlot() const;
+      void setRenderSlot(uint32_t slot) const;
+
       friend class ResourceManager;
 
     protected:
@@ -56,6 +101,11 @@ namespace Mortar::Resource {
 
     private:
       ResourceHandle handle;
+
+      mutable uint32_t renderSlot = NO_RENDER_SLOT;
+
+      // Set when the resource lives in a load's arena rather than on the heap
+      Arena *arena = nullptr;
   };
 
   template <typename T>
@@ -69,10 +119,7 @@ namespace Mortar::Resource {
 template <>
 struct std::hash<Mortar::Resource::ResourceHandle> {
   std::size_t operator()(const Mortar::Resource::ResourceHandle& handle) const noexcept {
-    std::size_t h1 = std::hash<std::size_t>{}(handle.id);
-    std::size_t h2 = std::hash<std::type_index>{}(handle.type);
-
-    return h1 ^ (h2 << 1);
+    return handle.getValue();
   }
 };
 
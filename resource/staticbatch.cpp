@@ -0,0 +1,376 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <forward_list>
+#include <map>
+#include <math.h>
+#include <stdexcept>
+#include <string.h>
+#include <tuple>
+#include <unordered_map>
+
+#include "../log.hpp"
+#include "../profiler.hpp"
+#include "meshlod.hpp"
+#include "staticbatch.hpp"
+
+using namespace Mortar::Resource;
+
+// Meshes placed more often than this are left to instancing
+static constexpr unsigned MAX_PLACEMENTS = 4;
+
+// Meshes using more vertices than this are drawn on their own
+static constexpr size_t MAX_MESH_VERTICES = 1024;
+
+// The grid over the batchable instances has this many cells a side;
+// placements bigger than a cell are drawn on their own
+static constexpr unsigned CELLS_PER_AXIS = 8;
+
+// Merged meshes are split before their vertices outgrow 16-bit indices
+static constexpr size_t MAX_BATCH_VERTICES = 0x10000;
+
+// The vertices a batchable mesh uses, in the order its surfaces first use
+// them, and every surface's indices into that list
+struct MeshVertices {
+  std::vector<uint16_t> used;
+  std::vector<uint16_t> indices;
+};
+
+struct Placement {
+  Mesh *mesh;
+  const Mortar::Math::Affine *transform;
+  Mortar::Math::AABB bounds;
+};
+
+using GroupKey = std::tuple<const Material *, ShaderType, const VertexLayout *, uint32_t>;
+
+static bool hasTransformableLayout(const VertexLayout& layout) {
+  bool hasPosition = false;
+
+  for (const auto& property : layout.getProperties()) {
+    switch (property.getUsage()) {
+      case VertexUsage::POSITION:
+        if (property.getDataType() != VertexDataType::VEC3) {
+          return false;
+        }
+        hasPosition = true;
+        break;
+      case VertexUsage::NORMAL:
+        if (property.getDataType() != VertexDataType::VEC3 && property.getDataType() != VertexDataType::INT_2_10_10_10) {
+          return false;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  return hasPosition;
+}
+
+// Whether a mesh can be merged, and if so the vertices it uses
+static bool getMeshVertices(const Mesh *mesh, MeshVertices& vertices) {
+  if (mesh->getShaderType() == ShaderType::INVALID || mesh->getShaderType() == ShaderType::SKIN) {
+    return false;
+  }
+
+  // Blended draws are sorted back to front, which they can't be once merged
+  const Material *material = mesh->getMaterial();
+  if (!material || material->isAlphaBlended()) {
+    return false;
+  }
+
+  const VertexLayout& layout = mesh->getVertexLayout();
+  const VertexBuffer *vertexBuffer = mesh->getVertexBuffer();
+  if (!vertexBuffer || !vertexBuffer->getData() || !layout.getStride() || !hasTransformableLayout(layout)) {
+    return false;
+  }
+
+  size_t vertexCount = vertexBuffer->getSize() / layout.getStride();
+  std::vector<int32_t> remap(vertexCount, -1);
+
+  for (auto surface : mesh->getSurfaces()) {
+    const IndexBuffer *indexBuffer = surface->getIndexBuffer();
+    if (surface->getPrimitiveType() != PrimitiveType::TRIANGLE_LIST || !indexBuffer->getData()) {
+      return false;
+    }
+
+    for (unsigned i = 0; i < indexBuffer->getCount(); i++) {
+      uint16_t vertex = indexBuffer->getData()[i];
+      if (vertex >= vertexCount) {
+        return false;
+      }
+
+      if (remap[vertex] < 0) {
+        if (vertices.used.size() == MAX_MESH_VERTICES) {
+          return false;
+        }
+
+        remap[vertex] = vertices.used.size();
+        vertices.used.push_back(vertex);
+      }
+
+      vertices.indices.push_back(remap[vertex]);
+    }
+  }
+
+  return !vertices.indices.empty();
+}
+
+static Mortar::Math::AABB calculateBounds(const VertexLayout& layout, const uint8_t *vertices, size_t vertexCount) {
+  std::span<const VertexLayout::VertexProperty> properties = layout.getProperties();
+  auto position = std::find_if(properties.begin(), properties.end(), [](const auto& property) {
+    return property.getUsage() == VertexUsage::POSITION;
+  });
+
+  float min[3] = { INFINITY, INFINITY, INFINITY };
+  float max[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+  for (size_t i = 0; i < vertexCount; i++) {
+    float vertex[3];
+    memcpy(vertex, vertices + i * layout.getStride() + position->getOffset(), sizeof(vertex));
+
+    for (int j = 0; j < 3; j++) {
+      min[j] = std::min(min[j], vertex[j]);
+      max[j] = std::max(max[j], vertex[j]);
+    }
+  }
+
+  return Mortar::Math::AABB::fromMinMax(
+    Mortar::Math::Vector(min[0], min[1], min[2], 1.0f),
+    Mortar::Math::Vector(max[0], max[1], max[2], 1.0f));
+}
+
+static Mesh *createMergedMesh(LoadContext& context, const GroupKey& key, const std::vector<uint8_t>& vertices, const std::vector<uint16_t>& indices) {
+  const VertexLayout& layout = *std::get<const VertexLayout *>(key);
+
+  VertexBuffer *vertexBuffer = context.createResource<VertexBuffer>();
+  uint8_t *vertexData = context.allocateArray<VertexBuffer, uint8_t>(vertices.size());
+  std::copy(vertices.begin(), vertices.end(), vertexData);
+
+  vertexBuffer->setSize(vertices.size());
+  vertexBuffer->setData(vertexData, nullptr);
+  vertexBuffer->computeContentHash();
+
+  IndexBuffer *indexBuffer = context.createResource<IndexBuffer>();
+  uint16_t *indexData = context.allocateArray<IndexBuffer, uint16_t>(indices.size());
+  std::copy(indices.begin(), indices.end(), indexData);
+
+  indexBuffer->setCount(indices.size());
+  indexBuffer->setData(indexData, nullptr);
+
+  Surface *surface = context.createResource<Surface>();
+  surface->setPrimitiveType(PrimitiveType::TRIANGLE_LIST);
+  surface->setIndexBuffer(indexBuffer);
+  surface->setSkinTransformCount(0);
+
+  std::vector<ushort> skinTransformIndices;
+  surface->setSkinTransformIndices(skinTransformIndices);
+
+  Mesh *mesh = context.createResource<Mesh>();
+  mesh->addSurface(surface);
+  mesh->setMaterial(std::get<const Material *>(key));
+  mesh->setShaderType(std::get<ShaderType>(key));
+  mesh->setVertexLayout(layout);
+  mesh->setVertexBuffer(vertexBuffer);
+  mesh->setBounds(calculateBounds(layout, vertices.data(), vertices.size() / layout.getStride()));
+
+  generateMeshLods(context, mesh);
+
+  return mesh;
+}
+
+std::vector<Mesh *> Mortar::Resource::batchStaticInstances(LoadContext& context, Scene *scene) {
+  PROFILE_ZONE("batchStaticInstances");
+
+  const std::vector<Instance *>& instances = scene->getInstances();
+
+  std::unordered_map<const Mesh *, unsigned> placementCounts;
+  for (auto instance : instances) {
+    for (auto mesh : instance->getMeshes()) {
+      placementCounts[mesh]++;
+    }
+  }
+
+  std::unordered_map<const Mesh *, MeshVertices> meshVertices;
+  for (auto& [mesh, count] : placementCounts) {
+    MeshVertices vertices;
+    if (count <= MAX_PLACEMENTS && getMeshVertices(mesh, vertices)) {
+      meshVertices.emplace(mesh, std::move(vertices));
+    }
+  }
+
+  // Every placement of a batchable mesh, and the grid around them all
+  std::vector<Placement> candidates;
+  Math::AABB gridBounds;
+  for (auto instance : instances) {
+    Math::Matrix transform = instance->getWorldTransform().toMatrix();
+
+    for (auto mesh : instance->getMeshes()) {
+      if (!meshVertices.contains(mesh) || mesh->getBounds().isEmpty()) {
+        continue;
+      }
+
+      Math::AABB bounds = mesh->getBounds().transform(transform);
+      candidates.push_back({ mesh, &instance->getWorldTransform(), bounds });
+      gridBounds = gridBounds.isEmpty() ? bounds : gridBounds.merge(bounds);
+    }
+  }
+
+  if (candidates.empty()) {
+    return {};
+  }
+
+  float gridMin[3] = { gridBounds.center.x - gridBounds.extents.x, gridBounds.center.y - gridBounds.extents.y, gridBounds.center.z - gridBounds.extents.z };
+  float gridSize[3] = { gridBounds.extents.x * 2.0f, gridBounds.extents.y * 2.0f, gridBounds.extents.z * 2.0f };
+
+  float cellSize[3];
+  for (int i = 0; i < 3; i++) {
+    cellSize[i] = gridSize[i] / CELLS_PER_AXIS;
+  }
+
+  // Groups are kept in the order they're first seen, so merged meshes come
+  // out the same on every load
+  std::map<GroupKey, size_t> groupIndices;
+  std::vector<std::pair<GroupKey, std::vector<const Placement *>>> groups;
+
+  for (const Placement& placement : candidates) {
+    float center[3] = { placement.bounds.center.x, placement.bounds.center.y, placement.bounds.center.z };
+    float size[3] = { placement.bounds.extents.x * 2.0f, placement.bounds.extents.y * 2.0f, placement.bounds.extents.z * 2.0f };
+
+    bool isLarge = false;
+    uint32_t cell = 0;
+    for (int i = 0; i < 3; i++) {
+      if (size[i] > cellSize[i] && cellSize[i] > 0.0f) {
+        isLarge = true;
+      }
+
+      uint32_t cellIdx = cellSize[i] > 0.0f ? (uint32_t)std::clamp<float>(floorf((center[i] - gridMin[i]) / cellSize[i]), 0.0f, CELLS_PER_AXIS - 1) : 0;
+      cell = cell * CELLS_PER_AXIS + cellIdx;
+    }
+
+    if (isLarge) {
+      continue;
+    }
+
+    const Mesh *mesh = placement.mesh;
+    GroupKey key { mesh->getMaterial(), mesh->getShaderType(), &mesh->getVertexLayout(), cell };
+
+    auto [groupIdx, inserted] = groupIndices.try_emplace(key, groups.size());
+    if (inserted) {
+      groups.push_back({ key, {} });
+    }
+
+    groups[groupIdx->second].second.push_back(&placement);
+  }
+
+  // A placement alone in its group gains nothing from being merged
+  std::vector<Mesh *> mergedMeshes;
+  std::unordered_map<const Math::Affine *, std::vector<const Mesh *>> batched;
+  size_t batchedCount = 0;
+
+  for (auto& [key, placements] : groups) {
+    if (placements.size() < 2) {
+      continue;
+    }
+
+    const VertexLayout& layout = *std::get<const VertexLayout *>(key);
+    size_t stride = layout.getStride();
+
+    std::vector<uint8_t> vertices;
+    std::vector<uint16_t> indices;
+    std::vector<uint8_t> gathered;
+
+    for (const Placement *placement : placements) {
+      const MeshVertices& used = meshVertices.at(placement->mesh);
+
+      size_t base = vertices.size() / stride;
+      if (base + used.used.size() > MAX_BATCH_VERTICES) {
+        mergedMeshes.push_back(createMergedMesh(context, key, vertices, indices));
+        vertices.clear();
+        indices.clear();
+        base = 0;
+      }
+
+      const uint8_t *source = placement->mesh->getVertexBuffer()->getData();
+      gathered.resize(used.used.size() * stride);
+      for (size_t i = 0; i < used.used.size(); i++) {
+        memcpy(gathered.data() + i * stride, source + used.used[i] * stride, stride);
+      }
+
+      vertices.resize((base + used.used.size()) * stride);
+      if (!transformVertices(layout, gathered.data(), used.used.size(), *placement->transform, vertices.data() + base * stride)) {
+        throw std::runtime_error("can't transform batched vertices");
+      }
+
+      for (uint16_t index : used.indices) {
+        indices.push_back(base + index);
+      }
+
+      batched[placement->transform].push_back(placement->mesh);
+      batchedCount++;
+    }
+
+    mergedMeshes.push_back(createMergedMesh(context, key, vertices, indices));
+  }
+
+  if (mergedMeshes.empty()) {
+    return {};
+  }
+
+  // Instances that lost some of their meshes are replaced by copies with
+  // the rest, and those that lost them all are dropped
+  std::vector<Instance *> remaining;
+  for (auto instance : instances) {
+    auto batchedMeshes = batched.find(&instance->getWorldTransform());
+    if (batchedMeshes == batched.end()) {
+      remaining.push_back(instance);
+      continue;
+    }
+
+    std::vector<Mesh *> kept;
+    for (auto mesh : instance->getMeshes()) {
+      if (std::find(batchedMeshes->second.begin(), batchedMeshes->second.end(), mesh) == batchedMeshes->second.end()) {
+        kept.push_back(mesh);
+      }
+    }
+
+    if (kept.empty()) {
+      continue;
+    }
+
+    Instance *copy = context.createResource<Instance>();
+    copy->setWorldTransform(instance->getWorldTransform());
+    copy->setMeshes(std::forward_list<Mesh *>(kept.begin(), kept.end()));
+
+    remaining.push_back(copy);
+  }
+
+  for (auto mesh : mergedMeshes) {
+    Instance *instance = context.createResource<Instance>();
+    instance->setWorldTransform(Math::Affine());
+    instance->setMeshes({ mesh });
+
+    remaining.push_back(instance);
+  }
+
+  DEBUG("merged %zu static placements into %zu meshes", batchedCount, mergedMeshes.size());
+
+  scene->setInstances(std::move(remaining));
+
+  return mergedMeshes;
+}
@@ -0,0 +1,40 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RESOURCE_STATICBATCH_H
+#define MORTAR_RESOURCE_STATICBATCH_H
+
+#include <vector>
+
+#include "loadcontext.hpp"
+#include "types/mesh.hpp"
+#include "types/scene.hpp"
+
+namespace Mortar::Resource {
+  // Load-time merging of a scene's small static instances. Opaque, unskinned
+  // meshes placed only a few times have their vertices moved into world
+  // space and appended to one mesh per material, shader, layout and grid
+  // cell. The cells are sized for culling. Large meshes and meshes placed
+  // often are left as they are, to be culled or instanced on their own.
+  //
+  // The scene's instances are replaced. Instances that kept only some of
+  // their meshes are new, so the old ones stay as they were for anyone still
+  // reading them. The merged meshes are returned for the caller to add to
+  // its model.
+  std::vector<Mesh *> batchStaticInstances(LoadContext& context, Scene *scene);
+}
+
+#endif
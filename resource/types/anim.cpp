@@ -14,9 +14,15 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <assert.h>
+#include <bit>
+#include <cfloat>
+#include <climits>
+#include <cmath>
 #include <stdexcept>
 
+#include "../../log.hpp"
 #include "anim.hpp"
 
 using namespace Mortar::Resource;
@@ -41,6 +47,398 @@ void Animation::addElement(Element *element) {
   this->elements.push_back(element);
 }
 
+// Raw keys as read, (time, inverse duration, value, rate)
+struct RawKey {
+  float time;
+  float inverseDuration;
+  float value;
+  float rate;
+};
+
+// Keys the baked channel would decode to
+struct BakedKey {
+  float time;
+  float value;
+  float rate;
+};
+
+static inline float evaluateHermite(float u, float startValue, float endValue, float startRate, float endRate) {
+  float u2 = u * u;
+  float u3 = u2 * u;
+
+  return (2 * u3 - 3 * u2 + 1) * startValue + (-2 * u3 + 3 * u2) * endValue + (u3 - 2 * u2 + u) * startRate + (u3 - u2) * endRate;
+}
+
+// The curve as the unbaked evaluator plays it, finding the segment from the
+// keyframe masks at the position's whole frame rather than by key time, so a
+// bake that changes what's played shows up as error
+static float evaluateKeyframes(const Animation::Channel *channel, const std::vector<RawKey>& keys, unsigned intervalCount, float position) {
+  position = fmaxf(position, 1.0f);
+
+  unsigned interval = std::min(((unsigned)position - 1) >> 5, intervalCount - 1);
+  unsigned frame = (interval << 5) + (unsigned)(position - (float)(interval << 5) - 1.0f);
+
+  // Only out of range for malformed masks, which the evaluator would read
+  // past the keys for
+  unsigned keyframe = std::clamp<unsigned>(channel->getKeyframeCount(frame), 1, keys.size() - 1);
+
+  const RawKey& start = keys[keyframe - 1];
+  const RawKey& end = keys[keyframe];
+
+  float duration = end.time - start.time;
+  float u = (position - start.time) * start.inverseDuration;
+
+  return evaluateHermite(u, start.value, end.value, duration * start.rate, duration * end.rate);
+}
+
+// Largest error over the samples in [from, until) of the segment from start
+// to end. NaN from a zero-length segment counts as too large.
+static float getSegmentError(const BakedKey& start, const BakedKey& end, float from, float until, const std::vector<float>& samples, const std::vector<float>& expected) {
+  float duration = end.time - start.time;
+  float inverseDuration = 1.0f / duration;
+
+  float error = 0.0f;
+  for (size_t i = std::lower_bound(samples.begin(), samples.end(), from) - samples.begin(); i < samples.size() && samples[i] < until; i++) {
+    float u = (samples[i] - start.time) * inverseDuration;
+    float value = evaluateHermite(u, start.value, end.value, duration * start.rate, duration * end.rate);
+
+    float difference = fabsf(value - expected[i]);
+    if (!(difference <= error)) {
+      error = std::isnan(difference) ? INFINITY : difference;
+    }
+  }
+
+  return error;
+}
+
+static uint16_t quantize(float value, float min, float scale) {
+  if (scale == 0.0f) {
+    return 0;
+  }
+
+  return (uint16_t)std::clamp(lroundf((value - min) / scale), 0l, 65535l);
+}
+
+static void bakeChannel(Animation::BakedChannels& baked, const Animation::Channel *channel, float length, unsigned intervalCount, float tolerance) {
+  Animation::BakedChannels::Channel info {};
+
+  auto addFloatKeys = [&] (const std::vector<BakedKey>& keys) {
+    info.firstKey = baked.times.size();
+    info.keyCount = keys.size();
+    info.isQuantized = false;
+
+    for (auto& key : keys) {
+      baked.times.push_back(key.time);
+      baked.values.push_back(key.value);
+      baked.rates.push_back(key.rate);
+    }
+
+    baked.channels.push_back(info);
+  };
+
+  if (channel->getKeyframeType() == Animation::KeyframeType::NONE) {
+    addFloatKeys({ { 0.0f, channel->getFloatData(), 0.0f } });
+    return;
+  }
+
+  const RawKey *data = (const RawKey *)channel->getData();
+  std::vector<RawKey> rawKeys (data, data + channel->getDataSize() / sizeof(RawKey));
+  assert(rawKeys.size() >= 2);
+
+  // Checked at every half frame played and at every original key
+  std::vector<float> samples;
+  for (float position = 1.0f; position < length; position += 0.5f) {
+    samples.push_back(position);
+  }
+  for (auto& key : rawKeys) {
+    if (key.time >= 1.0f && key.time < length) {
+      samples.push_back(key.time);
+    }
+  }
+  std::sort(samples.begin(), samples.end());
+  samples.erase(std::unique(samples.begin(), samples.end()), samples.end());
+
+  std::vector<float> expected;
+  for (float sample : samples) {
+    expected.push_back(evaluateKeyframes(channel, rawKeys, intervalCount, sample));
+  }
+
+  if (!expected.empty()) {
+    auto [min, max] = std::minmax_element(expected.begin(), expected.end());
+    if (*max - *min <= 2 * tolerance) {
+      addFloatKeys({ { 0.0f, (*min + *max) * 0.5f, 0.0f } });
+      return;
+    }
+  }
+
+  // Quantized over the channel's own ranges
+  float valueMin = INFINITY, valueMax = -INFINITY, rateMin = INFINITY, rateMax = -INFINITY;
+  for (auto& key : rawKeys) {
+    valueMin = fminf(valueMin, key.value);
+    valueMax = fmaxf(valueMax, key.value);
+    rateMin = fminf(rateMin, key.rate);
+    rateMax = fmaxf(rateMax, key.rate);
+  }
+
+  info.valueMin = valueMin;
+  info.valueScale = (valueMax - valueMin) / 65535.0f;
+  info.rateMin = rateMin;
+  info.rateScale = (rateMax - rateMin) / 65535.0f;
+
+  std::vector<uint16_t> quantizedTimes, quantizedValues, quantizedRates;
+  std::vector<BakedKey> keys;
+  for (auto& key : rawKeys) {
+    quantizedTimes.push_back(quantize(key.time, baked.timeBase, baked.timeStep));
+    quantizedValues.push_back(quantize(key.value, info.valueMin, info.valueScale));
+    quantizedRates.push_back(quantize(key.rate, info.rateMin, info.rateScale));
+
+    keys.push_back({
+      baked.timeBase + quantizedTimes.back() * baked.timeStep,
+      info.valueMin + quantizedValues.back() * info.valueScale,
+      info.rateMin + quantizedRates.back() * info.rateScale,
+    });
+  }
+
+  // Segments at either end also cover the positions past them
+  auto getSegmentErrorAt = [&] (size_t start, size_t end) {
+    float from = start == 0 ? -FLT_MAX : keys[start].time;
+    float until = end == keys.size() - 1 ? FLT_MAX : keys[end].time;
+
+    return getSegmentError(keys[start], keys[end], from, until, samples, expected);
+  };
+
+  float quantizationError = 0.0f;
+  for (size_t i = 0; i + 1 < keys.size(); i++) {
+    quantizationError = fmaxf(quantizationError, getSegmentErrorAt(i, i + 1));
+  }
+
+  info.isQuantized = quantizationError <= tolerance;
+  if (!info.isQuantized) {
+    float rawError = 0.0f;
+    for (size_t i = 0; i < keys.size(); i++) {
+      keys[i] = { rawKeys[i].time, rawKeys[i].value, rawKeys[i].rate };
+    }
+    for (size_t i = 0; i + 1 < keys.size(); i++) {
+      rawError = fmaxf(rawError, getSegmentErrorAt(i, i + 1));
+    }
+
+    // Segments picked by time play differently from the masks' own choice
+    if (rawError > tolerance) {
+      DEBUG("baked channel strays %f from its keyframes", rawError);
+    }
+  }
+
+  // Drop each key its neighbours can stand in for, testing only the
+  // samples the merged segment would cover. Keys are only ever dropped
+  // between the last one kept and the next, so the kept list grows at the
+  // end and nothing is copied to try a merge.
+  std::vector<size_t> kept { 0 };
+  for (size_t i = 1; i + 1 < keys.size(); i++) {
+    if (getSegmentErrorAt(kept.back(), i + 1) > tolerance) {
+      kept.push_back(i);
+    }
+  }
+  kept.push_back(keys.size() - 1);
+
+  if (!info.isQuantized) {
+    std::vector<BakedKey> keptKeys;
+    for (size_t i : kept) {
+      keptKeys.push_back(keys[i]);
+    }
+
+    addFloatKeys(keptKeys);
+    return;
+  }
+
+  info.firstKey = baked.quantizedTimes.size();
+  info.keyCount = kept.size();
+
+  for (size_t i : kept) {
+    baked.quantizedTimes.push_back(quantizedTimes[i]);
+    baked.quantizedValues.push_back(quantizedValues[i]);
+    baked.quantizedRates.push_back(quantizedRates[i]);
+  }
+
+  baked.channels.push_back(info);
+}
+
+void Animation::groupChannels() {
+  ChannelBatches& batches = this->channelBatches;
+  batches = ChannelBatches();
+
+  unsigned channelsPerElement = this->elements.empty() ? 0 : this->elements.front()->getChannelCount();
+  for (size_t i = 0; i < this->elements.size(); i++) {
+    for (unsigned j = 0; j < channelsPerElement; j++) {
+      uint32_t channelIdx = i * channelsPerElement + j;
+
+      switch (this->elements[i]->getChannel(j)->getKeyframeType()) {
+        case KeyframeType::NONE:
+          batches.constant.push_back(channelIdx);
+          break;
+        case KeyframeType::BOOLEAN:
+          batches.boolean.push_back(channelIdx);
+          break;
+        case KeyframeType::FLOAT:
+          batches.keyframed.push_back(channelIdx);
+          break;
+      }
+    }
+  }
+}
+
+void Animation::bake(float tolerance) {
+  BakedChannels& baked = this->bakedChannels;
+  baked = BakedChannels();
+  this->baked = false;
+
+  this->groupChannels();
+
+  if (this->elements.empty()) {
+    return;
+  }
+
+  baked.channelsPerElement = this->elements.front()->getChannelCount();
+
+  // Times share one quantization range across the animation
+  float minTime = INFINITY;
+  float maxTime = -INFINITY;
+
+  for (const Element *element : this->elements) {
+    assert(element->getChannelCount() == baked.channelsPerElement);
+
+    for (unsigned i = 0; i < baked.channelsPerElement; i++) {
+      const Channel *channel = element->getChannel(i);
+
+      if (channel->getKeyframeType() == KeyframeType::NONE) {
+        continue;
+      } else if (channel->getKeyframeType() != KeyframeType::FLOAT) {
+        return;
+      }
+
+      const RawKey *keys = (const RawKey *)channel->getData();
+      size_t keyCount = channel->getDataSize() / sizeof(RawKey);
+      for (size_t j = 0; j < keyCount; j++) {
+        minTime = fminf(minTime, keys[j].time);
+        maxTime = fmaxf(maxTime, keys[j].time);
+      }
+    }
+  }
+
+  if (maxTime > minTime) {
+    baked.timeBase = minTime;
+    baked.timeStep = (maxTime - minTime) / 65535.0f;
+  }
+
+  for (const Element *element : this->elements) {
+    for (unsigned i = 0; i < baked.channelsPerElement; i++) {
+      bakeChannel(baked, element->getChannel(i), this->length, this->intervalCount, tolerance);
+    }
+  }
+
+  this->baked = true;
+}
+
+bool Animation::isBaked() const {
+  return this->baked;
+}
+
+const Animation::BakedChannels& Animation::getBakedChannels() const {
+  return this->bakedChannels;
+}
+
+const Animation::ChannelBatches& Animation::getChannelBatches() const {
+  return this->channelBatches;
+}
+
+float Animation::BakedChannels::getKeyTime(const Channel& channel, uint32_t key) const {
+  if (channel.isQuantized) {
+    return this->timeBase + this->quantizedTimes[channel.firstKey + key] * this->timeStep;
+  }
+
+  return this->times[channel.firstKey + key];
+}
+
+float Animation::BakedChannels::getKeyValue(const Channel& channel, uint32_t key) const {
+  if (channel.isQuantized) {
+    return channel.valueMin + this->quantizedValues[channel.firstKey + key] * channel.valueScale;
+  }
+
+  return this->values[channel.firstKey + key];
+}
+
+float Animation::BakedChannels::getKeyRate(const Channel& channel, uint32_t key) const {
+  if (channel.isQuantized) {
+    return channel.rateMin + this->quantizedRates[channel.firstKey + key] * channel.rateScale;
+  }
+
+  return this->rates[channel.firstKey + key];
+}
+
+uint32_t Animation::BakedChannels::findSegment(const Channel& channel, float position, uint32_t hint) const {
+  if (channel.keyCount < 2) {
+    return 0;
+  }
+
+  // The answer is the last segment starting at or before position, or the
+  // first segment if none do
+  uint32_t last = channel.keyCount - 2;
+  uint32_t low = 0;
+  uint32_t high = last;
+
+  hint = std::min(hint, last);
+  if (this->getKeyTime(channel, hint) <= position) {
+    for (int i = 0; i < 2 && hint < last && this->getKeyTime(channel, hint + 1) <= position; i++) {
+      hint++;
+    }
+
+    if (hint == last || position < this->getKeyTime(channel, hint + 1)) {
+      return hint;
+    }
+
+    low = hint + 1;
+  } else if (hint == 0) {
+    return 0;
+  } else {
+    high = hint - 1;
+  }
+
+  while (low < high) {
+    uint32_t mid = (low + high + 1) / 2;
+
+    if (this->getKeyTime(channel, mid) <= position) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+
+  return low;
+}
+
+Animation::BakedChannels::Segment Animation::BakedChannels::decodeSegment(const Channel& channel, uint32_t key) const {
+  if (channel.keyCount < 2) {
+    float value = this->getKeyValue(channel, 0);
+
+    // Zero inverse duration keeps u at zero wherever the position is
+    return { -FLT_MAX, FLT_MAX, 0.0f, 0.0f, value, value, 0.0f, 0.0f };
+  }
+
+  float startTime = this->getKeyTime(channel, key);
+  float endTime = this->getKeyTime(channel, key + 1);
+  float duration = endTime - startTime;
+
+  return {
+    key == 0 ? -FLT_MAX : startTime,
+    key == channel.keyCount - 2 ? FLT_MAX : endTime,
+    startTime,
+    1.0f / duration,
+    this->getKeyValue(channel, key),
+    this->getKeyValue(channel, key + 1),
+    duration * this->getKeyRate(channel, key),
+    duration * this->getKeyRate(channel, key + 1),
+  };
+}
+
 Animation::KeyframeType Animation::Channel::getKeyframeType() const {
   return this->keyframeType;
 }
@@ -69,13 +467,48 @@ const uint8_t *Animation::Channel::getKeyframeMask(unsigned interval) const {
 }
 
 void Animation::Channel::addIntervalOffset(size_t offset) {
+  // The masks are needed to build the lookup table, so they come first
+  assert(this->intervalOffsets.size() < this->keyframeMasks.size());
+
+  const uint8_t *masks = this->keyframeMasks[this->intervalOffsets.size()].subintervalMasks;
   this->intervalOffsets.push_back(offset);
+
+  unsigned keyframes = offset;
+  for (int i = 0; i < 4; i++) {
+    this->subintervalKeyframes.push_back(keyframes);
+    keyframes += std::popcount(masks[i]);
+  }
 }
 
 size_t Animation::Channel::getIntervalOffset(unsigned interval) const {
   return this->intervalOffsets.at(interval);
 }
 
+unsigned Animation::Channel::getKeyframeCount(unsigned frame) const {
+  unsigned subinterval = frame >> 3;
+  assert(subinterval < this->subintervalKeyframes.size());
+
+  uint8_t mask = this->keyframeMasks[subinterval >> 2].subintervalMasks[subinterval & 3];
+  uint8_t framesUpTo = (2 << (frame & 7)) - 1;
+
+  return this->subintervalKeyframes[subinterval] + std::popcount((uint8_t)(mask & framesUpTo));
+}
+
+unsigned Animation::Channel::getNextKeyframeFrame(unsigned frame) const {
+  unsigned subinterval = frame >> 3;
+  uint8_t framesAfter = ~((2 << (frame & 7)) - 1);
+
+  for (; subinterval < this->keyframeMasks.size() * 4; subinterval++, framesAfter = 0xff) {
+    uint8_t mask = this->keyframeMasks[subinterval >> 2].subintervalMasks[subinterval & 3] & framesAfter;
+
+    if (mask) {
+      return (subinterval << 3) + std::countr_zero(mask);
+    }
+  }
+
+  return UINT_MAX;
+}
+
 const void *Animation::Channel::getData() const {
   assert(this->dataType == DataType::POINTER);
 
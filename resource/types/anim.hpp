@@ -35,6 +35,13 @@ namespace Mortar::Resource {
         FLOAT,
       };
 
+      // What's known of a clip before its channel data is read
+      struct Header {
+        float length;
+        unsigned elementCount;
+        unsigned intervalCount;
+      };
+
       class Channel : public Resource {
         public:
           Channel(ResourceHandle handle)
@@ -50,6 +57,14 @@ namespace Mortar::Resource {
           void addIntervalOffset(size_t offset);
           size_t getIntervalOffset(unsigned interval) const;
 
+          // Frames are counted from zero across intervals. Returns the total
+          // number of keyframes at or before the frame.
+          unsigned getKeyframeCount(unsigned frame) const;
+
+          // Returns the first frame after this one holding a keyframe, or
+          // UINT_MAX if there are none
+          unsigned getNextKeyframeFrame(unsigned frame) const;
+
           const void *getData() const;
           float getFloatData() const;
           size_t getDataSize() const;
@@ -71,6 +86,10 @@ namespace Mortar::Resource {
           std::vector<KeyframeMask> keyframeMasks;
           std::vector<size_t> intervalOffsets;
 
+          // Keyframes before each subinterval, interval offset included, so a
+          // lookup only has to count bits in the subinterval's own mask
+          std::vector<unsigned> subintervalKeyframes;
+
           DataType dataType;
           void *data;
           float floatData;
@@ -111,6 +130,80 @@ namespace Mortar::Resource {
           unsigned char flags;
       };
 
+      // Every channel's keys packed into flat arrays, so a pose is evaluated
+      // without visiting each channel's resource. Channel c of element e is
+      // e * channelsPerElement + c. Keys are (time, value, rate) and a
+      // segment runs from one key to the next.
+      //
+      // Most channels store 16-bit keys quantized over the channel's own
+      // range. Keys the neighbouring keys reproduce within the bake tolerance
+      // are dropped, and constant channels fold to a single key. Channels
+      // quantization can't keep within the tolerance store float keys.
+      struct BakedChannels {
+        struct Channel {
+          uint32_t firstKey;
+          uint32_t keyCount;
+          bool isQuantized;
+
+          // Quantized keys decode to min + q * scale
+          float valueMin;
+          float valueScale;
+          float rateMin;
+          float rateScale;
+        };
+
+        // A segment ready to evaluate. Rates are scaled by its duration, and
+        // it's used for positions from validFrom up to validUntil, which run
+        // past the end keys at either end of the channel.
+        struct Segment {
+          float validFrom;
+          float validUntil;
+          float startTime;
+          float inverseDuration;
+          float startValue;
+          float endValue;
+          float startRate;
+          float endRate;
+        };
+
+        unsigned channelsPerElement = 0;
+
+        // Quantized times are steps of timeStep from timeBase, for the whole
+        // animation
+        float timeBase = 0.0f;
+        float timeStep = 1.0f;
+
+        std::vector<Channel> channels;
+
+        // Indexed by key; quantized channels' keys are in the 16-bit arrays
+        // and the rest in the float arrays
+        std::vector<uint16_t> quantizedTimes;
+        std::vector<uint16_t> quantizedValues;
+        std::vector<uint16_t> quantizedRates;
+        std::vector<float> times;
+        std::vector<float> values;
+        std::vector<float> rates;
+
+        float getKeyTime(const Channel& channel, uint32_t key) const;
+        float getKeyValue(const Channel& channel, uint32_t key) const;
+        float getKeyRate(const Channel& channel, uint32_t key) const;
+
+        // Finds the segment holding position, looking near hint first since
+        // playback mostly moves forward a segment at a time. Returns the index
+        // of its first key within the channel.
+        uint32_t findSegment(const Channel& channel, float position, uint32_t hint) const;
+        Segment decodeSegment(const Channel& channel, uint32_t key) const;
+      };
+
+      // Channels, as e * channelsPerElement + c, grouped by keyframe type
+      // and in ascending order within each group, so each group is evaluated
+      // by a loop specialized for its type
+      struct ChannelBatches {
+        std::vector<uint32_t> constant;
+        std::vector<uint32_t> boolean;
+        std::vector<uint32_t> keyframed;
+      };
+
       Animation(ResourceHandle handle)
         : Resource { handle } {};
 
@@ -124,10 +217,27 @@ namespace Mortar::Resource {
       const Element *getElement(unsigned i) const;
       unsigned getElementCount() const;
 
+      // Packs the channels once every element has been added, keeping every
+      // channel within tolerance of the original curves at each frame and
+      // key. Nothing is baked if any channel has keyframes that segments
+      // can't represent.
+      void bake(float tolerance);
+      bool isBaked() const;
+      const BakedChannels& getBakedChannels() const;
+
+      // Grouped as bake() is called, whether or not anything was baked
+      const ChannelBatches& getChannelBatches() const;
+
     private:
       float length;
       unsigned intervalCount;
       std::vector<Element *> elements;
+
+      bool baked = false;
+      BakedChannels bakedChannels;
+      ChannelBatches channelBatches;
+
+      void groupChannels();
   };
 }
 
@@ -15,6 +15,7 @@
  */
 
 #include <assert.h>
+#include <stdexcept>
 #include <vector>
 
 #include "character.hpp"
@@ -41,22 +42,26 @@ const std::vector<Mortar::Resource::Joint *>& Character::getJoints() const {
   return this->joints;
 }
 
-const std::vector<Mortar::Math::Matrix>& Character::getRestPose() const {
+const std::vector<Mortar::Math::QTS>& Character::getRestPose() const {
   return this->restPose;
 }
 
-void Character::setRestPose(std::vector<Math::Matrix>& restPose) {
+void Character::setRestPose(std::vector<Math::QTS>& restPose) {
   this->restPose = restPose;
 }
 
-void Character::addSkinTransform(Math::Matrix& skinTransform) {
+void Character::addSkinTransform(const Math::Affine& skinTransform) {
   this->skinTransforms.push_back(skinTransform);
 }
 
-const Mortar::Math::Matrix& Character::getSkinTransform(unsigned i) const {
+const Mortar::Math::Affine& Character::getSkinTransform(unsigned i) const {
   return this->skinTransforms.at(i);
 }
 
+const std::vector<Mortar::Math::Affine>& Character::getSkinTransforms() const {
+  return this->skinTransforms;
+}
+
 void Character::addLayer(Layer *layer) {
   this->layers.push_back(layer);
 }
@@ -77,25 +82,103 @@ const Character::Locator *Character::getLocatorFromExternalIdx(unsigned char idx
   return this->locators.at(this->externalLocatorMap.at(idx));
 }
 
+const std::vector<Character::Locator *>& Character::getLocators() const {
+  return this->locators;
+}
+
 void Character::addExternalLocatorMapping(unsigned char external, unsigned char internal) {
   this->externalLocatorMap[external] = internal;
 }
 
-void Character::addSkeletalAnimation(AnimationType type, Animation *animation) {
+const tsl::sparse_map<unsigned char, unsigned char>& Character::getExternalLocatorMap() const {
+  return this->externalLocatorMap;
+}
+
+void Character::setResourceManager(ResourceManager *manager) {
+  this->resourceManager = manager;
+}
+
+void Character::addSkeletalAnimation(AnimationType type, const std::string& name, const Animation::Header& header) {
   assert(type != AnimationType::NONE);
-  this->skeletalAnimations[type] = animation;
+
+  auto slot = std::make_unique<AnimationSlot>();
+  slot->name = name;
+  slot->header = header;
+
+  this->skeletalAnimations[type] = std::move(slot);
 }
 
 bool Character::hasSkeletalAnimation(AnimationType type) const {
   return this->skeletalAnimations.contains(type);
 }
 
+const Mortar::Resource::Animation::Header *Character::getSkeletalAnimationHeader(AnimationType type) const {
+  if (!this->hasSkeletalAnimation(type)) {
+    return nullptr;
+  }
+
+  return &this->skeletalAnimations.at(type)->header;
+}
+
+void Character::acquireSkeletalAnimation(AnimationType type) const {
+  if (!this->hasSkeletalAnimation(type)) {
+    return;
+  }
+
+  AnimationSlot& slot = *this->skeletalAnimations.at(type);
+
+  std::lock_guard<std::mutex> lock(this->animationsMutex);
+  if (slot.useCount++ == 0) {
+    assert(this->resourceManager != nullptr);
+    slot.future = this->resourceManager->getResourceAsync<Animation>(slot.name);
+  }
+}
+
+void Character::releaseSkeletalAnimation(AnimationType type) const {
+  if (!this->hasSkeletalAnimation(type)) {
+    return;
+  }
+
+  AnimationSlot& slot = *this->skeletalAnimations.at(type);
+
+  {
+    std::lock_guard<std::mutex> lock(this->animationsMutex);
+    assert(slot.useCount > 0);
+
+    if (--slot.useCount > 0) {
+      return;
+    }
+
+    slot.animation = nullptr;
+    slot.future.reset();
+  }
+
+  // Either just cached or, past the memory budget, evicted; a load still
+  // running finishes and is cached the same way
+  this->resourceManager->releaseResource(slot.name);
+}
+
 const Mortar::Resource::Animation *Character::getSkeletalAnimation(AnimationType type) const {
   if (!this->hasSkeletalAnimation(type)) {
     return nullptr;
   }
 
-  return this->skeletalAnimations.at(type);
+  AnimationSlot& slot = *this->skeletalAnimations.at(type);
+
+  const Animation *animation = slot.animation.load(std::memory_order_acquire);
+  if (animation) {
+    return animation;
+  }
+
+  std::lock_guard<std::mutex> lock(this->animationsMutex);
+  if (!slot.future || !slot.future->isReady()) {
+    return nullptr;
+  }
+
+  animation = slot.future->get();
+  slot.animation.store(animation, std::memory_order_release);
+
+  return animation;
 }
 
 const Mortar::Math::Matrix& Character::Locator::getTransform() const {
@@ -113,3 +196,29 @@ unsigned char Character::Locator::getJointIdx() const {
 void Character::Locator::setJointIdx(unsigned char jointIdx) {
   this->jointIdx = jointIdx;
 }
+
+const std::vector<Character::AnimationLod>& Character::getAnimationLods() const {
+  return this->animationLods;
+}
+
+void Character::setAnimationLods(const std::vector<AnimationLod>& lods) {
+  if (lods.empty()) {
+    throw std::runtime_error("characters need at least one animation LOD");
+  }
+
+  this->animationLods = lods;
+}
+
+const Character::AnimationLod& Character::getAnimationLod(float screenSize) const {
+  return this->animationLods[this->getAnimationLodLevel(screenSize)];
+}
+
+unsigned Character::getAnimationLodLevel(float screenSize) const {
+  for (unsigned i = 0; i < this->animationLods.size(); i++) {
+    if (screenSize >= this->animationLods[i].minScreenSize) {
+      return i;
+    }
+  }
+
+  return this->animationLods.size() - 1;
+}
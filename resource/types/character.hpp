@@ -17,11 +17,18 @@
 #ifndef MORTAR_RESOURCE_CHARACTER_H
 #define MORTAR_RESOURCE_CHARACTER_H
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <tsl/sparse_map.h>
 #include <vector>
 
+#include "../../math/affine.hpp"
 #include "../../math/matrix.hpp"
+#include "../../math/qts.hpp"
+#include "../manager.hpp"
 #include "../resource.hpp"
 #include "anim.hpp"
 #include "layer.hpp"
@@ -52,6 +59,21 @@ namespace Mortar::Resource {
           unsigned char jointIdx;
       };
 
+      // One level of animation detail, used while an actor's bounding sphere
+      // projects to at least minScreenSize of the viewport height, the
+      // measure mesh LODs are chosen by
+      struct AnimationLod {
+        float minScreenSize;
+
+        // Simulation steps per pose evaluation; frames in between blend the
+        // last two evaluated poses
+        unsigned updateInterval;
+
+        // Joints past this many keep their rest pose, and zero evaluates them
+        // all. Parents come before their children, so no chain is cut.
+        unsigned jointCount;
+      };
+
       Character(ResourceHandle& handle)
         : Resource { handle } {};
 
@@ -62,11 +84,12 @@ namespace Mortar::Resource {
       const Joint *getJoint(unsigned i) const;
       const std::vector<Joint *>& getJoints() const;
 
-      void addSkinTransform(Math::Matrix& skinTransform);
-      const Math::Matrix& getSkinTransform(unsigned i) const;
+      void addSkinTransform(const Math::Affine& skinTransform);
+      const Math::Affine& getSkinTransform(unsigned i) const;
+      const std::vector<Math::Affine>& getSkinTransforms() const;
 
-      const std::vector<Math::Matrix>& getRestPose() const;
-      void setRestPose(std::vector<Math::Matrix>& restPose);
+      const std::vector<Math::QTS>& getRestPose() const;
+      void setRestPose(std::vector<Math::QTS>& restPose);
 
       void addLayer(Layer *layer);
       const Layer *getLayer(unsigned i) const;
@@ -74,22 +97,70 @@ namespace Mortar::Resource {
 
       void addLocator(Locator *locator);
       const Locator *getLocatorFromExternalIdx(unsigned char idx) const;
+      const std::vector<Locator *>& getLocators() const;
 
       void addExternalLocatorMapping(unsigned char external, unsigned char internal);
+      const tsl::sparse_map<unsigned char, unsigned char>& getExternalLocatorMap() const;
 
-      void addSkeletalAnimation(AnimationType type, Animation *animation);
+      // Clips are named resources, paged in the first time something starts
+      // using them and left to the manager to evict once nothing does. Only
+      // their headers are kept with the character.
+      void setResourceManager(ResourceManager *manager);
+      void addSkeletalAnimation(AnimationType type, const std::string& name, const Animation::Header& header);
       bool hasSkeletalAnimation(AnimationType type) const;
+      const Animation::Header *getSkeletalAnimationHeader(AnimationType type) const;
+
+      // Uses are counted, as several actors play the same clips. The first
+      // use starts loading the clip in the background.
+      void acquireSkeletalAnimation(AnimationType type) const;
+      void releaseSkeletalAnimation(AnimationType type) const;
+
+      // Null until a clip in use has finished loading
       const Animation *getSkeletalAnimation(AnimationType type) const;
 
+      // Levels are ordered largest first; the last applies below them all
+      const std::vector<AnimationLod>& getAnimationLods() const;
+      void setAnimationLods(const std::vector<AnimationLod>& lods);
+      const AnimationLod& getAnimationLod(float screenSize) const;
+
+      // Index of the LOD used at the screen size
+      unsigned getAnimationLodLevel(float screenSize) const;
+
     private:
       Mortar::Resource::Model *model;
       std::vector<Joint *> joints;
-      std::vector<Math::Matrix> restPose;
-      std::vector<Math::Matrix> skinTransforms;
+      std::vector<Math::QTS> restPose;
+      std::vector<Math::Affine> skinTransforms;
       std::vector<Layer *> layers;
       std::vector<Locator *> locators;
       tsl::sparse_map<unsigned char, unsigned char> externalLocatorMap;
-      tsl::sparse_map<AnimationType, Animation *> skeletalAnimations;
+
+      struct AnimationSlot {
+        std::string name;
+        Animation::Header header;
+
+        // Set once the clip is resident, so playing it takes no lock
+        std::atomic<const Animation *> animation { nullptr };
+
+        // Guarded by animationsMutex
+        unsigned useCount = 0;
+        std::optional<ResourceFuture<Animation>> future;
+      };
+
+      ResourceManager *resourceManager = nullptr;
+
+      // Slots are only added while loading, so lookups don't need the lock
+      tsl::sparse_map<AnimationType, std::unique_ptr<AnimationSlot>> skeletalAnimations;
+      mutable std::mutex animationsMutex;
+
+      // Conservative unless a game sets its own: actors animate at full rate
+      // until they're as small as a mesh's coarsest level is drawn at, and
+      // every joint is always evaluated
+      std::vector<AnimationLod> animationLods {
+        { 0.05f, 1, 0 },
+        { 0.02f, 2, 0 },
+        { 0.0f, 4, 0 },
+      };
   };
 }
 
@@ -20,7 +20,9 @@ using namespace Mortar::Resource;
 
 void GeomObject::reset() {
   this->mesh = nullptr;
-  this->skinTransforms.clear();
+  this->skinPalette = nullptr;
+  this->lodLevel = 0;
+  this->screenSize = 1.0f;
   this->worldTransform = Math::Matrix();
 }
 
@@ -40,10 +42,26 @@ void GeomObject::setWorldTransform(Math::Matrix worldTransform) {
   this->worldTransform = worldTransform;
 }
 
-const std::vector<Mortar::Math::Matrix>& GeomObject::getSkinTransforms() const {
-  return this->skinTransforms;
+const SkinPalette *GeomObject::getSkinPalette() const {
+  return this->skinPalette;
 }
 
-void GeomObject::setSkinTransforms(std::vector<Math::Matrix> skinTransforms) {
-  this->skinTransforms = skinTransforms;
+void GeomObject::setSkinPalette(const SkinPalette *skinPalette) {
+  this->skinPalette = skinPalette;
+}
+
+unsigned GeomObject::getLodLevel() const {
+  return this->lodLevel;
+}
+
+void GeomObject::setLodLevel(unsigned lodLevel) {
+  this->lodLevel = lodLevel;
+}
+
+float GeomObject::getScreenSize() const {
+  return this->screenSize;
+}
+
+void GeomObject::setScreenSize(float screenSize) {
+  this->screenSize = screenSize;
 }
@@ -23,6 +23,7 @@
 #include "../resource.hpp"
 #include "material.hpp"
 #include "mesh.hpp"
+#include "palette.hpp"
 
 namespace Mortar::Resource {
   class GeomObject : public Resource {
@@ -35,8 +36,19 @@ namespace Mortar::Resource {
       const Math::Matrix& getWorldTransform() const;
       void setWorldTransform(Math::Matrix worldTransform);
 
-      const std::vector<Math::Matrix>& getSkinTransforms() const;
-      void setSkinTransforms(std::vector<Math::Matrix> skinTransforms);
+      // Skinned geometry references its owner's palette; null otherwise
+      const SkinPalette *getSkinPalette() const;
+      void setSkinPalette(const SkinPalette *skinPalette);
+
+      // Which of the mesh's index sets to draw, zero being full density
+      unsigned getLodLevel() const;
+      void setLodLevel(unsigned lodLevel);
+
+      // The bounds' projected radius as a fraction of the viewport height,
+      // which streamed textures pick their levels by. Unknown sizes count
+      // as filling the view.
+      float getScreenSize() const;
+      void setScreenSize(float screenSize);
 
       friend class ResourceManager;
 
@@ -48,7 +60,9 @@ namespace Mortar::Resource {
       const Mesh *mesh;
       Math::Matrix worldTransform;
 
-      std::vector<Math::Matrix> skinTransforms;
+      const SkinPalette *skinPalette = nullptr;
+      unsigned lodLevel = 0;
+      float screenSize = 1.0f;
   };
 }
 
@@ -18,7 +18,7 @@
 
 using namespace Mortar::Resource;
 
-const std::forward_list<Mesh *> Instance::getMeshes() const {
+const std::forward_list<Mesh *>& Instance::getMeshes() const {
   return this->meshes;
 }
 
@@ -26,10 +26,10 @@ void Instance::setMeshes(std::forward_list<Mesh *> meshes) {
   this->meshes = meshes;
 }
 
-const Mortar::Math::Matrix& Instance::getWorldTransform() const {
+const Mortar::Math::Affine& Instance::getWorldTransform() const {
   return this->worldTransform;
 }
 
-void Instance::setWorldTransform(Math::Matrix& worldTransform) {
+void Instance::setWorldTransform(const Math::Affine& worldTransform) {
   this->worldTransform = worldTransform;
 }
@@ -19,7 +19,7 @@
 
 #include <forward_list>
 
-#include "../../math/matrix.hpp"
+#include "../../math/affine.hpp"
 #include "../resource.hpp"
 #include "mesh.hpp"
 
@@ -29,15 +29,15 @@ namespace Mortar::Resource {
       Instance(ResourceHandle handle)
         : Resource { handle } {};
 
-      const std::forward_list<Mesh *> getMeshes() const;
+      const std::forward_list<Mesh *>& getMeshes() const;
       void setMeshes(std::forward_list<Mesh *> mesh);
 
-      const Math::Matrix& getWorldTransform() const;
-      void setWorldTransform(Math::Matrix& worldTransform);
+      const Math::Affine& getWorldTransform() const;
+      void setWorldTransform(const Math::Affine& worldTransform);
 
     private:
       std::forward_list<Mesh *> meshes;
-      Math::Matrix worldTransform;
+      Math::Affine worldTransform;
   };
 }
 
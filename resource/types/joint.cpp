@@ -34,12 +34,17 @@ void Joint::setParentIdx(int parentIdx) {
   this->parentIdx = parentIdx;
 }
 
-const Mortar::Math::Matrix& Joint::getTransform() const {
+const Mortar::Math::Affine& Joint::getTransform() const {
   return this->transform;
 }
 
-void Joint::setTransform(Mortar::Math::Matrix &transform) {
+void Joint::setTransform(const Math::Affine& transform) {
   this->transform = transform;
+  this->decomposedTransform = Math::QTS(transform.toMatrix());
+}
+
+const Mortar::Math::QTS& Joint::getDecomposedTransform() const {
+  return this->decomposedTransform;
 }
 
 const Mortar::Math::Vector& Joint::getAttachmentPoint() const {
@@ -17,7 +17,9 @@
 #ifndef MORTAR_RESOURCE_JOINT_H
 #define MORTAR_RESOURCE_JOINT_H
 
+#include "../../math/affine.hpp"
 #include "../../math/matrix.hpp"
+#include "../../math/qts.hpp"
 #include "../resource.hpp"
 
 namespace Mortar::Resource {
@@ -32,8 +34,12 @@ namespace Mortar::Resource {
       int getParentIdx() const;
       void setParentIdx(int parentIdx);
 
-      const Math::Matrix& getTransform() const;
-      void setTransform(Mortar::Math::Matrix& transform);
+      const Math::Affine& getTransform() const;
+      void setTransform(const Math::Affine& transform);
+
+      // The transform as a rotation, translation and scale, for animations
+      // posing relative to the joint
+      const Math::QTS& getDecomposedTransform() const;
 
       const Math::Vector& getAttachmentPoint() const;
       void setAttachmentPoint(Math::Vector& attachmentPoint);
@@ -50,7 +56,8 @@ namespace Mortar::Resource {
 
       const char *name;
       int parentIdx;
-      Math::Matrix transform;
+      Math::Affine transform;
+      Math::QTS decomposedTransform;
       Math::Vector attachmentPoint;
 
       unsigned char flags;
@@ -14,6 +14,8 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+
 #include "mesh.hpp"
 #include "shader.hpp"
 #include "vertex.hpp"
@@ -36,6 +38,14 @@ void Surface::setIndexBuffer(IndexBuffer *indexBuffer) {
   this->indexBuffer = indexBuffer;
 }
 
+const std::vector<IndexBuffer *>& Surface::getLods() const {
+  return this->lods;
+}
+
+void Surface::addLod(IndexBuffer *lod) {
+  this->lods.push_back(lod);
+}
+
 unsigned Surface::getSkinTransformCount() const {
   return this->skinTransformCount;
 }
@@ -64,7 +74,7 @@ const Material *Mesh::getMaterial() const {
   return this->material;
 }
 
-void Mesh::setMaterial(Material *material) {
+void Mesh::setMaterial(const Material *material) {
   this->material = material;
 }
 
@@ -85,11 +95,47 @@ void Mesh::setShaderType(ShaderType shaderType) {
 }
 
 const VertexLayout& Mesh::getVertexLayout() const {
-  return this->vertexLayout;
+  return *this->vertexLayout;
 }
 
 void Mesh::setVertexLayout(const VertexLayout &vertexLayout) {
-  this->vertexLayout = vertexLayout;
+  this->vertexLayout = &vertexLayout;
+}
+
+bool Mesh::getUsesPaletteIndices() const {
+  return this->usesPaletteIndices;
+}
+
+void Mesh::setUsesPaletteIndices(bool usesPaletteIndices) {
+  this->usesPaletteIndices = usesPaletteIndices;
+}
+
+const Mortar::Math::AABB& Mesh::getBounds() const {
+  return this->bounds;
+}
+
+void Mesh::setBounds(const Math::AABB& bounds) {
+  this->bounds = bounds;
+}
+
+unsigned Mesh::getLodCount() const {
+  unsigned count = 1;
+  for (auto surface : this->surfaces) {
+    count = std::max(count, (unsigned)surface->getLods().size() + 1);
+  }
+  return count;
+}
+
+unsigned Mesh::getLodLevel(float screenSize) const {
+  // Projected radius, as a fraction of the viewport height, below which
+  // each simplified level takes over
+  static const float thresholds[MAX_LODS - 1] { 0.15f, 0.05f };
+
+  unsigned level = 0;
+  while (level < MAX_LODS - 1 && screenSize < thresholds[level]) {
+    level++;
+  }
+  return std::min(level, this->getLodCount() - 1);
 }
 
 const Mesh *KinematicMesh::getMesh() const {
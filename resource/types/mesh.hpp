@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <vector>
 
+#include "../../math/bounds.hpp"
 #include "../resource.hpp"
 #include "joint.hpp"
 #include "material.hpp"
@@ -44,6 +45,10 @@ namespace Mortar::Resource {
       const IndexBuffer *getIndexBuffer() const;
       void setIndexBuffer(IndexBuffer *indexBuffer);
 
+      // Coarser index sets over the same vertices, lods[i] being level i + 1
+      const std::vector<IndexBuffer *>& getLods() const;
+      void addLod(IndexBuffer *lod);
+
       unsigned getSkinTransformCount() const;
       void setSkinTransformCount(unsigned count);
 
@@ -54,6 +59,7 @@ namespace Mortar::Resource {
       PrimitiveType primitiveType;
 
       IndexBuffer *indexBuffer;
+      std::vector<IndexBuffer *> lods;
 
       unsigned skinTransformCount;
       std::vector<ushort> skinTransformIndices;
@@ -61,16 +67,20 @@ namespace Mortar::Resource {
 
   class Mesh : public Resource {
     public:
+      // Full density plus up to two simplified levels
+      static constexpr unsigned MAX_LODS = 3;
+
       Mesh(ResourceHandle handle)
         : Resource { handle },
           shaderType { ShaderType::INVALID },
-          vertexLayout { VertexLayout::EMPTY } {};
+          vertexLayout { &VertexLayout::EMPTY },
+          usesPaletteIndices { false } {};
 
       void addSurface(Surface *surface);
       const std::vector<Surface *>& getSurfaces() const;
 
       const Material *getMaterial() const;
-      void setMaterial(Material *material);
+      void setMaterial(const Material *material);
 
       const VertexBuffer *getVertexBuffer() const;
       void setVertexBuffer(VertexBuffer *vertexBuffer);
@@ -78,17 +88,37 @@ namespace Mortar::Resource {
       ShaderType getShaderType() const;
       void setShaderType(ShaderType shaderType);
 
+      // Layouts are static, so the mesh only keeps a pointer
       const VertexLayout& getVertexLayout() const;
       void setVertexLayout(const VertexLayout& vertexLayout);
 
+      // Set when the vertices' blend indices address the character's palette
+      // directly, so the surfaces' skin transform indices aren't needed
+      bool getUsesPaletteIndices() const;
+      void setUsesPaletteIndices(bool usesPaletteIndices);
+
+      // Bounds of the vertices the surfaces reference, in mesh space
+      const Math::AABB& getBounds() const;
+      void setBounds(const Math::AABB& bounds);
+
+      // Levels available on the most detailed surface, counting full density
+      unsigned getLodCount() const;
+
+      // The level to draw at, given the bounding sphere's projected radius
+      // as a fraction of the viewport height
+      unsigned getLodLevel(float screenSize) const;
+
     private:
       std::vector<Surface *> surfaces;
 
-      Material *material;
+      const Material *material;
       VertexBuffer *vertexBuffer;
 
       ShaderType shaderType;
-      VertexLayout vertexLayout;
+      const VertexLayout *vertexLayout;
+      bool usesPaletteIndices;
+
+      Math::AABB bounds;
   };
 
   class KinematicMesh : public Resource {
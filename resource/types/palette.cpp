@@ -0,0 +1,60 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "palette.hpp"
+
+using namespace Mortar::Resource;
+
+size_t SkinPalette::getSize() const {
+  return this->transforms.size();
+}
+
+void SkinPalette::setSize(size_t size) {
+  this->transforms.resize(size);
+}
+
+const std::vector<Mortar::Math::Affine>& SkinPalette::getTransforms() const {
+  return this->transforms;
+}
+
+std::vector<Mortar::Math::Affine>& SkinPalette::getTransforms() {
+  return this->transforms;
+}
+
+Mortar::Math::Affine& SkinPalette::getTransform(size_t idx) {
+  return this->transforms.at(idx);
+}
+
+bool SkinPalette::getIsLocalPose() const {
+  return this->character != nullptr;
+}
+
+const Character *SkinPalette::getCharacter() const {
+  return this->character;
+}
+
+const Mortar::Math::Matrix& SkinPalette::getRootTransform() const {
+  return this->rootTransform;
+}
+
+void SkinPalette::setLocalPose(const Character *character, const Math::Matrix& rootTransform) {
+  this->character = character;
+  this->rootTransform = rootTransform;
+}
+
+void SkinPalette::clearLocalPose() {
+  this->character = nullptr;
+}
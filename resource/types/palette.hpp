@@ -0,0 +1,66 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_RESOURCE_PALETTE_H
+#define MORTAR_RESOURCE_PALETTE_H
+
+#include <vector>
+
+#include "../../math/affine.hpp"
+#include "../../math/matrix.hpp"
+#include "../resource.hpp"
+
+namespace Mortar::Resource {
+  class Character;
+
+  // One actor's skin transforms for the current frame. Every skinned mesh of
+  // the actor references the same palette, which renderers upload once per
+  // frame and look up by handle.
+  //
+  // For renderers that compose skeletons themselves, the palette can hold
+  // the local pose instead. The character then supplies the joint parents
+  // and skin transforms, and the root transform places the skeleton.
+  class SkinPalette : public Resource {
+    public:
+      size_t getSize() const;
+      void setSize(size_t size);
+
+      const std::vector<Math::Affine>& getTransforms() const;
+      std::vector<Math::Affine>& getTransforms();
+      Math::Affine& getTransform(size_t idx);
+
+      bool getIsLocalPose() const;
+      const Character *getCharacter() const;
+      const Math::Matrix& getRootTransform() const;
+
+      void setLocalPose(const Character *character, const Math::Matrix& rootTransform);
+      void clearLocalPose();
+
+      friend class ResourceManager;
+
+    protected:
+      SkinPalette(ResourceHandle& handle)
+        : Resource { handle } {};
+
+    private:
+      std::vector<Math::Affine> transforms;
+
+      const Character *character = nullptr;
+      Math::Matrix rootTransform;
+  };
+}
+
+#endif
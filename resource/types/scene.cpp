@@ -14,6 +14,10 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 #include "character.hpp"
@@ -37,16 +41,45 @@ const std::vector<Instance *>& Scene::getInstances() const {
   return this->instances;
 }
 
-void Scene::addSpline(const std::string name, const Spline *spline) {
-  this->splines[name] = spline;
+void Scene::setInstances(std::vector<Instance *> instances) {
+  this->instances = std::move(instances);
 }
 
-const Spline *Scene::getSplineByName(const std::string name) const {
-  if (!this->splines.contains(name)) {
+static bool isBefore(const Scene::NamedSpline& spline, uint64_t hash) {
+  return spline.hash < hash;
+}
+
+void Scene::addSpline(std::string_view name, const Spline *spline) {
+  uint64_t hash = hashName(name);
+
+  auto position = std::lower_bound(this->splines.begin(), this->splines.end(), hash, isBefore);
+  if (position != this->splines.end() && position->hash == hash) {
+    if (position->name != name) {
+      throw std::runtime_error("spline names have the same hash");
+    }
+
+    position->spline = spline;
+    return;
+  }
+
+  this->splines.insert(position, { hash, name, spline });
+}
+
+const std::vector<Scene::NamedSpline>& Scene::getSplines() const {
+  return this->splines;
+}
+
+const Spline *Scene::getSplineByName(std::string_view name) const {
+  return this->getSplineByHash(hashName(name));
+}
+
+const Spline *Scene::getSplineByHash(uint64_t hash) const {
+  auto position = std::lower_bound(this->splines.begin(), this->splines.end(), hash, isBefore);
+  if (position == this->splines.end() || position->hash != hash) {
     return nullptr;
   }
 
-  return this->splines.at(name);
+  return position->spline;
 }
 
 void Scene::addPlayerCharacter(const Character *character) {
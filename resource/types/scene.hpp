@@ -17,10 +17,12 @@
 #ifndef MORTAR_RESOURCE_SCENE_H
 #define MORTAR_RESOURCE_SCENE_H
 
-#include <tsl/sparse_map.h>
+#include <stdint.h>
+#include <string_view>
 #include <vector>
 
 #include "../../math/matrix.hpp"
+#include "../name.hpp"
 #include "../resource.hpp"
 #include "character.hpp"
 #include "instance.hpp"
@@ -37,8 +39,27 @@ namespace Mortar::Resource {
       void addInstance(Instance *instance);
       const std::vector<Instance *>& getInstances() const;
 
-      void addSpline(const std::string name, const Spline *spline);
-      const Spline *getSplineByName(const std::string name) const;
+      // Replaces every instance, as when small ones are merged
+      void setInstances(std::vector<Instance *> instances);
+
+      // Splines are kept sorted by the hash of their name. Names whose hashes
+      // collide are refused, so a hash alone identifies a spline. Names are
+      // kept by their loader along with the splines.
+      struct NamedSpline {
+        uint64_t hash;
+        std::string_view name;
+        const Spline *spline;
+      };
+
+      // Replaces any spline of the same name
+      void addSpline(std::string_view name, const Spline *spline);
+
+      // Null if there's no such spline. The hash is as hashName() gives it,
+      // for names hashed ahead of time.
+      const Spline *getSplineByName(std::string_view name) const;
+      const Spline *getSplineByHash(uint64_t hash) const;
+
+      const std::vector<NamedSpline>& getSplines() const;
 
       void addPlayerCharacter(const Character *character);
       const std::vector<const Character *>& getPlayerCharacters() const;
@@ -56,7 +77,7 @@ namespace Mortar::Resource {
 
       std::vector<Math::Matrix> startTransforms;
 
-      tsl::sparse_map<std::string, const Spline *> splines;
+      std::vector<NamedSpline> splines;
 
       std::vector<const Character *> playerCharacters;
   };
@@ -14,6 +14,7 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "../hash.hpp"
 #include "texture.hpp"
 
 using namespace Mortar::Resource;
@@ -26,6 +27,14 @@ void Texture::setIsCompressed(bool isCompressed) {
   this->compressed = isCompressed;
 }
 
+GLenum Texture::getFormat() const {
+  return this->format;
+}
+
+void Texture::setFormat(GLenum format) {
+  this->format = format;
+}
+
 GLint Texture::getInternalFormat() const {
   return this->internalFormat;
 }
@@ -59,7 +68,9 @@ const std::vector<Texture::Level *>& Texture::getLevels() const {
 }
 
 Texture::Level::~Level() {
-  delete this->data;
+  if (this->ownsData) {
+    delete[] this->data;
+  }
 }
 
 unsigned Texture::Level::getLevel() const {
@@ -78,10 +89,45 @@ void Texture::Level::setSize(unsigned size) {
   this->size = size;
 }
 
-uint8_t *Texture::Level::getData() const {
+const uint8_t *Texture::Level::getData() const {
   return this->data;
 }
 
 void Texture::Level::setData(uint8_t *data) {
   this->data = data;
+  this->ownsData = true;
+  this->backing = nullptr;
+}
+
+void Texture::Level::setData(const uint8_t *data, std::shared_ptr<const void> backing) {
+  this->data = data;
+  this->ownsData = false;
+  this->backing = backing;
+}
+
+uint64_t Texture::getContentHash() const {
+  return this->contentHash;
+}
+
+void Texture::computeContentHash() {
+  uint32_t description[] = {
+    this->compressed,
+    static_cast<uint32_t>(this->format),
+    static_cast<uint32_t>(this->internalFormat),
+    static_cast<uint32_t>(this->width),
+    static_cast<uint32_t>(this->height),
+  };
+
+  uint64_t hash = hashContent(description, sizeof(description));
+  for (auto level : this->levels) {
+    uint32_t levelDescription[] = { level->getLevel(), level->getSize() };
+
+    hash = hashContent(levelDescription, sizeof(levelDescription), hash);
+    if (level->getData()) {
+      hash = hashContent(level->getData(), level->getSize(), hash);
+    }
+  }
+
+  // Zero is left to mean no hash
+  this->contentHash = hash ? hash : 1;
 }
@@ -18,6 +18,7 @@
 #define MORTAR_RESOURCE_TEXTURE_H
 
 #include <GL/gl.h>
+#include <memory>
 #include <stdint.h>
 #include <stdlib.h>
 #include <vector>
@@ -30,7 +31,9 @@ namespace Mortar::Resource {
       class Level : public Resource {
         public:
           Level(ResourceHandle handle)
-            : Resource { handle } {};
+            : Resource { handle },
+              data { nullptr },
+              ownsData { false } {};
 
           ~Level();
 
@@ -40,13 +43,20 @@ namespace Mortar::Resource {
           unsigned getSize() const;
           void setSize(unsigned size);
 
-          uint8_t *getData() const;
+          const uint8_t *getData() const;
+
+          // Takes ownership of a new[]-allocated array
           void setData(uint8_t *data);
 
+          // References memory owned by backing, such as a mapped file image
+          void setData(const uint8_t *data, std::shared_ptr<const void> backing);
+
         private:
           unsigned level;
           unsigned size;
-          uint8_t *data;
+          const uint8_t *data;
+          bool ownsData;
+          std::shared_ptr<const void> backing;
       };
 
       Texture(ResourceHandle handle)
@@ -60,6 +70,10 @@ namespace Mortar::Resource {
       bool getIsCompressed() const;
       void setIsCompressed(bool isCompressed);
 
+      // Layout of uncompressed data, such as GL_BGRA; unused when compressed
+      GLenum getFormat() const;
+      void setFormat(GLenum format);
+
       GLint getInternalFormat() const;
       void setInternalFormat(GLint internalFormat);
 
@@ -72,12 +86,19 @@ namespace Mortar::Resource {
       void addLevel(Texture::Level *level);
       const std::vector<Texture::Level *>& getLevels() const;
 
+      // Covers the format, size and every level's data, so textures with the
+      // same hash can share GPU storage. Zero until it's computed, once the
+      // levels have all been added.
+      uint64_t getContentHash() const;
+      void computeContentHash();
+
     private:
       bool compressed;
       GLenum format;
       GLint internalFormat;
       int width;
       int height;
+      uint64_t contentHash = 0;
 
       std::vector<Texture::Level *> levels;
   };
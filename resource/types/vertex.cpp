@@ -14,36 +14,253 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <bit>
+#include <math.h>
+#include <string.h>
 #include <vector>
 
+#include "../hash.hpp"
 #include "vertex.hpp"
 
 using namespace Mortar::Resource;
 
-VertexLayout VertexLayout::EMPTY = VertexLayout(0, {});
+// Halves only address texels finely enough close to the texture, so
+// coordinates past this keep their buffer in its original layout
+static constexpr float MAX_HALF_TEX_COORD = 2.0f;
 
-const std::vector<VertexLayout::VertexProperty>& VertexLayout::getProperties() const {
-  return this->properties;
+// Rounds to nearest even; values too small for a normal half flush to zero
+static uint16_t toHalf(float f) {
+  uint32_t bits = std::bit_cast<uint32_t>(f);
+  uint32_t sign = (bits >> 16) & 0x8000;
+  int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (exponent <= 0) {
+    return sign;
+  } else if (exponent >= 31) {
+    return sign | 0x7c00;
+  }
+
+  // A carry out of the mantissa correctly bumps the exponent
+  uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+  uint32_t remainder = mantissa & 0x1fff;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+    half++;
+  }
+
+  return half;
 }
 
-size_t VertexLayout::getStride() const {
-  return this->stride;
+static inline uint32_t toSnorm10(float f) {
+  f = std::clamp(f, -1.0f, 1.0f);
+
+  return (uint32_t)(int32_t)lroundf(f * 511.0f) & 0x3ff;
 }
 
-size_t VertexLayout::VertexProperty::getOffset() const {
-  return this->offset;
+static bool convertProperty(VertexDataType fromType, VertexDataType toType, const uint8_t *in, uint8_t *out) {
+  if (fromType == toType) {
+    memcpy(out, in, getVertexDataTypeSize(fromType));
+    return true;
+  }
+
+  float values[3];
+  memcpy(values, in, getVertexDataTypeSize(fromType));
+
+  switch (toType) {
+    case VertexDataType::INT_2_10_10_10: {
+      if (fromType != VertexDataType::VEC3) {
+        return false;
+      }
+
+      uint32_t packed = toSnorm10(values[0]) | (toSnorm10(values[1]) << 10) | (toSnorm10(values[2]) << 20);
+      memcpy(out, &packed, sizeof(packed));
+
+      return true;
+    }
+    case VertexDataType::HALF_VEC2: {
+      if (fromType != VertexDataType::VEC2 || fabsf(values[0]) > MAX_HALF_TEX_COORD || fabsf(values[1]) > MAX_HALF_TEX_COORD) {
+        return false;
+      }
+
+      uint16_t halves[2] = { toHalf(values[0]), toHalf(values[1]) };
+      memcpy(out, halves, sizeof(halves));
+
+      return true;
+    }
+    case VertexDataType::UBYTE_VEC4: {
+      if (fromType != VertexDataType::VEC3) {
+        return false;
+      }
+
+      // Truncated, as the shaders' integer casts did
+      uint8_t bytes[4] = { 0, 0, 0, 0 };
+      for (int i = 0; i < 3; i++) {
+        if (!(values[i] >= 0.0f && values[i] < 256.0f)) {
+          return false;
+        }
+        bytes[i] = (uint8_t)values[i];
+      }
+      memcpy(out, bytes, sizeof(bytes));
+
+      return true;
+    }
+    case VertexDataType::UNORM16_VEC2: {
+      if (fromType != VertexDataType::VEC2) {
+        return false;
+      }
+
+      uint16_t shorts[2];
+      for (int i = 0; i < 2; i++) {
+        if (!(values[i] >= 0.0f && values[i] <= 1.0f)) {
+          return false;
+        }
+        shorts[i] = (uint16_t)lroundf(values[i] * 65535.0f);
+      }
+      memcpy(out, shorts, sizeof(shorts));
+
+      return true;
+    }
+    default:
+      return false;
+  }
 }
 
-VertexUsage VertexLayout::VertexProperty::getUsage() const {
-  return this->usage;
+bool Mortar::Resource::convertVertices(const VertexLayout& from, const VertexLayout& to, const uint8_t *vertices, size_t vertexCount, uint8_t *out) {
+  std::span<const VertexLayout::VertexProperty> fromProperties = from.getProperties();
+  std::span<const VertexLayout::VertexProperty> toProperties = to.getProperties();
+
+  // Pairs each target property with the source one of the same usage
+  std::array<const VertexLayout::VertexProperty *, VertexLayout::MAX_PROPERTIES> sources;
+  for (size_t i = 0; i < toProperties.size(); i++) {
+    auto source = std::find_if(fromProperties.begin(), fromProperties.end(), [&](const auto& property) {
+      return property.getUsage() == toProperties[i].getUsage();
+    });
+
+    if (source == fromProperties.end() || source->getOffset() + getVertexDataTypeSize(source->getDataType()) > from.getStride()) {
+      return false;
+    }
+    sources[i] = &*source;
+  }
+
+  for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+    const uint8_t *in = vertices + vertex * from.getStride();
+    uint8_t *vertexOut = out + vertex * to.getStride();
+
+    for (size_t i = 0; i < toProperties.size(); i++) {
+      if (!convertProperty(sources[i]->getDataType(), toProperties[i].getDataType(), in + sources[i]->getOffset(), vertexOut + toProperties[i].getOffset())) {
+        return false;
+      }
+    }
+  }
+
+  return true;
 }
 
-VertexDataType VertexLayout::VertexProperty::getDataType() const {
-  return this->type;
+static inline float fromSnorm10(uint32_t bits) {
+  int32_t value = (int32_t)(bits << 22) >> 22;
+
+  return std::max(value / 511.0f, -1.0f);
+}
+
+bool Mortar::Resource::transformVertices(const VertexLayout& layout, const uint8_t *vertices, size_t vertexCount, const Math::Affine& transform, uint8_t *out) {
+  memcpy(out, vertices, vertexCount * layout.getStride());
+
+  const float (*m)[4] = transform.m;
+
+  // Normals go by the inverse transpose, which up to scale is the cofactor
+  // matrix; its rows are the cross products of the linear part's rows
+  float rows[3][3];
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      rows[i][j] = m[j][i];
+    }
+  }
+
+  float cofactors[3][3];
+  for (int i = 0; i < 3; i++) {
+    const float *a = rows[(i + 1) % 3];
+    const float *b = rows[(i + 2) % 3];
+
+    cofactors[i][0] = a[1] * b[2] - a[2] * b[1];
+    cofactors[i][1] = a[2] * b[0] - a[0] * b[2];
+    cofactors[i][2] = a[0] * b[1] - a[1] * b[0];
+  }
+
+  float determinant = rows[0][0] * cofactors[0][0] + rows[0][1] * cofactors[0][1] + rows[0][2] * cofactors[0][2];
+  float normalSign = determinant < 0.0f ? -1.0f : 1.0f;
+
+  for (const auto& property : layout.getProperties()) {
+    VertexUsage usage = property.getUsage();
+    VertexDataType type = property.getDataType();
+
+    if (usage == VertexUsage::POSITION) {
+      if (type != VertexDataType::VEC3) {
+        return false;
+      }
+
+      for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+        uint8_t *position = out + vertex * layout.getStride() + property.getOffset();
+
+        float in[3];
+        memcpy(in, position, sizeof(in));
+
+        float result[3];
+        for (int i = 0; i < 3; i++) {
+          result[i] = m[i][0] * in[0] + m[i][1] * in[1] + m[i][2] * in[2] + m[i][3];
+        }
+
+        memcpy(position, result, sizeof(result));
+      }
+    } else if (usage == VertexUsage::NORMAL) {
+      if (type != VertexDataType::VEC3 && type != VertexDataType::INT_2_10_10_10) {
+        return false;
+      }
+
+      for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+        uint8_t *normal = out + vertex * layout.getStride() + property.getOffset();
+
+        float in[3];
+        if (type == VertexDataType::VEC3) {
+          memcpy(in, normal, sizeof(in));
+        } else {
+          uint32_t packed;
+          memcpy(&packed, normal, sizeof(packed));
+
+          for (int i = 0; i < 3; i++) {
+            in[i] = fromSnorm10(packed >> (10 * i));
+          }
+        }
+
+        float result[3];
+        for (int i = 0; i < 3; i++) {
+          result[i] = normalSign * (in[0] * cofactors[0][i] + in[1] * cofactors[1][i] + in[2] * cofactors[2][i]);
+        }
+
+        float length = sqrtf(result[0] * result[0] + result[1] * result[1] + result[2] * result[2]);
+        if (length > 0.0f) {
+          for (int i = 0; i < 3; i++) {
+            result[i] /= length;
+          }
+        }
+
+        if (type == VertexDataType::VEC3) {
+          memcpy(normal, result, sizeof(result));
+        } else {
+          uint32_t packed = toSnorm10(result[0]) | (toSnorm10(result[1]) << 10) | (toSnorm10(result[2]) << 20);
+          memcpy(normal, &packed, sizeof(packed));
+        }
+      }
+    }
+  }
+
+  return true;
 }
 
 IndexBuffer::~IndexBuffer() {
-  delete this->data;
+  if (this->ownsData) {
+    delete[] this->data;
+  }
 }
 
 unsigned IndexBuffer::getCount() const {
@@ -60,10 +277,20 @@ const uint16_t *IndexBuffer::getData() const {
 
 void IndexBuffer::setData(uint16_t *data) {
   this->data = data;
+  this->ownsData = true;
+  this->backing = nullptr;
+}
+
+void IndexBuffer::setData(const uint16_t *data, std::shared_ptr<const void> backing) {
+  this->data = data;
+  this->ownsData = false;
+  this->backing = backing;
 }
 
 VertexBuffer::~VertexBuffer() {
-  delete this->data;
+  if (this->ownsData) {
+    delete[] this->data;
+  }
 }
 
 size_t VertexBuffer::getSize() const {
@@ -80,4 +307,23 @@ const uint8_t *VertexBuffer::getData() const {
 
 void VertexBuffer::setData(uint8_t *data) {
   this->data = data;
+  this->ownsData = true;
+  this->backing = nullptr;
+}
+
+void VertexBuffer::setData(const uint8_t *data, std::shared_ptr<const void> backing) {
+  this->data = data;
+  this->ownsData = false;
+  this->backing = backing;
+}
+
+uint64_t VertexBuffer::getContentHash() const {
+  return this->contentHash;
+}
+
+void VertexBuffer::computeContentHash() {
+  uint64_t hash = this->data ? hashContent(this->data, this->size) : hashContent(nullptr, 0, this->size);
+
+  // Zero is left to mean no hash
+  this->contentHash = hash ? hash : 1;
 }
@@ -17,10 +17,17 @@
 #ifndef MORTAR_RESOURCE_VERTEX_H
 #define MORTAR_RESOURCE_VERTEX_H
 
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <memory>
+#include <span>
+#include <stdexcept>
 #include <stdint.h>
 #include <stdlib.h>
 #include <vector>
 
+#include "../../math/affine.hpp"
 #include "../resource.hpp"
 
 namespace Mortar::Resource {
@@ -37,18 +44,57 @@ namespace Mortar::Resource {
     VEC3,
     VEC2,
     D3DCOLOR,
+
+    // Compact formats vertices are converted to at load
+    INT_2_10_10_10,  // Signed normalized XYZ, W unused
+    HALF_VEC2,
+    UBYTE_VEC4,      // Unnormalized, for indices
+    UNORM16_VEC2,
   };
 
+  constexpr size_t getVertexDataTypeSize(VertexDataType type) {
+    switch (type) {
+      case VertexDataType::VEC3:
+        return 3 * sizeof(float);
+      case VertexDataType::VEC2:
+        return 2 * sizeof(float);
+      case VertexDataType::D3DCOLOR:
+      case VertexDataType::INT_2_10_10_10:
+      case VertexDataType::HALF_VEC2:
+      case VertexDataType::UBYTE_VEC4:
+      case VertexDataType::UNORM16_VEC2:
+        return 4;
+    }
+
+    throw std::runtime_error("unrecognized vertex data type");
+  }
+
+  // Layouts are fixed-size and built at compile time, as static tables of
+  // the formats a game reads. They're never copied: meshes point at theirs,
+  // and renderers can key their own per-layout tables by its address.
   class VertexLayout {
     public:
+      static constexpr size_t MAX_PROPERTIES = 8;
+
       class VertexProperty {
         public:
+          constexpr VertexProperty()
+            : VertexProperty { VertexUsage::POSITION, VertexDataType::VEC3, 0 } {};
+
           constexpr VertexProperty(VertexUsage usage, VertexDataType type, size_t offset)
             : usage { usage }, type { type }, offset { offset } {};
 
-          size_t getOffset() const;
-          VertexUsage getUsage() const;
-          VertexDataType getDataType() const;
+          constexpr size_t getOffset() const {
+            return this->offset;
+          }
+
+          constexpr VertexUsage getUsage() const {
+            return this->usage;
+          }
+
+          constexpr VertexDataType getDataType() const {
+            return this->type;
+          }
 
         private:
           VertexUsage usage;
@@ -56,23 +102,83 @@ namespace Mortar::Resource {
           size_t offset;
       };
 
-      constexpr VertexLayout(unsigned stride, std::vector<VertexProperty> properties)
-        : stride { stride }, properties { properties } {};
+      constexpr VertexLayout(unsigned stride, std::initializer_list<VertexProperty> properties)
+        : stride { stride }, propertyCount { properties.size() } {
+        if (properties.size() > MAX_PROPERTIES) {
+          throw std::length_error("too many vertex properties");
+        }
+
+        std::copy(properties.begin(), properties.end(), this->properties.begin());
+      };
+
+      VertexLayout(const VertexLayout&) = delete;
+      VertexLayout& operator=(const VertexLayout&) = delete;
+
+      constexpr size_t getStride() const {
+        return this->stride;
+      }
+
+      constexpr std::span<const VertexProperty> getProperties() const {
+        return std::span(this->properties.data(), this->propertyCount);
+      }
+
+      // The same properties in the compact formats: packed normals, half
+      // texture coordinates, byte indices and 16-bit weights. Positions and
+      // colors stay as they are.
+      constexpr VertexLayout getCompactLayout() const {
+        std::array<VertexProperty, MAX_PROPERTIES> compact;
+        size_t offset = 0;
+
+        for (size_t i = 0; i < this->propertyCount; i++) {
+          const VertexProperty& property = this->properties[i];
+          VertexDataType type = property.getDataType();
 
-      size_t getStride() const;
-      const std::vector<VertexProperty>& getProperties() const;
+          if (property.getUsage() == VertexUsage::NORMAL && type == VertexDataType::VEC3) {
+            type = VertexDataType::INT_2_10_10_10;
+          } else if (property.getUsage() == VertexUsage::TEX_COORD && type == VertexDataType::VEC2) {
+            type = VertexDataType::HALF_VEC2;
+          } else if (property.getUsage() == VertexUsage::BLEND_INDICES && type == VertexDataType::VEC3) {
+            type = VertexDataType::UBYTE_VEC4;
+          } else if (property.getUsage() == VertexUsage::BLEND_WEIGHTS && type == VertexDataType::VEC2) {
+            type = VertexDataType::UNORM16_VEC2;
+          }
 
-      static VertexLayout EMPTY;
+          compact[i] = VertexProperty(property.getUsage(), type, offset);
+          offset += getVertexDataTypeSize(type);
+        }
+
+        return VertexLayout(offset, compact, this->propertyCount);
+      }
+
+      static const VertexLayout EMPTY;
 
     private:
+      constexpr VertexLayout(size_t stride, const std::array<VertexProperty, MAX_PROPERTIES>& properties, size_t propertyCount)
+        : stride { static_cast<unsigned>(stride) }, properties { properties }, propertyCount { propertyCount } {};
+
       unsigned stride;
-      std::vector<VertexProperty> properties;
+      std::array<VertexProperty, MAX_PROPERTIES> properties;
+      size_t propertyCount;
   };
 
+  inline constexpr VertexLayout VertexLayout::EMPTY { 0, {} };
+
+  // Repacks vertexCount vertices from one layout to another with the same
+  // usages, such as its compact layout. Returns false, with out partly
+  // written, where some value doesn't fit the target format.
+  bool convertVertices(const VertexLayout& from, const VertexLayout& to, const uint8_t *vertices, size_t vertexCount, uint8_t *out);
+
+  // Copies vertexCount vertices, moving their positions and normals by
+  // transform. Normals come out unit length. Returns false, with out partly
+  // written, where the layout has them in a format it can't transform.
+  bool transformVertices(const VertexLayout& layout, const uint8_t *vertices, size_t vertexCount, const Math::Affine& transform, uint8_t *out);
+
   class IndexBuffer : public Resource {
     public:
       IndexBuffer(ResourceHandle handle)
-        : Resource { handle } {};
+        : Resource { handle },
+          data { nullptr },
+          ownsData { false } {};
 
       ~IndexBuffer();
 
@@ -80,17 +186,26 @@ namespace Mortar::Resource {
       void setCount(unsigned count);
 
       const uint16_t *getData() const;
+
+      // Takes ownership of a new[]-allocated array
       void setData(uint16_t *data);
 
+      // References memory owned by backing, such as a mapped file image
+      void setData(const uint16_t *data, std::shared_ptr<const void> backing);
+
     private:
       unsigned count;
-      uint16_t *data;
+      const uint16_t *data;
+      bool ownsData;
+      std::shared_ptr<const void> backing;
   };
 
   class VertexBuffer : public Resource {
     public:
       VertexBuffer(ResourceHandle handle)
-        : Resource { handle } {};
+        : Resource { handle },
+          data { nullptr },
+          ownsData { false } {};
 
       ~VertexBuffer();
 
@@ -98,11 +213,24 @@ namespace Mortar::Resource {
       void setSize(size_t size);
 
       const uint8_t *getData() const;
+
+      // Takes ownership of a new[]-allocated array
       void setData(uint8_t *data);
 
+      // References memory owned by backing, such as a mapped file image
+      void setData(const uint8_t *data, std::shared_ptr<const void> backing);
+
+      // Buffers with the same hash hold the same bytes, so they can share GPU
+      // storage. Zero until it's computed, once the data is set.
+      uint64_t getContentHash() const;
+      void computeContentHash();
+
     private:
       size_t size;
-      uint8_t *data;
+      uint64_t contentHash = 0;
+      const uint8_t *data;
+      bool ownsData;
+      std::shared_ptr<const void> backing;
   };
 }
 
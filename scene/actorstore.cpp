@@ -0,0 +1,245 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <math.h>
+
+#include "actorstore.hpp"
+
+using namespace Mortar::Scene;
+
+ActorStore::ActorId ActorStore::add(const Resource::Character *character, const Math::Matrix& worldTransform, const Math::AABB& bounds) {
+  ActorId actor = this->characters.size();
+
+  this->characters.push_back(character);
+  this->worldTransforms.push_back(worldTransform);
+  this->bounds.push_back(bounds);
+
+  // Layers keep their clips in use on the character playing them
+  character->acquireSkeletalAnimation(Resource::Character::AnimationType::NONE);
+  this->animations.push_back({ { { { Resource::Character::AnimationType::NONE, 0.0f, 1.0f, 0.0f } } }, 1 });
+  this->animationRates.push_back(1.0f);
+
+  this->visibility.push_back(true);
+  this->lodLevels.push_back(0);
+  this->screenSizes.push_back(1.0f);
+
+  return actor;
+}
+
+size_t ActorStore::size() const {
+  return this->characters.size();
+}
+
+void ActorStore::clear() {
+  for (size_t i = 0; i < this->characters.size(); i++) {
+    const AnimationState& state = this->animations[i];
+    for (unsigned j = 0; j < state.layerCount; j++) {
+      this->characters[i]->releaseSkeletalAnimation(state.layers[j].animType);
+    }
+  }
+
+  this->characters.clear();
+  this->worldTransforms.clear();
+  this->bounds.clear();
+  this->animations.clear();
+  this->animationRates.clear();
+  this->visibility.clear();
+  this->lodLevels.clear();
+  this->screenSizes.clear();
+}
+
+const Mortar::Resource::Character *ActorStore::getCharacter(ActorId actor) const {
+  return this->characters[actor];
+}
+
+const Mortar::Math::Matrix& ActorStore::getWorldTransform(ActorId actor) const {
+  return this->worldTransforms[actor];
+}
+
+void ActorStore::setWorldTransform(ActorId actor, const Math::Matrix& worldTransform) {
+  this->worldTransforms[actor] = worldTransform;
+}
+
+Mortar::Resource::Character::AnimationType ActorStore::getAnimation(ActorId actor) const {
+  const AnimationState& state = this->animations[actor];
+  return state.layers[state.layerCount - 1].animType;
+}
+
+void ActorStore::setAnimation(ActorId actor, Resource::Character::AnimationType animType, float position) {
+  const Resource::Character *character = this->characters[actor];
+
+  character->acquireSkeletalAnimation(animType);
+  for (const AnimationLayer& layer : this->getAnimationLayers(actor)) {
+    character->releaseSkeletalAnimation(layer.animType);
+  }
+
+  AnimationState& state = this->animations[actor];
+  state.layers[0] = { animType, position, 1.0f, 0.0f };
+  state.layerCount = 1;
+}
+
+void ActorStore::crossfadeAnimation(ActorId actor, Resource::Character::AnimationType animType, float duration) {
+  if (duration <= 0.0f) {
+    this->setAnimation(actor, animType);
+    return;
+  } else if (animType == this->getAnimation(actor)) {
+    return;
+  }
+
+  this->characters[actor]->acquireSkeletalAnimation(animType);
+
+  AnimationState& state = this->animations[actor];
+  if (state.layerCount == MAX_ANIMATION_LAYERS) {
+    this->dropAnimationLayer(actor, 0);
+  }
+
+  // Everything already playing fades out at the new layer's pace
+  float fadeRate = 1.0f / duration;
+  for (unsigned i = 0; i < state.layerCount; i++) {
+    state.layers[i].fadeRate = fadeRate;
+  }
+
+  state.layers[state.layerCount++] = { animType, 0.0f, 0.0f, fadeRate };
+}
+
+void ActorStore::dropAnimationLayer(ActorId actor, unsigned layerIdx) {
+  AnimationState& state = this->animations[actor];
+  this->characters[actor]->releaseSkeletalAnimation(state.layers[layerIdx].animType);
+
+  for (unsigned i = layerIdx; i + 1 < state.layerCount; i++) {
+    state.layers[i] = state.layers[i + 1];
+  }
+
+  state.layerCount--;
+}
+
+void ActorStore::advanceAnimation(ActorId actor, float timeDelta) {
+  const Resource::Character *character = this->characters[actor];
+  AnimationState& state = this->animations[actor];
+
+  timeDelta *= this->animationRates[actor];
+
+  for (unsigned i = 0; i < state.layerCount; i++) {
+    AnimationLayer& layer = state.layers[i];
+    layer.position += timeDelta;
+
+    // Clips keep playing by their header while they're still loading
+    const Resource::Animation::Header *header = character->getSkeletalAnimationHeader(layer.animType);
+    if (!header) {
+      layer.position = 0.0f;
+      continue;
+    }
+
+    // XXX: Ignores animations that can't loop, animations that can play
+    // backwards, etc.
+    float animLength = header->length;
+    if (layer.position > animLength) {
+      float difference = layer.position - animLength;
+      layer.position = difference;
+    }
+  }
+
+  AnimationLayer& target = state.layers[state.layerCount - 1];
+  target.weight = std::min(target.weight + target.fadeRate * timeDelta, 1.0f);
+
+  // Once the target is fully in, nothing else contributes
+  if (target.weight >= 1.0f) {
+    for (unsigned i = 0; i + 1 < state.layerCount; i++) {
+      character->releaseSkeletalAnimation(state.layers[i].animType);
+    }
+
+    state.layers[0] = target;
+    state.layerCount = 1;
+    return;
+  }
+
+  for (unsigned i = state.layerCount - 1; i-- > 0;) {
+    AnimationLayer& layer = state.layers[i];
+    layer.weight -= layer.fadeRate * timeDelta;
+
+    if (layer.weight <= 0.0f) {
+      this->dropAnimationLayer(actor, i);
+    }
+  }
+}
+
+float ActorStore::getAnimationPosition(ActorId actor) const {
+  const AnimationState& state = this->animations[actor];
+  return state.layers[state.layerCount - 1].position;
+}
+
+float ActorStore::getAnimationRate(ActorId actor) const {
+  return this->animationRates[actor];
+}
+
+void ActorStore::setAnimationRate(ActorId actor, float rate) {
+  this->animationRates[actor] = rate;
+}
+
+std::span<const ActorStore::AnimationLayer> ActorStore::getAnimationLayers(ActorId actor) const {
+  const AnimationState& state = this->animations[actor];
+  return std::span(state.layers).first(state.layerCount);
+}
+
+bool ActorStore::hasAnimation(ActorId actor) const {
+  for (const AnimationLayer& layer : this->getAnimationLayers(actor)) {
+    if (layer.animType != Resource::Character::AnimationType::NONE) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ActorStore::cull(const Math::Matrix& view, const Math::Matrix& proj, const Math::Frustum& frustum) {
+  for (size_t i = 0; i < this->characters.size(); i++) {
+    const Math::Matrix& transform = this->worldTransforms[i];
+
+    if (this->bounds[i].isEmpty()) {
+      this->visibility[i] = true;
+      this->screenSizes[i] = 1.0f;
+    } else {
+      Math::AABB bounds = this->bounds[i].transform(transform);
+
+      this->visibility[i] = frustum.intersects(bounds);
+      if (!this->visibility[i]) {
+        continue;
+      }
+
+      Math::Vector viewCenter = bounds.center * view;
+      viewCenter.w = 0.0f;
+
+      // Eyes inside the bounds see them at full size
+      float radius = sqrtf(bounds.extents.x * bounds.extents.x + bounds.extents.y * bounds.extents.y + bounds.extents.z * bounds.extents.z);
+      this->screenSizes[i] = radius * proj._22 * 0.5f / std::max(viewCenter.getMagnitude(), radius);
+    }
+
+    this->lodLevels[i] = this->characters[i]->getAnimationLodLevel(this->screenSizes[i]);
+  }
+}
+
+bool ActorStore::isVisible(ActorId actor) const {
+  return this->visibility[actor];
+}
+
+const Mortar::Resource::Character::AnimationLod& ActorStore::getAnimationLod(ActorId actor) const {
+  return this->characters[actor]->getAnimationLods()[this->lodLevels[actor]];
+}
+
+float ActorStore::getScreenSize(ActorId actor) const {
+  return this->screenSizes[actor];
+}
@@ -0,0 +1,118 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_SCENE_ACTORSTORE_H
+#define MORTAR_SCENE_ACTORSTORE_H
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "../math/bounds.hpp"
+#include "../math/matrix.hpp"
+#include "../resource/types/character.hpp"
+
+namespace Mortar::Scene {
+  // Every actor in the scene, a column per field so each phase of a frame
+  // walks only the fields it reads. Actors are dense indices into the
+  // columns, and are only removed all at once.
+  class ActorStore {
+    public:
+      typedef uint32_t ActorId;
+      static constexpr ActorId NO_ACTOR = UINT32_MAX;
+
+      // Clips that can play at once; a crossfade past this many drops the
+      // oldest
+      static constexpr unsigned MAX_ANIMATION_LAYERS = 4;
+
+      // One clip being played, blended in by its share of the total weight.
+      // NONE plays the rest pose.
+      struct AnimationLayer {
+        Resource::Character::AnimationType animType;
+        float position;
+        float weight;
+
+        // Weight gained or lost per unit of time while fading
+        float fadeRate;
+      };
+
+      // Starts out playing the rest pose. Bounds are the actor's own, and
+      // empty ones are never culled.
+      ActorId add(const Resource::Character *character, const Math::Matrix& worldTransform, const Math::AABB& bounds);
+      size_t size() const;
+
+      // Removes every actor, letting go of the clips they were playing
+      void clear();
+
+      const Resource::Character *getCharacter(ActorId actor) const;
+
+      const Math::Matrix& getWorldTransform(ActorId actor) const;
+      void setWorldTransform(ActorId actor, const Math::Matrix& worldTransform);
+
+      // The clip being played or faded to
+      Resource::Character::AnimationType getAnimation(ActorId actor) const;
+      void setAnimation(ActorId actor, Resource::Character::AnimationType animType, float position = 0.0f);
+
+      // Fades the current clips out while the new one fades in over the
+      // duration, in the same units as animation positions
+      void crossfadeAnimation(ActorId actor, Resource::Character::AnimationType animType, float duration);
+
+      // Scaled by the actor's rate
+      void advanceAnimation(ActorId actor, float timeDelta);
+      float getAnimationPosition(ActorId actor) const;
+
+      float getAnimationRate(ActorId actor) const;
+      void setAnimationRate(ActorId actor, float rate);
+
+      // Oldest first, so the last layer is the one being faded to
+      std::span<const AnimationLayer> getAnimationLayers(ActorId actor) const;
+      bool hasAnimation(ActorId actor) const;
+
+      // Marks which actors are in the frustum, and picks the animation LOD of
+      // each one that is by its size on screen
+      void cull(const Math::Matrix& view, const Math::Matrix& proj, const Math::Frustum& frustum);
+      bool isVisible(ActorId actor) const;
+      const Resource::Character::AnimationLod& getAnimationLod(ActorId actor) const;
+
+      // The bounds' projected radius as a fraction of the viewport height,
+      // for picking mesh LODs. Actors without bounds are always full size.
+      float getScreenSize(ActorId actor) const;
+
+    private:
+      struct AnimationState {
+        std::array<AnimationLayer, MAX_ANIMATION_LAYERS> layers;
+        unsigned layerCount;
+      };
+
+      void dropAnimationLayer(ActorId actor, unsigned layerIdx);
+
+      std::vector<const Resource::Character *> characters;
+      std::vector<Math::Matrix> worldTransforms;
+      std::vector<Math::AABB> bounds;
+
+      std::vector<AnimationState> animations;
+      std::vector<float> animationRates;
+
+      // Written by cull(); LOD levels index the character's LODs and are
+      // only kept up to date for visible actors
+      std::vector<uint8_t> visibility;
+      std::vector<uint8_t> lodLevels;
+      std::vector<float> screenSizes;
+  };
+}
+
+#endif
@@ -0,0 +1,98 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "bvh.hpp"
+
+using namespace Mortar::Scene;
+
+void BVH::clear() {
+  this->nodes.clear();
+  this->items.clear();
+  this->bounds.clear();
+}
+
+bool BVH::isEmpty() const {
+  return this->nodes.empty();
+}
+
+void BVH::build(const std::vector<Math::AABB>& bounds) {
+  this->clear();
+
+  this->bounds = bounds;
+
+  // Empty boxes can never be hit, so they're left out of the tree
+  for (uint32_t i = 0; i < bounds.size(); i++) {
+    if (!bounds[i].isEmpty()) {
+      this->items.push_back(i);
+    }
+  }
+
+  if (this->items.empty()) {
+    return;
+  }
+
+  this->nodes.reserve(2 * this->items.size() / LEAF_SIZE + 1);
+  this->buildNode(0, this->items.size(), 0);
+}
+
+uint32_t BVH::buildNode(uint32_t first, uint32_t count, unsigned depth) {
+  uint32_t nodeIdx = this->nodes.size();
+  this->nodes.push_back({});
+
+  Math::AABB nodeBounds;
+  Math::AABB centroidBounds;
+  for (uint32_t i = first; i < first + count; i++) {
+    const Math::AABB& itemBounds = this->bounds[this->items[i]];
+
+    nodeBounds = nodeBounds.merge(itemBounds);
+    centroidBounds = centroidBounds.merge(Math::AABB::fromMinMax(itemBounds.center, itemBounds.center));
+  }
+
+  Node node {};
+  node.bounds = nodeBounds;
+  node.firstItem = first;
+  node.subtreeItemCount = count;
+
+  // Depth is bounded so queries can use a fixed stack; a median split keeps
+  // it at log2 of the item count in practice
+  if (count <= LEAF_SIZE || depth + 1 >= MAX_DEPTH / 2) {
+    node.itemCount = count;
+    this->nodes[nodeIdx] = node;
+    return nodeIdx;
+  }
+
+  // Split at the median centroid along the axis the centroids spread most
+  const Math::Vector& spread = centroidBounds.extents;
+  int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+
+  auto centroid = [&](uint32_t item) {
+    const Math::Vector& center = this->bounds[item].center;
+    return axis == 0 ? center.x : (axis == 1 ? center.y : center.z);
+  };
+
+  uint32_t half = count / 2;
+  std::nth_element(this->items.begin() + first, this->items.begin() + first + half, this->items.begin() + first + count, [&](uint32_t a, uint32_t b) {
+    return centroid(a) < centroid(b);
+  });
+
+  this->buildNode(first, half, depth + 1);
+  node.rightChild = this->buildNode(first + half, count - half, depth + 1);
+
+  this->nodes[nodeIdx] = node;
+  return nodeIdx;
+}
@@ -0,0 +1,129 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_SCENE_BVH_H
+#define MORTAR_SCENE_BVH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "../math/bounds.hpp"
+
+namespace Mortar::Scene {
+  // Bounding volume hierarchy over a fixed set of boxes, built once for
+  // geometry that never moves. Queries report the indices of the boxes it
+  // was built from.
+  class BVH {
+    public:
+      void build(const std::vector<Math::AABB>& bounds);
+      void clear();
+
+      bool isEmpty() const;
+
+      // Calls visit(index) for every box intersecting the frustum; subtrees
+      // wholly inside are reported without testing their boxes
+      template <typename F>
+      void query(const Math::Frustum& frustum, F&& visit) const {
+        if (this->nodes.empty()) {
+          return;
+        }
+
+        uint32_t stack[MAX_DEPTH];
+        unsigned top = 0;
+        stack[top++] = 0;
+
+        while (top) {
+          uint32_t nodeIdx = stack[--top];
+          const Node& node = this->nodes[nodeIdx];
+
+          Math::Frustum::Containment containment = frustum.classify(node.bounds);
+          if (containment == Math::Frustum::Containment::OUTSIDE) {
+            continue;
+          }
+
+          if (containment == Math::Frustum::Containment::INSIDE) {
+            for (uint32_t i = node.firstItem; i < node.firstItem + node.subtreeItemCount; i++) {
+              visit(this->items[i]);
+            }
+          } else if (node.itemCount) {
+            for (uint32_t i = node.firstItem; i < node.firstItem + node.itemCount; i++) {
+              if (frustum.intersects(this->bounds[this->items[i]])) {
+                visit(this->items[i]);
+              }
+            }
+          } else {
+            stack[top++] = node.rightChild;
+            stack[top++] = nodeIdx + 1;
+          }
+        }
+      }
+
+      // Calls visit(index) for every box containing the point
+      template <typename F>
+      void query(const Math::Vector& point, F&& visit) const {
+        if (this->nodes.empty()) {
+          return;
+        }
+
+        uint32_t stack[MAX_DEPTH];
+        unsigned top = 0;
+        stack[top++] = 0;
+
+        while (top) {
+          uint32_t nodeIdx = stack[--top];
+          const Node& node = this->nodes[nodeIdx];
+
+          if (!node.bounds.contains(point)) {
+            continue;
+          }
+
+          if (node.itemCount) {
+            for (uint32_t i = node.firstItem; i < node.firstItem + node.itemCount; i++) {
+              if (this->bounds[this->items[i]].contains(point)) {
+                visit(this->items[i]);
+              }
+            }
+          } else {
+            stack[top++] = node.rightChild;
+            stack[top++] = nodeIdx + 1;
+          }
+        }
+      }
+
+    private:
+      static constexpr unsigned LEAF_SIZE = 4;
+      static constexpr unsigned MAX_DEPTH = 64;
+
+      // Nodes are stored depth-first, so a node's left child follows it.
+      // Every node covers a contiguous run of items; leaves have itemCount
+      // set, interior nodes only rightChild.
+      struct Node {
+        Math::AABB bounds;
+        uint32_t firstItem;
+        uint32_t subtreeItemCount;
+        uint32_t itemCount;
+        uint32_t rightChild;
+      };
+
+      uint32_t buildNode(uint32_t first, uint32_t count, unsigned depth);
+
+      std::vector<Node> nodes;
+      std::vector<uint32_t> items;
+      std::vector<Math::AABB> bounds;
+  };
+}
+
+#endif
@@ -14,90 +14,243 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <SDL2/SDL_timer.h>
+#include <algorithm>
+#include <assert.h>
 #include <cmath>
 #include <forward_list>
-#include <list>
+#include <memory>
+#include <span>
 #include <stdexcept>
 #include <vector>
 
 #include "../anim/anim.hpp"
+#include "../anim/blend.hpp"
 #include "../log.hpp"
+#include "../math/batch.hpp"
+#include "../math/bounds.hpp"
+#include "../profiler.hpp"
 #include "../state.hpp"
 #include "manager.hpp"
 
 using namespace Mortar::Scene;
 
 void SceneManager::initialize(Render::Renderer *renderer) {
-  this->renderer = renderer;
+  Resource::ResourceManager& resourceManager = State::getResourceManager();
 
-  renderer->initialize();
+  this->renderThread.initialize(renderer, resourceManager);
 
-  this->geomPool = State::getResourceManager().createResourcePool<Resource::GeomObject>(4096);
+  this->geomPool = resourceManager.createResourcePool<Resource::GeomObject>(1024);
+
+  auto releaseGPUObjects = [this] (const Resource::Resource *resource) {
+    std::lock_guard<std::mutex> lock(this->pendingReleasesMutex);
+    this->pendingReleases.push_back(resource->getHandle());
+  };
+
+  resourceManager.registerEvictionHandler<Resource::Mesh>(releaseGPUObjects);
+  resourceManager.registerEvictionHandler<Resource::Surface>(releaseGPUObjects);
+  resourceManager.registerEvictionHandler<Resource::Texture>(releaseGPUObjects);
+  resourceManager.registerEvictionHandler<Resource::VertexBuffer>(releaseGPUObjects);
+
+  // The packet being drawn and the renderer's queued uploads may still
+  // point into an evicted load, so it's freed behind them
+  resourceManager.setRetireHandler([this] (std::shared_ptr<void> memory) {
+    std::lock_guard<std::mutex> lock(this->pendingReleasesMutex);
+    this->pendingRetirements.push_back(std::move(memory));
+  });
 }
 
 void SceneManager::shutDown() {
-  renderer->shutDown();
+  this->renderThread.shutDown();
+
+  std::lock_guard<std::mutex> lock(this->pendingReleasesMutex);
+  this->pendingReleases.clear();
+  this->pendingRetirements.clear();
 }
 
-struct SockSegment {
-  Mortar::Math::Vector minima { INFINITY, INFINITY, INFINITY, 1.0f };
-  Mortar::Math::Vector maxima { -INFINITY, -INFINITY, -INFINITY, 1.0f };
-};
+void SceneManager::clearActors() {
+  for (auto& draws : this->actorDraws) {
+    for (auto geom : draws->skinDraws) {
+      this->geomPool->releaseResource(geom);
+    }
 
-void calculateSplineExtrema(const Mortar::Math::Vector& vertex, Mortar::Math::Vector& minima, Mortar::Math::Vector& maxima) {
-  minima.x = fmin(minima.x, vertex.x);
-  minima.y = fmin(minima.y, vertex.y);
-  minima.z = fmin(minima.z, vertex.z);
+    for (auto& kinematic : draws->kinematicDraws) {
+      this->geomPool->releaseResource(kinematic.geom);
+    }
 
-  maxima.x = fmax(maxima.x, vertex.x);
-  maxima.y = fmax(maxima.y, vertex.y);
-  maxima.z = fmax(maxima.z, vertex.z);
-}
+    for (auto& attachment : draws->attachments) {
+      this->geomPool->releaseResource(attachment.geom);
+    }
 
-float getValue(const Mortar::Math::Vector& lookAt, const Mortar::Math::Vector& a, const Mortar::Math::Vector& b) {
-  // XXX: Currently do not understand the geometric significance of this blend calculation
-  float angle;
-  if (a.z - b.z == 0.0f) {
-    angle = 0.0f;
+    // Packets draw copies of it, so it can go now
+    State::getResourceManager().destroyResource(draws->palette);
   }
-  angle = atan((a.x - b.x) / (a.z - b.z));
 
-  return fabs((lookAt.x - b.x) * cos(-angle) + (lookAt.z - b.z) * sin(-angle));
+  this->actorDraws.clear();
+  this->actors.clear();
+  this->cameraTarget = ActorStore::NO_ACTOR;
 }
 
-Mortar::Resource::Actor *SceneManager::addActor(const Resource::Character *character, Math::Matrix worldTransform) {
-  static unsigned actorCount = 0;
+// XXX: use character config to determine enabled layers
+static const std::vector<unsigned> enabledLayers { 0, 2 };
+
+Mortar::Scene::ActorStore::ActorId SceneManager::addActor(const Resource::Character *character, Math::Matrix worldTransform) {
+  std::unique_ptr<ActorDraws> draws = std::make_unique<ActorDraws>();
+  Math::AABB bounds;
 
-  Mortar::Resource::Actor *actor = State::getResourceManager().createResource<Mortar::Resource::Actor>();
-  this->actors.push_back(actor);
+  size_t jointCount = character->getJoints().size();
+  draws->latestPose.resize(jointCount);
+  draws->previousPose.resize(jointCount);
+  draws->blendedPose.resize(jointCount);
+  draws->layerPose.resize(jointCount);
+  draws->boneTransforms.resize(jointCount);
 
-  actor->setCharacter(character);
-  actor->setWorldTransform(worldTransform);
-  actor->setAnimation(Resource::Character::AnimationType::IDLE);
+  for (const Resource::Joint *joint : character->getJoints()) {
+    draws->jointParents.push_back(joint->getParentIdx());
+  }
+
+  draws->palette = State::getResourceManager().createResource<Resource::SkinPalette>();
+  draws->palette->setSize(jointCount);
+
+  for (auto enabledLayer : enabledLayers) {
+    const Resource::Layer *layer = character->getLayer(enabledLayer);
 
+    for (auto meshes : { &layer->getDeformableSkinMeshes(), &layer->getSkinMeshes() }) {
+      for (auto mesh : *meshes) {
+        Resource::GeomObject *geom = this->geomPool->getResource();
+        geom->reset();
+
+        geom->setMesh(mesh);
+        geom->setSkinPalette(draws->palette);
+
+        draws->skinDraws.push_back(geom);
+        bounds = bounds.merge(mesh->getBounds());
+      }
+    }
+
+    for (auto kinematic : layer->getKinematicMeshes()) {
+      Resource::GeomObject *geom = this->geomPool->getResource();
+      geom->reset();
+
+      geom->setMesh(kinematic->getMesh());
+
+      draws->kinematicDraws.push_back({ geom, kinematic->getJointIdx() });
+    }
+  }
+
+  // Skinned meshes are bounded in their bind pose; the padding covers limbs
+  // that animate out of it
+  if (!bounds.isEmpty()) {
+    bounds.extents = bounds.extents * 1.5f;
+  }
+
+  ActorStore::ActorId actor = this->actors.add(character, worldTransform, bounds);
+  this->actors.setAnimation(actor, Resource::Character::AnimationType::IDLE);
+  this->actorDraws.push_back(std::move(draws));
+
+  // Uploads go out over the next few frames, and the actor is drawn once
+  // they're done
   const Resource::Model *model = character->getModel();
 
-  this->renderer->registerTextures(model->getTextures());
-  this->renderer->registerVertexBuffers(model->getVertexBuffers());
+  this->renderThread.registerTextures(model->getTextures());
+  this->renderThread.registerVertexBuffers(model->getVertexBuffers());
 
   // Must not be called until after registering vertex buffers
-  this->renderer->registerMeshes(model->getMeshes());
-
-  actorCount++;
+  this->renderThread.registerMeshes(model->getMeshes());
 
   return actor;
 }
 
+void SceneManager::attach(ActorStore::ActorId actor, unsigned char locator, const Resource::Mesh *mesh) {
+  ActorDraws& draws = *this->actorDraws[actor];
+
+  const Resource::Character *character = this->actors.getCharacter(actor);
+  if (character->getExternalLocatorMap().find(locator) == character->getExternalLocatorMap().end()) {
+    throw std::runtime_error("character doesn't have that locator");
+  }
+
+  auto slot = std::find(draws.locators.begin(), draws.locators.end(), locator);
+  if (slot == draws.locators.end()) {
+    const Resource::Character::Locator *resource = character->getLocatorFromExternalIdx(locator);
+
+    draws.locators.push_back(locator);
+    draws.locatorTransforms.push_back(resource->getTransform());
+    draws.locatorJoints.push_back(resource->getJointIdx());
+    draws.locatorJointTransforms.emplace_back();
+    draws.locatorWorldTransforms.emplace_back();
+
+    slot = draws.locators.end() - 1;
+  }
+
+  Resource::GeomObject *geom = this->geomPool->getResource();
+  geom->reset();
+
+  geom->setMesh(mesh);
+
+  draws.attachments.push_back({ geom, (unsigned)(slot - draws.locators.begin()) });
+
+  // Placed by the actor's next update
+  draws.isResident = false;
+}
+
+void SceneManager::detach(ActorStore::ActorId actor, unsigned char locator) {
+  ActorDraws& draws = *this->actorDraws[actor];
+
+  auto slot = std::find(draws.locators.begin(), draws.locators.end(), locator);
+  if (slot == draws.locators.end()) {
+    return;
+  }
+
+  unsigned locatorSlot = slot - draws.locators.begin();
+
+  std::erase_if(draws.attachments, [&] (const ActorDraws::Attachment& attachment) {
+    if (attachment.locatorSlot == locatorSlot) {
+      this->geomPool->releaseResource(attachment.geom);
+      return true;
+    }
+
+    return false;
+  });
+
+  for (auto& attachment : draws.attachments) {
+    if (attachment.locatorSlot > locatorSlot) {
+      attachment.locatorSlot--;
+    }
+  }
+
+  draws.locators.erase(slot);
+  draws.locatorTransforms.erase(draws.locatorTransforms.begin() + locatorSlot);
+  draws.locatorJoints.erase(draws.locatorJoints.begin() + locatorSlot);
+  draws.locatorJointTransforms.erase(draws.locatorJointTransforms.begin() + locatorSlot);
+  draws.locatorWorldTransforms.erase(draws.locatorWorldTransforms.begin() + locatorSlot);
+}
+
 void SceneManager::setScene(const Resource::Scene *scene) {
+  // Everything but the actors was published before a streamed load finished
+  this->updateSceneFeed();
+  bool isStreamed = this->streamedScene == scene;
+
+  this->sceneFeed.reset();
+  this->streamedScene = nullptr;
   this->scene = scene;
 
-  const Resource::Model *model = scene->getModel();
+  if (!isStreamed) {
+    const Resource::Model *model = scene->getModel();
 
-  this->renderer->registerTextures(model->getTextures());
-  this->renderer->registerVertexBuffers(model->getVertexBuffers());
+    this->renderThread.registerTextures(model->getTextures());
+    this->renderThread.registerVertexBuffers(model->getVertexBuffers());
 
-  // Must not be called until after registering vertex buffers
-  this->renderer->registerMeshes(model->getMeshes());
+    // Must not be called until after registering vertex buffers
+    this->renderThread.registerMeshes(model->getMeshes());
+
+    this->sockCamera.build(scene);
+  }
+
+  // Static instances never move, so their draws are built and indexed once.
+  // A streamed scene's are rebuilt too, as the finished load may have merged
+  // the instances its blocks placed.
+  this->clearSceneDraws();
+  this->addSceneDraws(scene->getInstances());
 
   Math::Vector player1Pos;
 
@@ -122,248 +275,656 @@ void SceneManager::setScene(const Resource::Scene *scene) {
     }
   }
 
-  Math::Vector camPos;
+  const std::vector<const Resource::Character *>& playerCharacters = scene->getPlayerCharacters();
+  assert(playerCharacters.size() == pcStartingTransforms.size());
 
-  for (int i = 0; i < 0x20; i++) {
-    char nameBuf[32];
-    sprintf(nameBuf, "sock_cam_%.2d", i);
+  // The camera follows the first player from here on. The last scene's
+  // actors go first, as its characters are released after this.
+  this->clearActors();
+  for (int i = 0; i < playerCharacters.size(); i++) {
+    ActorStore::ActorId actor = this->addActor(playerCharacters.at(i), pcStartingTransforms.at(i));
 
-    const Resource::Spline *camSpline = scene->getSplineByName(nameBuf);
-    if (camSpline != nullptr) {
-      size_t vertexCount = camSpline->getVertexCount();
+    if (i == 0) {
+      this->cameraTarget = actor;
+    }
+  }
 
-      sprintf(nameBuf, "sock_a_%.2d", i);
-      const Resource::Spline *aSpline = scene->getSplineByName(nameBuf);
+  this->updateCamera(player1Pos);
 
-      sprintf(nameBuf, "sock_b_%.2d", i);
-      const Resource::Spline *bSpline = scene->getSplineByName(nameBuf);
+  const Camera& camera = State::getCamera();
+  DEBUG("camera position %s, look at %s", camera.getPosition().toString().c_str(), camera.getLookAt().toString().c_str());
+}
 
-      if (aSpline == nullptr || bSpline == nullptr || aSpline->getVertexCount() != vertexCount && bSpline->getVertexCount() != vertexCount) {
-        continue;
-      }
+void SceneManager::streamScene(std::shared_ptr<SceneFeed> feed) {
+  this->sceneFeed = std::move(feed);
+  this->streamedScene = nullptr;
 
-      Math::Vector minima { INFINITY, INFINITY, INFINITY, 1.0f };
-      Math::Vector maxima { -INFINITY, -INFINITY, -INFINITY, 1.0f };
+  this->clearActors();
+  this->clearSceneDraws();
+}
 
-      std::vector<SockSegment> segments (vertexCount - 1);
+void SceneManager::updateSceneFeed() {
+  if (!this->sceneFeed) {
+    return;
+  }
 
-      // XXX: Factor in C and D splines
-      for (int j = 0; j < vertexCount; j++) {
-        Math::Vector aVertex = aSpline->getVertex(j);
-        Math::Vector bVertex = bSpline->getVertex(j);
+  SceneFeed::Update update = this->sceneFeed->take();
 
-        calculateSplineExtrema(aVertex, minima, maxima);
-        calculateSplineExtrema(bVertex, minima, maxima);
+  // The camera waits at the first player's start until there's a player
+  if (update.scene) {
+    this->streamedScene = update.scene;
+    this->sockCamera.build(update.scene);
 
-        if (j > 0) {
-          calculateSplineExtrema(aVertex, segments[j - 1].minima, segments[j - 1].maxima);
-          calculateSplineExtrema(bVertex, segments[j - 1].minima, segments[j - 1].maxima);
-        }
+    const Resource::Spline *startSpline = update.scene->getSplineByName("start");
+    if (startSpline != nullptr && startSpline->getVertexCount() > 0) {
+      this->updateCamera(startSpline->getVertex(0));
+    }
+  }
 
-        if (j < segments.size()) {
-          calculateSplineExtrema(aVertex, segments[j].minima, segments[j].maxima);
-          calculateSplineExtrema(bVertex, segments[j].minima, segments[j].maxima);
-        }
-      }
+  // Meshes are drawn in their material colors until their textures are in
+  if (!update.textures.empty()) {
+    this->renderThread.registerTextures(update.textures);
+  }
+
+  if (!update.vertexBuffers.empty()) {
+    this->renderThread.registerVertexBuffers(update.vertexBuffers);
+  }
+
+  // Must not be called until after registering vertex buffers
+  if (!update.meshes.empty()) {
+    this->renderThread.registerMeshes(update.meshes);
+  }
+
+  if (!update.instances.empty()) {
+    this->addSceneDraws(update.instances);
+  }
+}
+
+void SceneManager::clearSceneDraws() {
+  for (auto geom : this->sceneDraws) {
+    this->geomPool->releaseResource(geom);
+  }
+
+  this->sceneDraws.clear();
+  this->sceneDrawCenters.clear();
+  this->sceneDrawBounds.clear();
+  this->unboundedSceneDraws.clear();
+  this->sceneBvh.clear();
+}
 
-      // XXX: Create a sock system to be part of the scene manager and maintain
-      // these so that the camera can run this calculation per-frame
-      if (player1Pos.x >= minima.x && player1Pos.y >= minima.y && player1Pos.z >= minima.z && player1Pos.x <= maxima.x && player1Pos.y <= maxima.y && player1Pos.z <= maxima.z) {
-        DEBUG("player 1 in sock %d, %lu segments", i, vertexCount - 1);
-        for (int j = 0; j < segments.size(); j++) {
-          SockSegment segment = segments[j];
-
-          if (player1Pos.x >= segment.minima.x && player1Pos.y >= segment.minima.y && player1Pos.z >= segment.minima.z && player1Pos.x <= segment.maxima.x && player1Pos.y <= segment.maxima.y && player1Pos.z <= segment.maxima.z) {
-            DEBUG("player 1 in segment %d", j);
-
-            // XXX: Don't fully understand the calculation of the blend value here
-            float start = getValue(player1Pos, aSpline->getVertex(j), bSpline->getVertex(j));
-            float end = getValue(player1Pos, aSpline->getVertex(j + 1), bSpline->getVertex(j + 1));
-            float blend = start / (start + end);
-
-            const Math::Vector& camStartVertex = camSpline->getVertex(j);
-            camPos = (camSpline->getVertex(j + 1) - camStartVertex) * blend + camStartVertex;
-
-            // Use the mid spline to provide an upper limit on Y
-            // XXX: Read Y-limiting flag from scene config
-            sprintf(nameBuf, "sock_mid_%.2d", i);
-            const Resource::Spline *midSpline = scene->getSplineByName(nameBuf);
-            if (midSpline == nullptr || midSpline->getVertexCount() != vertexCount) {
-              // XXX: Don't have a way to deal with this right now
-              throw std::runtime_error("missing or invalid mid spline");
-            }
-
-            const Math::Vector& midStartVertex = midSpline->getVertex(j);
-            Math::Vector midBlended = (midSpline->getVertex(j + 1) - midStartVertex) * blend + midStartVertex;
-
-            camPos.y = fmax(camPos.y, fmin(1.2f, midBlended.y));
-          }
-        }
+// Where a draw is for sorting and detail: the center of its bounds, or its
+// origin when it has none. Meshes without bounds can't be culled, so they're
+// always drawn.
+static Mortar::Math::Vector getPlacement(const Mortar::Math::AABB& bounds, const Mortar::Math::Matrix& transform) {
+  if (bounds.isEmpty()) {
+    return { transform._41, transform._42, transform._43, 1.0f };
+  }
+
+  return bounds.center;
+}
+
+void SceneManager::addSceneDraws(std::span<const Resource::Instance * const> instances) {
+  for (auto instance : instances) {
+    for (auto mesh : instance->getMeshes()) {
+      Resource::GeomObject *geom = this->geomPool->getResource();
+      geom->reset();
+
+      geom->setMesh(mesh);
+      geom->setWorldTransform(instance->getWorldTransform().toMatrix());
+
+      const Math::AABB& bounds = this->sceneDrawBounds.emplace_back(mesh->getBounds().transform(geom->getWorldTransform()));
+      this->sceneDrawCenters.push_back(getPlacement(bounds, geom->getWorldTransform()));
+
+      if (bounds.isEmpty()) {
+        this->unboundedSceneDraws.push_back(this->sceneDraws.size());
       }
+
+      this->sceneDraws.push_back(geom);
     }
   }
 
-  Math::Vector lookAt = player1Pos;
+  this->sceneBvh.build(this->sceneDrawBounds);
+}
+
+void SceneManager::updateCamera(const Math::Vector& target) {
+  Math::Vector lookAt = target;
 
   // XXX: Pulled the height value out of a text file, need to read it in
   lookAt.y = 0.42f * 0.5f;
 
   State::getCamera().setLookAt(lookAt);
-  State::getCamera().setPosition(camPos);
+  State::getCamera().setPosition(this->sockCamera.update(target));
+}
 
-  DEBUG("camera position %s, look at %s", camPos.toString().c_str(), lookAt.toString().c_str());
+// Poses as many joints as the buffer holds. Each playing clip is evaluated
+// and blended into the pose in turn, so the cost grows with the clips that
+// have weight and only one extra pose buffer is needed.
+static void calculatePose(const Mortar::Resource::Character *character, std::span<const ActorStore::AnimationLayer> layers, std::span<Mortar::Math::QTS> pose, std::span<Mortar::Animation::AnimationCursor> cursors, std::span<Mortar::Math::QTS> layerPose, Mortar::Animation::PoseCache& poseCache) {
+  assert(cursors.size() >= layers.size());
+
+  float totalWeight = 0.0f;
+  for (size_t i = 0; i < layers.size(); i++) {
+    const ActorStore::AnimationLayer& layer = layers[i];
+    if (layer.weight <= 0.0f) {
+      continue;
+    }
 
-  const std::vector<const Resource::Character *>& playerCharacters = scene->getPlayerCharacters();
-  assert(playerCharacters.size() == pcStartingTransforms.size());
+    std::span<Mortar::Math::QTS> target = totalWeight > 0.0f ? layerPose.first(pose.size()) : pose;
 
-  for (int i = 0; i < playerCharacters.size(); i++) {
-    this->addActor(playerCharacters.at(i), pcStartingTransforms.at(i));
+    // Clips still loading hold the rest pose in the meantime
+    const Mortar::Resource::Animation *anim = nullptr;
+    if (layer.animType != Mortar::Resource::Character::AnimationType::NONE) {
+      if (!character->hasSkeletalAnimation(layer.animType)) {
+        throw std::runtime_error("character doesn't have that animation");
+      }
+
+      anim = character->getSkeletalAnimation(layer.animType);
+    }
+
+    if (anim) {
+      poseCache.getPose(anim, character->getJoints(), layer.position, target, &cursors[i]);
+    } else {
+      const std::vector<Mortar::Math::QTS>& restPose = character->getRestPose();
+      std::copy(restPose.begin(), restPose.begin() + target.size(), target.begin());
+    }
+
+    // Each layer takes its share of the weight blended so far
+    totalWeight += layer.weight;
+    if (target.data() != pose.data()) {
+      Mortar::Animation::blendPoses(pose, target, layer.weight / totalWeight, pose);
+    }
   }
 }
 
-const std::vector<Mortar::Math::Matrix> calculatePose(const Mortar::Resource::Actor *actor) {
-  const Mortar::Resource::Character *character = actor->getCharacter();
+// Poses in between evaluations are blended with normalized lerps, which are
+// close enough over the few frames they cover
+static void blendPoses(const std::vector<Mortar::Math::QTS>& from, const std::vector<Mortar::Math::QTS>& to, float blend, std::vector<Mortar::Math::QTS>& out) {
+  for (size_t i = 0; i < out.size(); i++) {
+    out[i].rotation = Mortar::Math::Quaternion::nlerp(from[i].rotation, to[i].rotation, blend);
+    out[i].translation = from[i].translation + (to[i].translation - from[i].translation) * blend;
+    out[i].scale = from[i].scale + (to[i].scale - from[i].scale) * blend;
+  }
+}
+
+static float getViewDistance(const Mortar::Math::Matrix& view, const Mortar::Math::Vector& position) {
+  Mortar::Math::Vector viewPosition { position.x, position.y, position.z, 1.0f };
+  viewPosition = viewPosition * view;
+  viewPosition.w = 0.0f;
+
+  return viewPosition.getMagnitude();
+}
+
+static float getViewDistance(const Mortar::Math::Matrix& view, const Mortar::Math::Matrix& transform) {
+  return getViewDistance(view, { transform._41, transform._42, transform._43, 1.0f });
+}
+
+// Bounding radius over distance, scaled to a fraction of the viewport
+// height. Eyes inside the bounds see them at full size.
+static float getScreenSize(const Mortar::Math::Matrix& proj, const Mortar::Math::AABB& bounds, float distance) {
+  // Meshes without bounds draw at full detail, as actors without them do
+  if (bounds.isEmpty()) {
+    return 1.0f;
+  }
+
+  float radius = sqrtf(bounds.extents.x * bounds.extents.x + bounds.extents.y * bounds.extents.y + bounds.extents.z * bounds.extents.z);
+  return radius * proj._22 * 0.5f / std::max(distance, radius);
+}
 
-  if (actor->getAnimation() == Mortar::Resource::Character::Character::AnimationType::NONE) {
-    return character->getRestPose();
+// Skinned geometry is placed by its palette rather than its world transform,
+// so the first skin transform stands in for its position
+static float getViewDistance(const Mortar::Math::Matrix& view, const Mortar::Resource::GeomObject& geom) {
+  const Mortar::Resource::SkinPalette *palette = geom.getSkinPalette();
+  if (!palette || !palette->getSize()) {
+    return getViewDistance(view, geom.getWorldTransform());
   }
 
-  const Mortar::Resource::Animation *anim = character->getSkeletalAnimation(actor->getAnimation());
-  if (!anim) {
-    throw std::runtime_error("character doesn't have that animation");
+  // Palettes holding local poses are placed by their root instead
+  return getViewDistance(view, palette->getIsLocalPose() ? palette->getRootTransform() : palette->getTransforms().front().toMatrix());
+}
+
+// One joint's world transform, for when the rest of the skeleton isn't needed
+static Mortar::Math::Matrix composeJoint(const std::vector<Mortar::Resource::Joint *>& joints, std::span<const Mortar::Math::QTS> pose, unsigned jointIdx, const Mortar::Math::Matrix& rootTransform) {
+  Mortar::Math::Matrix transform = pose[jointIdx].toMatrix();
+
+  for (int parentIdx = joints.at(jointIdx)->getParentIdx(); parentIdx != -1; parentIdx = joints.at(parentIdx)->getParentIdx()) {
+    transform = transform * pose[parentIdx].toMatrix();
   }
 
-  return Mortar::Animation::runSkeletalAnimation(anim, character->getJoints(), actor->getAnimationPosition());
+  return transform * rootTransform;
 }
 
-void SceneManager::render() {
-  std::list<const Resource::GeomObject *> geoms;
-  std::list<const Resource::GeomObject *> alphaGeoms;
+void SceneManager::updateActor(ActorStore::ActorId actor, unsigned stepCount, float stepDelta, float alpha) {
+  PROFILE_ZONE("updateActor");
 
-  // XXX: use character config to determine enabled layers
-  std::vector<unsigned> enabledLayers { 0, 2 };
+  ActorDraws& draws = *this->actorDraws[actor];
+  ActorStore& actors = this->actors;
+
+  if (State::animEnabled && actors.getAnimation(actor) != Resource::Character::Character::AnimationType::IDLE) {
+    actors.setAnimation(actor, Resource::Character::Character::AnimationType::IDLE);
+  } else if (!State::animEnabled) {
+    actors.setAnimation(actor, Resource::Character::Character::AnimationType::NONE);
+  }
 
-  float timeDelta = State::getClock().getTimeDelta() * State::animRate;
+  const Resource::Character *character = actors.getCharacter(actor);
+  const Math::Matrix& worldTransform = actors.getWorldTransform(actor);
 
-  for (auto actor : this->actors) {
-    if (State::animEnabled && actor->getAnimation() != Resource::Character::Character::AnimationType::IDLE) {
-      actor->setAnimation(Resource::Character::Character::AnimationType::IDLE);
-    } else if (!State::animEnabled) {
-      actor->setAnimation(Resource::Character::Character::AnimationType::NONE);
+  // Hidden actors keep playing but aren't posed, so their last pose is stale
+  // by the time they're seen again
+  bool isVisible = actors.isVisible(actor);
+  if (!isVisible || !actors.hasAnimation(actor)) {
+    for (unsigned i = 0; i < stepCount; i++) {
+      actors.advanceAnimation(actor, stepDelta);
     }
 
-    const Resource::Character *character = actor->getCharacter();
+    draws.hasPose = false;
+  }
 
-    actor->advanceAnimation(timeDelta);
+  if (!isVisible) {
+    return;
+  }
 
-    const std::vector<Math::Matrix> pose = calculatePose(actor);
+  const std::vector<Resource::Joint *>& joints = character->getJoints();
+  const std::vector<Math::QTS>& restPose = character->getRestPose();
 
-    const std::vector<Resource::Joint *> joints = character->getJoints();
+  std::span<const Math::QTS> pose = restPose;
+  if (actors.hasAnimation(actor)) {
+    const Resource::Character::AnimationLod& lod = actors.getAnimationLod(actor);
+    unsigned updateInterval = std::max(lod.updateInterval, 1u);
+    size_t jointCount = lod.jointCount ? std::min<size_t>(lod.jointCount, joints.size()) : joints.size();
 
-    std::vector<Math::Matrix> boneTransforms (joints.size());
-    for (int i = 0; i < joints.size(); i++) {
-      const Resource::Joint *joint = joints.at(i);
-      const int parentIdx = joint->getParentIdx();
+    auto evaluate = [&] () {
+      std::swap(draws.previousPose, draws.latestPose);
 
-      if (State::printNextFrame) {
-        Math::Matrix poseMtx = pose.at(i);
-        DEBUG("transforming %d, parent %d\npose:\n%s", i, parentIdx, poseMtx.toString().c_str());
-      }
+      calculatePose(character, actors.getAnimationLayers(actor), std::span(draws.latestPose).first(jointCount), draws.animationCursors, draws.layerPose, this->poseCache);
+      std::copy(restPose.begin() + jointCount, restPose.end(), draws.latestPose.begin() + jointCount);
 
-      if (parentIdx != -1) {
-        if (State::printNextFrame) {
-          DEBUG("parent\n%s", boneTransforms[parentIdx].toString().c_str());
-        }
-        boneTransforms[i] = pose.at(i) * boneTransforms[parentIdx];
-      } else {
-        boneTransforms[i] = pose.at(i) * actor->getWorldTransform();
-      }
+      draws.stepsSinceUpdate = 0;
+    };
+
+    // Starting over, both poses are the current one
+    if (!draws.hasPose) {
+      evaluate();
+      draws.previousPose = draws.latestPose;
+      draws.hasPose = true;
+    }
+
+    for (unsigned i = 0; i < stepCount; i++) {
+      actors.advanceAnimation(actor, stepDelta);
 
-      if (State::printNextFrame) {
-        DEBUG("result:\n%s", boneTransforms[i].toString().c_str());
+      if (++draws.stepsSinceUpdate >= updateInterval) {
+        evaluate();
       }
     }
 
-    std::vector<Math::Matrix> skinTransforms (joints.size());
+    // Trails the evaluations by one interval, reaching the latest pose just
+    // as the next one is evaluated
+    float blend = (draws.stepsSinceUpdate + alpha) / updateInterval;
+
+    if (blend >= 1.0f) {
+      pose = draws.latestPose;
+    } else {
+      blendPoses(draws.previousPose, draws.latestPose, blend, draws.blendedPose);
+      pose = draws.blendedPose;
+    }
+  }
+
+  // The renderer composes the skeleton on its side, so only the joints that
+  // carry kinematic meshes are composed here
+  if (this->renderThread.composesSkinPalettes()) {
     for (int i = 0; i < joints.size(); i++) {
-      skinTransforms[i] = character->getSkinTransform(i) * boneTransforms[i];
+      draws.palette->getTransform(i) = pose[i].toAffine();
     }
+    draws.palette->setLocalPose(character, worldTransform);
 
-    for (auto enabledLayer = enabledLayers.begin(); enabledLayer != enabledLayers.end(); enabledLayer++) {
-      const Resource::Layer *layer = character->getLayer(*enabledLayer);
+    for (auto& kinematic : draws.kinematicDraws) {
+      kinematic.geom->setWorldTransform(composeJoint(joints, pose, kinematic.jointIdx, worldTransform));
+    }
 
-      const std::vector<Resource::Mesh *>& deformableSkinMeshes = layer->getDeformableSkinMeshes();
-      for (auto mesh : deformableSkinMeshes) {
-        Resource::GeomObject *geom = this->geomPool->getResource();
-        geom->reset();
+    for (size_t i = 0; i < draws.locatorJoints.size(); i++) {
+      draws.locatorJointTransforms[i] = composeJoint(joints, pose, draws.locatorJoints[i], worldTransform);
+    }
+    placeAttachments(draws);
 
-        geom->setMesh(mesh);
-        geom->setSkinTransforms(skinTransforms);
+    return;
+  }
 
-        if (mesh->getMaterial()->isAlphaBlended()) {
-          alphaGeoms.push_back(geom);
-        } else {
-          geoms.push_back(geom);
-        }
-      }
+  draws.palette->clearLocalPose();
 
-      const std::vector<Resource::Mesh *>& skinMeshes = layer->getSkinMeshes();
-      for (auto mesh : skinMeshes) {
-        Resource::GeomObject *geom = this->geomPool->getResource();
-        geom->reset();
+  std::vector<Math::Matrix>& boneTransforms = draws.boneTransforms;
+  Math::multiplyHierarchy(pose, draws.jointParents, worldTransform, boneTransforms);
 
-        geom->setMesh(mesh);
-        geom->setSkinTransforms(skinTransforms);
+  if (State::printNextFrame) {
+    for (int i = 0; i < joints.size(); i++) {
+      Math::Matrix poseMtx = pose[i].toMatrix();
+      TRACE("transformed %d, parent %d\npose:\n%s\nresult:\n%s", i, draws.jointParents[i], poseMtx.toString().c_str(), boneTransforms[i].toString().c_str());
+    }
+  }
 
-        if (mesh->getMaterial()->isAlphaBlended()) {
-          alphaGeoms.push_back(geom);
-        } else {
-          geoms.push_back(geom);
-        }
-      }
+  Math::multiplyEach(character->getSkinTransforms(), boneTransforms, draws.palette->getTransforms());
 
-      const std::vector<Resource::KinematicMesh *>& kinematicMeshes = layer->getKinematicMeshes();
-      for (auto kinematic : kinematicMeshes) {
-        Resource::GeomObject *geom = this->geomPool->getResource();
-        geom->reset();
+  for (auto& kinematic : draws.kinematicDraws) {
+    kinematic.geom->setWorldTransform(boneTransforms.at(kinematic.jointIdx));
+  }
 
-        const Resource::Mesh *mesh = kinematic->getMesh();
+  for (size_t i = 0; i < draws.locatorJoints.size(); i++) {
+    draws.locatorJointTransforms[i] = boneTransforms.at(draws.locatorJoints[i]);
+  }
+  placeAttachments(draws);
+}
 
-        geom->setMesh(mesh);
-        geom->setWorldTransform(boneTransforms.at(kinematic->getJointIdx()));
+void SceneManager::placeAttachments(ActorDraws& draws) {
+  if (draws.attachments.empty()) {
+    return;
+  }
 
-        if (mesh->getMaterial()->isAlphaBlended()) {
-          alphaGeoms.push_back(geom);
-        } else {
-          geoms.push_back(geom);
-        }
-      }
+  Math::multiplyEach(draws.locatorTransforms, draws.locatorJointTransforms, draws.locatorWorldTransforms);
+
+  for (auto& attachment : draws.attachments) {
+    attachment.geom->setWorldTransform(draws.locatorWorldTransforms[attachment.locatorSlot]);
+  }
+}
+
+bool SceneManager::isResident(const ActorDraws& draws) const {
+  for (auto geom : draws.skinDraws) {
+    if (!this->renderThread.isMeshReady(geom->getMesh()->getHandle())) {
+      return false;
     }
   }
 
-  const std::vector<Resource::Instance *>& instances = this->scene->getInstances();
-  for (auto instance : instances) {
-    std::forward_list<Resource::Mesh *> meshes = instance->getMeshes();
-    for (auto mesh : meshes) {
-      Resource::GeomObject *geom = this->geomPool->getResource();
-      geom->reset();
+  for (auto& kinematic : draws.kinematicDraws) {
+    if (!this->renderThread.isMeshReady(kinematic.geom->getMesh()->getHandle())) {
+      return false;
+    }
+  }
 
-      geom->setMesh(mesh);
-      geom->setWorldTransform(instance->getWorldTransform());
+  for (auto& attachment : draws.attachments) {
+    if (!this->renderThread.isMeshReady(attachment.geom->getMesh()->getHandle())) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+Mortar::Render::RenderStats SceneManager::getRenderStats() const {
+  return this->renderThread.getRenderStats();
+}
+
+const FrameTimings& SceneManager::getFrameTimings() const {
+  return this->frameTimings;
+}
+
+const CullStats& SceneManager::getCullStats() const {
+  return this->cullStats;
+}
+
+void SceneManager::setOcclusionCulling(bool enabled) {
+  this->occlusionCulling = enabled;
+}
+
+bool SceneManager::getOcclusionCulling() const {
+  return this->occlusionCulling;
+}
+
+void SceneManager::setDepthMode(Render::DepthMode depthMode) {
+  this->depthMode = depthMode;
+}
+
+Mortar::Render::DepthMode SceneManager::getDepthMode() const {
+  return this->depthMode;
+}
+
+void SceneManager::flushPendingReleases() {
+  std::lock_guard<std::mutex> lock(this->pendingReleasesMutex);
+  if (!this->pendingReleases.empty() || !this->pendingRetirements.empty()) {
+    this->renderThread.unregisterResources(this->pendingReleases, std::move(this->pendingRetirements));
+    this->pendingReleases.clear();
+    this->pendingRetirements.clear();
+  }
+}
+
+void SceneManager::render() {
+  PROFILE_ZONE("SceneManager::render");
+
+  uint64_t frameStart = SDL_GetPerformanceCounter();
+
+  this->flushPendingReleases();
+  this->updateSceneFeed();
+
+  if (this->cameraTarget != ActorStore::NO_ACTOR) {
+    const Math::Matrix& transform = this->actors.getWorldTransform(this->cameraTarget);
+    this->updateCamera({ transform._41, transform._42, transform._43, 1.0f });
+  }
+
+  const Math::Matrix view = State::getCamera().getViewTransform();
+  const Math::Matrix& proj = State::getDisplayManager().getPerspectiveTransform();
+
+  // Same clip transform the renderer builds, including its handedness flip
+  const Math::Matrix projViewMtx = view * Math::Matrix::diagonal(1.0f, 1.0f, -1.0f) * proj;
+  const Math::Frustum frustum { projViewMtx };
+
+  // Frames without a step only blend the poses already evaluated
+  const Clock& clock = State::getClock();
+  unsigned stepCount = clock.getStepCount();
+  float stepDelta = clock.getStepDuration() * State::animRate;
+  float alpha = clock.getInterpolationAlpha();
+
+  // Culling and LOD selection only read the transform and bounds columns,
+  // so they're one pass over every actor ahead of posing
+  {
+    PROFILE_ZONE("cull actors");
+
+    this->actors.cull(view, proj, frustum);
+  }
 
-      if (mesh->getMaterial()->isAlphaBlended()) {
-        alphaGeoms.push_back(geom);
-      } else {
-        geoms.push_back(geom);
+  // Actors only write their own pose, palette and kinematic transforms, so
+  // they're animated in parallel before any of them is drawn
+  {
+    PROFILE_ZONE("animate actors");
+
+    this->poseCache.beginFrame();
+    State::getJobSystem().parallelFor(this->actors.size(), 1, [&] (size_t i) {
+      this->updateActor(i, stepCount, stepDelta, alpha);
+    });
+  }
+
+  uint64_t animateEnd = SDL_GetPerformanceCounter();
+
+  // Posing overlaps the last frame's draws; this waits for the frame before
+  // that to finish with the packet
+  Render::FramePacket& packet = this->renderThread.getPacket();
+  packet.begin(view, proj, this->depthMode);
+
+  uint64_t collectStart = SDL_GetPerformanceCounter();
+
+  PROFILE_ZONE("collect draws");
+
+  for (ActorStore::ActorId actor = 0; actor < this->actors.size(); actor++) {
+    if (!this->actors.isVisible(actor)) {
+      continue;
+    }
+
+    std::unique_ptr<ActorDraws>& draws = this->actorDraws[actor];
+    if (!draws->isResident) {
+      draws->isResident = this->isResident(*draws);
+    }
+
+    if (!draws->isResident) {
+      continue;
+    }
+
+    // Every skinned layer of an actor draws at the level its bounds call for
+    float screenSize = this->actors.getScreenSize(actor);
+    for (auto geom : draws->skinDraws) {
+      geom->setLodLevel(geom->getMesh()->getLodLevel(screenSize));
+      geom->setScreenSize(screenSize);
+      packet.push(geom, getViewDistance(view, *geom));
+    }
+
+    for (auto& kinematic : draws->kinematicDraws) {
+      const Resource::Mesh *mesh = kinematic.geom->getMesh();
+      Math::AABB bounds = mesh->getBounds().transform(kinematic.geom->getWorldTransform());
+      if (!bounds.isEmpty() && !frustum.intersects(bounds)) {
+        continue;
+      }
+
+      float distance = getViewDistance(view, getPlacement(bounds, kinematic.geom->getWorldTransform()));
+      float screenSize = getScreenSize(proj, bounds, distance);
+      kinematic.geom->setLodLevel(mesh->getLodLevel(screenSize));
+      kinematic.geom->setScreenSize(screenSize);
+      packet.push(kinematic.geom, distance);
+    }
+
+    // Props draw like kinematic meshes, placed by their locators
+    for (auto& attachment : draws->attachments) {
+      const Resource::Mesh *mesh = attachment.geom->getMesh();
+      Math::AABB bounds = mesh->getBounds().transform(attachment.geom->getWorldTransform());
+      if (!bounds.isEmpty() && !frustum.intersects(bounds)) {
+        continue;
       }
+
+      float distance = getViewDistance(view, getPlacement(bounds, attachment.geom->getWorldTransform()));
+      float screenSize = getScreenSize(proj, bounds, distance);
+      attachment.geom->setLodLevel(mesh->getLodLevel(screenSize));
+      attachment.geom->setScreenSize(screenSize);
+      packet.push(attachment.geom, distance);
     }
   }
 
-  geoms.splice(geoms.end(), alphaGeoms);
+  this->visibleSceneDraws.clear();
+  this->sceneBvh.query(frustum, [&](uint32_t drawIdx) {
+    this->visibleSceneDraws.push_back(drawIdx);
+  });
 
-  this->renderer->renderGeometry(geoms);
+  // The tree leaves out draws without bounds, which can't be culled
+  this->visibleSceneDraws.insert(this->visibleSceneDraws.end(), this->unboundedSceneDraws.begin(), this->unboundedSceneDraws.end());
+
+  this->cullStats = {};
+  this->cullStats.sceneDraws = this->sceneDraws.size();
+  this->cullStats.frustumRejected = this->sceneDraws.size() - this->visibleSceneDraws.size();
+
+  if (this->occlusionCulling) {
+    PROFILE_ZONE("cull occluded");
+
+    this->cullOccludedDraws(view, projViewMtx);
+  }
 
-  this->geomPool->reset();
+  for (uint32_t drawIdx : this->visibleSceneDraws) {
+    Resource::GeomObject *geom = this->sceneDraws[drawIdx];
+
+    float distance = getViewDistance(view, this->sceneDrawCenters[drawIdx]);
+    float screenSize = getScreenSize(proj, this->sceneDrawBounds[drawIdx], distance);
+    geom->setLodLevel(geom->getMesh()->getLodLevel(screenSize));
+    geom->setScreenSize(screenSize);
+    packet.push(geom, distance, true);
+  }
+
+  packet.sort();
+
+  uint64_t collectEnd = SDL_GetPerformanceCounter();
+
+  this->renderThread.submit();
+
+  float msPerCount = 1000.0f / SDL_GetPerformanceFrequency();
+  this->frameTimings.animateTime = (animateEnd - frameStart) * msPerCount;
+  this->frameTimings.collectTime = (collectEnd - collectStart) * msPerCount;
+  this->frameTimings.waitTime = (collectStart - animateEnd + SDL_GetPerformanceCounter() - collectEnd) * msPerCount;
 
   State::printNextFrame = false;
 }
+
+// Occluders are picked by how large their bounds look from the eye, up to a
+// budget of draws and triangles
+static constexpr float MIN_OCCLUDER_SIZE = 0.25f;
+static constexpr unsigned MAX_OCCLUDERS = 16;
+static constexpr unsigned MAX_OCCLUDER_TRIANGLES = 16384;
+
+void SceneManager::cullOccludedDraws(const Math::Matrix& view, const Math::Matrix& projViewMtx) {
+  if (this->visibleSceneDraws.size() < 2) {
+    return;
+  }
+
+  // Bounding radius over distance, which grows with the screen area a box
+  // can cover
+  std::vector<std::pair<float, uint32_t>>& occluders = this->occluderCandidates;
+  occluders.clear();
+  for (uint32_t drawIdx : this->visibleSceneDraws) {
+    const Resource::Mesh *mesh = this->sceneDraws[drawIdx]->getMesh();
+    if (mesh->getMaterial()->isAlphaBlended()) {
+      continue;
+    }
+
+    // Nothing is known about the extent of a draw without bounds
+    const Math::AABB& bounds = this->sceneDrawBounds[drawIdx];
+    if (bounds.isEmpty()) {
+      continue;
+    }
+
+    float radius = sqrtf(bounds.extents.x * bounds.extents.x + bounds.extents.y * bounds.extents.y + bounds.extents.z * bounds.extents.z);
+    float size = radius / std::max(getViewDistance(view, bounds.center), 1e-3f);
+
+    if (size >= MIN_OCCLUDER_SIZE) {
+      occluders.push_back({ size, drawIdx });
+    }
+  }
+
+  if (occluders.empty()) {
+    return;
+  }
+
+  std::sort(occluders.begin(), occluders.end(), [](const auto& a, const auto& b) {
+    return a.first > b.first;
+  });
+
+  this->occlusionBuffer.begin(projViewMtx);
+
+  std::vector<uint32_t>& occluderDraws = this->occluderDraws;
+  occluderDraws.clear();
+  for (auto& [size, drawIdx] : occluders) {
+    if (occluderDraws.size() == MAX_OCCLUDERS || this->cullStats.occluderTriangles >= MAX_OCCLUDER_TRIANGLES) {
+      break;
+    }
+
+    const Resource::GeomObject *geom = this->sceneDraws[drawIdx];
+    this->cullStats.occluderTriangles += this->occlusionBuffer.addOccluder(geom->getMesh(), geom->getWorldTransform());
+
+    occluderDraws.push_back(drawIdx);
+  }
+
+  this->cullStats.occluders = occluderDraws.size();
+
+  // Occluders are kept whatever the buffer says about them
+  size_t kept = 0;
+  for (uint32_t drawIdx : this->visibleSceneDraws) {
+    bool isOccluder = std::find(occluderDraws.begin(), occluderDraws.end(), drawIdx) != occluderDraws.end();
+    if (isOccluder || !this->occlusionBuffer.isOccluded(this->sceneDrawBounds[drawIdx])) {
+      this->visibleSceneDraws[kept++] = drawIdx;
+    }
+  }
+
+  this->cullStats.occlusionRejected = this->visibleSceneDraws.size() - kept;
+  this->visibleSceneDraws.resize(kept);
+}
+
+void SceneManager::replay(const Render::Capture& capture, size_t frame) {
+  PROFILE_ZONE("SceneManager::replay");
+
+  this->flushPendingReleases();
+
+  uint64_t frameStart = SDL_GetPerformanceCounter();
+
+  Render::FramePacket& packet = this->renderThread.getPacket();
+
+  uint64_t collectStart = SDL_GetPerformanceCounter();
+
+  packet.replay(capture.getFrame(frame));
+
+  uint64_t collectEnd = SDL_GetPerformanceCounter();
+
+  this->renderThread.submit();
+
+  float msPerCount = 1000.0f / SDL_GetPerformanceFrequency();
+  this->frameTimings.animateTime = 0.0f;
+  this->frameTimings.collectTime = (collectEnd - collectStart) * msPerCount;
+  this->frameTimings.waitTime = (collectStart - frameStart + SDL_GetPerformanceCounter() - collectEnd) * msPerCount;
+}
@@ -17,30 +17,228 @@
 #ifndef MORTAR_SCENE_MANAGER_H
 #define MORTAR_SCENE_MANAGER_H
 
+#include <array>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <vector>
 
+#include "../anim/anim.hpp"
+#include "../anim/posecache.hpp"
+#include "../math/bounds.hpp"
+#include "../math/qts.hpp"
 #include "../resource/pool.hpp"
-#include "../resource/types/actor.hpp"
 #include "../resource/types/character.hpp"
 #include "../resource/types/scene.hpp"
 #include "../render/renderer.hpp"
+#include "../render/renderthread.hpp"
+#include "actorstore.hpp"
+#include "bvh.hpp"
+#include "occlusion.hpp"
+#include "scenefeed.hpp"
+#include "sockcamera.hpp"
 
 namespace Mortar::Scene {
+  // CPU milliseconds one frame's render() spent in each of its phases
+  struct FrameTimings {
+    // Advancing and posing the actors
+    float animateTime;
+
+    // Filling and sorting the frame packet
+    float collectTime;
+
+    // Waiting on the render thread for a free packet and to hand it over
+    float waitTime;
+  };
+
+  // Static draws in the scene, and how many each culling stage rejected in
+  // the last render()
+  struct CullStats {
+    unsigned sceneDraws;
+    unsigned frustumRejected;
+    unsigned occlusionRejected;
+
+    // Draws rasterized into the occlusion buffer, and their triangles
+    unsigned occluders;
+    unsigned occluderTriangles;
+  };
+
   class SceneManager {
     public:
       void initialize(Render::Renderer *renderer);
       void shutDown();
 
-      Resource::Actor *addActor(const Resource::Character *character, Math::Matrix worldTransform);
+      ActorStore::ActorId addActor(const Resource::Character *character, Math::Matrix worldTransform);
+
+      // Hangs a prop off one of the actor's locators, by its external index,
+      // and draws it wherever the locator goes. The mesh's model must already
+      // be registered, as the scene's and actors' models are. The actor isn't
+      // drawn again until the prop is uploaded.
+      void attach(ActorStore::ActorId actor, unsigned char locator, const Resource::Mesh *mesh);
+
+      // Drops every prop hanging off the locator
+      void detach(ActorStore::ActorId actor, unsigned char locator);
       void setScene(const Resource::Scene *scene);
 
+      // Draws a scene's parts as its load publishes them, in place of the
+      // current scene's static draws. Setting the scene once it's loaded
+      // adds its actors.
+      void streamScene(std::shared_ptr<SceneFeed> feed);
+
       void render();
 
+      // Draws a captured frame in place of the scene, leaving the actors as
+      // they are, to time the renderer on its own
+      void replay(const Render::Capture& capture, size_t frame);
+
+      // Costs of a recent frame, for the stats overlay
+      Render::RenderStats getRenderStats() const;
+
+      // As of the last render()
+      const FrameTimings& getFrameTimings() const;
+
+      // As of the last render()
+      const CullStats& getCullStats() const;
+
+      // Whether static draws hidden behind the nearest large ones are dropped
+      void setOcclusionCulling(bool enabled);
+      bool getOcclusionCulling() const;
+
+      // How opaque draws use the depth buffer; the game sets it per scene
+      void setDepthMode(Render::DepthMode depthMode);
+      Render::DepthMode getDepthMode() const;
+
     private:
-      Render::Renderer *renderer;
-      std::vector<Resource::Actor *> actors;
+      // An actor's draws are built when it's added; each frame only rewrites
+      // its palette and its kinematic meshes' transforms. The skinned draws
+      // all reference the one palette. Pose buffers are sized up front, so
+      // steady frames don't allocate.
+      //
+      // Animations advance in the clock's fixed steps. Poses are evaluated
+      // every so many steps, as the character's animation LOD sets for the
+      // actor's size on screen, and each frame blends the last two evaluations by
+      // how far it is between them. Actors outside the frustum aren't posed or drawn.
+      // Actors crossfading between clips blend a pose for each of them.
+      //
+      // The store holds what every phase walks; these are the buffers only
+      // a visible actor's own update touches, indexed the same way.
+      struct ActorDraws {
+        struct KinematicDraw {
+          Resource::GeomObject *geom;
+          unsigned jointIdx;
+        };
+
+        // One cursor per animation layer, plus the pose each layer past the
+        // first is evaluated into before it's blended
+        std::array<Animation::AnimationCursor, ActorStore::MAX_ANIMATION_LAYERS> animationCursors;
+        std::vector<Math::QTS> layerPose;
+
+        std::vector<Math::QTS> latestPose;
+        std::vector<Math::QTS> previousPose;
+        std::vector<Math::QTS> blendedPose;
+        unsigned stepsSinceUpdate = 0;
+        bool hasPose = false;
+
+        // Actors aren't drawn until all of their meshes have been uploaded,
+        // so they never appear in pieces
+        bool isResident = false;
+
+        std::vector<Math::Matrix> boneTransforms;
+        std::vector<int> jointParents;
+        Resource::SkinPalette *palette;
+
+        std::vector<Resource::GeomObject *> skinDraws;
+        std::vector<KinematicDraw> kinematicDraws;
+
+        // Only the locators with something attached are placed, each once a
+        // frame however many props it carries. They're gathered into columns
+        // so they're placed by one batched multiply of the locators'
+        // joint-relative transforms by their joints'.
+        struct Attachment {
+          Resource::GeomObject *geom;
+          unsigned locatorSlot;
+        };
+
+        std::vector<unsigned char> locators;
+        std::vector<Math::Matrix> locatorTransforms;
+        std::vector<unsigned> locatorJoints;
+        std::vector<Math::Matrix> locatorJointTransforms;
+        std::vector<Math::Matrix> locatorWorldTransforms;
+
+        std::vector<Attachment> attachments;
+      };
+
+      // Drops every actor, for a scene change
+      void clearActors();
+
+      void updateActor(ActorStore::ActorId actor, unsigned stepCount, float stepDelta, float alpha);
+      static void placeAttachments(ActorDraws& draws);
+      bool isResident(const ActorDraws& draws) const;
+
+      void flushPendingReleases();
+
+      // Draws each frame's packet while the next one is being built
+      Render::RenderThread renderThread;
+      ActorStore actors;
+      std::vector<std::unique_ptr<ActorDraws>> actorDraws;
+
+      // Actors playing the same clip in lockstep evaluate it once per frame
+      Animation::PoseCache poseCache;
       const Resource::Scene *scene;
+
+      // Backs every persistent draw, static and actor alike
       Resource::ResourcePool<Resource::GeomObject> *geomPool;
+
+      // Static scene draws, built once per scene and indexed by their world
+      // bounds. They're ordered by the centers of those bounds, which suit
+      // large meshes better than their origins do.
+      std::vector<Resource::GeomObject *> sceneDraws;
+      std::vector<Math::Vector> sceneDrawCenters;
+      std::vector<Math::AABB> sceneDrawBounds;
+      BVH sceneBvh;
+
+      // Draws whose meshes have no bounds; the tree can't hold them, so
+      // they're always visible
+      std::vector<uint32_t> unboundedSceneDraws;
+
+      void clearSceneDraws();
+      void addSceneDraws(std::span<const Resource::Instance * const> instances);
+
+      // The static draws the frustum keeps each frame. The largest-looking
+      // opaque ones are rasterized as occluders, and the rest are dropped if
+      // they're hidden behind them.
+      std::vector<uint32_t> visibleSceneDraws;
+      std::vector<std::pair<float, uint32_t>> occluderCandidates;
+      std::vector<uint32_t> occluderDraws;
+      OcclusionBuffer occlusionBuffer;
+      bool occlusionCulling = true;
+
+      void cullOccludedDraws(const Math::Matrix& view, const Math::Matrix& projViewMtx);
+
+      // A scene being streamed, and the scene once its splines are in. The
+      // index is rebuilt each frame new instances arrive.
+      std::shared_ptr<SceneFeed> sceneFeed;
+      const Resource::Scene *streamedScene = nullptr;
+
+      void updateSceneFeed();
+
+      Render::DepthMode depthMode = Render::DepthMode::STATE_SORTED;
+
+      // Places the camera for the first player each frame
+      void updateCamera(const Math::Vector& target);
+
+      SockCamera sockCamera;
+      ActorStore::ActorId cameraTarget = ActorStore::NO_ACTOR;
+
+      // Evictions can happen on loader threads, but GPU objects can only be
+      // freed on the render thread, so they wait here for the next frame
+      // along with the evicted loads' memory
+      std::mutex pendingReleasesMutex;
+      std::vector<Resource::ResourceHandle> pendingReleases;
+      std::vector<std::shared_ptr<void>> pendingRetirements;
+
+      FrameTimings frameTimings {};
+      CullStats cullStats {};
   };
 }
 
@@ -0,0 +1,212 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "occlusion.hpp"
+
+using namespace Mortar::Scene;
+
+// Points this close to the eye plane, or behind it, can't be projected
+static constexpr float MIN_CLIP_W = 1e-4f;
+
+void OcclusionBuffer::begin(const Math::Matrix& projViewMtx) {
+  this->projViewMtx = projViewMtx;
+  std::fill(this->depth.begin(), this->depth.end(), FLT_MAX);
+}
+
+OcclusionBuffer::ScreenVertex OcclusionBuffer::project(const float position[3], const Math::Matrix& transform) const {
+  float clip[4];
+  for (int i = 0; i < 4; i++) {
+    clip[i] = position[0] * transform.m[0][i] + position[1] * transform.m[1][i] + position[2] * transform.m[2][i] + transform.m[3][i];
+  }
+
+  if (clip[3] < MIN_CLIP_W) {
+    return { 0.0f, 0.0f, 0.0f, true };
+  }
+
+  float invW = 1.0f / clip[3];
+
+  return {
+    (clip[0] * invW * 0.5f + 0.5f) * WIDTH,
+    (clip[1] * invW * 0.5f + 0.5f) * HEIGHT,
+    clip[2] * invW,
+    false,
+  };
+}
+
+void OcclusionBuffer::rasterize(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c) {
+  float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+  if (area == 0.0f || !isfinite(area)) {
+    return;
+  }
+
+  // Both windings count, so edge weights are made positive inside
+  float invArea = 1.0f / area;
+
+  int minX = std::max((int)floorf(std::min({ a.x, b.x, c.x })), 0);
+  int maxX = std::min((int)ceilf(std::max({ a.x, b.x, c.x })), (int)WIDTH - 1);
+  int minY = std::max((int)floorf(std::min({ a.y, b.y, c.y })), 0);
+  int maxY = std::min((int)ceilf(std::max({ a.y, b.y, c.y })), (int)HEIGHT - 1);
+
+  // Edge weights and depth step linearly across the screen. Pixels only
+  // count if their whole square is inside, which holds when each weight at
+  // the center clears half its change across the square, and they take the
+  // farthest depth in it.
+  float dw0dx = (b.y - c.y) * invArea, dw0dy = (c.x - b.x) * invArea;
+  float dw1dx = (c.y - a.y) * invArea, dw1dy = (a.x - c.x) * invArea;
+  float dw2dx = -dw0dx - dw1dx, dw2dy = -dw0dy - dw1dy;
+
+  float margin0 = 0.5f * (fabsf(dw0dx) + fabsf(dw0dy));
+  float margin1 = 0.5f * (fabsf(dw1dx) + fabsf(dw1dy));
+  float margin2 = 0.5f * (fabsf(dw2dx) + fabsf(dw2dy));
+
+  float dzdx = dw0dx * a.z + dw1dx * b.z + dw2dx * c.z;
+  float dzdy = dw0dy * a.z + dw1dy * b.z + dw2dy * c.z;
+  float zMargin = 0.5f * (fabsf(dzdx) + fabsf(dzdy));
+
+  for (int y = minY; y <= maxY; y++) {
+    float py = y + 0.5f;
+    float *row = this->depth.data() + y * WIDTH;
+
+    for (int x = minX; x <= maxX; x++) {
+      float px = x + 0.5f;
+
+      float w0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) * invArea;
+      float w1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) * invArea;
+      float w2 = 1.0f - w0 - w1;
+
+      if (w0 < margin0 || w1 < margin1 || w2 < margin2) {
+        continue;
+      }
+
+      // NDC depth is linear across the screen
+      float z = w0 * a.z + w1 * b.z + w2 * c.z + zMargin;
+      row[x] = std::min(row[x], z);
+    }
+  }
+}
+
+size_t OcclusionBuffer::addOccluder(const Resource::Mesh *mesh, const Math::Matrix& worldTransform) {
+  const Resource::VertexLayout& layout = mesh->getVertexLayout();
+  const Resource::VertexBuffer *vertexBuffer = mesh->getVertexBuffer();
+
+  std::span<const Resource::VertexLayout::VertexProperty> properties = layout.getProperties();
+  auto position = std::find_if(properties.begin(), properties.end(), [](const auto& property) {
+    return property.getUsage() == Resource::VertexUsage::POSITION;
+  });
+
+  size_t stride = layout.getStride();
+  if (position == properties.end() || position->getDataType() != Resource::VertexDataType::VEC3 || !vertexBuffer || !vertexBuffer->getData() || !stride) {
+    return 0;
+  }
+
+  size_t vertexCount = vertexBuffer->getSize() / stride;
+  const uint8_t *positions = vertexBuffer->getData() + position->getOffset();
+
+  Math::Matrix transform = worldTransform * this->projViewMtx;
+
+  size_t triangleCount = 0;
+  for (auto surface : mesh->getSurfaces()) {
+    const Resource::IndexBuffer *indexBuffer = surface->getIndexBuffer();
+    if (surface->getPrimitiveType() != Resource::PrimitiveType::TRIANGLE_LIST || !indexBuffer->getData()) {
+      continue;
+    }
+
+    const uint16_t *indices = indexBuffer->getData();
+    for (unsigned i = 0; i + 2 < indexBuffer->getCount(); i += 3) {
+      ScreenVertex vertices[3];
+      bool isClipped = false;
+
+      for (int j = 0; j < 3; j++) {
+        if (indices[i + j] >= vertexCount) {
+          isClipped = true;
+          break;
+        }
+
+        float vertex[3];
+        memcpy(vertex, positions + indices[i + j] * stride, sizeof(vertex));
+
+        vertices[j] = this->project(vertex, transform);
+        isClipped |= vertices[j].isClipped;
+      }
+
+      // Triangles crossing the eye plane are left out rather than clipped,
+      // which only ever hides less
+      if (isClipped) {
+        continue;
+      }
+
+      this->rasterize(vertices[0], vertices[1], vertices[2]);
+      triangleCount++;
+    }
+  }
+
+  return triangleCount;
+}
+
+bool OcclusionBuffer::isOccluded(const Math::AABB& bounds) const {
+  if (bounds.isEmpty()) {
+    return false;
+  }
+
+  float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+  float maxX = -FLT_MAX, maxY = -FLT_MAX;
+
+  for (int i = 0; i < 8; i++) {
+    float corner[3] = {
+      bounds.center.x + ((i & 1) ? bounds.extents.x : -bounds.extents.x),
+      bounds.center.y + ((i & 2) ? bounds.extents.y : -bounds.extents.y),
+      bounds.center.z + ((i & 4) ? bounds.extents.z : -bounds.extents.z),
+    };
+
+    ScreenVertex vertex = this->project(corner, this->projViewMtx);
+    if (vertex.isClipped) {
+      return false;
+    }
+
+    minX = std::min(minX, vertex.x);
+    maxX = std::max(maxX, vertex.x);
+    minY = std::min(minY, vertex.y);
+    maxY = std::max(maxY, vertex.y);
+    minZ = std::min(minZ, vertex.z);
+  }
+
+  // Every pixel the rectangle touches has to be nearer than the box
+  int x0 = std::max((int)floorf(minX), 0);
+  int x1 = std::min((int)ceilf(maxX) - 1, (int)WIDTH - 1);
+  int y0 = std::max((int)floorf(minY), 0);
+  int y1 = std::min((int)ceilf(maxY) - 1, (int)HEIGHT - 1);
+
+  if (x0 > x1 || y0 > y1) {
+    return false;
+  }
+
+  for (int y = y0; y <= y1; y++) {
+    const float *row = this->depth.data() + y * WIDTH;
+
+    for (int x = x0; x <= x1; x++) {
+      if (row[x] >= minZ) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,72 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_SCENE_OCCLUSION_H
+#define MORTAR_SCENE_OCCLUSION_H
+
+#include <vector>
+
+#include "../math/bounds.hpp"
+#include "../math/matrix.hpp"
+#include "../resource/types/mesh.hpp"
+
+namespace Mortar::Scene {
+  // A small depth buffer the CPU rasterizes a frame's biggest occluders
+  // into, so boxes wholly behind them can be dropped before they're drawn.
+  // Occluders only cover the pixels they cover wholly, at the farthest
+  // depth they reach in them, and each pixel keeps the nearest depth
+  // written to it. A box is occluded only if its nearest point is behind
+  // every pixel its screen rectangle touches, so it's never culled where an
+  // occluder merely grazes it.
+  class OcclusionBuffer {
+    public:
+      static constexpr unsigned WIDTH = 256;
+      static constexpr unsigned HEIGHT = 128;
+
+      OcclusionBuffer()
+        : depth(WIDTH * HEIGHT) {};
+
+      // Clears the buffer for a frame seen through the clip transform, for
+      // row vectors
+      void begin(const Math::Matrix& projViewMtx);
+
+      // Rasterizes a mesh's triangle lists; meshes without CPU-side
+      // positions are skipped. Returns the number of triangles drawn.
+      size_t addOccluder(const Resource::Mesh *mesh, const Math::Matrix& worldTransform);
+
+      // Whether nothing of the box, in world space, can be seen past the
+      // occluders drawn so far. Boxes reaching behind the eye never are.
+      bool isOccluded(const Math::AABB& bounds) const;
+
+    private:
+      // A vertex after the clip transform and divide, in pixels, with NDC
+      // depth; unprojectable ones are flagged
+      struct ScreenVertex {
+        float x;
+        float y;
+        float z;
+        bool isClipped;
+      };
+
+      ScreenVertex project(const float position[3], const Math::Matrix& transform) const;
+      void rasterize(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c);
+
+      Math::Matrix projViewMtx;
+      std::vector<float> depth;
+  };
+}
+
+#endif
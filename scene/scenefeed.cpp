@@ -0,0 +1,61 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <mutex>
+#include <utility>
+
+#include "scenefeed.hpp"
+
+using namespace Mortar::Scene;
+
+void SceneFeed::publishSplines(const Resource::Scene *scene) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->pending.scene = scene;
+}
+
+void SceneFeed::publishTextures(const std::vector<Resource::Texture *>& textures) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->pending.textures.insert(this->pending.textures.end(), textures.begin(), textures.end());
+}
+
+void SceneFeed::publishVertexBuffers(const std::vector<Resource::VertexBuffer *>& vertexBuffers) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->pending.vertexBuffers.insert(this->pending.vertexBuffers.end(), vertexBuffers.begin(), vertexBuffers.end());
+}
+
+void SceneFeed::publishMeshes(const std::vector<Resource::Mesh *>& meshes, const std::vector<Resource::Instance *>& instances) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->pending.meshes.insert(this->pending.meshes.end(), meshes.begin(), meshes.end());
+  this->pending.instances.insert(this->pending.instances.end(), instances.begin(), instances.end());
+}
+
+void SceneFeed::retain(Resource::LoadContext& context) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (!this->retained) {
+    this->retained = std::make_unique<Resource::LoadContext>(context.getResourceManager());
+  }
+
+  this->retained->absorb(context);
+}
+
+SceneFeed::Update SceneFeed::take() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  Update update = std::move(this->pending);
+  this->pending = Update();
+
+  return update;
+}
@@ -0,0 +1,71 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_SCENE_SCENEFEED_H
+#define MORTAR_SCENE_SCENEFEED_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../resource/loadcontext.hpp"
+#include "../resource/types/instance.hpp"
+#include "../resource/types/mesh.hpp"
+#include "../resource/types/scene.hpp"
+#include "../resource/types/texture.hpp"
+#include "../resource/types/vertex.hpp"
+
+namespace Mortar::Scene {
+  // Hands parts of a scene over as its loader reads them, so the scene can
+  // be drawn before the load is done. The loader publishes from whichever
+  // thread read each part, and the scene manager takes them each frame.
+  // Published resources are still staged; they're committed with the rest of
+  // the load, or kept by the feed if it fails.
+  class SceneFeed {
+    public:
+      struct Update {
+        // Set once the scene's splines have all been read
+        const Resource::Scene *scene = nullptr;
+
+        std::vector<const Resource::Texture *> textures;
+        std::vector<const Resource::VertexBuffer *> vertexBuffers;
+        std::vector<const Resource::Mesh *> meshes;
+
+        // Only published once all of their meshes have been
+        std::vector<const Resource::Instance *> instances;
+      };
+
+      void publishSplines(const Resource::Scene *scene);
+      void publishTextures(const std::vector<Resource::Texture *>& textures);
+      void publishVertexBuffers(const std::vector<Resource::VertexBuffer *>& vertexBuffers);
+      void publishMeshes(const std::vector<Resource::Mesh *>& meshes, const std::vector<Resource::Instance *>& instances);
+
+      // Takes over what a failed load staged, as some of it may already be
+      // drawn. It's freed with the feed.
+      void retain(Resource::LoadContext& context);
+
+      // Everything published since the last call
+      Update take();
+
+    private:
+      std::mutex mutex;
+      Update pending;
+
+      std::unique_ptr<Resource::LoadContext> retained;
+  };
+}
+
+#endif
@@ -0,0 +1,205 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <stdio.h>
+#include <vector>
+
+#include "../profiler.hpp"
+#include "sockcamera.hpp"
+
+using namespace Mortar::Scene;
+
+static void calculateSplineExtrema(const Mortar::Math::Vector& vertex, Mortar::Math::Vector& minima, Mortar::Math::Vector& maxima) {
+  minima.x = fmin(minima.x, vertex.x);
+  minima.y = fmin(minima.y, vertex.y);
+  minima.z = fmin(minima.z, vertex.z);
+
+  maxima.x = fmax(maxima.x, vertex.x);
+  maxima.y = fmax(maxima.y, vertex.y);
+  maxima.z = fmax(maxima.z, vertex.z);
+}
+
+static float getValue(const Mortar::Math::Vector& lookAt, const Mortar::Math::Vector& a, const Mortar::Math::Vector& b) {
+  // XXX: Currently do not understand the geometric significance of this blend calculation
+  float angle;
+  if (a.z - b.z == 0.0f) {
+    angle = 0.0f;
+  }
+  angle = atan((a.x - b.x) / (a.z - b.z));
+
+  return fabs((lookAt.x - b.x) * cos(-angle) + (lookAt.z - b.z) * sin(-angle));
+}
+
+void SockCamera::build(const Resource::Scene *scene) {
+  this->clear();
+
+  for (int i = 0; i < 0x20; i++) {
+    char nameBuf[32];
+    sprintf(nameBuf, "sock_cam_%.2d", i);
+
+    const Resource::Spline *camSpline = scene->getSplineByName(nameBuf);
+    if (camSpline == nullptr) {
+      continue;
+    }
+
+    size_t vertexCount = camSpline->getVertexCount();
+
+    sprintf(nameBuf, "sock_a_%.2d", i);
+    const Resource::Spline *aSpline = scene->getSplineByName(nameBuf);
+
+    sprintf(nameBuf, "sock_b_%.2d", i);
+    const Resource::Spline *bSpline = scene->getSplineByName(nameBuf);
+
+    if (aSpline == nullptr || bSpline == nullptr || (aSpline->getVertexCount() != vertexCount && bSpline->getVertexCount() != vertexCount)) {
+      continue;
+    }
+
+    sprintf(nameBuf, "sock_mid_%.2d", i);
+    const Resource::Spline *midSpline = scene->getSplineByName(nameBuf);
+
+    unsigned sockIdx = this->socks.size();
+    this->socks.push_back({ static_cast<unsigned>(i), camSpline, aSpline, bSpline, midSpline });
+
+    // XXX: Factor in C and D splines
+    for (size_t j = 0; j + 1 < vertexCount; j++) {
+      Math::Vector minima { INFINITY, INFINITY, INFINITY, 1.0f };
+      Math::Vector maxima { -INFINITY, -INFINITY, -INFINITY, 1.0f };
+
+      for (size_t k = j; k <= j + 1; k++) {
+        calculateSplineExtrema(aSpline->getVertex(k), minima, maxima);
+        calculateSplineExtrema(bSpline->getVertex(k), minima, maxima);
+      }
+
+      this->segments.push_back({ sockIdx, static_cast<unsigned>(j), Math::AABB::fromMinMax(minima, maxima), 0, 0 });
+    }
+  }
+
+  // A later segment can only decide for a target inside an earlier one if
+  // their bounds meet. Scenes have a few hundred segments at most, so
+  // testing every pair once is cheap.
+  for (uint32_t i = 0; i < this->segments.size(); i++) {
+    Segment& segment = this->segments[i];
+    segment.firstOverlap = this->laterOverlaps.size();
+
+    for (uint32_t j = i + 1; j < this->segments.size(); j++) {
+      if (segment.bounds.intersects(this->segments[j].bounds)) {
+        this->laterOverlaps.push_back(j);
+      }
+    }
+
+    segment.overlapCount = this->laterOverlaps.size() - segment.firstOverlap;
+  }
+
+  std::vector<Math::AABB> segmentBounds;
+  for (auto& segment : this->segments) {
+    segmentBounds.push_back(segment.bounds);
+  }
+
+  this->bvh.build(segmentBounds);
+}
+
+void SockCamera::clear() {
+  this->socks.clear();
+  this->segments.clear();
+  this->laterOverlaps.clear();
+  this->bvh.clear();
+
+  this->currentSegment = NO_SEGMENT;
+  this->position = Math::Vector();
+}
+
+uint32_t SockCamera::resolve(uint32_t segmentIdx, const Math::Vector& target) const {
+  const Segment& segment = this->segments[segmentIdx];
+  uint32_t last = segmentIdx;
+
+  for (uint32_t i = segment.firstOverlap; i < segment.firstOverlap + segment.overlapCount; i++) {
+    uint32_t overlapIdx = this->laterOverlaps[i];
+    if (this->segments[overlapIdx].bounds.contains(target)) {
+      last = std::max(last, overlapIdx);
+    }
+  }
+
+  return last;
+}
+
+uint32_t SockCamera::findSegment(const Math::Vector& target) const {
+  // Targets mostly stay in their segment or cross into a neighbour
+  if (this->currentSegment != NO_SEGMENT) {
+    for (int64_t offset : { 0, 1, -1 }) {
+      int64_t candidate = this->currentSegment + offset;
+      if (candidate < 0 || candidate >= static_cast<int64_t>(this->segments.size())) {
+        continue;
+      }
+
+      if (this->segments[candidate].bounds.contains(target)) {
+        return this->resolve(candidate, target);
+      }
+    }
+  }
+
+  uint32_t last = NO_SEGMENT;
+  this->bvh.query(target, [&](uint32_t segmentIdx) {
+    if (last == NO_SEGMENT || segmentIdx > last) {
+      last = segmentIdx;
+    }
+  });
+
+  return last;
+}
+
+Mortar::Math::Vector SockCamera::getPosition(const Segment& segment, const Math::Vector& target) const {
+  const Sock& sock = this->socks[segment.sock];
+  unsigned j = segment.segment;
+
+  // XXX: Don't fully understand the calculation of the blend value here
+  float start = getValue(target, sock.aSpline->getVertex(j), sock.bSpline->getVertex(j));
+  float end = getValue(target, sock.aSpline->getVertex(j + 1), sock.bSpline->getVertex(j + 1));
+  float blend = start / (start + end);
+
+  const Math::Vector& camStartVertex = sock.camSpline->getVertex(j);
+  Math::Vector camPos = (sock.camSpline->getVertex(j + 1) - camStartVertex) * blend + camStartVertex;
+
+  // Use the mid spline to provide an upper limit on Y
+  // XXX: Read Y-limiting flag from scene config
+  if (sock.midSpline == nullptr || sock.midSpline->getVertexCount() != sock.camSpline->getVertexCount()) {
+    // XXX: Don't have a way to deal with this right now
+    throw std::runtime_error("missing or invalid mid spline");
+  }
+
+  const Math::Vector& midStartVertex = sock.midSpline->getVertex(j);
+  Math::Vector midBlended = (sock.midSpline->getVertex(j + 1) - midStartVertex) * blend + midStartVertex;
+
+  camPos.y = fmax(camPos.y, fmin(1.2f, midBlended.y));
+
+  return camPos;
+}
+
+Mortar::Math::Vector SockCamera::update(const Math::Vector& target) {
+  PROFILE_ZONE("SockCamera::update");
+
+  uint32_t segmentIdx = this->findSegment(target);
+  if (segmentIdx == NO_SEGMENT) {
+    return this->position;
+  }
+
+  this->currentSegment = segmentIdx;
+  this->position = this->getPosition(this->segments[segmentIdx], target);
+
+  return this->position;
+}
@@ -0,0 +1,87 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_SCENE_SOCKCAMERA_H
+#define MORTAR_SCENE_SOCKCAMERA_H
+
+#include <cstdint>
+#include <vector>
+
+#include "../math/bounds.hpp"
+#include "../math/matrix.hpp"
+#include "../resource/types/scene.hpp"
+#include "../resource/types/spline.hpp"
+#include "bvh.hpp"
+
+namespace Mortar::Scene {
+  // Places the camera from a scene's camera socks. A sock is a run of
+  // segments between its a and b splines; a target inside a segment puts the
+  // camera on the cam spline between the segment's ends, as far along as the
+  // target is between them. Where segments overlap, the last in sock then
+  // segment order decides.
+  //
+  // The segments are indexed once per scene, along with the later segments
+  // each one overlaps. Updates start from the segment the target was last
+  // in, so a target moving within or into the next segment costs a few box
+  // tests, and only one that jumps away searches the index.
+  class SockCamera {
+    public:
+      void build(const Resource::Scene *scene);
+      void clear();
+
+      // Where the camera goes for the target. Outside every sock it stays
+      // where it last was, at the origin to begin with.
+      Math::Vector update(const Math::Vector& target);
+
+    private:
+      static constexpr uint32_t NO_SEGMENT = UINT32_MAX;
+
+      struct Sock {
+        unsigned index;
+        const Resource::Spline *camSpline;
+        const Resource::Spline *aSpline;
+        const Resource::Spline *bSpline;
+        const Resource::Spline *midSpline;
+      };
+
+      struct Segment {
+        unsigned sock;
+        unsigned segment;
+        Math::AABB bounds;
+
+        // Run of laterOverlaps holding the later segments whose bounds meet
+        // these
+        uint32_t firstOverlap;
+        uint32_t overlapCount;
+      };
+
+      // The segment that decides for a target inside the given one
+      uint32_t resolve(uint32_t segmentIdx, const Math::Vector& target) const;
+      uint32_t findSegment(const Math::Vector& target) const;
+
+      Math::Vector getPosition(const Segment& segment, const Math::Vector& target) const;
+
+      std::vector<Sock> socks;
+      std::vector<Segment> segments;
+      std::vector<uint32_t> laterOverlaps;
+      BVH bvh;
+
+      uint32_t currentSegment = NO_SEGMENT;
+      Math::Vector position;
+  };
+}
+
+#endif
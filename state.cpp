@@ -18,22 +18,27 @@
 
 #include "clock.hpp"
 #include "display.hpp"
+#include "jobs/jobsystem.hpp"
 #include "state.hpp"
 #include "resource/manager.hpp"
 #include "scene/manager.hpp"
+#include "telemetry.hpp"
 
 using namespace Mortar;
 
 Camera State::camera = Camera();
 Clock State::clock = Clock();
 DisplayManager State::displayManager = DisplayManager();
+Jobs::JobSystem State::jobSystem;
 Resource::ResourceManager State::resourceManager = Resource::ResourceManager();
 Scene::SceneManager State::sceneManager = Scene::SceneManager();
+Telemetry State::telemetry;
 
 float State::animRate = 1.0f;
 bool State::animEnabled = true;
 bool State::printNextFrame = false;
 State::InterpolateType State::interpolate = InterpolateType::HERMITE;
+float State::animTolerance = 0.0005f;
 
 Camera& State::getCamera() {
   return State::camera;
@@ -47,6 +52,10 @@ DisplayManager& State::getDisplayManager() {
   return State::displayManager;
 }
 
+Jobs::JobSystem& State::getJobSystem() {
+  return State::jobSystem;
+}
+
 Resource::ResourceManager& State::getResourceManager() {
   return State::resourceManager;
 }
@@ -54,3 +63,7 @@ Resource::ResourceManager& State::getResourceManager() {
 Scene::SceneManager& State::getSceneManager() {
   return State::sceneManager;
 }
+
+Telemetry& State::getTelemetry() {
+  return State::telemetry;
+}
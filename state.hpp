@@ -20,8 +20,10 @@
 #include "camera.hpp"
 #include "clock.hpp"
 #include "display.hpp"
+#include "jobs/jobsystem.hpp"
 #include "resource/manager.hpp"
 #include "scene/manager.hpp"
+#include "telemetry.hpp"
 
 namespace Mortar {
   class State {
@@ -29,8 +31,10 @@ namespace Mortar {
       static Clock& getClock();
       static Camera& getCamera();
       static DisplayManager& getDisplayManager();
+      static Jobs::JobSystem& getJobSystem();
       static Resource::ResourceManager& getResourceManager();
       static Scene::SceneManager& getSceneManager();
+      static Telemetry& getTelemetry();
 
       enum class InterpolateType {
         NONE,
@@ -41,13 +45,16 @@ namespace Mortar {
       static bool animEnabled;
       static bool printNextFrame;
       static InterpolateType interpolate;
+      static float animTolerance;
 
     private:
       static Camera camera;
       static Clock clock;
       static DisplayManager displayManager;
+      static Jobs::JobSystem jobSystem;
       static Resource::ResourceManager resourceManager;
       static Scene::SceneManager sceneManager;
+      static Telemetry telemetry;
   };
 }
 
@@ -0,0 +1,222 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <SDL2/SDL_endian.h>
+#include <fstream>
+#include <string.h>
+
+#include "bufferedstream.hpp"
+
+BufferedStream::BufferedStream(Stream& source, size_t blockSize) : Stream() {
+  if (blockSize == 0) {
+    throw std::ifstream::failure("block size must not be zero");
+  }
+
+  this->source = &source;
+  this->buffer.resize(blockSize);
+  this->bufferLength = 0;
+
+  this->sourcePosition = source.tell();
+  this->bufferStart = this->sourcePosition;
+  this->position = this->sourcePosition;
+}
+
+BufferedStream::BufferedStream(std::unique_ptr<Stream> source, size_t blockSize)
+  : BufferedStream(*source, blockSize) {
+  this->ownedSource = std::move(source);
+}
+
+size_t BufferedStream::fill(size_t wanted) {
+  long bufferEnd = this->bufferStart + (long)this->bufferLength;
+
+  size_t available = 0;
+  if (this->position >= this->bufferStart && this->position <= bufferEnd) {
+    available = bufferEnd - this->position;
+    if (available >= wanted) {
+      return available;
+    }
+
+    // Keep the unread tail and top up behind it
+    memmove(this->buffer.data(), this->buffer.data() + (this->position - this->bufferStart), available);
+  }
+
+  this->bufferStart = this->position;
+  this->bufferLength = available;
+
+  long readFrom = this->bufferStart + (long)available;
+  if (this->sourcePosition != readFrom) {
+    this->source->seek(readFrom, SEEK_SET);
+    this->sourcePosition = readFrom;
+  }
+
+  size_t got = this->source->read(this->buffer.data() + available, 1, this->buffer.size() - available);
+  this->sourcePosition += got;
+  this->bufferLength += got;
+
+  return this->bufferLength;
+}
+
+const uint8_t *BufferedStream::take(size_t size) {
+  if (this->fill(size) < size) {
+    throw std::ifstream::failure("read past end of stream");
+  }
+
+  const uint8_t *ptr = this->buffer.data() + (this->position - this->bufferStart);
+  this->position += size;
+
+  return ptr;
+}
+
+size_t BufferedStream::read(void *ptr, size_t size, size_t count) {
+  if (size == 0) {
+    return 0;
+  }
+
+  uint8_t *out = static_cast<uint8_t *>(ptr);
+  size_t total = size * count;
+  size_t copied = 0;
+
+  while (copied < total) {
+    size_t remaining = total - copied;
+
+    // Block-sized reads would only be copied through the buffer, so once
+    // what's buffered is used up they go straight to the source
+    long bufferEnd = this->bufferStart + (long)this->bufferLength;
+    bool buffered = this->position >= this->bufferStart && this->position < bufferEnd;
+    if (!buffered && remaining >= this->buffer.size()) {
+      if (this->sourcePosition != this->position) {
+        this->source->seek(this->position, SEEK_SET);
+      }
+
+      size_t got = this->source->read(out + copied, 1, remaining);
+      this->position += got;
+      this->sourcePosition = this->position;
+      copied += got;
+      break;
+    }
+
+    size_t available = this->fill(1);
+    if (available == 0) {
+      break;
+    }
+
+    size_t chunk = available < remaining ? available : remaining;
+    memcpy(out + copied, this->buffer.data() + (this->position - this->bufferStart), chunk);
+    this->position += chunk;
+    copied += chunk;
+  }
+
+  return copied / size;
+}
+
+int8_t BufferedStream::readInt8() {
+  return static_cast<int8_t>(this->readUint8());
+}
+
+int16_t BufferedStream::readInt16() {
+  return static_cast<int16_t>(this->readUint16());
+}
+
+int32_t BufferedStream::readInt32() {
+  return static_cast<int32_t>(this->readUint32());
+}
+
+uint8_t BufferedStream::readUint8() {
+  return *this->take(sizeof(uint8_t));
+}
+
+uint16_t BufferedStream::readUint16() {
+  uint16_t val;
+  memcpy(&val, this->take(sizeof(uint16_t)), sizeof(uint16_t));
+
+  return SDL_SwapLE16(val);
+}
+
+uint32_t BufferedStream::readUint32() {
+  uint32_t val;
+  memcpy(&val, this->take(sizeof(uint32_t)), sizeof(uint32_t));
+
+  return SDL_SwapLE32(val);
+}
+
+float BufferedStream::readFloat() {
+  float val;
+  memcpy(&val, this->take(sizeof(float)), sizeof(float));
+
+  return val;
+}
+
+void BufferedStream::readString(std::string& string) {
+  string.clear();
+
+  while (true) {
+    size_t available = this->fill(1);
+    if (available == 0) {
+      throw std::ifstream::failure("unterminated string");
+    }
+
+    const uint8_t *start = this->buffer.data() + (this->position - this->bufferStart);
+    const void *end = memchr(start, '\0', available);
+
+    size_t length = end == nullptr ? available : static_cast<const uint8_t *>(end) - start;
+    string.append(reinterpret_cast<const char *>(start), length);
+
+    if (end != nullptr) {
+      this->position += length + 1;
+      break;
+    }
+
+    this->position += length;
+  }
+}
+
+void BufferedStream::seek(long offset, int whence) {
+  long target;
+  switch (whence) {
+    case SEEK_SET:
+      target = offset;
+      break;
+    case SEEK_CUR:
+      target = this->position + offset;
+      break;
+    case SEEK_END:
+      // Only the source knows where it ends
+      this->source->seek(offset, SEEK_END);
+      this->sourcePosition = this->source->tell();
+      target = this->sourcePosition;
+      break;
+    default:
+      throw std::ifstream::failure("invalid seek origin");
+  }
+
+  this->position = target < 0 ? 0 : target;
+}
+
+long BufferedStream::tell() {
+  return this->position;
+}
+
+const uint8_t *BufferedStream::data() const {
+  return this->source->data();
+}
+
+size_t BufferedStream::size() const {
+  return this->source->size();
+}
+
+std::shared_ptr<const void> BufferedStream::getBacking() const {
+  return this->source->getBacking();
+}
@@ -0,0 +1,83 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_BUFFEREDSTREAM_H
+#define MORTAR_BUFFEREDSTREAM_H
+
+#include <memory>
+#include <vector>
+
+#include "stream.hpp"
+
+// BufferedStream reads its source a block at a time, so the per-field reads
+// the format readers issue are served from memory instead of one SDL_RWread
+// each. Seeks only move a logical cursor; short hops over padding or unused
+// fields that land inside the current block never touch the source.
+class BufferedStream : public Stream {
+  public:
+    static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+    // The source must outlive the buffered stream
+    BufferedStream(Stream& source, size_t blockSize = DEFAULT_BLOCK_SIZE);
+    BufferedStream(std::unique_ptr<Stream> source, size_t blockSize = DEFAULT_BLOCK_SIZE);
+
+    BufferedStream(const BufferedStream&) = delete;
+    BufferedStream& operator=(const BufferedStream&) = delete;
+
+    size_t read(void *ptr, size_t size, size_t count) override;
+
+    int8_t readInt8() override;
+    int16_t readInt16() override;
+    int32_t readInt32() override;
+
+    uint8_t readUint8() override;
+    uint16_t readUint16() override;
+    uint32_t readUint32() override;
+
+    float readFloat() override;
+    void readString(std::string& string) override;
+
+    void seek(long offset, int whence) override;
+    long tell() override;
+
+    // Memory-backed sources are passed through so views still work
+    const uint8_t *data() const override;
+    size_t size() const override;
+    std::shared_ptr<const void> getBacking() const override;
+
+  private:
+    // Returns the number of buffered bytes available at the cursor, reading
+    // ahead from the source if fewer than wanted are available
+    size_t fill(size_t wanted);
+
+    // Returns a pointer to size contiguous bytes at the cursor and advances
+    // past them
+    const uint8_t *take(size_t size);
+
+    std::unique_ptr<Stream> ownedSource;
+    Stream *source;
+
+    std::vector<uint8_t> buffer;
+    size_t bufferLength;
+
+    // Absolute source offsets of the first buffered byte, of the logical
+    // cursor and of the source's own cursor
+    long bufferStart;
+    long position;
+    long sourcePosition;
+};
+
+#endif
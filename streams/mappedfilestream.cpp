@@ -0,0 +1,117 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <SDL2/SDL_error.h>
+#include <SDL2/SDL_rwops.h>
+#include <fstream>
+#include <stdlib.h>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MORTAR_HAVE_MMAP
+#endif
+
+#ifdef MORTAR_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfilestream.hpp"
+#include "pathresolver.hpp"
+
+#ifdef MORTAR_HAVE_MMAP
+MappedFileStream::MappedFileStream(const char *path) : MemoryStream() {
+  std::string resolvedPath = PathResolver::resolve(path);
+
+  int fd = open(resolvedPath.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::ifstream::failure("unable to open file");
+  }
+
+  struct stat results;
+  if (fstat(fd, &results) != 0) {
+    close(fd);
+    throw std::ifstream::failure("cannot access file");
+  }
+
+  size_t size = results.st_size;
+
+  // mmap rejects zero-length mappings, but an empty file is still a valid
+  // (empty) stream
+  std::shared_ptr<const void> image;
+  if (size > 0) {
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      throw std::ifstream::failure("unable to map file");
+    }
+
+    // Readers hop between header tables and bodies, so ask for the whole file
+    // to be paged in rather than relying on sequential readahead
+    madvise(mapping, size, MADV_WILLNEED);
+
+    image = std::shared_ptr<const void>(mapping, [size] (const void *ptr) {
+      munmap(const_cast<void *>(ptr), size);
+    });
+  }
+
+  // The mapping holds its own reference to the file
+  close(fd);
+
+  this->setBuffer(static_cast<const uint8_t *>(image.get()), size, image);
+}
+#else
+MappedFileStream::MappedFileStream(const char *path) : MemoryStream() {
+  std::string resolvedPath = PathResolver::resolve(path);
+
+  SDL_RWops *file = SDL_RWFromFile(resolvedPath.c_str(), "rb");
+  if (file == nullptr) {
+    throw std::ifstream::failure(SDL_GetError());
+  }
+
+  Sint64 fileSize = SDL_RWsize(file);
+  if (fileSize < 0) {
+    SDL_RWclose(file);
+    throw std::ifstream::failure(SDL_GetError());
+  }
+
+  size_t size = fileSize;
+
+  std::shared_ptr<const void> image;
+  if (size > 0) {
+    void *buffer = malloc(size);
+    if (buffer == nullptr) {
+      SDL_RWclose(file);
+      throw std::ifstream::failure("unable to allocate memory");
+    }
+
+    image = std::shared_ptr<const void>(buffer, [] (const void *ptr) {
+      free(const_cast<void *>(ptr));
+    });
+
+    if (SDL_RWread(file, buffer, 1, size) != size) {
+      SDL_RWclose(file);
+      throw std::ifstream::failure("short read");
+    }
+  }
+
+  SDL_RWclose(file);
+
+  this->setBuffer(static_cast<const uint8_t *>(image.get()), size, image);
+}
+#endif
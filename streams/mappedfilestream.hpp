@@ -0,0 +1,34 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_MAPPEDFILESTREAM_H
+#define MORTAR_MAPPEDFILESTREAM_H
+
+#include "memorystream.hpp"
+
+// MappedFileStream maps a whole file read-only into memory and serves reads
+// straight out of the mapping. On platforms without mmap, the file is read
+// into a heap buffer up front instead. The mapping is released once the stream
+// and every resource holding its backing are gone.
+class MappedFileStream : public MemoryStream {
+  public:
+    MappedFileStream(const char *path);
+
+    MappedFileStream(const MappedFileStream&) = delete;
+    MappedFileStream& operator=(const MappedFileStream&) = delete;
+};
+
+#endif
@@ -14,10 +14,144 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <SDL2/SDL_rwops.h>
+#include <SDL2/SDL_endian.h>
+#include <fstream>
+#include <string.h>
 
 #include "memorystream.hpp"
 
 MemoryStream::MemoryStream(const void *data, size_t size) : Stream() {
-  this->rw = SDL_RWFromConstMem(data, size);
+  this->setBuffer(static_cast<const uint8_t *>(data), size, nullptr);
+}
+
+MemoryStream::MemoryStream(const void *data, size_t size, std::shared_ptr<const void> backing) : Stream() {
+  this->setBuffer(static_cast<const uint8_t *>(data), size, backing);
+}
+
+void MemoryStream::setBuffer(const uint8_t *buffer, size_t size, std::shared_ptr<const void> backing) {
+  this->buffer = buffer;
+  this->bufferSize = size;
+  this->position = 0;
+  this->backing = backing;
+}
+
+const uint8_t *MemoryStream::take(size_t size) {
+  if (size > this->bufferSize - this->position) {
+    throw std::ifstream::failure("read past end of stream");
+  }
+
+  const uint8_t *ptr = this->buffer + this->position;
+  this->position += size;
+
+  return ptr;
+}
+
+size_t MemoryStream::read(void *ptr, size_t size, size_t count) {
+  if (size == 0) {
+    return 0;
+  }
+
+  // Like SDL_RWread, bulk reads stop short at the end of the buffer rather
+  // than failing
+  size_t available = (this->bufferSize - this->position) / size;
+  if (count > available) {
+    count = available;
+  }
+
+  memcpy(ptr, this->take(size * count), size * count);
+
+  return count;
+}
+
+int8_t MemoryStream::readInt8() {
+  return static_cast<int8_t>(this->readUint8());
+}
+
+int16_t MemoryStream::readInt16() {
+  return static_cast<int16_t>(this->readUint16());
+}
+
+int32_t MemoryStream::readInt32() {
+  return static_cast<int32_t>(this->readUint32());
+}
+
+uint8_t MemoryStream::readUint8() {
+  return *this->take(sizeof(uint8_t));
+}
+
+uint16_t MemoryStream::readUint16() {
+  uint16_t val;
+  memcpy(&val, this->take(sizeof(uint16_t)), sizeof(uint16_t));
+
+  return SDL_SwapLE16(val);
+}
+
+uint32_t MemoryStream::readUint32() {
+  uint32_t val;
+  memcpy(&val, this->take(sizeof(uint32_t)), sizeof(uint32_t));
+
+  return SDL_SwapLE32(val);
+}
+
+float MemoryStream::readFloat() {
+  float val;
+  memcpy(&val, this->take(sizeof(float)), sizeof(float));
+
+  return val;
+}
+
+void MemoryStream::readString(std::string& string) {
+  const uint8_t *start = this->buffer + this->position;
+  size_t remaining = this->bufferSize - this->position;
+
+  const void *end = memchr(start, '\0', remaining);
+  if (end == nullptr) {
+    throw std::ifstream::failure("unterminated string");
+  }
+
+  size_t length = static_cast<const uint8_t *>(end) - start;
+  string.assign(reinterpret_cast<const char *>(this->take(length + 1)), length);
+}
+
+void MemoryStream::seek(long offset, int whence) {
+  long base;
+  switch (whence) {
+    case SEEK_SET:
+      base = 0;
+      break;
+    case SEEK_CUR:
+      base = this->position;
+      break;
+    case SEEK_END:
+      base = this->bufferSize;
+      break;
+    default:
+      throw std::ifstream::failure("invalid seek origin");
+  }
+
+  // Clamp to the buffer, matching SDL_RWFromConstMem's seek behavior
+  long target = base + offset;
+  if (target < 0) {
+    target = 0;
+  } else if (target > (long)this->bufferSize) {
+    target = this->bufferSize;
+  }
+
+  this->position = target;
+}
+
+long MemoryStream::tell() {
+  return this->position;
+}
+
+const uint8_t *MemoryStream::data() const {
+  return this->buffer;
+}
+
+size_t MemoryStream::size() const {
+  return this->bufferSize;
+}
+
+std::shared_ptr<const void> MemoryStream::getBacking() const {
+  return this->backing;
 }
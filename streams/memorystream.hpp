@@ -19,9 +19,49 @@
 
 #include "stream.hpp"
 
+// MemoryStream reads directly out of a read-only buffer without going through
+// SDL_RWops. The buffer is caller-owned unless a backing owner is supplied.
 class MemoryStream : public Stream {
   public:
     MemoryStream(const void *data, size_t size);
+    MemoryStream(const void *data, size_t size, std::shared_ptr<const void> backing);
+
+    size_t read(void *ptr, size_t size, size_t count) override;
+
+    int8_t readInt8() override;
+    int16_t readInt16() override;
+    int32_t readInt32() override;
+
+    uint8_t readUint8() override;
+    uint16_t readUint16() override;
+    uint32_t readUint32() override;
+
+    float readFloat() override;
+    void readString(std::string& string) override;
+
+    void seek(long offset, int whence) override;
+    long tell() override;
+
+    const uint8_t *data() const override;
+    size_t size() const override;
+    std::shared_ptr<const void> getBacking() const override;
+
+  protected:
+    MemoryStream()
+      : buffer { nullptr },
+        bufferSize { 0 },
+        position { 0 } {};
+
+    void setBuffer(const uint8_t *buffer, size_t size, std::shared_ptr<const void> backing);
+
+  private:
+    const uint8_t *take(size_t size);
+
+    const uint8_t *buffer;
+    size_t bufferSize;
+    size_t position;
+
+    std::shared_ptr<const void> backing;
 };
 
 #endif
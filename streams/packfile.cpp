@@ -0,0 +1,109 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <fstream>
+
+#include "filestream.hpp"
+#include "mappedfilestream.hpp"
+#include "memorystream.hpp"
+#include "packfile.hpp"
+
+PackFile::PackFile(const char *path) {
+  try {
+    this->stream = std::make_unique<MappedFileStream>(path);
+    this->isMapped = true;
+  } catch (std::ifstream::failure& e) {
+    this->stream = std::make_unique<FileStream>(path, "rb");
+    this->isMapped = false;
+  }
+
+  this->stream->seek(0, SEEK_SET);
+  struct PackHeader header = this->stream->readStruct<PackHeader>();
+
+  if (header.magic != PACK_MAGIC || header.version != PACK_VERSION) {
+    throw std::ifstream::failure("not a pack file");
+  }
+
+  this->entries.resize(header.entryCount);
+
+  this->stream->seek(header.indexOffset, SEEK_SET);
+  this->stream->readStructs(this->entries.data(), header.entryCount);
+
+  if (!std::is_sorted(this->entries.begin(), this->entries.end(), [] (const PackEntry& a, const PackEntry& b) {
+    return a.hash < b.hash;
+  })) {
+    throw std::ifstream::failure("pack index is not sorted");
+  }
+}
+
+const PackEntry *PackFile::find(std::string_view path) const {
+  uint64_t hash = hashPath(path);
+
+  auto entry = std::lower_bound(this->entries.begin(), this->entries.end(), hash, [] (const PackEntry& entry, uint64_t hash) {
+    return entry.hash < hash;
+  });
+
+  if (entry == this->entries.end() || entry->hash != hash) {
+    return nullptr;
+  }
+
+  return &*entry;
+}
+
+bool PackFile::contains(std::string_view path) const {
+  return this->find(path) != nullptr;
+}
+
+uint64_t PackFile::getSize(std::string_view path) const {
+  const PackEntry *entry = this->find(path);
+
+  return entry ? entry->size : 0;
+}
+
+std::unique_ptr<Stream> PackFile::open(std::string_view path) {
+  const PackEntry *entry = this->find(path);
+  if (!entry) {
+    return nullptr;
+  }
+
+  if (entry->compression != (uint32_t)PackCompression::STORED) {
+    throw std::ifstream::failure("unsupported pack entry compression");
+  }
+
+  if (this->isMapped) {
+    if (!this->stream->canView<uint8_t>(entry->offset, entry->size)) {
+      throw std::ifstream::failure("pack entry lies outside the pack");
+    }
+
+    const uint8_t *data = this->stream->view<uint8_t>(entry->offset, entry->size).data();
+
+    return std::make_unique<MemoryStream>(data, entry->size, this->stream->getBacking());
+  }
+
+  // The entry's bytes are kept alive by whatever ends up referencing them
+  auto data = std::make_shared<std::vector<uint8_t>>(entry->size);
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    this->stream->seek(entry->offset, SEEK_SET);
+    if (entry->size && this->stream->read(data->data(), entry->size, 1) != 1) {
+      throw std::ifstream::failure("pack entry lies outside the pack");
+    }
+  }
+
+  return std::make_unique<MemoryStream>(data->data(), data->size(), data);
+}
@@ -0,0 +1,125 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_PACKFILE_H
+#define MORTAR_PACKFILE_H
+
+#include <ctype.h>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+
+#include "stream.hpp"
+
+// A pack holds a whole data directory in one file: a header, an index of
+// entries sorted by path hash, then each entry's payload on a page boundary.
+// Paths are hashed as lowercased, '/'-separated paths relative to the packed
+// directory, matching how PathResolver treats the data's inconsistent case.
+//
+// Each entry records how it's stored. Only stored (uncompressed) entries are
+// written for now; the field leaves room for compressed ones.
+#define PACK_MAGIC 0x4b41504d // "MPAK"
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 4096
+
+enum class PackCompression : uint32_t {
+  STORED = 0,
+};
+
+struct PackHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entryCount;
+  uint32_t reserved;
+  uint64_t indexOffset;
+  uint64_t reserved2;
+};
+
+template <>
+struct StructLayout<PackHeader> {
+  static constexpr size_t size = 0x20;
+  static constexpr auto fields = std::tuple {
+    field(&PackHeader::magic,       0x0),
+    field(&PackHeader::version,     0x4),
+    field(&PackHeader::entryCount,  0x8),
+    field(&PackHeader::indexOffset, 0x10),
+  };
+};
+
+struct PackEntry {
+  uint64_t hash;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t compression;
+  uint32_t reserved;
+};
+
+template <>
+struct StructLayout<PackEntry> {
+  static constexpr size_t size = 0x20;
+  static constexpr auto fields = std::tuple {
+    field(&PackEntry::hash,        0x0),
+    field(&PackEntry::offset,      0x8),
+    field(&PackEntry::size,        0x10),
+    field(&PackEntry::compression, 0x18),
+  };
+};
+
+class PackFile {
+  public:
+    // Throws std::ifstream::failure if the file can't be opened or isn't a pack
+    PackFile(const char *path);
+
+    PackFile(const PackFile&) = delete;
+    PackFile& operator=(const PackFile&) = delete;
+
+    // FNV-1a over the path, lowercased and with '\\' taken as '/'
+    static inline uint64_t hashPath(std::string_view path) {
+      uint64_t hash = 0xcbf29ce484222325;
+      for (char c : path) {
+        c = c == '\\' ? '/' : tolower((unsigned char)c);
+        hash = (hash ^ (uint8_t)c) * 0x100000001b3;
+      }
+
+      return hash;
+    }
+
+    bool contains(std::string_view path) const;
+
+    // Size of an entry's contents, or zero if there's no such entry
+    uint64_t getSize(std::string_view path) const;
+
+    // Opens an entry as a stream of its own, or returns nullptr if there's no
+    // such entry. Entries of a mapped pack are served from the mapping, so
+    // zero-copy views into them work as they do on a mapped file. Safe to
+    // call from several threads at once.
+    std::unique_ptr<Stream> open(std::string_view path);
+
+  private:
+    const PackEntry *find(std::string_view path) const;
+
+    // Either the whole pack is mapped, or entries are read out of the file
+    // one at a time under the lock
+    std::unique_ptr<Stream> stream;
+    bool isMapped;
+    std::mutex mutex;
+
+    std::vector<PackEntry> entries;
+};
+
+#endif
@@ -0,0 +1,181 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fstream>
+
+#include "pathresolver.hpp"
+
+std::mutex PathResolver::mutex;
+tsl::sparse_map<std::string, PathResolver::Directory> PathResolver::directories;
+tsl::sparse_map<std::string, std::string> PathResolver::resolved;
+
+static std::string toLower(const std::string& str) {
+  std::string lower { str };
+  for (char& c : lower) {
+    c = tolower((unsigned char)c);
+  }
+
+  return lower;
+}
+
+static std::string joinPath(const std::string& dir, const std::string& name) {
+  if (dir.empty()) {
+    return name;
+  } else if (dir.back() == '/') {
+    return dir + name;
+  }
+
+  return dir + "/" + name;
+}
+
+PathResolver::EntryType PathResolver::statType(const std::string& path) {
+  struct stat results;
+  if (stat(path.c_str(), &results) != 0) {
+    // Dangling links can't be opened either
+    return EntryType::OTHER;
+  }
+
+  if (S_ISREG(results.st_mode)) {
+    return EntryType::FILE;
+  } else if (S_ISDIR(results.st_mode)) {
+    return EntryType::DIRECTORY;
+  }
+
+  return EntryType::OTHER;
+}
+
+const PathResolver::Directory& PathResolver::listDirectory(const std::string& path) {
+  auto it = directories.find(path);
+  if (it != directories.end()) {
+    return it->second;
+  }
+
+  DIR *dir = opendir(path.empty() ? "./" : path.c_str());
+  if (dir == nullptr) {
+    throw std::ifstream::failure("cannot access file or directory");
+  }
+
+  Directory listing;
+
+  struct dirent *content;
+  while ((content = readdir(dir)) != nullptr) {
+    std::string key = toLower(content->d_name);
+
+    // When names differ only by case the first one listed wins, as it did
+    // with the uncached walk
+    if (listing.contains(key)) {
+      continue;
+    }
+
+    EntryType type;
+#ifdef _DIRENT_HAVE_D_TYPE
+    if (content->d_type == DT_REG) {
+      type = EntryType::FILE;
+    } else if (content->d_type == DT_DIR) {
+      type = EntryType::DIRECTORY;
+    } else if (content->d_type != DT_LNK && content->d_type != DT_UNKNOWN) {
+      type = EntryType::OTHER;
+    } else
+#endif
+    {
+      // Symlinks and filesystems without d_type need a stat
+      type = statType(joinPath(path, content->d_name));
+    }
+
+    listing.insert({ key, { content->d_name, type } });
+  }
+
+  closedir(dir);
+
+  return directories[path] = std::move(listing);
+}
+
+std::string PathResolver::resolve(const char *path) {
+  if (path == NULL) {
+    throw std::ifstream::failure("path must not be null");
+  }
+
+  std::string key = toLower(path);
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto cached = resolved.find(key);
+  if (cached != resolved.end()) {
+    return cached->second;
+  }
+
+  std::string current;
+  if (key[0] == '/') {
+    current = "/";
+  }
+
+  bool found = false;
+  size_t start = 0;
+  while (start < key.size()) {
+    size_t end = key.find('/', start);
+    if (end == std::string::npos) {
+      end = key.size();
+    }
+
+    if (end == start) {
+      start++;
+      continue;
+    }
+
+    if (found) {
+      // The previous component was a file but more of the path follows
+      throw std::ifstream::failure("file or directory not found");
+    }
+
+    const Directory& listing = listDirectory(current);
+
+    auto it = listing.find(key.substr(start, end - start));
+    if (it == listing.end()) {
+      throw std::ifstream::failure("file or directory not found");
+    }
+
+    const Entry& entry = it->second;
+    if (entry.type == EntryType::FILE) {
+      found = true;
+    } else if (entry.type != EntryType::DIRECTORY) {
+      throw std::ifstream::failure("file or directory not found");
+    }
+
+    current = joinPath(current, entry.name);
+    start = end + 1;
+  }
+
+  if (current.empty()) {
+    throw std::ifstream::failure("path must not be empty");
+  } else if (!found) {
+    throw std::ifstream::failure("path is not a file");
+  }
+
+  resolved[key] = current;
+
+  return current;
+}
+
+void PathResolver::invalidate() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  directories.clear();
+  resolved.clear();
+}
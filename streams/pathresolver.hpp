@@ -0,0 +1,65 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_PATHRESOLVER_H
+#define MORTAR_PATHRESOLVER_H
+
+#include <mutex>
+#include <string>
+#include <tsl/sparse_map.h>
+
+// PathResolver maps paths onto their on-disk spelling case-insensitively, as
+// the game data refers to files with inconsistent case. Each directory is
+// listed once with a single readdir pass and results are cached process-wide,
+// so repeated opens under the same tree never touch the filesystem again.
+class PathResolver {
+  public:
+    // Returns the path with each component's on-disk spelling, throwing
+    // std::ifstream::failure if it does not name an existing file
+    static std::string resolve(const char *path);
+
+    // Forgets everything cached, for use after files are added, renamed or
+    // removed under a directory that has already been resolved against
+    static void invalidate();
+
+  private:
+    enum class EntryType {
+      FILE,
+      DIRECTORY,
+      OTHER
+    };
+
+    struct Entry {
+      std::string name;
+      EntryType type;
+    };
+
+    // Lowercased entry name to entry
+    typedef tsl::sparse_map<std::string, Entry> Directory;
+
+    static EntryType statType(const std::string& path);
+    static const Directory& listDirectory(const std::string& path);
+
+    static std::mutex mutex;
+
+    // Keyed by the directory's resolved path
+    static tsl::sparse_map<std::string, Directory> directories;
+
+    // Keyed by the lowercased path as requested
+    static tsl::sparse_map<std::string, std::string> resolved;
+};
+
+#endif
@@ -14,7 +14,6 @@
  * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <vector>
 
 #include "stream.hpp"
 
@@ -24,8 +23,8 @@ Stream::~Stream() {
   }
 }
 
-void Stream::read(void *ptr, size_t size, size_t count) {
-  SDL_RWread(this->rw, ptr, size, count);
+size_t Stream::read(void *ptr, size_t size, size_t count) {
+  return SDL_RWread(this->rw, ptr, size, count);
 }
 
 int8_t Stream::readInt8() {
@@ -60,6 +59,18 @@ long Stream::tell() {
   return SDL_RWtell(this->rw);
 }
 
+const uint8_t *Stream::data() const {
+  return nullptr;
+}
+
+size_t Stream::size() const {
+  return 0;
+}
+
+std::shared_ptr<const void> Stream::getBacking() const {
+  return nullptr;
+}
+
 float Stream::readFloat() {
   float val;
 
@@ -68,17 +79,19 @@ float Stream::readFloat() {
   return val;
 }
 
-char *Stream::readString() {
-  std::vector<char> vec;
+void Stream::readString(std::string& string) {
+  string.clear();
 
-  char val = '\0';
-  do {
-    this->read(&val, sizeof(char), 1);
-    vec.push_back(val);
-  } while (val != '\0');
+  char val;
+  while (true) {
+    if (this->read(&val, sizeof(char), 1) != 1) {
+      throw std::ifstream::failure("unterminated string");
+    }
 
-  char *ret = new char[vec.size() + 1];
-  memcpy(ret, vec.data(), vec.size());
+    if (val == '\0') {
+      break;
+    }
 
-  return ret;
+    string.push_back(val);
+  }
 }
@@ -18,14 +18,26 @@
 #define MORTAR_STREAM_H
 
 #include <SDL2/SDL_rwops.h>
+#include <bit>
+#include <fstream>
+#include <memory>
+#include <span>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "structlayout.hpp"
 
 class Stream {
   public:
     virtual ~Stream();
 
-    virtual void read(void *ptr, size_t size, size_t count);
+    // Reads up to count objects of the given size, returning how many were
+    // read in full
+    virtual size_t read(void *ptr, size_t size, size_t count);
 
     virtual int8_t readInt8();
     virtual int16_t readInt16();
@@ -36,13 +48,142 @@ class Stream {
     virtual uint32_t readUint32();
 
     virtual float readFloat();
-    virtual char *readString();
+
+    // Reads a NUL-terminated string into string, without the terminator.
+    // Reusing one string across reads keeps them from allocating.
+    virtual void readString(std::string& string);
 
     virtual void seek(long offset, int whence);
     virtual long tell();
 
+    // Memory-backed streams expose their whole image; others return nullptr
+    virtual const uint8_t *data() const;
+    virtual size_t size() const;
+
+    // Owner of the memory behind data(), if any. Resources that reference the
+    // stream's bytes directly must hold on to this to keep them alive.
+    virtual std::shared_ptr<const void> getBacking() const;
+
+    // Whether view<T>() can be served in place: the stream must be memory
+    // backed, the range in bounds and aligned, and the host little-endian
+    template <typename T>
+    bool canView(long offset, size_t count) const;
+
+    // Returns count elements of T at the given absolute offset without copying
+    template <typename T>
+    std::span<const T> view(long offset, size_t count) const;
+
+    // Reads count little-endian elements of T from the current position in a
+    // single bulk copy
+    template <typename T>
+    void readArray(T *out, size_t count);
+
+    // Decodes a struct described by a StructLayout from the current position
+    // in one pass, leaving the stream at the end of its record
+    template <typename T>
+    T readStruct();
+
+    // Decodes a table of count records from the current position, reading the
+    // whole table at once rather than field by field
+    template <typename T>
+    void readStructs(T *out, size_t count);
+
   protected:
-    SDL_RWops *rw;
+    SDL_RWops *rw = nullptr;
 };
 
+template <typename T>
+bool Stream::canView(long offset, size_t count) const {
+  static_assert(std::is_arithmetic_v<T>, "views are only provided over arithmetic types");
+
+  if (sizeof(T) > 1 && std::endian::native != std::endian::little) {
+    return false;
+  }
+
+  const uint8_t *base = this->data();
+  if (base == nullptr || offset < 0 || (size_t)offset > this->size() || count > (this->size() - offset) / sizeof(T)) {
+    return false;
+  }
+
+  return reinterpret_cast<uintptr_t>(base + offset) % alignof(T) == 0;
+}
+
+template <typename T>
+std::span<const T> Stream::view(long offset, size_t count) const {
+  if (!this->canView<T>(offset, count)) {
+    throw std::ifstream::failure("stream cannot provide a view of that range");
+  }
+
+  return std::span<const T>(reinterpret_cast<const T *>(this->data() + offset), count);
+}
+
+template <typename T>
+void Stream::readArray(T *out, size_t count) {
+  static_assert(std::is_arithmetic_v<T>, "arrays are only read as arithmetic types");
+
+  const uint8_t *base = this->data();
+  if (base != nullptr) {
+    long position = this->tell();
+    if (count > (this->size() - position) / sizeof(T)) {
+      throw std::ifstream::failure("read past end of stream");
+    }
+
+    memcpy(out, base + position, count * sizeof(T));
+    this->seek(count * sizeof(T), SEEK_CUR);
+  } else if (this->read(out, sizeof(T), count) != count) {
+    throw std::ifstream::failure("read past end of stream");
+  }
+
+  if constexpr (sizeof(T) > 1 && std::endian::native == std::endian::big) {
+    for (size_t i = 0; i < count; i++) {
+      uint8_t *bytes = reinterpret_cast<uint8_t *>(&out[i]);
+      for (size_t j = 0; j < sizeof(T) / 2; j++) {
+        uint8_t tmp = bytes[j];
+        bytes[j] = bytes[sizeof(T) - 1 - j];
+        bytes[sizeof(T) - 1 - j] = tmp;
+      }
+    }
+  }
+}
+
+template <typename T>
+T Stream::readStruct() {
+  T out {};
+  this->readStructs(&out, 1);
+
+  return out;
+}
+
+template <typename T>
+void Stream::readStructs(T *out, size_t count) {
+  constexpr size_t stride = StructLayout<T>::size;
+  constexpr size_t extent = getStructExtent<T>();
+
+  if (count == 0) {
+    return;
+  }
+
+  // Only the last record needs to be present up to the fields it uses
+  size_t size = (count - 1) * stride + extent;
+
+  long position = this->tell();
+  if (this->canView<uint8_t>(position, size)) {
+    const uint8_t *data = this->data() + position;
+    for (size_t i = 0; i < count; i++) {
+      decodeStruct(data + i * stride, out[i]);
+    }
+  } else {
+    std::vector<uint8_t> data (size);
+    if (this->read(data.data(), size, 1) != 1) {
+      throw std::ifstream::failure("read past end of stream");
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      decodeStruct(data.data() + i * stride, out[i]);
+    }
+  }
+
+  this->seek(position + count * stride, SEEK_SET);
+}
+
 #endif
@@ -0,0 +1,120 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_STRUCT_LAYOUT_H
+#define MORTAR_STRUCT_LAYOUT_H
+
+#include <bit>
+#include <cstddef>
+#include <stdint.h>
+#include <string.h>
+#include <tuple>
+#include <type_traits>
+
+// How a single member is decoded from its little-endian encoding. Arithmetic
+// types and arrays of them are covered here; other types, such as the math
+// classes, provide their own specialisation with an encoded size and decode().
+template <typename M>
+struct FieldCodec {
+  static_assert(std::is_arithmetic_v<M>, "no codec for this field type");
+
+  static constexpr size_t size = sizeof(M);
+
+  static inline void decode(const uint8_t *data, M& out) {
+    memcpy(&out, data, sizeof(M));
+
+    if constexpr (sizeof(M) > 1 && std::endian::native == std::endian::big) {
+      uint8_t *bytes = reinterpret_cast<uint8_t *>(&out);
+      for (size_t i = 0; i < sizeof(M) / 2; i++) {
+        uint8_t tmp = bytes[i];
+        bytes[i] = bytes[sizeof(M) - 1 - i];
+        bytes[sizeof(M) - 1 - i] = tmp;
+      }
+    }
+  }
+};
+
+template <typename M, size_t N>
+struct FieldCodec<M[N]> {
+  static constexpr size_t size = FieldCodec<M>::size * N;
+
+  static inline void decode(const uint8_t *data, M (&out)[N]) {
+    if constexpr (std::is_arithmetic_v<M> && (sizeof(M) == 1 || std::endian::native == std::endian::little)) {
+      memcpy(out, data, sizeof(out));
+    } else {
+      for (size_t i = 0; i < N; i++) {
+        FieldCodec<M>::decode(data + i * FieldCodec<M>::size, out[i]);
+      }
+    }
+  }
+};
+
+template <typename T, typename M>
+struct StructField {
+  M T::*member;
+  size_t offset;
+
+  inline void decode(const uint8_t *data, T& out) const {
+    FieldCodec<M>::decode(data + this->offset, out.*(this->member));
+  }
+
+  constexpr size_t getEnd() const {
+    return this->offset + FieldCodec<M>::size;
+  }
+};
+
+template <typename T, typename M>
+constexpr StructField<T, M> field(M T::*member, size_t offset) {
+  return { member, offset };
+}
+
+// Describes how T is laid out in a file: its encoded size, which is the
+// stride between records in a table, and the offset of each member that is
+// read. Members left out, such as unknown fields, are skipped. Readers
+// specialise this next to the struct, e.g.
+//
+//   template <>
+//   struct StructLayout<Foo> {
+//     static constexpr size_t size = 0x8;
+//     static constexpr auto fields = std::tuple {
+//       field(&Foo::offset, 0x0),
+//       field(&Foo::count,  0x4),
+//     };
+//   };
+template <typename T>
+struct StructLayout;
+
+// How many bytes of T's encoding the described members actually cover
+template <typename T>
+constexpr size_t getStructExtent() {
+  return std::apply([](const auto&... fields) {
+    size_t extent = 0;
+    ((extent = fields.getEnd() > extent ? fields.getEnd() : extent), ...);
+    return extent;
+  }, StructLayout<T>::fields);
+}
+
+// Decodes one T from its encoding, which must hold getStructExtent<T>() bytes
+template <typename T>
+inline void decodeStruct(const uint8_t *data, T& out) {
+  static_assert(getStructExtent<T>() <= StructLayout<T>::size, "struct field lies outside its record");
+
+  std::apply([&](const auto&... fields) {
+    (fields.decode(data, out), ...);
+  }, StructLayout<T>::fields);
+}
+
+#endif
@@ -0,0 +1,333 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <netinet/in.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.hpp"
+#include "profiler.hpp"
+#include "state.hpp"
+#include "telemetry.hpp"
+
+using namespace Mortar;
+
+static constexpr uint64_t NS_PER_SECOND = 1000000000;
+
+static uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void appendf(std::string& out, const char *format, ...) {
+  char buffer[256];
+
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+
+  if (length > 0) {
+    out.append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+  }
+}
+
+static void appendString(std::string& out, const std::string& string) {
+  out += '"';
+  for (char c : string) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+    } else if ((unsigned char)c < 0x20) {
+      continue;
+    }
+
+    out += c;
+  }
+  out += '"';
+}
+
+Telemetry::~Telemetry() {
+  this->stop();
+}
+
+void Telemetry::start(const Settings& settings) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->running) {
+    return;
+  }
+
+  this->settings = settings;
+
+  if (!settings.path.empty()) {
+    this->file = fopen(settings.path.c_str(), "a");
+    if (!this->file) {
+      WARNING("unable to open %s for telemetry", settings.path.c_str());
+    } else {
+      fseek(this->file, 0, SEEK_END);
+      this->fileSize = ftell(this->file);
+    }
+  }
+
+  if (settings.port) {
+    this->socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (this->socket == -1) {
+      WARNING("unable to open a socket for telemetry");
+    }
+  }
+
+  this->current = {};
+  this->lastFrame = 0;
+  this->stopping = false;
+  this->running = true;
+  this->thread = std::thread(&Telemetry::run, this);
+}
+
+void Telemetry::stop() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!this->running) {
+      return;
+    }
+
+    this->stopping = true;
+  }
+
+  // Seconds already handed over are still written
+  this->condition.notify_all();
+  this->thread.join();
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->running = false;
+  this->seconds.clear();
+  this->loads.clear();
+
+  if (this->file) {
+    fclose(this->file);
+    this->file = nullptr;
+  }
+
+  if (this->socket != -1) {
+    close(this->socket);
+    this->socket = -1;
+  }
+}
+
+bool Telemetry::isRunning() const {
+  return this->running;
+}
+
+void Telemetry::recordFrame(const Scene::FrameTimings& timings, const Render::RenderStats& stats) {
+  if (!this->running) {
+    return;
+  }
+
+  uint64_t frameEnd = now();
+  if (!this->lastFrame) {
+    this->lastFrame = frameEnd;
+    this->current.start = frameEnd;
+    return;
+  }
+
+  float frameTime = (frameEnd - this->lastFrame) / 1000000.0f;
+  this->lastFrame = frameEnd;
+
+  Second& second = this->current;
+  second.frames++;
+  second.frameTime += frameTime;
+  second.maxFrameTime = std::max(second.maxFrameTime, frameTime);
+
+  size_t bucket = 0;
+  while (bucket < FRAME_TIME_BUCKETS.size() && frameTime > FRAME_TIME_BUCKETS[bucket]) {
+    bucket++;
+  }
+  second.frameTimes[bucket]++;
+
+  second.animateTime += timings.animateTime;
+  second.collectTime += timings.collectTime;
+  second.waitTime += timings.waitTime;
+  second.submitTime += stats.submitTime;
+  second.gpuFrameTime += stats.gpuFrameTime;
+  second.uploadTime += stats.uploadTime;
+
+  second.drawCalls += stats.drawCalls;
+  second.triangles += stats.triangles;
+  second.stateChanges += stats.stateChanges;
+  second.bytesUploaded += stats.bytesUploaded;
+  second.textureLevelsStreamed += stats.textureLevelsStreamed;
+  second.textureLevelsEvicted += stats.textureLevelsEvicted;
+
+  second.bufferMemory = stats.bufferMemory;
+  second.textureMemory = stats.textureMemory;
+
+  if (frameEnd - second.start < NS_PER_SECOND) {
+    return;
+  }
+
+  second.end = frameEnd;
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->seconds.push_back(second);
+  }
+  this->condition.notify_one();
+
+  this->current = {};
+  this->current.start = frameEnd;
+}
+
+void Telemetry::recordLoad(const std::string& name, float loadTime) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->running) {
+    this->loads.push_back({ name, loadTime });
+  }
+}
+
+void Telemetry::run() {
+  std::vector<Second> seconds;
+  std::vector<Load> loads;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->condition.wait(lock, [this] () {
+        return this->stopping || !this->seconds.empty();
+      });
+
+      if (this->seconds.empty()) {
+        return;
+      }
+
+      std::swap(seconds, this->seconds);
+      std::swap(loads, this->loads);
+    }
+
+    // Loads are reported with the first second that sees them finish
+    for (auto& second : seconds) {
+      this->write(second, loads);
+      loads.clear();
+    }
+
+    seconds.clear();
+  }
+}
+
+void Telemetry::write(const Second& second, const std::vector<Load>& loads) {
+  PROFILE_ZONE("Telemetry::write");
+
+  unsigned frames = std::max(second.frames, 1u);
+  std::string line;
+
+  appendf(line, "{\"time\":%lld,\"frames\":%u,\"frameTime\":{\"avg\":%.3f,\"max\":%.3f,\"histogram\":[",
+    (long long)::time(nullptr), second.frames, second.frameTime / frames, second.maxFrameTime);
+  for (size_t i = 0; i < second.frameTimes.size(); i++) {
+    appendf(line, "%s%u", i ? "," : "", second.frameTimes[i]);
+  }
+
+  // Averages per frame, in milliseconds
+  appendf(line, "]},\"phases\":{\"animate\":%.3f,\"collect\":%.3f,\"wait\":%.3f,\"submit\":%.3f,\"gpu\":%.3f,\"upload\":%.3f}",
+    second.animateTime / frames, second.collectTime / frames, second.waitTime / frames,
+    second.submitTime / frames, second.gpuFrameTime / frames, second.uploadTime / frames);
+
+  appendf(line, ",\"draws\":{\"calls\":%.1f,\"triangles\":%.1f,\"stateChanges\":%.1f}",
+    (double)second.drawCalls / frames, (double)second.triangles / frames, (double)second.stateChanges / frames);
+
+  appendf(line, ",\"uploadedBytes\":%llu,\"textureLevels\":{\"streamed\":%u,\"evicted\":%u},\"gpuMemory\":{\"buffers\":%llu,\"textures\":%llu}",
+    (unsigned long long)second.bytesUploaded, second.textureLevelsStreamed, second.textureLevelsEvicted,
+    (unsigned long long)second.bufferMemory, (unsigned long long)second.textureMemory);
+
+  // The report takes the manager's locks, which the main loop shouldn't
+  // wait on
+  Resource::MemoryReport report = State::getResourceManager().getMemoryReport();
+
+  unsigned cached = 0;
+  for (auto& asset : report.assets) {
+    cached += !asset.isHeld;
+  }
+
+  appendf(line, ",\"resources\":{\"resident\":%zu,\"assets\":%zu,\"cached\":%u,\"types\":{", report.total, report.assets.size(), cached);
+  for (size_t i = 0; i < report.types.size(); i++) {
+    line += i ? "," : "";
+    appendString(line, Resource::MemoryReport::getTypeName(report.types[i].type));
+    appendf(line, ":%zu", report.types[i].size);
+  }
+  line += "}}";
+
+  line += ",\"loads\":[";
+  for (size_t i = 0; i < loads.size(); i++) {
+    line += i ? ",{\"name\":" : "{\"name\":";
+    appendString(line, loads[i].name);
+    appendf(line, ",\"time\":%.3f}", loads[i].loadTime);
+  }
+  line += "]";
+
+#ifdef MORTAR_PROFILE
+  // Milliseconds in each zone over the whole second, over every thread
+  std::vector<Profiler::ZoneTotal> zones;
+  Profiler::totalZones(second.start, second.end, zones);
+
+  line += ",\"zones\":{";
+  for (size_t i = 0; i < zones.size(); i++) {
+    line += i ? "," : "";
+    appendString(line, zones[i].name);
+    appendf(line, ":{\"count\":%llu,\"time\":%.3f}", (unsigned long long)zones[i].count, zones[i].duration / 1000000.0);
+  }
+  line += "}";
+#endif
+
+  line += "}\n";
+
+  this->output(line);
+}
+
+void Telemetry::output(const std::string& line) {
+  if (this->file) {
+    if (this->fileSize && this->fileSize + line.size() > this->settings.maxFileSize) {
+      std::string rotated = this->settings.path + ".1";
+
+      fclose(this->file);
+      if (rename(this->settings.path.c_str(), rotated.c_str()) != 0) {
+        WARNING("unable to rotate %s", this->settings.path.c_str());
+      }
+
+      this->file = fopen(this->settings.path.c_str(), "w");
+      this->fileSize = 0;
+      if (!this->file) {
+        WARNING("unable to open %s for telemetry", this->settings.path.c_str());
+      }
+    }
+
+    if (this->file) {
+      fwrite(line.data(), 1, line.size(), this->file);
+      fflush(this->file);
+      this->fileSize += line.size();
+    }
+  }
+
+  if (this->socket != -1) {
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(this->settings.port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // Nothing may be listening, and that's fine
+    sendto(this->socket, line.data(), line.size(), 0, (const sockaddr *)&address, sizeof(address));
+  }
+}
@@ -0,0 +1,137 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MORTAR_TELEMETRY_H
+#define MORTAR_TELEMETRY_H
+
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "render/renderer.hpp"
+#include "scene/manager.hpp"
+
+namespace Mortar {
+  // Counters for watching a running build without a debugger: what frames
+  // cost, by phase and by draws, and what memory resources take. The main
+  // loop folds each frame into the current second, and once a second hands
+  // that second to a thread of its own. The thread adds what's costly to
+  // gather, and writes each second as a line of JSON to a file, to a UDP
+  // port on this machine, or both.
+  class Telemetry {
+    public:
+      static constexpr size_t DEFAULT_MAX_FILE_SIZE = 16 * 1024 * 1024;
+
+      // Upper bounds in milliseconds of each frame time bucket but the
+      // last, which takes anything slower
+      static constexpr std::array<float, 6> FRAME_TIME_BUCKETS { 8.4f, 16.7f, 20.0f, 33.4f, 50.0f, 100.0f };
+
+      struct Settings {
+        // Lines are appended to the file unless it's empty. Past the size,
+        // it's moved to the same path with ".1" added, replacing the last.
+        std::string path;
+        size_t maxFileSize = DEFAULT_MAX_FILE_SIZE;
+
+        // Lines are also sent as datagrams to 127.0.0.1 unless it's zero
+        uint16_t port = 0;
+      };
+
+      Telemetry() = default;
+      ~Telemetry();
+
+      Telemetry(const Telemetry&) = delete;
+      Telemetry& operator=(const Telemetry&) = delete;
+
+      // Both read the resource manager from the thread, so must come between
+      // its initialize() and shutDown()
+      void start(const Settings& settings);
+      void stop();
+
+      bool isRunning() const;
+
+      // Once per pass of the main loop, after the frame's been handed to the
+      // renderer. The time between calls is the frame time.
+      void recordFrame(const Scene::FrameTimings& timings, const Render::RenderStats& stats);
+
+      // From any thread
+      void recordLoad(const std::string& name, float loadTime);
+
+    private:
+      // Frame counters of one second, summed, but for the GPU memory, which
+      // is as of its last frame
+      struct Second {
+        uint64_t start;
+        uint64_t end;
+
+        unsigned frames;
+        std::array<unsigned, FRAME_TIME_BUCKETS.size() + 1> frameTimes;
+        float frameTime;
+        float maxFrameTime;
+
+        float animateTime;
+        float collectTime;
+        float waitTime;
+        float submitTime;
+        float gpuFrameTime;
+        float uploadTime;
+
+        uint64_t drawCalls;
+        uint64_t triangles;
+        uint64_t stateChanges;
+        uint64_t bytesUploaded;
+        unsigned textureLevelsStreamed;
+        unsigned textureLevelsEvicted;
+
+        uint64_t bufferMemory;
+        uint64_t textureMemory;
+      };
+
+      struct Load {
+        std::string name;
+        float loadTime;
+      };
+
+      void run();
+      void write(const Second& second, const std::vector<Load>& loads);
+      void output(const std::string& line);
+
+      Settings settings;
+      std::thread thread;
+      bool running = false;
+
+      // Only the main loop touches these
+      Second current {};
+      uint64_t lastFrame = 0;
+
+      std::mutex mutex;
+      std::condition_variable condition;
+      std::vector<Second> seconds;
+      std::vector<Load> loads;
+      bool stopping = false;
+
+      // Only the thread touches these
+      FILE *file = nullptr;
+      size_t fileSize = 0;
+      int socket = -1;
+  };
+}
+
+#endif
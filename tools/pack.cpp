@@ -0,0 +1,159 @@
+/* This file is part of mortar.
+ *
+ * mortar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mortar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mortar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Packs a data directory into a single pack file for PackFile to read:
+//
+//   mortar-pack lego_data lego_data.pak
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "../streams/packfile.hpp"
+
+struct PackedFile {
+  std::filesystem::path source;
+  std::string name;
+  uint64_t hash;
+  uint64_t offset;
+  uint64_t size;
+};
+
+static void putUint32(std::vector<uint8_t>& out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out.push_back((value >> (i * 8)) & 0xff);
+  }
+}
+
+static void putUint64(std::vector<uint8_t>& out, uint64_t value) {
+  putUint32(out, value & 0xffffffff);
+  putUint32(out, value >> 32);
+}
+
+static uint64_t align(uint64_t offset) {
+  return (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <directory> <pack>\n", argv[0]);
+    return 1;
+  }
+
+  std::filesystem::path root { argv[1] };
+
+  std::vector<PackedFile> files;
+  for (auto& entry : std::filesystem::recursive_directory_iterator(root)) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+
+    std::string name = entry.path().lexically_relative(root).generic_string();
+    files.push_back({ entry.path(), name, PackFile::hashPath(name), 0, entry.file_size() });
+  }
+
+  // Payloads go in path order, so each level's or character's files sit
+  // together and read sequentially
+  std::sort(files.begin(), files.end(), [] (const PackedFile& a, const PackedFile& b) {
+    return a.name < b.name;
+  });
+
+  uint64_t offset = align(StructLayout<PackHeader>::size + files.size() * StructLayout<PackEntry>::size);
+  for (auto& file : files) {
+    file.offset = offset;
+    offset = align(offset + file.size);
+  }
+
+  // The index is searched by hash
+  std::vector<const PackedFile *> index;
+  for (auto& file : files) {
+    index.push_back(&file);
+  }
+
+  std::sort(index.begin(), index.end(), [] (const PackedFile *a, const PackedFile *b) {
+    return a->hash < b->hash;
+  });
+
+  for (size_t i = 1; i < index.size(); i++) {
+    if (index[i]->hash == index[i - 1]->hash) {
+      fprintf(stderr, "%s and %s hash alike; rename one\n", index[i - 1]->name.c_str(), index[i]->name.c_str());
+      return 1;
+    }
+  }
+
+  std::vector<uint8_t> head;
+  putUint32(head, PACK_MAGIC);
+  putUint32(head, PACK_VERSION);
+  putUint32(head, files.size());
+  putUint32(head, 0);
+  putUint64(head, StructLayout<PackHeader>::size);
+  putUint64(head, 0);
+
+  for (auto file : index) {
+    putUint64(head, file->hash);
+    putUint64(head, file->offset);
+    putUint64(head, file->size);
+    putUint32(head, (uint32_t)PackCompression::STORED);
+    putUint32(head, 0);
+  }
+
+  std::filesystem::path temporaryPath { argv[2] };
+  temporaryPath += ".tmp";
+
+  try {
+    std::ofstream out (temporaryPath, std::ios::binary | std::ios::trunc);
+    out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+    out.write((const char *)head.data(), head.size());
+
+    uint64_t position = head.size();
+    std::vector<char> buffer (1 << 20);
+    for (auto& file : files) {
+      std::fill(buffer.begin(), buffer.end(), 0);
+      out.write(buffer.data(), file.offset - position);
+
+      std::ifstream in (file.source, std::ios::binary);
+      in.exceptions(std::ifstream::badbit);
+
+      uint64_t remaining = file.size;
+      while (remaining) {
+        size_t count = std::min<uint64_t>(remaining, buffer.size());
+        in.read(buffer.data(), count);
+        if ((size_t)in.gcount() != count) {
+          throw std::ifstream::failure(file.name + " changed while packing");
+        }
+
+        out.write(buffer.data(), count);
+        remaining -= count;
+      }
+
+      position = file.offset + file.size;
+    }
+  } catch (std::exception& e) {
+    fprintf(stderr, "unable to write %s: %s\n", argv[2], e.what());
+    std::filesystem::remove(temporaryPath);
+    return 1;
+  }
+
+  std::filesystem::rename(temporaryPath, argv[2]);
+
+  printf("packed %zu files into %s\n", files.size(), argv[2]);
+
+  return 0;
+}